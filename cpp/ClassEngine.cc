@@ -21,6 +21,10 @@
 #include<sstream>
 #include<numeric>
 #include<cassert>
+#include <mutex>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 //#define DBUG
 
@@ -67,6 +71,8 @@ template string str(const unsigned long long &x);
 //----------------
 ClassEngine::ClassEngine(const ClassParams& pars): cl(0),dofree(true){
 
+  perturb_workspace_pool_init(&_workspace_pool);
+
   //prepare fp structure
   size_t n=pars.size();
   //
@@ -110,6 +116,8 @@ ClassEngine::ClassEngine(const ClassParams& pars): cl(0),dofree(true){
 
 ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file): cl(0),dofree(true){
 
+  perturb_workspace_pool_init(&_workspace_pool);
+
   struct file_content fc_precision;
   fc_precision.size = 0;
   //decode pre structure
@@ -128,6 +136,8 @@ ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file):
   for (size_t i=0;i<pars.size();i++){
     strcpy(fc_input.name[i],pars.key(i).c_str());
     strcpy(fc_input.value[i],pars.value(i).c_str());
+    //store
+    parNames.push_back(pars.key(i));
     if (pars.key(i)=="l_max_scalars") {
       istringstream strstrm(pars.value(i));
       strstrm >> _lmax;
@@ -135,7 +145,6 @@ ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file):
   }
   cout << __FILE__ << " : using lmax=" << _lmax <<endl;
   assert(_lmax>0);
-  
 
 
   //concatenate both
@@ -174,6 +183,7 @@ ClassEngine::~ClassEngine()
 
   //printFC();
   dofree && freeStructs();
+  perturb_workspace_pool_free(&_workspace_pool);
 
   delete [] cl;
 
@@ -183,7 +193,40 @@ ClassEngine::~ClassEngine()
 // Member functions --
 //-----------------
 bool ClassEngine::updateParValues(const std::vector<double>& par){
-  dofree && freeStructs();
+
+  _changed.clear();
+  for (size_t i=0;i<par.size();i++)
+    if (str(par[i])!=fc.value[i]) _changed.push_back(parNames[i]);
+
+  //if the previous model is still in memory, only rerun the modules
+  //that depend on the parameters that changed
+  if (dofree) {
+    enum computation_stage stage=cs_lensing,parameter_stage;
+    short recompute[_NUM_STAGES_];
+    for (size_t i=0;i<par.size();i++) {
+      if (str(par[i])!=fc.value[i]) {
+        input_parameter_stage(fc.name[i],&parameter_stage);
+        if (parameter_stage<stage) stage=parameter_stage;
+      }
+      strcpy(fc.value[i],str(par[i]).c_str());
+    }
+    if (_changed.empty()) {
+      for (int i=0;i<_NUM_STAGES_;i++) _recompute[i]=_FALSE_;
+      return true;
+    }
+    if (input_update(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&op,stage,recompute,_errmsg) == _FAILURE_) {
+      printf("\n\nError running input_update \n=>%s\n",_errmsg);
+      freeStructs();
+      dofree=false;
+      return false;
+    }
+    int status=computeCls(recompute);
+#ifdef DBUG
+    cout << "update par status=" << status << " succes=" << _SUCCESS_ << " from stage " << stage << endl;
+#endif
+    return (status==_SUCCESS_);
+  }
+
   for (size_t i=0;i<par.size();i++) {
     double val=par[i];
     strcpy(fc.value[i],str(val).c_str());
@@ -219,29 +262,33 @@ int ClassEngine::class_main(
 			    struct nonlinear * pnl,
 			    struct lensing * ple,
 			    struct output * pop,
+			    short * recompute,
 			    ErrorMsg errmsg) {
   
 
-  if (input_init(pfc,ppr,pba,pth,ppt,ptr,ppm,psp,pnl,ple,pop,errmsg) == _FAILURE_) {
+  if (recompute == NULL && input_init(pfc,ppr,pba,pth,ppt,ptr,ppm,psp,pnl,ple,pop,errmsg) == _FAILURE_) {
     printf("\n\nError running input_init_from_arguments \n=>%s\n",errmsg);
     dofree=false;
     return _FAILURE_;
   }
 
-  if (background_init(ppr,pba) == _FAILURE_) {
+  //input_update() keeps this pointer
+  if (recompute == NULL) ppt->workspace_pool = &_workspace_pool;
+
+  if ((recompute == NULL || recompute[cs_background] == _TRUE_) && background_init(ppr,pba) == _FAILURE_) {
     printf("\n\nError running background_init \n=>%s\n",pba->error_message);
     dofree=false;
     return _FAILURE_;
   }
 
-  if (thermodynamics_init(ppr,pba,pth) == _FAILURE_) {
+  if ((recompute == NULL || recompute[cs_thermodynamics] == _TRUE_) && thermodynamics_init(ppr,pba,pth) == _FAILURE_) {
     printf("\n\nError in thermodynamics_init \n=>%s\n",pth->error_message);
     background_free(&ba);
     dofree=false;
     return _FAILURE_;
   }
 
-  if (perturb_init(ppr,pba,pth,ppt) == _FAILURE_) {
+  if ((recompute == NULL || recompute[cs_perturbations] == _TRUE_) && perturb_init(ppr,pba,pth,ppt) == _FAILURE_) {
     printf("\n\nError in perturb_init \n=>%s\n",ppt->error_message);
     thermodynamics_free(&th);
     background_free(&ba);
@@ -249,7 +296,7 @@ int ClassEngine::class_main(
     return _FAILURE_;
   }
 
-  if (primordial_init(ppr,ppt,ppm) == _FAILURE_) {
+  if ((recompute == NULL || recompute[cs_primordial] == _TRUE_) && primordial_init(ppr,ppt,ppm) == _FAILURE_) {
     printf("\n\nError in primordial_init \n=>%s\n",ppm->error_message);
     perturb_free(&pt);
     thermodynamics_free(&th);
@@ -258,7 +305,7 @@ int ClassEngine::class_main(
     return _FAILURE_;
   }
 
-  if (nonlinear_init(ppr,pba,pth,ppt,ppm,pnl) == _FAILURE_)  {
+  if ((recompute == NULL || recompute[cs_nonlinear] == _TRUE_) && nonlinear_init(ppr,pba,pth,ppt,ppm,pnl) == _FAILURE_)  {
     printf("\n\nError in nonlinear_init \n=>%s\n",pnl->error_message);
     primordial_free(&pm);
     perturb_free(&pt);
@@ -268,7 +315,7 @@ int ClassEngine::class_main(
     return _FAILURE_;
   }
 
-  if (transfer_init(ppr,pba,pth,ppt,pnl,ptr) == _FAILURE_) {
+  if ((recompute == NULL || recompute[cs_transfer] == _TRUE_) && transfer_init(ppr,pba,pth,ppt,pnl,ptr) == _FAILURE_) {
     printf("\n\nError in transfer_init \n=>%s\n",ptr->error_message);
     nonlinear_free(&nl);
     primordial_free(&pm);
@@ -279,7 +326,7 @@ int ClassEngine::class_main(
     return _FAILURE_;
   }
 
-  if (spectra_init(ppr,pba,ppt,ppm,pnl,ptr,psp) == _FAILURE_) {
+  if ((recompute == NULL || recompute[cs_spectra] == _TRUE_) && spectra_init(ppr,pba,ppt,ppm,pnl,ptr,psp) == _FAILURE_) {
     printf("\n\nError in spectra_init \n=>%s\n",psp->error_message);
     transfer_free(&tr);
     nonlinear_free(&nl);
@@ -291,7 +338,7 @@ int ClassEngine::class_main(
     return _FAILURE_;
   }
 
-  if (lensing_init(ppr,ppt,psp,pnl,ple) == _FAILURE_) {
+  if ((recompute == NULL || recompute[cs_lensing] == _TRUE_) && lensing_init(ppr,ppt,psp,pnl,ple) == _FAILURE_) {
     printf("\n\nError in lensing_init \n=>%s\n",ple->error_message);
     spectra_free(&sp);
     transfer_free(&tr);
@@ -310,14 +357,16 @@ int ClassEngine::class_main(
 }
 
 
-int ClassEngine::computeCls(){
+int ClassEngine::computeCls(short * recompute){
 
 #ifdef DBUG
   cout <<"call computecls" << endl;
   //printFC();
 #endif
 
-  int status=this->class_main(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&op,_errmsg);
+  for (int i=0;i<_NUM_STAGES_;i++) _recompute[i] = (recompute==NULL ? _TRUE_ : recompute[i]);
+
+  int status=this->class_main(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&op,recompute,_errmsg);
 #ifdef DBUG
   cout <<"status=" << status << endl;
 #endif
@@ -325,6 +374,27 @@ int ClassEngine::computeCls(){
 
 }
 
+//the perturbation sources and transfer functions (often hundreds of MB)
+//are freed and allocated again with nearly the same sizes at each
+//update: raise the thresholds above which glibc returns memory to the
+//system, so that these blocks stay in the heap and are reused without
+//new page faults. Not called by the engine itself, since it holds for
+//the whole process
+#ifdef __GLIBC__
+static void raiseMallocThresholds(){
+  mallopt(M_MMAP_THRESHOLD,32*1024*1024);
+  mallopt(M_TRIM_THRESHOLD,1024*1024*1024);
+}
+#endif
+
+void
+ClassEngine::retainFreedMemory(){
+#ifdef __GLIBC__
+  static std::once_flag done;
+  std::call_once(done,raiseMallocThresholds);
+#endif
+}
+
 int
 ClassEngine::freeStructs(){
   
@@ -372,47 +442,84 @@ ClassEngine::freeStructs(){
   return _SUCCESS_;
 }
 
-double
-ClassEngine::getCl(Engine::cltype t,const long &l){
-
-  if (!dofree) throw out_of_range("no Cl available because CLASS failed");
-
-  if (output_total_cl_at_l(&sp,&le,&op,static_cast<double>(l),cl) == _FAILURE_){
-    cerr << ">>>fail getting Cl type=" << (int)t << " @l=" << l <<endl; 
-    throw out_of_range(sp.error_message);
-  }
-
-  double zecl=-1;
-
-  double tomuk=1e6*Tcmb();
-  double tomuk2=tomuk*tomuk;
+//index of type t in the tables of C_l's
+int
+ClassEngine::clIndex(Engine::cltype t) const {
 
   switch(t)
     {
     case TT:
-      (sp.has_tt==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_tt] : throw invalid_argument("no ClTT available");
-      break;
+      if (sp.has_tt==_TRUE_) return sp.index_ct_tt;
+      throw invalid_argument("no ClTT available");
     case TE:
-      (sp.has_te==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_te] : throw invalid_argument("no ClTE available");
-      break; 
+      if (sp.has_te==_TRUE_) return sp.index_ct_te;
+      throw invalid_argument("no ClTE available");
     case EE:
-      (sp.has_ee==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_ee] : throw invalid_argument("no ClEE available");
-      break;
+      if (sp.has_ee==_TRUE_) return sp.index_ct_ee;
+      throw invalid_argument("no ClEE available");
     case BB:
-      (sp.has_bb==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_bb] : throw invalid_argument("no ClBB available");
-      break;
+      if (sp.has_bb==_TRUE_) return sp.index_ct_bb;
+      throw invalid_argument("no ClBB available");
     case PP:
-      (sp.has_pp==_TRUE_) ? zecl=cl[sp.index_ct_pp] : throw invalid_argument("no ClPhi-Phi available");
-      break;
+      if (sp.has_pp==_TRUE_) return sp.index_ct_pp;
+      throw invalid_argument("no ClPhi-Phi available");
     case TP:
-      (sp.has_tp==_TRUE_) ? zecl=tomuk*cl[sp.index_ct_tp] : throw invalid_argument("no ClT-Phi available");
-      break;
+      if (sp.has_tp==_TRUE_) return sp.index_ct_tp;
+      throw invalid_argument("no ClT-Phi available");
     case EP:
-      (sp.has_ep==_TRUE_) ? zecl=tomuk*cl[sp.index_ct_ep] : throw invalid_argument("no ClE-Phi available");
-      break;
+      if (sp.has_ep==_TRUE_) return sp.index_ct_ep;
+      throw invalid_argument("no ClE-Phi available");
     }
-  
-  return zecl;
+  throw invalid_argument("unknown Cl type");
+}
+
+//the lensed and total tables at each integer l have the same columns
+//(index_lt_xx=index_ct_xx)
+ClassEngine::TableView
+ClassEngine::getClView(Engine::cltype t) const {
+
+  if (!dofree) throw out_of_range("no Cl available because CLASS failed");
+
+  TableView view;
+  int index_ct=clIndex(t);
+  if (le.has_lensed_cls==_TRUE_) {
+    view.data=le.cl_lens_dense+index_ct;
+    view.size=le.l_lensed_max+1;
+    view.stride=le.lt_size;
+  }
+  else {
+    view.data=sp.cl_tot_dense+index_ct;
+    view.size=sp.l_max_tot+1;
+    view.stride=sp.ct_size;
+  }
+  return view;
+}
+
+void
+ClassEngine::getCls(Engine::cltype t,unsigned lmax,double* out) const {
+
+  TableView view=getClView(t);
+  if (lmax>=view.size) throw out_of_range("Cl's only computed up to l="+str(view.size-1));
+
+  double tomuk=1e6*Tcmb();
+  double factor = (t==PP ? 1. : ((t==TP || t==EP) ? tomuk : tomuk*tomuk));
+
+  for (size_t l=0;l<=lmax;l++) out[l]=factor*view[l];
+}
+
+double
+ClassEngine::getCl(Engine::cltype t,const long &l){
+
+  TableView view=getClView(t);
+  if (l<0 || static_cast<size_t>(l)>=view.size) {
+    cerr << ">>>fail getting Cl type=" << (int)t << " @l=" << l <<endl; 
+    throw out_of_range("Cl's only computed up to l="+str(view.size-1));
+  }
+
+  double tomuk=1e6*Tcmb();
+  double factor = (t==PP ? 1. : ((t==TP || t==EP) ? tomuk : tomuk*tomuk));
+
+  return factor*view[l];
 
 }
 void 
@@ -428,15 +535,10 @@ ClassEngine::getCls(const std::vector<unsigned>& lvec, //input
   clbb.resize(lvec.size());
   
   for (size_t i=0;i<lvec.size();i++){
-    try{
-      cltt[i]=getCl(ClassEngine::TT,lvec[i]);
-      clte[i]=getCl(ClassEngine::TE,lvec[i]);
-      clee[i]=getCl(ClassEngine::EE,lvec[i]);
-      clbb[i]=getCl(ClassEngine::BB,lvec[i]);
-    }
-    catch(exception &e){
-      throw e;
-    }
+    cltt[i]=getCl(ClassEngine::TT,lvec[i]);
+    clte[i]=getCl(ClassEngine::TE,lvec[i]);
+    clee[i]=getCl(ClassEngine::EE,lvec[i]);
+    clbb[i]=getCl(ClassEngine::BB,lvec[i]);
   }
 
 }
@@ -467,20 +569,22 @@ ClassEngine::getLensing(const std::vector<unsigned>& lvec, //input
   return true;
 }
 
-
-double ClassEngine::get_f(double z)
+//all background quantities at z, in the workspace
+const double*
+ClassEngine::backgroundAtZ(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
+  if (_bgtable.size()<(size_t)ba.bg_size) _bgtable.resize(ba.bg_size);
 
-  //pvecback must be allocated 
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
+  if (background_at_z_vector(&ba,&z,1,ba.long_info,&_bgtable[0])==_FAILURE_)
+    throw out_of_range(ba.error_message);
 
-  //call to fill pvecback
-  background_at_tau(&ba,tau,ba.long_info,ba.inter_normal, &index, pvecback);
+  return &_bgtable[0];
+}
+
+double ClassEngine::get_f(double z)
+{
+  //all background quantities at z (no allocation)
+  const double *pvecback=backgroundAtZ(z);
 
 
 
@@ -494,19 +598,7 @@ double ClassEngine::get_f(double z)
 
 double ClassEngine::get_sigma8(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
   double sigma8 = 0.;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
-
-  //pvecback must be allocated 
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,ba.long_info,ba.inter_normal, &index, pvecback);
-  //background_at_tau(pba,tau,pba->long_info,pba->inter_normal,&last_index,pvecback);
   spectra_sigma(&ba,&pm,&sp,8./ba.h,z,&sigma8);
 
 #ifdef DBUG
@@ -527,17 +619,8 @@ double ClassEngine::get_Az(double z)
 
 double ClassEngine::get_Dv(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
-
-  //pvecback must be allocated 
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,ba.long_info,ba.inter_normal, &index, pvecback);
+  //all background quantities at z (no allocation)
+  const double *pvecback=backgroundAtZ(z);
 
 
   double H_z=pvecback[ba.index_bg_H];
@@ -558,17 +641,8 @@ double ClassEngine::get_Dv(double z)
 
 double ClassEngine::get_Fz(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
-
-  //pvecback must be allocated 
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,ba.long_info,ba.inter_normal, &index, pvecback);
+  //all background quantities at z (no allocation)
+  const double *pvecback=backgroundAtZ(z);
 
 
   double H_z=pvecback[ba.index_bg_H];
@@ -583,17 +657,8 @@ double ClassEngine::get_Fz(double z)
 
 double ClassEngine::get_Hz(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
-
-  //pvecback must be allocated 
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,ba.long_info,ba.inter_normal, &index, pvecback);
+  //all background quantities at z (no allocation)
+  const double *pvecback=backgroundAtZ(z);
 
 
   double H_z=pvecback[ba.index_bg_H];
@@ -603,19 +668,63 @@ double ClassEngine::get_Hz(double z)
 }
 
 
-double ClassEngine::get_Da(double z)
+void
+ClassEngine::get_background_at_z(const double* z, //input
+                                 size_t n,
+                                 int index_bg,
+                                 double* result)
+{
+  if (n==0) return;
+
+  //one line of background quantities per redshift, in the workspace
+  //(which only grows)
+  if (_bgtable.size()<n*ba.bg_size) _bgtable.resize(n*ba.bg_size);
+
+  if (background_at_z_vector(&ba,const_cast<double*>(z),n,ba.long_info,&_bgtable[0])==_FAILURE_)
+    throw out_of_range(ba.error_message);
+
+  for (size_t i=0;i<n;i++)
+    result[i]=_bgtable[i*ba.bg_size+index_bg];
+}
+
+void
+ClassEngine::get_background_at_z(const std::vector<double>& zvec, //input
+                                 int index_bg,
+                                 std::vector<double>& result)
+{
+  result.resize(zvec.size());
+  if (zvec.empty()) return;
+  get_background_at_z(&zvec[0],zvec.size(),index_bg,&result[0]);
+}
+
+void
+ClassEngine::get_Hz(const double* z, size_t n, double* Hz)
+{
+  get_background_at_z(z,n,ba.index_bg_H,Hz);
+}
+
+void
+ClassEngine::get_Da(const double* z, size_t n, double* Da)
+{
+  get_background_at_z(z,n,ba.index_bg_ang_distance,Da);
+}
+
+void
+ClassEngine::get_Hz(const std::vector<double>& zvec, std::vector<double>& Hz)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
+  get_background_at_z(zvec,ba.index_bg_H,Hz);
+}
 
-  //pvecback must be allocated 
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
+void
+ClassEngine::get_Da(const std::vector<double>& zvec, std::vector<double>& Da)
+{
+  get_background_at_z(zvec,ba.index_bg_ang_distance,Da);
+}
 
-  //call to fill pvecback
-  background_at_tau(&ba,tau,ba.long_info,ba.inter_normal, &index, pvecback);
+double ClassEngine::get_Da(double z)
+{
+  //all background quantities at z (no allocation)
+  const double *pvecback=backgroundAtZ(z);
 
 
   double H_z=pvecback[ba.index_bg_H];
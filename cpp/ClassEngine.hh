@@ -68,6 +68,15 @@ class ClassEngine : public Engine
   friend class ClassParams;
 
 public:
+  //view onto a table of CLASS, without copy: element i is data[i*stride]
+  //valid until the next updateParValues()
+  struct TableView {
+    const double* data;
+    size_t size;
+    size_t stride;
+    inline double operator[](size_t i) const {return data[i*stride];}
+  };
+
   //constructors
   ClassEngine(const ClassParams& pars);
   //with a class .pre file
@@ -78,8 +87,20 @@ public:
   ~ClassEngine();
 
   //modfiers: _FAILURE_ returned if CLASS pb:
+  //only the modules depending on the parameters that changed are re-run
   bool updateParValues(const std::vector<double>& par);
 
+  //after the last computation: names of the parameters that changed,
+  //and whether a given module was re-run (all of them the first time)
+  inline const std::vector<std::string>& changedParameters() const {return _changed;}
+  inline bool recomputed(enum computation_stage stage) const {return _recompute[stage]==_TRUE_;}
+
+  //optional, for a process running many updates: keep freed tables in
+  //the heap (glibc only), to be reused by the next update. This changes
+  //the malloc settings of the whole process; only the first call has an
+  //effect, and it may be done from any thread
+  static void retainFreedMemory();
+
 
   //get value at l ( 2<l<lmax): in units = (micro-K)^2
   //don't call if FAILURE returned previously
@@ -98,6 +119,14 @@ public:
 	      std::vector<double>& cltphi, 
 	      std::vector<double>& clephi);
 
+  //bulk access to the C_l's computed once for all at each integer l
+  //(lensed ones if lensing was requested), for l=0...size-1 (zero for l<2)
+  //view in CLASS units: dimensionless (multiply by (1e6*Tcmb())^2 for
+  //TT,TE,EE,BB or by 1e6*Tcmb() for TP,EP to get the units of getCl)
+  TableView getClView(Engine::cltype t) const;
+  //in the units of getCl, for l=0...lmax, written in out[0...lmax]
+  void getCls(Engine::cltype t,unsigned lmax,double* out) const;
+
  //for BAO
   inline double z_drag() const {return th.z_d;}
   inline double rs_drag() const {return th.rs_d;} 
@@ -111,6 +140,16 @@ public:
   double get_Hz(double z);
   double get_Az(double z);
 
+  //same for a whole vector of redshifts, sorted or not (one call to background_at_z_vector)
+  void get_Da(const std::vector<double>& zvec, std::vector<double>& Da);
+  void get_Hz(const std::vector<double>& zvec, std::vector<double>& Hz);
+  void get_background_at_z(const std::vector<double>& zvec, int index_bg, std::vector<double>& result);
+  //same for n redshifts z[0...n-1], written in result[0...n-1] (no allocation
+  //once the internal workspace is large enough)
+  void get_Da(const double* z, size_t n, double* Da);
+  void get_Hz(const double* z, size_t n, double* Hz);
+  void get_background_at_z(const double* z, size_t n, int index_bg, double* result);
+
   double getTauReio() const {return th.tau_reio;}
 
   //may need that
@@ -135,16 +174,22 @@ private:
   struct nonlinear nl;        /* for non-linear spectra */
   struct lensing le;          /* for lensed spectra */
   struct output op;           /* for output files */
+  struct perturb_workspace_pool _workspace_pool; /* perturbation workspaces kept between updates */
 
   ErrorMsg _errmsg;            /* for error messages */
   double * cl;
 
+  //workspace of the background getters, one line of bg_size values per redshift
+  std::vector<double> _bgtable;
+  const double* backgroundAtZ(double z);
+  int clIndex(Engine::cltype t) const;
+
   //helpers
   bool dofree;
   int freeStructs();
 
   //call once /model
-  int computeCls();
+  int computeCls(short * recompute=NULL);
 
   int class_main(
 		 struct file_content *pfc,
@@ -158,10 +203,15 @@ private:
 		 struct nonlinear * pnl,
 		 struct lensing * ple,
 		 struct output * pop,
+		 short * recompute,
 		 ErrorMsg errmsg);
   //parnames
   std::vector<std::string> parNames;
 
+  //bookkeeping of the last update
+  std::vector<std::string> _changed;
+  short _recompute[_NUM_STAGES_];
+
 protected:
  
   
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------
+//
+// Description:
+// 	class ClassEnginePool : see header file (ClassEnginePool.hh) for description.
+//
+//------------------------------------------------------------------------
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "ClassEnginePool.hh"
+// C++
+//--------------------
+#include<algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+//---------------
+// Constructors --
+//----------------
+ClassEnginePool::ClassEnginePool(const ClassParams& pars,unsigned size,int threads_per_engine):
+  _pars(pars),_size(max(size,1u)),_threads(threads_per_engine),_creating(0),_running(0){
+
+  //nested OpenMP loops (perturbations, transfer...) of the engines
+  //running together should not use more threads than available
+  if (_threads<=0) {
+#ifdef _OPENMP
+    _threads=max(omp_get_max_threads()/(int)_size,1);
+#else
+    _threads=1;
+#endif
+  }
+}
+
+//--------------
+// Destructor --
+//--------------
+ClassEnginePool::~ClassEnginePool(){
+
+  unique_lock<mutex> lock(_mutex);
+  while (_running>0 || _creating>0) _changed.wait(lock);
+
+  for (size_t i=0;i<_engines.size();i++) delete _engines[i];
+}
+
+//-----------------
+// Member functions --
+//-----------------
+ClassEnginePool::Lease::Lease(ClassEnginePool& p,const std::vector<double>& par):pool(p),engine(0){
+
+#ifdef _OPENMP
+  //for the parallel regions started by this thread only
+  omp_set_num_threads(pool._threads);
+#endif
+
+  try {
+    engine=pool.acquire(par);
+  }
+  catch (...) {
+    pool.release(0);
+    throw;
+  }
+}
+
+ClassEnginePool::Lease::~Lease(){
+  pool.release(engine);
+}
+
+//free engine, or new one if the pool is not full yet
+ClassEngine* ClassEnginePool::acquire(const std::vector<double>& par){
+
+  unique_lock<mutex> lock(_mutex);
+  while (_free.empty() && _engines.size()+_creating>=_size) _changed.wait(lock);
+
+  if (!_free.empty()) {
+    ClassEngine* engine=_free.back();
+    _free.pop_back();
+    return engine;
+  }
+
+  //create it outside the lock: the constructor runs a whole computation
+  _creating++;
+  lock.unlock();
+
+  ClassParams pars;
+  for (unsigned i=0;i<_pars.size();i++) {
+    if (i<par.size()) pars.add(_pars.key(i),par[i]);
+    else pars.add(_pars.key(i),_pars.value(i));
+  }
+
+  ClassEngine* engine(0);
+  try {
+    engine=new ClassEngine(pars);
+  }
+  catch (...) {
+    lock.lock();
+    _creating--;
+    _changed.notify_all();
+    throw;
+  }
+
+  lock.lock();
+  _creating--;
+  _engines.push_back(engine);
+  return engine;
+}
+
+//end of a computation, giving back its engine (if any)
+void ClassEnginePool::release(ClassEngine* engine){
+
+  lock_guard<mutex> lock(_mutex);
+  if (engine!=0) _free.push_back(engine);
+  _running--;
+  _changed.notify_all();
+}
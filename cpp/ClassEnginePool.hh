@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------------
+//
+// Description:
+// 	class ClassEnginePool :
+// a fixed number of independent ClassEngine's, used concurrently by
+// asynchronous computations (requires C++11)
+//
+// ClassEngine itself is not thread-safe: each computation borrows one
+// engine of the pool for its whole duration. The tables derived from
+// the precision parameters that CLASS keeps between runs (Bessel
+// functions when 'hyper cache directory' is set, ncdm quadratures,
+// lensing Wigner functions, HyRec tables...) are shared by all engines
+// of the process, and protected inside CLASS.
+//
+//------------------------------------------------------------------------
+
+#ifndef ClassEnginePool_hh
+#define ClassEnginePool_hh
+
+#include"ClassEngine.hh"
+//STD
+#include<vector>
+#include<future>
+#include<mutex>
+#include<condition_variable>
+#include<stdexcept>
+#include<utility>
+
+///////////////////////////////////////////////////////////////////////////
+class ClassEnginePool
+{
+
+public:
+  //size engines at most, each created at its first use with pars (the
+  //first values being replaced by those of the first computation).
+  //threads_per_engine: OpenMP threads of each computation; 0 divides
+  //the threads available (omp_get_max_threads()) between the engines
+  ClassEnginePool(const ClassParams& pars,unsigned size,int threads_per_engine=0);
+
+  //waits for the computations still running
+  ~ClassEnginePool();
+
+  //runs asynchronously updateParValues(par) on a free engine (waiting
+  //for one if all are busy), then f(engine), and returns the result of
+  //f. The future throws std::runtime_error if CLASS failed.
+  template<typename F>
+  std::future<decltype(std::declval<F>()(std::declval<ClassEngine&>()))>
+  submit(const std::vector<double>& par,F f){
+    typedef decltype(f(std::declval<ClassEngine&>())) result_type;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _running++;
+    }
+    try {
+      return std::async(std::launch::async,[this,par,f]() -> result_type {
+          Lease lease(*this,par);
+          if (!lease.engine->updateParValues(par))
+            throw std::runtime_error("CLASS failed for these parameters");
+          return f(*lease.engine);
+        });
+    }
+    catch (...) {
+      release(0);
+      throw;
+    }
+  }
+
+  inline unsigned size() const {return _size;}
+  inline int threadsPerEngine() const {return _threads;}
+
+private:
+  //engine borrowed for one computation, given back by the destructor
+  struct Lease {
+    Lease(ClassEnginePool& pool,const std::vector<double>& par);
+    ~Lease();
+    ClassEnginePool& pool;
+    ClassEngine* engine;
+  };
+
+  ClassEngine* acquire(const std::vector<double>& par);
+  void release(ClassEngine* engine);
+
+  ClassParams _pars;
+  unsigned _size;
+  int _threads;
+
+  std::vector<ClassEngine*> _engines; //all engines created so far
+  std::vector<ClassEngine*> _free;    //engines not used by a computation
+  unsigned _creating;                 //engines being created
+  unsigned _running;                  //computations submitted and not finished
+
+  std::mutex _mutex;
+  std::condition_variable _changed;
+
+  ClassEnginePool(const ClassEnginePool&);
+  ClassEnginePool& operator=(const ClassEnginePool&);
+};
+
+#endif
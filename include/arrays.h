@@ -10,6 +10,45 @@
 #define _SPLINE_NATURAL_ 0 /**< natural spline: ddy0=ddyn=0 */
 #define _SPLINE_EST_DERIV_ 1 /**< spline with estimation of first derivative on both edges */
 
+#define _SPLINE_PARALLEL_MIN_SIZE_ 100000 /**< minimum number of elements of a table for splining its columns in parallel */
+#define _SMOOTH_PARALLEL_MIN_SIZE_ 100000 /**< minimum number of terms summed by array_smooth() for smoothing in parallel */
+
+#define _LOOKUP_MAX_BINS_PER_LINE_ 8 /**< maximum number of bins of an array_lookup grid per line of the indexed array */
+
+/**
+ * Uniform grid in a variable u (a growing function of the argument x
+ * of some monotonic array), giving for each bin the index of the
+ * array line where it starts. The interval containing any x is then
+ * found arithmetically from u(x), up to a few steps from this index
+ * (see array_lookup_init() and array_interpolate_spline_lookup()).
+ */
+
+struct array_lookup {
+
+  int n_bins;     /**< number of bins of the uniform grid (0 if not initialized) */
+  double u_min;   /**< value of u at the beginning of the first bin */
+  double inv_du;  /**< inverse width of each bin */
+  int * index;    /**< index[j]: last line i such that u_array[i] <= u_min+j/inv_du (NULL if not initialized) */
+
+};
+
+/**
+ * Grid of an interpolation in x (growing or decreasing), with the
+ * width of each interval computed once by array_interpolation_init().
+ * The tables interpolated on this grid are passed to each evaluation,
+ * and the position of the previous point (hunt cursor) is kept by
+ * each caller, so that the grid can be shared between threads.
+ */
+
+struct array_interpolation {
+
+  double * x_array;    /**< values of x on each line (not owned) */
+  int n_lines;         /**< number of lines */
+  short growing;       /**< _TRUE_ if x_array grows with the line index */
+  double * h;          /**< h[i] = x_array[i+1]-x_array[i] (NULL: computed at each evaluation) */
+
+};
+
 /**
  * Boilerplate for C++
  */
@@ -182,6 +221,13 @@ int array_integrate_all_trapzd_or_spline(
 		   double * result,
 		   ErrorMsg errmsg);
 
+int array_integrate_all_trapzd_or_spline_weights(
+                                                 double * x,
+                                                 int n_lines,
+                                                 int index_start_spline,
+                                                 double * w,
+                                                 ErrorMsg errmsg);
+
   int array_integrate_spline_table_line_to_line(
 						double * x_array,
 						int n_lines,
@@ -230,6 +276,49 @@ int array_integrate_all_trapzd_or_spline(
 			int result_size,
 			ErrorMsg errmsg); /** from 1 to n_columns */
 
+  int array_interpolation_init(
+                               double * x_array,
+                               int n_lines,
+                               struct array_interpolation * pint,
+                               ErrorMsg errmsg);
+
+  int array_interpolation_view(
+                               double * x_array,
+                               int n_lines,
+                               struct array_interpolation * pint);
+
+  int array_interpolation_free(
+                               struct array_interpolation * pint);
+
+  int array_interpolation_locate(
+                                 struct array_interpolation * pint,
+                                 double x,
+                                 int * last_index,
+                                 double * weight,
+                                 ErrorMsg errmsg);
+
+  int array_interpolation_evaluate(
+                                   struct array_interpolation * pint,
+                                   double * __restrict__ array,
+                                   double * __restrict__ array_splined,
+                                   int n_columns,
+                                   int inf,
+                                   double b,
+                                   double * __restrict__ result,
+                                   int result_size);
+
+  int array_interpolation_at_points(
+                                    struct array_interpolation * pint,
+                                    double * array,
+                                    double * array_splined,
+                                    int n_columns,
+                                    double * x,
+                                    int n_points,
+                                    int * last_index,
+                                    double * result,
+                                    int result_size,
+                                    ErrorMsg errmsg);
+
   int array_interpolate_spline(
 			       double * __restrict__ x_array,
 			       int n_lines,
@@ -242,6 +331,30 @@ int array_integrate_all_trapzd_or_spline(
 			       int result_size, /** from 1 to n_columns */
 			       ErrorMsg errmsg);
 
+  int array_lookup_init(
+                        double * u_array,
+                        int n_lines,
+                        int max_bins,
+                        struct array_lookup * plookup,
+                        ErrorMsg errmsg);
+
+  int array_lookup_free(
+                        struct array_lookup * plookup);
+
+  int array_interpolate_spline_lookup(
+                                      struct array_lookup * plookup,
+                                      double * __restrict__ x_array,
+                                      int n_lines,
+                                      double * __restrict__ array,
+                                      double * __restrict__ array_splined,
+                                      int n_columns,
+                                      double x,
+                                      double u,
+                                      int * __restrict__ last_index,
+                                      double * __restrict__ result,
+                                      int result_size, /** from 1 to n_columns */
+                                      ErrorMsg errmsg);
+
   int array_interpolate_linear(
 			       double * x_array,
 			       int n_lines,
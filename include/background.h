@@ -105,6 +105,7 @@ struct background
   double * ncdm_psd_parameters;         /**< list of parameters for specifying/modifying
                                              ncdm p.s.d.'s, to be customized for given model
                                              (could be e.g. mixing angles) */
+  int ncdm_psd_parameters_size;         /**< number of entries in ncdm_psd_parameters */
   /* end of parameters for analytical ncdm p-s-d */
 
   /* the following parameters help to define tabulated ncdm p-s-d passed in file */
@@ -212,6 +213,15 @@ struct background
 
   //@}
 
+  /** @name - uniform grids for finding positions in the above tables without bisection (index set to NULL when not used) */
+
+  //@{
+
+  struct array_lookup tau_lookup; /**< uniform grid in \f$ \ln \tau \f$ indexing tau_table */
+  struct array_lookup z_lookup;   /**< uniform grid in \f$ -\ln(1+z) \f$ indexing z_table */
+
+  //@}
+
 
   /** @name - all indices for the vector of background quantities to be integrated (=bi)
    *
@@ -282,6 +292,19 @@ struct background
 
   //@}
 
+  /** @name - structure-of-arrays copy of the background quadratures of all ncdm species, used by background_ncdm_momenta_all() (NULL when not allocated) */
+
+  //@{
+
+  int ncdm_bg_size_tot;  /**< total number of background momenta of all species */
+  int * ncdm_bg_offset;  /**< ncdm_bg_offset[n_ncdm]: index of the first momentum of each species in the arrays below */
+  double * ncdm_bg_q2;   /**< \f$ q^2 \f$ at each momentum */
+  double * ncdm_bg_w_q2; /**< \f$ w q^2 \f$ */
+  double * ncdm_bg_w_q4; /**< \f$ w q^4/3 \f$ */
+  double * ncdm_bg_w_q6; /**< \f$ w q^6/3 \f$ */
+
+  //@}
+
   /**
    *@name - some flags needed for calling background functions
    */
@@ -307,6 +330,8 @@ struct background
 
   short background_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  struct class_profile profile; /**< resources used by background_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
@@ -330,6 +355,36 @@ struct background_parameters_and_workspace {
  * temporary parameters and workspace passed to phase space distribution function
  */
 
+/**
+ * maximum number of ncdm quadratures kept in the process-level cache
+ * of background_ncdm_init()
+ */
+
+#define _NCDM_QUADRATURE_CACHE_SIZE_ 16
+
+/**
+ * Quadrature of one ncdm species, as computed by
+ * background_ncdm_quadrature(), together with the inputs on which it
+ * depends (see background_ncdm_quadrature_key()). A process-level
+ * cache of such entries allows repeated runs to skip the adaptive
+ * construction of the quadratures.
+ */
+
+struct ncdm_quadrature {
+
+  int key_size;        /**< size of key */
+  double * key;        /**< all inputs of the quadrature */
+  int q_size;          /**< number of momenta for the perturbations */
+  double * q;          /**< momenta for the perturbations */
+  double * w;          /**< weights for the perturbations */
+  double * dlnf0_dlnq; /**< logarithmic derivative of the p.s.d. at each q */
+  int q_size_bg;       /**< number of momenta for the background */
+  double * q_bg;       /**< momenta for the background */
+  double * w_bg;       /**< weights for the background */
+  int last_use;        /**< value of the lookup counter when this entry was last used */
+
+};
+
 struct background_parameters_for_distributions {
 
   /* structures containing fixed input parameters (indices, ...) */
@@ -380,6 +435,29 @@ extern "C" {
 			  double * tau
 			  );
 
+  int background_at_tau_vector(
+                               struct background *pba,
+                               double * tau,
+                               int tau_size,
+                               short return_format,
+                               double * pvecback_table
+                               );
+
+  int background_tau_of_z_vector(
+                                 struct background *pba,
+                                 double * z,
+                                 int z_size,
+                                 double * tau
+                                 );
+
+  int background_at_z_vector(
+                             struct background *pba,
+                             double * z,
+                             int z_size,
+                             short return_format,
+                             double * pvecback_table
+                             );
+
   int background_init(
 		      struct precision *ppr,
 		      struct background *pba
@@ -389,6 +467,10 @@ extern "C" {
 		      struct background *pba
 		      );
 
+  int background_free_noinput(
+                              struct background *pba
+                              );
+
   int background_free_input(
                             struct background *pba
                             );
@@ -414,6 +496,36 @@ extern "C" {
 			    struct background *pba
 			    );
 
+  int background_ncdm_quadrature(
+                                 struct precision *ppr,
+                                 struct background *pba,
+                                 struct background_parameters_for_distributions * pbadist,
+                                 int k
+                                 );
+
+  int background_ncdm_quadrature_key(
+                                     struct precision *ppr,
+                                     struct background *pba,
+                                     struct background_parameters_for_distributions * pbadist,
+                                     double ** key,
+                                     int * key_size
+                                     );
+
+  int background_ncdm_quadrature_cache_get(
+                                           struct background *pba,
+                                           int k,
+                                           double * key,
+                                           int key_size,
+                                           short * found
+                                           );
+
+  int background_ncdm_quadrature_cache_put(
+                                           struct background *pba,
+                                           int k,
+                                           double * key,
+                                           int key_size
+                                           );
+
 
   int background_ncdm_momenta(
                              double * qvec,
@@ -429,6 +541,18 @@ extern "C" {
 			     double * pseudo_p
                              );
 
+  int background_ncdm_batch_init(
+                                 struct background *pba
+                                 );
+
+  int background_ncdm_momenta_all(
+                                  struct background *pba,
+                                  double z,
+                                  double * rho,
+                                  double * p,
+                                  double * pseudo_p
+                                  );
+
   int background_ncdm_M_from_Omega(
 				    struct precision *ppr,
 				    struct background *pba,
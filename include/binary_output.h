@@ -0,0 +1,59 @@
+/**
+ * definitions for module binary_output.c
+ */
+
+#ifndef __BINARY_OUTPUT__
+#define __BINARY_OUTPUT__
+
+#include "common.h"
+#include <stdint.h>
+
+/**
+ * Layout of the binary files (C_l's, P(k)'s and transfer functions
+ * written with format = binary, perturbations streamed with 'stream
+ * perturbations = yes'). All numbers are little-endian:
+ *
+ * - 8 characters _BINARY_OUTPUT_MAGIC_ (no terminating null character)
+ * - int32: _BINARY_OUTPUT_VERSION_
+ * - int32: number of rows, then int32: number of columns
+ * - int32: length n of the description, then n characters
+ * - int32: length m of the column titles, then m characters (each title followed by a tab)
+ * - rows*columns float64 values, row after row
+ *
+ * Columns follow the definitions of the class format.
+ */
+
+#define _BINARY_OUTPUT_MAGIC_ "CLASSBIN"
+#define _BINARY_OUTPUT_VERSION_ 1
+
+/**************************************************************/
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int binary_output_header(
+                           FILE * out,
+                           char * description,
+                           char * titles,
+                           int rows,
+                           int columns,
+                           ErrorMsg error_message
+                           );
+
+  int binary_output_write(
+                          FILE * out,
+                          void * data,
+                          size_t item_size,
+                          int count,
+                          ErrorMsg error_message
+                          );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,5 +30,6 @@
 #include "spectra.h"
 #include "lensing.h"
 #include "output.h"
+#include "driver.h"
 
 #endif
@@ -12,6 +12,10 @@
 #include "omp.h"
 #endif
 
+#ifdef WITH_MPI
+#include "mpi.h"
+#endif
+
 #ifndef __COMMON__
 #define __COMMON__
 
@@ -60,6 +64,21 @@ typedef char FileName[_FILENAMESIZE_];
 
 #define _DELIMITER_ "\t" /**< character used for delimiting titles in the title strings */
 
+#ifdef __GNUC__
+#define _ALWAYS_INLINE_ inline __attribute__((always_inline)) /**< for functions that must be inlined in all callers, e.g. to be specialised for constant arguments */
+#else
+#define _ALWAYS_INLINE_ inline
+#endif
+
+/* Kernels marked with _TARGET_CLONES_ are compiled for several
+   instruction sets, the best one for the running CPU being selected at
+   load time; elsewhere they are compiled once for the default target. */
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && defined(__x86_64__) && defined(__linux__)
+#define _TARGET_CLONES_ __attribute__((target_clones("arch=skylake-avx512","arch=haswell","default")))
+#else
+#define _TARGET_CLONES_
+#endif
+
 
 
 #ifndef __CLASSDIR__
@@ -176,6 +195,91 @@ int get_number_of_titles(char * titlestring);
   }                                                                                                              \
 }
 
+// First touch
+
+/**
+ * Ways in which class_first_touch() places the pages of a large table
+ * on the NUMA nodes of the threads. Operating systems usually put a
+ * page on the node of the thread writing to it first: a table filled
+ * or zeroed by a single thread ends up on one socket, and all other
+ * threads read it across the interconnect.
+ */
+
+enum first_touch_policy {
+  ft_none,      /**< pages left to the thread writing them first */
+  ft_block,     /**< each slab of the table split in contiguous blocks of pages, one per thread, like a static schedule */
+  ft_interleave /**< pages of the whole table dealt out to the threads in turn */
+};
+
+void class_first_touch(void * pointer, size_t slab_number, size_t slab_size, int policy);
+
+// Profiling
+
+#ifdef CLASS_PAPI
+
+/**
+ * Kernels in which hardware events are counted with PAPI, when the code
+ * is compiled with -DCLASS_PAPI (option PAPI of the Makefile). Each
+ * kernel is enclosed between class_kernel_start() and class_kernel_stop().
+ */
+
+enum class_kernel {
+  kernel_perturb_derivs,        /**< perturb_derivs() */
+  kernel_transfer_integrate,    /**< transfer_integrate() and transfer_integrate_l_block() */
+  kernel_spectra_compute_cl,    /**< spectra_compute_cl() */
+  kernel_lensing_correlation,   /**< lensed correlation functions and their Legendre transforms in lensing_init() */
+  kernel_sp_lusolve,            /**< sp_lusolve() */
+  _CLASS_KERNELS_               /**< number of kernels */
+};
+
+#define _CLASS_EVENTS_ 5        /**< events counted: cycles, instructions, L1 data cache misses, last level cache misses, double precision operations */
+#define _CLASS_EVENT_THREADS_ 32 /**< threads counted separately (the next ones are added to the last) */
+
+extern const char * class_kernel_name[_CLASS_KERNELS_];
+extern const char * class_event_name[_CLASS_EVENTS_];
+
+void class_kernel_count_start(enum class_kernel kernel);
+void class_kernel_count_stop(enum class_kernel kernel);
+int class_event_available(int index_event);
+
+#define class_kernel_start(kernel) class_kernel_count_start(kernel)
+#define class_kernel_stop(kernel) class_kernel_count_stop(kernel)
+
+#else
+
+#define class_kernel_start(kernel)
+#define class_kernel_stop(kernel)
+
+#endif
+
+/**
+ * Resources used by the initialisation of one module. Each *_init()
+ * function calls class_profile_start() on entry and class_profile_stop()
+ * when it succeeds, with the class_profile of its own structure. In
+ * between, the fields hold the negated values at the start. Modules
+ * initialised in two steps (see driver.h) call class_profile_resume()
+ * at the beginning of the second one, so that the time spent between
+ * the two steps is not counted.
+ */
+
+struct class_profile {
+
+  double wall_time;       /**< wall-clock time spent in the module, in seconds */
+  double cpu_time;        /**< CPU time of the process spent in the module (summed over threads), in seconds */
+  double peak_memory;     /**< peak resident memory of the process at the end of the module, in bytes */
+  double memory_increase; /**< increase of this peak during the module, in bytes */
+
+#ifdef CLASS_PAPI
+  long long event_count[_CLASS_EVENT_THREADS_][_CLASS_KERNELS_][_CLASS_EVENTS_]; /**< hardware events counted in each kernel by each thread during the module, event_count[index_thread][kernel][index_event] */
+  int event_threads;      /**< number of threads for which events have been counted so far */
+#endif
+
+};
+
+void class_profile_start(struct class_profile * pprof);
+void class_profile_stop(struct class_profile * pprof);
+void class_profile_resume(struct class_profile * pprof);
+
 // Testing
 
 #define class_test_message(err_out,extra,args...) {                                                              \
@@ -334,7 +438,7 @@ enum pk_def {
  * Different ways to present output files
  */
 
-enum file_format {class_format,camb_format};
+enum file_format {class_format,camb_format,binary_format};
 
 /**
  * All precision parameters.
@@ -365,6 +469,13 @@ struct precision
    */
   double tol_background_integration;
 
+  /**
+   * if true, find positions in the background and thermodynamics
+   * tables through uniform grids (in \f$ \ln \tau \f$, \f$ \ln a \f$ and
+   * \f$ z \f$) rather than by bisection, with identical results
+   */
+  short uniform_grid_lookup;
+
 
   /**
    * parameter controlling how deep inside radiation domination must the
@@ -405,6 +516,13 @@ struct precision
    */
   double tol_ncdm_bg;
 
+  /**
+   * if true, keep the ncdm quadratures in a process-level cache, so
+   * that later runs with the same p.s.d. and tolerances skip their
+   * construction
+   */
+  short ncdm_quadrature_cache;
+
   /**
    * parameter controlling how relativistic must non-cold relics be at
    * initial time
@@ -436,6 +554,8 @@ struct precision
 
   int recfast_Nz0;               /**< number of integration steps */
   double tol_thermo_integration; /**< precision of each integration step */
+  enum evolver_type recfast_evolver; /**< which evolver integrates the full RECFAST equations, once hydrogen recombination has started: rk restarts the Runge-Kutta integrator at each of the recfast_Nz0 steps, ndf15 integrates the whole phase at once with the stiff evolver, with output at the same redshifts */
+  double tol_thermo_integration_ndf15; /**< relative tolerance of the stiff evolver when recfast_evolver=ndf15 */
 
   /* He fudge parameters from recfast 1.4 */
 
@@ -479,6 +599,7 @@ struct precision
   FileName hyrec_R_inf_file;
   FileName hyrec_two_photon_tables_file;
 /* @endcond */
+  FileName hyrec_tables_binary_file; /**< if not empty, binary copy of the three HyRec tables above, read instead of them when it exists and written otherwise */
   /* - for reionization */
 
   double reionization_z_start_max; /**< maximum redshift at which reionization should start. If not, return an error. */
@@ -498,6 +619,19 @@ struct precision
 
   enum evolver_type evolver; /**< which type of evolver for integrating perturbations (Runge-Kutta? Stiff?...) */
 
+  int perturb_rk_dense_output; /**< if set to _TRUE_, the Runge-Kutta evolver (evolver=0) does not stop at each time where sources are sampled, but interpolates there within its steps (dense output): its steps then only depend on the time scale and on tol_perturb_integration, which should be lowered by about ten for the same accuracy */
+
+  int perturb_analytic_jacobian; /**< if set to _TRUE_, the stiff evolver gets the Jacobian of the perturbation equations from perturb_jacobian(), using their linearity and the sparse structure of the Boltzmann hierarchies, instead of estimating it by finite differences. Off by default: the integration is faster, but the spectra change at the level of the integration tolerance (up to a few 1e-5 for the TT C_l's) */
+
+  int perturb_specialised_derivs; /**< if set to _TRUE_, perturb_derivs() uses a copy of the perturbation equations specialised for the model class (see enum derivs_kernels) when there is one. Off by default: with -ffast-math the specialised copies are compiled with a different order of operations, which moves T(k) by a few 1e-4 and some C_l's by up to 1e-2 near their zero crossings */
+
+  int perturb_cost_scheduling; /**< if set to _TRUE_, wavenumbers are distributed to threads by decreasing estimated cost (longest job first) instead of simply backwards in k */
+
+  int perturb_task_pool; /**< if set to _TRUE_, all modes, initial conditions and wavenumbers are distributed to threads in a single parallel region; otherwise, the modes are integrated one after the other */
+
+  int perturb_sources_tile_tau; /**< number of values of tau in each tile of the source tables; if zero, the tables are not tiled and stored as [index_tau*k_size+index_k] */
+  int perturb_sources_tile_k; /**< number of values of k in each tile of the source tables; if zero, the tables are not tiled */
+
   double k_min_tau0; /**< number defining k_min for the computation of Cl's and P(k)'s (dimensionless): (k_min tau_0), usually chosen much smaller than one */
 
   double k_max_tau0_over_l_max; /**< number defining k_max for the computation of Cl's (dimensionless): (k_max tau_0)/l_max, usually chosen around two */
@@ -506,6 +640,7 @@ struct precision
   double k_step_super; /**< step in k space, in units of one period of acoustic oscillation at decoupling, for scales above sound horizon at decoupling */
   double k_step_transition; /**< dimensionless number regulating the transition from 'sub' steps to 'super' steps. Decrease for more precision. */
   double k_step_super_reduction; /**< the step k_step_super is reduced by this amount in the k-->0 limit (below scale of Hubble and/or curvature radius) */
+  double k_step_tensors_factor; /**< for tensor modes, the steps k_step_sub and k_step_super are multiplied by this factor (default 1): the tensor sources vary more slowly with k than the scalar ones, and can be sampled more coarsely by setting it to 2 */
 
   double k_per_decade_for_pk; /**< if values needed between kmax inferred from k_oscillations and k_kmax_for_pk, this gives the number of k per decade outside the BAO region*/
 
@@ -515,6 +650,12 @@ struct precision
 
   double k_bao_width; /**< in ln(k) space, width of the BAO region where sampling is finer: this number gives roughly the number of BAO oscillations well resolved on both sides of the central value (recommended: 4, i.e. finest sampling from before first up to 3+4=7th peak) */
 
+  int k_adaptive_sampling; /**< if set to _TRUE_, the wavenumbers defined by the above parameters are only candidates: perturbations are first integrated on a coarse subset of them, and the sampling is refined only where the source functions cannot be interpolated in k to the accuracy k_adaptive_tol */
+
+  int k_adaptive_coarsening; /**< with k_adaptive_sampling, the first pass integrates one candidate wavenumber out of k_adaptive_coarsening */
+
+  double k_adaptive_tol; /**< with k_adaptive_sampling, tolerance on the error made when interpolating the source functions in k, relative to their largest value over the neighbouring wavenumbers */
+
   double start_small_k_at_tau_c_over_tau_h; /**< largest wavelengths start being sampled when universe is sufficiently opaque. This is quantified in terms of the ratio of thermo to hubble time scales, \f$ \tau_c/\tau_H \f$. Start when start_largek_at_tau_c_over_tau_h equals this ratio. Decrease this value to start integrating the wavenumbers earlier in time. */
 
   double start_large_k_at_tau_h_over_tau_k;  /**< largest wavelengths start being sampled when mode is sufficiently outside Hubble scale. This is quantified in terms of the ratio of hubble time scale to wavenumber time scale, \f$ \tau_h/\tau_k \f$ which is roughly equal to (k*tau). Start when this ratio equals start_large_k_at_tau_k_over_tau_h. Decrease this value to start integrating the wavenumbers earlier in time. */
@@ -568,6 +709,13 @@ struct precision
    */
   double tol_perturb_integration;
 
+  /**
+   * for tensor modes, tol_perturb_integration is multiplied by this
+   * factor (default 1): their contribution to the C_l's is usually
+   * small enough to be computed with a looser tolerance, e.g. 10
+   */
+  double tol_perturb_integration_tensors_factor;
+
   /**
    * precision with which the code should determine (by bisection) the
    * times at which sources start being sampled, and at which
@@ -575,6 +723,17 @@ struct precision
    */
   double tol_tau_approx;
 
+  /**
+   * the approximation switching times are first found by bisection
+   * on a coarse grid of wavenumbers, made of one wavenumber every
+   * tau_approx_k_step; for the other wavenumbers, the bisection only
+   * calls perturb_approximations() between the switching times of the
+   * two enclosing coarse wavenumbers, after checking with two calls
+   * that the switch is indeed in this interval (0 or 1: no coarse
+   * grid, full bisection for each wavenumber)
+   */
+  int tau_approx_k_step;
+
   /**
    * method for switching off photon perturbations
    */
@@ -642,6 +801,8 @@ struct precision
   double primordial_inflation_small_epsilon; /**< value of slow-roll parameter epsilon used to define a field value phi_end close to the end of inflation (doesn't need to be exactly at the end): epsilon(phi_end)=small_epsilon (should be smaller than one) */
   double primordial_inflation_small_epsilon_tol; /**< tolerance in the search for phi_end */
   double primordial_inflation_extra_efolds; /**< a small number of efolds, irrelevant at the end, used in the search for the pivot scale (backward from the end of inflation) */
+  double primordial_inflation_adaptive_tol; /**< if positive, the mode equations are only integrated on a subset of the ln(k) grid, refined until a cubic interpolation between computed points predicts each new point with this accuracy on ln(P); zero to integrate on the full grid */
+  int primordial_inflation_adaptive_stride; /**< with adaptive sampling, spacing (in number of points of the ln(k) grid) of the first points integrated */
 
   //@}
 
@@ -662,6 +823,8 @@ struct precision
   double hyper_phi_min_abs;  /**< small value of Bessel function used in calculation of first point x (\f$ \Phi_l^{\nu}(x) \f$ equals hyper_phi_min_abs) */
   double hyper_x_tol;  /**< tolerance parameter used to determine first value of x */
   double hyper_flat_approximation_nu;  /**< value of nu below which the flat approximation is used to compute Bessel function */
+  FileName hyper_cache_directory; /**< if not empty, directory where the flat-space Bessel interpolation table is cached between runs and processes (see hyperspherical_HIS_create_cached()) */
+  FileName shared_tables_directory; /**< if not empty, directory (ideally on a memory file system like /dev/shm) through which the tables depending only on precision parameters (lensing mu sampling and d-functions, HyRec rates) are shared read-only between processes (see shared_table_get()) */
 
   /* parameters relevant for transfer function */
 
@@ -712,6 +875,10 @@ struct precision
 
   double transfer_neglect_late_source;  /**< value of l below which the CMB source functions can be neglected at late time, excepted when there is a Late ISW contribution */
 
+  int transfer_source_k_window; /**< if positive, low-memory mode: the transfer module does not build spline tables (nor non-linear corrected copies) of the perturbation sources, but interpolates them in k on demand, through a spline over this number of rows of the source table on each side of the requested wavenumber; if zero, global spline tables are built before the loop over wavenumbers */
+
+  int transfer_l_blocks; /**< number of blocks into which the list of multipoles is split, each (q, l-block) pair being an independent parallel task in transfer_init(); if zero or negative, chosen automatically from the number of threads and wavenumbers */
+
   /** when to use the Limber approximation for project gravitational potential cl's */
   double l_switch_limber;
 
@@ -738,6 +905,14 @@ struct precision
 
   //@}
 
+  /** @name - parameters related to the spectra module */
+
+  //@{
+
+  int fftlog_size; /**< number of points (a power of two) of the FFTLog transforms giving the correlation function and sigma(R) from P(k): half of them sample the computed range of k, the rest extrapolates it on each side */
+
+  //@}
+
   /** @name - parameters related to non-linear computations */
 
   //@{
@@ -771,6 +946,28 @@ struct precision
                                   kernels). They are sampled using
                                   this logarithmic step size. */
 
+  double halofit_k_nl_bracket; /**< half-width, in \f$ \log_{10} \f$,
+                                  of the bracket in which the
+                                  non-linear scale is first searched
+                                  around the value found at the
+                                  neighbouring redshift (zero by
+                                  default: always search in the
+                                  full range; e.g. 0.1 saves
+                                  bisection steps, but moves P_nl
+                                  by a few 1e-3, within the
+                                  tolerance on sigma(R_nl)) */
+
+  double halofit_r_per_decade; /**< number of radii per decade at which
+                                  the kernels of the halofit sigma
+                                  integrals are tabulated once for all
+                                  redshifts, the non-linear scale being
+                                  then found by interpolation (zero by
+                                  default: integrate over P(k) at each
+                                  step of the bisection; e.g. 20 halves
+                                  the time of the non-linear module, but
+                                  moves P_nl by up to a few 1e-7 and
+                                  the lensing potential by up to 1e-5) */
+
   //@}
 
   /** @name - parameters related to lensing */
@@ -779,6 +976,8 @@ struct precision
 
   int accurate_lensing; /**< switch between Gauss-Legendre quadrature integration and simple quadrature on a subdomain of angles */
   int num_mu_minus_lmax; /**< difference between num_mu and l_max, increase for more precision */
+  short lensing_cache_d_tables; /**< if true, the Wigner d-functions (which only depend on l_max and on the precision parameters) are computed for all values of mu once per process, and reused by all later runs with the same l_max; this costs 12*num_mu*l_max doubles that are never freed (the values of mu and quadrature weights are always cached); with -DCLASS_OFFLOAD, a copy stays on the offload device, where the lensed C_l's are then computed */
+  int lensing_mu_chunk; /**< if positive, number of values of mu per thread for which the Wigner d-functions are stored at the same time, the recurrences being run chunk by chunk and their results used immediately by a single kernel: memory then scales like lensing_mu_chunk*l_max per thread instead of num_mu*l_max; if zero, all values of mu are treated at once */
   int delta_l_max; /**< difference between l_max in unlensed and lensed spectra */
   double tol_gauss_legendre; /**< tolerance with which quadrature points are found: must be very small for an accurate integration (if not entered manually, set automatically to match machine precision) */
   //@}
@@ -789,6 +988,10 @@ struct precision
 
   double smallest_allowed_variation; /**< machine-dependent, assigned automatically by the code */
 
+  short low_memory; /**< if _TRUE_, the transfer module splines the perturbation sources one at a time instead of all together (this lowers the peak memory, which is reached there), driver_init() frees each large table as soon as all the modules using it are done (the perturbation sources after the transfer functions and spectra, the transfer functions after the C_l's), and the Wigner d-functions of the lensing module are not cached; the results are unchanged, but the sources and transfer functions can no longer be accessed after driver_init() */
+
+  int first_touch_policy; /**< placement of the pages of the source tables, transfer functions and flat Bessel functions on the NUMA nodes, see enum first_touch_policy: ft_block (default) gives each thread the part of the tables closest to what it uses in the loops over k and l, ft_interleave spreads the tables evenly (best combined with OMP_PROC_BIND=spread), ft_none leaves them where they are first written */
+
   //@}
 
   /** @name - zone for writing error messages */
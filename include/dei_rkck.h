@@ -22,8 +22,17 @@ struct generic_integrator_workspace
   double * ak6;
   double * ytemp;
 
+  double * y_old;     /**< y at the beginning of the last step (for dense output) */
+  double * dydx_old;  /**< dy/dx at the beginning of the last step (for dense output) */
+  double * y_dense;   /**< y interpolated at a sampling point (for dense output) */
+  double * dydx_dense;/**< dy/dx interpolated at a sampling point (for dense output) */
+
   double stepmin;
 
+  int steps;        /**< number of successful steps since initialization */
+  int failed_steps; /**< number of rejected steps since initialization */
+  int nfe;          /**< number of calls to derivs since initialization */
+
   /**
     * zone for writing error messages
     */
@@ -60,6 +69,32 @@ extern "C" {
 			 double hmin,
 			 struct generic_integrator_workspace * pgi);
 
+  int generic_integrator_dense(int (*derivs)(double x,
+					     double y[],
+					     double yprime[],
+					     void * parameters_and_workspace,
+					     ErrorMsg error_message),
+			       double x1,
+			       double x2,
+			       double ystart[],
+			       void * parameters_and_workspace_for_derivs,
+			       double eps,
+			       double hmin,
+			       double * x_sampling,
+			       int x_size,
+			       int * next_index_x,
+			       int (*output)(double x,
+					     double y[],
+					     double dy[],
+					     int index_x,
+					     void * parameters_and_workspace,
+					     ErrorMsg error_message),
+			       struct generic_integrator_workspace * pgi);
+
+  int generic_integrator_hermite(double x,
+				 double h,
+				 struct generic_integrator_workspace * pgi);
+
   int rkqs(double *x,
 	   double htry,
 	   double eps,
@@ -0,0 +1,108 @@
+/** @file driver.h Documented includes for the driver of the modules */
+
+#ifndef __DRIVER__
+#define __DRIVER__
+
+#include "input.h"
+#include "lensing.h"
+
+/**
+ * Steps in which driver_init() splits the initialisation of the
+ * modules. The perturbation and transfer modules are initialised in
+ * two steps each, so that the steps which only need the indices of
+ * the perturbation module (primordial spectra, flat spherical Bessel
+ * functions) can run while its sources are computed. The output files
+ * are written in five steps, each as soon as the modules it needs are
+ * initialised, so that writing them overlaps with the next modules.
+ */
+
+enum driver_step {
+  ds_background,        /**< background_init() */
+  ds_thermodynamics,    /**< thermodynamics_init() */
+  ds_perturb_indices,   /**< perturb_init_indices() */
+  ds_perturb_sources,   /**< perturb_init_sources() */
+  ds_primordial,        /**< primordial_init() */
+  ds_nonlinear,         /**< nonlinear_init() */
+  ds_transfer_bessel,   /**< transfer_init_bessel() */
+  ds_transfer_compute,  /**< transfer_init_compute() */
+  ds_spectra,           /**< spectra_init() */
+  ds_lensing,           /**< lensing_init() */
+  ds_output_background,     /**< output_part() for op_background */
+  ds_output_thermodynamics, /**< output_part() for op_thermodynamics */
+  ds_output_primordial,     /**< output_part() for op_primordial */
+  ds_output_perturbations,  /**< output_part() for op_perturbations */
+  ds_output_spectra,        /**< output_part() for op_spectra */
+  _DRIVER_STEPS_        /**< number of steps */
+};
+
+/**
+ * Large tables which, in low-memory mode, driver_init() frees as soon
+ * as all the steps using them are done.
+ */
+
+enum driver_table {
+  dt_perturb_sources,    /**< ppt->sources, used by the nonlinear, transfer and spectra modules */
+  dt_transfer_functions, /**< ptr->transfer, used by the spectra module */
+  _DRIVER_TABLES_        /**< number of tables */
+};
+
+/*************************************************************************************************************/
+/* @cond INCLUDE_WITH_DOXYGEN */
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int driver_init(
+                  struct precision * ppr,
+                  struct background * pba,
+                  struct thermo * pth,
+                  struct perturbs * ppt,
+                  struct primordial * ppm,
+                  struct nonlinear * pnl,
+                  struct transfers * ptr,
+                  struct spectra * psp,
+                  struct lensing * ple,
+                  struct output * pop,
+                  short * compute,
+                  short * computed,
+                  ErrorMsg errmsg
+                  );
+
+  int driver_dependencies(
+                          struct precision * ppr,
+                          struct nonlinear * pnl,
+                          int * depends,
+                          short * parallel
+                          );
+
+  int driver_free_table(
+                        struct perturbs * ppt,
+                        struct transfers * ptr,
+                        int index_table,
+                        ErrorMsg errmsg
+                        );
+
+  int driver_step(
+                  struct precision * ppr,
+                  struct background * pba,
+                  struct thermo * pth,
+                  struct perturbs * ppt,
+                  struct primordial * ppm,
+                  struct nonlinear * pnl,
+                  struct transfers * ptr,
+                  struct spectra * psp,
+                  struct lensing * ple,
+                  struct output * pop,
+                  int index_step,
+                  ErrorMsg errmsg
+                  );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @endcond */
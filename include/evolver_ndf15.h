@@ -4,6 +4,7 @@
 // #include "perturbations.h"
 #include "sparse.h"
 #define TINY 1e-50
+#define ORDERING_CACHE_SIZE 32 /* Maximal number of sparsity patterns for which the AMD ordering is kept */
 /**************************************************************/
 
 struct jacobian{
@@ -31,6 +32,7 @@ struct jacobian{
 	sp_num *Numerical; /*Stores the LU decomposition.*/
 	int *Cp; /* Stores the column pointers of the spJ+spJ' sparsity pattern. */
 	int *Ci; /* Stores the row indices of the  spJ+spJ' sparsity pattern. */
+	sp_ord **ordering_cache; /* Orderings already computed for previous patterns (possibly by previous calls to the evolver) */
 };
 
 struct numjac_workspace{
@@ -52,6 +54,18 @@ struct numjac_workspace{
 	int * Rowmax;
 };
 
+/**
+ * Scratch memory that a caller can keep between calls to
+ * evolver_ndf15 (typically one per thread), so that the work vectors,
+ * the Jacobian and the numjac workspace are carved out of a single
+ * block instead of being allocated and freed at each call. The block
+ * only grows when a larger system of equations is met.
+ */
+struct ndf15_arena{
+	size_t size;  /* Size of the block in bytes */
+	char *block;  /* Block of memory (NULL until the first call) */
+};
+
 /**
  * Boilerplate for C++
  */
@@ -63,6 +77,12 @@ extern "C" {
   int uninitialize_jacobian(struct jacobian *jac);
   int initialize_numjac_workspace(struct numjac_workspace * nj_ws,int neq, ErrorMsg error_message);
   int uninitialize_numjac_workspace(struct numjac_workspace * nj_ws);
+  int ndf15_arena_init(struct ndf15_arena * arena);
+  int ndf15_arena_free(struct ndf15_arena * arena);
+  int ndf15_arena_layout(char * block, size_t * size, int neq, int buffer_size, void ** buffer,
+			 struct jacobian *jac, struct numjac_workspace *nj_ws);
+  int ndf15_arena_setup(struct ndf15_arena * arena, int neq, int buffer_size, void ** buffer,
+			struct jacobian *jac, struct numjac_workspace *nj_ws, ErrorMsg error_message);
   int calc_C(struct jacobian *jac);
   int interp_from_dif(double tinterp,double tnew,double *ynew,double h,double **dif,int k, double *yinterp,
 		      double *ypinterp, double *yppinterp, int* index, int neq, int output);
@@ -85,6 +105,14 @@ extern "C" {
                    int *fevals,
                    ErrorMsg error_message);
 
+  int evaluate_jacobian(int (*derivs)(double x,double * y,double * dy,void * parameters_and_workspace,ErrorMsg error_message),
+			int (*jacobian)(double x,double * y,double * dy,sp_mat * J,short * has_jacobian,int * nfe,
+					void * parameters_and_workspace,ErrorMsg error_message),
+			short * use_jacobian,
+			double t, double *y, double *fval, struct jacobian *jac, struct numjac_workspace *nj_ws,
+			double thresh, int neq, int *nfe,
+			void * parameters_and_workspace_for_derivs, ErrorMsg error_message);
+
   int numjac(int (*derivs)(double x,double * y,double * dy,void * parameters_and_workspace,ErrorMsg error_message),
 	     double t, double *y, double *fval, struct jacobian *jac, struct numjac_workspace *nj_ws,
 	     double thresh, int neq, int *nfe,
@@ -94,6 +122,10 @@ extern "C" {
 int evolver_ndf15(
 	int (*derivs)(double x,double * y,double * dy,
 		void * parameters_and_workspace, ErrorMsg error_message),
+	int (*jacobian)(double x,double * y,double * dy,sp_mat * J,short * has_jacobian,int * nfe,
+		void * parameters_and_workspace, ErrorMsg error_message),
+	sp_ord ** ordering_cache,
+	struct ndf15_arena * arena,
 	double x_ini,
 	double x_final,
 	double * y_inout,
@@ -113,6 +145,7 @@ int evolver_ndf15(
 		ErrorMsg error_message),
 	int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
 		ErrorMsg error_message),
+	int * statistics,
 	ErrorMsg error_message);
 
 
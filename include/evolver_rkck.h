@@ -2,6 +2,9 @@
 #define __EVO__
 
 #include "dei_rkck.h"
+#include "sparse.h"
+
+struct ndf15_arena;
 
 /**************************************************************/
 
@@ -17,6 +20,16 @@ extern "C" {
 				    double * dy,
 				    void * parameters_and_workspace,
 				    ErrorMsg error_message),
+		      int (*jacobian)(double x,
+				    double * y,
+				    double * dy,
+				    sp_mat * J,
+				    short * has_jacobian,
+				    int * nfe,
+				    void * parameters_and_workspace,
+				    ErrorMsg error_message),
+		      sp_ord ** ordering_cache,
+		      struct ndf15_arena * arena,
 		      double x_ini,
 		      double x_end,
 		      double * y,
@@ -43,8 +56,53 @@ extern "C" {
 					     double dy[],
 					     void * parameters_and_workspace,
 					     ErrorMsg error_message),
+		      int * statistics,
 		      ErrorMsg error_message);
 
+  int evolver_rk_dense(int (*derivs)(double x,
+                                          double * y,
+                                          double * dy,
+                                          void * parameters_and_workspace,
+                                          ErrorMsg error_message),
+                            int (*jacobian)(double x,
+                                          double * y,
+                                          double * dy,
+                                          sp_mat * J,
+                                          short * has_jacobian,
+                                          int * nfe,
+                                          void * parameters_and_workspace,
+                                          ErrorMsg error_message),
+                            sp_ord ** ordering_cache,
+                            struct ndf15_arena * arena,
+                            double x_ini,
+                            double x_end,
+                            double * y,
+                            int * used_in_output,
+                            int y_size,
+                            void * parameters_and_workspace_for_derivs,
+                            double tolerance,
+                            double minimum_variation,
+                            int (*evaluate_timescale)(double x,
+                                                      void * parameters_and_workspace,
+                                                      double * timescale,
+                                                      ErrorMsg error_message),
+                            double timestep_over_timescale,
+                            double * x_sampling,
+                            int x_size,
+                            int (*output)(double x,
+                                          double y[],
+                                          double dy[],
+                                          int index_x,
+                                          void * parameters_and_workspace,
+                                          ErrorMsg error_message),
+                            int (*print_variables)(double x,
+                                                   double y[],
+                                                   double dy[],
+                                                   void * parameters_and_workspace,
+                                                   ErrorMsg error_message),
+                            int * statistics,
+                            ErrorMsg error_message);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,89 @@
+/**
+ * definitions for module fftlog.c
+ */
+
+#ifndef __FFTLOG__
+#define __FFTLOG__
+
+#include "common.h"
+
+/**
+ * Kernels K(x) of the transforms handled by fftlog_execute()
+ */
+
+enum fftlog_kernel {
+  fftlog_spherical_bessel, /**< spherical Bessel function \f$ j_\nu(x) \f$, e.g. for the correlation function (\f$ \nu=0 \f$) */
+  fftlog_tophat_squared    /**< square of the Fourier transform of a spherical top-hat, \f$ W^2(x)=[3(\sin x - x \cos x)/x^3]^2 \f$, for \f$ \sigma^2(R) \f$ */
+};
+
+/**
+ * Precomputed coefficients for the transform
+ *
+ * \f$ g(y) = \int_0^\infty f(x) \, K(xy) \, dx/x \f$
+ *
+ * of a function f sampled on a logarithmic grid of N points
+ * \f$ x_n = x_0 e^{n \Delta} \f$, the result being obtained on the grid
+ * \f$ y_m = y_0 e^{m \Delta} \f$. The same plan can be used for any number of
+ * functions f sampled on the same grid.
+ */
+
+struct fftlog_plan {
+
+  int N;            /**< number of points, a power of two */
+  double dlnx;      /**< logarithmic step \f$ \Delta \f$ */
+  double x0;        /**< first point of the input grid */
+  double y0;        /**< first point of the output grid */
+  double q;         /**< power-law bias: \f$ f(x) x^{-q} \f$ is the function actually expanded in Fourier series */
+
+  double * u_re;    /**< real part of the coefficients \f$ u_m = M(q+i\omega_m) (x_0 y_0)^{-i\omega_m} \f$, with M the Mellin transform of the kernel */
+  double * u_im;    /**< imaginary part of the same coefficients */
+
+  double * work_re; /**< workspace for the FFT (hence a plan cannot be shared between threads during fftlog_execute()) */
+  double * work_im; /**< workspace for the FFT */
+
+};
+
+/**************************************************************/
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int fftlog_fft(
+                 double * re,
+                 double * im,
+                 int N,
+                 ErrorMsg errmsg
+                 );
+
+  int fftlog_plan_init(
+                       int N,
+                       double x0,
+                       double dlnx,
+                       double y0,
+                       double q,
+                       enum fftlog_kernel kernel,
+                       double nu,
+                       struct fftlog_plan * pfp,
+                       ErrorMsg errmsg
+                       );
+
+  int fftlog_execute(
+                     struct fftlog_plan * pfp,
+                     double * f,
+                     double * g,
+                     ErrorMsg errmsg
+                     );
+
+  int fftlog_plan_free(
+                       struct fftlog_plan * pfp
+                       );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
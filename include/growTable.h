@@ -11,15 +11,33 @@
 #define _GT_FACTOR_ 2      /**< inflating factor when current max size is reached */
 #define _GT_END_ -1        /**< flag meaning the end of the current data in the growTable */
 
+/**
+ * Chunk of a growTable, after the first one: its data follows this header.
+ */
+struct gt_chunk {
+  struct gt_chunk * next; /**< next chunk (NULL for the last one) */
+  long offset;            /**< index of its first byte in the table */
+  long sz;                /**< size of its data */
+};
+
 /**
  * growTable structure.
+ *
+ * The data is written in a list of chunks, each new chunk being as large as
+ * all the previous ones together: the data already written is never moved
+ * while the table grows, and is gathered into a single buffer only once by
+ * gt_getPtr() (not at all if gt_reserve() made the first chunk large enough).
  */
 typedef struct {
-  void* buffer; /**< stack of data */
+  void* buffer; /**< stack of data (first chunk, then all the data after gt_getPtr()) */
   long sz;      /**< total size */
   long csz;     /**< real size */
   int freeze;   /**< if set to _TRUE_ no data can be added */
 
+  long buffer_sz;          /**< size of the first chunk */
+  struct gt_chunk * chunk; /**< list of the next chunks (NULL if none) */
+  struct gt_chunk * last;  /**< last chunk of this list */
+
   ErrorMsg error_message; /**< error message slot */
 } growTable;
 
@@ -30,6 +48,8 @@ extern "C" {
 
 int gt_init(growTable*);
 
+int gt_reserve(growTable*, long sz);
+
 int gt_add(growTable*, long idx, void* data, long sz);
 int gt_retrieve(growTable *,long idx, long sz, void* data);
 int gt_retrieveAll(growTable *,void* data);
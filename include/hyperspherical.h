@@ -12,8 +12,10 @@
 #define _TRIG_PRECISSION_ 1e-7
 #define _HYPER_BLOCK_ 8
 #define _HYPER_CHUNK_ 16
+#define _HYPER_CONVOLUTION_CHUNK_ 256
 #define _TWO_OVER_THREE_ 0.666666666666666666666666666667e0
 #define _HIS_BYTE_ALIGNMENT_ 16
+#define _HIS_CACHE_VERSION_ 1
 
 typedef struct HypersphericalInterpolationStructure{
   int K;                 //Sign of the curvature, (0,-1,1)
@@ -29,8 +31,56 @@ typedef struct HypersphericalInterpolationStructure{
   double *cotK;          //Vector of cot_K(xvec)
   double *phi;        //array of size nl*nx. [y_{l1}(x1) t_{l1}(x2)...]
   double *dphi;       //Same as phivec, but containing derivatives.
+  void *mapping;      //If not NULL, all vectors above point into this read-only mapping of a cache file.
+  size_t mapping_size; //Size in bytes of the mapping.
 } HyperInterpStruct;
 
+/**
+ * Copy of the tables phi and dphi of a HIS in the memory of the default
+ * offload device, used by hyperspherical_Hermite4_convolution_Phi_block_device()
+ * when the code is compiled with -DCLASS_OFFLOAD (option OFFLOAD of the
+ * Makefile). Copies are shared by all HIS with the same parameters and
+ * multipoles, and the last one is kept on the device from one run to
+ * the next (see hyperspherical_HIS_device_get()).
+ */
+typedef struct HypersphericalDeviceTables{
+  int K;
+  double beta;
+  double xmin;
+  double delta_x;
+  int l_size;
+  int x_size;
+  int *l;             //Host copy of the l values, to recognise the HIS.
+  double *phi;        //Device pointer to the copy of phi.
+  double *dphi;       //Device pointer to the copy of dphi.
+  int device;         //Device holding the copies.
+  int users;          //Number of calls to hyperspherical_HIS_device_get() not yet released.
+  struct HypersphericalDeviceTables *next;
+} HyperDeviceTables;
+
+/**
+ * Header of a cache file written by hyperspherical_HIS_create_cached(),
+ * followed by the vectors of the HIS in the order of
+ * hyperspherical_update_pointers(). All arguments of
+ * hyperspherical_HIS_create() are stored, so that a file is only used
+ * for exactly the same request.
+ */
+struct hyperspherical_cache_header{
+  char magic[8];         //"CLASSHIS"
+  int format_version;    //_HIS_CACHE_VERSION_
+  int K;
+  int l_size;
+  int x_size;
+  int trig_order;
+  int l_WKB;
+  double beta;
+  double xmin;
+  double xmax;
+  double sampling;
+  double phiminabs;
+  double delta_x;
+};
+
 struct WKB_parameters{
    int K;
    int l;
@@ -56,7 +106,31 @@ extern "C" {
                                 HyperInterpStruct *pHIS,
                                 ErrorMsg error_message);
 
+  int hyperspherical_HIS_create_cached(char *cache_directory,
+                                       int K,
+                                       double beta,
+                                       int nl,
+                                       int *lvec,
+                                       double xmin,
+                                       double xmax,
+                                       double sampling,
+                                       int l_WKB,
+                                       double phiminabs,
+                                       HyperInterpStruct *pHIS,
+                                       ErrorMsg error_message);
+
+  int hyperspherical_HIS_first_touch(HyperInterpStruct *pHIS,
+                                     int policy,
+                                     ErrorMsg error_message);
+
   int hyperspherical_HIS_free(HyperInterpStruct *pHIS, ErrorMsg error_message);
+
+  int hyperspherical_HIS_device_get(HyperInterpStruct *pHIS,
+                                    HyperDeviceTables **ppdev,
+                                    ErrorMsg error_message);
+
+  int hyperspherical_HIS_device_release(HyperDeviceTables *pdev);
+
   int hyperspherical_forwards_recurrence(int K,
                                          int lmax,
                                          double beta,
@@ -177,6 +251,32 @@ int hyperspherical_forwards_recurrence_chunk(int K,
   int hyperspherical_Hermite4_interpolation_vector_dPhid2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *dPhi,double *d2Phi, ErrorMsg error_message);
   int hyperspherical_Hermite4_interpolation_vector_PhidPhid2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *Phi,double *dPhi,double *d2Phi, ErrorMsg error_message);
   int hyperspherical_Hermite6_interpolation_vector_Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *Phi, ErrorMsg error_message);
+  int hyperspherical_Hermite4_convolution_Phi(HyperInterpStruct *pHIS,
+                                              int nxi,
+                                              int lnum,
+                                              double * __restrict__ xinterp,
+                                              double * __restrict__ f,
+                                              double * __restrict__ w,
+                                              double *result);
+  int hyperspherical_Hermite4_convolution_Phi_block(HyperInterpStruct *pHIS,
+                                                    int lnum,
+                                                    int l_count,
+                                                    int *nxi,
+                                                    double * __restrict__ xinterp,
+                                                    double * __restrict__ f,
+                                                    double * __restrict__ w,
+                                                    double *result);
+
+  int hyperspherical_Hermite4_convolution_Phi_block_device(HyperInterpStruct *pHIS,
+                                                           HyperDeviceTables *pdev,
+                                                           int lnum,
+                                                           int l_count,
+                                                           int *nxi,
+                                                           double *xinterp,
+                                                           double *f,
+                                                           double *w,
+                                                           double *result,
+                                                           ErrorMsg error_message);
   int hyperspherical_Hermite6_interpolation_vector_dPhi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *dPhi, ErrorMsg error_message);
   int hyperspherical_Hermite6_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *d2Phi, ErrorMsg error_message);
   int hyperspherical_Hermite6_interpolation_vector_PhidPhi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *Phi,double *dPhi, ErrorMsg error_message);
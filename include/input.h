@@ -136,7 +136,8 @@
 
 enum target_names {theta_s, Omega_dcdmdr, omega_dcdmdr, Omega_scf, Omega_ini_dcdm, omega_ini_dcdm};
 enum computation_stage {cs_background, cs_thermodynamics, cs_perturbations,
-                        cs_primordial, cs_nonlinear, cs_transfer, cs_spectra};
+                        cs_primordial, cs_nonlinear, cs_transfer, cs_spectra, cs_lensing};
+#define _NUM_STAGES_ 8 //Keep this number as number of computation stages
 #define _NUM_TARGETS_ 6 //Keep this number as number of target_names
 
 struct input_pprpba {
@@ -151,6 +152,43 @@ struct fzerofun_workspace {
   double * target_value;
   int target_size;
   enum computation_stage required_computation_stage;
+  short warm_start; /**< start from the solution of the previous shooting with the same targets (see struct shooting_warm_start) */
+};
+
+#define _INPUT_SNAPSHOT_VERSION_ 1 /**< version of the binary format written by input_write_snapshot() */
+
+/**
+ * Header of a binary input snapshot. It is followed by the filled
+ * precision structure and by the list of (size) parameters, each
+ * written as the length of the name, the name, the length of the
+ * value and the value (lengths include the final null character).
+ */
+
+struct input_snapshot_header {
+  char magic[8];          /**< "CLASSSNP" */
+  int format_version;     /**< _INPUT_SNAPSHOT_VERSION_ */
+  char class_version[16]; /**< _VERSION_ of the code that wrote the snapshot */
+  int precision_size;     /**< sizeof(struct precision) */
+  int size;               /**< number of parameters */
+};
+
+#define _SHOOTING_WARM_START_SIZE_ 4 /**< number of target combinations remembered by the warm start */
+#define _SHOOTING_WARM_START_ITER_ 4 /**< maximum number of secant steps tried before falling back to the cold search */
+
+/**
+ * Converged solution of a previous shooting, used as a starting point
+ * for the next one when the same targets are requested (typically in
+ * consecutive MCMC steps). The solution is extrapolated to the new
+ * target values with the stored local derivative dx/dF.
+ */
+
+struct shooting_warm_start {
+  int target_size;                              /**< number of targets */
+  enum target_names target_name[_NUM_TARGETS_]; /**< names of the targets, in the order of the workspace */
+  double target_value[_NUM_TARGETS_];           /**< target values at the stored solution */
+  double x[_NUM_TARGETS_];                      /**< unknown parameters at the stored solution */
+  double dxdF[_NUM_TARGETS_];                   /**< local derivative of each unknown parameter with respect to its target */
+  int last_use;                                 /**< value of the clock at the last use, for replacing the oldest entry */
 };
 
 
@@ -194,6 +232,28 @@ extern "C" {
 		 ErrorMsg errmsg
 		 );
 
+  int input_parameter_stage(
+                            char * name,
+                            enum computation_stage * stage
+                            );
+
+  int input_update(
+                   struct file_content * pfc,
+                   struct precision * ppr,
+                   struct background *pba,
+                   struct thermo *pth,
+                   struct perturbs *ppt,
+                   struct transfers *ptr,
+                   struct primordial *ppm,
+                   struct spectra *psp,
+                   struct nonlinear *pnl,
+                   struct lensing *ple,
+                   struct output *pop,
+                   enum computation_stage stage,
+                   short * recompute,
+                   ErrorMsg errmsg
+                   );
+
   int input_read_parameters(
                             struct file_content * pfc,
                             struct precision * ppr,
@@ -221,6 +281,21 @@ extern "C" {
 			   struct output *pop
 			   );
 
+  int input_write_snapshot(
+                           char * filename,
+                           struct file_content * pfc,
+                           short * skip,
+                           struct precision * ppr,
+                           ErrorMsg errmsg
+                           );
+
+  int input_read_snapshot(
+                          char * filename,
+                          struct file_content * pfc,
+                          struct precision * ppr,
+                          ErrorMsg errmsg
+                          );
+
   int input_default_precision(
 			      struct precision * ppp
 			      );
@@ -264,6 +339,24 @@ extern "C" {
                       struct fzerofun_workspace *pfzw,
                       ErrorMsg errmsg);
 
+  int input_find_root_warm(double x1,
+                           double dxdF,
+                           double *xzero,
+                           double *dxdF_out,
+                           int *fevals,
+                           struct fzerofun_workspace *pfzw,
+                           int *converged,
+                           ErrorMsg errmsg);
+
+  int input_shooting_warm_start_get(struct fzerofun_workspace *pfzw,
+                                    double *x,
+                                    double *dxdF,
+                                    int *found);
+
+  int input_shooting_warm_start_put(struct fzerofun_workspace *pfzw,
+                                    double *x,
+                                    double *dxdF);
+
   int file_exists(const char *fname);
 
   int input_auxillary_target_conditions(struct file_content * pfc,
@@ -87,6 +87,8 @@ struct lensing {
 
   double * ddcl_lens; /**< second derivatives for interpolation */
 
+  double * cl_lens_dense; /**< lensed \f$ C_l\f$'s interpolated once for all at each integer l up to l_lensed_max, cl_lens_dense[l * ple->lt_size + index_lt] (zero for l<2); a spectrum up to some l_max can be read directly from this table */
+
   //@}
 
   /** @name - technical parameters */
@@ -95,11 +97,20 @@ struct lensing {
 
   short lensing_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  struct class_profile profile; /**< resources used by lensing_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
 };
 
+/**
+ * Values of mu, quadrature weights and Wigner d-functions shared by
+ * all runs, defined in lensing.c
+ */
+
+struct lensing_mu_tables;
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -115,6 +126,10 @@ extern "C" {
                       double * cl_lensed
                       );
 
+  int lensing_cl_dense(
+                       struct lensing * ple
+                       );
+
   int lensing_init(
 		   struct precision * ppr,
                    struct perturbs * ppt,
@@ -133,31 +148,115 @@ extern "C" {
                       struct lensing * ple
                       );
 
-  int lensing_lensed_cl_tt(
-                        double *ksi,
-                        double **d00,
-                        double *w8,
-                        int nmu,
-                        struct lensing * ple
+  int lensing_mu_tables(
+                        struct precision * ppr,
+                        int num_mu,
+                        int l_max,
+                        short has_d,
+                        struct lensing_mu_tables ** ptables,
+                        ErrorMsg error_message
                         );
 
-  int lensing_lensed_cl_te(
-                           double *ksiX,
-                           double **d20,
-                           double *w8,
-                           int nmu,
-                           struct lensing * ple
-                           );
-
-  int lensing_lensed_cl_ee_bb(
-			      double *ksip,
-			      double *ksim,
-			      double **d22,
-			      double **d2m2,
-			      double *w8,
-			      int nmu,
-			      struct lensing * ple
-			      );
+  int lensing_mu_tables_pointers(
+                                 struct lensing_mu_tables * tables,
+                                 double * data
+                                 );
+
+  int lensing_mu_tables_compute(
+                                void * context,
+                                double * data,
+                                ErrorMsg error_message
+                                );
+
+#ifdef CLASS_OFFLOAD
+#pragma omp declare target
+#endif
+  int lensing_correlation_at_mu(
+                                int l_max,
+                                short has_tt,
+                                short has_te,
+                                short has_pol,
+                                short accurate_lensing,
+                                double * cl_tt,
+                                double * cl_te,
+                                double * cl_ee,
+                                double * cl_bb,
+                                double * cl_pp,
+                                double * sqrt1,
+                                double * sqrt2,
+                                double * sqrt3,
+                                double * sqrt4,
+                                double * sqrt5,
+                                double * d00,
+                                double * d11,
+                                double * d1m1,
+                                double * d2m2,
+                                double * d20,
+                                double * d3m1,
+                                double * d4m2,
+                                double * d22,
+                                double * d31,
+                                double * d3m3,
+                                double * d40,
+                                double * d4m4,
+                                double Cgl_at_one,
+                                double * Cgl,
+                                double * Cgl2,
+                                double * sigma2,
+                                double * ksi,
+                                double * ksiX,
+                                double * ksip,
+                                double * ksim
+                                );
+#ifdef CLASS_OFFLOAD
+#pragma omp end declare target
+#endif
+
+  int lensing_mu_tables_device(
+                               struct lensing_mu_tables * tables,
+                               ErrorMsg error_message
+                               );
+
+  int lensing_correlation_device(
+                                 struct precision * ppr,
+                                 struct lensing * ple,
+                                 struct lensing_mu_tables * tables,
+                                 int index_mu_start,
+                                 int n_mu,
+                                 double * cl_tt,
+                                 double * cl_te,
+                                 double * cl_ee,
+                                 double * cl_bb,
+                                 double * cl_pp,
+                                 double * sqrt1,
+                                 double * sqrt2,
+                                 double * sqrt3,
+                                 double * sqrt4,
+                                 double * sqrt5,
+                                 double * Cgl,
+                                 double * Cgl2,
+                                 double * sigma2,
+                                 double * ksi,
+                                 double * ksiX,
+                                 double * ksip,
+                                 double * ksim
+                                 );
+
+  int lensing_lensed_cl_chunk(
+                              double *ksi,
+                              double *ksiX,
+                              double *ksip,
+                              double *ksim,
+                              double **d00,
+                              double **d20,
+                              double **d22,
+                              double **d2m2,
+                              double *w8,
+                              int index_mu_start,
+                              int nmu,
+                              struct lensing * ple
+                              );
+
   int lensing_addback_cl_tt(
 			    struct lensing *ple,
 			    double *cl_tt
@@ -6,8 +6,56 @@
 #define __NONLINEAR__
 
 #define _M_EV_TOO_BIG_FOR_HALOFIT_ 10. /**< above which value of non-CDM mass (in eV) do we stop trusting halofit? */
+#define _HALOFIT_TAU_CHUNK_ 8 /**< number of consecutive values of tau in which halofit starts the search of k_nl from the value found at the previous one (the results depend on it, but not on the number of threads) */
 
-enum non_linear_method {nl_none,nl_halofit};
+enum non_linear_method {nl_none,nl_halofit,nl_engine};
+
+struct nonlinear;
+
+/**
+ * Callbacks of an external non-linear engine (emulator, response
+ * function model, external library, etc.)
+ *
+ * An engine is registered once per process with
+ * nonlinear_engine_register(), and then selected in the input with
+ * 'non linear = <name>'. nonlinear_init() calls init() once, then
+ * compute() for each value of tau in pnl->tau, and writes the result
+ * in pnl->nl_corr_density like for Halofit. nonlinear_free() calls
+ * free(). All callbacks write their error messages in
+ * pnl->error_message. The init() and free() callbacks are optional.
+ */
+
+struct nonlinear_engine {
+
+  const char * name; /**< name selecting this engine in the input ('halofit' is reserved) */
+
+  short is_thread_safe; /**< can compute() be called simultaneously for different values of tau? */
+
+  void * parameters; /**< engine-specific data, passed to all callbacks, owned by the caller of nonlinear_engine_register() */
+
+  int (*init)(struct nonlinear_engine * pne,
+              struct precision * ppr,
+              struct background * pba,
+              struct perturbs * ppt,
+              struct primordial * ppm,
+              struct nonlinear * pnl,
+              void ** workspace); /**< set *workspace to any data needed by compute() and free() for this run (pnl->k and pnl->tau are already filled) */
+
+  int (*compute)(struct nonlinear_engine * pne,
+                 void * workspace,
+                 struct nonlinear * pnl,
+                 int index_tau,
+                 double * pk_l,
+                 double * pk_nl,
+                 double * k_nl); /**< given the linear P(k) pk_l[index_k] in Mpc^3 at pnl->tau[index_tau], fill pk_nl[index_k] and the wavenumber k_nl of non-linearity in 1/Mpc */
+
+  int (*free)(struct nonlinear_engine * pne,
+              void * workspace,
+              struct nonlinear * pnl); /**< free the workspace of this run */
+
+  struct nonlinear_engine * next; /**< next registered engine */
+
+};
 
 /**
  * Structure containing all information on non-linear spectra.
@@ -28,6 +76,8 @@ struct nonlinear {
 
   enum non_linear_method method; /**< method for computing non-linear corrections (none, Halogit, etc.) */
 
+  struct nonlinear_engine * engine; /**< registered engine, when method is nl_engine */
+
   //@}
 
   /** @name - table non-linear corrections for matter density, sqrt(P_NL(k,z)/P_NL(k,z)) */
@@ -42,6 +92,21 @@ struct nonlinear {
   double * nl_corr_density;   /**< nl_corr_density[index_tau * ppt->k_size + index_k] */
   double * k_nl;  /**< wavenumber at which non-linear corrections become important, defined differently by different non_linear_method's */
 
+  void * engine_workspace; /**< workspace set by the init() callback of the engine, when method is nl_engine */
+
+  //@}
+
+  /** @name - kernels of the Gaussian-filtered integrals of halofit
+      (giving sigma(R), n_eff and the curvature), tabulated once for
+      all redshifts on a logarithmic grid of radii */
+
+  //@{
+
+  int sigma_k_size;       /**< number of values of k sampling the integrals */
+  int sigma_r_size;       /**< number of values of R (zero when the kernels are not tabulated) */
+  double * sigma_logr;    /**< sigma_logr[index_r] = list of \f$ \log_{10} R \f$ values, with R in Mpc */
+  double * sigma_kernel;  /**< sigma_kernel[(index_r*3+index_sum)*sigma_k_size+index_k] = quadrature weight times kernel of the integral index_sum at radius index_r, such that each integral is a sum over P(k) */
+
   //@}
 
   /** @name - technical parameters */
@@ -50,6 +115,8 @@ struct nonlinear {
 
   short nonlinear_verbose;  	/**< amount of information written in standard output */
 
+  struct class_profile profile; /**< resources used by nonlinear_init() */
+
   ErrorMsg error_message; 	/**< zone for writing error messages */
 
   //@}
@@ -85,6 +152,16 @@ extern "C" {
                      struct nonlinear *pnl
                      );
 
+  int nonlinear_engine_register(
+                                struct nonlinear_engine * pne,
+                                ErrorMsg error_message
+                                );
+
+  int nonlinear_engine_find(
+                            char * name,
+                            struct nonlinear_engine ** ppne
+                            );
+
   int nonlinear_pk_l(struct perturbs *ppt,
                      struct primordial *ppm,
                      struct nonlinear *pnl,
@@ -105,9 +182,55 @@ extern "C" {
                         double *lnpk,
                         double *ddlnpk,
                         double *pk_nl,
+                        double k_nl_guess,
                         double *k_nl
                         );
 
+  int nonlinear_spline_quadrature_weights(
+                                          struct nonlinear *pnl,
+                                          double *x,
+                                          int x_size,
+                                          double *weight
+                                          );
+
+  int nonlinear_halofit_sigma_kernels(
+                                      struct precision *ppr,
+                                      struct nonlinear *pnl
+                                      );
+
+  int nonlinear_halofit_sigma_table(
+                                    struct nonlinear *pnl,
+                                    double *integrand_array,
+                                    int ia_size,
+                                    int index_ia_pk,
+                                    double *sigma_table,
+                                    double *ddsigma_table
+                                    );
+
+  int nonlinear_halofit_sigma_interpolate(
+                                          struct nonlinear *pnl,
+                                          double *sigma_table,
+                                          double *ddsigma_table,
+                                          double xlogr,
+                                          int *last_index,
+                                          double *sigma,
+                                          double *d1,
+                                          double *d2
+                                          );
+
+  int nonlinear_halofit_sigma(
+                              struct nonlinear *pnl,
+                              double *integrand_array,
+                              int integrand_size,
+                              int ia_size,
+                              int index_ia_k,
+                              int index_ia_pk,
+                              int index_ia_sum,
+                              int index_ia_ddsum,
+                              double R,
+                              double *sigma
+                              );
+
 #ifdef __cplusplus
 }
 #endif
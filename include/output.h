@@ -5,6 +5,7 @@
 
 #include "common.h"
 #include "lensing.h"
+#include "binary_output.h"
 
 /**
  * Maximum number of values of redshift at which the spectra will be
@@ -13,6 +14,22 @@
 
 #define _Z_PK_NUM_MAX_ 100
 
+/**
+ * Groups of files written by output_part(), each as soon as the
+ * modules it needs are initialised (see driver.h). The first group
+ * must be written first, since it starts the measurement of the
+ * resources used by the output module.
+ */
+
+enum output_part {
+  op_background,      /**< background.dat */
+  op_thermodynamics,  /**< thermodynamics.dat */
+  op_primordial,      /**< primordial_Pk.dat */
+  op_perturbations,   /**< perturbations_k*.dat and perturbations_profile.csv */
+  op_spectra,         /**< C_l's, P(k)'s, correlations and transfer functions */
+  _OUTPUT_PARTS_      /**< number of groups */
+};
+
 /**
  * Structure containing various informations on the output format,
  * all of them initialized by user in input module.
@@ -47,7 +64,9 @@ struct output {
   short write_background; /**< flag for outputing background evolution in file */
   short write_thermodynamics; /**< flag for outputing thermodynamical evolution in file */
   short write_perturbations; /**< flag for outputing perturbations of selected wavenumber(s) in file(s) */
+  short write_perturbations_profile; /**< flag for outputing integration statistics for each wavenumber in a csv file */
   short write_primordial; /**< flag for outputing scalar/tensor primordial spectra in files */
+  short print_profile; /**< flag for printing the resources used by each module (see output_print_profile()) */
 
   //@}
 
@@ -57,11 +76,80 @@ struct output {
 
   short output_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  struct class_profile profile; /**< resources used by output_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
 };
 
+/**
+ * Table of numbers with column titles, filled by the output_*_table()
+ * routines with the content of the corresponding output files, for
+ * codes linking to the library that do not want to go through files.
+ *
+ * Before the call, either set data to NULL to let the output module
+ * allocate it (free it with output_table_free()), or point it to a
+ * buffer of the caller holding capacity numbers.
+ */
+
+struct output_table {
+
+  char titles[_MAXTITLESTRINGLENGTH_]; /**< column titles, each followed by _DELIMITER_ */
+  int columns; /**< number of columns */
+  int rows; /**< number of rows */
+  double * data; /**< table with argument data[index_row*columns+index_column] */
+  int capacity; /**< number of doubles available in data, when it is a buffer of the caller */
+  short data_is_allocated; /**< _TRUE_ if data was allocated by the output module */
+
+};
+
+/**
+ * Layout of the states written by output_state_pack(), holding the
+ * results of a run so that they can be restored without computing
+ * anything:
+ *
+ * - 8 characters _STATE_MAGIC_ (no terminating null character)
+ * - uint32: _STATE_BYTE_ORDER_, in the byte order of the machine that
+ *   wrote the state
+ * - int32: _STATE_VERSION_
+ * - 3 uint8: sizes of short, int and double, in which the tables are
+ *   stored
+ * - _STATE_MODULES_ int16: flags of the background, thermo,
+ *   primordial, nonlinear, spectra and lensing structures contained
+ *   in the state
+ * - each of these structures field by field, in the order of its
+ *   declaration (short as int16, int and enum as int32, double),
+ *   without pointers and error messages, followed by the tables and
+ *   strings it points to, each preceded by its size in bytes as an
+ *   uint64 (zero for a NULL pointer)
+ *
+ * Numbers are in the byte order of the machine, which is checked
+ * when unpacking, as the sizes of numbers. The fields are listed in
+ * output_state_background() and the following routines: a field
+ * added to one of these structures must be added there too, and
+ * _STATE_VERSION_ increased.
+ */
+
+#define _STATE_MAGIC_ "CLASSSTA"
+#define _STATE_BYTE_ORDER_ 0x01020304
+#define _STATE_VERSION_ 2
+#define _STATE_MODULES_ 6
+
+/**
+ * Buffer in which a state is packed or from which it is unpacked
+ */
+
+struct output_state_buffer {
+
+  char * data;     /**< content of the state */
+  size_t size;     /**< number of bytes of the state */
+  size_t capacity; /**< number of bytes allocated in data (when packing) */
+  size_t position; /**< number of bytes already packed or unpacked */
+  short unpack;    /**< _TRUE_ when reading the state, _FALSE_ when writing it */
+
+};
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -91,6 +179,19 @@ extern "C" {
                   struct output * pop
                   );
 
+  int output_part(
+                  struct background * pba,
+                  struct thermo * pth,
+                  struct perturbs * ppt,
+                  struct primordial * ppm,
+                  struct transfers * ptr,
+                  struct spectra * psp,
+                  struct nonlinear * pnl,
+                  struct lensing * ple,
+                  struct output * pop,
+                  enum output_part part
+                  );
+
   int output_cl(
                 struct background * pba,
                 struct perturbs * ppt,
@@ -113,6 +214,12 @@ extern "C" {
                    struct output * pop
                    );
 
+  int output_correlations(
+                          struct background * pba,
+                          struct spectra * psp,
+                          struct output * pop
+                          );
+
   int output_tk(
                 struct background * pba,
                 struct perturbs * ppt,
@@ -137,12 +244,69 @@ extern "C" {
                            struct output * pop
                            );
 
+  int output_perturbations_profile(
+                                   struct perturbs * ppt,
+                                   struct output * pop
+                                   );
+
   int output_primordial(
                         struct perturbs * ppt,
                         struct primordial * ppm,
                         struct output * pop
                         );
 
+  int output_print_profile(
+                           struct background * pba,
+                           struct thermo * pth,
+                           struct perturbs * ppt,
+                           struct primordial * ppm,
+                           struct nonlinear * pnl,
+                           struct transfers * ptr,
+                           struct spectra * psp,
+                           struct lensing * ple,
+                           struct output * pop
+                           );
+
+  int output_table_init(
+                        struct output * pop,
+                        char * titles,
+                        int rows,
+                        struct output_table * ptable
+                        );
+
+  int output_table_free(
+                        struct output_table * ptable
+                        );
+
+  int output_background_table(
+                              struct background * pba,
+                              struct output * pop,
+                              struct output_table * ptable
+                              );
+
+  int output_thermodynamics_table(
+                                  struct background * pba,
+                                  struct thermo * pth,
+                                  struct output * pop,
+                                  struct output_table * ptable
+                                  );
+
+  int output_tk_table(
+                      struct background * pba,
+                      struct perturbs * ppt,
+                      struct spectra * psp,
+                      struct output * pop,
+                      double z,
+                      struct output_table * ptable
+                      );
+
+  int output_primordial_table(
+                              struct perturbs * ppt,
+                              struct primordial * ppm,
+                              struct output * pop,
+                              struct output_table * ptable
+                              );
+
   int output_print_data(FILE *out,
                         char titles[_MAXTITLESTRINGLENGTH_],
                         double *dataptr,
@@ -182,6 +346,15 @@ extern "C" {
                             double one_pk
                             );
 
+  int output_binary_pk(
+                       struct background * pba,
+                       struct spectra * psp,
+                       struct output * pop,
+                       FILE * pkfile,
+                       double * pk,
+                       int stride
+                       );
+
   int output_open_pk_nl_file(
                              struct background * pba,
                              struct nonlinear * pnl,
@@ -194,6 +367,126 @@ extern "C" {
                              );
 
 
+  int output_state_bytes(
+                         struct output_state_buffer * psb,
+                         void * data,
+                         size_t size,
+                         ErrorMsg error_message
+                         );
+
+  int output_state_array(
+                         struct output_state_buffer * psb,
+                         void ** parray,
+                         size_t size,
+                         ErrorMsg error_message
+                         );
+
+  int output_state_short(
+                         struct output_state_buffer * psb,
+                         short * value,
+                         ErrorMsg error_message
+                         );
+
+  int output_state_int(
+                       struct output_state_buffer * psb,
+                       int * value,
+                       ErrorMsg error_message
+                       );
+
+  int output_state_double(
+                          struct output_state_buffer * psb,
+                          double * value,
+                          ErrorMsg error_message
+                          );
+
+  int output_state_string(
+                          struct output_state_buffer * psb,
+                          char ** pstring,
+                          ErrorMsg error_message
+                          );
+
+  int output_state_background(
+                              struct output_state_buffer * psb,
+                              struct background * pba,
+                              ErrorMsg error_message
+                              );
+
+  int output_state_thermodynamics(
+                                  struct output_state_buffer * psb,
+                                  struct thermo * pth,
+                                  ErrorMsg error_message
+                                  );
+
+  int output_state_primordial(
+                              struct output_state_buffer * psb,
+                              struct primordial * ppm,
+                              ErrorMsg error_message
+                              );
+
+  int output_state_nonlinear(
+                             struct output_state_buffer * psb,
+                             struct nonlinear * pnl,
+                             ErrorMsg error_message
+                             );
+
+  int output_state_spectra(
+                           struct output_state_buffer * psb,
+                           struct spectra * psp,
+                           ErrorMsg error_message
+                           );
+
+  int output_state_lensing(
+                           struct output_state_buffer * psb,
+                           struct lensing * ple,
+                           ErrorMsg error_message
+                           );
+
+  int output_state_all(
+                       struct output_state_buffer * psb,
+                       short * has_module,
+                       struct background * pba,
+                       struct thermo * pth,
+                       struct primordial * ppm,
+                       struct nonlinear * pnl,
+                       struct spectra * psp,
+                       struct lensing * ple,
+                       ErrorMsg error_message
+                       );
+
+  int output_state_pack(
+                        struct background * pba,
+                        struct thermo * pth,
+                        struct primordial * ppm,
+                        struct nonlinear * pnl,
+                        struct spectra * psp,
+                        struct lensing * ple,
+                        char ** state,
+                        size_t * state_size,
+                        ErrorMsg error_message
+                        );
+
+  int output_state_unpack(
+                          char * state,
+                          size_t state_size,
+                          struct background * pba,
+                          struct thermo * pth,
+                          struct primordial * ppm,
+                          struct nonlinear * pnl,
+                          struct spectra * psp,
+                          struct lensing * ple,
+                          short * has_module,
+                          ErrorMsg error_message
+                          );
+
+  int output_state_free(
+                        struct background * pba,
+                        struct thermo * pth,
+                        struct primordial * ppm,
+                        struct nonlinear * pnl,
+                        struct spectra * psp,
+                        struct lensing * ple
+                        );
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,6 +15,10 @@ struct file_content {
   FileArg * name;  /**< list of (size) names */
   FileArg * value; /**< list of (size) values */
   short * read;    /**< set to _TRUE_ if this parameter is effectively read */
+  int index_entries; /**< number of entries covered by the hash index (the index is rebuilt when it differs from size) */
+  int index_size;    /**< number of slots in the hash index (a power of two) */
+  int * index;       /**< hash index of names: position of the first entry with that name, or -1 for an empty slot; NULL until built */
+  int * next;        /**< list of (size) positions of the next entry with the same name, or -1 */
 };
 
 /**************************************************************/
@@ -43,6 +47,22 @@ int parser_free(
 		struct file_content * pfc
 		);
 
+int parser_index(
+		 struct file_content * pfc,
+		 ErrorMsg errmsg
+		 );
+
+int parser_find(
+		struct file_content * pfc,
+		char * name,
+		int * index,
+		ErrorMsg errmsg
+		);
+
+unsigned int parser_hash(
+			 char * string
+			 );
+
 int parser_read_line(
 		char * line,
 		int * is_data,
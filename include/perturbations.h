@@ -11,7 +11,45 @@
 #define _vectors_ ((ppt->has_vectors == _TRUE_) && (index_md == ppt->index_md_vectors))
 #define _tensors_ ((ppt->has_tensors == _TRUE_) && (index_md == ppt->index_md_tensors))
 
-#define _set_source_(index) ppt->sources[index_md][index_ic * ppt->tp_size[index_md] + index][index_tau * ppt->k_size[index_md] + index_k]
+/**
+ * Type of the elements of the source function tables. Compiling with
+ * -DSINGLE_PRECISION_SOURCES (see the Makefile) stores them, and
+ * their second derivatives in the transfer module, as float. This
+ * halves the largest memory footprint of the code, while all
+ * arithmetic is still performed in double precision.
+ */
+
+#ifdef SINGLE_PRECISION_SOURCES
+typedef float source_t;
+#define _MPI_SOURCE_T_ MPI_FLOAT
+#else
+typedef double source_t;
+#define _MPI_SOURCE_T_ MPI_DOUBLE
+#endif
+
+/**
+ * Position of the element (index_tau, index_k) in a table of source
+ * functions of mode index_md. The tables are either stored untiled,
+ * as [index_tau*k_size+index_k], or, when ppt->tile_k_size is
+ * non-zero, in tiles of tile_tau_size x tile_k_size values. Tiles of
+ * the same range of k follow each other, and inside a tile the
+ * values at fixed k are contiguous in tau: the transfer module reads
+ * the sources along tau for neighbouring values of k.
+ */
+
+#define _source_index_(index_tau,index_k) \
+  (ppt->tile_k_size == 0 ? (index_tau) * ppt->k_size[index_md] + (index_k) : \
+   ((((index_k) / ppt->tile_k_size * ppt->tau_tile_number + (index_tau) / ppt->tile_tau_size) \
+     * ppt->tile_k_size + (index_k) % ppt->tile_k_size) * ppt->tile_tau_size + (index_tau) % ppt->tile_tau_size))
+
+/** Number of elements of a table of source functions of mode index_md, including the padding of the last tiles */
+
+#define _source_table_size_ \
+  (ppt->tile_k_size == 0 ? ppt->k_size[index_md] * ppt->tau_size : \
+   (ppt->k_size[index_md] + ppt->tile_k_size - 1) / ppt->tile_k_size * ppt->tile_k_size \
+   * ppt->tau_tile_number * ppt->tile_tau_size)
+
+#define _set_source_(index) ppt->sources[index_md][index_ic * ppt->tp_size[index_md] + index][_source_index_(index_tau,index_k)]
 
 /**
  * flags for various approximation schemes
@@ -60,6 +98,23 @@ enum possible_gauges {
 
 //@}
 
+/**
+ * List of kernels computing the derivatives of the perturbations. The
+ * specialised kernels are compiled with all model flags fixed, and
+ * are used for the most common scalar-mode models when the precision
+ * parameter perturb_specialised_derivs is set.
+ */
+
+//@{
+
+enum derivs_kernels {
+  dk_generic,               /**< any model: all model flags tested at run time */
+  dk_lcdm_synchronous,      /**< scalars, synchronous gauge, flat, cdm + ur only */
+  dk_lcdm_ncdm_synchronous  /**< scalars, synchronous gauge, flat, cdm + ur + ncdm only */
+};
+
+//@}
+
 //@{
 
 /**
@@ -80,6 +135,38 @@ enum selection_type {gaussian,tophat,dirac};
 
 //@}
 
+//@{
+
+/**
+ * columns of the table of integration statistics, with one row for
+ * each mode, initial condition and wavenumber. The six counters from
+ * pfl_steps to pfl_solves follow the order of the statistics returned
+ * by the evolvers.
+ */
+enum profile_columns {
+  pfl_md,           /**< index of the mode */
+  pfl_ic,           /**< index of the initial condition */
+  pfl_k,            /**< wavenumber in 1/Mpc */
+  pfl_process,      /**< index of the MPI process (0 without MPI) */
+  pfl_thread,       /**< index of the thread within this process */
+  pfl_time,         /**< wall time spent in perturb_solve(), in s */
+  pfl_intervals,    /**< number of intervals with a uniform approximation scheme */
+  pfl_tau_ini,      /**< initial conformal time of the integration */
+  pfl_tau_tca,      /**< conformal time at which tight-coupling is switched off (0 if never) */
+  pfl_tau_rsa,      /**< conformal time at which radiation streaming is switched on (0 if never) */
+  pfl_tau_ufa,      /**< conformal time at which the ur fluid approximation is switched on (0 if never) */
+  pfl_tau_ncdmfa,   /**< conformal time at which the ncdm fluid approximation is switched on (0 if never) */
+  pfl_steps,        /**< number of successful steps */
+  pfl_failed_steps, /**< number of failed steps */
+  pfl_derivs,       /**< number of calls to perturb_derivs() */
+  pfl_jacobians,    /**< number of Jacobians computed (ndf15 only) */
+  pfl_lu,           /**< number of LU decompositions (ndf15 only) */
+  pfl_solves,       /**< number of linear solves (ndf15 only) */
+  pfl_size          /**< number of columns */
+};
+
+//@}
+
 
 
 /**
@@ -141,6 +228,9 @@ struct perturbs
   short has_nc_gr;       /**< in dCl, do we want gravity terms ? */
 
   int l_scalar_max; /**< maximum l value for CMB scalars \f$ C_l \f$'s */
+  int l_scalar_max_cmb_temperature;       /**< maximum l value for which the scalar CMB temperature transfer functions are needed (at most l_scalar_max) */
+  int l_scalar_max_cmb_polarization;      /**< maximum l value for which the scalar CMB polarization transfer functions are needed (at most l_scalar_max) */
+  int l_scalar_max_cmb_lensing_potential; /**< maximum l value for which the CMB lensing potential transfer functions are needed (at most l_scalar_max) */
   int l_vector_max; /**< maximum l value for CMB vectors \f$ C_l \f$'s */
   int l_tensor_max; /**< maximum l value for CMB tensors \f$ C_l \f$'s */
   int l_lss_max; /**< maximum l value for LSS \f$ C_l \f$'s (density and lensing potential in  bins) */
@@ -160,6 +250,8 @@ struct perturbs
   double eisw_lisw_split_z; /**< at which redshift do we define the cut between eisw and lisw ?*/
 
   int store_perturbations;  /**< Do we want to store perturbations? */
+  short stream_perturbations; /**< if _TRUE_, perturbations of selected wavenumbers are written to binary files while each wavenumber is integrated, instead of being stored in scalar/vector/tensor_perturbations_data */
+  FileName stream_root; /**< root of the file names of streamed perturbations (copied from the output root) */
   int k_output_values_num;       /**< Number of perturbation outputs (default=0) */
   double k_output_values[_MAX_NUMBER_OF_K_FILES_];    /**< List of k values where perturbation output is requested. */
   int *index_k_output_values; /**< List of indices corresponding to k-values close to k_output_values for each mode. [index_md*k_output_values_num+ik]*/
@@ -174,6 +266,11 @@ struct perturbs
   double * scalar_perturbations_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of double pointers to perturbation output for scalars */
   double * vector_perturbations_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of double pointers to perturbation output for vectors */
   double * tensor_perturbations_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of double pointers to perturbation output for tensors */
+
+  short store_profile;  /**< Do we want to store integration statistics for each mode, initial condition and wavenumber? */
+  char profile_titles[_MAXTITLESTRINGLENGTH_]; /**< _DELIMITER_ separated string of titles for the columns of profile_data, in the order of enum profile_columns */
+  int profile_rows;     /**< number of rows of profile_data (sum over modes of ic_size*k_size) */
+  double * profile_data; /**< table of integration statistics, profile_data[row*pfl_size+column], with row running over modes, then initial conditions, then wavenumbers (NULL unless store_profile is set) */
  int size_scalar_perturbation_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of sizes of scalar double pointers  */
  int size_vector_perturbation_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of sizes of vector double pointers  */
  int size_tensor_perturbation_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of sizes of tensor double pointers  */
@@ -349,10 +446,14 @@ struct perturbs
 
   //@{
 
-  double *** sources; /**< Pointer towards the source interpolation table
+  source_t *** sources; /**< Pointer towards the source interpolation table
                          sources[index_md]
                          [index_ic * ppt->tp_size[index_md] + index_type]
-                         [index_tau * ppt->k_size + index_k] */
+                         [_source_index_(index_tau,index_k)] */
+
+  int tile_tau_size;   /**< number of values of tau in one tile of the source tables */
+  int tile_k_size;     /**< number of values of k in one tile of the source tables (zero if the tables are not tiled) */
+  int tau_tile_number; /**< number of tiles covering the range of tau */
 
 
   //@}
@@ -363,6 +464,12 @@ struct perturbs
 
   short perturbations_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  struct perturb_workspace_pool * workspace_pool; /**< optional pool of workspaces kept between runs (NULL by default, see perturb_workspace_pool_init()) */
+
+  struct perturb_switch_table * switch_table; /**< switch_table[index_md]: approximation switching times on a coarse grid of wavenumbers, only allocated during perturb_init() (NULL otherwise) */
+
+  struct class_profile profile; /**< resources used by perturb_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
@@ -501,7 +608,9 @@ struct perturb_workspace
   double delta_m;	/**< relative density perturbation of all non-relativistic species */
   double theta_m;	/**< velocity divergence theta of all non-relativistic species */
 
-  FILE * perturb_output_file; /**< filepointer to output file*/
+  FILE * perturb_output_file; /**< filepointer to output file (only when perturbations are streamed, otherwise NULL) */
+  double * perturb_output_row; /**< one row of streamed perturbations, filled by perturb_print_variables() */
+  int perturb_output_rows;     /**< number of rows streamed so far to perturb_output_file */
   int index_ikout;            /**< index for output k value (when k_output_values is set) */
 
   //@}
@@ -515,6 +624,18 @@ struct perturb_workspace
   int last_index_back;   /**< the background interpolation function background_at_tau() keeps memory of the last point called through this index */
   int last_index_thermo; /**< the thermodynamics interpolation function thermodynamics_at_z() keeps memory of the last point called through this index */
 
+  double lookup_tau;       /**< conformal time at which perturb_vectors_at_tau() last filled pvecback (and maybe pvecthermo) */
+  short lookup_inter_mode; /**< interpolation mode used for this lookup */
+  short lookup_content;    /**< 0 if pvecback and pvecthermo hold nothing valid, 1 if only pvecback is filled at lookup_tau, 2 if both are */
+
+  double * profile; /**< row of ppt->profile_data for the wavenumber being integrated (NULL if statistics are not stored) */
+
+  struct ndf15_arena ndf15_arena; /**< memory kept between calls to the stiff evolver by this workspace, grown to the largest system of equations met */
+
+  enum derivs_kernels derivs_kernel; /**< kernel used by perturb_derivs() for this mode, chosen once in perturb_workspace_init() */
+
+  sp_ord * ordering_cache; /**< orderings of the sparse Jacobians already met by the stiff evolver in this workspace, reused for all subsequent wavenumbers sharing the same sparsity pattern (i.e. the same approximation scheme) */
+
   //@}
 
   /** @name - approximations used at a given time */
@@ -542,6 +663,69 @@ struct perturb_workspace
 
 };
 
+/**
+ * Number of integers describing the parameters which determine the
+ * content of a workspace (see perturb_workspace_key()), not counting
+ * the one integer per non-cold dark matter species
+ */
+
+#define _PERTURB_WORKSPACE_KEY_SIZE_ 25
+
+/**
+ * Pool of workspaces which can survive between several runs with the
+ * same precision settings (e.g. in a Markov chain). When
+ * ppt->workspace_pool points to such a structure, perturb_init() takes
+ * the workspaces from the pool instead of allocating them, and leaves
+ * them in the pool at the end, together with everything they have
+ * learnt (e.g. the orderings of sparse Jacobians). The caller must
+ * create it with perturb_workspace_pool_init() and release it with
+ * perturb_workspace_pool_free() after the last run.
+ */
+
+struct perturb_workspace_pool {
+
+  int md_size;                     /**< number of modes for which workspaces are kept */
+  int number_of_threads;           /**< number of workspaces kept for each mode */
+  struct perturb_workspace ** ppw; /**< ppw[index_md*number_of_threads+thread], NULL if not allocated yet */
+  int ** key;                      /**< key[index_md*number_of_threads+thread]: parameters for which each workspace was built, NULL if not allocated yet */
+  int * key_size;                  /**< key_size[index_md*number_of_threads+thread]: number of integers in the above key */
+
+};
+
+/**
+ * Maximum number of switches of one approximation stored in a struct
+ * perturb_switch_table
+ */
+
+#define _PERTURB_SWITCHES_MAX_ 4
+
+/**
+ * Half-width of the first bracket tried by
+ * perturb_find_approximation_switches() around the interpolated
+ * switching time, in units of the difference between the switching
+ * times of the two enclosing coarse wavenumbers
+ */
+
+#define _PERTURB_SWITCH_BRACKET_ 0.05
+
+/**
+ * Approximation switching times for a given mode on a coarse grid of
+ * wavenumbers (one every ppr->tau_approx_k_step). These times are
+ * smooth in k, and perturb_find_approximation_switches() uses the
+ * ones of the two coarse wavenumbers enclosing k to restrict its
+ * bisections.
+ */
+
+struct perturb_switch_table {
+
+  int k_size;   /**< number of coarse wavenumbers (0 if the table is not usable yet) */
+  int ap_size;  /**< number of approximations of this mode */
+  double * k;   /**< k[index_k]: coarse wavenumbers, in growing order */
+  int * number; /**< number[index_k*ap_size+index_ap]: number of switches of each approximation (-1 if more than _PERTURB_SWITCHES_MAX_) */
+  double * tau; /**< tau[(index_k*ap_size+index_ap)*_PERTURB_SWITCHES_MAX_+index_switch]: switching times */
+
+};
+
 /**
  * Structure pointing towards all what the function that perturb_derivs
  * needs to know: fixed input parameters and indices contained in the
@@ -587,10 +771,70 @@ extern "C" {
                    struct perturbs * ppt
                    );
 
+  int perturb_init_indices(
+                           struct precision * ppr,
+                           struct background * pba,
+                           struct thermo * pth,
+                           struct perturbs * ppt
+                           );
+
+  int perturb_init_sources(
+                           struct precision * ppr,
+                           struct background * pba,
+                           struct thermo * pth,
+                           struct perturbs * ppt
+                           );
+
   int perturb_free(
                    struct perturbs * ppt
                    );
 
+  int perturb_free_sources(
+                           struct perturbs * ppt
+                           );
+
+  int perturb_sources_first_touch(
+                                  struct precision * ppr,
+                                  struct perturbs * ppt,
+                                  int index_md,
+                                  source_t * source
+                                  );
+
+  int perturb_workspace_pool_init(
+                                  struct perturb_workspace_pool * pool
+                                  );
+
+  int perturb_workspace_pool_free(
+                                  struct perturb_workspace_pool * pool
+                                  );
+
+  int perturb_workspace_pool_resize(
+                                    struct perturb_workspace_pool * pool,
+                                    int md_size,
+                                    int number_of_threads,
+                                    ErrorMsg error_message
+                                    );
+
+  int perturb_workspace_pool_get(
+                                 struct precision * ppr,
+                                 struct background * pba,
+                                 struct thermo * pth,
+                                 struct perturbs * ppt,
+                                 int index_md,
+                                 int thread,
+                                 struct perturb_workspace ** ppw
+                                 );
+
+  int perturb_workspace_key(
+                            struct precision * ppr,
+                            struct background * pba,
+                            struct thermo * pth,
+                            struct perturbs * ppt,
+                            int index_md,
+                            int ** key,
+                            int * key_size
+                            );
+
   int perturb_indices_of_perturbs(
                                   struct precision * ppr,
                                   struct background * pba,
@@ -611,6 +855,45 @@ extern "C" {
                          struct perturbs * ppt
                          );
 
+  int perturb_k_adaptive_init(
+                              struct precision * ppr,
+                              struct perturbs * ppt,
+                              int index_md,
+                              short * k_todo
+                              );
+
+  int perturb_k_adaptive_refine(
+                                struct precision * ppr,
+                                struct perturbs * ppt,
+                                int index_md,
+                                short * k_done,
+                                short * k_todo,
+                                int * number_of_new_k
+                                );
+
+  int perturb_k_adaptive_compact(
+                                 struct precision * ppr,
+                                 struct perturbs * ppt,
+                                 int index_md,
+                                 short * k_done,
+                                 int profile_row
+                                 );
+
+  int perturb_solve_task_pool(
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermo * pth,
+                              struct perturbs * ppt,
+                              int index_md_first,
+                              int index_md_last,
+                              short ** k_todo,
+                              short ** k_done,
+                              struct perturb_workspace *** pppw,
+                              int number_of_threads,
+                              int process,
+                              int number_of_processes
+                              );
+
   int perturb_workspace_init(
                              struct precision * ppr,
                              struct background * pba,
@@ -637,6 +920,30 @@ extern "C" {
                     struct perturb_workspace * ppw
                     );
 
+  int perturb_find_initial_time(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermo * pth,
+                                struct perturbs * ppt,
+                                double k,
+                                struct perturb_workspace * ppw,
+                                double * tau_ini
+                                );
+
+  int perturb_estimate_cost(
+                            struct precision * ppr,
+                            struct background * pba,
+                            struct thermo * pth,
+                            struct perturbs * ppt,
+                            int index_md,
+                            int index_k,
+                            struct perturb_workspace * ppw,
+                            double * cost
+                            );
+
+  int perturb_compare_cost(const void * a,
+                           const void * b);
+
   int perturb_find_approximation_number(
                                         struct precision * ppr,
                                         struct background * pba,
@@ -665,9 +972,35 @@ extern "C" {
                                           int interval_number,
                                           int * interval_number_of,
                                           double * interval_limit,
-                                          int ** interval_approx
+                                          int ** interval_approx,
+                                          double * tau_switch
                                           );
 
+  int perturb_switch_table_init(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermo * pth,
+                                struct perturbs * ppt,
+                                int index_md,
+                                struct perturb_workspace ** ppw,
+                                int number_of_threads
+                                );
+
+  int perturb_switch_table_at_k(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermo * pth,
+                                struct perturbs * ppt,
+                                int index_md,
+                                int index_k,
+                                struct perturb_workspace * ppw,
+                                struct perturb_switch_table * pst
+                                );
+
+  int perturb_switch_table_free(
+                                struct perturbs * ppt
+                                );
+
   int perturb_vector_init(
                           struct precision * ppr,
                           struct background * pba,
@@ -707,6 +1040,16 @@ extern "C" {
                              struct perturb_workspace * ppw
                              );
 
+  int perturb_vectors_at_tau(
+                             struct background * pba,
+                             struct thermo * pth,
+                             struct perturb_workspace * ppw,
+                             double tau,
+                             short inter_mode,
+                             short with_thermo,
+                             ErrorMsg error_message
+                             );
+
   int perturb_timescale(
                         double tau,
                         void * parameters_and_workspace,
@@ -762,6 +1105,24 @@ extern "C" {
                      ErrorMsg error_message
                      );
 
+  int perturb_jacobian(
+                       double tau,
+                       double * y,
+                       double * dy,
+                       sp_mat * J,
+                       short * has_jacobian,
+                       int * nfe,
+                       void * parameters_and_workspace,
+                       ErrorMsg error_message
+                       );
+
+  int perturb_jacobian_hierarchy(
+                                 int index_l0,
+                                 int l_max,
+                                 int * row_min,
+                                 int * row_max
+                                 );
+
   int perturb_tca_slip_and_shear(
                                  double * y,
                                  void * parameters_and_workspace,
@@ -784,7 +1145,12 @@ extern "C" {
                                   struct perturbs * ppt,
                                   struct perturb_workspace * ppw,
                                   int index_ikout,
-                                  int index_md);
+                                  int index_md,
+                                  int index_ic,
+                                  double k);
+
+  int perturb_close_output_file(struct perturbs * ppt,
+                                struct perturb_workspace * ppw);
 
   int perturb_prepare_output(struct background * pba,
                              struct perturbs * ppt);
@@ -69,6 +69,39 @@ enum inflation_module_behavior {
   analytical
 };
 
+struct primordial;
+
+/**
+ * Function computing the primordial spectra in the 'external_Pk' mode
+ * inside the process, instead of running an external command and
+ * parsing its output.
+ *
+ * A function is registered once per process with
+ * primordial_external_function_register(), and then selected in the
+ * input with 'external_Pk_function = <name>' (in place of
+ * 'command'). It is called by primordial_init() on the usual grid of
+ * ln(k) values, and receives the parameters custom1 to custom10 in
+ * the primordial structure.
+ */
+
+struct primordial_external_function {
+
+  const char * name; /**< name selecting this function in the input */
+
+  void * parameters; /**< function-specific data passed to spectrum(), owned by the caller of primordial_external_function_register() */
+
+  int (*spectrum)(struct primordial_external_function * pef,
+                  struct primordial * ppm,
+                  int lnk_size,
+                  double * lnk,
+                  double * lnpk_scalars,
+                  double * lnpk_tensors,
+                  ErrorMsg error_message); /**< fill lnpk_scalars[index_k] with \f$ \ln P_R(k) \f$ and, unless it is NULL, lnpk_tensors[index_k] with \f$ \ln P_h(k) \f$, for each lnk[index_k] */
+
+  struct primordial_external_function * next; /**< next registered function */
+
+};
+
 /**
  * Structure containing everything about primordial spectra that other modules need to know.
  *
@@ -196,6 +229,8 @@ struct primordial {
   double custom9;  /**< one parameter of the primordial computed in 'external_Pk' */
   double custom10; /**< one parameter of the primordial computed in 'external_Pk' */
 
+  struct primordial_external_function * external_function; /**< registered function computing the spectra in 'external_Pk' mode, or NULL to run the command */
+
   //@}
 
   /** @name - pre-computed table of primordial spectra, and related quantities */
@@ -296,6 +331,8 @@ struct primordial {
 
   //@}
 
+  struct class_profile profile; /**< resources used by primordial_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
 };
@@ -344,6 +381,15 @@ extern "C" {
                                double * pk
                                );
 
+  int primordial_spectrum_at_k_vector(
+                                      struct primordial * ppm,
+                                      int index_md,
+                                      enum linear_or_logarithmic mode,
+                                      double * input,
+                                      int input_size,
+                                      double * output
+                                      );
+
   int primordial_init(
                       struct precision  * ppr,
                       struct perturbs   * ppt,
@@ -420,6 +466,22 @@ extern "C" {
                                    double * y_ini
                                    );
 
+  int primordial_inflation_spectra_list(
+                                        struct perturbs * ppt,
+                                        struct primordial * ppm,
+                                        struct precision * ppr,
+                                        double * y_ini,
+                                        int * index_k_list,
+                                        int list_size
+                                        );
+
+  int primordial_inflation_spectra_adaptive(
+                                            struct perturbs * ppt,
+                                            struct primordial * ppm,
+                                            struct precision * ppr,
+                                            double * y_ini
+                                            );
+
   int primordial_inflation_one_wavenumber(
                                           struct perturbs * ppt,
                                           struct primordial * ppm,
@@ -504,6 +566,21 @@ extern "C" {
                                         struct primordial * ppm
                                         );
 
+  int primordial_external_function_spectrum_init(
+                                                 struct perturbs * ppt,
+                                                 struct primordial * ppm
+                                                 );
+
+  int primordial_external_function_register(
+                                            struct primordial_external_function * pef,
+                                            ErrorMsg error_message
+                                            );
+
+  int primordial_external_function_find(
+                                        char * name,
+                                        struct primordial_external_function ** ppef
+                                        );
+
   int primordial_output_titles(struct perturbs * ppt,
                                struct primordial * ppm,
                                char titles[_MAXTITLESTRINGLENGTH_]
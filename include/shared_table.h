@@ -0,0 +1,81 @@
+/**
+ * definitions for module shared_table.c
+ */
+
+#ifndef __SHARED_TABLE__
+#define __SHARED_TABLE__
+
+#include "common.h"
+
+#define _SHARED_TABLE_VERSION_ 1 /**< version of the layout of the files written by shared_table_get() */
+
+/**
+ * Function filling a table of doubles of a given size, called by
+ * shared_table_get() when the table is not found in the cache
+ * directory: build(context,data,errmsg)
+ */
+
+typedef int (*shared_table_builder)(void * context, double * data, ErrorMsg errmsg);
+
+/**
+ * Table of doubles which depends only on some precision parameters
+ * (its key), shared by all the processes of a node: it is built by
+ * the first process asking for it, written to a file of a cache
+ * directory, and then mapped read-only by all processes (including
+ * the first one), so that they all use the same physical pages.
+ */
+
+struct shared_table {
+
+  double * data;       /**< the table (inside the mapping, or allocated if mapping is NULL) */
+  size_t data_size;    /**< number of doubles in the table */
+  void * mapping;      /**< start of the read-only mapping of the cache file, or NULL if data was allocated */
+  size_t mapping_size; /**< size in bytes of the mapping */
+
+};
+
+/**
+ * Header of the files written by shared_table_get(), followed by the
+ * key (padded to a multiple of 8 bytes) and by the table
+ */
+
+struct shared_table_header {
+
+  char magic[8];         /**< "CLASSTAB" */
+  int format_version;    /**< _SHARED_TABLE_VERSION_ */
+  int key_size;          /**< size in bytes of the key */
+  char kind[16];         /**< kind of table (also in the file name) */
+  unsigned long long data_size; /**< number of doubles in the table */
+
+};
+
+/**************************************************************/
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int shared_table_get(
+                       char * directory,
+                       char * kind,
+                       void * key,
+                       size_t key_size,
+                       size_t data_size,
+                       shared_table_builder build,
+                       void * context,
+                       struct shared_table * table,
+                       ErrorMsg errmsg
+                       );
+
+  int shared_table_free(
+                        struct shared_table * table
+                        );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,6 +32,17 @@ typedef struct sparse_numerical{
 	double *w;		/* Work array for sp_lu */
 } sp_num;
 
+typedef struct sparse_ordering{
+	/* Column ordering found by sp_amd for one sparsity pattern. Orderings are kept in a
+	   linked list, so that they can be reused for all matrices sharing the same pattern: */
+	int n;			/* Matrix assumed square, [nxn] */
+	int nz;			/* Number of entries in the pattern */
+	int *Ap;		/* Ap[0..n]. Column pointers of the pattern. */
+	int *Ai;		/* Ai[0..(nz-1)]. Row indices of the pattern. */
+	int *q;			/* q[0..n]. Column permutation (n+1 like in sp_num). */
+	struct sparse_ordering *next;
+} sp_ord;
+
 
 /**
  * Boilerplate for C++
@@ -52,6 +63,9 @@ int sp_lusolve(sp_num *N, double *b, double *x);
 int sp_refactor(sp_num *N, sp_mat *A);
 int column_grouping(sp_mat *G, int *col_g, int *col_wi);
 int sp_amd(int *Cp, int *Ci, int n, int cnzmax, int *P, int *W);
+int sp_ord_lookup(sp_ord **list, sp_mat *A, int *q, int *found);
+int sp_ord_store(sp_ord **list, sp_mat *A, int *q, int max_entries, ErrorMsg error_message);
+int sp_ord_free(sp_ord *list);
 int sp_wclear(int mark, int lemax, int *w, int n);
 int sp_tdfs(int j, int k, int *head, const int *next, int *post, int *stack);
 
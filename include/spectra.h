@@ -4,6 +4,7 @@
 #define __SPECTRA__
 
 #include "transfer.h"
+#include "fftlog.h"
 
 /**
  * Structure containing everything about anisotropy and Fourier power spectra that other modules need to know.
@@ -125,6 +126,10 @@ struct spectra {
   double ** cl;   /**< table of anisotropy spectra for each mode, multipole, pair of initial conditions and types, cl[index_md][(index_l * psp->ic_ic_size[index_md] + index_ic1_ic2) * psp->ct_size + index_ct] */
   double ** ddcl; /**< second derivatives of previous table with respect to l, in view of spline interpolation */
 
+  double * cl_tot_dense;     /**< total \f$ C_l\f$'s interpolated once for all at each integer l up to l_max_tot, cl_tot_dense[l * psp->ct_size + index_ct] (zero for l<2); a spectrum up to some l_max can be read directly from this table */
+  double ** cl_md_dense;     /**< same for each mode, cl_md_dense[index_md][l * psp->ct_size + index_ct] (only allocated if md_size>1) */
+  double ** cl_md_ic_dense;  /**< same for each mode and pair of initial conditions, cl_md_ic_dense[index_md][(l * psp->ic_ic_size[index_md] + index_ic1_ic2) * psp->ct_size + index_ct] (only allocated for modes with several initial conditions) */
+
   double alpha_II_2_20;	/**< parameter describing adiabatic versus isocurvature contribution in mutipole range [2,20] (see Planck parameter papers) */
   double alpha_RI_2_20;	/**< parameter describing adiabatic versus isocurvature contribution in mutipole range [2,20] (see Planck parameter papers) */
   double alpha_RR_2_20;	/**< parameter describing adiabatic versus isocurvature contribution in mutipole range [2,20] (see Planck parameter papers) */
@@ -194,6 +199,19 @@ struct spectra {
                     */
   double * ddln_pk_nl; /**< second derivative of above array with respect to log(tau), for spline interpolation. */
 
+  short has_correlations; /**< do we want the real-space tables below, computed from P(k) with FFTLog? */
+
+  int ln_r_size;    /**< number of ln(r) values */
+  double * ln_r;    /**< list of ln(r) values ln_r[index_r], with r in Mpc */
+
+  double * xi;      /**< linear matter correlation function,
+                       xi[index_tau * psp->ln_r_size + index_r] */
+  double * ddxi;    /**< second derivative of above array with respect to log(tau), for spline interpolation. */
+
+  double * sigma_r; /**< r.m.s. of linear matter fluctuations in spheres of radius R=r,
+                       sigma_r[index_tau * psp->ln_r_size + index_r] */
+  double * ddsigma_r; /**< second derivative of above array with respect to log(tau), for spline interpolation. */
+
   int index_tr_delta_g;        /**< index of gamma density transfer function */
   int index_tr_delta_b;        /**< index of baryon density transfer function */
   int index_tr_delta_cdm;      /**< index of cold dark matter density transfer function */
@@ -236,6 +254,8 @@ struct spectra {
 
   short spectra_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  struct class_profile profile; /**< resources used by spectra_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
@@ -267,6 +287,18 @@ extern "C" {
                       double ** cl_md_ic
                       );
 
+  int spectra_cl_at_l_spline(
+                             struct spectra * psp,
+                             double l,
+                             double * cl,
+                             double ** cl_md,
+                             double ** cl_md_ic
+                             );
+
+  int spectra_cl_dense(
+                       struct spectra * psp
+                       );
+
   int spectra_pk_at_z(
                       struct background * pba,
                       struct spectra * psp,
@@ -303,6 +335,26 @@ extern "C" {
                                double * pk_tot
                                );
 
+  int spectra_pk_at_k_and_z_vector(
+                                   struct background * pba,
+                                   struct primordial * ppm,
+                                   struct spectra * psp,
+                                   short nonlinear,
+                                   double * k,
+                                   int k_size,
+                                   double * z,
+                                   int z_size,
+                                   double * pk_tot
+                                   );
+
+  int spectra_correlations_at_z(
+                                struct background * pba,
+                                struct spectra * psp,
+                                double z,
+                                double * xi,
+                                double * sigma_r
+                                );
+
   int spectra_tk_at_z(
                       struct background * pba,
                       struct spectra * psp,
@@ -348,23 +400,37 @@ extern "C" {
                   struct spectra * psp
                   );
 
-  int spectra_compute_cl(
+  int spectra_cl_weights(
                          struct background * pba,
-                         struct perturbs * ppt,
                          struct transfers * ptr,
                          struct primordial * ppm,
                          struct spectra * psp,
                          int index_md,
+                         double * cl_weight
+                         );
+
+  int spectra_compute_cl(
+                         struct perturbs * ppt,
+                         struct transfers * ptr,
+                         struct spectra * psp,
+                         int index_md,
                          int index_ic1,
                          int index_ic2,
                          int index_l,
-                         int cl_integrand_num_columns,
-                         double * cl_integrand,
-                         double * primordial_pk,
-                         double * transfer_ic1,
-                         double * transfer_ic2
+                         double * cl_weight,
+                         double * cl_workspace
                          );
 
+  int spectra_cl_integral(
+                          int q_size,
+                          double * __restrict__ cl_weight,
+                          double * a1,
+                          double * b2,
+                          double * b1,
+                          double * a2,
+                          double * cl
+                          );
+
   int spectra_k_and_tau(
                         struct background * pba,
                         struct perturbs * ppt,
@@ -379,6 +445,11 @@ extern "C" {
                  struct spectra * psp
                  );
 
+  int spectra_correlations(
+                           struct precision * ppr,
+                           struct spectra * psp
+                           );
+
   int spectra_sigma(
                     struct background * pba,
                     struct primordial * ppm,
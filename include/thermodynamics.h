@@ -185,6 +185,14 @@ struct thermo
 
   //@}
 
+  /** @name - uniform grid in z for finding positions in the above tables without bisection (index set to NULL when not used) */
+
+  //@{
+
+  struct array_lookup z_lookup; /**< uniform grid in z indexing z_table */
+
+  //@}
+
 
   /** @name - redshift, conformal time and sound horizon at recombination */
 
@@ -247,6 +255,11 @@ struct thermo
 
   short thermodynamics_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  struct recombination_cache * recombination_cache; /**< optional cache of recombination histories kept between runs (NULL by default, see thermodynamics_recombination_cache_init()) */
+  struct recombination_response * recombination_response; /**< optional linear response of the RECFAST history around a fiducial model, kept between runs (NULL by default, see thermodynamics_recombination_response_init()) */
+
+  struct class_profile profile; /**< resources used by thermodynamics_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
@@ -433,6 +446,104 @@ struct reionization {
 
 };
 
+/**
+ * number of parameters compared, together with a hash of the
+ * background tables, to decide whether a recombination history can be
+ * taken from a struct recombination_cache
+ */
+
+#define _RECOMBINATION_CACHE_KEY_SIZE_ 52
+
+/**
+ * Cache of recombination histories which can survive between several
+ * runs (e.g. in a Markov chain where most steps only vary primordial
+ * or nuisance parameters). When pth->recombination_cache points to
+ * such a structure, thermodynamics_recombination() first looks for a
+ * history computed with exactly the same inputs (thermodynamics and
+ * precision parameters, and background tables), and only runs RECFAST
+ * or HyRec if none is found; the new history then replaces the least
+ * recently used one. The caller must create it with
+ * thermodynamics_recombination_cache_init() and release it with
+ * thermodynamics_recombination_cache_free() after the last run.
+ */
+
+struct recombination_cache {
+
+  int size;                       /**< maximum number of histories kept */
+  int number;                     /**< number of histories currently kept */
+  int clock;                      /**< number of lookups so far, used to find the least recently used history */
+  int hits;                       /**< number of lookups which found a history */
+  int misses;                     /**< number of lookups which did not */
+  double * key;                   /**< key[index_entry*_RECOMBINATION_CACHE_KEY_SIZE_+i]: parameters of each history */
+  unsigned long long * hash;      /**< hash[index_entry]: hash of the background tables and file names used for each history */
+  int * last_use;                 /**< last_use[index_entry]: value of clock when each history was last used */
+  double * n_e;                   /**< n_e[index_entry]: value of pth->n_e for each history */
+  struct recombination * reco;    /**< reco[index_entry]: copy of the recombination structure of each history, with its own table */
+
+};
+
+/**
+ * number of parameters with respect to which a struct
+ * recombination_response tabulates the derivatives of the RECFAST
+ * history: omega_b, omega_cdm, YHe and T_cmb
+ */
+
+#define _RECOMBINATION_RESPONSE_PARAMETERS_ 4
+
+/**
+ * relative tolerance on the inputs which must match the fiducial model
+ * of a struct recombination_response (some of them, like Neff, are
+ * derived from ratios which change by rounding errors with T_cmb)
+ */
+
+#define _RECOMBINATION_RESPONSE_TOLERANCE_ 1.e-10
+
+/**
+ * minimum number of lines of the thermodynamics table for sharing
+ * between threads the passes over the table in thermodynamics_init()
+ */
+
+#define _THERMO_TABLE_PARALLEL_MIN_SIZE_ 5000
+
+/**
+ * Linear response of the RECFAST history around a fiducial model,
+ * which can survive between several runs (e.g. in a Markov chain
+ * exploring a small region of parameter space). When
+ * pth->recombination_response points to such a structure, the first
+ * RECFAST run becomes the fiducial model: the logarithms of x_e, T_b
+ * and c_b^2 are tabulated together with their derivatives with
+ * respect to the logarithms of omega_b, omega_cdm, YHe and T_cmb,
+ * obtained by centred finite differences (eight more RECFAST runs,
+ * each with its own background). The following runs with the same
+ * other inputs, and with each of these four parameters within the
+ * trust region, then get their history from a first-order Taylor
+ * expansion instead of an integration; any other run falls back to
+ * RECFAST. The caller must create it with
+ * thermodynamics_recombination_response_init() and release it with
+ * thermodynamics_recombination_response_free() after the last run.
+ */
+
+struct recombination_response {
+
+  double trust_region;            /**< largest change of the logarithm of each parameter for which the expansion is used (the finite differences extend over half of it) */
+  short has_fiducial;             /**< _TRUE_ once the fiducial history and its derivatives are tabulated */
+  short vary_T_cmb;               /**< _FALSE_ if T_cmb must match the fiducial value exactly (models with non-cold dark matter, whose background depends on T_cmb in a way not reproduced for the finite differences, or finite differences beyond the allowed range of T_cmb) */
+  double key[_RECOMBINATION_CACHE_KEY_SIZE_]; /**< other inputs of the fiducial model, which must match up to _RECOMBINATION_RESPONSE_TOLERANCE_ (see thermodynamics_recombination_cache_key()) */
+  double ln_param[_RECOMBINATION_RESPONSE_PARAMETERS_]; /**< logarithms of omega_b, omega_cdm, YHe and T_cmb in the fiducial model */
+  struct recombination reco;      /**< recombination structure of the fiducial model, with its own table */
+  double * dln_table;             /**< dln_table[(index_param*reco.rt_size+index_z)*reco.re_size+index_re]: derivative of the logarithm of each column of reco.recombination_table with respect to the logarithm of each parameter (zero for the columns not expanded) */
+  int hits;                       /**< number of histories obtained from the expansion */
+  int fallbacks;                  /**< number of histories which had to be integrated after the fiducial one */
+
+};
+
+/**
+ * HyRec tables shared by all runs, defined in thermodynamics.c (which
+ * includes the HyRec headers giving their dimensions)
+ */
+
+struct hyrec_tables;
+
 /**
  * temporary  parameters and workspace passed to the thermodynamics_derivs function
  */
@@ -447,6 +558,9 @@ struct thermodynamics_parameters_and_workspace {
   /* workspace */
   double * pvecback;
 
+  /* line of the recombination table filled at the first output of thermodynamics_recombination_with_recfast_ndf15() */
+  int index_first_row;
+
 };
 
 /**************************************************************/
@@ -468,6 +582,14 @@ extern "C" {
 			  double * pvecthermo
 			  );
 
+  int thermodynamics_at_z_vector(
+                                 struct background * pba,
+                                 struct thermo * pth,
+                                 double * z,
+                                 int z_size,
+                                 double * pvecthermo_table
+                                 );
+
   int thermodynamics_init(
 			  struct precision * ppr,
 			  struct background * pba,
@@ -548,6 +670,82 @@ extern "C" {
 				   double * pvecback
 				   );
 
+  int thermodynamics_hyrec_tables(
+                                  struct precision * ppr,
+                                  struct hyrec_tables ** ptables,
+                                  ErrorMsg error_message
+                                  );
+
+  int thermodynamics_hyrec_tables_read(
+                                       void * context,
+                                       double * data,
+                                       ErrorMsg error_message
+                                       );
+
+  int thermodynamics_recombination_cache_init(
+                                              struct recombination_cache * cache,
+                                              int size,
+                                              ErrorMsg error_message
+                                              );
+
+  int thermodynamics_recombination_cache_free(
+                                              struct recombination_cache * cache
+                                              );
+
+  int thermodynamics_recombination_cache_key(
+                                             struct precision * ppr,
+                                             struct background * pba,
+                                             struct thermo * pth,
+                                             short for_response,
+                                             double * key,
+                                             unsigned long long * hash
+                                             );
+
+  int thermodynamics_recombination_response_init(
+                                                 struct recombination_response * response,
+                                                 double trust_region,
+                                                 ErrorMsg error_message
+                                                 );
+
+  int thermodynamics_recombination_response_free(
+                                                 struct recombination_response * response
+                                                 );
+
+  int thermodynamics_recombination_response_parameters(
+                                                       struct precision * ppr,
+                                                       struct background * pba,
+                                                       struct thermo * pth,
+                                                       double * key,
+                                                       double * ln_param,
+                                                       short * usable
+                                                       );
+
+  int thermodynamics_recombination_response_build(
+                                                  struct precision * ppr,
+                                                  struct background * pba,
+                                                  struct thermo * pth,
+                                                  struct recombination * preco,
+                                                  double * pvecback,
+                                                  struct recombination_response * response,
+                                                  double * key,
+                                                  double * ln_param
+                                                  );
+
+  int thermodynamics_recombination_response_apply(
+                                                  struct precision * ppr,
+                                                  struct background * pba,
+                                                  struct thermo * pth,
+                                                  struct recombination * preco,
+                                                  struct recombination_response * response,
+                                                  double * ln_param
+                                                  );
+
+  unsigned long long thermodynamics_hash_bytes(
+                                               unsigned long long hash,
+                                               const void * data,
+                                               size_t size
+                                               );
+
   int thermodynamics_recombination_with_hyrec(
 						struct precision * ppr,
 						struct background * pba,
@@ -564,6 +762,32 @@ extern "C" {
 						double * pvecback
 						);
 
+  int thermodynamics_recombination_with_recfast_ndf15(
+                                                      struct precision * ppr,
+                                                      struct thermo * pth,
+                                                      struct recombination * preco,
+                                                      struct thermodynamics_parameters_and_workspace * ptpaw,
+                                                      double * y,
+                                                      int index_step
+                                                      );
+
+  int thermodynamics_derivs_with_recfast_ndf15(
+                                               double mz,
+                                               double * y,
+                                               double * dy,
+                                               void * parameters_and_workspace,
+                                               ErrorMsg error_message
+                                               );
+
+  int thermodynamics_recfast_ndf15_output(
+                                          double mz,
+                                          double * y,
+                                          double * dy,
+                                          int index_mz,
+                                          void * parameters_and_workspace,
+                                          ErrorMsg error_message
+                                          );
+
   int thermodynamics_derivs_with_recfast(
 					 double z,
 					 double * y,
@@ -12,6 +12,40 @@
 /* macro: test if index_tt is in the range between index and index+num, while the flag is true */
 #define _index_tt_in_range_(index,num,flag) (flag == _TRUE_) && (index_tt >= index) && (index_tt < index+num)
 
+/**
+ * when the number of (q, l-block) tasks is chosen automatically, the
+ * list of multipoles is split until there are at least this many
+ * tasks per thread
+ */
+
+#define _TRANSFER_TASKS_PER_THREAD_ 4
+
+/**
+ * maximum number of consecutive multipoles whose transfer functions are
+ * computed together, sharing the interpolation of the Bessel functions
+ */
+
+#define _TRANSFER_L_BLOCK_ 16
+
+#define _TRANSFER_ARENA_CHUNK_SIZE_ 1048576 /**< size in bytes of the chunks of the arena of the transfer structure; larger blocks get a chunk of their own */
+#define _TRANSFER_ARENA_ALIGNMENT_ 64 /**< alignment in bytes of the blocks of the arena (one cache line) */
+
+/**
+ * Memory of the tables of the transfer structure: blocks are taken in
+ * sequence from a list of large chunks, and are all released together
+ * by transfer_free(). Not thread-safe: blocks are taken outside of
+ * parallel regions.
+ */
+
+struct transfer_arena_chunk;
+
+struct transfer_arena {
+
+  struct transfer_arena_chunk * chunk; /**< list of chunks, the one being filled first (NULL if empty) */
+  size_t size;                         /**< total size of the blocks handed out, in bytes */
+
+};
+
 /**
  * Structure containing everything about transfer functions in
  * harmonic space \f$ \Delta_l^{X} (q) \f$ that other modules need to
@@ -159,6 +193,16 @@ struct transfers {
 
   short transfer_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  struct transfer_arena arena; /**< memory of the tables of this structure (except q), released at once by transfer_free() */
+
+  HyperInterpStruct BIS; /**< flat spherical Bessel functions, computed by transfer_init_bessel() and freed at the end of transfer_init_compute() */
+
+  HyperDeviceTables * BIS_device; /**< copy of BIS on the offload device, used by transfer_init_compute() with -DCLASS_OFFLOAD (NULL otherwise) */
+
+  struct transfer_selection_table * selection_table; /**< selection_table[index_tt]: time sampling and window function of each CMB lensing, number count or galaxy lensing type of the scalar mode, computed and freed by transfer_init_compute() (NULL if there are no such types) */
+
+  struct class_profile profile; /**< resources used by transfer_init() */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
@@ -179,7 +223,7 @@ struct transfer_workspace {
 
   HyperInterpStruct HIS; /**< structure containing all hyperspherical bessel functions (flat case) or all hyperspherical bessel functions for a given value of beta=q/sqrt(|K|) (non-flat case). HIS = Hyperspherical Interpolation Structure. */
 
-  int HIS_allocated; /**< flag specifying whether the previous structure has been allocated */
+  int HIS_allocated; /**< flag specifying whether the previous structure has been allocated (and is owned by this workspace rather than by a transfer_HIS_cache) */
 
   HyperInterpStruct * pBIS;  /**< pointer to structure containing all the spherical bessel functions of the flat case (used even in the non-flat case, for approximation schemes). pBIS = pointer to Bessel Interpolation Structure. */
 
@@ -224,6 +268,95 @@ struct transfer_workspace {
 
   double tau0_minus_tau_cut; /**< critical value of (tau0-tau) in time cut approximation for the wavenumber at hand */
   short neglect_late_source; /**< flag stating whether we use the time cut approximation for the wavenumber at hand */
+
+  /** @name - sliding windows of the perturbation sources, used instead of global spline tables in low-memory mode (see transfer_source_k_window in the precision structure) */
+
+  //@{
+
+  int window_k_size;          /**< number of rows k of the source tables in each window (zero when global spline tables are used) */
+  int window_slot_size;       /**< number of windows, one per (mode, initial condition, source type) */
+  int * window_slot_of_md;    /**< window_slot_of_md[index_md]: index of the first window of each mode */
+  int * window_k_min;         /**< window_k_min[index_slot]: index of the first row k of the window (-1 if the window is empty) */
+  short * window_nl_corr;     /**< window_nl_corr[index_slot]: whether the source should be multiplied by the non-linear correction */
+  double * nl_corr_density;   /**< pointer to the non-linear corrections of the nonlinear structure (or NULL) */
+  double ** window_sources;   /**< window_sources[index_slot][index_tau*window_k_size+index_k]: rows of the source table */
+  double ** window_splines;   /**< window_splines[index_slot][index_tau*window_k_size+index_k]: their second derivative with respect to k */
+
+  //@}
+
+  int index_tau_limber; /**< bracketing index found by the last Limber interpolation of the current source, used as a starting point by the next one (successive multipoles probe monotonic values of tau) */
+};
+
+/**
+ * state of an entry of the shared cache of hyperspherical Bessel functions
+ */
+
+enum transfer_HIS_status {
+  his_empty,    /**< not computed yet */
+  his_building, /**< being computed by one thread */
+  his_ready,    /**< computed, can be read by all threads */
+  his_failed    /**< computation failed */
+};
+
+/**
+ * Cache of hyperspherical Bessel functions shared by all threads in
+ * the non-flat case, when each wavenumber is split into several
+ * (q, l-block) tasks: the structure of a given q is computed once, by
+ * the first thread needing it, then read by all the threads working
+ * on the other blocks of that q, and freed after the last one.
+ */
+
+struct transfer_HIS_cache {
+
+  int q_size;                       /**< number of wavenumbers */
+  HyperInterpStruct * HIS;          /**< HIS[index_q]: hyperspherical Bessel functions for this wavenumber */
+  enum transfer_HIS_status * status; /**< status[index_q]: state of the previous structure */
+  int * users;                      /**< users[index_q]: number of tasks for this wavenumber not finished yet */
+
+};
+
+/**
+ * Perturbation sources dealt with by one pass of
+ * transfer_init_compute(). In low-memory mode, the transfer functions
+ * are computed in one pass per mode, initial condition and source
+ * type, so that a single source is copied and splined at a time;
+ * otherwise there is one pass for all of them, with all indices set
+ * to -1.
+ */
+
+struct transfer_pass {
+
+  int index_md; /**< mode of this pass, or -1 for all modes */
+  int index_ic; /**< initial condition of this pass, or -1 for all */
+  int index_tp; /**< source type of this pass (index in the perturbation module), or -1 for all */
+
+};
+
+/* whether the source (index_md,index_ic,index_tp) belongs to the pass ppass; -1 stands for any index */
+#define _transfer_pass_includes_(ppass,md,ic,tp) \
+  ((((ppass)->index_md < 0) || ((ppass)->index_md == (md))) && \
+   (((ppass)->index_ic < 0) || ((ppass)->index_ic == (ic))) && \
+   (((ppass)->index_tp < 0) || ((ppass)->index_tp == (tp))))
+
+/**
+ * Time sampling, integration weights and window function of a CMB
+ * lensing, number count or galaxy lensing transfer source, which only
+ * depend on the background: the transfer source at wavenumber k is
+ * the perturbation source interpolated linearly at these times,
+ * multiplied by rescaling[index_tau] and by a function of k (k^k_power,
+ * or the lcmb_... factors for CMB lensing).
+ */
+
+struct transfer_selection_table {
+
+  int tau_size;             /**< number of sampled times (zero for types without a table) */
+  double * tau0_minus_tau;  /**< tau0_minus_tau[index_tau]: sampled values of (tau0-tau) */
+  double * w_trapz;         /**< w_trapz[index_tau]: trapezoidal weights for integration over tau */
+  double * rescaling;       /**< rescaling[index_tau]: window function and background factors multiplying the source */
+  int * index_tau_sampling; /**< index_tau_sampling[index_tau]: index of the time of ppt->tau_sampling preceding (or equal to) this time */
+  double * weight;          /**< weight[index_tau]: weight of the next time of ppt->tau_sampling in the linear interpolation */
+  int k_power;              /**< power of k multiplying the source */
+
 };
 
 /**
@@ -276,10 +409,31 @@ extern "C" {
                     struct transfers * ptr
                     );
 
+  int transfer_init_bessel(
+                           struct precision * ppr,
+                           struct background * pba,
+                           struct thermo * pth,
+                           struct perturbs * ppt,
+                           struct transfers * ptr
+                           );
+
+  int transfer_init_compute(
+                            struct precision * ppr,
+                            struct background * pba,
+                            struct thermo * pth,
+                            struct perturbs * ppt,
+                            struct nonlinear * pnl,
+                            struct transfers * ptr
+                            );
+
   int transfer_free(
                     struct transfers * ptr
                     );
 
+  int transfer_free_functions(
+                              struct transfers * ptr
+                              );
+
   int transfer_indices_of_transfers(
                                     struct precision * ppr,
                                     struct perturbs * ppt,
@@ -290,32 +444,55 @@ extern "C" {
                                     );
 
   int transfer_perturbation_copy_sources_and_nl_corrections(
+                                                            struct precision * ppr,
                                                             struct perturbs * ppt,
                                                             struct nonlinear * pnl,
                                                             struct transfers * ptr,
-                                                            double *** sources
+                                                            short apply_nl_corrections,
+                                                            struct transfer_pass * ppass,
+                                                            source_t *** sources
                                                             );
 
+  int transfer_perturbation_source_has_nl_correction(
+                                                     struct perturbs * ppt,
+                                                     struct nonlinear * pnl,
+                                                     int index_md,
+                                                     int index_tp,
+                                                     short * has_nl_correction
+                                                     );
+
   int transfer_perturbation_source_spline(
                                           struct perturbs * ppt,
                                           struct transfers * ptr,
-                                          double *** sources,
-                                          double *** sources_spline
+                                          struct transfer_pass * ppass,
+                                          source_t *** sources,
+                                          source_t *** sources_spline
                                           );
 
   int transfer_perturbation_sources_free(
                                          struct perturbs * ppt,
                                          struct nonlinear * pnl,
                                          struct transfers * ptr,
-                                         double *** sources
+                                         short apply_nl_corrections,
+                                         source_t *** sources
                                          );
 
   int transfer_perturbation_sources_spline_free(
                                                 struct perturbs * ppt,
                                                 struct transfers * ptr,
-                                                double *** sources_spline
+                                                source_t *** sources_spline
                                                 );
 
+  int transfer_get_passes(
+                          struct precision * ppr,
+                          struct perturbs * ppt,
+                          struct transfers * ptr,
+                          int ** tp_of_tt,
+                          short low_memory_sources,
+                          struct transfer_pass ** pass,
+                          int * pass_size
+                          );
+
   int transfer_get_l_list(
                           struct precision * ppr,
                           struct perturbs * ppt,
@@ -386,10 +563,13 @@ extern "C" {
                                   struct transfers * ptr,
                                   int ** tp_of_tt,
                                   int index_q,
+                                  int index_l_start,
+                                  int index_l_end,
                                   int tau_size_max,
                                   double tau_rec,
-                                  double *** sources,
-                                  double *** sources_spline,
+                                  struct transfer_pass * ppass,
+                                  source_t *** sources,
+                                  source_t *** sources_spline,
                                   struct transfer_workspace * ptw
                                   );
 
@@ -403,12 +583,13 @@ extern "C" {
   int transfer_interpolate_sources(
                                    struct perturbs * ppt,
                                    struct transfers * ptr,
+                                   struct transfer_workspace * ptw,
                                    int index_q,
                                    int index_md,
                                    int index_ic,
                                    int index_type,
-                                   double * sources,
-                                   double * source_spline,
+                                   source_t * sources,
+                                   source_t * source_spline,
                                    double * interpolated_sources
                                    );
 
@@ -428,6 +609,35 @@ extern "C" {
                        int * tau_size_out
                        );
 
+  int transfer_selection_table_init(
+                                    struct precision * ppr,
+                                    struct background * pba,
+                                    struct perturbs * ppt,
+                                    struct transfers * ptr,
+                                    double tau_rec
+                                    );
+
+  int transfer_selection_table_free(
+                                    struct perturbs * ppt,
+                                    struct transfers * ptr
+                                    );
+
+  short transfer_selection_table_needed(
+                                        struct perturbs * ppt,
+                                        struct transfers * ptr,
+                                        int index_tt
+                                        );
+
+  int transfer_selection_table_compute(
+                                       struct precision * ppr,
+                                       struct background * pba,
+                                       struct perturbs * ppt,
+                                       struct transfers * ptr,
+                                       double tau_rec,
+                                       int index_tt,
+                                       struct transfer_selection_table * pst
+                                       );
+
   int transfer_selection_function(
                                   struct precision * ppr,
                                   struct perturbs * ppt,
@@ -461,19 +671,6 @@ extern "C" {
                                 double * tau0_minus_tau,
                                 int tau_size);
 
-  int transfer_source_resample(
-                               struct precision * ppr,
-                               struct background * pba,
-                               struct perturbs * ppt,
-                               struct transfers * ptr,
-                               int bin,
-                               double * tau0_minus_tau,
-                               int tau_size,
-                               int index_md,
-                               double tau0,
-                               double * interpolated_sources,
-                               double * sources);
-
   int transfer_selection_times(
                                struct precision * ppr,
                                struct background * pba,
@@ -507,11 +704,29 @@ extern "C" {
                                   int index_ic,
                                   int index_tt,
                                   int index_l,
+                                  int l_block_size,
                                   double l,
                                   double q_max_bessel,
                                   radial_function_type radial_type
                                   );
 
+  int transfer_l_block_size(
+                            struct precision * ppr,
+                            struct perturbs * ppt,
+                            struct transfers * ptr,
+                            struct transfer_workspace * ptw,
+                            int index_q,
+                            int index_md,
+                            int index_ic,
+                            int index_tt,
+                            int index_l,
+                            int index_l_stop,
+                            double ra_rec,
+                            double q_max_bessel,
+                            radial_function_type radial_type,
+                            int * l_block_size
+                            );
+
   int transfer_use_limber(
                           struct precision * ppr,
                           struct perturbs * ppt,
@@ -538,6 +753,24 @@ extern "C" {
                          double * trsf
                          );
 
+  int transfer_integration_range(
+                                 struct transfer_workspace * ptw,
+                                 double tau0_minus_tau_min_bessel,
+                                 int * index_tau_max,
+                                 int * index_tau_max_Bessel
+                                 );
+
+  int transfer_integrate_l_block(
+                                 struct transfers * ptr,
+                                 struct transfer_workspace *ptw,
+                                 int index_q,
+                                 int index_md,
+                                 int index_l,
+                                 int l_block_size,
+                                 double k,
+                                 double * trsf
+                                 );
+
   int transfer_limber(
                       struct transfers * ptr,
                       struct transfer_workspace * ptw,
@@ -555,6 +788,7 @@ extern "C" {
                                   double * sources,
                                   int tau_size,
                                   double tau0_minus_tau_limber,
+                                  int * index_tau_limber,
                                   double * S
                                   );
 
@@ -634,11 +868,45 @@ extern "C" {
                               HyperInterpStruct * pBIS
                               );
 
+  int transfer_workspace_init_source_window(
+                                            struct precision * ppr,
+                                            struct perturbs * ppt,
+                                            struct nonlinear * pnl,
+                                            struct transfers * ptr,
+                                            struct transfer_workspace * ptw
+                                            );
+
   int transfer_workspace_free(
                               struct transfers * ptr,
                               struct transfer_workspace *ptw
                               );
 
+  int transfer_HIS_cache_init(
+                              struct transfers * ptr,
+                              int users,
+                              struct transfer_HIS_cache * phc
+                              );
+
+  int transfer_HIS_cache_get(
+                             struct precision * ppr,
+                             struct transfers * ptr,
+                             struct transfer_workspace * ptw,
+                             struct transfer_HIS_cache * phc,
+                             int index_q,
+                             double tau0
+                             );
+
+  int transfer_HIS_cache_release(
+                                 struct transfers * ptr,
+                                 struct transfer_HIS_cache * phc,
+                                 int index_q
+                                 );
+
+  int transfer_HIS_cache_free(
+                              struct transfers * ptr,
+                              struct transfer_HIS_cache * phc
+                              );
+
   int transfer_update_HIS(
                           struct precision * ppr,
                           struct transfers * ptr,
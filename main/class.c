@@ -4,6 +4,15 @@
 
 #include "class.h"
 
+/* With MPI, the other processes would wait forever for a failed one in
+   the collective calls of the perturbation module: stop all of them. */
+static int class_failure() {
+#ifdef WITH_MPI
+  MPI_Abort(MPI_COMM_WORLD,_FAILURE_);
+#endif
+  return _FAILURE_;
+}
+
 int main(int argc, char **argv) {
 
   struct precision pr;        /* for precision parameters */
@@ -17,99 +26,77 @@ int main(int argc, char **argv) {
   struct lensing le;          /* for lensed spectra */
   struct output op;           /* for output files */
   ErrorMsg errmsg;            /* for error messages */
+  int process=0;              /* index of MPI process (0 without MPI) */
+
+#ifdef WITH_MPI
+  MPI_Init(&argc,&argv);
+  MPI_Comm_rank(MPI_COMM_WORLD,&process);
+#endif
 
   if (input_init_from_arguments(argc, argv,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&op,errmsg) == _FAILURE_) {
     printf("\n\nError running input_init_from_arguments \n=>%s\n",errmsg);
-    return _FAILURE_;
-  }
-
-  if (background_init(&pr,&ba) == _FAILURE_) {
-    printf("\n\nError running background_init \n=>%s\n",ba.error_message);
-    return _FAILURE_;
-  }
-
-  if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
-    printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
-    return _FAILURE_;
-  }
-
-  if (perturb_init(&pr,&ba,&th,&pt) == _FAILURE_) {
-    printf("\n\nError in perturb_init \n=>%s\n",pt.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
-  if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
-    printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
-    return _FAILURE_;
+  /* all modules from background to lensing, with the independent
+     steps running concurrently, and the output files written as soon
+     as their modules are ready (see driver.h). All MPI processes hold
+     the same results: only the first one writes them. */
+  if (driver_init(&pr,&ba,&th,&pt,&pm,&nl,&tr,&sp,&le,(process == 0) ? &op : NULL,NULL,NULL,errmsg) == _FAILURE_) {
+    printf("\n\nError in driver_init \n=>%s\n",errmsg);
+    return class_failure();
   }
 
-  if (nonlinear_init(&pr,&ba,&th,&pt,&pm,&nl) == _FAILURE_) {
-    printf("\n\nError in nonlinear_init \n=>%s\n",nl.error_message);
-    return _FAILURE_;
-  }
-
-  if (transfer_init(&pr,&ba,&th,&pt,&nl,&tr) == _FAILURE_) {
-    printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
-    return _FAILURE_;
-  }
-
-  if (spectra_init(&pr,&ba,&pt,&pm,&nl,&tr,&sp) == _FAILURE_) {
-    printf("\n\nError in spectra_init \n=>%s\n",sp.error_message);
-    return _FAILURE_;
-  }
-
-  if (lensing_init(&pr,&pt,&sp,&nl,&le) == _FAILURE_) {
-    printf("\n\nError in lensing_init \n=>%s\n",le.error_message);
-    return _FAILURE_;
-  }
-
-  if (output_init(&ba,&th,&pt,&pm,&tr,&sp,&nl,&le,&op) == _FAILURE_) {
-    printf("\n\nError in output_init \n=>%s\n",op.error_message);
-    return _FAILURE_;
+  if ((process == 0) && (op.print_profile == _TRUE_)) {
+    output_print_profile(&ba,&th,&pt,&pm,&nl,&tr,&sp,&le,&op);
   }
 
   /****** all calculations done, now free the structures ******/
 
   if (lensing_free(&le) == _FAILURE_) {
     printf("\n\nError in lensing_free \n=>%s\n",le.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
   if (spectra_free(&sp) == _FAILURE_) {
     printf("\n\nError in spectra_free \n=>%s\n",sp.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
   if (transfer_free(&tr) == _FAILURE_) {
     printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
   if (nonlinear_free(&nl) == _FAILURE_) {
     printf("\n\nError in nonlinear_free \n=>%s\n",nl.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
   if (primordial_free(&pm) == _FAILURE_) {
     printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
   if (perturb_free(&pt) == _FAILURE_) {
     printf("\n\nError in perturb_free \n=>%s\n",pt.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
   if (thermodynamics_free(&th) == _FAILURE_) {
     printf("\n\nError in thermodynamics_free \n=>%s\n",th.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
   if (background_free(&ba) == _FAILURE_) {
     printf("\n\nError in background_free \n=>%s\n",ba.error_message);
-    return _FAILURE_;
+    return class_failure();
   }
 
+#ifdef WITH_MPI
+  MPI_Finalize();
+#endif
+
   return _SUCCESS_;
 
 }
@@ -26,12 +26,30 @@ cdef extern from "class.h":
     cdef enum file_format:
          class_format
          camb_format
+         binary_format
+
+    cdef enum computation_stage:
+        cs_background
+        cs_thermodynamics
+        cs_perturbations
+        cs_primordial
+        cs_nonlinear
+        cs_transfer
+        cs_spectra
+        cs_lensing
+
+    cdef struct class_profile:
+        double wall_time
+        double cpu_time
+        double peak_memory
+        double memory_increase
 
     cdef struct precision:
         ErrorMsg error_message
 
     cdef struct background:
         ErrorMsg error_message
+        class_profile profile
         int bg_size
         int index_bg_ang_distance
         int index_bg_lum_distance
@@ -59,6 +77,7 @@ cdef extern from "class.h":
 
     cdef struct thermo:
         ErrorMsg error_message
+        class_profile profile
         int th_size
         int index_th_xe
         int index_th_Tb
@@ -79,8 +98,17 @@ cdef extern from "class.h":
 
         int tt_size
 
+    cdef struct perturb_workspace_pool:
+        int md_size
+        int number_of_threads
+
     cdef struct perturbs:
         ErrorMsg error_message
+        class_profile profile
+        short has_perturbations
+        int md_size
+        int * k_size
+        int tau_size
         short has_scalars
         short has_vectors
         short has_tensors
@@ -91,6 +119,8 @@ cdef extern from "class.h":
         int has_pk_matter
         int l_lss_max
 
+        perturb_workspace_pool * workspace_pool
+
         int store_perturbations
         int k_output_values_num
         double k_output_values[_MAX_NUMBER_OF_K_FILES_]
@@ -112,9 +142,14 @@ cdef extern from "class.h":
 
     cdef struct transfers:
         ErrorMsg error_message
+        class_profile profile
+        short has_cls
+        int q_size
+        int l_size_max
 
     cdef struct primordial:
         ErrorMsg error_message
+        class_profile profile
         double k_pivot
         double A_s
         double n_s
@@ -146,6 +181,7 @@ cdef extern from "class.h":
         int lnk_size
     cdef struct spectra:
         ErrorMsg error_message
+        class_profile profile
         int has_tt
         int has_te
         int has_ee
@@ -162,6 +198,7 @@ cdef extern from "class.h":
         # Ends here 
         int l_max_tot
         int ** l_max_ct
+        double * cl_tot_dense
         int ln_k_size
         int ct_size
         int * ic_size
@@ -207,6 +244,7 @@ cdef extern from "class.h":
 
     cdef struct output:
         ErrorMsg error_message
+        class_profile profile
 
     cdef struct lensing:
         # Modification 
@@ -241,11 +279,14 @@ cdef extern from "class.h":
         int has_lensed_cls
         int l_lensed_max
         int l_unlensed_max
+        double * cl_lens_dense
         ErrorMsg error_message
+        class_profile profile
 
     cdef struct nonlinear:
         int method
         ErrorMsg error_message
+        class_profile profile
 
     cdef struct file_content:
         char * filename
@@ -253,37 +294,58 @@ cdef extern from "class.h":
         FileArg * name
         FileArg * value
         short * read
-
-    void lensing_free(void*)
-    void spectra_free(void*)
-    void transfer_free(void*)
-    void primordial_free(void*)
-    void perturb_free(void*)
-    void thermodynamics_free(void*)
-    void background_free(void*)
-    void nonlinear_free(void*)
+        int index_entries
+        int index_size
+        int * index
+        int * next
+
+    void lensing_free(void*) nogil
+    void spectra_free(void*) nogil
+    void transfer_free(void*) nogil
+    void primordial_free(void*) nogil
+    void perturb_free(void*) nogil
+    void thermodynamics_free(void*) nogil
+    void background_free(void*) nogil
+    void nonlinear_free(void*) nogil
+    int perturb_workspace_pool_init(void*) nogil
+    int perturb_workspace_pool_free(void*) nogil
 
     cdef int _FAILURE_
     cdef int _FALSE_
     cdef int _TRUE_
 
     int input_init(void*, void*, void*, void*, void*, void*, void*, void*, void*,
-        void*, void*, char*)
-    int background_init(void*,void*)
-    int thermodynamics_init(void*,void*,void*)
-    int perturb_init(void*,void*,void*,void*)
-    int primordial_init(void*,void*,void*)
-    int nonlinear_init(void*,void*,void*,void*,void*,void*)
-    int transfer_init(void*,void*,void*,void*,void*,void*)
-    int spectra_init(void*,void*,void*,void*,void*,void*,void*)
-    int lensing_init(void*,void*,void*,void*,void*)
+        void*, void*, char*) nogil
+    int input_parameter_stage(char * name, computation_stage * stage)
+    int input_update(void*, void*, void*, void*, void*, void*, void*, void*, void*,
+        void*, void*, computation_stage stage, short * recompute, char*) nogil
+    int background_init(void*,void*) nogil
+    int thermodynamics_init(void*,void*,void*) nogil
+    int perturb_init(void*,void*,void*,void*) nogil
+    int primordial_init(void*,void*,void*) nogil
+    int nonlinear_init(void*,void*,void*,void*,void*,void*) nogil
+    int transfer_init(void*,void*,void*,void*,void*,void*) nogil
+    int spectra_init(void*,void*,void*,void*,void*,void*,void*) nogil
+    int lensing_init(void*,void*,void*,void*,void*) nogil
+    int driver_init(void*,void*,void*,void*,void*,void*,void*,void*,void*,void*,
+        short * compute, short * computed, char*) nogil
+
+    int output_state_pack(void* pba, void* pth, void* ppm, void* pnl, void* psp, void* ple,
+        char ** state, size_t * state_size, char* errmsg) nogil
+    int output_state_unpack(char * state, size_t state_size, void* pba, void* pth, void* ppm,
+        void* pnl, void* psp, void* ple, short * has_module, char* errmsg) nogil
+    int output_state_free(void* pba, void* pth, void* ppm, void* pnl, void* psp, void* ple) nogil
 
     int background_tau_of_z(void* pba, double z,double* tau)
     int background_at_tau(void* pba, double tau, short return_format, short inter_mode, int * last_index, double *pvecback)
+    int background_at_tau_vector(void* pba, double * tau, int tau_size, short return_format, double * pvecback_table)
+    int background_tau_of_z_vector(void* pba, double * z, int z_size, double * tau)
+    int background_at_z_vector(void* pba, double * z, int z_size, short return_format, double * pvecback_table)
     int background_output_titles(void * pba, char titles[_MAXTITLESTRINGLENGTH_])
     int background_output_data(void *pba, int number_of_titles, double *data)
 
     int thermodynamics_at_z(void * pba, void * pth, double z, short inter_mode, int * last_index, double *pvecback, double *pvecthermo)
+    int thermodynamics_at_z_vector(void * pba, void * pth, double * z, int z_size, double * pvecthermo_table)
     int thermodynamics_output_titles(void * pba, void *pth, char titles[_MAXTITLESTRINGLENGTH_])
     int thermodynamics_output_data(void *pba, void *pth, int number_of_titles, double *data)
 
@@ -328,6 +390,17 @@ cdef extern from "class.h":
         double z,
         double * output_tot)
 
+    int spectra_pk_at_k_and_z_vector(
+        void * pba,
+        void * ppm,
+        void * psp,
+        short nonlinear,
+        double * k,
+        int k_size,
+        double * z,
+        int z_size,
+        double * pk_tot)
+
     int nonlinear_k_nl_at_z(void* pba, void* pnl, double z, double* k_nl)
 
     int spectra_firstline_and_ic_suffix(void *ppt, int index_ic, char first_line[_LINE_LENGTH_MAX_], FileName ic_suffix)
@@ -16,6 +16,7 @@ from libc.stdlib cimport *
 from libc.stdio cimport *
 from libc.string cimport *
 cimport cython
+from openmp cimport omp_set_num_threads, omp_get_max_threads
 
 ctypedef np.float_t DTYPE_t
 ctypedef np.int_t DTYPE_i
@@ -24,6 +25,7 @@ ctypedef np.int_t DTYPE_i
 from cclassy cimport *
 
 DEF _MAXTITLESTRINGLENGTH_ = 8000
+DEF _NUM_STAGES_ = 8
 
 # Implement a specific Exception (this might not be optimally designed, nor
 # even acceptable for python standards. It, however, does the job).
@@ -60,6 +62,17 @@ class CosmoComputationError(CosmoError):
     pass
 
 
+def _class_from_state(pars, state):
+    """
+    Rebuild a Class instance when unpickling it (see Class.__reduce__)
+    """
+    cosmo = Class()
+    cosmo.set(pars)
+    if state is not None:
+        cosmo.set_state(state)
+    return cosmo
+
+
 cdef class Class:
     """
     Class wrapping, creates the glue between C and python
@@ -68,6 +81,16 @@ cdef class Class:
     (indeed the only one we will import, with the command:
     from classy import Class
 
+    Each instance owns all its structures, and compute() releases the GIL
+    while CLASS runs, so that separate instances can compute concurrently
+    in different Python threads (e.g. in a thread pool). The caches shared
+    between instances inside CLASS are protected. A single instance must
+    not be used by several threads at the same time.
+
+    Each instance also keeps its perturbation workspaces from one compute()
+    to the next (see perturb_workspace_pool in perturbations.h), so that
+    a sequence of runs, e.g. in a Markov chain, does not rebuild them.
+
     """
     # List of used structures, defined in the header file. They have to be
     # "cdefined", because they correspond to C structures
@@ -82,10 +105,13 @@ cdef class Class:
     cdef output op
     cdef lensing le
     cdef file_content fc
+    cdef perturb_workspace_pool workspace_pool
 
     cpdef int ready # Flag
     cpdef object _pars # Dictionary of the parameters
     cpdef object ncp   # Keeps track of the structures initialized, in view of cleaning.
+    cpdef object _computed_pars # Parameters of the modules currently allocated
+    cdef bint _from_state # True if the structures were restored by set_state()
 
     # Defining two new properties to recover, respectively, the parameters used
     # or the age (set after computation). Follow this syntax if you want to
@@ -114,13 +140,22 @@ cdef class Class:
         self.ready = False
         self._pars = {}
         self.fc.size=0
+        self.fc.index_entries=0
+        self.fc.index = NULL
+        self.fc.next = NULL
         self.fc.filename = <char*>malloc(sizeof(char)*30)
         assert(self.fc.filename!=NULL)
         dumc = "NOFILE"
         sprintf(self.fc.filename,"%s",dumc)
         self.ncp = set()
+        self._computed_pars = None
+        self._from_state = False
+        perturb_workspace_pool_init(&self.workspace_pool)
         if default: self.set_default()
 
+    def __dealloc__(self):
+        perturb_workspace_pool_free(&self.workspace_pool)
+
     # Set up the dictionary
     def set(self,*pars,**kars):
         if len(pars)==1:
@@ -144,6 +179,13 @@ cdef class Class:
             free(self.fc.name)
             free(self.fc.value)
             free(self.fc.read)
+        # the hash index refers to the previous names: drop it, it is
+        # rebuilt at the first lookup
+        if self.fc.index!=NULL:
+            free(self.fc.index)
+            free(self.fc.next)
+            self.fc.index = NULL
+            self.fc.next = NULL
         self.fc.size = len(self._pars)
         self.fc.name = <FileArg*> malloc(sizeof(FileArg)*len(self._pars))
         assert(self.fc.name!=NULL)
@@ -168,25 +210,47 @@ cdef class Class:
 
     # Called at the end of a run, to free memory
     def struct_cleanup(self):
+        cdef bint has_lensing = "lensing" in self.ncp
+        cdef bint has_spectra = "spectra" in self.ncp
+        cdef bint has_transfer = "transfer" in self.ncp
+        cdef bint has_nonlinear = "nonlinear" in self.ncp
+        cdef bint has_primordial = "primordial" in self.ncp
+        cdef bint has_perturb = "perturb" in self.ncp
+        cdef bint has_thermodynamics = "thermodynamics" in self.ncp
+        cdef bint has_background = "background" in self.ncp
         if self.ready == _FALSE_:
              return
-        if "lensing" in self.ncp:
-            lensing_free(&self.le)
-        if "spectra" in self.ncp:
-            spectra_free(&self.sp)
-        if "transfer" in self.ncp:
-            transfer_free(&self.tr)
-        if "nonlinear" in self.ncp:
-            nonlinear_free(&self.nl)
-        if "primordial" in self.ncp:
-            primordial_free(&self.pm)
-        if "perturb" in self.ncp:
-            perturb_free(&self.pt)
-        if "thermodynamics" in self.ncp:
-            thermodynamics_free(&self.th)
-        if "background" in self.ncp:
-            background_free(&self.ba)
+        if self._from_state:
+            with nogil:
+                output_state_free(<void*>&self.ba if has_background else NULL,
+                                  <void*>&self.th if has_thermodynamics else NULL,
+                                  <void*>&self.pm if has_primordial else NULL,
+                                  <void*>&self.nl if has_nonlinear else NULL,
+                                  <void*>&self.sp if has_spectra else NULL,
+                                  <void*>&self.le if has_lensing else NULL)
+            self._from_state = False
+            self.ready = False
+            self._computed_pars = None
+            return
+        with nogil:
+            if has_lensing:
+                lensing_free(&self.le)
+            if has_spectra:
+                spectra_free(&self.sp)
+            if has_transfer:
+                transfer_free(&self.tr)
+            if has_nonlinear:
+                nonlinear_free(&self.nl)
+            if has_primordial:
+                primordial_free(&self.pm)
+            if has_perturb:
+                perturb_free(&self.pt)
+            if has_thermodynamics:
+                thermodynamics_free(&self.th)
+            if has_background:
+                background_free(&self.ba)
         self.ready = False
+        self._computed_pars = None
 
     def _check_task_dependency(self, level):
         """
@@ -269,12 +333,31 @@ cdef class Class:
             level default value should be left as an array (it was creating
             problem when casting as a set later on, in _check_task_dependency)
 
+        .. note::
+
+            the GIL is released while each CLASS module runs, so that other
+            Python threads (and other Class instances) keep running.
+
         """
         cdef ErrorMsg errmsg
+        cdef computation_stage stage, parameter_stage
+        cdef short recompute[_NUM_STAGES_]
+        cdef short compute[_NUM_STAGES_]
+        cdef short computed[_NUM_STAGES_]
+        cdef int status
 
         # Append to the list level all the modules necessary to compute.
         level = self._check_task_dependency(level)
 
+        # A state restored by set_state() has no perturbations nor transfer
+        # functions, but it is enough as long as the parameters did not
+        # change. Otherwise, everything is computed again.
+        if self._from_state:
+            if (self.ready and self._pars == self._computed_pars and
+                    self.ncp.issuperset(set(level) - set(["input", "perturb", "transfer"]))):
+                return
+            self.struct_cleanup()
+
         # Check if this function ran before (self.ready should be true), and
         # if no other modules were requested, i.e. if self.ncp contains (or is
         # equivalent to) level. If it is the case, simply stop the execution of
@@ -282,6 +365,27 @@ cdef class Class:
         if self.ready and self.ncp.issuperset(level):
             return
 
+        # If all the modules of a previous run are still allocated, find the
+        # first computation stage affected by the parameters that changed
+        # since then. Only the modules depending on this stage will be
+        # re-run: e.g., a change in A_s alone keeps the background,
+        # thermodynamics, perturbations (and transfer functions, if there
+        # are no non-linear corrections). If nothing changed, there is
+        # nothing to do either.
+        update = False
+        if self._computed_pars is not None and "lensing" in self.ncp:
+            changed = [key for key in set(self._pars) | set(self._computed_pars)
+                       if str(self._pars.get(key)) != str(self._computed_pars.get(key))]
+            if not changed:
+                self.ready = True
+                return
+            stage = cs_lensing
+            for key in changed:
+                input_parameter_stage(key, &parameter_stage)
+                if parameter_stage < stage:
+                    stage = parameter_stage
+            update = True
+
         # Otherwise, proceed with the normal computation.
         self.ready = False
 
@@ -290,7 +394,8 @@ cdef class Class:
 
         # self.ncp will contain the list of computed modules (under the form of
         # a set, instead of a python list)
-        self.ncp=set()
+        if not update:
+            self.ncp=set()
 
         # --------------------------------------------------------------------
         # Check the presence for all CLASS modules in the list 'level'. If a
@@ -298,13 +403,33 @@ cdef class Class:
         # --------------------------------------------------------------------
         # The input module should raise a CosmoSevereError, because
         # non-understood parameters asked to the wrapper is a problematic
-        # situation.
+        # situation. When updating, input_update frees the modules that must
+        # be re-run, and the list 'level' is reduced to these modules.
         if "input" in level:
-            if input_init(&self.fc, &self.pr, &self.ba, &self.th,
-                          &self.pt, &self.tr, &self.pm, &self.sp,
-                          &self.nl, &self.le, &self.op, errmsg) == _FAILURE_:
-                raise CosmoSevereError(errmsg)
-            self.ncp.add("input")
+            if update:
+                with nogil:
+                    status = input_update(&self.fc, &self.pr, &self.ba, &self.th,
+                                          &self.pt, &self.tr, &self.pm, &self.sp,
+                                          &self.nl, &self.le, &self.op, stage,
+                                          recompute, errmsg)
+                if status == _FAILURE_:
+                    raise CosmoSevereError(errmsg)
+                modules = ["background", "thermodynamics", "perturb",
+                           "primordial", "nonlinear", "transfer", "spectra",
+                           "lensing"]
+                level = [modules[i] for i in range(_NUM_STAGES_) if recompute[i]]
+                self.ncp = set(["input"]) | (set(modules) - set(level))
+            else:
+                with nogil:
+                    status = input_init(&self.fc, &self.pr, &self.ba, &self.th,
+                                        &self.pt, &self.tr, &self.pm, &self.sp,
+                                        &self.nl, &self.le, &self.op, errmsg)
+                if status == _FAILURE_:
+                    raise CosmoSevereError(errmsg)
+                # input_update() keeps this pointer
+                self.pt.workspace_pool = &self.workspace_pool
+                self.ncp.add("input")
+            self._computed_pars = None
             # This part is done to list all the unread parameters, for debugging
             problem_flag = False
             problematic_parameters = []
@@ -317,70 +442,139 @@ cdef class Class:
                     "Class did not read input parameter(s): %s\n" % ', '.join(
                     problematic_parameters))
 
-        # The following list of computation is straightforward. If the "_init"
-        # methods fail, call `struct_cleanup` and raise a CosmoComputationError
-        # with the error message from the faulty module of CLASS.
-        if "background" in level:
-            if background_init(&(self.pr), &(self.ba)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.ba.error_message)
-            self.ncp.add("background")
+        # All modules in the list 'level' are computed by driver_init(),
+        # which runs concurrently the parts of them that do not depend on
+        # each other. If it fails, call `struct_cleanup` and raise a
+        # CosmoComputationError with the error message from the faulty
+        # module of CLASS.
+        modules = ["background", "thermodynamics", "perturb",
+                   "primordial", "nonlinear", "transfer", "spectra",
+                   "lensing"]
+        for i in range(_NUM_STAGES_):
+            compute[i] = _TRUE_ if modules[i] in level else _FALSE_
+        with nogil:
+            status = driver_init(&self.pr, &self.ba, &self.th, &self.pt,
+                                 &self.pm, &self.nl, &self.tr, &self.sp,
+                                 &self.le, NULL, compute, computed, errmsg)
+        for i in range(_NUM_STAGES_):
+            if computed[i] == _TRUE_:
+                self.ncp.add(modules[i])
+        if status == _FAILURE_:
+            self.struct_cleanup()
+            raise CosmoComputationError(errmsg)
 
-        if "thermodynamics" in level:
-            if thermodynamics_init(&(self.pr), &(self.ba),
-                                   &(self.th)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.th.error_message)
-            self.ncp.add("thermodynamics")
+        self._computed_pars = dict(self._pars)
+        self.ready = True
 
-        if "perturb" in level:
-            if perturb_init(&(self.pr), &(self.ba),
-                            &(self.th), &(self.pt)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.pt.error_message)
-            self.ncp.add("perturb")
+        # At this point, the cosmological instance contains everything needed. The
+        # following functions are only to output the desired numbers
+        return
 
-        if "primordial" in level:
-            if primordial_init(&(self.pr), &(self.pt),
-                               &(self.pm)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.pm.error_message)
-            self.ncp.add("primordial")
+    def get_state(self):
+        """
+        get_state()
 
-        if "nonlinear" in level:
-            if nonlinear_init(&self.pr, &self.ba, &self.th,
-                              &self.pt, &self.pm, &self.nl) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.nl.error_message)
-            self.ncp.add("nonlinear")
+        Return the results of the last computation in a compact form, from
+        which set_state() restores them in another instance (possibly in
+        another process) without computing anything. Pickling a Class
+        instance goes through this function.
 
-        if "transfer" in level:
-            if transfer_init(&(self.pr), &(self.ba), &(self.th),
-                             &(self.pt), &(self.nl), &(self.tr)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.tr.error_message)
-            self.ncp.add("transfer")
+        The tables of the background, thermodynamics, primordial, nonlinear,
+        spectra and lensing modules are kept; perturbations and transfer
+        functions are not. The state can be restored by any build of CLASS
+        reading the same version of the format, on a machine with the same
+        byte order.
 
-        if "spectra" in level:
-            if spectra_init(&(self.pr), &(self.ba), &(self.pt),
-                            &(self.pm), &(self.nl), &(self.tr),
-                            &(self.sp)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.sp.error_message)
-            self.ncp.add("spectra")
+        Returns
+        -------
+        state : dict
+            Parameters of the computation, and the results as bytes
+        """
+        cdef ErrorMsg errmsg
+        cdef char * buffer
+        cdef size_t size
+        cdef int status
+        cdef void * pba = NULL
+        cdef void * pth = NULL
+        cdef void * ppm = NULL
+        cdef void * pnl = NULL
+        cdef void * psp = NULL
+        cdef void * ple = NULL
+
+        if not self.ready:
+            raise CosmoSevereError("no computed cosmology to save: call compute() first")
 
-        if "lensing" in level:
-            if lensing_init(&(self.pr), &(self.pt), &(self.sp),
-                            &(self.nl), &(self.le)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.le.error_message)
-            self.ncp.add("lensing")
+        if "background" in self.ncp:
+            pba = &self.ba
+        if "thermodynamics" in self.ncp:
+            pth = &self.th
+        if "primordial" in self.ncp:
+            ppm = &self.pm
+        if "nonlinear" in self.ncp:
+            pnl = &self.nl
+        if "spectra" in self.ncp:
+            psp = &self.sp
+        if "lensing" in self.ncp:
+            ple = &self.le
+
+        with nogil:
+            status = output_state_pack(pba, pth, ppm, pnl, psp, ple,
+                                       &buffer, &size, errmsg)
+        if status == _FAILURE_:
+            raise CosmoSevereError(errmsg)
+        try:
+            data = buffer[:size]
+        finally:
+            free(buffer)
+
+        return {"pars": dict(self._pars),
+                "l_lss_max": self.pt.l_lss_max,
+                "state": data}
+
+    def set_state(self, state):
+        """
+        set_state(state)
+
+        Restore the results saved by get_state(), replacing those of this
+        instance. Nothing is computed; calling compute() afterwards with
+        other parameters computes everything again.
 
+        Parameters
+        ----------
+        state : dict
+            As returned by get_state()
+        """
+        cdef ErrorMsg errmsg
+        cdef short has_module[6]
+        cdef char * buffer
+        cdef size_t size
+        cdef int status
+
+        self.struct_cleanup()
+
+        data = state["state"]
+        buffer = data
+        size = len(data)
+        with nogil:
+            status = output_state_unpack(buffer, size, &self.ba, &self.th,
+                                         &self.pm, &self.nl, &self.sp, &self.le,
+                                         has_module, errmsg)
+        if status == _FAILURE_:
+            raise CosmoSevereError(errmsg)
+
+        modules = ["background", "thermodynamics", "primordial", "nonlinear",
+                   "spectra", "lensing"]
+        self.ncp = set([modules[i] for i in range(6) if has_module[i]])
+        self.pt.l_lss_max = state["l_lss_max"]
+        self._pars = dict(state["pars"])
+        self._computed_pars = dict(self._pars)
+        self._from_state = True
         self.ready = True
 
-        # At this point, the cosmological instance contains everything needed. The
-        # following functions are only to output the desired numbers
-        return
+    def __reduce__(self):
+        if self.ready:
+            return (_class_from_state, (dict(self._pars), self.get_state()))
+        return (_class_from_state, (dict(self._pars), None))
 
     def raw_cl(self, lmax=-1, nofail=False):
         """
@@ -409,17 +603,7 @@ cdef class Class:
                 ell array.
         """
         cdef int lmaxR
-        cdef double *rcl = <double*> calloc(self.sp.ct_size,sizeof(double))
-
-        # Quantities for tensor modes
-        cdef double **cl_md = <double**> calloc(self.sp.md_size, sizeof(double*))
-        for index_md in range(self.sp.md_size):
-            cl_md[index_md] = <double*> calloc(self.sp.ct_size, sizeof(double))
-
-        # Quantities for isocurvature modes
-        cdef double **cl_md_ic = <double**> calloc(self.sp.md_size, sizeof(double*))
-        for index_md in range(self.sp.md_size):
-            cl_md_ic[index_md] = <double*> calloc(self.sp.ct_size*self.sp.ic_ic_size[index_md], sizeof(double))
+        cdef double[:, ::1] cl_dense
 
         # Define a list of integers, refering to the flags and indices of each
         # possible output Cl. It allows for a clear and concise way of looping
@@ -457,16 +641,14 @@ cdef class Class:
         for elem in spectra:
             cl[elem] = np.zeros(lmax+1, dtype=np.double)
 
-        # Recover for each ell the information from CLASS
-        for ell from 2<=ell<lmax+1:
-            if spectra_cl_at_l(&self.sp, ell, rcl, cl_md, cl_md_ic) == _FAILURE_:
-                raise CosmoSevereError(self.sp.error_message)
-            for flag, index, name in has_flags:
-                if name in spectra:
-                    cl[name][ell] = rcl[index]
+        # Read the information from the table of C_l's at each
+        # integer ell computed by CLASS (zero for ell<2)
+        cl_dense = <double[:lmax+1, :self.sp.ct_size]> self.sp.cl_tot_dense
+        for flag, index, name in has_flags:
+            if name in spectra:
+                cl[name][:] = cl_dense[:, index]
         cl['ell'] = np.arange(lmax+1)
 
-        free(rcl)
         return cl
 
     def lensed_cl(self, lmax=-1,nofail=False):
@@ -492,7 +674,7 @@ cdef class Class:
                 important from the python point of view.
         """
         cdef int lmaxR
-        cdef double *lcl = <double*> calloc(self.le.lt_size,sizeof(double))
+        cdef double[:, ::1] cl_dense
 
         # Define a list of integers, refering to the flags and indices of each
         # possible output Cl. It allows for a clear and concise way of looping
@@ -532,15 +714,15 @@ cdef class Class:
         # Simple Cls, for temperature and polarisation, are not so big in size
         for elem in spectra:
             cl[elem] = np.zeros(lmax+1, dtype=np.double)
-        for ell from 2<=ell<lmax+1:
-            if lensing_cl_at_l(&self.le,ell,lcl) == _FAILURE_:
-                raise CosmoSevereError(self.le.error_message)
-            for flag, index, name in has_flags:
-                if name in spectra:
-                    cl[name][ell] = lcl[index]
+
+        # Read the information from the table of lensed C_l's at each
+        # integer ell computed by CLASS (zero for ell<2)
+        cl_dense = <double[:lmax+1, :self.le.lt_size]> self.le.cl_lens_dense
+        for flag, index, name in has_flags:
+            if name in spectra:
+                cl[name][:] = cl_dense[:, index]
         cl['ell'] = np.arange(lmax+1)
 
-        free(lcl)
         return cl
 
     def density_cl(self, lmax=-1, nofail=False):
@@ -565,17 +747,7 @@ cdef class Class:
             starts at index_ct_dd.
         """
         cdef int lmaxR
-        cdef double *dcl = <double*> calloc(self.sp.ct_size,sizeof(double))
-
-        # Quantities for tensor modes
-        cdef double **cl_md = <double**> calloc(self.sp.md_size, sizeof(double*))
-        for index_md in range(self.sp.md_size):
-            cl_md[index_md] = <double*> calloc(self.sp.ct_size, sizeof(double))
-
-        # Quantities for isocurvature modes
-        cdef double **cl_md_ic = <double**> calloc(self.sp.md_size, sizeof(double*))
-        for index_md in range(self.sp.md_size):
-            cl_md_ic[index_md] = <double*> calloc(self.sp.ct_size*self.sp.ic_ic_size[index_md], sizeof(double))
+        cdef double[:, ::1] cl_dense
 
         lmaxR = self.pt.l_lss_max
         has_flags = [
@@ -623,68 +795,99 @@ cdef class Class:
             if elem in spectra:
                 cl[elem] = np.zeros(lmax+1, dtype=np.double)
 
-        for ell from 2<=ell<lmax+1:
-            if spectra_cl_at_l(&self.sp, ell, dcl, cl_md, cl_md_ic) == _FAILURE_:
-                raise CosmoSevereError(self.sp.error_message)
-            if 'dd' in spectra:
-                for index in range(size):
-                    cl['dd'][index][ell] = dcl[self.sp.index_ct_dd+index]
-            if 'll' in spectra:
-                for index in range(size):
-                    cl['ll'][index][ell] = dcl[self.sp.index_ct_ll+index]
-            if 'td' in spectra:
-                cl['td'][ell] = dcl[self.sp.index_ct_td]
-            if 'tl' in spectra:
-                cl['tl'][ell] = dcl[self.sp.index_ct_tl]
+        # Read the information from the table of C_l's at each integer
+        # ell computed by CLASS (zero for ell<2)
+        if lmax > self.sp.l_max_tot:
+            raise CosmoSevereError("Can only compute up to lmax=%d"%self.sp.l_max_tot)
+        cl_dense = <double[:lmax+1, :self.sp.ct_size]> self.sp.cl_tot_dense
+        if 'dd' in spectra:
+            for index in range(size):
+                cl['dd'][index][:] = cl_dense[:, self.sp.index_ct_dd+index]
+        if 'll' in spectra:
+            for index in range(size):
+                cl['ll'][index][:] = cl_dense[:, self.sp.index_ct_ll+index]
+        if 'td' in spectra:
+            cl['td'][:] = cl_dense[:, self.sp.index_ct_td]
+        if 'tl' in spectra:
+            cl['tl'][:] = cl_dense[:, self.sp.index_ct_tl]
         cl['ell'] = np.arange(lmax+1)
 
-        free(dcl)
         return cl
 
-    def z_of_r (self,z_array):
-        cdef double tau=0.0
-        cdef int last_index=0 #junk
-        cdef double * pvecback
-        r = np.zeros(len(z_array),'float64')
-        dzdr = np.zeros(len(z_array),'float64')
+    def _background_at_z(self, z, indices):
+        """
+        Return the background quantities with the given indices
+        (index_bg_...) at one or several redshifts, with a single call to
+        background_at_z_vector()
 
-        pvecback = <double*> calloc(self.ba.bg_size,sizeof(double))
+        Parameters
+        ----------
+        z : float or array
+                Desired redshift(s)
+        indices : list of int
+                Indices of the quantities in the background vector
 
-        i = 0
-        for redshift in z_array:
-            if background_tau_of_z(&self.ba,redshift,&tau)==_FAILURE_:
-                raise CosmoSevereError(self.ba.error_message)
+        Returns
+        -------
+        One float (if z is a float) or one array with the shape of z per index
+        """
+        cdef np.ndarray[DTYPE_t, ndim=1] z_array = np.ascontiguousarray(np.ravel(z), dtype='float64')
+        cdef int z_size = z_array.shape[0]
+        cdef np.ndarray[DTYPE_t, ndim=2] table = np.zeros((max(z_size,1), self.ba.bg_size), 'float64')
 
-            if background_at_tau(&self.ba,tau,self.ba.long_info,self.ba.inter_normal,&last_index,pvecback)==_FAILURE_:
+        if z_size > 0:
+            if background_at_z_vector(&self.ba, &z_array[0], z_size, self.ba.long_info, &table[0,0])==_FAILURE_:
                 raise CosmoSevereError(self.ba.error_message)
 
-            # store r
-            r[i] = pvecback[self.ba.index_bg_conf_distance]
-            # store dz/dr = H
-            dzdr[i] = pvecback[self.ba.index_bg_H]
+        if np.ndim(z) == 0:
+            return [table[0, index] for index in indices]
+        return [table[:z_size, index].reshape(np.shape(z)) for index in indices]
 
-            i += 1
+    def _thermodynamics_at_z(self, z, indices):
+        """
+        Return the thermodynamics quantities with the given indices
+        (index_th_...) at one or several redshifts, with a single call to
+        thermodynamics_at_z_vector()
+
+        Parameters
+        ----------
+        z : float or array
+                Desired redshift(s)
+        indices : list of int
+                Indices of the quantities in the thermodynamics vector
+
+        Returns
+        -------
+        One float (if z is a float) or one array with the shape of z per index
+        """
+        cdef np.ndarray[DTYPE_t, ndim=1] z_array = np.ascontiguousarray(np.ravel(z), dtype='float64')
+        cdef int z_size = z_array.shape[0]
+        cdef np.ndarray[DTYPE_t, ndim=2] table = np.zeros((max(z_size,1), self.th.th_size), 'float64')
+
+        if z_size > 0:
+            if thermodynamics_at_z_vector(&self.ba, &self.th, &z_array[0], z_size, &table[0,0])==_FAILURE_:
+                raise CosmoSevereError(self.th.error_message)
 
-        free(pvecback)
+        if np.ndim(z) == 0:
+            return [table[0, index] for index in indices]
+        return [table[:z_size, index].reshape(np.shape(z)) for index in indices]
+
+    def z_of_r (self,z_array):
+        # r and dz/dr = H
+        r, dzdr = self._background_at_z(np.atleast_1d(z_array),
+                                        [self.ba.index_bg_conf_distance, self.ba.index_bg_H])
         return r[:],dzdr[:]
 
     def luminosity_distance(self, z):
         """
         luminosity_distance(z)
-        """
-        cdef double tau=0.0
-        cdef int last_index = 0  # junk
-        pvecback = <double*> calloc(self.ba.bg_size,sizeof(double))
-
-        if background_tau_of_z(&self.ba, z, &tau)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
 
-        if background_at_tau(&self.ba, tau, self.ba.long_info,
-                self.ba.inter_normal, &last_index, pvecback)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-        lum_distance = pvecback[self.ba.index_bg_lum_distance]
-        free(pvecback)
-        return lum_distance
+        Parameters
+        ----------
+        z : float or array
+                Desired redshift(s)
+        """
+        return self._background_at_z(z, [self.ba.index_bg_lum_distance])[0]
 
     # Gives the pk for a given (k,z)
     def pk(self,double k,double z):
@@ -728,14 +931,64 @@ cdef class Class:
     def get_pk(self, np.ndarray[DTYPE_t,ndim=3] k, np.ndarray[DTYPE_t,ndim=1] z, int k_size, int z_size, int mu_size):
         """ Fast function to get a power spectrum on a k and z array """
         cdef np.ndarray[DTYPE_t, ndim=3] pk = np.zeros((k_size,z_size,mu_size),'float64')
-        cdef int index_k, index_z, index_mu
+        cdef int index_z
 
-        for index_k in xrange(k_size):
-            for index_z in xrange(z_size):
-                for index_mu in xrange(mu_size):
-                    pk[index_k,index_z,index_mu] = self.pk(k[index_k,index_z,index_mu],z[index_z])
+        for index_z in xrange(z_size):
+            pk[:,index_z,:] = self.pk_array(np.ravel(k[:,index_z,:]),z[index_z:index_z+1])[:,0].reshape((k_size,mu_size))
         return pk
 
+    def pk_array(self, k, z, nonlinear=None):
+        """
+        pk_array(k, z, nonlinear=None)
+
+        Gives the total matter power spectrum for all pairs of k and z,
+        with a single call to spectra_pk_at_k_and_z_vector()
+
+        Parameters
+        ----------
+        k : array
+                Wavenumbers in 1/Mpc, sorted or not
+        z : array
+                Redshifts
+        nonlinear : bool, optional
+                Non-linear spectrum if True, linear one if False; by
+                default, the same spectrum as pk()
+
+        Returns
+        -------
+        pk : numpy array of shape (len(k), len(z)), in Mpc^3
+        """
+        cdef np.ndarray[DTYPE_t, ndim=1] k_array = np.ascontiguousarray(np.ravel(k), dtype='float64')
+        cdef np.ndarray[DTYPE_t, ndim=1] z_array = np.ascontiguousarray(np.ravel(z), dtype='float64')
+        cdef int k_size = k_array.shape[0]
+        cdef int z_size = z_array.shape[0]
+        cdef np.ndarray[DTYPE_t, ndim=2] pk = np.zeros((max(z_size,1), max(k_size,1)), 'float64')
+        cdef short nl
+
+        abort = True
+        if 'output' in self._pars:
+            options = self._pars['output'].split()
+            for option in options:
+                if option in ['mPk', 'mTk', 'vTk']:
+                    abort = False
+                    break
+        if abort:
+            raise CosmoSevereError(
+                "No power spectrum nor transfer function"
+                " asked: you should not ask for a power"
+                " spectrum, then")
+
+        if nonlinear is None:
+            nl = (self.nl.method != 0)
+        else:
+            nl = bool(nonlinear)
+
+        if (k_size > 0) and (z_size > 0):
+            if spectra_pk_at_k_and_z_vector(&self.ba, &self.pm, &self.sp, nl, &k_array[0], k_size, &z_array[0], z_size, &pk[0,0])==_FAILURE_:
+                raise CosmoSevereError(self.sp.error_message)
+
+        return pk[:z_size,:k_size].T
+
     def age(self):
         self.compute(["background"])
         return self.ba.age
@@ -776,26 +1029,10 @@ cdef class Class:
 
         Parameters
         ----------
-        z : float
-                Desired redshift
+        z : float or array
+                Desired redshift(s)
         """
-        cdef double tau
-        cdef int last_index #junk
-        cdef double * pvecback
-
-        pvecback = <double*> calloc(self.ba.bg_size,sizeof(double))
-
-        if background_tau_of_z(&self.ba,z,&tau)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        if background_at_tau(&self.ba,tau,self.ba.long_info,self.ba.inter_normal,&last_index,pvecback)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        D_A = pvecback[self.ba.index_bg_ang_distance]
-
-        free(pvecback)
-
-        return D_A
+        return self._background_at_z(z, [self.ba.index_bg_ang_distance])[0]
 
     def Hubble(self, z):
         """
@@ -806,26 +1043,10 @@ cdef class Class:
 
         Parameters
         ----------
-        z : float
-                Desired redshift
+        z : float or array
+                Desired redshift(s)
         """
-        cdef double tau
-        cdef int last_index #junk
-        cdef double * pvecback
-
-        pvecback = <double*> calloc(self.ba.bg_size,sizeof(double))
-
-        if background_tau_of_z(&self.ba,z,&tau)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        if background_at_tau(&self.ba,tau,self.ba.long_info,self.ba.inter_normal,&last_index,pvecback)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        H = pvecback[self.ba.index_bg_H]
-
-        free(pvecback)
-
-        return H
+        return self._background_at_z(z, [self.ba.index_bg_H])[0]
 
     def ionization_fraction(self, z):
         """
@@ -835,32 +1056,10 @@ cdef class Class:
 
         Parameters
         ----------
-        z : float
-                Desired redshift
+        z : float or array
+                Desired redshift(s)
         """
-        cdef double tau
-        cdef int last_index #junk
-        cdef double * pvecback
-        cdef double * pvecthermo
-
-        pvecback = <double*> calloc(self.ba.bg_size,sizeof(double))
-        pvecthermo = <double*> calloc(self.th.th_size,sizeof(double))
-
-        if background_tau_of_z(&self.ba,z,&tau)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        if background_at_tau(&self.ba,tau,self.ba.long_info,self.ba.inter_normal,&last_index,pvecback)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        if thermodynamics_at_z(&self.ba,&self.th,z,self.th.inter_normal,&last_index,pvecback,pvecthermo) == _FAILURE_:
-            raise CosmoSevereError(self.th.error_message)
-
-        xe = pvecthermo[self.th.index_th_xe]
-
-        free(pvecback)
-        free(pvecthermo)
-
-        return xe
+        return self._thermodynamics_at_z(z, [self.th.index_th_xe])[0]
 
     def baryon_temperature(self, z):
         """
@@ -870,32 +1069,10 @@ cdef class Class:
 
         Parameters
         ----------
-        z : float
-                Desired redshift
+        z : float or array
+                Desired redshift(s)
         """
-        cdef double tau
-        cdef int last_index #junk
-        cdef double * pvecback
-        cdef double * pvecthermo
-
-        pvecback = <double*> calloc(self.ba.bg_size,sizeof(double))
-        pvecthermo = <double*> calloc(self.th.th_size,sizeof(double))
-
-        if background_tau_of_z(&self.ba,z,&tau)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        if background_at_tau(&self.ba,tau,self.ba.long_info,self.ba.inter_normal,&last_index,pvecback)==_FAILURE_:
-            raise CosmoSevereError(self.ba.error_message)
-
-        if thermodynamics_at_z(&self.ba,&self.th,z,self.th.inter_normal,&last_index,pvecback,pvecthermo) == _FAILURE_:
-            raise CosmoSevereError(self.th.error_message)
-
-        Tb = pvecthermo[self.th.index_th_Tb]
-
-        free(pvecback)
-        free(pvecthermo)
-
-        return Tb
+        return self._thermodynamics_at_z(z, [self.th.index_th_Tb])[0]
 
     def T_cmb(self):
         """
@@ -1018,6 +1195,61 @@ cdef class Class:
         return primordial
 
 
+    def get_profile(self):
+        """
+        Return the resources used by each module computed so far, and the
+        main sizes of the tables.
+
+        Returns
+        -------
+        profile : dictionary with one entry per computed module (keys of
+            the modules as in 'compute'), each a dictionary with the
+            wall-clock time and CPU time in seconds, the peak resident
+            memory of the process at the end of the module and its increase
+            during the module in bytes; and an entry 'sizes' with k_size (a
+            list, one value per mode), tau_size, q_size and l_size when
+            they have been computed.
+        """
+        cdef class_profile * pprof
+        cdef int index_md
+
+        profiles = {}
+        for module in ["background", "thermodynamics", "perturb", "primordial",
+                       "nonlinear", "transfer", "spectra", "lensing"]:
+            if module not in self.ncp:
+                continue
+            if module == "background":
+                pprof = &self.ba.profile
+            elif module == "thermodynamics":
+                pprof = &self.th.profile
+            elif module == "perturb":
+                pprof = &self.pt.profile
+            elif module == "primordial":
+                pprof = &self.pm.profile
+            elif module == "nonlinear":
+                pprof = &self.nl.profile
+            elif module == "transfer":
+                pprof = &self.tr.profile
+            elif module == "spectra":
+                pprof = &self.sp.profile
+            else:
+                pprof = &self.le.profile
+            profiles[module] = {'wall_time': pprof.wall_time,
+                                'cpu_time': pprof.cpu_time,
+                                'peak_memory': pprof.peak_memory,
+                                'memory_increase': pprof.memory_increase}
+
+        sizes = {}
+        if "perturb" in self.ncp and self.pt.has_perturbations:
+            sizes['tau_size'] = self.pt.tau_size
+            sizes['k_size'] = [self.pt.k_size[index_md] for index_md in range(self.pt.md_size)]
+        if "transfer" in self.ncp and self.tr.has_cls:
+            sizes['q_size'] = self.tr.q_size
+            sizes['l_size'] = self.tr.l_size_max
+        profiles['sizes'] = sizes
+
+        return profiles
+
     def get_perturbations(self):
         """
         Return scalar, vector and/or tensor perturbations as arrays for requested
@@ -1412,3 +1644,508 @@ cdef class Class:
         ctx.add('boundary', True)
         # Store itself into the context, to be accessed by the likelihoods
         ctx.add('cosmo', self)
+
+
+def _compute_in_thread(cosmo, level, int num_threads):
+    """
+    Run cosmo.compute(level) in the calling thread, with num_threads OpenMP
+    threads (the OpenMP number of threads is a per-thread setting).
+    """
+    omp_set_num_threads(num_threads)
+    cosmo.compute(list(level))
+    return cosmo
+
+
+def compute_many(list_of_pars, level=["lensing"], threads=None, workers=None,
+                 cache_directory=None, return_exceptions=False):
+    """
+    compute_many(list_of_pars, level=["lensing"], threads=None, workers=None,
+                 cache_directory=None, return_exceptions=False)
+
+    Compute a batch of cosmologies concurrently, and return one computed
+    Class instance for each dictionary of parameters, in the same order.
+
+    The cosmologies are computed by a pool of python threads (compute()
+    releases the GIL), and the OpenMP threads are split between them. The
+    data that only depends on precision parameters is computed once and
+    shared by all of them: HyRec tables, lensing d-tables, ncdm momentum
+    quadratures, and (when cache_directory is set) flat spherical Bessel
+    functions.
+
+    Parameters
+    ----------
+    list_of_pars : list of dict
+            Parameters of each cosmology, as passed to Class.set()
+    level : list, optional
+            Last module to compute, as in Class.compute()
+    threads : int, optional
+            Total number of OpenMP threads (default: omp_get_max_threads())
+    workers : int, optional
+            Number of cosmologies computed at the same time (default: as
+            many as possible with at least one OpenMP thread each)
+    cache_directory : str, optional
+            Directory in which the spherical Bessel functions are cached,
+            used as 'hyper cache directory' for the cosmologies which do
+            not set it
+    return_exceptions : bool, optional
+            If True, a cosmology that fails gives the CosmoError instead of
+            a Class instance in the returned list; otherwise the first
+            error is raised
+
+    Returns
+    -------
+    cosmos : list of Class
+            Independent computed instances, each of which must be cleaned
+            up with struct_cleanup() when no longer needed
+    """
+    from concurrent.futures import ThreadPoolExecutor
+
+    if threads is None:
+        threads = omp_get_max_threads()
+    if workers is None:
+        workers = min(len(list_of_pars), threads)
+    workers = max(1, workers)
+    num_threads = max(1, threads // workers)
+
+    cosmos = []
+    for pars in list_of_pars:
+        cosmo = Class()
+        cosmo.set(pars)
+        if cache_directory is not None and 'hyper cache directory' not in cosmo.pars:
+            cosmo.set({'hyper cache directory': cache_directory})
+        cosmos.append(cosmo)
+
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+        futures = [pool.submit(_compute_in_thread, cosmo, level, num_threads)
+                   for cosmo in cosmos]
+
+    # Failed computations have already freed their structures; when an
+    # error is raised, also free those of the successful ones
+    results = []
+    first_error = None
+    for cosmo, future in zip(cosmos, futures):
+        error = future.exception()
+        if error is None:
+            results.append(cosmo)
+        elif return_exceptions and isinstance(error, CosmoError):
+            results.append(error)
+        elif first_error is None:
+            first_error = error
+    if first_error is not None:
+        for result in results:
+            if isinstance(result, Class):
+                result.struct_cleanup()
+        raise first_error
+    return results
+
+
+def _auto_spectra_of(name):
+    """
+    Names of the two auto-spectra of a cross-spectrum 'xy' ('te' -> 'tt', 'ee')
+    """
+    return name[0]*2, name[1]*2
+
+
+class ClassEmulator(object):
+    """
+    Emulator of the unlensed C_l's and of the linear P(k) of CLASS inside a
+    box of parameters, with the same interface as Class for these outputs.
+
+    train() computes CLASS on a Latin hypercube of the box, compresses the
+    spectra by a principal component analysis (PCA), and interpolates the
+    PCA coefficients between the training points with a cubic radial basis
+    function (plus a linear term). It then computes CLASS on independent
+    validation points, and records the error of the emulator at each of
+    them, together with the distance of this point to the nearest training
+    point (in units of the box).
+
+    For a query, the error estimate is the largest validation error among
+    the validation points which are at least as far from the training
+    points as the query. The query is answered by the emulator only if it
+    lies in the box, if the other parameters are those of the training,
+    and if this estimate is below the tolerance; otherwise (and for any
+    output which is not emulated), the full CLASS pipeline is run. The
+    estimate used is given by error_estimate().
+
+    Errors are relative for the auto-spectra and P(k), and relative to
+    sqrt(C_l^XX C_l^YY) for a cross-spectrum XY.
+
+    Example::
+
+        emu = ClassEmulator({'output': 'tCl,pCl,mPk', 'lensing': 'no'},
+                            {'omega_b': (0.021, 0.023), 'omega_cdm': (0.11, 0.13)},
+                            lmax=2000, z=[0., 1.])
+        emu.train(100)
+        emu.set({'omega_b': 0.0222, 'omega_cdm': 0.12})
+        emu.compute()
+        cl = emu.raw_cl()
+        print(emu.emulated, emu.error_estimate())
+
+    Parameters
+    ----------
+    fixed_pars : dict
+            Parameters common to all cosmologies, as passed to Class.set()
+    varied : dict
+            Range (min, max) of each varied parameter
+    lmax : int, optional
+            Largest multipole of the emulated C_l's (sets 'l_max_scalars'
+            if fixed_pars does not)
+    k : array, optional
+            Wavenumbers in 1/Mpc at which ln P(k) is emulated (default: 200
+            values from 1e-4 to 1); P(k) is interpolated linearly in ln k
+            between them
+    z : array, optional
+            Redshifts at which P(k) is emulated (default: z=0)
+    tolerance : float, optional
+            Largest error estimate for which the emulator answers
+    n_components : int, optional
+            Number of principal components kept (default: enough to keep
+            all but 1e-10 of the variance of the training set)
+    """
+
+    def __init__(self, fixed_pars, varied, lmax=2500, k=None, z=None,
+                 tolerance=1e-3, n_components=None):
+        self.fixed_pars = dict(fixed_pars)
+        self.names = sorted(varied)
+        self.lower = np.array([float(varied[name][0]) for name in self.names])
+        self.upper = np.array([float(varied[name][1]) for name in self.names])
+        if np.any(self.upper <= self.lower):
+            raise CosmoSevereError("each varied parameter needs a range (min, max) with min < max")
+        self.lmax = int(lmax)
+        if k is None:
+            k = np.logspace(-4., 0., 200)
+        self.k = np.sort(np.ravel(np.asarray(k, dtype='float64')))
+        if z is None:
+            z = [0.]
+        self.z = np.ravel(np.asarray(z, dtype='float64'))
+        self.tolerance = float(tolerance)
+        self.n_components = n_components
+
+        output = str(self.fixed_pars.get('output', '')).replace(',', ' ').split()
+        self.has_cls = any(o in output for o in ['tCl', 'pCl', 'lCl'])
+        self.has_pk = 'mPk' in output
+        if not (self.has_cls or self.has_pk):
+            raise CosmoSevereError("the emulator needs 'output' to contain C_l's (tCl, pCl, lCl) and/or mPk")
+        if self.has_cls and 'l_max_scalars' not in self.fixed_pars:
+            self.fixed_pars['l_max_scalars'] = self.lmax
+        if self.has_pk:
+            if 'P_k_max_1/Mpc' not in self.fixed_pars and 'P_k_max_h/Mpc' not in self.fixed_pars:
+                self.fixed_pars['P_k_max_1/Mpc'] = 1.01*self.k[-1]
+            if 'z_max_pk' not in self.fixed_pars and 'z_pk' not in self.fixed_pars:
+                self.fixed_pars['z_max_pk'] = max(0., float(np.max(self.z)))
+
+        self.trained = False
+        self.validation = {}
+        self._validation_distances = np.zeros(0)
+        self._validation_errors = np.zeros(0)
+        self._pars = {}
+        self._cosmo = None
+        self._spectra = None
+        self.emulated = False
+        self._estimate = np.inf
+
+    # ------------------------------------------------------------------
+    # Training
+    # ------------------------------------------------------------------
+
+    def _unit(self, values):
+        return (np.asarray(values, dtype='float64') - self.lower)/(self.upper - self.lower)
+
+    def _pars_at(self, unit_point):
+        pars = dict(self.fixed_pars)
+        values = self.lower + np.asarray(unit_point)*(self.upper - self.lower)
+        for name, value in zip(self.names, values):
+            pars[name] = repr(float(value))
+        return pars
+
+    def _raw_outputs(self, cosmo):
+        """
+        Emulated outputs of a computed Class instance, as a dict of arrays
+        """
+        raw = {}
+        if self.has_cls:
+            cl = cosmo.raw_cl(self.lmax)
+            for name in cl:
+                if name != 'ell':
+                    raw[name] = np.array(cl[name][2:self.lmax+1])
+        if self.has_pk:
+            raw['pk'] = np.ravel(cosmo.pk_array(self.k, self.z, nonlinear=False).T)
+        return raw
+
+    def _compute_raw(self, unit_points, threads, workers):
+        """
+        Run CLASS at each point of the unit box, and return the points which
+        succeeded and their outputs
+        """
+        cosmos = compute_many([self._pars_at(p) for p in unit_points], level=["lensing"],
+                              threads=threads, workers=workers, return_exceptions=True)
+        points = []
+        outputs = []
+        for point, cosmo in zip(unit_points, cosmos):
+            if isinstance(cosmo, Class):
+                try:
+                    outputs.append(self._raw_outputs(cosmo))
+                    points.append(point)
+                finally:
+                    cosmo.struct_cleanup()
+        return np.array(points), outputs
+
+    def _to_features(self, raw):
+        return np.concatenate([np.log(raw[name]) if use_log else raw[name]
+                               for name, use_log in self._blocks])
+
+    def _from_features(self, features):
+        raw = {}
+        start = 0
+        for name, use_log in self._blocks:
+            size = self._block_sizes[name]
+            block = features[start:start+size]
+            raw[name] = np.exp(block) if use_log else block.copy()
+            start += size
+        return raw
+
+    def _errors(self, true, predicted):
+        """
+        Largest error of each emulated output (relative, or relative to
+        sqrt(C_l^XX C_l^YY) for cross-spectra)
+        """
+        errors = {}
+        for name, use_log in self._blocks:
+            if name == 'pk' or name[0] == name[1]:
+                scale = np.abs(true[name])
+            else:
+                auto1, auto2 = _auto_spectra_of(name)
+                if auto1 in true and auto2 in true:
+                    scale = np.sqrt(np.abs(true[auto1]*true[auto2]))
+                else:
+                    scale = np.max(np.abs(true[name]))*np.ones_like(true[name])
+            scale = np.where(scale > 0., scale, 1.)
+            errors[name] = float(np.max(np.abs(predicted[name] - true[name])/scale))
+        return errors
+
+    def _rbf_matrix(self, points):
+        distance = np.sqrt(((points[:, None, :] - self._nodes[None, :, :])**2).sum(axis=2))
+        return np.hstack([distance**3, np.ones((points.shape[0], 1)), points])
+
+    def _predict_features(self, unit_point):
+        coefficients = self._rbf_matrix(np.atleast_2d(unit_point)).dot(self._weights)[0]
+        return self._mean + self._scale*coefficients.dot(self._components)
+
+    def train(self, n_train, n_validation=None, seed=0, threads=None, workers=None):
+        """
+        train(n_train, n_validation=None, seed=0, threads=None, workers=None)
+
+        Compute CLASS at n_train points of a Latin hypercube and at
+        n_validation (default: n_train/4) random points of the box, build the
+        emulator on the former and validate it on the latter. The
+        cosmologies are computed with compute_many(threads, workers);
+        those for which CLASS fails are dropped.
+
+        Returns
+        -------
+        validation : dict
+                Largest validation error of each emulated output, and over
+                all of them ('max')
+        """
+        dim = len(self.names)
+        rng = np.random.RandomState(seed)
+        if n_validation is None:
+            n_validation = max(1, n_train//4)
+
+        # Latin hypercube: one point in each of the n_train slices of each dimension
+        unit_points = np.empty((n_train, dim))
+        for index_dim in range(dim):
+            unit_points[:, index_dim] = (rng.permutation(n_train) + rng.uniform(size=n_train))/n_train
+        nodes, outputs = self._compute_raw(unit_points, threads, workers)
+        if len(outputs) < dim + 2:
+            raise CosmoComputationError("only %d training cosmologies could be computed" % len(outputs))
+
+        # Use ln C_l for the auto-spectra and ln P(k), as long as they are positive
+        names = sorted(outputs[0])
+        self._block_sizes = dict((name, outputs[0][name].size) for name in names)
+        self._blocks = [(name, (name == 'pk' or name[0] == name[1]) and
+                         all(np.all(output[name] > 0.) for output in outputs))
+                        for name in names]
+
+        # Principal components of the standardised features
+        features = np.array([self._to_features(output) for output in outputs])
+        self._mean = features.mean(axis=0)
+        self._scale = features.std(axis=0)
+        self._scale[self._scale == 0.] = 1.
+        u, s, vt = np.linalg.svd((features - self._mean)/self._scale, full_matrices=False)
+        if self.n_components is None:
+            variance = np.cumsum(s**2)/np.sum(s**2)
+            n_components = int(np.searchsorted(variance, 1. - 1e-10) + 1)
+        else:
+            n_components = int(self.n_components)
+        n_components = max(1, min(n_components, len(s)))
+        self._components = vt[:n_components]
+        coefficients = u[:, :n_components]*s[:n_components]
+
+        # Cubic radial basis functions with a linear polynomial, interpolating
+        # the coefficients exactly at the nodes
+        self._nodes = nodes
+        n_nodes = nodes.shape[0]
+        matrix = np.zeros((n_nodes + dim + 1, n_nodes + dim + 1))
+        matrix[:n_nodes, :] = self._rbf_matrix(nodes)
+        matrix[n_nodes:, :n_nodes] = matrix[:n_nodes, n_nodes:].T
+        rhs = np.zeros((n_nodes + dim + 1, n_components))
+        rhs[:n_nodes] = coefficients
+        self._weights = np.linalg.lstsq(matrix, rhs, rcond=None)[0]
+
+        # Validation errors, and distance of each validation point to the nodes
+        validation_points, validation_outputs = self._compute_raw(rng.uniform(size=(n_validation, dim)),
+                                                                  threads, workers)
+        self.validation = dict((name, 0.) for name, use_log in self._blocks)
+        distances = []
+        errors = []
+        for point, true in zip(validation_points, validation_outputs):
+            point_errors = self._errors(true, self._from_features(self._predict_features(point)))
+            for name in point_errors:
+                self.validation[name] = max(self.validation[name], point_errors[name])
+            errors.append(max(point_errors.values()))
+            distances.append(np.min(np.sqrt(((self._nodes - point)**2).sum(axis=1))))
+        self.validation['max'] = max(errors) if errors else np.inf
+        order = np.argsort(distances)
+        self._validation_distances = np.array(distances)[order]
+        # largest error among the validation points at least as far from the nodes
+        self._validation_errors = np.maximum.accumulate(np.array(errors)[order][::-1])[::-1]
+        self.n_components = n_components
+        self.trained = True
+        return dict(self.validation)
+
+    # ------------------------------------------------------------------
+    # Same interface as Class
+    # ------------------------------------------------------------------
+
+    def set(self, *pars, **kars):
+        if len(pars) == 1:
+            self._pars.update(dict(pars[0]))
+        elif len(pars) != 0:
+            raise CosmoSevereError("bad call")
+        self._pars.update(kars)
+        self.struct_cleanup()
+        return True
+
+    def empty(self):
+        self._pars = {}
+        self.struct_cleanup()
+
+    def _estimate_error(self):
+        """
+        Error estimate of the emulator at the current parameters (inf if
+        they are not in its domain)
+        """
+        if not self.trained or not self._validation_errors.size:
+            return np.inf
+        for name in self._pars:
+            if name not in self.names and str(self._pars[name]) != str(self.fixed_pars.get(name)):
+                return np.inf
+        if any(name not in self._pars for name in self.names):
+            return np.inf
+        point = self._unit([float(self._pars[name]) for name in self.names])
+        if np.any(point < 0.) or np.any(point > 1.):
+            return np.inf
+        distance = np.min(np.sqrt(((self._nodes - point)**2).sum(axis=1)))
+        index = np.searchsorted(self._validation_distances, distance)
+        if index >= self._validation_distances.size:
+            return np.inf
+        return float(self._validation_errors[index])
+
+    def compute(self, level=["lensing"]):
+        """
+        compute(level=["lensing"])
+
+        Emulate the spectra if the error estimate at these parameters is
+        below the tolerance, otherwise run the full CLASS pipeline
+        """
+        if self._spectra is not None or self._cosmo is not None:
+            return
+        self._estimate = self._estimate_error()
+        if self._estimate <= self.tolerance:
+            point = self._unit([float(self._pars[name]) for name in self.names])
+            self._spectra = self._from_features(self._predict_features(point))
+            self.emulated = True
+        else:
+            self._full(level)
+
+    def _full(self, level=["lensing"]):
+        """
+        Class instance computed by the full pipeline at the current parameters
+        """
+        if self._cosmo is None:
+            cosmo = Class()
+            cosmo.set(self.fixed_pars)
+            cosmo.set(self._pars)
+            cosmo.compute(list(level))
+            self._cosmo = cosmo
+            self.emulated = False
+        return self._cosmo
+
+    def error_estimate(self):
+        """
+        Error estimate of the emulator at the parameters of the last
+        compute(): below the tolerance when the spectra were emulated, inf
+        outside of the domain of the emulator
+        """
+        return self._estimate
+
+    def struct_cleanup(self):
+        if self._cosmo is not None:
+            self._cosmo.struct_cleanup()
+        self._cosmo = None
+        self._spectra = None
+        self.emulated = False
+        self._estimate = np.inf
+
+    def raw_cl(self, lmax=-1, nofail=False):
+        """
+        Dictionary of the unlensed C_l's, as Class.raw_cl()
+        """
+        if self._spectra is None or not self.has_cls or lmax > self.lmax:
+            return self._full().raw_cl(lmax, nofail)
+        if lmax == -1:
+            lmax = self.lmax
+        cl = {'ell': np.arange(lmax+1)}
+        for name, use_log in self._blocks:
+            if name != 'pk':
+                cl[name] = np.zeros(lmax+1)
+                cl[name][2:] = self._spectra[name][:lmax-1]
+        return cl
+
+    def pk_array(self, k, z, nonlinear=None):
+        """
+        Linear P(k) for all pairs of k and z, as Class.pk_array(); emulated
+        when all z are training redshifts and all k in the training range
+        """
+        k = np.ravel(np.asarray(k, dtype='float64'))
+        z = np.ravel(np.asarray(z, dtype='float64'))
+        if (self._spectra is None or not self.has_pk or nonlinear or
+                (nonlinear is None and str(self.fixed_pars.get('non linear', 'none')) not in ['', 'none', '0']) or
+                (k.size and (np.min(k) < self.k[0] or np.max(k) > self.k[-1]))):
+            return self._full().pk_array(k, z, nonlinear)
+        ln_pk = np.log(self._spectra['pk']).reshape((self.z.size, self.k.size))
+        pk = np.zeros((k.size, z.size))
+        for index_z in range(z.size):
+            match = np.nonzero(np.abs(self.z - z[index_z]) <= 1e-10*(1. + np.abs(z[index_z])))[0]
+            if not match.size:
+                return self._full().pk_array(k, z, nonlinear)
+            pk[:, index_z] = np.exp(np.interp(np.log(k), np.log(self.k), ln_pk[match[0]]))
+        return pk
+
+    def pk(self, k, z):
+        return self.pk_array([k], [z])[0, 0]
+
+    def __getattr__(self, name):
+        # any other quantity comes from the full pipeline
+        if name.startswith('_'):
+            raise AttributeError(name)
+        return getattr(self._full(), name)
+
+    def __getstate__(self):
+        state = dict(self.__dict__)
+        state['_cosmo'] = None
+        state['_spectra'] = None
+        state['emulated'] = False
+        state['_estimate'] = np.inf
+        return state
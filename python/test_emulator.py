@@ -0,0 +1,241 @@
+"""
+.. module:: test_emulator
+    :synopsis: python script testing the emulator and the batch functions of classy
+
+This is a python script testing ClassEmulator against the full CLASS
+pipeline, and compute_many(), get_state(), set_state() and successive
+runs of one instance against Class.compute(). The wrapper must be built
+first: 'make test_classy' builds and installs it, then runs this script.
+Otherwise, type
+nosetests test_emulator.py
+or
+python test_emulator.py
+
+The emulator is trained once for all its tests, on a small box of two
+parameters; this takes about a hundred CLASS runs.
+"""
+from classy import Class
+from classy import ClassEmulator
+from classy import CosmoError
+from classy import CosmoSevereError
+from classy import compute_many
+import pickle
+import unittest
+import numpy as np
+
+# Parameters common to all cosmologies of these tests
+FIXED = {'output': 'tCl,pCl,mPk',
+         'lensing': 'no',
+         'l_max_scalars': 1000,
+         'P_k_max_1/Mpc': 1.5,
+         'z_max_pk': 1.}
+
+# Box of the emulator
+VARIED = {'omega_b': (0.0215, 0.0230),
+          'omega_cdm': (0.115, 0.125)}
+
+LMAX = 1000
+Z = [0., 1.]
+K = np.logspace(-3., 0., 50)
+
+
+def full_class(pars):
+    """
+    Class instance computed with FIXED and pars
+    """
+    cosmo = Class()
+    cosmo.set(FIXED)
+    cosmo.set(pars)
+    cosmo.compute()
+    return cosmo
+
+
+def relative_errors(cl, cl_ref, pk, pk_ref):
+    """
+    Largest error of each spectrum, defined as in the documentation of
+    ClassEmulator: relative for the auto-spectra and P(k), relative to
+    sqrt(C_l^XX C_l^YY) for a cross-spectrum XY
+    """
+    errors = {}
+    for name in ['tt', 'ee']:
+        errors[name] = np.max(np.abs(cl[name][2:]/cl_ref[name][2:] - 1.))
+    scale = np.sqrt(np.abs(cl_ref['tt'][2:]*cl_ref['ee'][2:]))
+    errors['te'] = np.max(np.abs(cl['te'][2:] - cl_ref['te'][2:])/scale)
+    errors['pk'] = np.max(np.abs(pk/pk_ref - 1.))
+    return errors
+
+
+class TestEmulator(unittest.TestCase):
+    """
+    ClassEmulator against the full pipeline
+    """
+
+    @classmethod
+    def setUpClass(cls):
+        cls.emulator = ClassEmulator(FIXED, VARIED, lmax=LMAX, z=Z)
+        cls.validation = cls.emulator.train(60, seed=1)
+
+    def query(self, pars):
+        """
+        Spectra of the emulator and of the full pipeline at pars
+        """
+        self.emulator.set(pars)
+        self.emulator.compute()
+        cl = self.emulator.raw_cl(LMAX)
+        pk = self.emulator.pk_array(K, Z)
+        cosmo = full_class(pars)
+        cl_ref = cosmo.raw_cl(LMAX)
+        pk_ref = cosmo.pk_array(K, Z, nonlinear=False)
+        cosmo.struct_cleanup()
+        cosmo.empty()
+        return cl, cl_ref, pk, pk_ref
+
+    def test_validation(self):
+        """The validation errors are finite and cover all emulated spectra"""
+        for name in ['tt', 'ee', 'te', 'pk', 'max']:
+            self.assertIn(name, self.validation)
+            self.assertTrue(np.isfinite(self.validation[name]))
+
+    def test_within_tolerance(self):
+        """Emulated spectra agree with the full pipeline within the tolerance"""
+        rng = np.random.RandomState(2)
+        emulated = 0
+        for index in range(8):
+            # points away from the edges of the box
+            pars = {}
+            for name in VARIED:
+                low, high = VARIED[name]
+                pars[name] = low + (high - low)*rng.uniform(0.2, 0.8)
+            cl, cl_ref, pk, pk_ref = self.query(pars)
+            if not self.emulator.emulated:
+                continue
+            emulated += 1
+            self.assertLessEqual(self.emulator.error_estimate(), self.emulator.tolerance)
+            errors = relative_errors(cl, cl_ref, pk, pk_ref)
+            for name in errors:
+                self.assertLessEqual(
+                    errors[name], self.emulator.tolerance,
+                    "error %e on %s at %s above the tolerance %e" % (
+                        errors[name], name, pars, self.emulator.tolerance))
+        # otherwise this test would not check anything
+        self.assertGreater(emulated, 0, "no query was answered by the emulator")
+
+    def test_outside_box(self):
+        """Outside of the box, the full pipeline is run"""
+        pars = {'omega_b': 0.0240, 'omega_cdm': 0.120}
+        cl, cl_ref, pk, pk_ref = self.query(pars)
+        self.assertFalse(self.emulator.emulated)
+        self.assertEqual(self.emulator.error_estimate(), np.inf)
+        for name in ['tt', 'ee', 'te']:
+            np.testing.assert_array_equal(cl[name], cl_ref[name])
+        np.testing.assert_array_equal(pk, pk_ref)
+
+    def test_other_parameters(self):
+        """Changing a parameter which is not varied runs the full pipeline"""
+        self.emulator.set({'omega_b': 0.0222, 'omega_cdm': 0.120, 'n_s': 0.95})
+        self.emulator.compute()
+        self.assertFalse(self.emulator.emulated)
+        self.emulator.empty()
+
+    def test_pickle(self):
+        """A pickled emulator gives the same spectra"""
+        pars = {'omega_b': 0.0222, 'omega_cdm': 0.120}
+        self.emulator.set(pars)
+        self.emulator.compute()
+        copy = pickle.loads(pickle.dumps(self.emulator))
+        copy.compute()
+        self.assertEqual(copy.emulated, self.emulator.emulated)
+        cl = self.emulator.raw_cl(LMAX)
+        cl_copy = copy.raw_cl(LMAX)
+        for name in ['tt', 'ee', 'te']:
+            np.testing.assert_array_equal(cl[name], cl_copy[name])
+        copy.struct_cleanup()
+        self.emulator.struct_cleanup()
+
+
+class TestBatch(unittest.TestCase):
+    """
+    compute_many(), get_state() and set_state() against Class.compute()
+    """
+
+    def setUp(self):
+        self.list_of_pars = [{'omega_b': 0.0220, 'omega_cdm': 0.118},
+                             {'omega_b': 0.0225, 'omega_cdm': 0.121},
+                             {'omega_b': 0.0228, 'omega_cdm': 0.124}]
+        for pars in self.list_of_pars:
+            pars.update(FIXED)
+
+    def assert_same_results(self, cosmo, cosmo_ref):
+        cl = cosmo.raw_cl(LMAX)
+        cl_ref = cosmo_ref.raw_cl(LMAX)
+        for name in ['tt', 'ee', 'te']:
+            np.testing.assert_array_equal(cl[name], cl_ref[name])
+        np.testing.assert_array_equal(cosmo.pk_array(K, Z, nonlinear=False),
+                                      cosmo_ref.pk_array(K, Z, nonlinear=False))
+        self.assertEqual(cosmo.angular_distance(1.), cosmo_ref.angular_distance(1.))
+        self.assertEqual(cosmo.rs_drag(), cosmo_ref.rs_drag())
+
+    def test_compute_many(self):
+        """compute_many() gives the results of compute(), in the same order"""
+        cosmos = compute_many(self.list_of_pars, threads=2, workers=2)
+        self.assertEqual(len(cosmos), len(self.list_of_pars))
+        for pars, cosmo in zip(self.list_of_pars, cosmos):
+            cosmo_ref = full_class(pars)
+            self.assert_same_results(cosmo, cosmo_ref)
+            cosmo_ref.struct_cleanup()
+            cosmo.struct_cleanup()
+
+    def test_compute_many_exceptions(self):
+        """A failed cosmology gives its error with return_exceptions=True"""
+        bad = dict(self.list_of_pars[0])
+        bad['omega_b'] = -1.
+        cosmos = compute_many([self.list_of_pars[0], bad], return_exceptions=True)
+        self.assertIsInstance(cosmos[0], Class)
+        self.assertIsInstance(cosmos[1], CosmoError)
+        cosmos[0].struct_cleanup()
+        self.assertRaises(CosmoError, compute_many, [self.list_of_pars[0], bad])
+
+    def test_state(self):
+        """set_state() restores the results of get_state(), also through pickle"""
+        cosmo = full_class(self.list_of_pars[1])
+        restored = Class()
+        restored.set_state(cosmo.get_state())
+        self.assert_same_results(restored, cosmo)
+        unpickled = pickle.loads(pickle.dumps(cosmo))
+        self.assert_same_results(unpickled, cosmo)
+        for instance in [cosmo, restored, unpickled]:
+            instance.struct_cleanup()
+
+    def test_successive_cosmologies(self):
+        """One instance, whose perturbation workspaces are kept between
+        runs, gives the results of fresh instances for different models"""
+        # the specialised kernel of perturb_derivs() is valid for flat
+        # models only: a workspace built for one must not be reused for
+        # a curved one
+        models = [{},
+                  {'Omega_k': 0.02},
+                  {'N_ur': 2.0328, 'N_ncdm': 1, 'm_ncdm': 0.06},
+                  {}]
+        cosmo = Class()
+        for model in models:
+            pars = dict(self.list_of_pars[0])
+            pars['perturb_specialised_derivs'] = 1
+            pars.update(model)
+            cosmo.struct_cleanup()
+            cosmo.empty()
+            cosmo.set(pars)
+            cosmo.compute()
+            cosmo_ref = full_class(pars)
+            self.assert_same_results(cosmo, cosmo_ref)
+            cosmo_ref.struct_cleanup()
+        cosmo.struct_cleanup()
+
+    def test_state_before_compute(self):
+        """get_state() needs a computed cosmology"""
+        cosmo = Class()
+        cosmo.set(self.list_of_pars[0])
+        self.assertRaises(CosmoSevereError, cosmo.get_state)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -139,7 +139,24 @@ int background_at_tau(
       or array_interpolate_growing_closeby() (depending on
       interpolation mode) */
 
-  if (intermode == pba->inter_normal) {
+  if ((intermode == pba->inter_normal) && (pba->tau_lookup.index != NULL)) {
+    class_call(array_interpolate_spline_lookup(
+                                               &(pba->tau_lookup),
+                                               pba->tau_table,
+                                               pba->bt_size,
+                                               pba->background_table,
+                                               pba->d2background_dtau2_table,
+                                               pba->bg_size,
+                                               tau,
+                                               log(tau),
+                                               last_index,
+                                               pvecback,
+                                               pvecback_size,
+                                               pba->error_message),
+               pba->error_message,
+               pba->error_message);
+  }
+  else if (intermode == pba->inter_normal) {
     class_call(array_interpolate_spline(
                                         pba->tau_table,
                                         pba->bt_size,
@@ -206,7 +223,28 @@ int background_tau_of_z(
              pba->error_message,
              "out of range: a=%e > a_max=%e\n",z,pba->z_table[0]);
 
-  /** - interpolate from pre-computed table with array_interpolate() */
+  /** - interpolate from pre-computed table with array_interpolate(),
+      or with array_interpolate_spline_lookup() when a uniform grid
+      in ln(a) is available */
+  if (pba->z_lookup.index != NULL) {
+    class_call(array_interpolate_spline_lookup(
+                                               &(pba->z_lookup),
+                                               pba->z_table,
+                                               pba->bt_size,
+                                               pba->tau_table,
+                                               pba->d2tau_dz2_table,
+                                               1,
+                                               z,
+                                               -log(1.+z),
+                                               &last_index,
+                                               tau,
+                                               1,
+                                               pba->error_message),
+               pba->error_message,
+               pba->error_message);
+    return _SUCCESS_;
+  }
+
   class_call(array_interpolate_spline(
                                       pba->z_table,
                                       pba->bt_size,
@@ -224,6 +262,133 @@ int background_tau_of_z(
   return _SUCCESS_;
 }
 
+/**
+ * Background quantities at several values of conformal time.
+ *
+ * Same as calling background_at_tau() for each tau[i], but when the
+ * values are sorted (in growing or decreasing order) the position
+ * found in the table for each of them is the starting point of the
+ * search for the next one.
+ *
+ * @param pba            Input: pointer to background structure (containing pre-computed table)
+ * @param tau            Input: values of conformal time, sorted or not
+ * @param tau_size       Input: number of values
+ * @param return_format  Input: format of output vectors (short, normal, long)
+ * @param pvecback_table Output: table pvecback_table[i*size+index_bg], where size is the length of the vector returned by background_at_tau() for this format (must be already allocated)
+ * @return the error status
+ */
+
+int background_at_tau_vector(
+                             struct background *pba,
+                             double * tau,
+                             int tau_size,
+                             short return_format,
+                             double * pvecback_table
+                             ) {
+
+  int pvecback_size;
+  int i;
+  int last_index=0;
+  short growing=_TRUE_,decreasing=_TRUE_;
+  short intermode;
+
+  if (return_format == pba->normal_info)
+    pvecback_size=pba->bg_size_normal;
+  else if (return_format == pba->short_info)
+    pvecback_size=pba->bg_size_short;
+  else
+    pvecback_size=pba->bg_size;
+
+  for (i=1; i<tau_size; i++) {
+    if (tau[i] < tau[i-1]) growing = _FALSE_;
+    if (tau[i] > tau[i-1]) decreasing = _FALSE_;
+  }
+
+  for (i=0; i<tau_size; i++) {
+
+    if ((i > 0) && ((growing == _TRUE_) || (decreasing == _TRUE_)))
+      intermode = pba->inter_closeby;
+    else
+      intermode = pba->inter_normal;
+
+    class_call(background_at_tau(pba,
+                                 tau[i],
+                                 return_format,
+                                 intermode,
+                                 &last_index,
+                                 pvecback_table+i*pvecback_size),
+               pba->error_message,
+               pba->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Conformal time at several redshifts.
+ *
+ * @param pba    Input: pointer to background structure
+ * @param z      Input: redshifts
+ * @param z_size Input: number of redshifts
+ * @param tau    Output: conformal times (must be already allocated)
+ * @return the error status
+ */
+
+int background_tau_of_z_vector(
+                               struct background *pba,
+                               double * z,
+                               int z_size,
+                               double * tau
+                               ) {
+
+  int i;
+
+  for (i=0; i<z_size; i++) {
+    class_call(background_tau_of_z(pba,z[i],tau+i),
+               pba->error_message,
+               pba->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Background quantities at several redshifts, combining
+ * background_tau_of_z_vector() and background_at_tau_vector().
+ *
+ * @param pba            Input: pointer to background structure
+ * @param z              Input: redshifts, sorted or not
+ * @param z_size         Input: number of redshifts
+ * @param return_format  Input: format of output vectors (short, normal, long)
+ * @param pvecback_table Output: table of background quantities, as in background_at_tau_vector() (must be already allocated)
+ * @return the error status
+ */
+
+int background_at_z_vector(
+                           struct background *pba,
+                           double * z,
+                           int z_size,
+                           short return_format,
+                           double * pvecback_table
+                           ) {
+
+  double * tau;
+
+  class_alloc(tau,MAX(z_size,1)*sizeof(double),pba->error_message);
+
+  class_call(background_tau_of_z_vector(pba,z,z_size,tau),
+             pba->error_message,
+             pba->error_message);
+
+  class_call(background_at_tau_vector(pba,tau,z_size,return_format,pvecback_table),
+             pba->error_message,
+             pba->error_message);
+
+  free(tau);
+
+  return _SUCCESS_;
+}
+
 /**
  * Background quantities at given \f$ a \f$.
  *
@@ -346,7 +511,28 @@ int background_functions(
   }
 
   /* ncdm */
-  if (pba->has_ncdm == _TRUE_) {
+  if ((pba->has_ncdm == _TRUE_) && (pba->ncdm_bg_q2 != NULL)) {
+
+    /* all species at once, written directly in pvecback */
+    class_call(background_ncdm_momenta_all(pba,
+                                           1./a_rel-1.,
+                                           pvecback+pba->index_bg_rho_ncdm1,
+                                           pvecback+pba->index_bg_p_ncdm1,
+                                           pvecback+pba->index_bg_pseudo_p_ncdm1),
+               pba->error_message,
+               pba->error_message);
+
+    for(n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++){
+
+      rho_ncdm = pvecback[pba->index_bg_rho_ncdm1+n_ncdm];
+      p_ncdm = pvecback[pba->index_bg_p_ncdm1+n_ncdm];
+      rho_tot += rho_ncdm;
+      p_tot += p_ncdm;
+      rho_r += 3.* p_ncdm;
+      rho_m += rho_ncdm - 3.* p_ncdm;
+    }
+  }
+  else if (pba->has_ncdm == _TRUE_) {
 
     /* Loop over species: */
     for(n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++){
@@ -463,6 +649,17 @@ int background_init(
   double Neff;
   int filenum=0;
 
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(pba->profile));
+
+  /** - no uniform grid yet for finding positions in the tables, and
+      no ncdm buffer yet */
+  pba->tau_lookup.index = NULL;
+  pba->z_lookup.index = NULL;
+  pba->ncdm_bg_offset = NULL;
+  pba->ncdm_bg_q2 = NULL;
+
   /** - in verbose mode, provide some information */
   if (pba->background_verbose > 0) {
     printf("Running CLASS version %s\n",_VERSION_);
@@ -531,6 +728,13 @@ int background_init(
              pba->error_message,
              pba->error_message);
 
+  /** - gather the ncdm background quadratures for background_ncdm_momenta_all() */
+  if (pba->has_ncdm == _TRUE_) {
+    class_call(background_ncdm_batch_init(pba),
+               pba->error_message,
+               pba->error_message);
+  }
+
   /** - control that cosmological parameter values make sense */
 
   /* H0 in Mpc^{-1} */
@@ -587,6 +791,7 @@ int background_init(
              pba->error_message,
              pba->error_message);
 
+  class_profile_stop(&(pba->profile));
   return _SUCCESS_;
 
 }
@@ -602,17 +807,44 @@ int background_init(
 int background_free(
                     struct background *pba
                     ) {
-  int err;
+
+  class_call(background_free_noinput(pba),
+             pba->error_message,
+             pba->error_message);
+
+  class_call(background_free_input(pba),
+             pba->error_message,
+             pba->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the tables allocated by background_init(), but not the
+ * pointers allocated in input_read_parameters() (e.g. for a copy of
+ * the background structure sharing them with the original one).
+ *
+ * @param pba Input: pointer to background structure (to be freed)
+ * @return the error status
+ */
+
+int background_free_noinput(
+                            struct background *pba
+                            ) {
 
   free(pba->tau_table);
   free(pba->z_table);
   free(pba->d2tau_dz2_table);
   free(pba->background_table);
   free(pba->d2background_dtau2_table);
+  array_lookup_free(&(pba->tau_lookup));
+  array_lookup_free(&(pba->z_lookup));
+  if (pba->ncdm_bg_q2 != NULL) {
+    free(pba->ncdm_bg_offset);
+    free(pba->ncdm_bg_q2);
+  }
 
-  err = background_free_input(pba);
-
-  return err;
+  return _SUCCESS_;
 }
 
 /**
@@ -1045,9 +1277,17 @@ int background_ncdm_test_function(
   return _SUCCESS_;
 }
 
+/** process-level cache of ncdm quadratures (see struct ncdm_quadrature) */
+
+static struct ncdm_quadrature ncdm_quadrature_cache[_NCDM_QUADRATURE_CACHE_SIZE_];
+static int ncdm_quadrature_cache_number = 0; /**< number of entries in use */
+static int ncdm_quadrature_cache_clock = 0;  /**< number of lookups so far */
+
 /**
  * This function finds optimal quadrature weights for each ncdm
- * species
+ * species. When ppr->ncdm_quadrature_cache is true, they are taken
+ * from a process-level cache if a previous call (in any run)
+ * computed them for the same inputs.
  *
  * @param ppr Input: precision structure
  * @param pba Input/Output: background structure
@@ -1058,10 +1298,13 @@ int background_ncdm_init(
                          struct background *pba
                          ) {
 
-  int index_q, k,tolexp,row,status,filenum;
-  double f0m2,f0m1,f0,f0p1,f0p2,dq,q,df0dq,tmp1,tmp2;
+  int k,row,status,filenum;
+  double tmp1,tmp2;
   struct background_parameters_for_distributions pbadist;
   FILE *psdfile;
+  double * key;
+  int key_size;
+  short found;
 
   pbadist.pba = pba;
 
@@ -1116,117 +1359,355 @@ int background_ncdm_init(
       filenum++;
     }
 
-    /* Handle perturbation qsampling: */
-    class_alloc(pba->q_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
-    class_alloc(pba->w_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
-
-    class_call(get_qsampling(pba->q_ncdm[k],
-                             pba->w_ncdm[k],
-                             &(pba->q_size_ncdm[k]),
-                             _QUADRATURE_MAX_,
-                             ppr->tol_ncdm,
-                             pbadist.q,
-                             pbadist.tablesize,
-                             background_ncdm_test_function,
-                             background_ncdm_distribution,
-                             &pbadist,
-                             pba->error_message),
-               pba->error_message,
-               pba->error_message);
-    pba->q_ncdm[k]=realloc(pba->q_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
-    pba->w_ncdm[k]=realloc(pba->w_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
+    /* Handle perturbation and background q-sampling, unless found in the cache: */
+    found = _FALSE_;
 
+    if (ppr->ncdm_quadrature_cache == _TRUE_) {
 
-    if (pba->background_verbose > 0)
-      printf("ncdm species i=%d sampled with %d points for purpose of perturbation integration\n",
-             k+1,
-             pba->q_size_ncdm[k]);
+      class_call(background_ncdm_quadrature_key(ppr,pba,&pbadist,&key,&key_size),
+                 pba->error_message,
+                 pba->error_message);
 
-    /* Handle background q_sampling: */
-    class_alloc(pba->q_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
-    class_alloc(pba->w_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
-
-    class_call(get_qsampling(pba->q_ncdm_bg[k],
-                             pba->w_ncdm_bg[k],
-                             &(pba->q_size_ncdm_bg[k]),
-                             _QUADRATURE_MAX_BG_,
-                             ppr->tol_ncdm_bg,
-                             pbadist.q,
-                             pbadist.tablesize,
-                             background_ncdm_test_function,
-                             background_ncdm_distribution,
-                             &pbadist,
-                             pba->error_message),
-               pba->error_message,
-               pba->error_message);
+#pragma omp critical (ncdm_quadrature_cache)
+      status = background_ncdm_quadrature_cache_get(pba,k,key,key_size,&found);
 
+      class_test(status == _FAILURE_,
+                 pba->error_message,
+                 "could not copy quadrature from cache");
+    }
 
-    pba->q_ncdm_bg[k]=realloc(pba->q_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
-    pba->w_ncdm_bg[k]=realloc(pba->w_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
+    if (found == _FALSE_) {
 
-    /** - in verbose mode, inform user of number of sampled momenta
-        for background quantities */
-    if (pba->background_verbose > 0)
+      class_call(background_ncdm_quadrature(ppr,pba,&pbadist,k),
+                 pba->error_message,
+                 pba->error_message);
+
+      if (ppr->ncdm_quadrature_cache == _TRUE_) {
+
+#pragma omp critical (ncdm_quadrature_cache)
+        status = background_ncdm_quadrature_cache_put(pba,k,key,key_size);
+
+        class_test(status == _FAILURE_,
+                   pba->error_message,
+                   "could not store quadrature in cache");
+      }
+    }
+
+    if (ppr->ncdm_quadrature_cache == _TRUE_)
+      free(key);
+
+    if (pba->background_verbose > 0) {
+      printf("ncdm species i=%d sampled with %d points for purpose of perturbation integration\n",
+             k+1,
+             pba->q_size_ncdm[k]);
+      /** - in verbose mode, inform user of number of sampled momenta
+          for background quantities */
       printf("ncdm species i=%d sampled with %d points for purpose of background integration\n",
              k+1,
              pba->q_size_ncdm_bg[k]);
+    }
 
-    class_alloc(pba->dlnf0_dlnq_ncdm[k],
-                pba->q_size_ncdm[k]*sizeof(double),
-                pba->error_message);
+    pba->factor_ncdm[k]=pba->deg_ncdm[k]*4*_PI_*pow(pba->T_cmb*pba->T_ncdm[k]*_k_B_,4)*8*_PI_*_G_
+      /3./pow(_h_P_/2./_PI_,3)/pow(_c_,7)*_Mpc_over_m_*_Mpc_over_m_;
 
+    /* If allocated, deallocate interpolation table:  */
+    if ((pba->got_files!=NULL)&&(pba->got_files[k]==_TRUE_)){
+      free(pbadist.q);
+      free(pbadist.f0);
+      free(pbadist.d2f0);
+    }
+  }
 
-    for (index_q=0; index_q<pba->q_size_ncdm[k]; index_q++) {
-      q = pba->q_ncdm[k][index_q];
-      class_call(background_ncdm_distribution(&pbadist,q,&f0),
-                 pba->error_message,pba->error_message);
 
-      //Loop to find appropriate dq:
-      for(tolexp=_PSD_DERIVATIVE_EXP_MIN_; tolexp<_PSD_DERIVATIVE_EXP_MAX_; tolexp++){
+  return _SUCCESS_;
+}
 
-        if (index_q == 0){
-          dq = MIN((0.5-ppr->smallest_allowed_variation)*q,2*exp(tolexp)*(pba->q_ncdm[k][index_q+1]-q));
-        }
-        else if (index_q == pba->q_size_ncdm[k]-1){
-          dq = exp(tolexp)*2.0*(pba->q_ncdm[k][index_q]-pba->q_ncdm[k][index_q-1]);
-        }
-        else{
-          dq = exp(tolexp)*(pba->q_ncdm[k][index_q+1]-pba->q_ncdm[k][index_q-1]);
-        }
 
-        class_call(background_ncdm_distribution(&pbadist,q-2*dq,&f0m2),
-                   pba->error_message,pba->error_message);
-        class_call(background_ncdm_distribution(&pbadist,q+2*dq,&f0p2),
-                   pba->error_message,pba->error_message);
+/**
+ * Compute the quadrature weights of one ncdm species, for the
+ * perturbations and for the background, as well as the logarithmic
+ * derivative of its p.s.d. at each momentum of the first quadrature.
+ *
+ * @param ppr     Input: precision structure
+ * @param pba     Input/Output: background structure
+ * @param pbadist Input: parameters of the p.s.d. of this species
+ * @param k       Input: index of the species
+ * @return the error status
+ */
 
-        if (fabs((f0p2-f0m2)/f0)>sqrt(ppr->smallest_allowed_variation)) break;
+int background_ncdm_quadrature(
+                               struct precision *ppr,
+                               struct background *pba,
+                               struct background_parameters_for_distributions * pbadist,
+                               int k
+                               ) {
+
+  int index_q,tolexp;
+  double f0m2,f0m1,f0,f0p1,f0p2,dq,q,df0dq;
+
+  /* Handle perturbation qsampling: */
+  class_alloc(pba->q_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
+  class_alloc(pba->w_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
+
+  class_call(get_qsampling(pba->q_ncdm[k],
+                           pba->w_ncdm[k],
+                           &(pba->q_size_ncdm[k]),
+                           _QUADRATURE_MAX_,
+                           ppr->tol_ncdm,
+                           pbadist->q,
+                           pbadist->tablesize,
+                           background_ncdm_test_function,
+                           background_ncdm_distribution,
+                           pbadist,
+                           pba->error_message),
+             pba->error_message,
+             pba->error_message);
+  pba->q_ncdm[k]=realloc(pba->q_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
+  pba->w_ncdm[k]=realloc(pba->w_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
+
+
+  /* Handle background q_sampling: */
+  class_alloc(pba->q_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
+  class_alloc(pba->w_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
+
+  class_call(get_qsampling(pba->q_ncdm_bg[k],
+                           pba->w_ncdm_bg[k],
+                           &(pba->q_size_ncdm_bg[k]),
+                           _QUADRATURE_MAX_BG_,
+                           ppr->tol_ncdm_bg,
+                           pbadist->q,
+                           pbadist->tablesize,
+                           background_ncdm_test_function,
+                           background_ncdm_distribution,
+                           pbadist,
+                           pba->error_message),
+             pba->error_message,
+             pba->error_message);
+
+
+  pba->q_ncdm_bg[k]=realloc(pba->q_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
+  pba->w_ncdm_bg[k]=realloc(pba->w_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
+
+  class_alloc(pba->dlnf0_dlnq_ncdm[k],
+              pba->q_size_ncdm[k]*sizeof(double),
+              pba->error_message);
+
+
+  for (index_q=0; index_q<pba->q_size_ncdm[k]; index_q++) {
+    q = pba->q_ncdm[k][index_q];
+    class_call(background_ncdm_distribution(pbadist,q,&f0),
+               pba->error_message,pba->error_message);
+
+    //Loop to find appropriate dq:
+    for(tolexp=_PSD_DERIVATIVE_EXP_MIN_; tolexp<_PSD_DERIVATIVE_EXP_MAX_; tolexp++){
+
+      if (index_q == 0){
+        dq = MIN((0.5-ppr->smallest_allowed_variation)*q,2*exp(tolexp)*(pba->q_ncdm[k][index_q+1]-q));
+      }
+      else if (index_q == pba->q_size_ncdm[k]-1){
+        dq = exp(tolexp)*2.0*(pba->q_ncdm[k][index_q]-pba->q_ncdm[k][index_q-1]);
+      }
+      else{
+        dq = exp(tolexp)*(pba->q_ncdm[k][index_q+1]-pba->q_ncdm[k][index_q-1]);
       }
 
-      class_call(background_ncdm_distribution(&pbadist,q-dq,&f0m1),
+      class_call(background_ncdm_distribution(pbadist,q-2*dq,&f0m2),
                  pba->error_message,pba->error_message);
-      class_call(background_ncdm_distribution(&pbadist,q+dq,&f0p1),
+      class_call(background_ncdm_distribution(pbadist,q+2*dq,&f0p2),
                  pba->error_message,pba->error_message);
-      //5 point estimate of the derivative:
-      df0dq = (+f0m2-8*f0m1+8*f0p1-f0p2)/12.0/dq;
-      //printf("df0dq[%g] = %g. dlf=%g ?= %g. f0 =%g.\n",q,df0dq,q/f0*df0dq,
-      //Avoid underflow in extreme tail:
-      if (fabs(f0)==0.)
-        pba->dlnf0_dlnq_ncdm[k][index_q] = -q; /* valid for whatever f0 with exponential tail in exp(-q) */
-      else
-        pba->dlnf0_dlnq_ncdm[k][index_q] = q/f0*df0dq;
+
+      if (fabs((f0p2-f0m2)/f0)>sqrt(ppr->smallest_allowed_variation)) break;
     }
 
-    pba->factor_ncdm[k]=pba->deg_ncdm[k]*4*_PI_*pow(pba->T_cmb*pba->T_ncdm[k]*_k_B_,4)*8*_PI_*_G_
-      /3./pow(_h_P_/2./_PI_,3)/pow(_c_,7)*_Mpc_over_m_*_Mpc_over_m_;
+    class_call(background_ncdm_distribution(pbadist,q-dq,&f0m1),
+               pba->error_message,pba->error_message);
+    class_call(background_ncdm_distribution(pbadist,q+dq,&f0p1),
+               pba->error_message,pba->error_message);
+    //5 point estimate of the derivative:
+    df0dq = (+f0m2-8*f0m1+8*f0p1-f0p2)/12.0/dq;
+    //printf("df0dq[%g] = %g. dlf=%g ?= %g. f0 =%g.\n",q,df0dq,q/f0*df0dq,
+    //Avoid underflow in extreme tail:
+    if (fabs(f0)==0.)
+      pba->dlnf0_dlnq_ncdm[k][index_q] = -q; /* valid for whatever f0 with exponential tail in exp(-q) */
+    else
+      pba->dlnf0_dlnq_ncdm[k][index_q] = q/f0*df0dq;
+  }
 
-    /* If allocated, deallocate interpolation table:  */
-    if ((pba->got_files!=NULL)&&(pba->got_files[k]==_TRUE_)){
-      free(pbadist.q);
-      free(pbadist.f0);
-      free(pbadist.d2f0);
+  return _SUCCESS_;
+}
+
+/**
+ * Summarize in a vector all the inputs on which the quadrature of
+ * one ncdm species depends: tolerances, chemical potential, optional
+ * p.s.d. parameters, and tabulated p.s.d. if read from a file.
+ *
+ * @param ppr      Input: precision structure
+ * @param pba      Input: background structure
+ * @param pbadist  Input: parameters of the p.s.d. of this species
+ * @param key      Output: pointer to the key (allocated here, to be freed by the caller)
+ * @param key_size Output: size of the key
+ * @return the error status
+ */
+
+int background_ncdm_quadrature_key(
+                                   struct precision *ppr,
+                                   struct background *pba,
+                                   struct background_parameters_for_distributions * pbadist,
+                                   double ** key,
+                                   int * key_size
+                                   ) {
+
+  int i,n;
+  int k = pbadist->n_ncdm;
+
+  *key_size = 9 + pba->ncdm_psd_parameters_size + 2*pbadist->tablesize;
+
+  class_alloc(*key,*key_size*sizeof(double),pba->error_message);
+
+  n=0;
+  (*key)[n++] = ((pba->got_files != NULL) ? (double)(pba->got_files[k]) : 0.);
+  (*key)[n++] = pba->ksi_ncdm[k];
+  (*key)[n++] = ppr->tol_ncdm;
+  (*key)[n++] = ppr->tol_ncdm_bg;
+  (*key)[n++] = ppr->smallest_allowed_variation;
+  (*key)[n++] = (double)_QUADRATURE_MAX_;
+  (*key)[n++] = (double)_QUADRATURE_MAX_BG_;
+  (*key)[n++] = (double)pba->ncdm_psd_parameters_size;
+  for (i=0; i<pba->ncdm_psd_parameters_size; i++)
+    (*key)[n++] = pba->ncdm_psd_parameters[i];
+  (*key)[n++] = (double)pbadist->tablesize;
+  for (i=0; i<pbadist->tablesize; i++) {
+    (*key)[n++] = pbadist->q[i];
+    (*key)[n++] = pbadist->f0[i];
+  }
+
+  class_test(n != *key_size,
+             pba->error_message,
+             "stop to avoid overflow: %d entries for a key of size %d",n,*key_size);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Look for the quadrature of one ncdm species in the process-level
+ * cache and, if found, copy it in the background structure. Must be
+ * called inside the critical section ncdm_quadrature_cache.
+ *
+ * @param pba      Input/Output: background structure
+ * @param k        Input: index of the species
+ * @param key      Input: key built by background_ncdm_quadrature_key()
+ * @param key_size Input: size of the key
+ * @param found    Output: _TRUE_ if the quadrature was found
+ * @return the error status
+ */
+
+int background_ncdm_quadrature_cache_get(
+                                         struct background *pba,
+                                         int k,
+                                         double * key,
+                                         int key_size,
+                                         short * found
+                                         ) {
+
+  int index_entry;
+  struct ncdm_quadrature * entry;
+
+  *found = _FALSE_;
+  ncdm_quadrature_cache_clock++;
+
+  for (index_entry=0; index_entry<ncdm_quadrature_cache_number; index_entry++) {
+
+    entry = &(ncdm_quadrature_cache[index_entry]);
+
+    if ((entry->key_size == key_size) &&
+        (memcmp(entry->key,key,key_size*sizeof(double)) == 0)) {
+
+      pba->q_size_ncdm[k] = entry->q_size;
+      pba->q_size_ncdm_bg[k] = entry->q_size_bg;
+
+      class_alloc(pba->q_ncdm[k],entry->q_size*sizeof(double),pba->error_message);
+      class_alloc(pba->w_ncdm[k],entry->q_size*sizeof(double),pba->error_message);
+      class_alloc(pba->dlnf0_dlnq_ncdm[k],entry->q_size*sizeof(double),pba->error_message);
+      class_alloc(pba->q_ncdm_bg[k],entry->q_size_bg*sizeof(double),pba->error_message);
+      class_alloc(pba->w_ncdm_bg[k],entry->q_size_bg*sizeof(double),pba->error_message);
+
+      memcpy(pba->q_ncdm[k],entry->q,entry->q_size*sizeof(double));
+      memcpy(pba->w_ncdm[k],entry->w,entry->q_size*sizeof(double));
+      memcpy(pba->dlnf0_dlnq_ncdm[k],entry->dlnf0_dlnq,entry->q_size*sizeof(double));
+      memcpy(pba->q_ncdm_bg[k],entry->q_bg,entry->q_size_bg*sizeof(double));
+      memcpy(pba->w_ncdm_bg[k],entry->w_bg,entry->q_size_bg*sizeof(double));
+
+      entry->last_use = ncdm_quadrature_cache_clock;
+      *found = _TRUE_;
+
+      return _SUCCESS_;
     }
   }
 
+  return _SUCCESS_;
+}
+
+/**
+ * Store the quadrature of one ncdm species in the process-level
+ * cache, in a free entry or in place of the least recently used
+ * one. Must be called inside the critical section
+ * ncdm_quadrature_cache.
+ *
+ * @param pba      Input: background structure
+ * @param k        Input: index of the species
+ * @param key      Input: key built by background_ncdm_quadrature_key()
+ * @param key_size Input: size of the key
+ * @return the error status
+ */
+
+int background_ncdm_quadrature_cache_put(
+                                         struct background *pba,
+                                         int k,
+                                         double * key,
+                                         int key_size
+                                         ) {
+
+  int index_entry,index_lru;
+  struct ncdm_quadrature * entry;
+
+  if (ncdm_quadrature_cache_number < _NCDM_QUADRATURE_CACHE_SIZE_) {
+    index_lru = ncdm_quadrature_cache_number;
+    ncdm_quadrature_cache_number++;
+  }
+  else {
+    index_lru = 0;
+    for (index_entry=1; index_entry<ncdm_quadrature_cache_number; index_entry++)
+      if (ncdm_quadrature_cache[index_entry].last_use < ncdm_quadrature_cache[index_lru].last_use)
+        index_lru = index_entry;
+    entry = &(ncdm_quadrature_cache[index_lru]);
+    free(entry->key);
+    free(entry->q);
+    free(entry->w);
+    free(entry->dlnf0_dlnq);
+    free(entry->q_bg);
+    free(entry->w_bg);
+  }
+
+  entry = &(ncdm_quadrature_cache[index_lru]);
+
+  entry->key_size = key_size;
+  entry->q_size = pba->q_size_ncdm[k];
+  entry->q_size_bg = pba->q_size_ncdm_bg[k];
+  entry->last_use = ncdm_quadrature_cache_clock;
+
+  class_alloc(entry->key,key_size*sizeof(double),pba->error_message);
+  class_alloc(entry->q,entry->q_size*sizeof(double),pba->error_message);
+  class_alloc(entry->w,entry->q_size*sizeof(double),pba->error_message);
+  class_alloc(entry->dlnf0_dlnq,entry->q_size*sizeof(double),pba->error_message);
+  class_alloc(entry->q_bg,entry->q_size_bg*sizeof(double),pba->error_message);
+  class_alloc(entry->w_bg,entry->q_size_bg*sizeof(double),pba->error_message);
+
+  memcpy(entry->key,key,key_size*sizeof(double));
+  memcpy(entry->q,pba->q_ncdm[k],entry->q_size*sizeof(double));
+  memcpy(entry->w,pba->w_ncdm[k],entry->q_size*sizeof(double));
+  memcpy(entry->dlnf0_dlnq,pba->dlnf0_dlnq_ncdm[k],entry->q_size*sizeof(double));
+  memcpy(entry->q_bg,pba->q_ncdm_bg[k],entry->q_size_bg*sizeof(double));
+  memcpy(entry->w_bg,pba->w_ncdm_bg[k],entry->q_size_bg*sizeof(double));
 
   return _SUCCESS_;
 }
@@ -1309,6 +1790,116 @@ int background_ncdm_momenta(
   return _SUCCESS_;
 }
 
+/**
+ * Gather the background quadratures of all ncdm species in one
+ * structure-of-arrays buffer, with the powers of q multiplying each
+ * weight computed once and for all, for background_ncdm_momenta_all().
+ *
+ * @param pba Input/Output: background structure
+ * @return the error status
+ */
+
+int background_ncdm_batch_init(
+                               struct background *pba
+                               ) {
+
+  int n_ncdm,index_q,i;
+  double q2,w;
+
+  class_alloc(pba->ncdm_bg_offset,pba->N_ncdm*sizeof(int),pba->error_message);
+
+  pba->ncdm_bg_size_tot = 0;
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+    pba->ncdm_bg_offset[n_ncdm] = pba->ncdm_bg_size_tot;
+    pba->ncdm_bg_size_tot += pba->q_size_ncdm_bg[n_ncdm];
+  }
+
+  /* one allocation for the four arrays */
+  class_alloc(pba->ncdm_bg_q2,4*pba->ncdm_bg_size_tot*sizeof(double),pba->error_message);
+  pba->ncdm_bg_w_q2 = pba->ncdm_bg_q2 + pba->ncdm_bg_size_tot;
+  pba->ncdm_bg_w_q4 = pba->ncdm_bg_w_q2 + pba->ncdm_bg_size_tot;
+  pba->ncdm_bg_w_q6 = pba->ncdm_bg_w_q4 + pba->ncdm_bg_size_tot;
+
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+    for (index_q=0; index_q<pba->q_size_ncdm_bg[n_ncdm]; index_q++) {
+      i = pba->ncdm_bg_offset[n_ncdm]+index_q;
+      q2 = pba->q_ncdm_bg[n_ncdm][index_q]*pba->q_ncdm_bg[n_ncdm][index_q];
+      w = pba->w_ncdm_bg[n_ncdm][index_q];
+      pba->ncdm_bg_q2[i] = q2;
+      pba->ncdm_bg_w_q2[i] = w*q2;
+      pba->ncdm_bg_w_q4[i] = w*q2*q2/3.;
+      pba->ncdm_bg_w_q6[i] = w*q2*q2*q2/3.;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Density, pressure and pseudo-pressure of all ncdm species at a
+ * given redshift, as given by background_ncdm_momenta() for each of
+ * them, but from the buffer filled by background_ncdm_batch_init()
+ * and with one SIMD loop per species, free of branches and of calls
+ * to pow().
+ *
+ * @param pba      Input: background structure
+ * @param z        Input: redshift
+ * @param rho      Output: rho[n_ncdm], energy density of each species
+ * @param p        Output: p[n_ncdm], pressure of each species
+ * @param pseudo_p Output: pseudo_p[n_ncdm], pseudo-pressure of each species
+ * @return the error status
+ */
+
+int background_ncdm_momenta_all(
+                                struct background *pba,
+                                double z,
+                                double * rho,
+                                double * p,
+                                double * pseudo_p
+                                ) {
+
+  int n_ncdm,index_q,offset,qsize;
+  double M2,factor2,inv_epsilon,epsilon;
+  double rho_sum,p_sum,pseudo_p_sum;
+  double * __restrict__ q2;
+  double * __restrict__ w_q2;
+  double * __restrict__ w_q4;
+  double * __restrict__ w_q6;
+
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+
+    offset = pba->ncdm_bg_offset[n_ncdm];
+    qsize = pba->q_size_ncdm_bg[n_ncdm];
+    q2 = pba->ncdm_bg_q2 + offset;
+    w_q2 = pba->ncdm_bg_w_q2 + offset;
+    w_q4 = pba->ncdm_bg_w_q4 + offset;
+    w_q6 = pba->ncdm_bg_w_q6 + offset;
+
+    /* squared mass divided by (1+z)^2, and normalization at given redshift */
+    M2 = pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]/(1.+z)/(1.+z);
+    factor2 = pba->factor_ncdm[n_ncdm]*pow(1+z,4);
+
+    rho_sum = 0.;
+    p_sum = 0.;
+    pseudo_p_sum = 0.;
+
+#pragma omp simd private(epsilon,inv_epsilon) reduction(+:rho_sum,p_sum,pseudo_p_sum)
+    for (index_q=0; index_q<qsize; index_q++) {
+      epsilon = sqrt(q2[index_q]+M2);
+      inv_epsilon = 1./epsilon;
+      rho_sum += w_q2[index_q]*epsilon;
+      p_sum += w_q4[index_q]*inv_epsilon;
+      pseudo_p_sum += w_q6[index_q]*inv_epsilon*inv_epsilon*inv_epsilon;
+    }
+
+    rho[n_ncdm] = rho_sum*factor2;
+    p[n_ncdm] = p_sum*factor2;
+    pseudo_p[n_ncdm] = pseudo_p_sum*factor2;
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * When the user passed the density fraction Omega_ncdm or
  * omega_ncdm in input but not the mass, infer the mass with Newton iteration method.
@@ -1418,6 +2009,8 @@ int background_solve(
   int last_index=0;
   /* comoving radius coordinate in Mpc (equal to conformal distance in flat case) */
   double comoving_radius=0.;
+  /* values of the variable of a uniform lookup grid on each line of the tables */
+  double * u_table;
 
   bpaw.pba = pba;
   class_alloc(pvecback,pba->bg_size*sizeof(double),pba->error_message);
@@ -1449,6 +2042,14 @@ int background_solve(
              gTable.error_message,
              pba->error_message);
 
+  /* each step multiplies a by about (1+back_integration_stepsize):
+     reserve room for the expected number of steps */
+  class_call(gt_reserve(&gTable,
+                        (long)(log(pba->a_today/pvecback_integration[pba->index_bi_a])/log(1.+ppr->back_integration_stepsize)+2.)
+                        *pba->bi_size*sizeof(double)),
+             gTable.error_message,
+             pba->error_message);
+
   /* initialize the counter for the number of steps */
   pba->bt_size=0;
 
@@ -1634,6 +2235,36 @@ int background_solve(
              pba->error_message,
              pba->error_message);
 
+  /** - build uniform grids in ln(tau) and ln(a) for finding positions in these tables */
+  if (ppr->uniform_grid_lookup == _TRUE_) {
+
+    class_alloc(u_table,pba->bt_size*sizeof(double),pba->error_message);
+
+    for (i=0; i < pba->bt_size; i++)
+      u_table[i] = log(pba->tau_table[i]);
+
+    class_call(array_lookup_init(u_table,
+                                 pba->bt_size,
+                                 _LOOKUP_MAX_BINS_PER_LINE_*pba->bt_size,
+                                 &(pba->tau_lookup),
+                                 pba->error_message),
+               pba->error_message,
+               pba->error_message);
+
+    for (i=0; i < pba->bt_size; i++)
+      u_table[i] = -log(1.+pba->z_table[i]);
+
+    class_call(array_lookup_init(u_table,
+                                 pba->bt_size,
+                                 _LOOKUP_MAX_BINS_PER_LINE_*pba->bt_size,
+                                 &(pba->z_lookup),
+                                 pba->error_message),
+               pba->error_message,
+               pba->error_message);
+
+    free(u_table);
+  }
+
   /** - compute remaining "related parameters" 
    *     - so-called "effective neutrino number", computed at earliest
       time in interpolation table. This should be seen as a
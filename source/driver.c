@@ -0,0 +1,522 @@
+/** @file driver.c Documented driver of the modules
+ *
+ * Runs the initialisation of all modules, from background_init() to
+ * lensing_init(), as a graph of steps (see enum driver_step). A step
+ * starts as soon as the steps it depends on are done, and the steps
+ * which become ready at the same time run concurrently, each on its
+ * own thread, with nested OpenMP threads for the steps which are
+ * parallelised internally. In particular, primordial_init() and the
+ * flat spherical Bessel functions of the transfer module only need
+ * the indices of the perturbation module, so they are computed while
+ * the perturbation module integrates its sources.
+ *
+ * When an output structure is passed, the output files are written
+ * by steps of the same graph: each group of files (see enum
+ * output_part) is written as soon as the modules it needs are
+ * initialised, e.g. background.dat while the thermodynamics and
+ * perturbations are computed. These steps depend on each other in
+ * the order of enum output_part, so that a single writer runs at a
+ * time, and the files are the same as with output_init() called at
+ * the end.
+ *
+ * The results do not depend on the order in which the steps are run:
+ * they are the same as with the *_init() functions called one after
+ * the other.
+ *
+ * In low-memory mode (ppr->low_memory), the largest tables (see enum
+ * driver_table) are freed as soon as all the steps using them are
+ * done, without changing the results. This lowers the memory used
+ * after each step; the peak, reached in the transfer module, is
+ * lowered by that module itself (see transfer_get_passes()).
+ *
+ * The following functions can be called from other modules:
+ *
+ * -# driver_init() after input_init(), instead of the *_init() functions
+ */
+
+#include "driver.h"
+
+/** module initialised by each step (-1 for the output steps) */
+static const int driver_module[_DRIVER_STEPS_] = {
+  cs_background, cs_thermodynamics, cs_perturbations, cs_perturbations, cs_primordial,
+  cs_nonlinear, cs_transfer, cs_transfer, cs_spectra, cs_lensing,
+  -1, -1, -1, -1, -1
+};
+
+/** steps producing the tables freed in low-memory mode (see enum driver_table) */
+static const int driver_table_producer[_DRIVER_TABLES_] = {
+  ds_perturb_sources, ds_transfer_compute
+};
+
+/** steps using each of these tables, as bit fields (1<<index_step) */
+static const int driver_table_consumers[_DRIVER_TABLES_] = {
+  (1<<ds_nonlinear) | (1<<ds_transfer_compute) | (1<<ds_spectra),
+  (1<<ds_spectra)
+};
+
+/**
+ * Initialise the modules from background to lensing, running
+ * concurrently the steps which do not depend on each other.
+ *
+ * With compute=NULL, all modules are initialised. Otherwise, only the
+ * modules with compute[index_stage] == _TRUE_ (with index_stage one
+ * of the computation_stage's) are; the other ones must already be
+ * initialised if they are needed, or not be needed at all.
+ *
+ * If computed is not NULL, computed[index_stage] is set to _TRUE_ for
+ * each module initialised by this call, even when another module
+ * failed: the caller must then free these modules only.
+ *
+ * If pop is not NULL, the output files are also written, by the steps
+ * ds_output_*; they run even when compute is not NULL, and then need
+ * the modules which are not requested to be already initialised.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Output: pointer to background structure
+ * @param pth      Output: pointer to thermodynamics structure
+ * @param ppt      Output: pointer to perturbation structure
+ * @param ppm      Output: pointer to primordial structure
+ * @param pnl      Output: pointer to nonlinear structure
+ * @param ptr      Output: pointer to transfers structure
+ * @param psp      Output: pointer to spectra structure
+ * @param ple      Output: pointer to lensing structure
+ * @param pop      Input: pointer to output structure, or NULL for not writing output files
+ * @param compute  Input: modules to initialise (array of _NUM_STAGES_ flags), or NULL for all of them
+ * @param computed Output: modules initialised (array of _NUM_STAGES_ flags), or NULL
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int driver_init(
+                struct precision * ppr,
+                struct background * pba,
+                struct thermo * pth,
+                struct perturbs * ppt,
+                struct primordial * ppm,
+                struct nonlinear * pnl,
+                struct transfers * ptr,
+                struct spectra * psp,
+                struct lensing * ple,
+                struct output * pop,
+                short * compute,
+                short * computed,
+                ErrorMsg errmsg
+                ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  /* for each step, bit field of the steps it depends on, and whether
+     it uses several threads */
+  int depends[_DRIVER_STEPS_];
+  short parallel[_DRIVER_STEPS_];
+  /* for each step, whether it must run, and whether it is done */
+  short todo[_DRIVER_STEPS_];
+  short done[_DRIVER_STEPS_];
+  /* for each step, status and error message of its last run */
+  int status[_DRIVER_STEPS_];
+  ErrorMsg step_errmsg[_DRIVER_STEPS_];
+  /* for each table of enum driver_table, whether it has been freed */
+  short freed[_DRIVER_TABLES_];
+  int index_table;
+  /* steps ready to run at the same time, and how many of them are parallelised */
+  int ready[_DRIVER_STEPS_];
+  int ready_size;
+  int parallel_size;
+  int index_step,index_other,index_ready,index_stage;
+  /* first step which failed (-1 if none) */
+  int failed=-1;
+  /* whether the ready steps run concurrently */
+  short concurrent;
+  /* number of threads, in total and for each parallelised step running concurrently with others */
+  int number_of_threads=1;
+  int inner_threads;
+#ifdef _OPENMP
+  /* OpenMP settings of the caller, restored at the end */
+  int nested=0;
+  int max_active_levels=1;
+  short in_parallel;
+#endif
+
+  /** - find the dependencies between the steps */
+
+  class_call(driver_dependencies(ppr,pnl,depends,parallel),
+             errmsg,
+             errmsg);
+
+  for (index_step = 0; index_step < _DRIVER_STEPS_; index_step++) {
+    if (driver_module[index_step] < 0)
+      todo[index_step] = (pop != NULL) ? _TRUE_ : _FALSE_;
+    else
+      todo[index_step] = ((compute == NULL) || (compute[driver_module[index_step]] == _TRUE_)) ? _TRUE_ : _FALSE_;
+    done[index_step] = _FALSE_;
+  }
+
+  for (index_table = 0; index_table < _DRIVER_TABLES_; index_table++)
+    freed[index_table] = _FALSE_;
+
+  /** - allow each step running concurrently with others to start its
+      own team of threads, unless we are already in a parallel region
+      (then all steps run one after the other in the calling thread) */
+
+#ifdef _OPENMP
+  number_of_threads = omp_get_max_threads();
+  in_parallel = omp_in_parallel();
+  if (in_parallel == _FALSE_) {
+    nested = omp_get_nested();
+    max_active_levels = omp_get_max_active_levels();
+    omp_set_nested(1);
+    omp_set_max_active_levels(MAX(max_active_levels,2));
+  }
+  else {
+    number_of_threads = 1;
+  }
+#endif
+
+  /** - run the steps by successive groups of steps ready at the same
+      time, until all of them are done or one of them failed */
+
+  while (failed < 0) {
+
+    ready_size = 0;
+    parallel_size = 0;
+
+    for (index_step = 0; index_step < _DRIVER_STEPS_; index_step++) {
+
+      if ((todo[index_step] == _FALSE_) || (done[index_step] == _TRUE_))
+        continue;
+
+      for (index_other = 0; index_other < _DRIVER_STEPS_; index_other++) {
+        if (((depends[index_step] >> index_other) & 1) &&
+            (todo[index_other] == _TRUE_) && (done[index_other] == _FALSE_))
+          break;
+      }
+
+      if (index_other == _DRIVER_STEPS_) {
+        ready[ready_size++] = index_step;
+        if (parallel[index_step] == _TRUE_)
+          parallel_size++;
+      }
+    }
+
+    if (ready_size == 0)
+      break;
+
+    /** - --> the parallelised steps share all threads; each other
+        step gets one extra thread, only busy for a short time */
+
+    concurrent = ((ready_size > 1) && (number_of_threads > 1)) ? _TRUE_ : _FALSE_;
+    inner_threads = MAX(1,number_of_threads/MAX(parallel_size,1));
+
+#pragma omp parallel for                                          \
+  schedule(dynamic,1)                                             \
+  num_threads(MIN(ready_size,number_of_threads))                  \
+  private(index_step)                                             \
+  if(concurrent)
+
+    for (index_ready = 0; index_ready < ready_size; index_ready++) {
+
+      index_step = ready[index_ready];
+
+#ifdef _OPENMP
+      if (concurrent == _TRUE_)
+        omp_set_num_threads(parallel[index_step] == _TRUE_ ? inner_threads : 1);
+#endif
+
+      status[index_step] = driver_step(ppr,pba,pth,ppt,ppm,pnl,ptr,psp,ple,pop,index_step,step_errmsg[index_step]);
+    }
+
+    for (index_ready = 0; index_ready < ready_size; index_ready++) {
+      index_step = ready[index_ready];
+      if (status[index_step] == _SUCCESS_)
+        done[index_step] = _TRUE_;
+      else if (failed < 0)
+        failed = index_step;
+    }
+
+    /** - --> in low-memory mode, free the tables produced by this
+        call and used by no remaining step. A table is kept if one of
+        the steps using it was not requested, since the caller may
+        run it later. */
+
+    if ((ppr->low_memory == _TRUE_) && (failed < 0)) {
+
+      for (index_table = 0; index_table < _DRIVER_TABLES_; index_table++) {
+
+        if ((freed[index_table] == _TRUE_) ||
+            (todo[driver_table_producer[index_table]] == _FALSE_) ||
+            (done[driver_table_producer[index_table]] == _FALSE_))
+          continue;
+
+        for (index_step = 0; index_step < _DRIVER_STEPS_; index_step++) {
+          if (((driver_table_consumers[index_table] >> index_step) & 1) &&
+              ((todo[index_step] == _FALSE_) || (done[index_step] == _FALSE_)))
+            break;
+        }
+
+        if (index_step == _DRIVER_STEPS_) {
+          class_call(driver_free_table(ppt,ptr,index_table,errmsg),
+                     errmsg,
+                     errmsg);
+          freed[index_table] = _TRUE_;
+        }
+      }
+    }
+  }
+
+#ifdef _OPENMP
+  if (in_parallel == _FALSE_) {
+    omp_set_nested(nested);
+    omp_set_max_active_levels(max_active_levels);
+  }
+#endif
+
+  /** - a module is initialised when all its steps are done */
+
+  if (computed != NULL) {
+    for (index_stage = 0; index_stage < _NUM_STAGES_; index_stage++)
+      computed[index_stage] = _FALSE_;
+    for (index_step = 0; index_step < _DRIVER_STEPS_; index_step++)
+      if ((driver_module[index_step] >= 0) && (todo[index_step] == _TRUE_))
+        computed[driver_module[index_step]] = _TRUE_;
+    for (index_step = 0; index_step < _DRIVER_STEPS_; index_step++)
+      if ((driver_module[index_step] >= 0) && (todo[index_step] == _TRUE_) && (done[index_step] == _FALSE_))
+        computed[driver_module[index_step]] = _FALSE_;
+  }
+
+  /** - if the transfer functions will not be computed after the
+      Bessel functions, free the latter */
+
+  if ((todo[ds_transfer_bessel] == _TRUE_) && (done[ds_transfer_bessel] == _TRUE_) &&
+      (done[ds_transfer_compute] == _FALSE_) && (ptr->has_cls == _TRUE_)) {
+    class_call(hyperspherical_HIS_free(&(ptr->BIS),errmsg),
+               errmsg,
+               errmsg);
+  }
+
+  if (failed >= 0) {
+    strcpy(errmsg,step_errmsg[failed]);
+    return _FAILURE_;
+  }
+
+  for (index_step = 0; index_step < _DRIVER_STEPS_; index_step++) {
+    class_test((todo[index_step] == _TRUE_) && (done[index_step] == _FALSE_),
+               errmsg,
+               "step %d could not run: some of the modules it depends on are neither initialised nor requested",
+               index_step);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the steps on which each step depends, and the steps which use
+ * several threads (when such steps run at the same time as others,
+ * they share the threads). Some dependencies only exist for some
+ * precision or input parameters: the Bessel functions need the final
+ * list of wavenumbers of the perturbation module, only known after
+ * its sources with k_adaptive_sampling, and the transfer functions
+ * need the non-linear corrections, if any. The output steps form a
+ * chain, so that they never write at the same time.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pnl      Input: pointer to nonlinear structure (only the input parameters are used)
+ * @param depends  Output: for each step, bit field of the steps it depends on (1<<index_step)
+ * @param parallel Output: for each step, whether it uses several threads
+ * @return the error status
+ */
+
+int driver_dependencies(
+                        struct precision * ppr,
+                        struct nonlinear * pnl,
+                        int * depends,
+                        short * parallel
+                        ) {
+
+  int index_step;
+
+  depends[ds_background] = 0;
+  depends[ds_thermodynamics] = (1<<ds_background);
+  depends[ds_perturb_indices] = (1<<ds_thermodynamics);
+  depends[ds_perturb_sources] = (1<<ds_perturb_indices);
+  depends[ds_primordial] = (1<<ds_perturb_indices);
+  depends[ds_nonlinear] = (1<<ds_perturb_sources) | (1<<ds_primordial);
+  depends[ds_transfer_bessel] = (1<<ds_perturb_indices);
+  if (ppr->k_adaptive_sampling == _TRUE_)
+    depends[ds_transfer_bessel] |= (1<<ds_perturb_sources);
+  depends[ds_transfer_compute] = (1<<ds_transfer_bessel) | (1<<ds_perturb_sources);
+  if (pnl->method != nl_none)
+    depends[ds_transfer_compute] |= (1<<ds_nonlinear);
+  depends[ds_spectra] = (1<<ds_perturb_sources) | (1<<ds_primordial) | (1<<ds_nonlinear) | (1<<ds_transfer_compute);
+  depends[ds_lensing] = (1<<ds_spectra);
+  depends[ds_output_background] = (1<<ds_background);
+  depends[ds_output_thermodynamics] = (1<<ds_output_background) | (1<<ds_thermodynamics);
+  depends[ds_output_primordial] = (1<<ds_output_thermodynamics) | (1<<ds_primordial);
+  depends[ds_output_perturbations] = (1<<ds_output_primordial) | (1<<ds_perturb_sources);
+  depends[ds_output_spectra] = (1<<ds_output_perturbations) | (1<<ds_nonlinear) | (1<<ds_spectra) | (1<<ds_lensing);
+
+  for (index_step = 0; index_step < _DRIVER_STEPS_; index_step++)
+    parallel[index_step] = _TRUE_;
+  parallel[ds_background] = _FALSE_;
+  parallel[ds_thermodynamics] = _FALSE_;
+  parallel[ds_perturb_indices] = _FALSE_;
+  parallel[ds_primordial] = _FALSE_;
+  parallel[ds_transfer_bessel] = _FALSE_;
+  for (index_step = ds_output_background; index_step <= ds_output_spectra; index_step++)
+    parallel[index_step] = _FALSE_;
+  if (pnl->method == nl_none)
+    parallel[ds_nonlinear] = _FALSE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free one of the tables of enum driver_table.
+ *
+ * @param ppt         Input/Output: pointer to perturbation structure
+ * @param ptr         Input/Output: pointer to transfers structure
+ * @param index_table Input: table to free
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
+
+int driver_free_table(
+                      struct perturbs * ppt,
+                      struct transfers * ptr,
+                      int index_table,
+                      ErrorMsg errmsg
+                      ) {
+
+  switch (index_table) {
+
+  case dt_perturb_sources:
+    class_call(perturb_free_sources(ppt),
+               ppt->error_message,
+               errmsg);
+    break;
+
+  case dt_transfer_functions:
+    class_call(transfer_free_functions(ptr),
+               ptr->error_message,
+               errmsg);
+    break;
+
+  default:
+    class_stop(errmsg,"unknown table %d",index_table);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Run one step of driver_init().
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input/Output: pointer to background structure
+ * @param pth        Input/Output: pointer to thermodynamics structure
+ * @param ppt        Input/Output: pointer to perturbation structure
+ * @param ppm        Input/Output: pointer to primordial structure
+ * @param pnl        Input/Output: pointer to nonlinear structure
+ * @param ptr        Input/Output: pointer to transfers structure
+ * @param psp        Input/Output: pointer to spectra structure
+ * @param ple        Input/Output: pointer to lensing structure
+ * @param pop        Input: pointer to output structure (only used by the output steps)
+ * @param index_step Input: step to run
+ * @param errmsg     Output: error message
+ * @return the error status
+ */
+
+int driver_step(
+                struct precision * ppr,
+                struct background * pba,
+                struct thermo * pth,
+                struct perturbs * ppt,
+                struct primordial * ppm,
+                struct nonlinear * pnl,
+                struct transfers * ptr,
+                struct spectra * psp,
+                struct lensing * ple,
+                struct output * pop,
+                int index_step,
+                ErrorMsg errmsg
+                ) {
+
+  switch (index_step) {
+
+  case ds_background:
+    class_call(background_init(ppr,pba),
+               pba->error_message,
+               errmsg);
+    break;
+
+  case ds_thermodynamics:
+    class_call(thermodynamics_init(ppr,pba,pth),
+               pth->error_message,
+               errmsg);
+    break;
+
+  case ds_perturb_indices:
+    class_call(perturb_init_indices(ppr,pba,pth,ppt),
+               ppt->error_message,
+               errmsg);
+    break;
+
+  case ds_perturb_sources:
+    class_call(perturb_init_sources(ppr,pba,pth,ppt),
+               ppt->error_message,
+               errmsg);
+    break;
+
+  case ds_primordial:
+    class_call(primordial_init(ppr,ppt,ppm),
+               ppm->error_message,
+               errmsg);
+    break;
+
+  case ds_nonlinear:
+    class_call(nonlinear_init(ppr,pba,pth,ppt,ppm,pnl),
+               pnl->error_message,
+               errmsg);
+    break;
+
+  case ds_transfer_bessel:
+    class_call(transfer_init_bessel(ppr,pba,pth,ppt,ptr),
+               ptr->error_message,
+               errmsg);
+    break;
+
+  case ds_transfer_compute:
+    class_call(transfer_init_compute(ppr,pba,pth,ppt,pnl,ptr),
+               ptr->error_message,
+               errmsg);
+    break;
+
+  case ds_spectra:
+    class_call(spectra_init(ppr,pba,ppt,ppm,pnl,ptr,psp),
+               psp->error_message,
+               errmsg);
+    break;
+
+  case ds_lensing:
+    class_call(lensing_init(ppr,ppt,psp,pnl,ple),
+               ple->error_message,
+               errmsg);
+    break;
+
+  case ds_output_background:
+  case ds_output_thermodynamics:
+  case ds_output_primordial:
+  case ds_output_perturbations:
+  case ds_output_spectra:
+    class_call(output_part(pba,pth,ppt,ppm,ptr,psp,pnl,ple,pop,(enum output_part)(index_step-ds_output_background)),
+               pop->error_message,
+               errmsg);
+    break;
+
+  default:
+    class_stop(errmsg,"unknown step %d",index_step);
+  }
+
+  return _SUCCESS_;
+}
@@ -43,7 +43,9 @@ int input_init_from_arguments(
 
   char input_file[_ARGUMENT_LENGTH_MAX_];
   char precision_file[_ARGUMENT_LENGTH_MAX_];
+  char snapshot_file[_ARGUMENT_LENGTH_MAX_];
   char tmp_file[_ARGUMENT_LENGTH_MAX_];
+  struct precision pr_snapshot;
 
   int i;
   char extension[5];
@@ -62,6 +64,7 @@ int input_init_from_arguments(
   fc_precision.size = 0;
   input_file[0]='\0';
   precision_file[0]='\0';
+  snapshot_file[0]='\0';
 
   /** - If some arguments are passed, identify eventually some 'xxx.ini'
       and 'xxx.pre' files, and store their name. */
@@ -82,12 +85,55 @@ int input_init_from_arguments(
                    "You have passed more than one precision with extension '.pre', choose one.");
         strcpy(precision_file,argv[i]);
       }
+      else if (strcmp(extension,".snp") == 0) {
+        class_test(snapshot_file[0] != '\0',
+                   errmsg,
+                   "You have passed more than one snapshot with extension '.snp', choose one.");
+        strcpy(snapshot_file,argv[i]);
+      }
       else {
-        fprintf(stdout,"Warning: the file %s has an extension different from .ini and .pre, so it has been ignored\n",argv[i]);
+        fprintf(stdout,"Warning: the file %s has an extension different from .ini, .pre and .snp, so it has been ignored\n",argv[i]);
       }
     }
   }
 
+  /** - if there is an 'xxx.snp' file, written by a previous run with
+      'write snapshot', it contains all parameters (with unknown ones
+      already found by shooting) and the filled precision structure:
+      initialize from it and return */
+
+  if (snapshot_file[0] != '\0') {
+
+    class_test((input_file[0] != '\0') || (precision_file[0] != '\0'),
+               errmsg,
+               "a snapshot '.snp' already contains all input and precision parameters, it cannot be combined with '.ini' or '.pre' files");
+
+    class_call(input_read_snapshot(snapshot_file,&fc,&pr_snapshot,errmsg),
+               errmsg,
+               errmsg);
+
+    class_call(input_init(&fc,
+                          ppr,
+                          pba,
+                          pth,
+                          ppt,
+                          ptr,
+                          ppm,
+                          psp,
+                          pnl,
+                          ple,
+                          pop,
+                          errmsg),
+               errmsg,
+               errmsg);
+
+    *ppr = pr_snapshot;
+
+    class_call(parser_free(&fc),errmsg,errmsg);
+
+    return _SUCCESS_;
+  }
+
   /** - if there is an 'xxx.ini' file, read it and store its content. */
 
   if (input_file[0] != '\0'){
@@ -183,6 +229,143 @@ int input_init_from_arguments(
   return _SUCCESS_;
 }
 
+/**
+ * Write a binary snapshot of the parsed input: the filled precision
+ * structure and the list of parameters, in view of starting later runs
+ * with input_read_snapshot() instead of parsing text files. The
+ * 'write snapshot' entry itself is never stored.
+ *
+ * @param filename Input: name of the snapshot file
+ * @param pfc      Input: parameters
+ * @param skip     Input: if not NULL, entries flagged _TRUE_ are not stored
+ * @param ppr      Input: filled precision structure
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int input_write_snapshot(
+                         char * filename,
+                         struct file_content * pfc,
+                         short * skip,
+                         struct precision * ppr,
+                         ErrorMsg errmsg
+                         ) {
+
+  FILE * snapshot;
+  struct input_snapshot_header header;
+  int i,length;
+
+  memset(&header,0,sizeof(struct input_snapshot_header));
+  memcpy(header.magic,"CLASSSNP",8);
+  header.format_version = _INPUT_SNAPSHOT_VERSION_;
+  strncpy(header.class_version,_VERSION_,15);
+  header.precision_size = sizeof(struct precision);
+  header.size = 0;
+  for (i=0; i<pfc->size; i++) {
+    if (((skip == NULL) || (skip[i] == _FALSE_)) && (strcmp(pfc->name[i],"write snapshot") != 0))
+      header.size++;
+  }
+
+  class_open(snapshot,filename,"wb",errmsg);
+
+  class_test((fwrite(&header,sizeof(struct input_snapshot_header),1,snapshot) != 1) ||
+             (fwrite(ppr,sizeof(struct precision),1,snapshot) != 1),
+             errmsg,
+             "could not write snapshot file %s",filename);
+
+  for (i=0; i<pfc->size; i++) {
+    if (((skip != NULL) && (skip[i] == _TRUE_)) || (strcmp(pfc->name[i],"write snapshot") == 0))
+      continue;
+    length = strlen(pfc->name[i])+1;
+    class_test((fwrite(&length,sizeof(int),1,snapshot) != 1) ||
+               (fwrite(pfc->name[i],sizeof(char),length,snapshot) != length),
+               errmsg,
+               "could not write snapshot file %s",filename);
+    length = strlen(pfc->value[i])+1;
+    class_test((fwrite(&length,sizeof(int),1,snapshot) != 1) ||
+               (fwrite(pfc->value[i],sizeof(char),length,snapshot) != length),
+               errmsg,
+               "could not write snapshot file %s",filename);
+  }
+
+  fclose(snapshot);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read a binary snapshot written by input_write_snapshot(). The
+ * snapshot must have been written by the same version of the code,
+ * with the same layout of the precision structure.
+ *
+ * @param filename Input: name of the snapshot file
+ * @param pfc      Output: parameters (allocated here, free with parser_free())
+ * @param ppr      Output: filled precision structure
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int input_read_snapshot(
+                        char * filename,
+                        struct file_content * pfc,
+                        struct precision * ppr,
+                        ErrorMsg errmsg
+                        ) {
+
+  FILE * snapshot;
+  struct input_snapshot_header header;
+  int i,length;
+
+  class_open(snapshot,filename,"rb",errmsg);
+
+  class_test(fread(&header,sizeof(struct input_snapshot_header),1,snapshot) != 1,
+             errmsg,
+             "could not read header of snapshot file %s",filename);
+
+  class_test(memcmp(header.magic,"CLASSSNP",8) != 0,
+             errmsg,
+             "%s is not a CLASS snapshot file",filename);
+
+  class_test((header.format_version != _INPUT_SNAPSHOT_VERSION_) ||
+             (strncmp(header.class_version,_VERSION_,15) != 0) ||
+             (header.precision_size != sizeof(struct precision)),
+             errmsg,
+             "snapshot file %s was written by another version of CLASS (%s, format %d), write it again",
+             filename,header.class_version,header.format_version);
+
+  class_test(header.size <= 0,
+             errmsg,
+             "snapshot file %s contains no parameters",filename);
+
+  class_test(fread(ppr,sizeof(struct precision),1,snapshot) != 1,
+             errmsg,
+             "could not read precision parameters in snapshot file %s",filename);
+
+  class_call(parser_init(pfc,header.size,filename,errmsg),
+             errmsg,
+             errmsg);
+
+  for (i=0; i<pfc->size; i++) {
+    class_test((fread(&length,sizeof(int),1,snapshot) != 1) ||
+               (length <= 0) || (length > _ARGUMENT_LENGTH_MAX_) ||
+               (fread(pfc->name[i],sizeof(char),length,snapshot) != length),
+               errmsg,
+               "could not read parameter %d in snapshot file %s",i,filename);
+    pfc->name[i][length-1] = '\0';
+    class_test((fread(&length,sizeof(int),1,snapshot) != 1) ||
+               (length <= 0) || (length > _ARGUMENT_LENGTH_MAX_) ||
+               (fread(pfc->value[i],sizeof(char),length,snapshot) != length),
+               errmsg,
+               "could not read parameter %d in snapshot file %s",i,filename);
+    pfc->value[i][length-1] = '\0';
+    pfc->read[i] = _FALSE_;
+  }
+
+  fclose(snapshot);
+
+  return _SUCCESS_;
+}
+
 /**
  * Initialize each parameter, first to its default values, and then
  * from what can be interpreted from the values passed in the input
@@ -217,6 +400,8 @@ int input_init(
   double *dxdF, *x_inout;
 
   char string1[_ARGUMENT_LENGTH_MAX_];
+  FileArg snapshot_file;
+  short * skip;
   FILE * param_output;
   FILE * param_unused;
   char param_output_name[_LINE_LENGTH_MAX_];
@@ -234,10 +419,16 @@ int input_init(
   enum computation_stage target_cs[] = {cs_thermodynamics, cs_background, cs_background,
                                         cs_background, cs_background, cs_background};
 
-  int input_verbose = 0, int1, aux_flag, shooting_failed=_FALSE_;
+  int input_verbose = 0, int1, aux_flag, shooting_failed=_FALSE_, found;
 
   class_read_int("input_verbose",input_verbose);
 
+  fzw.warm_start = _FALSE_;
+  class_read_int("shooting_warm_start",fzw.warm_start);
+
+  snapshot_file[0] = '\0';
+  class_read_string("write snapshot",snapshot_file);
+
   /** - Do we need to fix unknown parameters? */
   unknown_parameters_size = 0;
   fzw.required_computation_stage = 0;
@@ -350,6 +541,11 @@ int input_init(
                                  errmsg),
                  errmsg, errmsg);
 
+      /* With a warm start, the guess is replaced by the previous solution */
+      if (fzw.warm_start == _TRUE_) {
+        input_shooting_warm_start_get(&fzw,x_inout,dxdF,&found);
+      }
+
       class_call_try(fzero_Newton(input_try_unknown_parameters,
                                   x_inout,
                                   dxdF,
@@ -361,6 +557,10 @@ int input_init(
                                   errmsg),
                      errmsg, pba->shooting_error,shooting_failed=_TRUE_);
 
+      if ((fzw.warm_start == _TRUE_) && (shooting_failed == _FALSE_)) {
+        input_shooting_warm_start_put(&fzw,x_inout,dxdF);
+      }
+
       if (input_verbose > 0) {
         fprintf(stdout,"Computing unknown input parameters\n");
       }
@@ -404,6 +604,25 @@ int input_init(
     /** - --> Set status of shooting */
     pba->shooting_failed = shooting_failed;
 
+    /** - --> eventually write a snapshot with the tuned parameters
+        in place of the targets, so that it can be used without
+        shooting again */
+    if ((snapshot_file[0] != '\0') && (shooting_failed == _FALSE_)) {
+      class_alloc(skip,fzw.fc.size*sizeof(short),errmsg);
+      for (i=0; i < fzw.fc.size; i++)
+        skip[i] = _FALSE_;
+      for (counter = 0; counter < unknown_parameters_size; counter++){
+        class_call(parser_find(pfc,target_namestrings[target_indices[counter]],&i,errmsg),
+                   errmsg,
+                   errmsg);
+        skip[i] = _TRUE_;
+      }
+      class_call(input_write_snapshot(snapshot_file,&(fzw.fc),skip,ppr,errmsg),
+                 errmsg,
+                 errmsg);
+      free(skip);
+    }
+
     /* all parameters read in fzw must be considered as read in
        pfc. At the same time the parameters read before in pfc (like
        theta_s,...) must still be considered as read (hence we could
@@ -439,6 +658,13 @@ int input_init(
                                      errmsg),
                errmsg,
                errmsg);
+
+    /** - --> eventually write a snapshot */
+    if (snapshot_file[0] != '\0') {
+      class_call(input_write_snapshot(snapshot_file,pfc,NULL,ppr,errmsg),
+                 errmsg,
+                 errmsg);
+    }
   }
 
   /** - eventually write all the read parameters in a file, unread parameters in another file, and warnings about unread parameters */
@@ -494,6 +720,216 @@ int input_init(
 
 }
 
+/**
+ * Find the first computation stage affected by a given input
+ * parameter.
+ *
+ * Only the parameters of the analytic primordial spectrum are known
+ * to enter no module before the primordial one; any other parameter
+ * is conservatively attributed to the background stage, so that a
+ * change in its value triggers a full recomputation.
+ *
+ * @param name  Input: name of the parameter, as in the input file
+ * @param stage Output: first stage depending on this parameter
+ * @return the error status
+ */
+
+int input_parameter_stage(
+                          char * name,
+                          enum computation_stage * stage
+                          ) {
+
+  char * const primordial_namestrings[] = {"A_s","ln10^{10}A_s","n_s","alpha_s",
+                                           "k_pivot","r","n_t","alpha_t",
+                                           "custom1","custom2","custom3","custom4","custom5",
+                                           "custom6","custom7","custom8","custom9","custom10"};
+  char * const ic_namestrings[] = {"ad","bi","cdi","nid","niv"};
+  char * const coefficient_namestrings[] = {"c","n","alpha"};
+  char string1[_ARGUMENT_LENGTH_MAX_];
+  int i,index_ic1,index_ic2;
+
+  *stage = cs_primordial;
+
+  for (i=0; i<(int)(sizeof(primordial_namestrings)/sizeof(char *)); i++) {
+    if (strcmp(name,primordial_namestrings[i]) == 0)
+      return _SUCCESS_;
+  }
+
+  /** - amplitudes, tilts and runnings of isocurvature modes (f_bi,
+      n_bi, alpha_bi...) and of their cross-correlations with any
+      other mode, in both orders (c_ad_bi, n_bi_ad...) */
+  for (index_ic1=0; index_ic1<5; index_ic1++) {
+    if (index_ic1 > 0) {
+      for (i=0; i<3; i++) {
+        sprintf(string1,"%s_%s",(i==0 ? "f" : coefficient_namestrings[i]),ic_namestrings[index_ic1]);
+        if (strcmp(name,string1) == 0)
+          return _SUCCESS_;
+      }
+    }
+    for (index_ic2=0; index_ic2<5; index_ic2++) {
+      if (index_ic2 == index_ic1)
+        continue;
+      for (i=0; i<3; i++) {
+        sprintf(string1,"%s_%s_%s",coefficient_namestrings[i],ic_namestrings[index_ic1],ic_namestrings[index_ic2]);
+        if (strcmp(name,string1) == 0)
+          return _SUCCESS_;
+      }
+    }
+  }
+
+  *stage = cs_background;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read a new set of input parameters for structures that still
+ * contain the results of a previous run, and find which modules must
+ * be re-run.
+ *
+ * The caller passes the first computation stage affected by the
+ * parameters that changed since the previous run (see
+ * input_parameter_stage()). The new parameters are read into
+ * temporary structures. The modules that must be re-run are freed,
+ * and their structures are replaced by the temporary ones; the other
+ * modules are left untouched, since by construction their input is
+ * unchanged. When only primordial parameters changed, this means
+ * that the background, thermodynamics and perturbation modules are
+ * kept, as well as the transfer module when no non-linear method is
+ * used (otherwise transfer_init() depends on the non-linear
+ * spectrum). If the new parameters turn out to affect an earlier
+ * module anyway (for instance because r switches on or off the
+ * tensor modes), all modules are re-run.
+ *
+ * On entry, all modules from background to lensing must have been
+ * initialized. On exit, the caller must call the _init() function of
+ * each module flagged in recompute. If the parameters cannot be read,
+ * the function fails and leaves all structures untouched.
+ *
+ * @param pfc       Input: pointer to the new input parameters
+ * @param ppr       Input/Output: pointer to precision structure
+ * @param pba       Input/Output: pointer to background structure
+ * @param pth       Input/Output: pointer to thermodynamics structure
+ * @param ppt       Input/Output: pointer to perturbation structure
+ * @param ptr       Input/Output: pointer to transfer structure
+ * @param ppm       Input/Output: pointer to primordial structure
+ * @param psp       Input/Output: pointer to spectra structure
+ * @param pnl       Input/Output: pointer to nonlinear structure
+ * @param ple       Input/Output: pointer to lensing structure
+ * @param pop       Input/Output: pointer to output structure
+ * @param stage     Input: first stage affected by the changed parameters
+ * @param recompute Output: array of _NUM_STAGES_ flags, indexed by computation stage, telling which modules must be re-run
+ * @param errmsg    Input/Output: error message
+ * @return the error status
+ */
+
+int input_update(
+                 struct file_content * pfc,
+                 struct precision * ppr,
+                 struct background *pba,
+                 struct thermo *pth,
+                 struct perturbs *ppt,
+                 struct transfers *ptr,
+                 struct primordial *ppm,
+                 struct spectra *psp,
+                 struct nonlinear * pnl,
+                 struct lensing *ple,
+                 struct output *pop,
+                 enum computation_stage stage,
+                 short * recompute,
+                 ErrorMsg errmsg
+                 ) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermo th;           /* for thermodynamics */
+  struct perturbs pt;         /* for source functions */
+  struct transfers tr;        /* for transfer functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct spectra sp;          /* for output spectra */
+  struct nonlinear nl;        /* for non-linear spectra */
+  struct lensing le;          /* for lensed spectra */
+  struct output op;           /* for output files */
+  int index_stage;
+
+  class_call(input_init(pfc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&op,errmsg),
+             errmsg,
+             errmsg);
+
+  /** - a change in the primordial parameters can only be absorbed by
+      the last modules if it does not change the list of modes, and
+      if the spectrum is the analytic one or is computed by the same
+      registered function (the other types read different parameters,
+      possibly through an external command) */
+  if ((pt.has_tensors != ppt->has_tensors) ||
+      (pm.primordial_spec_type != ppm->primordial_spec_type) ||
+      ((pm.primordial_spec_type != analytic_Pk) &&
+       ((pm.primordial_spec_type != external_Pk) ||
+        (pm.external_function == NULL) ||
+        (pm.external_function != ppm->external_function))))
+    stage = cs_background;
+
+  /** - in low-memory mode, the sources and transfer functions of the
+      previous run have been freed: they must be computed again */
+  if ((ppr->low_memory == _TRUE_) && (stage > cs_perturbations))
+    stage = cs_perturbations;
+
+  for (index_stage=0; index_stage<_NUM_STAGES_; index_stage++)
+    recompute[index_stage] = (index_stage >= stage ? _TRUE_ : _FALSE_);
+
+  if ((stage >= cs_primordial) && (pnl->method == nl_none))
+    recompute[cs_transfer] = _FALSE_;
+
+  /** - free the modules that must be re-run */
+  if (recompute[cs_lensing] == _TRUE_)
+    class_call(lensing_free(ple), ple->error_message, errmsg);
+  if (recompute[cs_spectra] == _TRUE_)
+    class_call(spectra_free(psp), psp->error_message, errmsg);
+  if (recompute[cs_transfer] == _TRUE_)
+    class_call(transfer_free(ptr), ptr->error_message, errmsg);
+  if (recompute[cs_nonlinear] == _TRUE_)
+    class_call(nonlinear_free(pnl), pnl->error_message, errmsg);
+  if (recompute[cs_primordial] == _TRUE_)
+    class_call(primordial_free(ppm), ppm->error_message, errmsg);
+  if (recompute[cs_perturbations] == _TRUE_)
+    class_call(perturb_free(ppt), ppt->error_message, errmsg);
+  if (recompute[cs_thermodynamics] == _TRUE_)
+    class_call(thermodynamics_free(pth), pth->error_message, errmsg);
+  if (recompute[cs_background] == _TRUE_)
+    class_call(background_free(pba), pba->error_message, errmsg);
+
+  /** - replace them by the freshly read structures, and release what
+      input_init() allocated in the discarded ones */
+  *ppr = pr;
+  *pop = op;
+
+  if (recompute[cs_background] == _TRUE_)
+    *pba = ba;
+  else
+    class_call(background_free_input(&ba), ba.error_message, errmsg);
+  if (recompute[cs_thermodynamics] == _TRUE_) {
+    th.recombination_cache = pth->recombination_cache;
+    th.recombination_response = pth->recombination_response;
+    *pth = th;
+  }
+  if (recompute[cs_perturbations] == _TRUE_) {
+    pt.workspace_pool = ppt->workspace_pool;
+    *ppt = pt;
+  }
+  if (recompute[cs_primordial] == _TRUE_)
+    *ppm = pm;
+  if (recompute[cs_nonlinear] == _TRUE_)
+    *pnl = nl;
+  if (recompute[cs_transfer] == _TRUE_)
+    *ptr = tr;
+  if (recompute[cs_spectra] == _TRUE_)
+    *psp = sp;
+  if (recompute[cs_lensing] == _TRUE_)
+    *ple = le;
+
+  return _SUCCESS_;
+}
+
 int input_read_parameters(
                           struct file_content * pfc,
                           struct precision * ppr,
@@ -800,6 +1236,7 @@ int input_read_parameters(
     class_read_double("tol_ncdm_newtonian",ppr->tol_ncdm_newtonian);
     class_read_double("tol_ncdm_synchronous",ppr->tol_ncdm_synchronous);
     class_read_double("tol_ncdm_bg",ppr->tol_ncdm_bg);
+    class_read_int("ncdm_quadrature_cache",ppr->ncdm_quadrature_cache);
     if (ppt->gauge == synchronous)
       ppr->tol_ncdm = ppr->tol_ncdm_synchronous;
     if (ppt->gauge == newtonian)
@@ -872,6 +1309,8 @@ int input_read_parameters(
                                 &(pba->ncdm_psd_parameters),
                                 &flag2,
                                 errmsg);
+    if (flag2 == _TRUE_)
+      pba->ncdm_psd_parameters_size = entries_read;
 
     class_call(background_ncdm_init(ppr,pba),
                pba->error_message,
@@ -1954,14 +2393,28 @@ int input_read_parameters(
   }
 
   else if (ppm->primordial_spec_type == external_Pk) {
-    class_call(parser_read_string(pfc, "command", &(string1), &(flag1), errmsg),
+    class_call(parser_read_string(pfc, "external_Pk_function", &(string1), &(flag1), errmsg),
                errmsg, errmsg);
-    class_test(strlen(string1) == 0,
-               errmsg,
-               "You omitted to write a command for the external Pk");
 
-    ppm->command = (char *) malloc (strlen(string1) + 1);
-    strcpy(ppm->command, string1);
+    if (flag1 == _TRUE_) {
+      /* function registered with primordial_external_function_register() */
+      class_call(primordial_external_function_find(string1,&(ppm->external_function)),
+                 errmsg,
+                 errmsg);
+      class_test(ppm->external_function == NULL,
+                 errmsg,
+                 "no external primordial spectrum function named '%s' was registered",string1);
+    }
+    else {
+      class_call(parser_read_string(pfc, "command", &(string1), &(flag1), errmsg),
+                 errmsg, errmsg);
+      class_test(strlen(string1) == 0,
+                 errmsg,
+                 "You omitted to write a command for the external Pk");
+
+      ppm->command = (char *) malloc (strlen(string1) + 1);
+      strcpy(ppm->command, string1);
+    }
     class_read_double("custom1",ppm->custom1);
     class_read_double("custom2",ppm->custom2);
     class_read_double("custom3",ppm->custom3);
@@ -2004,6 +2457,22 @@ int input_read_parameters(
           (ppt->has_cl_cmb_lensing_potential == _TRUE_))
         class_read_double("l_max_scalars",ppt->l_scalar_max);
 
+      /* optional smaller l_max for some of the CMB spectra (zero
+         meaning l_max_scalars) */
+      class_read_int("l_max_tCl",ppt->l_scalar_max_cmb_temperature);
+      class_read_int("l_max_pCl",ppt->l_scalar_max_cmb_polarization);
+      class_read_int("l_max_lCl",ppt->l_scalar_max_cmb_lensing_potential);
+
+      class_test((ppt->l_scalar_max_cmb_temperature > ppt->l_scalar_max) ||
+                 (ppt->l_scalar_max_cmb_polarization > ppt->l_scalar_max) ||
+                 (ppt->l_scalar_max_cmb_lensing_potential > ppt->l_scalar_max),
+                 errmsg,
+                 "l_max_tCl=%d, l_max_pCl=%d and l_max_lCl=%d cannot be larger than l_max_scalars=%d",
+                 ppt->l_scalar_max_cmb_temperature,
+                 ppt->l_scalar_max_cmb_polarization,
+                 ppt->l_scalar_max_cmb_lensing_potential,
+                 ppt->l_scalar_max);
+
       if ((ppt->has_cl_lensing_potential == _TRUE_) || (ppt->has_cl_number_count == _TRUE_))
         class_read_double("l_max_lss",ppt->l_lss_max);
     }
@@ -2338,6 +2807,20 @@ int input_read_parameters(
   }
   /* end of z_max section */
 
+  /* real-space correlation functions */
+  class_call(parser_read_string(pfc,"correlation functions",&string1,&flag1,errmsg),
+             errmsg,
+             errmsg);
+
+  if ((flag1 == _TRUE_) && ((strstr(string1,"y") != NULL) || (strstr(string1,"Y") != NULL))) {
+
+    class_test(ppt->has_pk_matter == _FALSE_,
+               errmsg,
+               "'correlation functions' are computed from the matter power spectrum: you should also ask for 'mPk' in the output field");
+
+    psp->has_correlations = _TRUE_;
+  }
+
   class_read_string("root",pop->root);
 
   class_call(parser_read_string(pfc,
@@ -2363,9 +2846,11 @@ int input_read_parameters(
     else {
       if ((strstr(string1,"camb") != NULL) || (strstr(string1,"CAMB") != NULL))
         pop->output_format = camb_format;
+      else if ((strstr(string1,"binary") != NULL) || (strstr(string1,"BINARY") != NULL))
+        pop->output_format = binary_format;
       else
         class_stop(errmsg,
-                   "You wrote: format=%s. Could not identify any of the possible formats ('class', 'CLASS', 'camb', 'CAMB')",string1);
+                   "You wrote: format=%s. Could not identify any of the possible formats ('class', 'CLASS', 'camb', 'CAMB', 'binary', 'BINARY')",string1);
     }
   }
 
@@ -2387,6 +2872,17 @@ int input_read_parameters(
       pnl->method=nl_halofit;
       ppt->has_nl_corrections_based_on_delta_m = _TRUE_;
     }
+    else {
+      /* name of an engine registered with nonlinear_engine_register() */
+      class_call(nonlinear_engine_find(string1,&(pnl->engine)),
+                 errmsg,
+                 errmsg);
+
+      if (pnl->engine != NULL) {
+        pnl->method=nl_engine;
+        ppt->has_nl_corrections_based_on_delta_m = _TRUE_;
+      }
+    }
 
   }
 
@@ -2426,6 +2922,7 @@ int input_read_parameters(
   class_read_double("a_ini_over_a_today_default",ppr->a_ini_over_a_today_default);
   class_read_double("back_integration_stepsize",ppr->back_integration_stepsize);
   class_read_double("tol_background_integration",ppr->tol_background_integration);
+  class_read_int("uniform_grid_lookup",ppr->uniform_grid_lookup);
   class_read_double("tol_initial_Omega_r",ppr->tol_initial_Omega_r);
   class_read_double("tol_ncdm_initial_w",ppr->tol_ncdm_initial_w);
   class_read_double("safe_phi_scf",ppr->safe_phi_scf);
@@ -2438,6 +2935,8 @@ int input_read_parameters(
 
   class_read_int("recfast_Nz0",ppr->recfast_Nz0);
   class_read_double("tol_thermo_integration",ppr->tol_thermo_integration);
+  class_read_int("recfast_evolver",ppr->recfast_evolver);
+  class_read_double("tol_thermo_integration_ndf15",ppr->tol_thermo_integration_ndf15);
 
   class_read_int("recfast_Heswitch",ppr->recfast_Heswitch);
   class_read_double("recfast_fudge_He",ppr->recfast_fudge_He);
@@ -2471,6 +2970,7 @@ int input_read_parameters(
   class_read_string("Alpha_inf hyrec file",ppr->hyrec_Alpha_inf_file);
   class_read_string("R_inf hyrec file",ppr->hyrec_R_inf_file);
   class_read_string("two_photon_tables hyrec file",ppr->hyrec_two_photon_tables_file);
+  class_read_string("hyrec tables binary file",ppr->hyrec_tables_binary_file);
 
   class_read_double("reionization_z_start_max",ppr->reionization_z_start_max);
   class_read_double("reionization_sampling",ppr->reionization_sampling);
@@ -2482,6 +2982,13 @@ int input_read_parameters(
   /** - (h.3.) parameters related to the perturbations */
 
   class_read_int("evolver",ppr->evolver);
+  class_read_int("perturb_rk_dense_output",ppr->perturb_rk_dense_output);
+  class_read_int("perturb_analytic_jacobian",ppr->perturb_analytic_jacobian);
+  class_read_int("perturb_specialised_derivs",ppr->perturb_specialised_derivs);
+  class_read_int("perturb_cost_scheduling",ppr->perturb_cost_scheduling);
+  class_read_int("perturb_task_pool",ppr->perturb_task_pool);
+  class_read_int("perturb_sources_tile_tau",ppr->perturb_sources_tile_tau);
+  class_read_int("perturb_sources_tile_k",ppr->perturb_sources_tile_k);
 
   class_read_double("k_scalar_min_tau0",ppr->k_min_tau0); // obsolete precision parameter: read for compatibility with old precision files
   class_read_double("k_scalar_max_tau0_over_l_max",ppr->k_max_tau0_over_l_max); // obsolete precision parameter: read for compatibility with old precision files
@@ -2499,10 +3006,17 @@ int input_read_parameters(
   class_read_double("k_step_super",ppr->k_step_super);
   class_read_double("k_step_transition",ppr->k_step_transition);
   class_read_double("k_step_super_reduction",ppr->k_step_super_reduction);
+  class_read_double("k_step_tensors_factor",ppr->k_step_tensors_factor);
+  class_test(ppr->k_step_tensors_factor <= 0.,
+             errmsg,
+             "k_step_tensors_factor=%e should be strictly positive",ppr->k_step_tensors_factor);
   class_read_double("k_per_decade_for_pk",ppr->k_per_decade_for_pk);
   class_read_double("k_per_decade_for_bao",ppr->k_per_decade_for_bao);
   class_read_double("k_bao_center",ppr->k_bao_center);
   class_read_double("k_bao_width",ppr->k_bao_width);
+  class_read_int("k_adaptive_sampling",ppr->k_adaptive_sampling);
+  class_read_int("k_adaptive_coarsening",ppr->k_adaptive_coarsening);
+  class_read_double("k_adaptive_tol",ppr->k_adaptive_tol);
 
   class_read_double("start_small_k_at_tau_c_over_tau_h",ppr->start_small_k_at_tau_c_over_tau_h);
   class_read_double("start_large_k_at_tau_h_over_tau_k",ppr->start_large_k_at_tau_h_over_tau_k);
@@ -2545,7 +3059,15 @@ int input_read_parameters(
   class_read_double("gw_ini",ppr->gw_ini);
   class_read_double("perturb_integration_stepsize",ppr->perturb_integration_stepsize);
   class_read_double("tol_tau_approx",ppr->tol_tau_approx);
+  class_read_int("tau_approx_k_step",ppr->tau_approx_k_step);
+  class_test(ppr->tau_approx_k_step < 0,
+             errmsg,
+             "tau_approx_k_step=%d should be positive or null",ppr->tau_approx_k_step);
   class_read_double("tol_perturb_integration",ppr->tol_perturb_integration);
+  class_read_double("tol_perturb_integration_tensors_factor",ppr->tol_perturb_integration_tensors_factor);
+  class_test(ppr->tol_perturb_integration_tensors_factor <= 0.,
+             errmsg,
+             "tol_perturb_integration_tensors_factor=%e should be strictly positive",ppr->tol_perturb_integration_tensors_factor);
   class_read_double("perturb_sampling_stepsize",ppr->perturb_sampling_stepsize);
 
   class_read_int("radiation_streaming_approximation",ppr->radiation_streaming_approximation);
@@ -2594,6 +3116,8 @@ int input_read_parameters(
   class_read_double("primordial_inflation_small_epsilon",ppr->primordial_inflation_small_epsilon);
   class_read_double("primordial_inflation_small_epsilon_tol",ppr->primordial_inflation_small_epsilon_tol);
   class_read_double("primordial_inflation_extra_efolds",ppr->primordial_inflation_extra_efolds);
+  class_read_double("primordial_inflation_adaptive_tol",ppr->primordial_inflation_adaptive_tol);
+  class_read_int("primordial_inflation_adaptive_stride",ppr->primordial_inflation_adaptive_stride);
 
   /** - (h.5.) parameter related to the transfer functions */
 
@@ -2608,6 +3132,8 @@ int input_read_parameters(
   class_read_double("hyper_phi_min_abs",ppr->hyper_phi_min_abs);
   class_read_double("hyper_x_tol",ppr->hyper_x_tol);
   class_read_double("hyper_flat_approximation_nu",ppr->hyper_flat_approximation_nu);
+  class_read_string("hyper cache directory",ppr->hyper_cache_directory);
+  class_read_string("shared tables directory",ppr->shared_tables_directory);
 
   class_read_double("q_linstep",ppr->q_linstep);
   class_read_double("q_logstep_spline",ppr->q_logstep_spline);
@@ -2635,6 +3161,10 @@ int input_read_parameters(
 
   class_read_double("transfer_neglect_late_source",ppr->transfer_neglect_late_source);
 
+  class_read_int("transfer_source_k_window",ppr->transfer_source_k_window);
+
+  class_read_int("transfer_l_blocks",ppr->transfer_l_blocks);
+
   /* Modification */
   class_read_double("chiral_par",psp->chiral_par);
   /* Ends here */
@@ -2662,25 +3192,67 @@ int input_read_parameters(
   class_read_double("selection_sampling_bessel_los",ppr->selection_sampling_bessel_los);
   class_read_double("selection_tophat_edge",ppr->selection_tophat_edge);
 
-  /** - (h.6.) parameters related to nonlinear calculations */
+  /** - (h.6.) parameters related to the spectra module */
+
+  class_read_int("fftlog_size",ppr->fftlog_size);
+
+  class_test((ppr->fftlog_size < 8) || ((ppr->fftlog_size & (ppr->fftlog_size-1)) != 0),
+             errmsg,
+             "fftlog_size=%d should be a power of two, at least 8",ppr->fftlog_size);
+
+  /** - (h.7.) parameters related to nonlinear calculations */
 
   class_read_double("halofit_dz",ppr->halofit_dz);
   class_read_double("halofit_min_k_nonlinear",ppr->halofit_min_k_nonlinear);
   class_read_double("halofit_k_per_decade",ppr->halofit_k_per_decade);
   class_read_double("halofit_sigma_precision",ppr->halofit_sigma_precision);
+  class_read_double("halofit_k_nl_bracket",ppr->halofit_k_nl_bracket);
+  class_read_double("halofit_r_per_decade",ppr->halofit_r_per_decade);
 
-  /** - (h.7.) parameter related to lensing */
+  /** - (h.8.) parameter related to lensing */
 
   class_read_int("accurate_lensing",ppr->accurate_lensing);
   class_read_int("delta_l_max",ppr->delta_l_max);
+  class_read_int("lensing_mu_chunk",ppr->lensing_mu_chunk);
+  class_read_int("lensing_cache_d_tables",ppr->lensing_cache_d_tables);
   if (ppr->accurate_lensing == _TRUE_) {
     class_read_int("num_mu_minus_lmax",ppr->num_mu_minus_lmax);
     class_read_int("tol_gauss_legendre",ppr->tol_gauss_legendre);
   }
+  /** - (h.9.) low-memory mode */
+
+  class_call(parser_read_string(pfc,"low memory",&string1,&flag1,errmsg),
+             errmsg,
+             errmsg);
+
+  if ((flag1 == _TRUE_) && ((strstr(string1,"y") != NULL) || (strstr(string1,"Y") != NULL))) {
+
+    ppr->low_memory = _TRUE_;
+
+  }
+
+  /** - (h.10.) placement of the large tables on the NUMA nodes */
+
+  class_read_int("first_touch_policy",ppr->first_touch_policy);
+  class_test((ppr->first_touch_policy < ft_none) || (ppr->first_touch_policy > ft_interleave),
+             errmsg,
+             "first_touch_policy=%d should be 0 (none), 1 (block) or 2 (interleave)",ppr->first_touch_policy);
+
   /** (i) Write values in file */
   if (ple->has_lensed_cls == _TRUE_)
     ppt->l_scalar_max+=ppr->delta_l_max;
 
+  /** - the lensing module needs all unlensed CMB spectra up to
+      l_scalar_max: in that case, or when they were not set, the l_max
+      of temperature, polarization and lensing potential spectra are
+      those of all CMB scalars */
+  if ((ple->has_lensed_cls == _TRUE_) || (ppt->l_scalar_max_cmb_temperature <= 0))
+    ppt->l_scalar_max_cmb_temperature = ppt->l_scalar_max;
+  if ((ple->has_lensed_cls == _TRUE_) || (ppt->l_scalar_max_cmb_polarization <= 0))
+    ppt->l_scalar_max_cmb_polarization = ppt->l_scalar_max;
+  if ((ple->has_lensed_cls == _TRUE_) || (ppt->l_scalar_max_cmb_lensing_potential <= 0))
+    ppt->l_scalar_max_cmb_lensing_potential = ppt->l_scalar_max;
+
   /** - (i.1.) shall we write background quantities in a file? */
 
   class_call(parser_read_string(pfc,"write background",&string1,&flag1,errmsg),
@@ -2732,7 +3304,33 @@ int input_read_parameters(
     qsort (ppt->k_output_values, ppt->k_output_values_num, sizeof(double), compare_doubles);
 
     ppt->store_perturbations = _TRUE_;
-    pop->write_perturbations = _TRUE_;
+
+    /* streamed perturbations are written while each wavenumber is
+       integrated, not by the output module */
+    class_call(parser_read_string(pfc,"stream perturbations",&string1,&flag1,errmsg),
+               errmsg,
+               errmsg);
+
+    if ((flag1 == _TRUE_) && ((strstr(string1,"y") != NULL) || (strstr(string1,"Y") != NULL))) {
+      ppt->stream_perturbations = _TRUE_;
+      sprintf(ppt->stream_root,"%s",pop->root);
+    }
+    else {
+      pop->write_perturbations = _TRUE_;
+    }
+  }
+
+  /** - (i.3.bis) shall we write integration statistics for each wavenumber in a file? */
+
+  class_call(parser_read_string(pfc,"write perturbations profile",&string1,&flag1,errmsg),
+             errmsg,
+             errmsg);
+
+  if ((flag1 == _TRUE_) && ((strstr(string1,"y") != NULL) || (strstr(string1,"Y") != NULL))) {
+
+    ppt->store_profile = _TRUE_;
+    pop->write_perturbations_profile = _TRUE_;
+
   }
 
   /** - (i.4.) shall we write primordial spectra in a file? */
@@ -2747,6 +3345,18 @@ int input_read_parameters(
 
   }
 
+  /** - (i.5.) shall we print the resources used by each module? */
+
+  class_call(parser_read_string(pfc,"print profile",&string1,&flag1,errmsg),
+             errmsg,
+             errmsg);
+
+  if ((flag1 == _TRUE_) && ((strstr(string1,"y") != NULL) || (strstr(string1,"Y") != NULL))) {
+
+    pop->print_profile = _TRUE_;
+
+  }
+
   return _SUCCESS_;
 
 }
@@ -2820,6 +3430,7 @@ int input_default_params(
   pba->deg_ncdm_default = 1.;
   pba->deg_ncdm = NULL;
   pba->ncdm_psd_parameters = NULL;
+  pba->ncdm_psd_parameters_size = 0;
   pba->ncdm_psd_files = NULL;
 
   pba->Omega0_scf = 0.; /* Scalar field defaults */
@@ -2872,6 +3483,9 @@ int input_default_params(
   pth->annihilation_z_halo = 30.;
   pth->has_on_the_spot = _TRUE_;
 
+  pth->recombination_cache = NULL;
+  pth->recombination_response = NULL;
+
   pth->compute_cb2_derivatives=_FALSE_;
 
   pth->compute_damping_scale = _FALSE_;
@@ -2917,6 +3531,9 @@ int input_default_params(
   ppt->has_tensors=_FALSE_;
 
   ppt->l_scalar_max=2500;
+  ppt->l_scalar_max_cmb_temperature=0;
+  ppt->l_scalar_max_cmb_polarization=0;
+  ppt->l_scalar_max_cmb_lensing_potential=0;
   ppt->l_vector_max=500;
   ppt->l_tensor_max=500;
   ppt->l_lss_max=300;
@@ -2926,6 +3543,10 @@ int input_default_params(
 
   ppt->k_output_values_num=0;
   ppt->store_perturbations = _FALSE_;
+  ppt->stream_perturbations = _FALSE_;
+  ppt->stream_root[0] = '\0';
+  ppt->store_profile = _FALSE_;
+  ppt->profile_data = NULL;
   ppt->number_of_scalar_titles=0;
   ppt->number_of_vector_titles=0;
   ppt->number_of_tensor_titles=0;
@@ -2935,6 +3556,8 @@ int input_default_params(
     ppt->tensor_perturbations_data[filenum] = NULL;
   }
   ppt->index_k_output_values=NULL;
+  ppt->workspace_pool=NULL;
+  ppt->switch_table=NULL;
 
   ppt->three_ceff2_ur=1.;
   ppt->three_cvis2_ur=1.;
@@ -3014,6 +3637,7 @@ int input_default_params(
   ppm->H4=0.;
   ppm->behavior=numerical;
   ppm->command="write here your command for the external Pk";
+  ppm->external_function=NULL;
   ppm->custom1=0.;
   ppm->custom2=0.;
   ppm->custom3=0.;
@@ -3048,7 +3672,9 @@ int input_default_params(
   pop->write_background = _FALSE_;
   pop->write_thermodynamics = _FALSE_;
   pop->write_perturbations = _FALSE_;
+  pop->write_perturbations_profile = _FALSE_;
   pop->write_primordial = _FALSE_;
+  pop->print_profile = _FALSE_;
 
   /** - spectra structure */
 
@@ -3058,6 +3684,7 @@ int input_default_params(
 
   psp->z_max_pk = pop->z_pk[0];
   psp->non_diag=0;
+  psp->has_correlations = _FALSE_;
 
   /** - nonlinear structure */
 
@@ -3068,6 +3695,7 @@ int input_default_params(
   /** - nonlinear structure */
 
   pnl->method = nl_none;
+  pnl->engine = NULL;
 
   /** - all verbose parameters */
 
@@ -3105,6 +3733,7 @@ int input_default_precision ( struct precision * ppr ) {
   ppr->a_ini_over_a_today_default = 1.e-14;
   ppr->back_integration_stepsize = 7.e-3;
   ppr->tol_background_integration = 1.e-2;
+  ppr->uniform_grid_lookup = _TRUE_;
 
   ppr->tol_initial_Omega_r = 1.e-4;
   ppr->tol_M_ncdm = 1.e-7;
@@ -3112,6 +3741,7 @@ int input_default_precision ( struct precision * ppr ) {
   ppr->tol_ncdm_synchronous = 1.e-3;
   ppr->tol_ncdm_newtonian = 1.e-5;
   ppr->tol_ncdm_bg = 1.e-5;
+  ppr->ncdm_quadrature_cache = _TRUE_;
   ppr->tol_ncdm_initial_w=1.e-3;
 
   /**
@@ -3128,6 +3758,8 @@ int input_default_precision ( struct precision * ppr ) {
 
   ppr->recfast_Nz0=20000;
   ppr->tol_thermo_integration=1.e-2;
+  ppr->recfast_evolver=rk;
+  ppr->tol_thermo_integration_ndf15=1.e-7;
 
   ppr->recfast_Heswitch=6;                 /* from recfast 1.4 */
   ppr->recfast_fudge_He=0.86;              /* from recfast 1.4 */
@@ -3163,6 +3795,7 @@ int input_default_precision ( struct precision * ppr ) {
   strcat(ppr->hyrec_R_inf_file,"/hyrec/R_inf.dat");
   sprintf(ppr->hyrec_two_photon_tables_file,__CLASSDIR__);
   strcat(ppr->hyrec_two_photon_tables_file,"/hyrec/two_photon_tables.dat");
+  ppr->hyrec_tables_binary_file[0]='\0';
 
   /* for reionization */
 
@@ -3180,6 +3813,13 @@ int input_default_precision ( struct precision * ppr ) {
    */
 
   ppr->evolver = ndf15;
+  ppr->perturb_rk_dense_output = _FALSE_;
+  ppr->perturb_analytic_jacobian = _FALSE_;
+  ppr->perturb_specialised_derivs = _FALSE_;
+  ppr->perturb_cost_scheduling = _TRUE_;
+  ppr->perturb_task_pool = _TRUE_;
+  ppr->perturb_sources_tile_tau = 64;
+  ppr->perturb_sources_tile_k = 8;
 
   ppr->k_min_tau0=0.1;
   ppr->k_max_tau0_over_l_max=2.4; // very relevant for accuracy of lensed ClTT at highest l's
@@ -3187,10 +3827,14 @@ int input_default_precision ( struct precision * ppr ) {
   ppr->k_step_super=0.002;
   ppr->k_step_transition=0.2;
   ppr->k_step_super_reduction=0.1;
+  ppr->k_step_tensors_factor=1.;
   ppr->k_per_decade_for_pk=10.;
   ppr->k_per_decade_for_bao=70.;
   ppr->k_bao_center=3.;
   ppr->k_bao_width=4.;
+  ppr->k_adaptive_sampling = _FALSE_;
+  ppr->k_adaptive_coarsening = 4;
+  ppr->k_adaptive_tol = 1.e-3;
 
   ppr->start_small_k_at_tau_c_over_tau_h = 0.0015;  /* decrease to start earlier in time */
   ppr->start_large_k_at_tau_h_over_tau_k = 0.07;  /* decrease to start earlier in time */
@@ -3215,7 +3859,9 @@ int input_default_precision ( struct precision * ppr ) {
   ppr->perturb_integration_stepsize=0.5;
 
   ppr->tol_tau_approx=1.e-10;
+  ppr->tau_approx_k_step=8;
   ppr->tol_perturb_integration=1.e-5;
+  ppr->tol_perturb_integration_tensors_factor=1.;
   ppr->perturb_sampling_stepsize=0.10;
 
   ppr->radiation_streaming_approximation = rsa_MD_with_reio;
@@ -3252,6 +3898,8 @@ int input_default_precision ( struct precision * ppr ) {
   ppr->primordial_inflation_small_epsilon=0.1;
   ppr->primordial_inflation_small_epsilon_tol=0.01;
   ppr->primordial_inflation_extra_efolds=2.;
+  ppr->primordial_inflation_adaptive_tol=0.;
+  ppr->primordial_inflation_adaptive_stride=8;
 
   /**
    * - parameter related to the transfer functions
@@ -3268,6 +3916,8 @@ int input_default_precision ( struct precision * ppr ) {
   ppr->hyper_phi_min_abs = 1.e-10;
   ppr->hyper_x_tol = 1.e-4;
   ppr->hyper_flat_approximation_nu = 4000.;
+  ppr->hyper_cache_directory[0] = '\0';
+  ppr->shared_tables_directory[0] = '\0';
 
   ppr->q_linstep=0.45;
   ppr->q_logstep_spline=170.;
@@ -3289,6 +3939,10 @@ int input_default_precision ( struct precision * ppr ) {
 
   ppr->transfer_neglect_late_source = 400.;
 
+  ppr->transfer_source_k_window = 0;
+
+  ppr->transfer_l_blocks = 0;
+
   ppr->l_switch_limber=10.;
   // For density Cl, we recommend not to use the Limber approximation
   // at all, and hence to put here a very large number (e.g. 10000); but
@@ -3312,7 +3966,7 @@ int input_default_precision ( struct precision * ppr ) {
    * - parameters related to spectra module
    */
 
-  /* nothing */
+  ppr->fftlog_size = 2048;
 
   /**
    * - parameters related to nonlinear module
@@ -3323,6 +3977,8 @@ int input_default_precision ( struct precision * ppr ) {
   ppr->halofit_k_per_decade = 80.;
   ppr->halofit_sigma_precision=0.05;
   ppr->halofit_min_k_max=5.;
+  ppr->halofit_k_nl_bracket=0.;
+  ppr->halofit_r_per_decade=0.;
 
   /**
    * - parameter related to lensing
@@ -3330,6 +3986,8 @@ int input_default_precision ( struct precision * ppr ) {
 
   ppr->accurate_lensing=_FALSE_;
   ppr->num_mu_minus_lmax=70;
+  ppr->lensing_mu_chunk=32;
+  ppr->lensing_cache_d_tables=_FALSE_;
   ppr->delta_l_max=500; // 750 for 0.2% near l_max, 1000 for 0.1%
 
   /**
@@ -3345,6 +4003,18 @@ int input_default_precision ( struct precision * ppr ) {
 
   ppr->tol_gauss_legendre = ppr->smallest_allowed_variation;
 
+  /**
+   * - low-memory mode
+   */
+
+  ppr->low_memory=_FALSE_;
+
+  /**
+   * - placement of the large tables on the NUMA nodes
+   */
+
+  ppr->first_touch_policy=ft_block;
+
   return _SUCCESS_;
 
 }
@@ -3814,8 +4484,35 @@ int input_find_root(double *xzero,
   double x1, x2, f1, f2, dxdy, dx;
   int iter, iter2;
   int return_function;
+  int found, converged;
   /** Summary: */
 
+  /** - With a warm start, try a few secant steps from the previous
+      solution first; fall back to the search below if they do not
+      converge */
+  if (pfzw->warm_start == _TRUE_) {
+
+    input_shooting_warm_start_get(pfzw,&x1,&dxdy,&found);
+
+    if (found == _TRUE_) {
+
+      class_call(input_find_root_warm(x1,
+                                      dxdy,
+                                      xzero,
+                                      &dxdy,
+                                      fevals,
+                                      pfzw,
+                                      &converged,
+                                      errmsg),
+                 errmsg, errmsg);
+
+      if (converged == _TRUE_) {
+        input_shooting_warm_start_put(pfzw,xzero,&dxdy);
+        return _SUCCESS_;
+      }
+    }
+  }
+
   /** - Fisrt we do our guess */
   class_call(input_get_guess(&x1, &dxdy, pfzw, errmsg),
              errmsg, errmsg);
@@ -3879,6 +4576,191 @@ int input_find_root(double *xzero,
                                 errmsg),
              errmsg,errmsg);
 
+  /** - Remember the solution, with the slope of the bracket as local
+      derivative */
+  if (pfzw->warm_start == _TRUE_) {
+    if (f2 != f1)
+      dxdy = (x2-x1)/(f2-f1);
+    input_shooting_warm_start_put(pfzw,xzero,&dxdy);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Secant iteration for one unknown parameter, started from the
+ * extrapolated solution of a previous shooting. The first step uses
+ * the stored derivative dx/dF, the next ones the secant slope. The
+ * iteration stops when the next step would be smaller than the
+ * tolerance of input_find_root(), so that a well-predicted solution
+ * costs a single evaluation.
+ *
+ * A failed evaluation or a lack of convergence after
+ * _SHOOTING_WARM_START_ITER_ steps is not an error: converged is then
+ * set to _FALSE_ and the caller proceeds with the usual search.
+ *
+ * @param x1        Input: starting point
+ * @param dxdF      Input: estimate of dx/dF at the starting point
+ * @param xzero     Output: root, if converged
+ * @param dxdF_out  Output: last estimate of dx/dF, if converged
+ * @param fevals    Input/Output: number of function evaluations
+ * @param pfzw      Input: shooting workspace
+ * @param converged Output: whether a root was found
+ * @param errmsg    Output: error message
+ * @return the error status
+ */
+
+int input_find_root_warm(double x1,
+                         double dxdF,
+                         double *xzero,
+                         double *dxdF_out,
+                         int *fevals,
+                         struct fzerofun_workspace *pfzw,
+                         int *converged,
+                         ErrorMsg errmsg){
+
+  double x0=0., f0=0., f1, x2;
+  int iter;
+
+  *converged = _FALSE_;
+
+  for (iter=0; iter < _SHOOTING_WARM_START_ITER_; iter++) {
+
+    if (input_fzerofun_1d(x1,pfzw,&f1,errmsg) == _FAILURE_)
+      return _SUCCESS_;
+    (*fevals)++;
+
+    if ((iter > 0) && (f1 != f0))
+      dxdF = (x1-x0)/(f1-f0);
+
+    x2 = x1 - f1*dxdF;
+
+    if (fabs(x2-x1) <= 1e-5*MAX(fabs(x1),fabs(x2))) {
+      *xzero = x2;
+      *dxdF_out = dxdF;
+      *converged = _TRUE_;
+      return _SUCCESS_;
+    }
+
+    x0 = x1;
+    f0 = f1;
+    x1 = x2;
+  }
+
+  return _SUCCESS_;
+}
+
+/** process-level memory of previous shootings (see struct shooting_warm_start) */
+
+static struct shooting_warm_start shooting_warm_start_list[_SHOOTING_WARM_START_SIZE_];
+static int shooting_warm_start_number = 0; /**< number of entries in use */
+static int shooting_warm_start_clock = 0;  /**< number of lookups so far */
+
+/**
+ * Look for a previous solution with the same targets as the current
+ * workspace and, if found, extrapolate it to the current target values.
+ *
+ * @param pfzw  Input: shooting workspace
+ * @param x     Output: starting point for the unknown parameters, if found
+ * @param dxdF  Output: stored derivatives dx/dF, if found
+ * @param found Output: whether an entry matched
+ * @return the error status
+ */
+
+int input_shooting_warm_start_get(struct fzerofun_workspace *pfzw,
+                                  double *x,
+                                  double *dxdF,
+                                  int *found){
+
+  int index_entry,i;
+  struct shooting_warm_start * entry;
+
+  *found = _FALSE_;
+
+#pragma omp critical (shooting_warm_start)
+  {
+    shooting_warm_start_clock++;
+
+    for (index_entry=0; index_entry<shooting_warm_start_number; index_entry++) {
+      entry = &(shooting_warm_start_list[index_entry]);
+      if (entry->target_size != pfzw->target_size)
+        continue;
+      for (i=0; i<entry->target_size; i++)
+        if (entry->target_name[i] != pfzw->target_name[i])
+          break;
+      if (i < entry->target_size)
+        continue;
+
+      for (i=0; i<entry->target_size; i++) {
+        x[i] = entry->x[i] + entry->dxdF[i]*(pfzw->target_value[i]-entry->target_value[i]);
+        dxdF[i] = entry->dxdF[i];
+      }
+      entry->last_use = shooting_warm_start_clock;
+      *found = _TRUE_;
+      break;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Remember the solution of a successful shooting, replacing the entry
+ * with the same targets or, if there is none, the oldest one.
+ *
+ * @param pfzw Input: shooting workspace
+ * @param x    Input: solution for the unknown parameters
+ * @param dxdF Input: local derivatives dx/dF at the solution
+ * @return the error status
+ */
+
+int input_shooting_warm_start_put(struct fzerofun_workspace *pfzw,
+                                  double *x,
+                                  double *dxdF){
+
+  int index_entry,index_lru,i;
+  struct shooting_warm_start * entry;
+
+#pragma omp critical (shooting_warm_start)
+  {
+    index_lru = -1;
+    for (index_entry=0; index_entry<shooting_warm_start_number; index_entry++) {
+      entry = &(shooting_warm_start_list[index_entry]);
+      if (entry->target_size != pfzw->target_size)
+        continue;
+      for (i=0; i<entry->target_size; i++)
+        if (entry->target_name[i] != pfzw->target_name[i])
+          break;
+      if (i == entry->target_size) {
+        index_lru = index_entry;
+        break;
+      }
+    }
+
+    if (index_lru == -1) {
+      if (shooting_warm_start_number < _SHOOTING_WARM_START_SIZE_) {
+        index_lru = shooting_warm_start_number;
+        shooting_warm_start_number++;
+      }
+      else {
+        index_lru = 0;
+        for (index_entry=1; index_entry<shooting_warm_start_number; index_entry++)
+          if (shooting_warm_start_list[index_entry].last_use < shooting_warm_start_list[index_lru].last_use)
+            index_lru = index_entry;
+      }
+    }
+
+    entry = &(shooting_warm_start_list[index_lru]);
+    entry->target_size = pfzw->target_size;
+    for (i=0; i<pfzw->target_size; i++) {
+      entry->target_name[i] = pfzw->target_name[i];
+      entry->target_value[i] = pfzw->target_value[i];
+      entry->x[i] = x[i];
+      entry->dxdF[i] = dxdF[i];
+    }
+    entry->last_use = shooting_warm_start_clock;
+  }
+
   return _SUCCESS_;
 }
 
@@ -16,15 +16,81 @@
  */
 
 #include "lensing.h"
+#include "shared_table.h"
 #include <time.h>
 
+/**
+ * Values of \f$ \mu \f$, quadrature weights and (optionally) Wigner
+ * d-functions used by lensing_init(). They depend only on the
+ * precision parameters and on l_unlensed_max, so they are computed
+ * once per process for each set of these inputs and shared, read-only,
+ * by all later runs (see lensing_mu_tables()). All these tables are
+ * stored one after the other in a single shared_table, which can also
+ * be shared between processes (see shared_table_get()).
+ */
+
+struct lensing_mu_tables {
+
+  int num_mu;                 /**< number of values of mu (the last one being mu=1) */
+  int l_max;                  /**< maximum multipole of the d-functions */
+  int accurate_lensing;       /**< quadrature type (see precision structure) */
+  double tol_gauss_legendre;  /**< tolerance of the Gauss-Legendre quadrature */
+  short has_d;                /**< are the d-functions stored? */
+
+  double * mu;                /**< mu[index_mu] */
+  double * w8;                /**< w8[index_mu], quadrature weights (num_mu-1 values) */
+
+  double * d00;               /**< d00[index_mu*(l_max+1)+l], and similarly for all d-functions below (only if has_d) */
+  double * d11;               /**< see d00 */
+  double * d1m1;              /**< see d00 */
+  double * d2m2;              /**< see d00 */
+  double * d20;               /**< see d00 */
+  double * d3m1;              /**< see d00 */
+  double * d4m2;              /**< see d00 */
+  double * d22;               /**< see d00 */
+  double * d31;               /**< see d00 */
+  double * d3m3;              /**< see d00 */
+  double * d40;               /**< see d00 */
+  double * d4m4;              /**< see d00 */
+
+  struct shared_table shared; /**< storage of all the tables above, in the order mu, w8, d00, d11, ... */
+
+  double * device_d;          /**< with -DCLASS_OFFLOAD: device pointer to a copy of the twelve tables above, one after the other in the order of lensing_mu_tables_compute() (only if has_d) */
+  double * device_w8;         /**< with -DCLASS_OFFLOAD: device pointer to a copy of w8 (only if has_d) */
+  int device;                 /**< device holding these copies */
+
+  struct lensing_mu_tables * next; /**< next set of tables computed in this process */
+
+};
+
+/** list of all sets of tables computed in this process */
+
+static struct lensing_mu_tables * lensing_mu_tables_list = NULL;
+
+/**
+ * Inputs on which the tables of a struct lensing_mu_tables depend,
+ * used as a key for sharing them between processes
+ */
+
+struct lensing_mu_tables_key {
+
+  int num_mu;                /**< number of values of mu */
+  int l_max;                 /**< maximum multipole of the d-functions */
+  int accurate_lensing;      /**< quadrature type */
+  int has_d;                 /**< are the d-functions stored? */
+  double tol_gauss_legendre; /**< tolerance of the Gauss-Legendre quadrature */
+
+};
+
 /**
  * Anisotropy power spectra \f$ C_l\f$'s for all types, modes and initial conditions.
  * SO FAR: ONLY SCALAR
  *
  * This routine evaluates all the lensed \f$ C_l\f$'s at a given value of l by
- * picking it in the pre-computed table. When relevant, it also
- * sums over all initial conditions for each mode, and over all modes.
+ * picking it in the pre-computed table (copying it from the dense table
+ * filled once by lensing_cl_dense() for l between 2 and l_lensed_max).
+ * When relevant, it also sums over all initial conditions for each
+ * mode, and over all modes.
  *
  * This function can be called from whatever module at whatever time,
  * provided that lensing_init() has been called before, and
@@ -48,6 +114,11 @@ int lensing_cl_at_l(
              ple->error_message,
              "you asked for lensed Cls at l=%d, they were computed only up to l=%d, you should increase l_max_scalars or decrease the precision parameter delta_l_max",l,ple->l_lensed_max);
 
+  if ((ple->cl_lens_dense != NULL) && (l >= 2)) {
+    memcpy(cl_lensed,ple->cl_lens_dense+l*ple->lt_size,ple->lt_size*sizeof(double));
+    return _SUCCESS_;
+  }
+
   class_call(array_interpolate_spline(ple->l,
                                       ple->l_size,
                                       ple->cl_lens,
@@ -69,6 +140,38 @@ int lensing_cl_at_l(
   return _SUCCESS_;
 }
 
+/**
+ * This routine fills the table cl_lens_dense of the lensed \f$ C_l\f$'s
+ * at each integer l from 2 to l_lensed_max, by interpolating the
+ * spline table of lensing_init(). The entries l=0,1 are set to zero.
+ *
+ * @param ple Input/Output: pointer to lensing structure
+ * @return the error status
+ */
+
+int lensing_cl_dense(
+                     struct lensing * ple
+                     ) {
+
+  double * cl_dense;
+  int l;
+
+  class_calloc(cl_dense,(ple->l_lensed_max+1)*ple->lt_size,sizeof(double),ple->error_message);
+
+  /* ple->cl_lens_dense is still NULL here, so that lensing_cl_at_l()
+     interpolates the spline table */
+  for (l=2; l<=ple->l_lensed_max; l++) {
+    class_call(lensing_cl_at_l(ple,l,cl_dense+l*ple->lt_size),
+               ple->error_message,
+               ple->error_message);
+  }
+
+  ple->cl_lens_dense = cl_dense;
+
+  return _SUCCESS_;
+
+}
+
 /**
  * This routine initializes the lensing structure (in particular,
  * computes table of lensed anisotropy spectra \f$ C_l^{X} \f$)
@@ -95,13 +198,12 @@ int lensing_init(
   double * mu; /* mu[index_mu]: discretized values of mu
                   between -1 and 1, roots of Legendre polynomial */
   double * w8; /* Corresponding Gauss-Legendre quadrature weights */
-  double theta,delta_theta;
 
   double ** d00;  /* dmn[index_mu][index_l] */
   double ** d11;
   double ** d2m2;
-  double ** d22;
-  double ** d20;
+  double ** d22 = NULL;
+  double ** d20 = NULL;
   double ** d1m1;
   double ** d31;
   double ** d40;
@@ -115,57 +217,46 @@ int lensing_init(
   double * Cgl2;  /* Cgl2[index_mu] */
   double * sigma2; /* sigma[index_mu] */
 
-  double * ksi;  /* ksi[index_mu] */
-  double * ksiX;  /* ksiX[index_mu] */
-  double * ksip;  /* ksip[index_mu] */
-  double * ksim;  /* ksim[index_mu] */
-
-  double fac,fac1;
-  double X_000;
-  double X_p000;
-  double X_220;
-  double X_022;
-  double X_p022;
-  double X_121;
-  double X_132;
-  double X_242;
+  double * ksi = NULL;  /* ksi[index_mu] */
+  double * ksiX = NULL;  /* ksiX[index_mu] */
+  double * ksip = NULL;  /* ksip[index_mu] */
+  double * ksim = NULL;  /* ksim[index_mu] */
 
   int num_mu,index_mu,icount;
+  int mu_chunk,index_mu_start,n_mu,row,position,d_rows;
+  struct lensing_mu_tables * tables;
+  int index_l;
   int l;
   double ll;
-  double * cl_unlensed;  /* cl_unlensed[index_ct] */
+  double * cl_unlensed;  /* cl_unlensed[index_ct], pointer to one row of psp->cl_tot_dense */
   double * cl_tt; /* unlensed  cl, to be filled to avoid repeated calls to spectra_cl_at_l */
-  double * cl_te; /* unlensed  cl, to be filled to avoid repeated calls to spectra_cl_at_l */
-  double * cl_ee; /* unlensed  cl, to be filled to avoid repeated calls to spectra_cl_at_l */
-  double * cl_bb; /* unlensed  cl, to be filled to avoid repeated calls to spectra_cl_at_l */
+  double * cl_te = NULL; /* unlensed  cl, to be filled to avoid repeated calls to spectra_cl_at_l */
+  double * cl_ee = NULL; /* unlensed  cl, to be filled to avoid repeated calls to spectra_cl_at_l */
+  double * cl_bb = NULL; /* unlensed  cl, to be filled to avoid repeated calls to spectra_cl_at_l */
   double * cl_pp; /* potential cl, to be filled to avoid repeated calls to spectra_cl_at_l */
 
-  double res,resX,lens;
-  double resp, resm, lensp, lensm;
-
   double * sqrt1;
   double * sqrt2;
   double * sqrt3;
   double * sqrt4;
   double * sqrt5;
 
-  double ** cl_md_ic; /* array with argument
-                         cl_md_ic[index_md][index_ic1_ic2*psp->ct_size+index_ct] */
-
-  double ** cl_md;    /* array with argument
-                         cl_md[index_md][index_ct] */
-
-  int index_md;
-
   /* Timing */
   //double debut, fin;
   //double cpu_time;
 
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(ple->profile));
+
   /** - check that we really want to compute at least one spectrum */
 
+  ple->cl_lens_dense = NULL;
+
   if (ple->has_lensed_cls == _FALSE_) {
     if (ple->lensing_verbose > 0)
       printf("No lensing requested. Lensing module skipped.\n");
+    class_profile_stop(&(ple->profile));
     return _SUCCESS_;
   }
   else {
@@ -196,43 +287,55 @@ int lensing_init(
     /* Integrate correlation function difference on [0,pi/16] */
     num_mu = (ple->l_unlensed_max * 2 )/16;
   }
-  /** - allocate array of \f$ \mu \f$ values, as well as quadrature weights */
-
-  class_alloc(mu,
-              num_mu*sizeof(double),
-              ple->error_message);
-  /* Reserve last element of mu for mu=1, needed for sigma2 */
-  mu[num_mu-1] = 1.0;
-
-  class_alloc(w8,
-              (num_mu-1)*sizeof(double),
-              ple->error_message);
-
-  if (ppr->accurate_lensing == _TRUE_) {
-
-    //debut = omp_get_wtime();
-    class_call(quadrature_gauss_legendre(mu,
-                                         w8,
-                                         num_mu-1,
-                                         ppr->tol_gauss_legendre,
-                                         ple->error_message),
-               ple->error_message,
-               ple->error_message);
-    //fin = omp_get_wtime();
-    //cpu_time = (fin-debut);
-    //printf("time in quadrature_gauss_legendre=%4.3f s\n",cpu_time);
-
-  } else { /* Crude integration on [0,pi/16]: Riemann sum on theta */
-
-    delta_theta = _PI_/16. / (double)(num_mu-1);
-    for (index_mu=0;index_mu<num_mu-1;index_mu++) {
-      theta = (index_mu+1)*delta_theta;
-      mu[index_mu] = cos(theta);
-      w8[index_mu] = sin(theta)*delta_theta; /* We integrate on mu */
-    }
-  }
+  /** - get the values of \f$ \mu \f$ and the quadrature weights
+      (and, if ppr->lensing_cache_d_tables is true and we are not in
+      low-memory mode, the \f$ d^l_{mm'} (\mu) \f$), computed only
+      the first time that they are needed in the process */
+
+  class_call(lensing_mu_tables(ppr,
+                               num_mu,
+                               ple->l_unlensed_max,
+                               (ppr->lensing_cache_d_tables == _TRUE_) && (ppr->low_memory == _FALSE_),
+                               &tables,
+                               ple->error_message),
+             ple->error_message,
+             ple->error_message);
 
-  /** - Compute \f$ d^l_{mm'} (\mu) \f$*/
+  mu = tables->mu;
+  w8 = tables->w8;
+
+  /** - Choose the number of values of \f$ \mu \f$ for which the
+      \f$ d^l_{mm'} (\mu) \f$ are stored at the same time. The values
+      of \f$ \mu \f$ are processed by chunks of lensing_mu_chunk values
+      per thread: for each chunk the recurrences are run and their
+      results immediately used, while still in cache, for the
+      correlation functions and the lensed \f$ C_l\f$'s (the last
+      value, \f$ \mu=1 \f$, is only needed for sigma2 and treated
+      first). Memory then scales like O(l_max) per thread. If
+      lensing_mu_chunk is zero, all values are treated at once, which
+      requires O(num_mu*l_max) memory. */
+
+  mu_chunk = ppr->lensing_mu_chunk;
+#ifdef _OPENMP
+  mu_chunk *= omp_get_max_threads();
+#endif
+  if ((mu_chunk <= 0) || (mu_chunk > num_mu-1))
+    mu_chunk = num_mu-1;
+
+  /** - with -DCLASS_OFFLOAD and the d-functions in the shared tables,
+      all values of \f$ \mu \f$ are sent to the device at once */
+
+  if (tables->device_d != NULL)
+    mu_chunk = num_mu-1;
+
+  /** - Allocate the arrays of pointers to the \f$ d^l_{mm'} (\mu) \f$,
+      and a contiguous buffer for one chunk of them (unless they are
+      read in the shared tables) */
+
+  if (tables->has_d == _TRUE_)
+    d_rows = 0;
+  else
+    d_rows = mu_chunk;
 
   icount = 0;
   class_alloc(d00,
@@ -250,7 +353,7 @@ int lensing_init(
   class_alloc(d2m2,
               num_mu*sizeof(double*),
               ple->error_message);
-  icount += 4*num_mu*(ple->l_unlensed_max+1);
+  icount += 4*d_rows*(ple->l_unlensed_max+1);
 
   if(ple->has_te==_TRUE_) {
 
@@ -265,7 +368,7 @@ int lensing_init(
     class_alloc(d4m2,
                 num_mu*sizeof(double*),
                 ple->error_message);
-    icount += 3*num_mu*(ple->l_unlensed_max+1);
+    icount += 3*d_rows*(ple->l_unlensed_max+1);
   }
 
   if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
@@ -289,7 +392,7 @@ int lensing_init(
     class_alloc(d4m4,
                 num_mu*sizeof(double*),
                 ple->error_message);
-    icount += 5*num_mu*(ple->l_unlensed_max+1);
+    icount += 5*d_rows*(ple->l_unlensed_max+1);
   }
 
   icount += 5*(ple->l_unlensed_max+1); /* for arrays sqrt1[l] to sqrt5[l] */
@@ -300,36 +403,6 @@ int lensing_init(
               ple->error_message);
 
   icount = 0;
-  for (index_mu=0; index_mu<num_mu; index_mu++) {
-
-    d00[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-    d11[index_mu] = &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-    d1m1[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
-    d2m2[index_mu]= &(buf_dxx[icount+(index_mu+3*num_mu) * (ple->l_unlensed_max+1)]);
-  }
-  icount += 4*num_mu*(ple->l_unlensed_max+1);
-
-  if (ple->has_te==_TRUE_) {
-    for (index_mu=0; index_mu<num_mu; index_mu++) {
-      d20[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-      d3m1[index_mu]= &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-      d4m2[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
-    }
-    icount += 3*num_mu*(ple->l_unlensed_max+1);
-  }
-
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-
-    for (index_mu=0; index_mu<num_mu; index_mu++) {
-      d22[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-      d31[index_mu] = &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-      d3m3[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
-      d40[index_mu] = &(buf_dxx[icount+(index_mu+3*num_mu) * (ple->l_unlensed_max+1)]);
-      d4m4[index_mu]= &(buf_dxx[icount+(index_mu+4*num_mu) * (ple->l_unlensed_max+1)]);
-    }
-    icount += 5*num_mu*(ple->l_unlensed_max+1);
-  }
-
   sqrt1 = &(buf_dxx[icount]);
   icount += ple->l_unlensed_max+1;
   sqrt2 = &(buf_dxx[icount]);
@@ -340,68 +413,19 @@ int lensing_init(
   icount += ple->l_unlensed_max+1;
   sqrt5 = &(buf_dxx[icount]);
   icount += ple->l_unlensed_max+1;
+  /* from now on, icount is the position of the d^l_{mm'} in buf_dxx */
 
-  //debut = omp_get_wtime();
-  class_call(lensing_d00(mu,num_mu,ple->l_unlensed_max,d00),
-             ple->error_message,
-             ple->error_message);
-
-  class_call(lensing_d11(mu,num_mu,ple->l_unlensed_max,d11),
-             ple->error_message,
-             ple->error_message);
-
-  class_call(lensing_d1m1(mu,num_mu,ple->l_unlensed_max,d1m1),
-             ple->error_message,
-             ple->error_message);
-
-  class_call(lensing_d2m2(mu,num_mu,ple->l_unlensed_max,d2m2),
-             ple->error_message,
-             ple->error_message);
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in lensing_dxx=%4.3f s\n",cpu_time);
-
-
-  if (ple->has_te==_TRUE_) {
-
-    class_call(lensing_d20(mu,num_mu,ple->l_unlensed_max,d20),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d3m1(mu,num_mu,ple->l_unlensed_max,d3m1),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d4m2(mu,num_mu,ple->l_unlensed_max,d4m2),
-               ple->error_message,
-               ple->error_message);
-
-  }
-
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-
-    class_call(lensing_d22(mu,num_mu,ple->l_unlensed_max,d22),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d31(mu,num_mu,ple->l_unlensed_max,d31),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d3m3(mu,num_mu,ple->l_unlensed_max,d3m3),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d40(mu,num_mu,ple->l_unlensed_max,d40),
-               ple->error_message,
-               ple->error_message);
+  for (l=2;l<=ple->l_unlensed_max;l++) {
 
-    class_call(lensing_d4m4(mu,num_mu,ple->l_unlensed_max,d4m4),
-               ple->error_message,
-               ple->error_message);
+    ll = (double)l;
+    sqrt1[l]=sqrt((ll+2)*(ll+1)*ll*(ll-1));
+    sqrt2[l]=sqrt((ll+2)*(ll-1));
+    sqrt3[l]=sqrt((ll+3)*(ll-2));
+    sqrt4[l]=sqrt((ll+4)*(ll+3)*(ll-2.)*(ll-3));
+    sqrt5[l]=sqrt(ll*(ll+1));
   }
 
-  /** - compute \f$ Cgl(\mu)\f$, \f$ Cgl2(\mu) \f$ and sigma2(\f$\mu\f$) */
+  /** - Allocate \f$ Cgl(\mu)\f$, \f$ Cgl2(\mu) \f$ and sigma2(\f$\mu\f$) */
 
   class_alloc(Cgl,
               num_mu*sizeof(double),
@@ -415,11 +439,6 @@ int lensing_init(
               (num_mu-1)*sizeof(double), /* Zero separation is omitted */
               ple->error_message);
 
-  class_alloc(cl_unlensed,
-              psp->ct_size*sizeof(double),
-              ple->error_message);
-
-
   /** - Locally store unlensed temperature \f$ cl_{tt}\f$ and potential \f$ cl_{pp}\f$ spectra **/
   class_alloc(cl_tt,
               (ple->l_unlensed_max+1)*sizeof(double),
@@ -442,33 +461,10 @@ int lensing_init(
               (ple->l_unlensed_max+1)*sizeof(double),
               ple->error_message);
 
-  class_alloc(cl_md_ic,
-              psp->md_size*sizeof(double *),
-              ple->error_message);
-
-  class_alloc(cl_md,
-              psp->md_size*sizeof(double *),
-              ple->error_message);
-
-  for (index_md = 0; index_md < psp->md_size; index_md++) {
-
-    if (psp->md_size > 1)
-
-      class_alloc(cl_md[index_md],
-                  psp->ct_size*sizeof(double),
-                  ple->error_message);
-
-    if (psp->ic_size[index_md] > 1)
-
-      class_alloc(cl_md_ic[index_md],
-                  psp->ic_ic_size[index_md]*psp->ct_size*sizeof(double),
-                  ple->error_message);
-  }
-
+  /* the unlensed spectra at each integer l are read directly in the
+     dense table of the spectra module (l_unlensed_max=l_max_tot) */
   for (l=2; l<=ple->l_unlensed_max; l++) {
-    class_call(spectra_cl_at_l(psp,l,cl_unlensed,cl_md,cl_md_ic),
-               psp->error_message,
-               ple->error_message);
+    cl_unlensed = psp->cl_tot_dense + l*psp->ct_size;
     cl_tt[l] = cl_unlensed[ple->index_lt_tt];
     cl_pp[l] = cl_unlensed[ple->index_lt_pp];
     if (ple->has_te==_TRUE_) {
@@ -480,55 +476,7 @@ int lensing_init(
     }
   }
 
-  for (index_md = 0; index_md < psp->md_size; index_md++) {
-
-    if (psp->md_size > 1)
-      free(cl_md[index_md]);
-
-    if (psp->ic_size[index_md] > 1)
-      free(cl_md_ic[index_md]);
-
-  }
-
-  free(cl_md_ic);
-  free(cl_md);
-
-  /** - Compute sigma2\f$(\mu)\f$ and Cgl2(\f$\mu\f$) **/
-
-  //debut = omp_get_wtime();
-#pragma omp parallel for                        \
-  private (index_mu,l)                          \
-  schedule (static)
-  for (index_mu=0; index_mu<num_mu; index_mu++) {
-
-    Cgl[index_mu]=0;
-    Cgl2[index_mu]=0;
-
-    for (l=2; l<=ple->l_unlensed_max; l++) {
-
-      Cgl[index_mu] += (2.*l+1.)*l*(l+1.)*
-        cl_pp[l]*d11[index_mu][l];
-
-      Cgl2[index_mu] += (2.*l+1.)*l*(l+1.)*
-        cl_pp[l]*d1m1[index_mu][l];
-
-    }
-
-    Cgl[index_mu] /= 4.*_PI_;
-    Cgl2[index_mu] /= 4.*_PI_;
-
-  }
-
-  for (index_mu=0; index_mu<num_mu-1; index_mu++) {
-    /* Cgl(1.0) - Cgl(mu) */
-    sigma2[index_mu] = Cgl[num_mu-1] - Cgl[index_mu];
-  }
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in Cgl,Cgl2,sigma2=%4.3f s\n",cpu_time);
-
-
-  /** - compute ksi, ksi+, ksi-, ksiX */
+  /** - Allocate ksi, ksi+, ksi-, ksiX */
 
   /** - --> ksi is for TT **/
   if (ple->has_tt==_TRUE_) {
@@ -562,171 +510,260 @@ int lensing_init(
                  ple->error_message);
   }
 
-  for (l=2;l<=ple->l_unlensed_max;l++) {
+  /** - The lensed \f$ C_l\f$'s are accumulated chunk by chunk: set them to zero */
 
-    ll = (double)l;
-    sqrt1[l]=sqrt((ll+2)*(ll+1)*ll*(ll-1));
-    sqrt2[l]=sqrt((ll+2)*(ll-1));
-    sqrt3[l]=sqrt((ll+3)*(ll-2));
-    sqrt4[l]=sqrt((ll+4)*(ll+3)*(ll-2.)*(ll-3));
-    sqrt5[l]=sqrt(ll*(ll+1));
+  for (index_l=0; index_l<ple->l_size; index_l++) {
+    if (ple->has_tt==_TRUE_)
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] = 0.;
+    if (ple->has_te==_TRUE_)
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] = 0.;
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] = 0.;
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] = 0.;
+    }
   }
 
+  /** - Compute \f$ Cgl(\mu=1)\f$, needed by sigma2(\f$\mu\f$) for all \f$ \mu \f$ */
 
-  //debut = omp_get_wtime();
-#pragma omp parallel for                                                \
-  private (index_mu,l,ll,res,resX,resp,resm,lens,lensp,lensm,           \
-           fac,fac1,X_000,X_p000,X_220,X_022,X_p022,X_121,X_132,X_242)	\
-  schedule (static)
+  index_mu = num_mu-1;
 
-  for (index_mu=0;index_mu<num_mu-1;index_mu++) {
+  if (tables->has_d == _TRUE_) {
+    d11[index_mu] = tables->d11+index_mu*(ple->l_unlensed_max+1);
+  }
+  else {
+    d11[index_mu] = &(buf_dxx[icount+mu_chunk*(ple->l_unlensed_max+1)]);
 
-    for (l=2;l<=ple->l_unlensed_max;l++) {
+    class_call(lensing_d11(mu+index_mu,1,ple->l_unlensed_max,d11+index_mu),
+               ple->error_message,
+               ple->error_message);
+  }
 
-      ll = (double)l;
+  Cgl[index_mu]=0;
+  for (l=2; l<=ple->l_unlensed_max; l++) {
+    Cgl[index_mu] += (2.*l+1.)*l*(l+1.)*
+      cl_pp[l]*d11[index_mu][l];
+  }
+  Cgl[index_mu] /= 4.*_PI_;
 
-      fac = ll*(ll+1)/4.;
-      fac1 = (2*ll+1)/(4.*_PI_);
+  /** - Loop over chunks of values of \f$ \mu \f$ */
 
-      /* In the following we will keep terms of the form (sigma2)^k*(Cgl2)^m
-         with k+m <= 2 */
+  for (index_mu_start=0; index_mu_start<num_mu-1; index_mu_start+=mu_chunk) {
 
-      X_000 = exp(-fac*sigma2[index_mu]);
-      X_p000 = -fac*X_000;
-      /* X_220 = 0.25*sqrt1[l] * exp(-(fac-0.5)*sigma2[index_mu]); */
-      X_220 = 0.25*sqrt1[l] * X_000; /* Order 0 */
-      /* next 5 lines useless, but avoid compiler warning 'may be used uninitialized' */
-      X_242=0.;
-      X_132=0.;
-      X_121=0.;
-      X_p022=0.;
-      X_022=0.;
+    n_mu = MIN(mu_chunk,num_mu-1-index_mu_start);
 
-      if (ple->has_te==_TRUE_ || ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-        /* X_022 = exp(-(fac-1.)*sigma2[index_mu]); */
-        X_022 = X_000 * (1+sigma2[index_mu]*(1+0.5*sigma2[index_mu])); /* Order 2 */
-        X_p022 = (fac-1.)*X_022;
-        /* X_242 = 0.25*sqrt4[l]  * exp(-(fac-5./2.)*sigma2[index_mu]); */
-        X_242 = 0.25*sqrt4[l] * X_000; /* Order 0 */
-        if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    /** - --> point to the rows of the shared tables, or of the buffer, used by this chunk */
+
+    for (index_mu=index_mu_start; index_mu<index_mu_start+n_mu; index_mu++) {
 
-          /* X_121 = - 0.5*sqrt2[l] * exp(-(fac-2./3.)*sigma2[index_mu]);
-             X_132 = - 0.5*sqrt3[l] * exp(-(fac-5./3.)*sigma2[index_mu]); */
-          X_121 = -0.5*sqrt2[l] * X_000 * (1+2./3.*sigma2[index_mu]); /* Order 1 */
-          X_132 = -0.5*sqrt3[l] * X_000 * (1+5./3.*sigma2[index_mu]); /* Order 1 */
+      if (tables->has_d == _TRUE_) {
+        row = index_mu*(ple->l_unlensed_max+1);
+        d00[index_mu] = tables->d00+row;
+        d11[index_mu] = tables->d11+row;
+        d1m1[index_mu]= tables->d1m1+row;
+        d2m2[index_mu]= tables->d2m2+row;
+        if (ple->has_te==_TRUE_) {
+          d20[index_mu] = tables->d20+row;
+          d3m1[index_mu]= tables->d3m1+row;
+          d4m2[index_mu]= tables->d4m2+row;
         }
+        if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+          d22[index_mu] = tables->d22+row;
+          d31[index_mu] = tables->d31+row;
+          d3m3[index_mu]= tables->d3m3+row;
+          d40[index_mu] = tables->d40+row;
+          d4m4[index_mu]= tables->d4m4+row;
+        }
+        continue;
       }
 
+      row = index_mu-index_mu_start;
+      position = icount;
 
-      if (ple->has_tt==_TRUE_) {
+      d00[index_mu] = &(buf_dxx[position+row              * (ple->l_unlensed_max+1)]);
+      d11[index_mu] = &(buf_dxx[position+(row+mu_chunk)   * (ple->l_unlensed_max+1)]);
+      d1m1[index_mu]= &(buf_dxx[position+(row+2*mu_chunk) * (ple->l_unlensed_max+1)]);
+      d2m2[index_mu]= &(buf_dxx[position+(row+3*mu_chunk) * (ple->l_unlensed_max+1)]);
+      position += 4*mu_chunk*(ple->l_unlensed_max+1);
 
-        res = fac1*cl_tt[l];
+      if (ple->has_te==_TRUE_) {
+        d20[index_mu] = &(buf_dxx[position+row              * (ple->l_unlensed_max+1)]);
+        d3m1[index_mu]= &(buf_dxx[position+(row+mu_chunk)   * (ple->l_unlensed_max+1)]);
+        d4m2[index_mu]= &(buf_dxx[position+(row+2*mu_chunk) * (ple->l_unlensed_max+1)]);
+        position += 3*mu_chunk*(ple->l_unlensed_max+1);
+      }
 
-        lens = (X_000*X_000*d00[index_mu][l] +
-                X_p000*X_p000*d1m1[index_mu][l]
-                *Cgl2[index_mu]*8./(ll*(ll+1)) +
-                (X_p000*X_p000*d00[index_mu][l] +
-                 X_220*X_220*d2m2[index_mu][l])
-                *Cgl2[index_mu]*Cgl2[index_mu]);
-        if (ppr->accurate_lensing == _FALSE_) {
-          /* Remove unlensed correlation function */
-          lens -= d00[index_mu][l];
-        }
-        res *= lens;
-        ksi[index_mu] += res;
+      if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+        d22[index_mu] = &(buf_dxx[position+row              * (ple->l_unlensed_max+1)]);
+        d31[index_mu] = &(buf_dxx[position+(row+mu_chunk)   * (ple->l_unlensed_max+1)]);
+        d3m3[index_mu]= &(buf_dxx[position+(row+2*mu_chunk) * (ple->l_unlensed_max+1)]);
+        d40[index_mu] = &(buf_dxx[position+(row+3*mu_chunk) * (ple->l_unlensed_max+1)]);
+        d4m4[index_mu]= &(buf_dxx[position+(row+4*mu_chunk) * (ple->l_unlensed_max+1)]);
       }
+    }
+
+    /** - --> if the d-functions are on the offload device, do the
+        rest of the work for this chunk there */
+
+    if (tables->device_d != NULL) {
+      class_call(lensing_correlation_device(ppr,ple,tables,index_mu_start,n_mu,
+                                            cl_tt,cl_te,cl_ee,cl_bb,cl_pp,
+                                            sqrt1,sqrt2,sqrt3,sqrt4,sqrt5,
+                                            Cgl,Cgl2,sigma2,
+                                            ksi,ksiX,ksip,ksim),
+                 ple->error_message,
+                 ple->error_message);
+      continue;
+    }
+
+    /** - --> compute \f$ d^l_{mm'} (\mu) \f$ for this chunk */
+
+    if (tables->has_d == _FALSE_) {
+
+      //debut = omp_get_wtime();
+      class_call(lensing_d00(mu+index_mu_start,n_mu,ple->l_unlensed_max,d00+index_mu_start),
+                 ple->error_message,
+                 ple->error_message);
+
+      class_call(lensing_d11(mu+index_mu_start,n_mu,ple->l_unlensed_max,d11+index_mu_start),
+                 ple->error_message,
+                 ple->error_message);
+
+      class_call(lensing_d1m1(mu+index_mu_start,n_mu,ple->l_unlensed_max,d1m1+index_mu_start),
+                 ple->error_message,
+                 ple->error_message);
+
+      class_call(lensing_d2m2(mu+index_mu_start,n_mu,ple->l_unlensed_max,d2m2+index_mu_start),
+                 ple->error_message,
+                 ple->error_message);
+      //fin = omp_get_wtime();
+      //cpu_time = (fin-debut);
+      //printf("time in lensing_dxx=%4.3f s\n",cpu_time);
+
 
       if (ple->has_te==_TRUE_) {
 
-        resX = fac1*cl_te[l];
+        class_call(lensing_d20(mu+index_mu_start,n_mu,ple->l_unlensed_max,d20+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
 
+        class_call(lensing_d3m1(mu+index_mu_start,n_mu,ple->l_unlensed_max,d3m1+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
+
+        class_call(lensing_d4m2(mu+index_mu_start,n_mu,ple->l_unlensed_max,d4m2+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
 
-        lens = ( X_022*X_000*d20[index_mu][l] +
-                 Cgl2[index_mu]*2.*X_p000/sqrt5[l] *
-                 (X_121*d11[index_mu][l] + X_132*d3m1[index_mu][l]) +
-                 0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
-                 ( ( 2.*X_p022*X_p000+X_220*X_220 ) *
-                   d20[index_mu][l] + X_220*X_242*d4m2[index_mu][l] ) );
-        if (ppr->accurate_lensing == _FALSE_) {
-          lens -= d20[index_mu][l];
-        }
-        resX *= lens;
-        ksiX[index_mu] += resX;
       }
 
       if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
 
-        resp = fac1*(cl_ee[l]+cl_bb[l]);
-        resm = fac1*(cl_ee[l]-cl_bb[l]);
-
-        lensp = ( X_022*X_022*d22[index_mu][l] +
-                  2.*Cgl2[index_mu]*X_132*X_121*d31[index_mu][l] +
-                  Cgl2[index_mu]*Cgl2[index_mu] *
-                  ( X_p022*X_p022*d22[index_mu][l] +
-                    X_242*X_220*d40[index_mu][l] ) );
-
-        lensm = ( X_022*X_022*d2m2[index_mu][l] +
-                  Cgl2[index_mu] *
-                  ( X_121*X_121*d1m1[index_mu][l] +
-                    X_132*X_132*d3m3[index_mu][l] ) +
-                  0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
-                  ( 2.*X_p022*X_p022*d2m2[index_mu][l] +
-                    X_220*X_220*d00[index_mu][l] +
-                    X_242*X_242*d4m4[index_mu][l] ) );
-        if (ppr->accurate_lensing == _FALSE_) {
-          lensp -= d22[index_mu][l];
-          lensm -= d2m2[index_mu][l];
-        }
-        resp *= lensp;
-        resm *= lensm;
-        ksip[index_mu] += resp;
-        ksim[index_mu] += resm;
-      }
+        class_call(lensing_d22(mu+index_mu_start,n_mu,ple->l_unlensed_max,d22+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
+
+        class_call(lensing_d31(mu+index_mu_start,n_mu,ple->l_unlensed_max,d31+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
+
+        class_call(lensing_d3m3(mu+index_mu_start,n_mu,ple->l_unlensed_max,d3m3+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
+
+        class_call(lensing_d40(mu+index_mu_start,n_mu,ple->l_unlensed_max,d40+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
+
+        class_call(lensing_d4m4(mu+index_mu_start,n_mu,ple->l_unlensed_max,d4m4+index_mu_start),
+                   ple->error_message,
+                   ple->error_message);
+      }
+    }
+
+    /** - --> for each value of \f$ \mu \f$ in this chunk, compute in a
+        single pass over the rows of \f$ d^l_{mm'} (\mu) \f$ (still in
+        cache): Cgl(\f$\mu\f$), Cgl2(\f$\mu\f$), sigma2(\f$\mu\f$), and
+        then ksi, ksi+, ksi-, ksiX */
+
+    //debut = omp_get_wtime();
+#pragma omp parallel for                                                \
+  private (index_mu)                                                    \
+  schedule (static)
+
+    for (index_mu=index_mu_start;index_mu<index_mu_start+n_mu;index_mu++) {
+
+      /* count hardware events in each thread (only with -DCLASS_PAPI) */
+      class_kernel_start(kernel_lensing_correlation);
+
+      lensing_correlation_at_mu(ple->l_unlensed_max,
+                                ple->has_tt,
+                                ple->has_te,
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_),
+                                ppr->accurate_lensing,
+                                cl_tt,cl_te,cl_ee,cl_bb,cl_pp,
+                                sqrt1,sqrt2,sqrt3,sqrt4,sqrt5,
+                                d00[index_mu],d11[index_mu],d1m1[index_mu],d2m2[index_mu],
+                                (ple->has_te==_TRUE_ ? d20[index_mu] : NULL),
+                                (ple->has_te==_TRUE_ ? d3m1[index_mu] : NULL),
+                                (ple->has_te==_TRUE_ ? d4m2[index_mu] : NULL),
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_ ? d22[index_mu] : NULL),
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_ ? d31[index_mu] : NULL),
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_ ? d3m3[index_mu] : NULL),
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_ ? d40[index_mu] : NULL),
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_ ? d4m4[index_mu] : NULL),
+                                Cgl[num_mu-1],
+                                Cgl+index_mu,
+                                Cgl2+index_mu,
+                                sigma2+index_mu,
+                                (ple->has_tt==_TRUE_ ? ksi+index_mu : NULL),
+                                (ple->has_te==_TRUE_ ? ksiX+index_mu : NULL),
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_ ? ksip+index_mu : NULL),
+                                (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_ ? ksim+index_mu : NULL));
+
+      class_kernel_stop(kernel_lensing_correlation);
     }
-  }
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in ksi=%4.3f s\n",cpu_time);
+    //fin = omp_get_wtime();
+    //cpu_time = (fin-debut);
+    //printf("time in ksi=%4.3f s\n",cpu_time);
 
+    /** - --> add the contribution of this chunk to the lensed \f$ C_l\f$'s */
 
-  /** - compute lensed \f$ C_l\f$'s by integration */
-  //debut = omp_get_wtime();
-  if (ple->has_tt==_TRUE_) {
-    class_call(lensing_lensed_cl_tt(ksi,d00,w8,num_mu-1,ple),
+    //debut = omp_get_wtime();
+    class_call(lensing_lensed_cl_chunk(ksi,ksiX,ksip,ksim,
+                                       d00,d20,d22,d2m2,
+                                       w8,
+                                       index_mu_start,
+                                       n_mu,
+                                       ple),
                ple->error_message,
                ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
+    //fin=omp_get_wtime();
+    //cpu_time = (fin-debut);
+    //printf("time in final lensing computation=%4.3f s\n",cpu_time);
+  }
+
+  /** - in fast mode, add back the unlensed \f$ C_l\f$'s */
+
+  if (ppr->accurate_lensing == _FALSE_) {
+
+    if (ple->has_tt==_TRUE_) {
       class_call(lensing_addback_cl_tt(ple,cl_tt),
                  ple->error_message,
                  ple->error_message);
     }
-  }
 
-  if (ple->has_te==_TRUE_) {
-    class_call(lensing_lensed_cl_te(ksiX,d20,w8,num_mu-1,ple),
-               ple->error_message,
-               ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
+    if (ple->has_te==_TRUE_) {
       class_call(lensing_addback_cl_te(ple,cl_te),
                  ple->error_message,
                  ple->error_message);
     }
-  }
-
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
 
-    class_call(lensing_lensed_cl_ee_bb(ksip,ksim,d22,d2m2,w8,num_mu-1,ple),
-               ple->error_message,
-               ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
       class_call(lensing_addback_cl_ee_bb(ple,cl_ee,cl_bb),
                  ple->error_message,
                  ple->error_message);
     }
   }
-  //fin=omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in final lensing computation=%4.3f s\n",cpu_time);
 
   /** - spline computed \f$ C_l\f$'s in view of interpolation */
 
@@ -740,6 +777,13 @@ int lensing_init(
              ple->error_message,
              ple->error_message);
 
+  /** - interpolate once for all the spectra at each integer l, so
+      that later calls to lensing_cl_at_l() only copy them */
+
+  class_call(lensing_cl_dense(ple),
+             ple->error_message,
+             ple->error_message);
+
   /** - Free lots of stuff **/
   free(buf_dxx);
 
@@ -772,10 +816,7 @@ int lensing_init(
   free(Cgl2);
   free(sigma2);
 
-  free(mu);
-  free(w8);
 
-  free(cl_unlensed);
   free(cl_tt);
   if (ple->has_te==_TRUE_)
     free(cl_te);
@@ -786,10 +827,288 @@ int lensing_init(
   free(cl_pp);
   /** - Exit **/
 
+  class_profile_stop(&(ple->profile));
+  return _SUCCESS_;
+
+}
+
+/**
+ * Return the values of \f$ \mu \f$ and the quadrature weights (and,
+ * if has_d is true, the Wigner d-functions) for num_mu values of mu
+ * and multipoles up to l_max. They are computed only the first time
+ * that these inputs are encountered in the process; later calls, from
+ * any run or thread, return the same read-only tables, which are never
+ * freed. If ppr->shared_tables_directory is not empty, the tables are
+ * also shared with the other processes through this directory.
+ *
+ * The last value of \f$ \mu \f$ is 1, needed for sigma2. The other
+ * ones are the roots of a Gauss-Legendre quadrature (accurate mode) or
+ * a uniform sampling of \f$ \theta \f$ in [0, \f$ \pi/16 \f$] (fast mode).
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param num_mu        Input: number of values of mu
+ * @param l_max         Input: maximum multipole of the d-functions
+ * @param has_d         Input: do we need the d-functions?
+ * @param ptables       Output: pointer to the shared tables
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int lensing_mu_tables(
+                      struct precision * ppr,
+                      int num_mu,
+                      int l_max,
+                      short has_d,
+                      struct lensing_mu_tables ** ptables,
+                      ErrorMsg error_message
+                      ) {
+
+  struct lensing_mu_tables * tables;
+  struct lensing_mu_tables_key key;
+  size_t data_size;
+  int status = _SUCCESS_;
+  ErrorMsg error_compute;
+
+#pragma omp critical (lensing_mu_tables)
+  {
+    for (tables = lensing_mu_tables_list; tables != NULL; tables = tables->next) {
+      if ((tables->num_mu == num_mu) &&
+          (tables->l_max == l_max) &&
+          (tables->accurate_lensing == ppr->accurate_lensing) &&
+          (tables->tol_gauss_legendre == ppr->tol_gauss_legendre) &&
+          (tables->has_d == has_d))
+        break;
+    }
+
+    if (tables == NULL) {
+      tables = (struct lensing_mu_tables *)calloc(1,sizeof(struct lensing_mu_tables));
+      if (tables == NULL) {
+        sprintf(error_compute,"could not allocate lensing tables");
+        status = _FAILURE_;
+      }
+      else {
+        tables->num_mu = num_mu;
+        tables->l_max = l_max;
+        tables->accurate_lensing = ppr->accurate_lensing;
+        tables->tol_gauss_legendre = ppr->tol_gauss_legendre;
+        tables->has_d = has_d;
+
+        memset(&key,0,sizeof(struct lensing_mu_tables_key));
+        key.num_mu = num_mu;
+        key.l_max = l_max;
+        key.accurate_lensing = ppr->accurate_lensing;
+        key.has_d = has_d;
+        key.tol_gauss_legendre = ppr->tol_gauss_legendre;
+
+        /* mu, w8 and the twelve d-tables */
+        data_size = 2*(size_t)num_mu-1;
+        if (has_d == _TRUE_)
+          data_size += 12*(size_t)num_mu*(l_max+1);
+
+        status = shared_table_get(ppr->shared_tables_directory,
+                                  "lensing_mu",
+                                  &key,
+                                  sizeof(struct lensing_mu_tables_key),
+                                  data_size,
+                                  lensing_mu_tables_compute,
+                                  tables,
+                                  &(tables->shared),
+                                  error_compute);
+
+        if (status == _SUCCESS_) {
+          lensing_mu_tables_pointers(tables,tables->shared.data);
+#ifdef CLASS_OFFLOAD
+          status = lensing_mu_tables_device(tables,error_compute);
+#endif
+        }
+
+        if (status == _SUCCESS_) {
+          tables->next = lensing_mu_tables_list;
+          lensing_mu_tables_list = tables;
+        }
+        else {
+          free(tables);
+          tables = NULL;
+        }
+      }
+    }
+  }
+
+  class_test(status == _FAILURE_,
+             error_message,
+             "%s",error_compute);
+
+  *ptables = tables;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Point the tables of a struct lensing_mu_tables into a block of
+ * doubles, in the order mu, w8, d00, d11, ... (the d-functions only if
+ * has_d).
+ *
+ * @param tables Input/Output: tables, with their inputs already set
+ * @param data   Input: block of 2*num_mu-1 (+12*num_mu*(l_max+1)) doubles
+ * @return the error status
+ */
+
+int lensing_mu_tables_pointers(
+                               struct lensing_mu_tables * tables,
+                               double * data
+                               ) {
+
+  int index_d;
+  size_t table_size;
+  double ** d[12] = {&(tables->d00),&(tables->d11),&(tables->d1m1),&(tables->d2m2),
+                     &(tables->d20),&(tables->d3m1),&(tables->d4m2),
+                     &(tables->d22),&(tables->d31),&(tables->d3m3),&(tables->d40),&(tables->d4m4)};
+
+  tables->mu = data;
+  tables->w8 = data+tables->num_mu;
+
+  table_size = (size_t)tables->num_mu*(tables->l_max+1);
+
+  for (index_d=0; index_d<12; index_d++) {
+    if (tables->has_d == _TRUE_)
+      *(d[index_d]) = data+2*tables->num_mu-1+index_d*table_size;
+    else
+      *(d[index_d]) = NULL;
+  }
+
   return _SUCCESS_;
+}
+
+/**
+ * Fill the tables of lensing_mu_tables(), given their inputs: this is
+ * the shared_table_builder of these tables.
+ *
+ * @param context       Input: pointer to the struct lensing_mu_tables, with its inputs already set
+ * @param data          Output: block of doubles in which the tables are written (see lensing_mu_tables_pointers())
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int lensing_mu_tables_compute(
+                              void * context,
+                              double * data,
+                              ErrorMsg error_message
+                              ) {
+
+  struct lensing_mu_tables * tables;
+  int num_mu,index_mu,index_d;
+  double theta,delta_theta;
+  double ** row;
+
+  /* all the d-functions, with the routine computing each of them */
+  int (*recurrence[12])(double *,int,int,double **) = {lensing_d00,lensing_d11,lensing_d1m1,lensing_d2m2,
+                                                       lensing_d20,lensing_d3m1,lensing_d4m2,
+                                                       lensing_d22,lensing_d31,lensing_d3m3,lensing_d40,lensing_d4m4};
+  double ** d[12];
+
+  tables = (struct lensing_mu_tables *)context;
+
+  lensing_mu_tables_pointers(tables,data);
+
+  d[0] = &(tables->d00); d[1] = &(tables->d11); d[2] = &(tables->d1m1); d[3] = &(tables->d2m2);
+  d[4] = &(tables->d20); d[5] = &(tables->d3m1); d[6] = &(tables->d4m2);
+  d[7] = &(tables->d22); d[8] = &(tables->d31); d[9] = &(tables->d3m3); d[10] = &(tables->d40); d[11] = &(tables->d4m4);
+
+  num_mu = tables->num_mu;
+
+  /** - fill array of \f$ \mu \f$ values, as well as quadrature weights */
+
+  /* Reserve last element of mu for mu=1, needed for sigma2 */
+  tables->mu[num_mu-1] = 1.0;
+
+  if (tables->accurate_lensing == _TRUE_) {
+
+    class_call(quadrature_gauss_legendre(tables->mu,
+                                         tables->w8,
+                                         num_mu-1,
+                                         tables->tol_gauss_legendre,
+                                         error_message),
+               error_message,
+               error_message);
+
+  } else { /* Crude integration on [0,pi/16]: Riemann sum on theta */
+
+    delta_theta = _PI_/16. / (double)(num_mu-1);
+    for (index_mu=0;index_mu<num_mu-1;index_mu++) {
+      theta = (index_mu+1)*delta_theta;
+      tables->mu[index_mu] = cos(theta);
+      tables->w8[index_mu] = sin(theta)*delta_theta; /* We integrate on mu */
+    }
+  }
+
+  if (tables->has_d == _FALSE_)
+    return _SUCCESS_;
+
+  /** - compute all the \f$ d^l_{mm'} (\mu) \f$ for all \f$ \mu \f$ */
+
+  class_alloc(row,num_mu*sizeof(double*),error_message);
 
+  for (index_d=0; index_d<12; index_d++) {
+
+    for (index_mu=0; index_mu<num_mu; index_mu++)
+      row[index_mu] = *(d[index_d])+index_mu*(tables->l_max+1);
+
+    class_call((*recurrence[index_d])(tables->mu,num_mu,tables->l_max,row),
+               error_message,
+               error_message);
+  }
+
+  free(row);
+
+  return _SUCCESS_;
+}
+
+#ifdef CLASS_OFFLOAD
+
+/**
+ * With -DCLASS_OFFLOAD, keep a copy of the d-functions and weights of
+ * lensing_mu_tables() on the offload device, for
+ * lensing_correlation_device()
+ *
+ * @param tables        Input/Output: tables
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int lensing_mu_tables_device(
+                             struct lensing_mu_tables * tables,
+                             ErrorMsg error_message
+                             ) {
+
+  size_t table_size;
+
+  if (tables->has_d == _FALSE_)
+    return _SUCCESS_;
+
+  tables->device = omp_get_default_device();
+  table_size = (size_t)tables->num_mu*(tables->l_max+1)*sizeof(double);
+
+  tables->device_d = (double *)omp_target_alloc(12*table_size,tables->device);
+  tables->device_w8 = (double *)omp_target_alloc((tables->num_mu-1)*sizeof(double),tables->device);
+  class_test((tables->device_d == NULL) || (tables->device_w8 == NULL),
+             error_message,
+             "could not allocate %zu bytes for the d-functions on the offload device",12*table_size);
+
+  /* the twelve tables are contiguous, in the order of lensing_mu_tables_pointers() */
+  class_test(omp_target_memcpy(tables->device_d,tables->d00,12*table_size,
+                               0,0,tables->device,omp_get_initial_device()) != 0,
+             error_message,
+             "could not copy the d-functions to the offload device");
+  class_test(omp_target_memcpy(tables->device_w8,tables->w8,(tables->num_mu-1)*sizeof(double),
+                               0,0,tables->device,omp_get_initial_device()) != 0,
+             error_message,
+             "could not copy the quadrature weights to the offload device");
+
+  return _SUCCESS_;
 }
 
+#endif
+
 /**
  * This routine frees all the memory space allocated by lensing_init().
  *
@@ -810,6 +1129,8 @@ int lensing_free(
     free(ple->cl_lens);
     free(ple->ddcl_lens);
     free(ple->l_max_lt);
+    if (ple->cl_lens_dense != NULL)
+      free(ple->cl_lens_dense);
 
   }
 
@@ -1046,175 +1367,545 @@ int lensing_indices(
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine computes, for one value of \f$ \mu \f$, Cgl(\f$\mu\f$),
+ * Cgl2(\f$\mu\f$), sigma2(\f$\mu\f$) and the lensed correlation
+ * functions ksi, ksiX, ksi+, ksi- (added to the values already there),
+ * in a single pass over the rows of \f$ d^l_{mm'} (\mu) \f$. It is
+ * called by lensing_init() for each value of \f$ \mu \f$, on the host
+ * or, with -DCLASS_OFFLOAD, on the offload device (see
+ * lensing_correlation_device()). The d-functions and correlation
+ * functions of the types that are not computed are not used (and can
+ * be NULL).
  *
- * @param ksi  Input: Lensed correlation function (ksi[index_mu])
- * @param d00  Input: Legendre polynomials (\f$ d^l_{00}\f$[l][index_mu])
- * @param w8   Input: Legendre quadrature weights (w8[index_mu])
- * @param nmu  Input: Number of quadrature points (0<=index_mu<=nmu)
- * @param ple  Input/output: Pointer to the lensing structure
+ * @param l_max            Input: maximum multipole
+ * @param has_tt           Input: compute ksi?
+ * @param has_te           Input: compute ksiX?
+ * @param has_pol          Input: compute ksi+ and ksi-?
+ * @param accurate_lensing Input: if false, remove the unlensed correlation functions
+ * @param cl_tt            Input: unlensed \f$ C_l \f$'s, and similarly for the four next arguments
+ * @param cl_te            Input: see cl_tt
+ * @param cl_ee            Input: see cl_tt
+ * @param cl_bb            Input: see cl_tt
+ * @param cl_pp            Input: see cl_tt
+ * @param sqrt1            Input: square roots of polynomials in l (see lensing_init()), and similarly for the four next arguments
+ * @param sqrt2            Input: see sqrt1
+ * @param sqrt3            Input: see sqrt1
+ * @param sqrt4            Input: see sqrt1
+ * @param sqrt5            Input: see sqrt1
+ * @param d00              Input: \f$ d^l_{00} (\mu) \f$[l], and similarly for the eleven next arguments
+ * @param d11              Input: see d00
+ * @param d1m1             Input: see d00
+ * @param d2m2             Input: see d00
+ * @param d20              Input: see d00
+ * @param d3m1             Input: see d00
+ * @param d4m2             Input: see d00
+ * @param d22              Input: see d00
+ * @param d31              Input: see d00
+ * @param d3m3             Input: see d00
+ * @param d40              Input: see d00
+ * @param d4m4             Input: see d00
+ * @param Cgl_at_one       Input: Cgl(\f$\mu=1\f$)
+ * @param Cgl              Output: Cgl(\f$\mu\f$)
+ * @param Cgl2             Output: Cgl2(\f$\mu\f$)
+ * @param sigma2           Output: sigma2(\f$\mu\f$)
+ * @param ksi              Input/output: ksi(\f$\mu\f$), and similarly for the three next arguments
+ * @param ksiX             Input/output: see ksi
+ * @param ksip             Input/output: see ksi
+ * @param ksim             Input/output: see ksi
  * @return the error status
  */
 
+#ifdef CLASS_OFFLOAD
+#pragma omp declare target
+#endif
+int lensing_correlation_at_mu(
+                              int l_max,
+                              short has_tt,
+                              short has_te,
+                              short has_pol,
+                              short accurate_lensing,
+                              double * cl_tt,
+                              double * cl_te,
+                              double * cl_ee,
+                              double * cl_bb,
+                              double * cl_pp,
+                              double * sqrt1,
+                              double * sqrt2,
+                              double * sqrt3,
+                              double * sqrt4,
+                              double * sqrt5,
+                              double * d00,
+                              double * d11,
+                              double * d1m1,
+                              double * d2m2,
+                              double * d20,
+                              double * d3m1,
+                              double * d4m2,
+                              double * d22,
+                              double * d31,
+                              double * d3m3,
+                              double * d40,
+                              double * d4m4,
+                              double Cgl_at_one,
+                              double * Cgl,
+                              double * Cgl2,
+                              double * sigma2,
+                              double * ksi,
+                              double * ksiX,
+                              double * ksip,
+                              double * ksim
+                              ) {
+
+  int l;
+  double ll;
+  double fac,fac1;
+  double X_000;
+  double X_p000;
+  double X_220;
+  double X_022;
+  double X_p022;
+  double X_121;
+  double X_132;
+  double X_242;
+  double res,resX,lens;
+  double resp,resm,lensp,lensm;
+
+  *Cgl=0;
+  *Cgl2=0;
 
-int lensing_lensed_cl_tt(
-                         double *ksi,
-                         double **d00,
-                         double *w8,
-                         int nmu,
-                         struct lensing * ple
-                         ) {
+  for (l=2; l<=l_max; l++) {
 
-  double cle;
-  int imu;
-  int index_l;
+    *Cgl += (2.*l+1.)*l*(l+1.)*
+      cl_pp[l]*d11[l];
 
-  /** Integration by Gauss-Legendre quadrature. **/
-#pragma omp parallel for                        \
-  private (imu,index_l,cle)                     \
-  schedule (static)
+    *Cgl2 += (2.*l+1.)*l*(l+1.)*
+      cl_pp[l]*d1m1[l];
 
-  for(index_l=0; index_l<ple->l_size; index_l++){
-    cle=0;
-    for (imu=0;imu<nmu;imu++) {
-      cle += ksi[imu]*d00[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
+  }
+
+  *Cgl /= 4.*_PI_;
+  *Cgl2 /= 4.*_PI_;
+
+  /* Cgl(1.0) - Cgl(mu) */
+  *sigma2 = Cgl_at_one - *Cgl;
+
+  for (l=2;l<=l_max;l++) {
+
+    ll = (double)l;
+
+    fac = ll*(ll+1)/4.;
+    fac1 = (2*ll+1)/(4.*_PI_);
+
+    /* In the following we will keep terms of the form (sigma2)^k*(Cgl2)^m
+       with k+m <= 2 */
+
+    X_000 = exp(-fac*(*sigma2));
+    X_p000 = -fac*X_000;
+    /* X_220 = 0.25*sqrt1[l] * exp(-(fac-0.5)*(*sigma2)); */
+    X_220 = 0.25*sqrt1[l] * X_000; /* Order 0 */
+    /* next 5 lines useless, but avoid compiler warning 'may be used uninitialized' */
+    X_242=0.;
+    X_132=0.;
+    X_121=0.;
+    X_p022=0.;
+    X_022=0.;
+
+    if (has_te==_TRUE_ || has_pol==_TRUE_) {
+      /* X_022 = exp(-(fac-1.)*(*sigma2)); */
+      X_022 = X_000 * (1+(*sigma2)*(1+0.5*(*sigma2))); /* Order 2 */
+      X_p022 = (fac-1.)*X_022;
+      /* X_242 = 0.25*sqrt4[l]  * exp(-(fac-5./2.)*(*sigma2)); */
+      X_242 = 0.25*sqrt4[l] * X_000; /* Order 0 */
+      if (has_pol==_TRUE_) {
+
+        /* X_121 = - 0.5*sqrt2[l] * exp(-(fac-2./3.)*(*sigma2));
+           X_132 = - 0.5*sqrt3[l] * exp(-(fac-5./3.)*(*sigma2)); */
+        X_121 = -0.5*sqrt2[l] * X_000 * (1+2./3.*(*sigma2)); /* Order 1 */
+        X_132 = -0.5*sqrt3[l] * X_000 * (1+5./3.*(*sigma2)); /* Order 1 */
+      }
+    }
+
+
+    if (has_tt==_TRUE_) {
+
+      res = fac1*cl_tt[l];
+
+      lens = (X_000*X_000*d00[l] +
+              X_p000*X_p000*d1m1[l]
+              *(*Cgl2)*8./(ll*(ll+1)) +
+              (X_p000*X_p000*d00[l] +
+               X_220*X_220*d2m2[l])
+              *(*Cgl2)*(*Cgl2));
+      if (accurate_lensing == _FALSE_) {
+        /* Remove unlensed correlation function */
+        lens -= d00[l];
+      }
+      res *= lens;
+      *ksi += res;
+    }
+
+    if (has_te==_TRUE_) {
+
+      resX = fac1*cl_te[l];
+
+
+      lens = ( X_022*X_000*d20[l] +
+               *Cgl2*2.*X_p000/sqrt5[l] *
+               (X_121*d11[l] + X_132*d3m1[l]) +
+               0.5 * (*Cgl2) * (*Cgl2) *
+               ( ( 2.*X_p022*X_p000+X_220*X_220 ) *
+                 d20[l] + X_220*X_242*d4m2[l] ) );
+      if (accurate_lensing == _FALSE_) {
+        lens -= d20[l];
+      }
+      resX *= lens;
+      *ksiX += resX;
+    }
+
+    if (has_pol==_TRUE_) {
+
+      resp = fac1*(cl_ee[l]+cl_bb[l]);
+      resm = fac1*(cl_ee[l]-cl_bb[l]);
+
+      lensp = ( X_022*X_022*d22[l] +
+                2.*(*Cgl2)*X_132*X_121*d31[l] +
+                *Cgl2*(*Cgl2) *
+                ( X_p022*X_p022*d22[l] +
+                  X_242*X_220*d40[l] ) );
+
+      lensm = ( X_022*X_022*d2m2[l] +
+                *Cgl2 *
+                ( X_121*X_121*d1m1[l] +
+                  X_132*X_132*d3m3[l] ) +
+                0.5 * (*Cgl2) * (*Cgl2) *
+                ( 2.*X_p022*X_p022*d2m2[l] +
+                  X_220*X_220*d00[l] +
+                  X_242*X_242*d4m4[l] ) );
+      if (accurate_lensing == _FALSE_) {
+        lensp -= d22[l];
+        lensm -= d2m2[l];
+      }
+      resp *= lensp;
+      resm *= lensm;
+      *ksip += resp;
+      *ksim += resm;
     }
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt]=cle*2.0*_PI_;
   }
 
+
   return _SUCCESS_;
 }
+#ifdef CLASS_OFFLOAD
+#pragma omp end declare target
+#endif
 
 /**
- * This routine adds back the unlensed \f$ cl_{tt}\f$ power spectrum
- * Used in case of fast (and BB inaccurate) integration of
- * correlation functions.
+ * This routine does the work of one chunk of values of \f$ \mu \f$ of
+ * lensing_init() on the offload device, when the code is compiled with
+ * -DCLASS_OFFLOAD and the d-functions are in the shared tables of
+ * lensing_mu_tables(), which keeps a copy of them on the device for
+ * all runs: it computes the correlation functions with
+ * lensing_correlation_at_mu(), and adds the contribution of these
+ * values of \f$ \mu \f$ to the lensed \f$ C_l\f$'s, like
+ * lensing_lensed_cl_chunk(). Only the unlensed \f$ C_l\f$'s and the
+ * results are exchanged with the host. The sums over \f$ \mu \f$ are
+ * done in the same order as on the host, the sums over l too, but the
+ * device may round differently.
  *
- * @param ple   Input/output: Pointer to the lensing structure
- * @param cl_tt Input: Array of unlensed power spectrum
+ * @param ppr            Input: pointer to precision structure
+ * @param ple            Input/output: pointer to the lensing structure
+ * @param tables         Input: shared tables, with their copy on the device
+ * @param index_mu_start Input: first value of mu
+ * @param n_mu           Input: number of values of mu
+ * @param cl_tt          Input: unlensed \f$ C_l \f$'s, and similarly for the four next arguments
+ * @param cl_te          Input: see cl_tt
+ * @param cl_ee          Input: see cl_tt
+ * @param cl_bb          Input: see cl_tt
+ * @param cl_pp          Input: see cl_tt
+ * @param sqrt1          Input: see lensing_correlation_at_mu(), and similarly for the four next arguments
+ * @param sqrt2          Input: see sqrt1
+ * @param sqrt3          Input: see sqrt1
+ * @param sqrt4          Input: see sqrt1
+ * @param sqrt5          Input: see sqrt1
+ * @param Cgl            Input/output: Cgl[index_mu] (the value at \f$ \mu=1 \f$ being known)
+ * @param Cgl2           Output: Cgl2[index_mu]
+ * @param sigma2         Output: sigma2[index_mu]
+ * @param ksi            Output: ksi[index_mu], and similarly for the three next arguments
+ * @param ksiX           Output: see ksi
+ * @param ksip           Output: see ksi
+ * @param ksim           Output: see ksi
  * @return the error status
  */
 
-int lensing_addback_cl_tt(
-                          struct lensing * ple,
-                          double *cl_tt) {
-  int index_l, l;
+int lensing_correlation_device(
+                               struct precision * ppr,
+                               struct lensing * ple,
+                               struct lensing_mu_tables * tables,
+                               int index_mu_start,
+                               int n_mu,
+                               double * cl_tt,
+                               double * cl_te,
+                               double * cl_ee,
+                               double * cl_bb,
+                               double * cl_pp,
+                               double * sqrt1,
+                               double * sqrt2,
+                               double * sqrt3,
+                               double * sqrt4,
+                               double * sqrt5,
+                               double * Cgl,
+                               double * Cgl2,
+                               double * sigma2,
+                               double * ksi,
+                               double * ksiX,
+                               double * ksip,
+                               double * ksim
+                               ) {
+
+#ifdef CLASS_OFFLOAD
+  /* device pointers to the twelve tables of d-functions, in the order
+     of lensing_mu_tables_compute(), and to the quadrature weights */
+  double * d = tables->device_d;
+  double * w8 = tables->device_w8;
+  double * cl_lens = ple->cl_lens;
+  double * l_list = ple->l;
+  size_t table_size = (size_t)tables->num_mu*(tables->l_max+1);
+  size_t row;
+  int l_max = ple->l_unlensed_max;
+  short has_tt = ple->has_tt;
+  short has_te = ple->has_te;
+  short has_pol = (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_);
+  short accurate_lensing = ppr->accurate_lensing;
+  int l_size = ple->l_size;
+  int lt_size = ple->lt_size;
+  int index_lt_tt = ple->index_lt_tt;
+  int index_lt_te = ple->index_lt_te;
+  int index_lt_ee = ple->index_lt_ee;
+  int index_lt_bb = ple->index_lt_bb;
+  /* sizes of the arrays copied to the device, zero for types not computed */
+  int n_l = l_max+1;
+  int n_tt = (has_tt==_TRUE_ ? n_l : 0);
+  int n_te = (has_te==_TRUE_ ? n_l : 0);
+  int n_pol = (has_pol==_TRUE_ ? n_l : 0);
+  int n_mu_tt = (has_tt==_TRUE_ ? n_mu : 0);
+  int n_mu_te = (has_te==_TRUE_ ? n_mu : 0);
+  int n_mu_pol = (has_pol==_TRUE_ ? n_mu : 0);
+  double Cgl_at_one = Cgl[tables->num_mu-1];
+  int index_mu,index_l,imu,l;
+  double cle,clte,clp,clm;
+
+  class_test(l_max != tables->l_max,
+             ple->error_message,
+             "the d-functions on the device go up to l=%d instead of %d",tables->l_max,l_max);
+
+#pragma omp target data device(tables->device)                                  \
+  map(to:cl_tt[0:n_tt],cl_te[0:n_te],cl_ee[0:n_pol],cl_bb[0:n_pol],cl_pp[0:n_l], \
+      sqrt1[0:n_l],sqrt2[0:n_l],sqrt3[0:n_l],sqrt4[0:n_l],sqrt5[0:n_l],          \
+      l_list[0:l_size])                                                        \
+  map(from:Cgl[index_mu_start:n_mu],Cgl2[index_mu_start:n_mu],sigma2[index_mu_start:n_mu]) \
+  map(tofrom:ksi[index_mu_start:n_mu_tt],ksiX[index_mu_start:n_mu_te],          \
+      ksip[index_mu_start:n_mu_pol],ksim[index_mu_start:n_mu_pol],              \
+      cl_lens[0:l_size*lt_size])
+  {
+
+    /** - correlation functions, one value of mu per device thread */
+
+#pragma omp target teams distribute parallel for device(tables->device) is_device_ptr(d) private(row)
+    for (index_mu=index_mu_start; index_mu<index_mu_start+n_mu; index_mu++) {
+
+      row = (size_t)index_mu*(l_max+1);
+
+      lensing_correlation_at_mu(l_max,has_tt,has_te,has_pol,accurate_lensing,
+                                cl_tt,cl_te,cl_ee,cl_bb,cl_pp,
+                                sqrt1,sqrt2,sqrt3,sqrt4,sqrt5,
+                                d+row,d+table_size+row,d+2*table_size+row,d+3*table_size+row,
+                                d+4*table_size+row,d+5*table_size+row,d+6*table_size+row,
+                                d+7*table_size+row,d+8*table_size+row,d+9*table_size+row,
+                                d+10*table_size+row,d+11*table_size+row,
+                                Cgl_at_one,
+                                Cgl+index_mu,Cgl2+index_mu,sigma2+index_mu,
+                                (has_tt==_TRUE_ ? ksi+index_mu : NULL),
+                                (has_te==_TRUE_ ? ksiX+index_mu : NULL),
+                                (has_pol==_TRUE_ ? ksip+index_mu : NULL),
+                                (has_pol==_TRUE_ ? ksim+index_mu : NULL));
+    }
 
-  for (index_l=0; index_l<ple->l_size; index_l++) {
-    l = (int)ple->l[index_l];
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] += cl_tt[l];
+    /** - lensed C_l's, one multipole per device thread (see lensing_lensed_cl_chunk()) */
+
+#pragma omp target teams distribute parallel for device(tables->device) is_device_ptr(d,w8) \
+  private(imu,l,cle,clte,clp,clm)
+    for (index_l=0; index_l<l_size; index_l++) {
+
+      l = (int)l_list[index_l];
+
+      if (has_tt==_TRUE_) {
+        cle=0;
+        for (imu=index_mu_start;imu<index_mu_start+n_mu;imu++) {
+          cle += ksi[imu]*d[(size_t)imu*(l_max+1)+l]*w8[imu];
+        }
+        cl_lens[index_l*lt_size+index_lt_tt]+=cle*2.0*_PI_;
+      }
+
+      if (has_te==_TRUE_) {
+        clte=0;
+        for (imu=index_mu_start;imu<index_mu_start+n_mu;imu++) {
+          clte += ksiX[imu]*d[4*table_size+(size_t)imu*(l_max+1)+l]*w8[imu];
+        }
+        cl_lens[index_l*lt_size+index_lt_te]+=clte*2.0*_PI_;
+      }
+
+      if (has_pol==_TRUE_) {
+        clp=0; clm=0;
+        for (imu=index_mu_start;imu<index_mu_start+n_mu;imu++) {
+          clp += ksip[imu]*d[7*table_size+(size_t)imu*(l_max+1)+l]*w8[imu];
+          clm += ksim[imu]*d[3*table_size+(size_t)imu*(l_max+1)+l]*w8[imu];
+        }
+        cl_lens[index_l*lt_size+index_lt_ee]+=(clp+clm)*_PI_;
+        cl_lens[index_l*lt_size+index_lt_bb]+=(clp-clm)*_PI_;
+      }
+    }
   }
-  return _SUCCESS_;
+#else
+  class_stop(ple->error_message,
+             "the code was compiled without -DCLASS_OFFLOAD (option OFFLOAD of the Makefile)");
+#endif
 
+  return _SUCCESS_;
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine computes the lensed power spectra by Gaussian quadrature,
+ * for all the types (TT, TE, EE, BB) in a single pass over the rows of
+ * \f$ d^l_{mm'} (\mu) \f$.
+ *
+ * The contribution of the quadrature points index_mu_start <= index_mu
+ * < index_mu_start+nmu is added to the values already in ple->cl_lens,
+ * so that the sum can be split into chunks of \f$ \mu \f$ values.
+ * The correlation functions and d-functions of the types that are not
+ * computed are not used (and can be NULL).
  *
- * @param ksiX Input: Lensed correlation function (ksiX[index_mu])
- * @param d20  Input: Wigner d-function (\f$ d^l_{20}\f$[l][index_mu])
- * @param w8   Input: Legendre quadrature weights (w8[index_mu])
- * @param nmu  Input: Number of quadrature points (0<=index_mu<=nmu)
- * @param ple  Input/output: Pointer to the lensing structure
+ * @param ksi            Input: Lensed correlation function (ksi[index_mu])
+ * @param ksiX           Input: Lensed correlation function (ksiX[index_mu])
+ * @param ksip           Input: Lensed correlation function (ksi+[index_mu])
+ * @param ksim           Input: Lensed correlation function (ksi-[index_mu])
+ * @param d00            Input: Legendre polynomials (\f$ d^l_{00}\f$[index_mu][l])
+ * @param d20            Input: Wigner d-function (\f$ d^l_{20}\f$[index_mu][l])
+ * @param d22            Input: Wigner d-function (\f$ d^l_{22}\f$[index_mu][l])
+ * @param d2m2           Input: Wigner d-function (\f$ d^l_{2-2}\f$[index_mu][l])
+ * @param w8             Input: Legendre quadrature weights (w8[index_mu])
+ * @param index_mu_start Input: first quadrature point
+ * @param nmu            Input: Number of quadrature points
+ * @param ple            Input/output: Pointer to the lensing structure
  * @return the error status
  */
 
+int lensing_lensed_cl_chunk(
+                            double *ksi,
+                            double *ksiX,
+                            double *ksip,
+                            double *ksim,
+                            double **d00,
+                            double **d20,
+                            double **d22,
+                            double **d2m2,
+                            double *w8,
+                            int index_mu_start,
+                            int nmu,
+                            struct lensing * ple
+                            ) {
 
-int lensing_lensed_cl_te(
-                         double *ksiX,
-                         double **d20,
-                         double *w8,
-                         int nmu,
-                         struct lensing * ple
-                         ) {
-
-  double clte;
+  double cle, clte, clp, clm;
   int imu;
   int index_l;
+  int l;
 
   /** Integration by Gauss-Legendre quadrature. **/
 #pragma omp parallel for                        \
-  private (imu,index_l,clte)                    \
+  private (imu,index_l,l,cle,clte,clp,clm)      \
   schedule (static)
 
-  for(index_l=0; index_l < ple->l_size; index_l++){
-    clte=0;
-    for (imu=0;imu<nmu;imu++) {
-      clte += ksiX[imu]*d20[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
+  for(index_l=0; index_l<ple->l_size; index_l++){
+
+    class_kernel_start(kernel_lensing_correlation);
+
+    l = (int)ple->l[index_l];
+
+    if (ple->has_tt==_TRUE_) {
+      cle=0;
+      for (imu=index_mu_start;imu<index_mu_start+nmu;imu++) {
+        cle += ksi[imu]*d00[imu][l]*w8[imu];
+      }
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt]+=cle*2.0*_PI_;
+    }
+
+    if (ple->has_te==_TRUE_) {
+      clte=0;
+      for (imu=index_mu_start;imu<index_mu_start+nmu;imu++) {
+        clte += ksiX[imu]*d20[imu][l]*w8[imu];
+      }
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te]+=clte*2.0*_PI_;
+    }
+
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      clp=0; clm=0;
+      for (imu=index_mu_start;imu<index_mu_start+nmu;imu++) {
+        clp += ksip[imu]*d22[imu][l]*w8[imu];
+        clm += ksim[imu]*d2m2[imu][l]*w8[imu];
+      }
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee]+=(clp+clm)*_PI_;
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb]+=(clp-clm)*_PI_;
     }
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te]=clte*2.0*_PI_;
+
+    class_kernel_stop(kernel_lensing_correlation);
   }
 
   return _SUCCESS_;
 }
 
 /**
- * This routine adds back the unlensed \f$ cl_{te}\f$ power spectrum
+ * This routine adds back the unlensed \f$ cl_{tt}\f$ power spectrum
  * Used in case of fast (and BB inaccurate) integration of
  * correlation functions.
  *
  * @param ple   Input/output: Pointer to the lensing structure
- * @param cl_te Input: Array of unlensed power spectrum
+ * @param cl_tt Input: Array of unlensed power spectrum
  * @return the error status
  */
 
-int lensing_addback_cl_te(
+int lensing_addback_cl_tt(
                           struct lensing * ple,
-                          double *cl_te) {
+                          double *cl_tt) {
   int index_l, l;
 
   for (index_l=0; index_l<ple->l_size; index_l++) {
     l = (int)ple->l[index_l];
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] += cl_te[l];
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] += cl_tt[l];
   }
   return _SUCCESS_;
 
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine adds back the unlensed \f$ cl_{te}\f$ power spectrum
+ * Used in case of fast (and BB inaccurate) integration of
+ * correlation functions.
  *
- * @param ksip Input: Lensed correlation function (ksi+[index_mu])
- * @param ksim Input: Lensed correlation function (ksi-[index_mu])
- * @param d22  Input: Wigner d-function (\f$ d^l_{22}\f$[l][index_mu])
- * @param d2m2 Input: Wigner d-function (\f$ d^l_{2-2}\f$[l][index_mu])
- * @param w8   Input: Legendre quadrature weights (w8[index_mu])
- * @param nmu  Input: Number of quadrature points (0<=index_mu<=nmu)
- * @param ple  Input/output: Pointer to the lensing structure
+ * @param ple   Input/output: Pointer to the lensing structure
+ * @param cl_te Input: Array of unlensed power spectrum
  * @return the error status
  */
 
+int lensing_addback_cl_te(
+                          struct lensing * ple,
+                          double *cl_te) {
+  int index_l, l;
 
-int lensing_lensed_cl_ee_bb(
-                            double *ksip,
-                            double *ksim,
-                            double **d22,
-                            double **d2m2,
-                            double *w8,
-                            int nmu,
-                            struct lensing * ple
-                            ) {
-
-  double clp, clm;
-  int imu;
-  int index_l;
-
-  /** Integration by Gauss-Legendre quadrature. **/
-#pragma omp parallel for                        \
-  private (imu,index_l,clp,clm)                 \
-  schedule (static)
-
-  for(index_l=0; index_l < ple->l_size; index_l++){
-    clp=0; clm=0;
-    for (imu=0;imu<nmu;imu++) {
-      clp += ksip[imu]*d22[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
-      clm += ksim[imu]*d2m2[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
-    }
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee]=(clp+clm)*_PI_;
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb]=(clp-clm)*_PI_;
+  for (index_l=0; index_l<ple->l_size; index_l++) {
+    l = (int)ple->l[index_l];
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] += cl_te[l];
   }
-
   return _SUCCESS_;
+
 }
 
 /**
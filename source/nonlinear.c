@@ -13,6 +13,88 @@
 
 #include "nonlinear.h"
 
+/** list of all non-linear engines registered in this process */
+
+static struct nonlinear_engine * nonlinear_engine_list = NULL;
+
+/**
+ * Register a non-linear engine, which can then be selected in the
+ * input with 'non linear = <name>'. The structure is not copied: it
+ * must remain valid as long as it can be used. Registering an engine
+ * with the name of an already registered one replaces it.
+ *
+ * @param pne           Input: pointer to engine with name and callbacks filled
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int nonlinear_engine_register(
+                              struct nonlinear_engine * pne,
+                              ErrorMsg error_message
+                              ) {
+
+  struct nonlinear_engine ** ppne;
+
+  class_test((pne->name == NULL) || (pne->name[0] == '\0'),
+             error_message,
+             "a non-linear engine needs a name");
+
+  class_test((strstr(pne->name,"halofit") != NULL) || (strstr(pne->name,"Halofit") != NULL) || (strstr(pne->name,"HALOFIT") != NULL),
+             error_message,
+             "the name '%s' of a non-linear engine cannot contain 'halofit', which selects the Halofit method",pne->name);
+
+  class_test(pne->compute == NULL,
+             error_message,
+             "the non-linear engine '%s' has no compute() callback",pne->name);
+
+#pragma omp critical (nonlinear_engine_list)
+  {
+    for (ppne = &nonlinear_engine_list; *ppne != NULL; ppne = &((*ppne)->next)) {
+      if (strcmp((*ppne)->name,pne->name) == 0)
+        break;
+    }
+
+    if (*ppne != NULL) {
+      /* replace the engine with the same name */
+      pne->next = (*ppne)->next;
+    }
+    else {
+      pne->next = NULL;
+    }
+    *ppne = pne;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find a registered non-linear engine by its name.
+ *
+ * @param name Input: name of the engine
+ * @param ppne Output: pointer to the engine, or NULL if none has this name
+ * @return the error status
+ */
+
+int nonlinear_engine_find(
+                          char * name,
+                          struct nonlinear_engine ** ppne
+                          ) {
+
+  struct nonlinear_engine * pne;
+
+#pragma omp critical (nonlinear_engine_list)
+  {
+    for (pne = nonlinear_engine_list; pne != NULL; pne = pne->next) {
+      if (strcmp(pne->name,name) == 0)
+        break;
+    }
+  }
+
+  *ppne = pne;
+
+  return _SUCCESS_;
+}
+
 int nonlinear_k_nl_at_z(
                         struct background *pba,
                         struct nonlinear * pnl,
@@ -66,11 +148,19 @@ int nonlinear_init(
   double *lnk_l;
   double *lnpk_l;
   double *ddlnpk_l;
-  short print_warning=_FALSE_;
+  short * halofit_failed;
+  double k_nl_guess;
+  int index_tau_previous;
+  int index_chunk,chunk_number;
+  int abort;
   double * pvecback;
   int last_index;
   double a,z;
 
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(pnl->profile));
+
   /** Summary
    *
    * (a) First deal with the case where non non-linear corrections requested */
@@ -80,13 +170,17 @@ int nonlinear_init(
       printf("No non-linear spectra requested. Nonlinear module skipped.\n");
   }
 
-  /** (b) Compute for HALOFIT non-linear spectrum */
+  /** (b) Compute for HALOFIT non-linear spectrum, or with a registered engine */
 
-  else if (pnl->method == nl_halofit) {
-    if (pnl->nonlinear_verbose > 0)
-      printf("Computing non-linear matter power spectrum with Halofit (including update Takahashi et al. 2012 and Bird 2014)\n");
+  else if ((pnl->method == nl_halofit) || (pnl->method == nl_engine)) {
+    if (pnl->nonlinear_verbose > 0) {
+      if (pnl->method == nl_halofit)
+        printf("Computing non-linear matter power spectrum with Halofit (including update Takahashi et al. 2012 and Bird 2014)\n");
+      else
+        printf("Computing non-linear matter power spectrum with engine '%s'\n",pnl->engine->name);
+    }
 
-    if (pba->has_ncdm) {
+    if ((pnl->method == nl_halofit) && (pba->has_ncdm)) {
       for (index_ncdm=0;index_ncdm < pba->N_ncdm; index_ncdm++){
         if (pba->m_ncdm_in_eV[index_ncdm] >  _M_EV_TOO_BIG_FOR_HALOFIT_)
           fprintf(stdout,"Warning: Halofit is proved to work for CDM, and also with a small HDM component thanks to Bird et al.'s update. But it sounds like you are running with a WDM component of mass %f eV, which makes the use of Halofit suspicious.\n",pba->m_ncdm_in_eV[index_ncdm]);
@@ -108,73 +202,170 @@ int nonlinear_init(
     class_alloc(pnl->nl_corr_density,pnl->tau_size*pnl->k_size*sizeof(double),pnl->error_message);
     class_alloc(pnl->k_nl,pnl->tau_size*sizeof(double),pnl->error_message);
 
-    class_alloc(pk_l,pnl->k_size*sizeof(double),pnl->error_message);
-    class_alloc(pk_nl,pnl->k_size*sizeof(double),pnl->error_message);
+    class_alloc(halofit_failed,pnl->tau_size*sizeof(short),pnl->error_message);
+
+    pnl->sigma_r_size = 0;
+    pnl->engine_workspace = NULL;
 
-    class_alloc(lnk_l,pnl->k_size*sizeof(double),pnl->error_message);
-    class_alloc(lnpk_l,pnl->k_size*sizeof(double),pnl->error_message);
-    class_alloc(ddlnpk_l,pnl->k_size*sizeof(double),pnl->error_message);
+    if (pnl->method == nl_halofit) {
 
-    /** - loop over time */
+      /** - tabulate once for all redshifts the kernels of the integrals giving sigma(R) */
 
-    for (index_tau = pnl->tau_size-1; index_tau>=0; index_tau--) {
+      class_call(nonlinear_halofit_sigma_kernels(ppr,pnl),
+                 pnl->error_message,
+                 pnl->error_message);
+    }
+    else if (pnl->engine->init != NULL) {
 
-      /* get P_L(k) at this time */
-      class_call(nonlinear_pk_l(ppt,ppm,pnl,index_tau,pk_l,lnk_l,lnpk_l,ddlnpk_l),
+      /** - or let the engine prepare its workspace for this run */
+
+      class_call(pnl->engine->init(pnl->engine,ppr,pba,ppt,ppm,pnl,&(pnl->engine_workspace)),
                  pnl->error_message,
                  pnl->error_message);
+    }
 
-      /*
-      for (index_k=0; index_k<pnl->k_size; index_k++) {
-        fprintf(stdout,"%e  %e\n",pnl->k[index_k],pk_l[index_k]);
-      }
-      */
-
-      //class_stop(pnl->error_message,"stop here");
-
-      /* get P_NL(k) at this time */
-      if (nonlinear_halofit(ppr,
-                            pba,
-                            ppm,
-                            pnl,
-                            pnl->tau[index_tau],
-                            pk_l,
-                            pk_nl,
-                            lnk_l,
-                            lnpk_l,
-                            ddlnpk_l,
-                            &(pnl->k_nl[index_tau])) == _SUCCESS_) {
-
-        /*
-          for (index_k=0; index_k<pnl->k_size; index_k++) {
-          fprintf(stdout,"%e  %e  %e\n",pnl->k[index_k],pk_l[index_k],pk_nl[index_k]);
+    /** - loop over time. The values of tau are split in chunks of
+          _HALOFIT_TAU_CHUNK_ consecutive values, distributed over
+          threads. Within a chunk, the loop goes backward in time, so
+          that the search for k_nl can start from the value just found
+          at the previous (lower) redshift; the first value of each
+          chunk is searched in the full range. The chunks do not depend
+          on the number of threads, and neither do the results. */
+
+    /* initialize error management flag */
+    abort = _FALSE_;
+
+    chunk_number = (pnl->tau_size+_HALOFIT_TAU_CHUNK_-1)/_HALOFIT_TAU_CHUNK_;
+
+    /* beginning of parallel region */
+
+#pragma omp parallel                            \
+  shared(ppr,pba,ppt,ppm,pnl,halofit_failed,abort)   \
+  private(index_chunk,index_tau,index_k,pk_l,pk_nl,lnk_l,lnpk_l,ddlnpk_l,k_nl_guess,index_tau_previous) \
+  if ((pnl->method == nl_halofit) || (pnl->engine->is_thread_safe == _TRUE_))
+    {
+
+      /* allocate workspace (one per thread) */
+      class_alloc_parallel(pk_l,pnl->k_size*sizeof(double),pnl->error_message);
+      class_alloc_parallel(pk_nl,pnl->k_size*sizeof(double),pnl->error_message);
+
+      class_alloc_parallel(lnk_l,pnl->k_size*sizeof(double),pnl->error_message);
+      class_alloc_parallel(lnpk_l,pnl->k_size*sizeof(double),pnl->error_message);
+      class_alloc_parallel(ddlnpk_l,pnl->k_size*sizeof(double),pnl->error_message);
+
+#pragma omp for schedule (dynamic,1)
+
+      for (index_chunk = 0; index_chunk < chunk_number; index_chunk++) {
+
+        index_tau_previous = -1;
+
+        for (index_tau = pnl->tau_size-1-index_chunk*_HALOFIT_TAU_CHUNK_;
+             index_tau >= MAX(pnl->tau_size-(index_chunk+1)*_HALOFIT_TAU_CHUNK_,0);
+             index_tau--) {
+
+          /* get P_L(k) at this time */
+          class_call_parallel(nonlinear_pk_l(ppt,ppm,pnl,index_tau,pk_l,lnk_l,lnpk_l,ddlnpk_l),
+                              pnl->error_message,
+                              pnl->error_message);
+
+          if (abort == _TRUE_) continue;
+
+          /* with an engine */
+          if (pnl->method == nl_engine) {
+
+            class_call_parallel(pnl->engine->compute(pnl->engine,
+                                                     pnl->engine_workspace,
+                                                     pnl,
+                                                     index_tau,
+                                                     pk_l,
+                                                     pk_nl,
+                                                     &(pnl->k_nl[index_tau])),
+                                pnl->error_message,
+                                pnl->error_message);
+
+            halofit_failed[index_tau] = _FALSE_;
+
+            for (index_k=0; index_k<pnl->k_size; index_k++) {
+              pnl->nl_corr_density[index_tau * pnl->k_size + index_k] = sqrt(pk_nl[index_k]/pk_l[index_k]);
+            }
           }
-          fprintf(stdout,"\n\n");
-        */
 
-        for (index_k=0; index_k<pnl->k_size; index_k++) {
-          pnl->nl_corr_density[index_tau * pnl->k_size + index_k] = sqrt(pk_nl[index_k]/pk_l[index_k]);
-        }
-      }
-      else {
-        /* when Halofit failed, use 1 as the non-linear correction, and print a warning */
-        for (index_k=0; index_k<pnl->k_size; index_k++) {
-          pnl->nl_corr_density[index_tau * pnl->k_size + index_k] = 1.;
-        }
-        if ((pnl->nonlinear_verbose > 0) && (print_warning == _FALSE_)) {
-          class_alloc(pvecback,pba->bg_size*sizeof(double),pnl->error_message);
-          class_call(background_at_tau(pba,pnl->tau[index_tau],pba->short_info,pba->inter_normal,&last_index,pvecback),
-                     pba->error_message,
-                     pnl->error_message);
-          a = pvecback[pba->index_bg_a];
-          z = pba->a_today/a-1.;
-          fprintf(stdout,
-                  " -> [WARNING:] Halofit non-linear corrections could not be computed at redshift z=%5.2f and higher.\n    This is probably because k_max is too small for Halofit to be able to compute the scale k_NL at this redshift.\n    If non-linear corrections at such high redshift really matter for you,\n    just try to increase P_k_max_h/Mpc or P_k_max_1/Mpc until reaching desired z.\n",
-                  z);
-          free(pvecback);
-        }
-        print_warning = _TRUE_;
-      }
+          /* with Halofit */
+          else {
+
+            /* use as a guess the value of k_nl found at the previous redshift of this chunk, if any */
+            if ((index_tau_previous == index_tau+1) && (halofit_failed[index_tau_previous] == _FALSE_))
+              k_nl_guess = pnl->k_nl[index_tau_previous];
+            else
+              k_nl_guess = 0.;
+
+            /* get P_NL(k) at this time */
+            if (nonlinear_halofit(ppr,
+                                  pba,
+                                  ppm,
+                                  pnl,
+                                  pnl->tau[index_tau],
+                                  pk_l,
+                                  pk_nl,
+                                  lnk_l,
+                                  lnpk_l,
+                                  ddlnpk_l,
+                                  k_nl_guess,
+                                  &(pnl->k_nl[index_tau])) == _SUCCESS_) {
+
+              halofit_failed[index_tau] = _FALSE_;
+
+              for (index_k=0; index_k<pnl->k_size; index_k++) {
+                pnl->nl_corr_density[index_tau * pnl->k_size + index_k] = sqrt(pk_nl[index_k]/pk_l[index_k]);
+              }
+            }
+            else {
+              /* when Halofit failed, use 1 as the non-linear correction */
+              halofit_failed[index_tau] = _TRUE_;
+
+              for (index_k=0; index_k<pnl->k_size; index_k++) {
+                pnl->nl_corr_density[index_tau * pnl->k_size + index_k] = 1.;
+              }
+            }
+
+            index_tau_previous = index_tau;
+          }
+
+#pragma omp flush(abort)
+
+        } /* end of loop over time within a chunk */
+
+      } /* end of loop over chunks */
+
+      free(pk_l);
+      free(pk_nl);
+
+      free(lnk_l);
+      free(lnpk_l);
+      free(ddlnpk_l);
+
+    } /* end of parallel region */
+
+    if (abort == _TRUE_) return _FAILURE_;
+
+    /** - print a warning for the lowest redshift at which Halofit failed (it then usually fails at all higher redshifts) */
+
+    for (index_tau = pnl->tau_size-1; index_tau>=0; index_tau--) {
+      if (halofit_failed[index_tau] == _TRUE_)
+        break;
+    }
+
+    if ((pnl->nonlinear_verbose > 0) && (index_tau >= 0)) {
+      class_alloc(pvecback,pba->bg_size*sizeof(double),pnl->error_message);
+      class_call(background_at_tau(pba,pnl->tau[index_tau],pba->short_info,pba->inter_normal,&last_index,pvecback),
+                 pba->error_message,
+                 pnl->error_message);
+      a = pvecback[pba->index_bg_a];
+      z = pba->a_today/a-1.;
+      fprintf(stdout,
+              " -> [WARNING:] Halofit non-linear corrections could not be computed at redshift z=%5.2f and higher.\n    This is probably because k_max is too small for Halofit to be able to compute the scale k_NL at this redshift.\n    If non-linear corrections at such high redshift really matter for you,\n    just try to increase P_k_max_h/Mpc or P_k_max_1/Mpc until reaching desired z.\n",
+              z);
+      free(pvecback);
     }
 
     /*
@@ -186,12 +377,7 @@ int nonlinear_init(
     }
     */
 
-    free(pk_l);
-    free(pk_nl);
-
-    free(lnk_l);
-    free(lnpk_l);
-    free(ddlnpk_l);
+    free(halofit_failed);
   }
 
   else {
@@ -199,6 +385,7 @@ int nonlinear_init(
                "Your non-linear method variable is set to %d, out of the range defined in nonlinear.h",pnl->method);
   }
 
+  class_profile_stop(&(pnl->profile));
   return _SUCCESS_;
 }
 
@@ -208,12 +395,22 @@ int nonlinear_free(
 
   if (pnl->method > nl_none) {
 
-    if (pnl->method == nl_halofit) {
+    if ((pnl->method == nl_halofit) || (pnl->method == nl_engine)) {
       /* free here */
       free(pnl->k);
       free(pnl->tau);
       free(pnl->nl_corr_density);
       free(pnl->k_nl);
+      if (pnl->sigma_r_size > 0) {
+        free(pnl->sigma_logr);
+        free(pnl->sigma_kernel);
+      }
+    }
+
+    if ((pnl->method == nl_engine) && (pnl->engine->free != NULL)) {
+      class_call(pnl->engine->free(pnl->engine,pnl->engine_workspace,pnl),
+                 pnl->error_message,
+                 pnl->error_message);
     }
   }
 
@@ -235,21 +432,25 @@ int nonlinear_pk_l(
   int index_k;
   int index_ic1,index_ic2,index_ic1_ic2;
   double * primordial_pk;
+  double * pk_primordial;
   double source_ic1,source_ic2;
 
   index_md = ppt->index_md_scalars;
 
-  class_alloc(primordial_pk,ppm->ic_ic_size[index_md]*sizeof(double),pnl->error_message);
+  class_alloc(primordial_pk,pnl->k_size*ppm->ic_ic_size[index_md]*sizeof(double),pnl->error_message);
+
+  class_call(primordial_spectrum_at_k_vector(ppm,
+                                             index_md,
+                                             linear,
+                                             pnl->k,
+                                             pnl->k_size,
+                                             primordial_pk),
+             ppm->error_message,
+             pnl->error_message);
 
   for (index_k=0; index_k<pnl->k_size; index_k++) {
 
-    class_call(primordial_spectrum_at_k(ppm,
-                                        index_md,
-                                        linear,
-                                        pnl->k[index_k],
-                                        primordial_pk),
-               ppm->error_message,
-               pnl->error_message);
+    pk_primordial = primordial_pk+index_k*ppm->ic_ic_size[index_md];
 
     pk_l[index_k] = 0;
 
@@ -260,11 +461,11 @@ int nonlinear_pk_l(
 
       source_ic1 = ppt->sources[index_md]
         [index_ic1 * ppt->tp_size[index_md] + ppt->index_tp_delta_m]
-        [index_tau * ppt->k_size[index_md] + index_k];
+        [_source_index_(index_tau,index_k)];
 
       pk_l[index_k] += 2.*_PI_*_PI_/pow(pnl->k[index_k],3)
         *source_ic1*source_ic1
-        *primordial_pk[index_ic1_ic2];
+        *pk_primordial[index_ic1_ic2];
     }
 
     /* part non-diagonal in initial conditions */
@@ -277,15 +478,15 @@ int nonlinear_pk_l(
 
           source_ic1 = ppt->sources[index_md]
             [index_ic1 * ppt->tp_size[index_md] + ppt->index_tp_delta_m]
-            [index_tau * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau,index_k)];
 
           source_ic2 = ppt->sources[index_md]
             [index_ic2 * ppt->tp_size[index_md] + ppt->index_tp_delta_m]
-            [index_tau * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau,index_k)];
 
           pk_l[index_k] += 2.*2.*_PI_*_PI_/pow(pnl->k[index_k],3)
             *source_ic1*source_ic2
-            *primordial_pk[index_ic1_ic2]; // extra 2 factor (to include the symmetric term ic2,ic1)
+            *pk_primordial[index_ic1_ic2]; // extra 2 factor (to include the symmetric term ic2,ic1)
 
         }
       }
@@ -311,6 +512,352 @@ int nonlinear_pk_l(
 
 }
 
+/**
+ * Weights w_i such that the integral computed by
+ * array_integrate_all_spline() after array_spline() in natural mode
+ * is \f$ \sum_i w_i y_i \f$.
+ *
+ * The second derivatives are y''=A^{-1} B y, with A the symmetric
+ * tridiagonal matrix of the natural spline and B the matrix of finite
+ * differences. The integral is t.y + c.y'', so that w = t + B^T z
+ * with A z = c. This costs one tridiagonal solve.
+ *
+ * @param pnl    Input: pointer to nonlinear structure (for error message)
+ * @param x      Input: abscissa, of size x_size >= 3, increasing
+ * @param x_size Input: number of values
+ * @param weight Output: quadrature weights
+ * @return the error status
+ */
+
+int nonlinear_spline_quadrature_weights(
+                                        struct nonlinear *pnl,
+                                        double *x,
+                                        int x_size,
+                                        double *weight
+                                        ) {
+
+  int i;
+  double *h;
+  double *z;
+  double *diag;
+  double factor;
+
+  class_test(x_size < 3,
+             pnl->error_message,
+             "needs at least 3 values, got %d",x_size);
+
+  class_alloc(h,(x_size-1)*sizeof(double),pnl->error_message);
+  class_calloc(z,x_size,sizeof(double),pnl->error_message);
+  class_alloc(diag,x_size*sizeof(double),pnl->error_message);
+
+  for (i=0; i<x_size-1; i++)
+    h[i] = x[i+1]-x[i];
+
+  /* trapezoidal part t, and right-hand side c (coefficient of y''_i
+     in the quadrature, with y'' vanishing at both ends) */
+  for (i=0; i<x_size; i++) {
+    weight[i] = 0.;
+    if (i > 0) weight[i] += h[i-1]/2.;
+    if (i < x_size-1) weight[i] += h[i]/2.;
+  }
+  for (i=1; i<x_size-1; i++)
+    z[i] = (h[i-1]*h[i-1]*h[i-1]+h[i]*h[i]*h[i])/24.;
+
+  /* solve A z = c for the interior points, with A_{i,i-1} = h_{i-1}/6,
+     A_{i,i} = (h_{i-1}+h_i)/3, A_{i,i+1} = h_i/6 (Thomas algorithm) */
+  diag[1] = (h[0]+h[1])/3.;
+  for (i=2; i<x_size-1; i++) {
+    factor = h[i-1]/6./diag[i-1];
+    diag[i] = (h[i-1]+h[i])/3. - factor*h[i-1]/6.;
+    z[i] -= factor*z[i-1];
+  }
+  z[x_size-2] /= diag[x_size-2];
+  for (i=x_size-3; i>=1; i--)
+    z[i] = (z[i] - h[i]/6.*z[i+1])/diag[i];
+
+  /* add B^T z, with (B y)_i = (y_{i+1}-y_i)/h_i - (y_i-y_{i-1})/h_{i-1} */
+  for (i=1; i<x_size-1; i++) {
+    weight[i-1] += z[i]/h[i-1];
+    weight[i]   -= z[i]*(1./h[i-1]+1./h[i]);
+    weight[i+1] += z[i]/h[i];
+  }
+
+  free(h);
+  free(z);
+  free(diag);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Tabulate the kernels of the three Gaussian-filtered integrals of
+ * halofit (sum1, sum2, sum3 in nonlinear_halofit()) on a logarithmic
+ * grid of radii between the smallest radius for which sigma(R) is
+ * converged and 1/halofit_min_k_nonlinear.
+ *
+ * The integrals are computed with the natural spline quadrature of
+ * array_integrate_all_spline(), which is linear in the integrand. Its
+ * weights are multiplied once by the kernels. At each redshift, each
+ * integral is then a plain sum over the linear P(k), without any call
+ * to exp().
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pnl Input/Output: pointer to nonlinear structure
+ * @return the error status
+ */
+
+int nonlinear_halofit_sigma_kernels(
+                                    struct precision *ppr,
+                                    struct nonlinear *pnl
+                                    ) {
+
+  int index_k,index_r;
+  double *k_array;
+  double *weight;
+  double k,x2,R,kernel;
+  double xlogr_min,xlogr_max;
+  double anorm = 1./(2*pow(_PI_,2));
+
+  pnl->sigma_r_size = 0;
+
+  if (ppr->halofit_r_per_decade <= 0.)
+    return _SUCCESS_;
+
+  /* same sampling in k as the integrand array of nonlinear_halofit() */
+  pnl->sigma_k_size=(int)(log(pnl->k[pnl->k_size-1]/pnl->k[0])/log(10.)*ppr->halofit_k_per_decade)+1;
+
+  /* same range in R as the bisection of nonlinear_halofit() */
+  xlogr_min = log10(sqrt(-log(ppr->halofit_sigma_precision))
+                    /(pnl->k[0]*pow(10.,(pnl->sigma_k_size-1)/ppr->halofit_k_per_decade)));
+  xlogr_max = log10(1./ppr->halofit_min_k_nonlinear);
+
+  /* empty range: leave the errors to the bisection of nonlinear_halofit() */
+  if (xlogr_max <= xlogr_min)
+    return _SUCCESS_;
+
+  pnl->sigma_r_size = (int)ceil((xlogr_max-xlogr_min)*ppr->halofit_r_per_decade)+1;
+
+  class_alloc(pnl->sigma_logr,pnl->sigma_r_size*sizeof(double),pnl->error_message);
+  class_alloc(pnl->sigma_kernel,pnl->sigma_r_size*3*pnl->sigma_k_size*sizeof(double),pnl->error_message);
+
+  for (index_r=0; index_r<pnl->sigma_r_size; index_r++)
+    pnl->sigma_logr[index_r] = xlogr_min + (xlogr_max-xlogr_min)*index_r/(pnl->sigma_r_size-1);
+
+  /* values of k and quadrature weights */
+  class_alloc(k_array,pnl->sigma_k_size*sizeof(double),pnl->error_message);
+  class_alloc(weight,pnl->sigma_k_size*sizeof(double),pnl->error_message);
+
+  for (index_k=0; index_k<pnl->sigma_k_size; index_k++)
+    k_array[index_k] = pnl->k[0]*pow(10.,index_k/ppr->halofit_k_per_decade);
+
+  class_call(nonlinear_spline_quadrature_weights(pnl,k_array,pnl->sigma_k_size,weight),
+             pnl->error_message,
+             pnl->error_message);
+
+  for (index_r=0; index_r<pnl->sigma_r_size; index_r++) {
+
+    R = pow(10.,pnl->sigma_logr[index_r]);
+
+    for (index_k=0; index_k<pnl->sigma_k_size; index_k++) {
+
+      k = k_array[index_k];
+      x2 = k*k*R*R;
+      kernel = weight[index_k]*k*k*anorm*exp(-x2);
+
+      pnl->sigma_kernel[(index_r*3+0)*pnl->sigma_k_size+index_k] = kernel;
+      pnl->sigma_kernel[(index_r*3+1)*pnl->sigma_k_size+index_k] = kernel*2.*x2;
+      pnl->sigma_kernel[(index_r*3+2)*pnl->sigma_k_size+index_k] = kernel*4.*x2*(1.-x2);
+    }
+  }
+
+  free(weight);
+  free(k_array);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute at one redshift, on the grid of radii of the tabulated
+ * kernels, the quantities \f$ \ln \sigma^2 \f$, d1 and d2 of
+ * nonlinear_halofit(), and spline them in \f$ \log_{10} R \f$.
+ *
+ * @param pnl             Input: pointer to nonlinear structure
+ * @param integrand_array Input: array of k and P(k) sampled like the kernels
+ * @param ia_size         Input: number of columns
+ * @param index_ia_pk     Input: index of column containing P(k)
+ * @param sigma_table     Output: sigma_table[index_r*3+index], with index 0, 1, 2 for \f$ \ln \sigma^2 \f$, d1, d2
+ * @param ddsigma_table   Output: second derivatives of the previous table
+ * @return the error status
+ */
+
+int nonlinear_halofit_sigma_table(
+                                  struct nonlinear *pnl,
+                                  double *integrand_array,
+                                  int ia_size,
+                                  int index_ia_pk,
+                                  double *sigma_table,
+                                  double *ddsigma_table
+                                  ) {
+
+  int index_k,index_r;
+  double sum1,sum2,sum3,pk;
+  double *kernel1,*kernel2,*kernel3;
+
+  for (index_r=0; index_r<pnl->sigma_r_size; index_r++) {
+
+    kernel1 = pnl->sigma_kernel+(index_r*3+0)*pnl->sigma_k_size;
+    kernel2 = pnl->sigma_kernel+(index_r*3+1)*pnl->sigma_k_size;
+    kernel3 = pnl->sigma_kernel+(index_r*3+2)*pnl->sigma_k_size;
+
+    sum1=0.;
+    sum2=0.;
+    sum3=0.;
+
+    for (index_k=0; index_k<pnl->sigma_k_size; index_k++) {
+      pk = integrand_array[index_k*ia_size + index_ia_pk];
+      sum1 += kernel1[index_k]*pk;
+      sum2 += kernel2[index_k]*pk;
+      sum3 += kernel3[index_k]*pk;
+    }
+
+    class_test(sum1 <= 0.,
+               pnl->error_message,
+               "sigma(R) vanishes at R=%e Mpc",pow(10.,pnl->sigma_logr[index_r]));
+
+    sigma_table[index_r*3+0] = log(sum1);
+    sigma_table[index_r*3+1] = -sum2/sum1;
+    sigma_table[index_r*3+2] = -sum2*sum2/sum1/sum1 - sum3/sum1;
+  }
+
+  class_call(array_spline_table_lines(pnl->sigma_logr,
+                                      pnl->sigma_r_size,
+                                      sigma_table,
+                                      3,
+                                      ddsigma_table,
+                                      _SPLINE_EST_DERIV_,
+                                      pnl->error_message),
+             pnl->error_message,
+             pnl->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Interpolate \f$ \sigma(R) \f$, d1 and d2 in the table filled by
+ * nonlinear_halofit_sigma_table().
+ *
+ * @param pnl           Input: pointer to nonlinear structure
+ * @param sigma_table   Input: table of \f$ \ln \sigma^2 \f$, d1, d2
+ * @param ddsigma_table Input: its second derivatives
+ * @param xlogr         Input: \f$ \log_{10} R \f$, with R in Mpc
+ * @param last_index    Input/Output: index of the last interval used
+ * @param sigma         Output: \f$ \sigma(R) \f$
+ * @param d1            Output: d1 (can be NULL)
+ * @param d2            Output: d2 (can be NULL)
+ * @return the error status
+ */
+
+int nonlinear_halofit_sigma_interpolate(
+                                        struct nonlinear *pnl,
+                                        double *sigma_table,
+                                        double *ddsigma_table,
+                                        double xlogr,
+                                        int *last_index,
+                                        double *sigma,
+                                        double *d1,
+                                        double *d2
+                                        ) {
+
+  double result[3];
+
+  class_call(array_interpolate_spline(pnl->sigma_logr,
+                                      pnl->sigma_r_size,
+                                      sigma_table,
+                                      ddsigma_table,
+                                      3,
+                                      xlogr,
+                                      last_index,
+                                      result,
+                                      3,
+                                      pnl->error_message),
+             pnl->error_message,
+             pnl->error_message);
+
+  *sigma = exp(0.5*result[0]);
+  if (d1 != NULL) *d1 = result[1];
+  if (d2 != NULL) *d2 = result[2];
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute \f$ \sigma(R) \f$ with a Gaussian window, by integrating
+ * over the linear spectrum tabulated in the integrand array of
+ * nonlinear_halofit().
+ *
+ * @param pnl             Input: pointer to nonlinear structure (for error message)
+ * @param integrand_array Input/Output: array of k, P(k) and workspace columns
+ * @param integrand_size  Input: number of lines
+ * @param ia_size         Input: number of columns
+ * @param index_ia_k      Input: index of column containing k
+ * @param index_ia_pk     Input: index of column containing P(k)
+ * @param index_ia_sum    Input: index of workspace column for the integrand
+ * @param index_ia_ddsum  Input: index of workspace column for its second derivative
+ * @param R               Input: radius in Mpc
+ * @param sigma           Output: \f$ \sigma(R) \f$
+ * @return the error status
+ */
+
+int nonlinear_halofit_sigma(
+                            struct nonlinear *pnl,
+                            double *integrand_array,
+                            int integrand_size,
+                            int ia_size,
+                            int index_ia_k,
+                            int index_ia_pk,
+                            int index_ia_sum,
+                            int index_ia_ddsum,
+                            double R,
+                            double *sigma
+                            ) {
+
+  int index_k;
+  double x2,sum;
+  double anorm = 1./(2*pow(_PI_,2));
+
+  for (index_k=0; index_k < integrand_size; index_k++) {
+    x2 = pow(integrand_array[index_k*ia_size + index_ia_k]*R,2);
+    integrand_array[index_k*ia_size + index_ia_sum] = integrand_array[index_k*ia_size + index_ia_pk]
+      *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*exp(-x2);
+  }
+  /* fill in second derivatives */
+  class_call(array_spline(integrand_array,
+                          ia_size,
+                          integrand_size,
+                          index_ia_k,
+                          index_ia_sum,
+                          index_ia_ddsum,
+                          _SPLINE_EST_DERIV_,
+                          pnl->error_message),
+             pnl->error_message,
+             pnl->error_message);
+  /* integrate */
+  class_call(array_integrate_all_spline(integrand_array,
+                                        ia_size,
+                                        integrand_size,
+                                        index_ia_k,
+                                        index_ia_sum,
+                                        index_ia_ddsum,
+                                        &sum,
+                                        pnl->error_message),
+             pnl->error_message,
+             pnl->error_message);
+
+  *sigma = sqrt(sum);
+
+  return _SUCCESS_;
+}
+
 int nonlinear_halofit(
                       struct precision *ppr,
                       struct background *pba,
@@ -322,6 +869,7 @@ int nonlinear_halofit(
                       double *lnk_l,
                       double *lnpk_l,
                       double *ddlnpk_l,
+                      double k_nl_guess,
                       double *k_nl
                       ) {
 
@@ -362,7 +910,11 @@ int nonlinear_halofit(
   double k_integrand;
   double lnpk_integrand;
 
-  double x2,R;
+  double x2;
+  double R_min,R_max,xlogr_min,xlogr_max;
+  short bracketed;
+  double *sigma_table;
+  double *ddsigma_table;
 
   class_alloc(pvecback,pba->bg_size*sizeof(double),pnl->error_message);
 
@@ -433,183 +985,234 @@ int nonlinear_halofit(
   Omega_m = pvecback[pba->index_bg_Omega_m];
   Omega_v = 1.-pvecback[pba->index_bg_Omega_m]-pvecback[pba->index_bg_Omega_r];
 
-  /* minimum value of R such that the integral giving sigma_R is converged */
-  R=sqrt(-log(ppr->halofit_sigma_precision))/integrand_array[(integrand_size-1)*ia_size + index_ia_k];
+  /* these tables remain NULL when the kernels are not tabulated */
+  sigma_table = NULL;
+  ddsigma_table = NULL;
 
-  /* corresponding value of sigma_R */
-  sum1=0.;
-  for (index_k=0; index_k < integrand_size; index_k++) {
-    x2 = pow(integrand_array[index_k*ia_size + index_ia_k]*R,2);
-    integrand_array[index_k*ia_size + index_ia_sum1] = integrand_array[index_k*ia_size + index_ia_pk]
-      *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*exp(-x2);
+  if (pnl->sigma_r_size > 0) {
+
+    /* sigma(R), d1 and d2 on the grid of radii of the tabulated kernels */
+    class_test_except(integrand_size != pnl->sigma_k_size,
+                      pnl->error_message,
+                      free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table),
+                      "sampling of the sigma integrals (%d values of k) differs from that of the tabulated kernels (%d)",
+                      integrand_size,pnl->sigma_k_size);
+
+    class_alloc(sigma_table,3*pnl->sigma_r_size*sizeof(double),pnl->error_message);
+    class_alloc(ddsigma_table,3*pnl->sigma_r_size*sizeof(double),pnl->error_message);
+
+    class_call_except(nonlinear_halofit_sigma_table(pnl,integrand_array,ia_size,index_ia_pk,sigma_table,ddsigma_table),
+                      pnl->error_message,
+                      pnl->error_message,
+                      free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
+
+    xlogr_min = pnl->sigma_logr[0];
+    xlogr_max = pnl->sigma_logr[pnl->sigma_r_size-1];
+    R_min = pow(10.,xlogr_min);
+    R_max = pow(10.,xlogr_max);
   }
-  /* fill in second derivatives */
-  class_call(array_spline(integrand_array,
-                          ia_size,
-                          integrand_size,
-                          index_ia_k,
-                          index_ia_sum1,
-                          index_ia_ddsum1,
-                          _SPLINE_EST_DERIV_,
-                          pnl->error_message),
-             pnl->error_message,
-             pnl->error_message);
-  /* integrate */
-  class_call(array_integrate_all_spline(integrand_array,
-                                        ia_size,
-                                        integrand_size,
-                                        index_ia_k,
-                                        index_ia_sum1,
-                                        index_ia_ddsum1,
-                                        &sum1,
-                                        pnl->error_message),
-             pnl->error_message,
-             pnl->error_message);
-  sigma  = sqrt(sum1);
+  else {
+
+    /* minimum value of R such that the integral giving sigma_R is converged */
+    R_min=sqrt(-log(ppr->halofit_sigma_precision))/integrand_array[(integrand_size-1)*ia_size + index_ia_k];
+    xlogr_min = log(R_min)/log(10.);
 
-  class_test_except(sigma < 1.,
-                    pnl->error_message,
-                    free(pvecback);free(integrand_array),
-                    "Your k_max=%g 1/Mpc is too small for Halofit to find the non-linearity scale z_nl at z=%g. Increase input parameter P_k_max_h/Mpc or P_k_max_1/Mpc",
-                    pnl->k[pnl->k_size-1],
-                    pba->a_today/pvecback[pba->index_bg_a]-1.);
+    /* maximum value of R in the bisection algorithm leading to the determination of R_nl */
+    R_max=1./ppr->halofit_min_k_nonlinear;
+    xlogr_max = log(R_max)/log(10.);
+  }
 
-  xlogr1 = log(R)/log(10.);
+  last_index = 0;
 
-  /* maximum value of R in the bisection algorithm leading to the determination of R_nl */
-  R=1./ppr->halofit_min_k_nonlinear;
+  /* when a guess is available (typically the value found at a
+     neighbouring redshift), first try a narrow bracket around it; the
+     bisection then needs fewer iterations to reach the same
+     tolerance. If the root is not inside this bracket, fall back to
+     the full one. */
+  bracketed = _FALSE_;
 
-  /* corresponding value of sigma_R */
-  sum1=0.;
-  for (index_k=0; index_k < integrand_size; index_k++) {
-    x2 = pow(integrand_array[index_k*ia_size + index_ia_k]*R,2);
-    integrand_array[index_k*ia_size + index_ia_sum1] = integrand_array[index_k*ia_size + index_ia_pk]
-      *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*exp(-x2);
+  if ((k_nl_guess > 0.) && (ppr->halofit_k_nl_bracket > 0.)) {
+
+    xlogr1 = MAX(log10(1./k_nl_guess)-ppr->halofit_k_nl_bracket,xlogr_min);
+    xlogr2 = MIN(log10(1./k_nl_guess)+ppr->halofit_k_nl_bracket,xlogr_max);
+
+    if (pnl->sigma_r_size > 0) {
+      class_call_except(nonlinear_halofit_sigma_interpolate(pnl,sigma_table,ddsigma_table,xlogr1,&last_index,&sigma,NULL,NULL),
+                        pnl->error_message,
+                        pnl->error_message,
+                        free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
+    }
+    else {
+      class_call_except(nonlinear_halofit_sigma(pnl,integrand_array,integrand_size,ia_size,index_ia_k,index_ia_pk,index_ia_sum1,index_ia_ddsum1,pow(10.,xlogr1),&sigma),
+                        pnl->error_message,
+                        pnl->error_message,
+                        free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
+    }
+
+    if (sigma > 1.) {
+
+      if (pnl->sigma_r_size > 0) {
+        class_call_except(nonlinear_halofit_sigma_interpolate(pnl,sigma_table,ddsigma_table,xlogr2,&last_index,&sigma,NULL,NULL),
+                          pnl->error_message,
+                          pnl->error_message,
+                          free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
+      }
+      else {
+        class_call_except(nonlinear_halofit_sigma(pnl,integrand_array,integrand_size,ia_size,index_ia_k,index_ia_pk,index_ia_sum1,index_ia_ddsum1,pow(10.,xlogr2),&sigma),
+                          pnl->error_message,
+                          pnl->error_message,
+                          free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
+      }
+
+      if (sigma < 1.)
+        bracketed = _TRUE_;
+    }
   }
-  /* fill in second derivatives */
-  class_call(array_spline(integrand_array,
-                          ia_size,
-                          integrand_size,
-                          index_ia_k,
-                          index_ia_sum1,
-                          index_ia_ddsum1,
-                          _SPLINE_EST_DERIV_,
-                          pnl->error_message),
-             pnl->error_message,
-             pnl->error_message);
-  /* integrate */
-  class_call(array_integrate_all_spline(integrand_array,
-                                        ia_size,
-                                        integrand_size,
-                                        index_ia_k,
-                                        index_ia_sum1,
-                                        index_ia_ddsum1,
-                                        &sum1,
-                                        pnl->error_message),
-             pnl->error_message,
-             pnl->error_message);
-  sigma  = sqrt(sum1);
 
-  class_test_except(sigma > 1.,
-                    pnl->error_message,
-                    free(pvecback);free(integrand_array),
-                    "Your input value for the precision parameter halofit_min_k_nonlinear=%e is too large, the non-linear wavenumber k_nl must be smaller than that",
-                    ppr->halofit_min_k_nonlinear);
+  if (bracketed == _FALSE_) {
+
+    /* corresponding value of sigma_R */
+    if (pnl->sigma_r_size > 0) {
+      sigma = exp(0.5*sigma_table[0]);
+    }
+    else {
+      class_call_except(nonlinear_halofit_sigma(pnl,integrand_array,integrand_size,ia_size,index_ia_k,index_ia_pk,index_ia_sum1,index_ia_ddsum1,R_min,&sigma),
+                        pnl->error_message,
+                        pnl->error_message,
+                        free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
+    }
+
+    class_test_except(sigma < 1.,
+                      pnl->error_message,
+                      free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table),
+                      "Your k_max=%g 1/Mpc is too small for Halofit to find the non-linearity scale z_nl at z=%g. Increase input parameter P_k_max_h/Mpc or P_k_max_1/Mpc",
+                      pnl->k[pnl->k_size-1],
+                      pba->a_today/pvecback[pba->index_bg_a]-1.);
+
+    xlogr1 = xlogr_min;
+
+    /* corresponding value of sigma_R */
+    if (pnl->sigma_r_size > 0) {
+      sigma = exp(0.5*sigma_table[(pnl->sigma_r_size-1)*3]);
+    }
+    else {
+      class_call_except(nonlinear_halofit_sigma(pnl,integrand_array,integrand_size,ia_size,index_ia_k,index_ia_pk,index_ia_sum1,index_ia_ddsum1,R_max,&sigma),
+                        pnl->error_message,
+                        pnl->error_message,
+                        free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
+    }
+
+    class_test_except(sigma > 1.,
+                      pnl->error_message,
+                      free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table),
+                      "Your input value for the precision parameter halofit_min_k_nonlinear=%e is too large, the non-linear wavenumber k_nl must be smaller than that",
+                      ppr->halofit_min_k_nonlinear);
 
-  xlogr2 = log(R)/log(10.);
+    xlogr2 = xlogr_max;
+  }
 
   counter = 0;
   do {
     rmid = pow(10,(xlogr2+xlogr1)/2.0);
     counter ++;
 
-    /* in original halofit, this is the function wint() */
-    sum1=0.;
-    sum2=0.;
-    sum3=0.;
+    if (pnl->sigma_r_size > 0) {
 
-    for (index_k=0; index_k < integrand_size; index_k++) {
-      x2 = pow(integrand_array[index_k*ia_size + index_ia_k],2)*rmid*rmid;
-      integrand_array[index_k*ia_size + index_ia_sum1] = integrand_array[index_k*ia_size + index_ia_pk]
-        *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*exp(-x2);
-      integrand_array[index_k*ia_size + index_ia_sum2] = integrand_array[index_k*ia_size + index_ia_pk]
-        *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*2.*x2*exp(-x2);
-      integrand_array[index_k*ia_size + index_ia_sum3] = integrand_array[index_k*ia_size + index_ia_pk]
-        *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*4.*x2*(1.-x2)*exp(-x2);
+      /* interpolate the values tabulated at this redshift */
+      class_call_except(nonlinear_halofit_sigma_interpolate(pnl,sigma_table,ddsigma_table,(xlogr2+xlogr1)/2.0,&last_index,&sigma,&d1,&d2),
+                        pnl->error_message,
+                        pnl->error_message,
+                        free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table));
     }
+    else {
+      /* in original halofit, this is the function wint() */
+      sum1=0.;
+      sum2=0.;
+      sum3=0.;
+
+      for (index_k=0; index_k < integrand_size; index_k++) {
+        x2 = pow(integrand_array[index_k*ia_size + index_ia_k],2)*rmid*rmid;
+        integrand_array[index_k*ia_size + index_ia_sum1] = integrand_array[index_k*ia_size + index_ia_pk]
+          *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*exp(-x2);
+        integrand_array[index_k*ia_size + index_ia_sum2] = integrand_array[index_k*ia_size + index_ia_pk]
+          *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*2.*x2*exp(-x2);
+        integrand_array[index_k*ia_size + index_ia_sum3] = integrand_array[index_k*ia_size + index_ia_pk]
+          *pow(integrand_array[index_k*ia_size + index_ia_k],2)*anorm*4.*x2*(1.-x2)*exp(-x2);
+      }
 
-    /* fill in second derivatives */
-    class_call(array_spline(integrand_array,
-                            ia_size,
-                            integrand_size,
-                            index_ia_k,
-                            index_ia_sum1,
-                            index_ia_ddsum1,
-                            _SPLINE_NATURAL_,
-                            pnl->error_message),
-               pnl->error_message,
-               pnl->error_message);
+      /* fill in second derivatives */
+      class_call(array_spline(integrand_array,
+                              ia_size,
+                              integrand_size,
+                              index_ia_k,
+                              index_ia_sum1,
+                              index_ia_ddsum1,
+                              _SPLINE_NATURAL_,
+                              pnl->error_message),
+                 pnl->error_message,
+                 pnl->error_message);
 
-    class_call(array_spline(integrand_array,
-                            ia_size,
-                            integrand_size,
-                            index_ia_k,
-                            index_ia_sum2,
-                            index_ia_ddsum2,
-                            _SPLINE_NATURAL_,
-                            pnl->error_message),
-               pnl->error_message,
-               pnl->error_message);
+      class_call(array_spline(integrand_array,
+                              ia_size,
+                              integrand_size,
+                              index_ia_k,
+                              index_ia_sum2,
+                              index_ia_ddsum2,
+                              _SPLINE_NATURAL_,
+                              pnl->error_message),
+                 pnl->error_message,
+                 pnl->error_message);
 
-    class_call(array_spline(integrand_array,
-                            ia_size,
-                            integrand_size,
-                            index_ia_k,
-                            index_ia_sum3,
-                            index_ia_ddsum3,
-                            _SPLINE_NATURAL_,
-                            pnl->error_message),
-               pnl->error_message,
-               pnl->error_message);
+      class_call(array_spline(integrand_array,
+                              ia_size,
+                              integrand_size,
+                              index_ia_k,
+                              index_ia_sum3,
+                              index_ia_ddsum3,
+                              _SPLINE_NATURAL_,
+                              pnl->error_message),
+                 pnl->error_message,
+                 pnl->error_message);
 
-    /* integrate */
-    class_call(array_integrate_all_spline(integrand_array,
-                                          ia_size,
-                                          integrand_size,
-                                          index_ia_k,
-                                          index_ia_sum1,
-                                          index_ia_ddsum1,
-                                          &sum1,
-                                          pnl->error_message),
-               pnl->error_message,
-               pnl->error_message);
+      /* integrate */
+      class_call(array_integrate_all_spline(integrand_array,
+                                            ia_size,
+                                            integrand_size,
+                                            index_ia_k,
+                                            index_ia_sum1,
+                                            index_ia_ddsum1,
+                                            &sum1,
+                                            pnl->error_message),
+                 pnl->error_message,
+                 pnl->error_message);
 
-    class_call(array_integrate_all_spline(integrand_array,
-                                          ia_size,
-                                          integrand_size,
-                                          index_ia_k,
-                                          index_ia_sum2,
-                                          index_ia_ddsum2,
-                                          &sum2,
-                                          pnl->error_message),
-               pnl->error_message,
-               pnl->error_message);
+      class_call(array_integrate_all_spline(integrand_array,
+                                            ia_size,
+                                            integrand_size,
+                                            index_ia_k,
+                                            index_ia_sum2,
+                                            index_ia_ddsum2,
+                                            &sum2,
+                                            pnl->error_message),
+                 pnl->error_message,
+                 pnl->error_message);
 
-    class_call(array_integrate_all_spline(integrand_array,
-                                          ia_size,
-                                          integrand_size,
-                                          index_ia_k,
-                                          index_ia_sum3,
-                                          index_ia_ddsum3,
-                                          &sum3,
-                                          pnl->error_message),
-               pnl->error_message,
-               pnl->error_message);
+      class_call(array_integrate_all_spline(integrand_array,
+                                            ia_size,
+                                            integrand_size,
+                                            index_ia_k,
+                                            index_ia_sum3,
+                                            index_ia_ddsum3,
+                                            &sum3,
+                                            pnl->error_message),
+                 pnl->error_message,
+                 pnl->error_message);
 
-    sigma  = sqrt(sum1);
-    d1 = -sum2/sum1;
-    d2 = -sum2*sum2/sum1/sum1 - sum3/sum1;
-    /* in original halofit, this is the end of the function wint() */
+      sigma  = sqrt(sum1);
+      d1 = -sum2/sum1;
+      d2 = -sum2*sum2/sum1/sum1 - sum3/sum1;
+      /* in original halofit, this is the end of the function wint() */
+    }
 
     diff = sigma - 1.0;
 
@@ -622,7 +1225,7 @@ int nonlinear_halofit(
 
     class_test_except(counter > _MAX_IT_,
                       pnl->error_message,
-                      free(pvecback);free(integrand_array),
+                      free(pvecback);free(integrand_array);free(sigma_table);free(ddsigma_table),
                       "could not converge within maximum allowed number of iterations");
 
   } while (fabs(diff) > 0.001);
@@ -698,5 +1301,8 @@ int nonlinear_halofit(
 
   free(pvecback);
   free(integrand_array);
+  free(sigma_table);
+  free(ddsigma_table);
+
   return _SUCCESS_;
 }
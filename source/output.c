@@ -7,6 +7,7 @@
  * The following functions can be called from other modules or from the main:
  *
  * -# output_init() (must be called after spectra_init())
+ * -# output_part() (called by driver_init(), see driver.h)
  * -# output_total_cl_at_l() (can be called even before output_init())
  *
  * No memory needs to be deallocated after that,
@@ -93,6 +94,10 @@ int output_total_cl_at_l(
 /**
  * This routine writes the output in files.
  *
+ * It writes all groups of files of enum output_part, one after the
+ * other. Instead, driver_init() can write each group with
+ * output_part() as soon as the modules it needs are initialised,
+ * while the other modules are still computing.
  *
  * @param pba Input: pointer to background structure (needed for calling spectra_pk_at_z())
  * @param pth Input: pointer to thermodynamics structure
@@ -117,93 +122,185 @@ int output_init(
                 struct output * pop
                 ) {
 
+  int part;
+
+  for (part = 0; part < _OUTPUT_PARTS_; part++) {
+    class_call(output_part(pba,pth,ppt,ppm,ptr,psp,pnl,ple,pop,(enum output_part)part),
+               pop->error_message,
+               pop->error_message);
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine writes one group of output files. The groups must be
+ * written in the order of enum output_part, but each of them only
+ * needs the modules it writes: the background for op_background, the
+ * thermodynamics for op_thermodynamics, the primordial spectra for
+ * op_primordial, the perturbations for op_perturbations, and the
+ * spectra, nonlinear and lensing modules for op_spectra.
+ *
+ * @param pba  Input: pointer to background structure (needed for calling spectra_pk_at_z())
+ * @param pth  Input: pointer to thermodynamics structure
+ * @param ppt  Input: pointer perturbation structure
+ * @param ppm  Input: pointer to primordial structure
+ * @param ptr  Input: pointer to transfer structure
+ * @param psp  Input: pointer to spectra structure
+ * @param pnl  Input: pointer to nonlinear structure
+ * @param ple  Input: pointer to lensing structure
+ * @param pop  Input: pointer to output structure
+ * @param part Input: group of files to write
+ * @return the error status
+ */
+
+int output_part(
+                struct background * pba,
+                struct thermo * pth,
+                struct perturbs * ppt,
+                struct primordial * ppm,
+                struct transfers * ptr,
+                struct spectra * psp,
+                struct nonlinear * pnl,
+                struct lensing * ple,
+                struct output * pop,
+                enum output_part part
+                ) {
+
   /** Summary: */
 
+  /** - start (for the first group) or resume measuring the resources
+      used by this module (see class_profile) */
+
+  if (part == op_background)
+    class_profile_start(&(pop->profile));
+  else
+    class_profile_resume(&(pop->profile));
+
   /** - check that we really want to output at least one file */
 
   if ((ppt->has_cls == _FALSE_) && (ppt->has_pk_matter == _FALSE_) && (ppt->has_density_transfers == _FALSE_) && (ppt->has_velocity_transfers == _FALSE_) && (pop->write_background == _FALSE_) && (pop->write_thermodynamics == _FALSE_) && (pop->write_primordial == _FALSE_)) {
-    if (pop->output_verbose > 0)
+    if ((pop->output_verbose > 0) && (part == op_background))
       printf("No output files requested. Output module skipped.\n");
+    class_profile_stop(&(pop->profile));
     return _SUCCESS_;
   }
   else {
-    if (pop->output_verbose > 0)
+    if ((pop->output_verbose > 0) && (part == op_background))
       printf("Writing output files in %s... \n",pop->root);
   }
 
-  /** - deal with all anisotropy power spectra \f$ C_l\f$'s */
+  switch (part) {
 
-  if (ppt->has_cls == _TRUE_) {
+    /** - deal with background quantities */
 
-    class_call(output_cl(pba,ppt,psp,ple,pop),
-               pop->error_message,
-               pop->error_message);
-  }
+  case op_background:
 
-  /** - deal with all Fourier matter power spectra P(k)'s */
+    if (pop->write_background == _TRUE_) {
 
-  if (ppt->has_pk_matter == _TRUE_) {
+      class_call(output_background(pba,pop),
+                 pop->error_message,
+                 pop->error_message);
 
-    class_call(output_pk(pba,ppt,psp,pop),
-               pop->error_message,
-               pop->error_message);
+    }
+    break;
+
+    /** - deal with thermodynamics quantities */
+
+  case op_thermodynamics:
+
+    if (pop->write_thermodynamics == _TRUE_) {
+
+      class_call(output_thermodynamics(pba,pth,pop),
+                 pop->error_message,
+                 pop->error_message);
 
-    if (pnl->method != nl_none) {
-          class_call(output_pk_nl(pba,ppt,psp,pop),
-                     pop->error_message,
-                     pop->error_message);
     }
-  }
+    break;
 
-  /** - deal with density and matter power spectra */
+    /** - deal with primordial spectra */
 
-  if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_)) {
+  case op_primordial:
 
-    class_call(output_tk(pba,ppt,psp,pop),
-               pop->error_message,
-               pop->error_message);
-  }
+    if (pop->write_primordial == _TRUE_) {
 
-  /** - deal with background quantities */
+      class_call(output_primordial(ppt,ppm,pop),
+                 pop->error_message,
+                 pop->error_message);
 
-  if (pop->write_background == _TRUE_) {
+    }
+    break;
 
-    class_call(output_background(pba,pop),
-               pop->error_message,
-               pop->error_message);
+    /** - deal with perturbation quantities, and with the integration
+        statistics of perturbations */
 
-  }
+  case op_perturbations:
 
-  /** - deal with thermodynamics quantities */
+    if (pop->write_perturbations == _TRUE_) {
 
-  if (pop->write_thermodynamics == _TRUE_) {
+      class_call(output_perturbations(pba,ppt,pop),
+                 pop->error_message,
+                 pop->error_message);
 
-    class_call(output_thermodynamics(pba,pth,pop),
-               pop->error_message,
-               pop->error_message);
+    }
 
-  }
+    if (pop->write_perturbations_profile == _TRUE_) {
 
-  /** - deal with perturbation quantities */
+      class_call(output_perturbations_profile(ppt,pop),
+                 pop->error_message,
+                 pop->error_message);
 
-  if (pop->write_perturbations == _TRUE_) {
+    }
+    break;
 
-    class_call(output_perturbations(pba,ppt,pop),
-               pop->error_message,
-               pop->error_message);
+  case op_spectra:
 
-  }
+    /** - deal with all anisotropy power spectra \f$ C_l\f$'s */
 
-  /** - deal with primordial spectra */
+    if (ppt->has_cls == _TRUE_) {
 
-  if (pop->write_primordial == _TRUE_) {
+      class_call(output_cl(pba,ppt,psp,ple,pop),
+                 pop->error_message,
+                 pop->error_message);
+    }
 
-    class_call(output_primordial(ppt,ppm,pop),
-               pop->error_message,
-               pop->error_message);
+    /** - deal with all Fourier matter power spectra P(k)'s */
+
+    if (ppt->has_pk_matter == _TRUE_) {
+
+      class_call(output_pk(pba,ppt,psp,pop),
+                 pop->error_message,
+                 pop->error_message);
+
+      if (pnl->method != nl_none) {
+        class_call(output_pk_nl(pba,ppt,psp,pop),
+                   pop->error_message,
+                   pop->error_message);
+      }
+
+      if (psp->has_correlations == _TRUE_) {
+        class_call(output_correlations(pba,psp,pop),
+                   pop->error_message,
+                   pop->error_message);
+      }
+    }
+
+    /** - deal with density and matter power spectra */
+
+    if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_)) {
 
+      class_call(output_tk(pba,ppt,psp,pop),
+                 pop->error_message,
+                 pop->error_message);
+    }
+    break;
+
+  default:
+    class_stop(pop->error_message,"unknown group of output files %d",part);
   }
 
+  class_profile_stop(&(pop->profile));
   return _SUCCESS_;
 
 }
@@ -847,31 +944,50 @@ int output_pk(
                  pop->error_message);
     }
 
-    /** - fourth, write in files */
+    /** - fourth, write in files (in binary format, one table at once) */
 
-    for (index_k=0; index_k<psp->ln_k_size; index_k++) {
+    if (pop->output_format == binary_format) {
 
-      class_call(output_one_line_of_pk(out,
-                                       exp(psp->ln_k[index_k])/pba->h,
-                                       pk_tot[index_k]*pow(pba->h,3)),
+      class_call(output_binary_pk(pba,psp,pop,out,pk_tot,1),
                  pop->error_message,
                  pop->error_message);
 
       if (psp->ic_size[index_md] > 1) {
-
         for (index_ic1_ic2 = 0; index_ic1_ic2 < psp->ic_ic_size[index_md]; index_ic1_ic2++) {
-
           if (psp->is_non_zero[index_md][index_ic1_ic2] == _TRUE_) {
-
-            class_call(output_one_line_of_pk(out_ic[index_ic1_ic2],
-                                             exp(psp->ln_k[index_k])/pba->h,
-                                             pk_ic[index_k * psp->ic_ic_size[index_md] + index_ic1_ic2]*pow(pba->h,3)),
+            class_call(output_binary_pk(pba,psp,pop,out_ic[index_ic1_ic2],pk_ic+index_ic1_ic2,psp->ic_ic_size[index_md]),
                        pop->error_message,
                        pop->error_message);
           }
         }
       }
     }
+    else {
+
+      for (index_k=0; index_k<psp->ln_k_size; index_k++) {
+
+        class_call(output_one_line_of_pk(out,
+                                         exp(psp->ln_k[index_k])/pba->h,
+                                         pk_tot[index_k]*pow(pba->h,3)),
+                   pop->error_message,
+                   pop->error_message);
+
+        if (psp->ic_size[index_md] > 1) {
+
+          for (index_ic1_ic2 = 0; index_ic1_ic2 < psp->ic_ic_size[index_md]; index_ic1_ic2++) {
+
+            if (psp->is_non_zero[index_md][index_ic1_ic2] == _TRUE_) {
+
+              class_call(output_one_line_of_pk(out_ic[index_ic1_ic2],
+                                               exp(psp->ln_k[index_k])/pba->h,
+                                               pk_ic[index_k * psp->ic_ic_size[index_md] + index_ic1_ic2]*pow(pba->h,3)),
+                         pop->error_message,
+                         pop->error_message);
+            }
+          }
+        }
+      }
+    }
 
     /** - fifth, free memory and close files */
 
@@ -981,16 +1097,25 @@ int output_pk_nl(
                  pop->error_message);
     }
 
-    /** - fourth, write in files */
+    /** - fourth, write in files (in binary format, one table at once) */
 
-    for (index_k=0; index_k<psp->ln_k_size; index_k++) {
+    if (pop->output_format == binary_format) {
 
-      class_call(output_one_line_of_pk(out,
-                                       exp(psp->ln_k[index_k])/pba->h,
-                                       pk_tot[index_k]*pow(pba->h,3)),
+      class_call(output_binary_pk(pba,psp,pop,out,pk_tot,1),
                  pop->error_message,
                  pop->error_message);
+    }
+    else {
+
+      for (index_k=0; index_k<psp->ln_k_size; index_k++) {
 
+        class_call(output_one_line_of_pk(out,
+                                         exp(psp->ln_k[index_k])/pba->h,
+                                         pk_tot[index_k]*pow(pba->h,3)),
+                   pop->error_message,
+                   pop->error_message);
+
+      }
     }
 
     /** - fifth, free memory and close files */
@@ -1005,6 +1130,97 @@ int output_pk_nl(
 }
 
 
+/**
+ * This routines writes the output in files for the linear matter
+ * correlation function \f$ \xi(r) \f$ and \f$ \sigma(R) \f$.
+ *
+ * @param pba Input: pointer to background structure (needed for calling spectra_correlations_at_z())
+ * @param psp Input: pointer to spectra structure
+ * @param pop Input: pointer to output structure
+ */
+
+int output_correlations(
+                        struct background * pba,
+                        struct spectra * psp,
+                        struct output * pop
+                        ) {
+
+  FILE * out;
+
+  double * xi;      /* array with argument xi[index_r] */
+  double * sigma_r; /* array with argument sigma_r[index_r] */
+
+  int index_r;
+  int index_z;
+  int colnum;
+
+  FileName file_name;
+  FileName redshift_suffix;
+
+  class_alloc(xi,psp->ln_r_size*sizeof(double),pop->error_message);
+  class_alloc(sigma_r,psp->ln_r_size*sizeof(double),pop->error_message);
+
+  for (index_z = 0; index_z < pop->z_pk_num; index_z++) {
+
+    /** - first, check that requested redshift z_pk is consistent */
+
+    class_test((pop->z_pk[index_z] > psp->z_max_pk),
+               pop->error_message,
+               "P(k,z) computed up to z=%f but requested at z=%f. Must increase z_max_pk in precision file.",psp->z_max_pk,pop->z_pk[index_z]);
+
+    if (pop->z_pk_num == 1)
+      redshift_suffix[0]='\0';
+    else
+      sprintf(redshift_suffix,"z%d_",index_z+1);
+
+    /** - second, open the file and write a heading */
+
+    sprintf(file_name,"%s%s%s",pop->root,redshift_suffix,"xi.dat");
+
+    class_open(out,file_name,"w",pop->error_message);
+
+    if (pop->write_header == _TRUE_) {
+      colnum = 1;
+      fprintf(out,"# Linear matter correlation function xi(r) and rms fluctuation sigma(R) in spheres of radius R=r, at redshift z=%g\n",pop->z_pk[index_z]);
+      fprintf(out,"# for r=%g to %g Mpc/h,\n",
+              exp(psp->ln_r[0])*pba->h,
+              exp(psp->ln_r[psp->ln_r_size-1])*pba->h);
+      fprintf(out,"# number of radii equal to %d\n",psp->ln_r_size);
+      fprintf(out,"#");
+      class_fprintf_columntitle(out,"r (Mpc/h)",_TRUE_,colnum);
+      class_fprintf_columntitle(out,"xi",_TRUE_,colnum);
+      class_fprintf_columntitle(out,"sigma",_TRUE_,colnum);
+      fprintf(out,"\n");
+    }
+
+    /** - third, interpolate the tables at z_pk and write them */
+
+    class_call(spectra_correlations_at_z(pba,
+                                         psp,
+                                         pop->z_pk[index_z],
+                                         xi,
+                                         sigma_r),
+               psp->error_message,
+               pop->error_message);
+
+    for (index_r=0; index_r<psp->ln_r_size; index_r++) {
+      fprintf(out," ");
+      class_fprintf_double(out,exp(psp->ln_r[index_r])*pba->h,_TRUE_);
+      class_fprintf_double(out,xi[index_r],_TRUE_);
+      class_fprintf_double(out,sigma_r[index_r],_TRUE_);
+      fprintf(out,"\n");
+    }
+
+    fclose(out);
+  }
+
+  free(xi);
+  free(sigma_r);
+
+  return _SUCCESS_;
+
+}
+
 /**
  * This routines writes the output in files for matter transfer functions \f$ T_i(k)\f$'s.
  *
@@ -1024,9 +1240,8 @@ int output_tk(
   /** Summary: */
 
   /** - define local variables */
-  char titles[_MAXTITLESTRINGLENGTH_]={0};
-  double * data;
-  int size_data, number_of_titles;
+  struct output_table table;
+  int size_data;
 
   FILE * tkfile;
 
@@ -1039,6 +1254,7 @@ int output_tk(
   FileName file_name;
   FileName redshift_suffix;
   char first_line[_LINE_LENGTH_MAX_];
+  char description[_LINE_LENGTH_MAX_];
   FileName ic_suffix;
 
   index_md=ppt->index_md_scalars;
@@ -1054,24 +1270,19 @@ int output_tk(
                "you wish to output the transfer functions in CMBFAST/CAMB format, but you requested velocity transfer functions. The two are not compatible (since CMBFAST/CAMB do not compute velocity transfer functions): switch to CLASS output format, or ask only for density transfer function");
   }
 
-
-  class_call(spectra_output_tk_titles(pba,ppt,pop->output_format,titles),
-             pba->error_message,
-             pop->error_message);
-  number_of_titles = get_number_of_titles(titles);
-  size_data = number_of_titles*psp->ln_k_size;
-
-  class_alloc(data, sizeof(double)*psp->ic_size[index_md]*size_data, pop->error_message);
-
   for (index_z = 0; index_z < pop->z_pk_num; index_z++) {
 
     z = pop->z_pk[index_z];
 
-    /** - first, check that requested redshift z_pk is consistent */
+    /** - first, compute the transfer functions of all initial
+        conditions (this also checks that the requested redshift z_pk
+        is consistent) */
 
-    class_test((pop->z_pk[index_z] > psp->z_max_pk),
+    table.data = NULL;
+    class_call(output_tk_table(pba,ppt,psp,pop,z,&table),
                pop->error_message,
-               "T_i(k,z) computed up to z=%f but requested at z=%f. Must increase z_max_pk in precision file.",psp->z_max_pk,pop->z_pk[index_z]);
+               pop->error_message);
+    size_data = table.columns*psp->ln_k_size;
 
     if (pop->z_pk_num == 1)
       redshift_suffix[0]='\0';
@@ -1080,17 +1291,6 @@ int output_tk(
 
     /** - second, open only the relevant files, and write a heading in each of them */
 
-    class_call(spectra_output_tk_data(pba,
-                                      ppt,
-                                      psp,
-                                      pop->output_format,
-                                      pop->z_pk[index_z],
-                                      number_of_titles,
-                                      data
-                                      ),
-               psp->error_message,
-               pop->error_message);
-
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
 
       class_call(spectra_firstline_and_ic_suffix(ppt, index_ic, first_line, ic_suffix),
@@ -1103,6 +1303,31 @@ int output_tk(
 
       class_open(tkfile, file_name, "w", pop->error_message);
 
+      if (pop->output_format == binary_format) {
+
+        sprintf(description,"Transfer functions T_i(k) %sat redshift z=%g",first_line,z);
+
+        class_call(binary_output_header(tkfile,
+                                        description,
+                                        table.titles,
+                                        psp->ln_k_size,
+                                        table.columns,
+                                        pop->error_message),
+                   pop->error_message,
+                   pop->error_message);
+
+        class_call(binary_output_write(tkfile,
+                                       table.data+index_ic*size_data,
+                                       sizeof(double),
+                                       size_data,
+                                       pop->error_message),
+                   pop->error_message,
+                   pop->error_message);
+
+        fclose(tkfile);
+        continue;
+      }
+
       if (pop->write_header == _TRUE_) {
         if (pop->output_format == class_format) {
           fprintf(tkfile,"# Transfer functions T_i(k) %sat redshift z=%g\n",first_line,z);
@@ -1135,8 +1360,8 @@ int output_tk(
       }
 
       output_print_data(tkfile,
-                        titles,
-                        data+index_ic*size_data,
+                        table.titles,
+                        table.data+index_ic*size_data,
                         size_data);
       
       /** - free memory and close files */
@@ -1144,9 +1369,9 @@ int output_tk(
 
     }
 
-  }
+    output_table_free(&table);
 
-  free(data);
+  }
 
   return _SUCCESS_;
 
@@ -1160,20 +1385,11 @@ int output_background(
   FILE * backfile;
   FileName file_name;
 
-  char titles[_MAXTITLESTRINGLENGTH_]={0};
-  double * data;
-  int size_data, number_of_titles;
+  struct output_table table;
 
-  class_call(background_output_titles(pba,titles),
-             pba->error_message,
-             pop->error_message);
-  number_of_titles = get_number_of_titles(titles);
-  size_data = number_of_titles*pba->bt_size;
-  class_alloc(data,sizeof(double)*size_data,pop->error_message);
-  class_call(background_output_data(pba,
-                                    number_of_titles,
-                                    data),
-             pba->error_message,
+  table.data = NULL;
+  class_call(output_background_table(pba,pop,&table),
+             pop->error_message,
              pop->error_message);
 
   sprintf(file_name,"%s%s",pop->root,"background.dat");
@@ -1192,11 +1408,11 @@ int output_background(
   }
 
   output_print_data(backfile,
-                    titles,
-                    data,
-                    size_data);
+                    table.titles,
+                    table.data,
+                    table.rows*table.columns);
 
-  free(data);
+  output_table_free(&table);
   fclose(backfile);
 
   return _SUCCESS_;
@@ -1211,21 +1427,11 @@ int output_thermodynamics(
 
   FileName file_name;
   FILE * thermofile;
-  char titles[_MAXTITLESTRINGLENGTH_]={0};
-  double * data;
-  int size_data, number_of_titles;
+  struct output_table table;
 
-  class_call(thermodynamics_output_titles(pba,pth,titles),
-             pth->error_message,
-             pop->error_message);
-  number_of_titles = get_number_of_titles(titles);
-  size_data = number_of_titles*pth->tt_size;
-  class_alloc(data,sizeof(double)*size_data,pop->error_message);
-  class_call(thermodynamics_output_data(pba,
-                                        pth,
-                                        number_of_titles,
-                                        data),
-             pth->error_message,
+  table.data = NULL;
+  class_call(output_thermodynamics_table(pba,pth,pop,&table),
+             pop->error_message,
              pop->error_message);
 
   sprintf(file_name,"%s%s",pop->root,"thermodynamics.dat");
@@ -1247,11 +1453,11 @@ int output_thermodynamics(
   }
 
   output_print_data(thermofile,
-                    titles,
-                    data,
-                    size_data);
+                    table.titles,
+                    table.data,
+                    table.rows*table.columns);
 
-  free(data);
+  output_table_free(&table);
   fclose(thermofile);
 
   return _SUCCESS_;
@@ -1276,7 +1482,7 @@ int output_perturbations(
       index_md = ppt->index_md_scalars;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_s.dat");
-      class_open(out, file_name, "w", ppt->error_message);
+      class_open(out, file_name, "w", pop->error_message);
       fprintf(out,"#scalar perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
       output_print_data(out,
                         ppt->scalar_titles,
@@ -1289,7 +1495,7 @@ int output_perturbations(
       index_md = ppt->index_md_vectors;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_v.dat");
-      class_open(out, file_name, "w", ppt->error_message);
+      class_open(out, file_name, "w", pop->error_message);
       fprintf(out,"#vector perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
       output_print_data(out,
                         ppt->vector_titles,
@@ -1302,7 +1508,7 @@ int output_perturbations(
       index_md = ppt->index_md_tensors;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_t.dat");
-      class_open(out, file_name, "w", ppt->error_message);
+      class_open(out, file_name, "w", pop->error_message);
       fprintf(out,"#tensor perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
       output_print_data(out,
                         ppt->tensor_titles,
@@ -1318,6 +1524,62 @@ int output_perturbations(
 
 }
 
+/**
+ * This routine writes the integration statistics of each mode,
+ * initial condition and wavenumber (stored by perturb_init() when
+ * 'write perturbations profile = yes') in a comma-separated file, with
+ * one line of titles, so that it can be read directly by spreadsheets
+ * or data-analysis tools.
+ *
+ * @param ppt Input: pointer to perturbation structure
+ * @param pop Input: pointer to output structure
+ * @return the error status
+ */
+
+int output_perturbations_profile(
+                                 struct perturbs * ppt,
+                                 struct output * pop
+                                 ) {
+
+  FILE * out;
+  FileName file_name;
+  char thetitle[_MAXTITLESTRINGLENGTH_];
+  char * pch;
+  char * pch_state; /* strtok_r() keeps no global state */
+  int index_row, index_column;
+  double * row;
+
+  if (ppt->profile_data == NULL)
+    return _SUCCESS_;
+
+  sprintf(file_name,"%s%s",pop->root,"perturbations_profile.csv");
+  class_open(out,file_name,"w",pop->error_message);
+
+  strcpy(thetitle,ppt->profile_titles);
+  pch = strtok_r(thetitle,_DELIMITER_,&pch_state);
+  while (pch != NULL){
+    fprintf(out,"%s",pch);
+    pch = strtok_r(NULL,_DELIMITER_,&pch_state);
+    fprintf(out,"%s",(pch == NULL) ? "\n" : ",");
+  }
+
+  for (index_row=0; index_row<ppt->profile_rows; index_row++) {
+    row = ppt->profile_data + index_row*pfl_size;
+    for (index_column=0; index_column<pfl_size; index_column++) {
+      if ((index_column == pfl_k) || (index_column == pfl_time) || ((index_column >= pfl_tau_ini) && (index_column <= pfl_tau_ncdmfa)))
+        fprintf(out,"%.*e",_OUTPUTPRECISION_,row[index_column]);
+      else
+        fprintf(out,"%d",(int)row[index_column]);
+      fprintf(out,"%s",(index_column == pfl_size-1) ? "\n" : ",");
+    }
+  }
+
+  fclose(out);
+
+  return _SUCCESS_;
+
+}
+
 int output_primordial(
                       struct perturbs * ppt,
                       struct primordial * ppm,
@@ -1325,23 +1587,13 @@ int output_primordial(
                       ) {
   FileName file_name;
   FILE * out;
-  char titles[_MAXTITLESTRINGLENGTH_]={0};
-  double * data;
-  int size_data, number_of_titles;
+  struct output_table table;
 
   sprintf(file_name,"%s%s",pop->root,"primordial_Pk.dat");
 
-  class_call(primordial_output_titles(ppt,ppm,titles),
-             ppm->error_message,
-             pop->error_message);
-  number_of_titles = get_number_of_titles(titles);
-  size_data = number_of_titles*ppm->lnk_size;
-  class_alloc(data,sizeof(double)*size_data,pop->error_message);
-  class_call(primordial_output_data(ppt,
-                                    ppm,
-                                    number_of_titles,
-                                    data),
-             ppm->error_message,
+  table.data = NULL;
+  class_call(output_primordial_table(ppt,ppm,pop,&table),
+             pop->error_message,
              pop->error_message);
 
   class_open(out,file_name,"w",pop->error_message);
@@ -1350,36 +1602,381 @@ int output_primordial(
   }
 
   output_print_data(out,
-                    titles,
-                    data,
-                    size_data);
+                    table.titles,
+                    table.data,
+                    table.rows*table.columns);
 
-  free(data);
+  output_table_free(&table);
   fclose(out);
 
   return _SUCCESS_;
 }
 
 
-int output_print_data(FILE *out,
-                      char titles[_MAXTITLESTRINGLENGTH_],
-                      double *dataptr,
-                      int size_dataptr){
-  int colnum=1, number_of_titles;
-  int index_title, index_tau;
-  char thetitle[_MAXTITLESTRINGLENGTH_];
-  char *pch;
+/**
+ * This routine prints in the standard output the resources used by
+ * each module (see class_profile, filled by each *_init() function),
+ * followed by the main sizes of the tables. It is called by class.c
+ * after output_init() when 'print profile = yes'.
+ *
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param ppm Input: pointer to primordial structure
+ * @param pnl Input: pointer to nonlinear structure
+ * @param ptr Input: pointer to transfers structure
+ * @param psp Input: pointer to spectra structure
+ * @param ple Input: pointer to lensing structure
+ * @param pop Input: pointer to output structure
+ * @return the error status
+ */
 
-  /** Summary*/
-   
-  /** - First we print the titles */
+int output_print_profile(
+                         struct background * pba,
+                         struct thermo * pth,
+                         struct perturbs * ppt,
+                         struct primordial * ppm,
+                         struct nonlinear * pnl,
+                         struct transfers * ptr,
+                         struct spectra * psp,
+                         struct lensing * ple,
+                         struct output * pop
+                         ) {
+
+  const char * name[9] = {"background","thermodynamics","perturbations","primordial",
+                          "nonlinear","transfer","spectra","lensing","output"};
+  struct class_profile * pprof[9];
+  struct class_profile total;
+  int index_module, index_md;
+
+  pprof[0] = &(pba->profile);
+  pprof[1] = &(pth->profile);
+  pprof[2] = &(ppt->profile);
+  pprof[3] = &(ppm->profile);
+  pprof[4] = &(pnl->profile);
+  pprof[5] = &(ptr->profile);
+  pprof[6] = &(psp->profile);
+  pprof[7] = &(ple->profile);
+  pprof[8] = &(pop->profile);
+
+  total.wall_time = 0.;
+  total.cpu_time = 0.;
+  total.memory_increase = 0.;
+
+  /* the memory columns are the peak resident set size (RSS) of the
+     whole process, not the bytes allocated by each module */
+  printf("Profile of the modules (memory: peak RSS of the process):\n");
+  printf(" %-16s %12s %12s %16s %16s\n","module","wall [s]","cpu [s]","peak RSS [MB]","RSS incr. [MB]");
+  for (index_module=0; index_module<9; index_module++) {
+    printf(" %-16s %12.4f %12.4f %16.1f %16.1f\n",
+           name[index_module],
+           pprof[index_module]->wall_time,
+           pprof[index_module]->cpu_time,
+           pprof[index_module]->peak_memory/1048576.,
+           pprof[index_module]->memory_increase/1048576.);
+    total.wall_time += pprof[index_module]->wall_time;
+    total.cpu_time += pprof[index_module]->cpu_time;
+    total.memory_increase += pprof[index_module]->memory_increase;
+  }
+  printf(" %-16s %12.4f %12.4f %16.1f %16.1f\n","total",
+         total.wall_time,total.cpu_time,pop->profile.peak_memory/1048576.,total.memory_increase/1048576.);
+
+  printf("Sizes:\n");
+  if (ppt->has_perturbations == _TRUE_) {
+    printf(" tau_size = %d\n",ppt->tau_size);
+    for (index_md=0; index_md<ppt->md_size; index_md++)
+      printf(" k_size[%d] = %d\n",index_md,ppt->k_size[index_md]);
+  }
+  if (ptr->has_cls == _TRUE_) {
+    printf(" q_size = %zu\n",ptr->q_size);
+    printf(" l_size = %d\n",ptr->l_size_max);
+  }
+
+#ifdef CLASS_PAPI
+  int kernel, index_thread, index_event;
+  short counted;
+
+  /** - hardware events counted in each kernel by each thread, for the modules in which the kernel was called */
+  printf("Hardware events:\n");
+  printf(" %-16s %-20s %6s","module","kernel","thread");
+  for (index_event=0; index_event<_CLASS_EVENTS_; index_event++)
+    if (class_event_available(index_event) == _TRUE_)
+      printf(" %16s",class_event_name[index_event]);
+  printf("\n");
+
+  for (index_module=0; index_module<9; index_module++) {
+    for (kernel=0; kernel<_CLASS_KERNELS_; kernel++) {
+      for (index_thread=0; index_thread<pprof[index_module]->event_threads; index_thread++) {
+        counted = _FALSE_;
+        for (index_event=0; index_event<_CLASS_EVENTS_; index_event++)
+          if (pprof[index_module]->event_count[index_thread][kernel][index_event] != 0)
+            counted = _TRUE_;
+        if (counted == _FALSE_)
+          continue;
+        printf(" %-16s %-20s %6d",name[index_module],class_kernel_name[kernel],index_thread);
+        for (index_event=0; index_event<_CLASS_EVENTS_; index_event++)
+          if (class_event_available(index_event) == _TRUE_)
+            printf(" %16lld",pprof[index_module]->event_count[index_thread][kernel][index_event]);
+        printf("\n");
+      }
+    }
+  }
+#endif
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine prepares a table to be filled: it checks the size of
+ * a buffer provided by the caller (ptable->data not NULL), or
+ * allocates the data array otherwise.
+ *
+ * @param pop     Input: pointer to output structure
+ * @param titles  Input: column titles, each followed by _DELIMITER_
+ * @param rows    Input: number of rows
+ * @param ptable  Input/Output: table, with titles and sizes filled and data ready to be written
+ * @return the error status
+ */
+
+int output_table_init(
+                      struct output * pop,
+                      char * titles,
+                      int rows,
+                      struct output_table * ptable
+                      ) {
+
+  strcpy(ptable->titles,titles);
+  ptable->columns = get_number_of_titles(titles);
+  ptable->rows = rows;
+
+  if (ptable->data == NULL) {
+    class_alloc(ptable->data,MAX(ptable->rows*ptable->columns,1)*sizeof(double),pop->error_message);
+    ptable->data_is_allocated = _TRUE_;
+  }
+  else {
+    class_test(ptable->capacity < ptable->rows*ptable->columns,
+               pop->error_message,
+               "the buffer passed for this table holds %d numbers, but %d rows of %d columns are needed",
+               ptable->capacity,ptable->rows,ptable->columns);
+    ptable->data_is_allocated = _FALSE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine frees the data array of a table, if it was allocated
+ * by the output module. Buffers provided by the caller are left
+ * untouched.
+ *
+ * @param ptable Input/Output: table
+ * @return the error status
+ */
+
+int output_table_free(
+                      struct output_table * ptable
+                      ) {
+
+  if (ptable->data_is_allocated == _TRUE_) {
+    free(ptable->data);
+    ptable->data = NULL;
+    ptable->data_is_allocated = _FALSE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine fills a table with the same background quantities as
+ * the file written by output_background(), without writing anything.
+ *
+ * @param pba    Input: pointer to background structure
+ * @param pop    Input: pointer to output structure (used for error messages)
+ * @param ptable Input/Output: table (see output_table_init() for the data buffer)
+ * @return the error status
+ */
+
+int output_background_table(
+                            struct background * pba,
+                            struct output * pop,
+                            struct output_table * ptable
+                            ) {
+
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+
+  class_call(background_output_titles(pba,titles),
+             pba->error_message,
+             pop->error_message);
+
+  class_call(output_table_init(pop,titles,pba->bt_size,ptable),
+             pop->error_message,
+             pop->error_message);
+
+  class_call(background_output_data(pba,
+                                    ptable->columns,
+                                    ptable->data),
+             pba->error_message,
+             pop->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine fills a table with the same thermodynamics quantities
+ * as the file written by output_thermodynamics(), without writing
+ * anything.
+ *
+ * @param pba    Input: pointer to background structure
+ * @param pth    Input: pointer to thermodynamics structure
+ * @param pop    Input: pointer to output structure (used for error messages)
+ * @param ptable Input/Output: table (see output_table_init() for the data buffer)
+ * @return the error status
+ */
+
+int output_thermodynamics_table(
+                                struct background * pba,
+                                struct thermo * pth,
+                                struct output * pop,
+                                struct output_table * ptable
+                                ) {
+
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+
+  class_call(thermodynamics_output_titles(pba,pth,titles),
+             pth->error_message,
+             pop->error_message);
+
+  class_call(output_table_init(pop,titles,pth->tt_size,ptable),
+             pop->error_message,
+             pop->error_message);
+
+  class_call(thermodynamics_output_data(pba,
+                                        pth,
+                                        ptable->columns,
+                                        ptable->data),
+             pth->error_message,
+             pop->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine fills a table with the transfer functions at redshift
+ * z, like in the files written by output_tk(), without writing
+ * anything. With several initial conditions, the blocks of
+ * psp->ln_k_size rows of each initial condition follow each other.
+ *
+ * @param pba    Input: pointer to background structure
+ * @param ppt    Input: pointer to perturbation structure
+ * @param psp    Input: pointer to spectra structure
+ * @param pop    Input: pointer to output structure (gives the format, class or camb)
+ * @param z      Input: redshift
+ * @param ptable Input/Output: table (see output_table_init() for the data buffer)
+ * @return the error status
+ */
+
+int output_tk_table(
+                    struct background * pba,
+                    struct perturbs * ppt,
+                    struct spectra * psp,
+                    struct output * pop,
+                    double z,
+                    struct output_table * ptable
+                    ) {
+
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+  enum file_format tk_format;
+
+  /* binary files contain the columns of the class format */
+  tk_format = (pop->output_format == camb_format) ? camb_format : class_format;
+
+  class_test(z > psp->z_max_pk,
+             pop->error_message,
+             "T_i(k,z) computed up to z=%f but requested at z=%f. Must increase z_max_pk in precision file.",psp->z_max_pk,z);
+
+  class_call(spectra_output_tk_titles(pba,ppt,tk_format,titles),
+             pba->error_message,
+             pop->error_message);
+
+  class_call(output_table_init(pop,
+                               titles,
+                               ppt->ic_size[ppt->index_md_scalars]*psp->ln_k_size,
+                               ptable),
+             pop->error_message,
+             pop->error_message);
+
+  class_call(spectra_output_tk_data(pba,
+                                    ppt,
+                                    psp,
+                                    tk_format,
+                                    z,
+                                    ptable->columns,
+                                    ptable->data),
+             psp->error_message,
+             pop->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine fills a table with the same primordial spectra as the
+ * file written by output_primordial(), without writing anything.
+ *
+ * @param ppt    Input: pointer to perturbation structure
+ * @param ppm    Input: pointer to primordial structure
+ * @param pop    Input: pointer to output structure (used for error messages)
+ * @param ptable Input/Output: table (see output_table_init() for the data buffer)
+ * @return the error status
+ */
+
+int output_primordial_table(
+                            struct perturbs * ppt,
+                            struct primordial * ppm,
+                            struct output * pop,
+                            struct output_table * ptable
+                            ) {
+
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+
+  class_call(primordial_output_titles(ppt,ppm,titles),
+             ppm->error_message,
+             pop->error_message);
+
+  class_call(output_table_init(pop,titles,ppm->lnk_size,ptable),
+             pop->error_message,
+             pop->error_message);
+
+  class_call(primordial_output_data(ppt,
+                                    ppm,
+                                    ptable->columns,
+                                    ptable->data),
+             ppm->error_message,
+             pop->error_message);
+
+  return _SUCCESS_;
+}
+
+int output_print_data(FILE *out,
+                      char titles[_MAXTITLESTRINGLENGTH_],
+                      double *dataptr,
+                      int size_dataptr){
+  int colnum=1, number_of_titles;
+  int index_title, index_tau;
+  char thetitle[_MAXTITLESTRINGLENGTH_];
+  char *pch;
+  char *pch_state;
+
+  /** Summary*/
+   
+  /** - First we print the titles */
   fprintf(out,"#");
 
   strcpy(thetitle,titles);
-  pch = strtok(thetitle,_DELIMITER_);
+  pch = strtok_r(thetitle,_DELIMITER_,&pch_state);
   while (pch != NULL){
     class_fprintf_columntitle(out, pch, _TRUE_, colnum);
-    pch = strtok(NULL,_DELIMITER_);
+    pch = strtok_r(NULL,_DELIMITER_,&pch_state);
   }
   fprintf(out,"\n");
 
@@ -1397,7 +1994,6 @@ int output_print_data(FILE *out,
   return _SUCCESS_;
 }
 
-
 /**
  * This routine opens one file where some \f$ C_l\f$'s will be written, and writes
  * a heading with some general information concerning its content.
@@ -1424,12 +2020,111 @@ int output_open_cl_file(
   int index_d1,index_d2;
   int colnum = 1;
   char tmp[60]; //A fixed number here is ok, since it should just correspond to the largest string which is printed to tmp.
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+  char thetitle[_MAXTITLESTRINGLENGTH_];
+  char description[_LINE_LENGTH_MAX_];
+  char *pch;
+  char *pch_state;
 
   class_open(*clfile,filename,"w",pop->error_message);
 
+  /** - First we collect the titles of the columns following l; the
+      first ones depend on the format type */
+
+  if (pop->output_format == camb_format) {
+    class_store_columntitle(titles,"TT",psp->has_tt);
+    class_store_columntitle(titles,"EE",psp->has_ee);
+    class_store_columntitle(titles,"BB",psp->has_bb);
+    class_store_columntitle(titles,"TE",psp->has_te);
+    class_store_columntitle(titles,"dd",psp->has_pp);
+    class_store_columntitle(titles,"dT",psp->has_tp);
+    class_store_columntitle(titles,"dE",psp->has_ep);
+    /* Modification starts here */
+    class_store_columntitle(titles,"TB",psp->has_tb);
+    class_store_columntitle(titles,"EB",psp->has_eb);
+    /* Ends here */
+  }
+  else {
+    class_store_columntitle(titles,"TT",psp->has_tt);
+    class_store_columntitle(titles,"EE",psp->has_ee);
+    class_store_columntitle(titles,"TE",psp->has_te);
+    class_store_columntitle(titles,"BB",psp->has_bb);
+    class_store_columntitle(titles,"phiphi",psp->has_pp);
+    class_store_columntitle(titles,"TPhi",psp->has_tp);
+    class_store_columntitle(titles,"Ephi",psp->has_ep);
+    /* Modification starts here */
+    class_store_columntitle(titles,"TB",psp->has_tb);
+    class_store_columntitle(titles,"EB",psp->has_eb);
+    /* Ends here */
+  }
+
+  /** - Next deal with entries that are independent of format type */
+
+  if (psp->has_dd == _TRUE_){
+    for (index_d1=0; index_d1<psp->d_size; index_d1++){
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++){
+        sprintf(tmp,"dens[%d]-dens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+  if (psp->has_td == _TRUE_){
+    for (index_d1=0; index_d1<psp->d_size; index_d1++){
+      sprintf(tmp,"T-dens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (psp->has_pd == _TRUE_){
+    for (index_d1=0; index_d1<psp->d_size; index_d1++){
+      sprintf(tmp,"phi-dens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (psp->has_ll == _TRUE_){
+    for (index_d1=0; index_d1<psp->d_size; index_d1++){
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++){
+        sprintf(tmp,"lens[%d]-lens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+  if (psp->has_tl == _TRUE_){
+    for (index_d1=0; index_d1<psp->d_size; index_d1++){
+      sprintf(tmp,"T-lens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (psp->has_dl == _TRUE_){
+    for (index_d1=0; index_d1<psp->d_size; index_d1++){
+      for (index_d2=MAX(index_d1-psp->non_diag,0); index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
+        sprintf(tmp,"dens[%d]-lens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+
+  /** - In binary format, the header is always written, with l as first column */
+
+  if (pop->output_format == binary_format) {
+
+    sprintf(description,"dimensionless %s for l=2 to %d",first_line,lmax);
+    sprintf(thetitle,"l%s%s",_DELIMITER_,titles);
+
+    class_call(binary_output_header(*clfile,
+                                    description,
+                                    thetitle,
+                                    lmax-1,
+                                    get_number_of_titles(thetitle),
+                                    pop->error_message),
+               pop->error_message,
+               pop->error_message);
+
+    return _SUCCESS_;
+  }
+
   if (pop->write_header == _TRUE_) {
     
-    /** - First we deal with the entries that are dependent of format type */
+    /** - Then we write the heading, which depends on the format type */
 
     if (pop->output_format == class_format) {
       fprintf(*clfile,"# dimensionless %s\n",first_line);
@@ -1448,84 +2143,14 @@ int output_open_cl_file(
     fprintf(*clfile,"# -> if you don't want to see such a header, set 'headers' to 'no' in input file\n");
     fprintf(*clfile,"#\n");
 
-    if (0==1){
-      fprintf(*clfile,"#");
-      class_fprintf_columntitle(*clfile,"l",_TRUE_,colnum);
-    }
-    else{
-      fprintf(*clfile,"# 1:l ");
-      colnum++;
-    }
-    if (pop->output_format == class_format) {
-      class_fprintf_columntitle(*clfile,"TT",psp->has_tt,colnum);
-      class_fprintf_columntitle(*clfile,"EE",psp->has_ee,colnum);
-      class_fprintf_columntitle(*clfile,"TE",psp->has_te,colnum);
-      class_fprintf_columntitle(*clfile,"BB",psp->has_bb,colnum);
-      class_fprintf_columntitle(*clfile,"phiphi",psp->has_pp,colnum);
-      class_fprintf_columntitle(*clfile,"TPhi",psp->has_tp,colnum);
-      class_fprintf_columntitle(*clfile,"Ephi",psp->has_ep,colnum);
-      /* Modification starts here */
-      class_fprintf_columntitle(*clfile,"TB",psp->has_tb,colnum);
-      class_fprintf_columntitle(*clfile,"EB",psp->has_eb,colnum);
-      /* Ends here */
-    }
-    else if (pop->output_format == camb_format) {
-      class_fprintf_columntitle(*clfile,"TT",psp->has_tt,colnum);
-      class_fprintf_columntitle(*clfile,"EE",psp->has_ee,colnum);
-      class_fprintf_columntitle(*clfile,"BB",psp->has_bb,colnum);
-      class_fprintf_columntitle(*clfile,"TE",psp->has_te,colnum);
-      class_fprintf_columntitle(*clfile,"dd",psp->has_pp,colnum);
-      class_fprintf_columntitle(*clfile,"dT",psp->has_tp,colnum);
-      class_fprintf_columntitle(*clfile,"dE",psp->has_ep,colnum);
-      /* Modification starts here */
-      class_fprintf_columntitle(*clfile,"TB",psp->has_tb,colnum);
-      class_fprintf_columntitle(*clfile,"EB",psp->has_eb,colnum);
-      /* Ends here */
-    }
-
-    /** - Next deal with entries that are independent of format type */
+    fprintf(*clfile,"# 1:l ");
+    colnum++;
 
-    if (psp->has_dd == _TRUE_){
-      for (index_d1=0; index_d1<psp->d_size; index_d1++){
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++){
-          sprintf(tmp,"dens[%d]-dens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
-    }
-    if (psp->has_td == _TRUE_){
-      for (index_d1=0; index_d1<psp->d_size; index_d1++){
-        sprintf(tmp,"T-dens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (psp->has_pd == _TRUE_){
-      for (index_d1=0; index_d1<psp->d_size; index_d1++){
-        sprintf(tmp,"phi-dens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (psp->has_ll == _TRUE_){
-      for (index_d1=0; index_d1<psp->d_size; index_d1++){
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++){
-          sprintf(tmp,"lens[%d]-lens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
-    }
-    if (psp->has_tl == _TRUE_){
-      for (index_d1=0; index_d1<psp->d_size; index_d1++){
-        sprintf(tmp,"T-lens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (psp->has_dl == _TRUE_){
-      for (index_d1=0; index_d1<psp->d_size; index_d1++){
-        for (index_d2=MAX(index_d1-psp->non_diag,0); index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
-          sprintf(tmp,"dens[%d]-lens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
+    strcpy(thetitle,titles);
+    pch = strtok_r(thetitle,_DELIMITER_,&pch_state);
+    while (pch != NULL){
+      class_fprintf_columntitle(*clfile, pch, _TRUE_, colnum);
+      pch = strtok_r(NULL,_DELIMITER_,&pch_state);
     }
     fprintf(*clfile,"\n");
   }
@@ -1558,9 +2183,23 @@ int output_one_line_of_cl(
                           ) {
   int index_ct, index_ct_rest;
   double factor;
+  double * line;
 
   factor = l*(l+1)/2./_PI_;
 
+  if (pop->output_format == binary_format) {
+    class_alloc(line,(ct_size+1)*sizeof(double),pop->error_message);
+    line[0] = l;
+    for (index_ct=0; index_ct < ct_size; index_ct++) {
+      line[index_ct+1] = factor*cl[index_ct];
+    }
+    class_call(binary_output_write(clfile,line,sizeof(double),ct_size+1,pop->error_message),
+               pop->error_message,
+               pop->error_message);
+    free(line);
+    return _SUCCESS_;
+  }
+
   fprintf(clfile," ");
 
   if (0==1){
@@ -1645,8 +2284,29 @@ int output_open_pk_file(
                         ) {
 
   int colnum = 1;
+  char description[_LINE_LENGTH_MAX_];
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+
   class_open(*pkfile,filename,"w",pop->error_message);
 
+  if (pop->output_format == binary_format) {
+
+    sprintf(description,"Matter power spectrum P(k) %sat redshift z=%g",first_line,z);
+    class_store_columntitle(titles,"k (h/Mpc)",_TRUE_);
+    class_store_columntitle(titles,"P (Mpc/h)^3",_TRUE_);
+
+    class_call(binary_output_header(*pkfile,
+                                    description,
+                                    titles,
+                                    psp->ln_k_size,
+                                    2,
+                                    pop->error_message),
+               pop->error_message,
+               pop->error_message);
+
+    return _SUCCESS_;
+  }
+
   if (pop->write_header == _TRUE_) {
     fprintf(*pkfile,"# Matter power spectrum P(k) %sat redshift z=%g\n",first_line,z);
     fprintf(*pkfile,"# for k=%g to %g h/Mpc,\n",
@@ -1687,3 +2347,1523 @@ int output_one_line_of_pk(
   return _SUCCESS_;
 
 }
+
+/**
+ * This routine writes all values of k and P(k) in a file opened in
+ * binary format, with a single write
+ *
+ * @param pba     Input: pointer to background structure (needed for h)
+ * @param psp     Input: pointer to spectra structure
+ * @param pop     Input: pointer to output structure
+ * @param pkfile  Input: file pointer
+ * @param pk      Input: matter power spectrum in \f$ Mpc^3 \f$, in pk[index_k*stride]
+ * @param stride  Input: distance between two wavenumbers in pk
+ * @return the error status
+ */
+
+int output_binary_pk(
+                     struct background * pba,
+                     struct spectra * psp,
+                     struct output * pop,
+                     FILE * pkfile,
+                     double * pk,
+                     int stride
+                     ) {
+
+  double * data;
+  int index_k;
+
+  class_alloc(data,2*psp->ln_k_size*sizeof(double),pop->error_message);
+
+  for (index_k=0; index_k<psp->ln_k_size; index_k++) {
+    data[2*index_k] = exp(psp->ln_k[index_k])/pba->h;
+    data[2*index_k+1] = pk[index_k*stride]*pow(pba->h,3);
+  }
+
+  class_call(binary_output_write(pkfile,data,sizeof(double),2*psp->ln_k_size,pop->error_message),
+             pop->error_message,
+             pop->error_message);
+
+  free(data);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine appends (when packing) or reads back (when unpacking)
+ * a block of bytes in a state buffer.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param data          Input/Output: block of size bytes
+ * @param size          Input: number of bytes
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_bytes(
+                       struct output_state_buffer * psb,
+                       void * data,
+                       size_t size,
+                       ErrorMsg error_message
+                       ) {
+
+  char * data_new;
+  size_t capacity_new;
+
+  if (size == 0)
+    return _SUCCESS_;
+
+  if (psb->unpack == _TRUE_) {
+    class_test(psb->position+size > psb->size,
+               error_message,
+               "state truncated: %zu bytes needed at position %zu, but only %zu bytes in total",
+               size,psb->position,psb->size);
+    memcpy(data,psb->data+psb->position,size);
+  }
+  else {
+    if (psb->position+size > psb->capacity) {
+      capacity_new = MAX(2*psb->capacity,psb->position+size);
+      class_realloc(data_new,psb->data,capacity_new,error_message);
+      psb->data = data_new;
+      psb->capacity = capacity_new;
+    }
+    memcpy(psb->data+psb->position,data,size);
+    psb->size = psb->position+size;
+  }
+
+  psb->position += size;
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks one array of a state, preceded by its
+ * size in bytes. A NULL array is stored with size zero and unpacked
+ * as NULL; otherwise the unpacked array is allocated here, after
+ * checking that its size matches the one inferred from the structure.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param parray        Input/Output: pointer to the array
+ * @param size          Input: size of the array in bytes
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_array(
+                       struct output_state_buffer * psb,
+                       void ** parray,
+                       size_t size,
+                       ErrorMsg error_message
+                       ) {
+
+  uint64_t stored;
+
+  if (psb->unpack == _FALSE_)
+    stored = ((*parray == NULL) ? 0 : size);
+
+  class_call(output_state_bytes(psb,&stored,sizeof(uint64_t),error_message),
+             error_message,
+             error_message);
+
+  if (stored == 0) {
+    if (psb->unpack == _TRUE_)
+      *parray = NULL;
+    return _SUCCESS_;
+  }
+
+  if (psb->unpack == _TRUE_) {
+    class_test(stored != (uint64_t)size,
+               error_message,
+               "state inconsistent: array of %llu bytes where %zu were expected",
+               (unsigned long long)stored,size);
+    class_alloc(*parray,size,error_message);
+  }
+
+  class_call(output_state_bytes(psb,*parray,size,error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks a short, stored as a 16-bit integer.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param value         Input/Output: the number
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_short(
+                       struct output_state_buffer * psb,
+                       short * value,
+                       ErrorMsg error_message
+                       ) {
+
+  int16_t stored;
+
+  stored = (int16_t)(*value);
+
+  class_call(output_state_bytes(psb,&stored,sizeof(int16_t),error_message),
+             error_message,
+             error_message);
+
+  *value = (short)stored;
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks an int (or an enum), stored as a
+ * 32-bit integer.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param value         Input/Output: the number
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_int(
+                     struct output_state_buffer * psb,
+                     int * value,
+                     ErrorMsg error_message
+                     ) {
+
+  int32_t stored;
+
+  stored = (int32_t)(*value);
+
+  class_call(output_state_bytes(psb,&stored,sizeof(int32_t),error_message),
+             error_message,
+             error_message);
+
+  *value = (int)stored;
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks a double.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param value         Input/Output: the number
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_double(
+                        struct output_state_buffer * psb,
+                        double * value,
+                        ErrorMsg error_message
+                        ) {
+
+  class_call(output_state_bytes(psb,value,sizeof(double),error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks a null-terminated string, preceded by
+ * its size in bytes (zero for a NULL string, which is unpacked as
+ * NULL). The unpacked string is allocated here.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param pstring       Input/Output: pointer to the string
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_string(
+                        struct output_state_buffer * psb,
+                        char ** pstring,
+                        ErrorMsg error_message
+                        ) {
+
+  uint64_t stored;
+
+  if (psb->unpack == _FALSE_)
+    stored = ((*pstring == NULL) ? 0 : strlen(*pstring)+1);
+
+  class_call(output_state_bytes(psb,&stored,sizeof(uint64_t),error_message),
+             error_message,
+             error_message);
+
+  if (stored == 0) {
+    if (psb->unpack == _TRUE_)
+      *pstring = NULL;
+    return _SUCCESS_;
+  }
+
+  if (psb->unpack == _TRUE_) {
+    class_test(stored > psb->size-psb->position,
+               error_message,
+               "state truncated: string of %llu bytes at position %zu, but only %zu bytes in total",
+               (unsigned long long)stored,psb->position,psb->size);
+    class_alloc(*pstring,stored,error_message);
+  }
+
+  class_call(output_state_bytes(psb,*pstring,stored,error_message),
+             error_message,
+             error_message);
+
+  if (psb->unpack == _TRUE_)
+    class_test((*pstring)[stored-1] != '\0',
+               error_message,
+               "state inconsistent: string without terminating null character");
+
+  return _SUCCESS_;
+}
+
+/**
+ * Shorthands packing or unpacking one scalar field of a structure, in
+ * the routines below (which all have psb and error_message as
+ * arguments). The value of an enum goes through an int.
+ */
+
+#define _state_short_(field)                                            \
+  class_call(output_state_short(psb,&(field),error_message),            \
+             error_message,                                             \
+             error_message)
+
+#define _state_int_(field)                                              \
+  class_call(output_state_int(psb,&(field),error_message),              \
+             error_message,                                             \
+             error_message)
+
+#define _state_double_(field)                                           \
+  class_call(output_state_double(psb,&(field),error_message),           \
+             error_message,                                             \
+             error_message)
+
+#define _state_enum_(field) {                                           \
+    int value_of_enum = (int)(field);                                   \
+    _state_int_(value_of_enum);                                         \
+    (field) = value_of_enum;                                            \
+  }
+
+/**
+ * This routine packs or unpacks the background structure: all its
+ * scalars, the tables, and the parameters and momentum sampling of
+ * non-cold relics, including the files and parameters giving their
+ * phase-space distributions.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param pba           Input/Output: pointer to background structure
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_background(
+                            struct output_state_buffer * psb,
+                            struct background * pba,
+                            ErrorMsg error_message
+                            ) {
+
+  int n_ncdm;
+  int files;
+
+  if (psb->unpack == _TRUE_)
+    memset(pba,0,sizeof(struct background));
+
+  _state_double_(pba->H0);
+  _state_double_(pba->Omega0_g);
+  _state_double_(pba->T_cmb);
+  _state_double_(pba->Omega0_b);
+  _state_double_(pba->Omega0_cdm);
+  _state_double_(pba->Omega0_lambda);
+  _state_double_(pba->Omega0_fld);
+  _state_double_(pba->w0_fld);
+  _state_double_(pba->wa_fld);
+  _state_double_(pba->cs2_fld);
+  _state_double_(pba->Omega0_ur);
+  _state_double_(pba->Omega0_dcdmdr);
+  _state_double_(pba->Gamma_dcdm);
+  _state_double_(pba->Omega_ini_dcdm);
+  _state_double_(pba->Omega0_scf);
+  _state_short_(pba->attractor_ic_scf);
+  _state_double_(pba->phi_ini_scf);
+  _state_double_(pba->phi_prime_ini_scf);
+  _state_int_(pba->scf_parameters_size);
+  _state_int_(pba->scf_tuning_index);
+  _state_double_(pba->Omega0_k);
+  _state_int_(pba->N_ncdm);
+  _state_double_(pba->Omega0_ncdm_tot);
+  _state_double_(pba->deg_ncdm_default);
+  _state_double_(pba->T_ncdm_default);
+  _state_double_(pba->ksi_ncdm_default);
+  _state_int_(pba->ncdm_psd_parameters_size);
+  _state_double_(pba->h);
+  _state_double_(pba->age);
+  _state_double_(pba->conformal_age);
+  _state_double_(pba->K);
+  _state_int_(pba->sgnK);
+  _state_double_(pba->Neff);
+  _state_double_(pba->Omega0_dcdm);
+  _state_double_(pba->Omega0_dr);
+  _state_double_(pba->a_today);
+  _state_int_(pba->index_bg_a);
+  _state_int_(pba->index_bg_H);
+  _state_int_(pba->index_bg_H_prime);
+  _state_int_(pba->index_bg_rho_g);
+  _state_int_(pba->index_bg_rho_b);
+  _state_int_(pba->index_bg_rho_cdm);
+  _state_int_(pba->index_bg_rho_lambda);
+  _state_int_(pba->index_bg_rho_fld);
+  _state_int_(pba->index_bg_rho_ur);
+  _state_int_(pba->index_bg_rho_dcdm);
+  _state_int_(pba->index_bg_rho_dr);
+  _state_int_(pba->index_bg_phi_scf);
+  _state_int_(pba->index_bg_phi_prime_scf);
+  _state_int_(pba->index_bg_V_scf);
+  _state_int_(pba->index_bg_dV_scf);
+  _state_int_(pba->index_bg_ddV_scf);
+  _state_int_(pba->index_bg_rho_scf);
+  _state_int_(pba->index_bg_p_scf);
+  _state_int_(pba->index_bg_rho_ncdm1);
+  _state_int_(pba->index_bg_p_ncdm1);
+  _state_int_(pba->index_bg_pseudo_p_ncdm1);
+  _state_int_(pba->index_bg_Omega_r);
+  _state_int_(pba->index_bg_rho_crit);
+  _state_int_(pba->index_bg_Omega_m);
+  _state_int_(pba->index_bg_conf_distance);
+  _state_int_(pba->index_bg_ang_distance);
+  _state_int_(pba->index_bg_lum_distance);
+  _state_int_(pba->index_bg_time);
+  _state_int_(pba->index_bg_rs);
+  _state_int_(pba->index_bg_D);
+  _state_int_(pba->index_bg_f);
+  _state_int_(pba->bg_size_short);
+  _state_int_(pba->bg_size_normal);
+  _state_int_(pba->bg_size);
+  _state_int_(pba->bt_size);
+  _state_int_(pba->tau_lookup.n_bins);
+  _state_double_(pba->tau_lookup.u_min);
+  _state_double_(pba->tau_lookup.inv_du);
+  _state_int_(pba->z_lookup.n_bins);
+  _state_double_(pba->z_lookup.u_min);
+  _state_double_(pba->z_lookup.inv_du);
+  _state_int_(pba->index_bi_a);
+  _state_int_(pba->index_bi_rho_dcdm);
+  _state_int_(pba->index_bi_rho_dr);
+  _state_int_(pba->index_bi_phi_scf);
+  _state_int_(pba->index_bi_phi_prime_scf);
+  _state_int_(pba->index_bi_time);
+  _state_int_(pba->index_bi_rs);
+  _state_int_(pba->index_bi_tau);
+  _state_int_(pba->index_bi_growth);
+  _state_int_(pba->bi_B_size);
+  _state_int_(pba->bi_size);
+  _state_short_(pba->has_cdm);
+  _state_short_(pba->has_dcdm);
+  _state_short_(pba->has_dr);
+  _state_short_(pba->has_scf);
+  _state_short_(pba->has_ncdm);
+  _state_short_(pba->has_lambda);
+  _state_short_(pba->has_fld);
+  _state_short_(pba->has_ur);
+  _state_short_(pba->has_curvature);
+  _state_int_(pba->ncdm_bg_size_tot);
+  _state_short_(pba->short_info);
+  _state_short_(pba->normal_info);
+  _state_short_(pba->long_info);
+  _state_short_(pba->inter_normal);
+  _state_short_(pba->inter_closeby);
+  _state_short_(pba->shooting_failed);
+  _state_short_(pba->background_verbose);
+
+  if (pba->Omega0_scf != 0.) {
+    class_call(output_state_array(psb,(void**)&(pba->scf_parameters),pba->scf_parameters_size*sizeof(double),error_message),
+               error_message,
+               error_message);
+  }
+
+  if (pba->Omega0_ncdm_tot != 0.) {
+
+    class_call(output_state_array(psb,(void**)&(pba->M_ncdm),pba->N_ncdm*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->Omega0_ncdm),pba->N_ncdm*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->deg_ncdm),pba->N_ncdm*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->T_ncdm),pba->N_ncdm*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->ksi_ncdm),pba->N_ncdm*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->m_ncdm_in_eV),pba->N_ncdm*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->factor_ncdm),pba->N_ncdm*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->got_files),pba->N_ncdm*sizeof(int),error_message),
+               error_message,
+               error_message);
+
+    /* one name of _ARGUMENT_LENGTH_MAX_ characters per species read from a file, as in input_read_parameters() */
+    files = 0;
+    if (pba->got_files != NULL) {
+      for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+        if (pba->got_files[n_ncdm] == _TRUE_)
+          files++;
+      }
+    }
+    class_call(output_state_array(psb,(void**)&(pba->ncdm_psd_files),files*_ARGUMENT_LENGTH_MAX_*sizeof(char),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->ncdm_psd_parameters),pba->ncdm_psd_parameters_size*sizeof(double),error_message),
+               error_message,
+               error_message);
+
+    class_call(output_state_array(psb,(void**)&(pba->q_size_ncdm),pba->N_ncdm*sizeof(int),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pba->q_size_ncdm_bg),pba->N_ncdm*sizeof(int),error_message),
+               error_message,
+               error_message);
+
+    if (psb->unpack == _TRUE_) {
+      class_alloc(pba->q_ncdm,pba->N_ncdm*sizeof(double*),error_message);
+      class_alloc(pba->w_ncdm,pba->N_ncdm*sizeof(double*),error_message);
+      class_alloc(pba->dlnf0_dlnq_ncdm,pba->N_ncdm*sizeof(double*),error_message);
+      class_alloc(pba->q_ncdm_bg,pba->N_ncdm*sizeof(double*),error_message);
+      class_alloc(pba->w_ncdm_bg,pba->N_ncdm*sizeof(double*),error_message);
+    }
+
+    for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+      class_call(output_state_array(psb,(void**)&(pba->q_ncdm[n_ncdm]),pba->q_size_ncdm[n_ncdm]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(pba->w_ncdm[n_ncdm]),pba->q_size_ncdm[n_ncdm]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(pba->dlnf0_dlnq_ncdm[n_ncdm]),pba->q_size_ncdm[n_ncdm]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(pba->q_ncdm_bg[n_ncdm]),pba->q_size_ncdm_bg[n_ncdm]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(pba->w_ncdm_bg[n_ncdm]),pba->q_size_ncdm_bg[n_ncdm]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+    }
+  }
+
+  class_call(output_state_array(psb,(void**)&(pba->ncdm_bg_offset),pba->N_ncdm*sizeof(int),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pba->ncdm_bg_q2),4*pba->ncdm_bg_size_tot*sizeof(double),error_message),
+             error_message,
+             error_message);
+  if ((psb->unpack == _TRUE_) && (pba->ncdm_bg_q2 != NULL)) {
+    pba->ncdm_bg_w_q2 = pba->ncdm_bg_q2 + pba->ncdm_bg_size_tot;
+    pba->ncdm_bg_w_q4 = pba->ncdm_bg_w_q2 + pba->ncdm_bg_size_tot;
+    pba->ncdm_bg_w_q6 = pba->ncdm_bg_w_q4 + pba->ncdm_bg_size_tot;
+  }
+
+  class_call(output_state_array(psb,(void**)&(pba->tau_table),pba->bt_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pba->z_table),pba->bt_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pba->d2tau_dz2_table),pba->bt_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pba->background_table),pba->bt_size*pba->bg_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pba->d2background_dtau2_table),pba->bt_size*pba->bg_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pba->tau_lookup.index),pba->tau_lookup.n_bins*sizeof(int),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pba->z_lookup.index),pba->z_lookup.n_bins*sizeof(int),error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks the thermodynamics structure, with
+ * the parameters of binned and tanh reionization histories. The
+ * recombination cache and response, which belong to the caller, are
+ * not kept.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param pth           Input/Output: pointer to thermodynamics structure
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_thermodynamics(
+                                struct output_state_buffer * psb,
+                                struct thermo * pth,
+                                ErrorMsg error_message
+                                ) {
+
+  if (psb->unpack == _TRUE_)
+    memset(pth,0,sizeof(struct thermo));
+
+  _state_double_(pth->YHe);
+  _state_enum_(pth->recombination);
+  _state_enum_(pth->reio_parametrization);
+  _state_enum_(pth->reio_z_or_tau);
+  _state_double_(pth->tau_reio);
+  _state_double_(pth->z_reio);
+  _state_short_(pth->compute_cb2_derivatives);
+  _state_short_(pth->compute_damping_scale);
+  _state_double_(pth->reionization_width);
+  _state_double_(pth->reionization_exponent);
+  _state_double_(pth->helium_fullreio_redshift);
+  _state_double_(pth->helium_fullreio_width);
+  _state_int_(pth->binned_reio_num);
+  _state_double_(pth->binned_reio_step_sharpness);
+  _state_int_(pth->many_tanh_num);
+  _state_double_(pth->many_tanh_width);
+  _state_double_(pth->annihilation);
+  _state_short_(pth->has_on_the_spot);
+  _state_double_(pth->decay);
+  _state_double_(pth->annihilation_variation);
+  _state_double_(pth->annihilation_z);
+  _state_double_(pth->annihilation_zmax);
+  _state_double_(pth->annihilation_zmin);
+  _state_double_(pth->annihilation_f_halo);
+  _state_double_(pth->annihilation_z_halo);
+  _state_int_(pth->index_th_xe);
+  _state_int_(pth->index_th_dkappa);
+  _state_int_(pth->index_th_tau_d);
+  _state_int_(pth->index_th_ddkappa);
+  _state_int_(pth->index_th_dddkappa);
+  _state_int_(pth->index_th_exp_m_kappa);
+  _state_int_(pth->index_th_g);
+  _state_int_(pth->index_th_dg);
+  _state_int_(pth->index_th_ddg);
+  _state_int_(pth->index_th_Tb);
+  _state_int_(pth->index_th_cb2);
+  _state_int_(pth->index_th_dcb2);
+  _state_int_(pth->index_th_ddcb2);
+  _state_int_(pth->index_th_rate);
+  _state_int_(pth->index_th_r_d);
+  _state_int_(pth->th_size);
+  _state_int_(pth->tt_size);
+  _state_int_(pth->z_lookup.n_bins);
+  _state_double_(pth->z_lookup.u_min);
+  _state_double_(pth->z_lookup.inv_du);
+  _state_double_(pth->z_rec);
+  _state_double_(pth->tau_rec);
+  _state_double_(pth->rs_rec);
+  _state_double_(pth->ds_rec);
+  _state_double_(pth->ra_rec);
+  _state_double_(pth->da_rec);
+  _state_double_(pth->rd_rec);
+  _state_double_(pth->z_d);
+  _state_double_(pth->tau_d);
+  _state_double_(pth->ds_d);
+  _state_double_(pth->rs_d);
+  _state_double_(pth->tau_cut);
+  _state_double_(pth->angular_rescaling);
+  _state_double_(pth->tau_free_streaming);
+  _state_double_(pth->tau_ini);
+  _state_double_(pth->n_e);
+  _state_short_(pth->inter_normal);
+  _state_short_(pth->inter_closeby);
+  _state_short_(pth->thermodynamics_verbose);
+
+  class_call(output_state_array(psb,(void**)&(pth->binned_reio_z),pth->binned_reio_num*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pth->binned_reio_xe),pth->binned_reio_num*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pth->many_tanh_z),pth->many_tanh_num*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pth->many_tanh_xe),pth->many_tanh_num*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pth->z_table),pth->tt_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pth->thermodynamics_table),pth->tt_size*pth->th_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pth->d2thermodynamics_dz2_table),pth->tt_size*pth->th_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pth->z_lookup.index),pth->z_lookup.n_bins*sizeof(int),error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks the primordial structure. In
+ * 'external_Pk' mode, the command computing the spectrum is kept;
+ * a registered function is kept by its name, and found again if it
+ * is registered in the process unpacking the state (otherwise
+ * external_function is left to NULL: the tabulated spectra are enough
+ * for interpolation).
+ *
+ * @param psb           Input/Output: state buffer
+ * @param ppm           Input/Output: pointer to primordial structure
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_primordial(
+                            struct output_state_buffer * psb,
+                            struct primordial * ppm,
+                            ErrorMsg error_message
+                            ) {
+
+  int index_md;
+  char * function_name;
+
+  if (psb->unpack == _TRUE_)
+    memset(ppm,0,sizeof(struct primordial));
+
+  _state_double_(ppm->k_pivot);
+  _state_enum_(ppm->primordial_spec_type);
+  _state_double_(ppm->A_s);
+  _state_double_(ppm->n_s);
+  _state_double_(ppm->alpha_s);
+  _state_double_(ppm->beta_s);
+  _state_double_(ppm->r);
+  _state_double_(ppm->n_t);
+  _state_double_(ppm->alpha_t);
+  _state_double_(ppm->f_bi);
+  _state_double_(ppm->n_bi);
+  _state_double_(ppm->alpha_bi);
+  _state_double_(ppm->f_cdi);
+  _state_double_(ppm->n_cdi);
+  _state_double_(ppm->alpha_cdi);
+  _state_double_(ppm->f_nid);
+  _state_double_(ppm->n_nid);
+  _state_double_(ppm->alpha_nid);
+  _state_double_(ppm->f_niv);
+  _state_double_(ppm->n_niv);
+  _state_double_(ppm->alpha_niv);
+  _state_double_(ppm->c_ad_bi);
+  _state_double_(ppm->n_ad_bi);
+  _state_double_(ppm->alpha_ad_bi);
+  _state_double_(ppm->c_ad_cdi);
+  _state_double_(ppm->n_ad_cdi);
+  _state_double_(ppm->alpha_ad_cdi);
+  _state_double_(ppm->c_ad_nid);
+  _state_double_(ppm->n_ad_nid);
+  _state_double_(ppm->alpha_ad_nid);
+  _state_double_(ppm->c_ad_niv);
+  _state_double_(ppm->n_ad_niv);
+  _state_double_(ppm->alpha_ad_niv);
+  _state_double_(ppm->c_bi_cdi);
+  _state_double_(ppm->n_bi_cdi);
+  _state_double_(ppm->alpha_bi_cdi);
+  _state_double_(ppm->c_bi_nid);
+  _state_double_(ppm->n_bi_nid);
+  _state_double_(ppm->alpha_bi_nid);
+  _state_double_(ppm->c_bi_niv);
+  _state_double_(ppm->n_bi_niv);
+  _state_double_(ppm->alpha_bi_niv);
+  _state_double_(ppm->c_cdi_nid);
+  _state_double_(ppm->n_cdi_nid);
+  _state_double_(ppm->alpha_cdi_nid);
+  _state_double_(ppm->c_cdi_niv);
+  _state_double_(ppm->n_cdi_niv);
+  _state_double_(ppm->alpha_cdi_niv);
+  _state_double_(ppm->c_nid_niv);
+  _state_double_(ppm->n_nid_niv);
+  _state_double_(ppm->alpha_nid_niv);
+  _state_enum_(ppm->potential);
+  _state_double_(ppm->V0);
+  _state_double_(ppm->V1);
+  _state_double_(ppm->V2);
+  _state_double_(ppm->V3);
+  _state_double_(ppm->V4);
+  _state_double_(ppm->H0);
+  _state_double_(ppm->H1);
+  _state_double_(ppm->H2);
+  _state_double_(ppm->H3);
+  _state_double_(ppm->H4);
+  _state_double_(ppm->phi_end);
+  _state_enum_(ppm->phi_pivot_method);
+  _state_double_(ppm->phi_pivot_target);
+  _state_enum_(ppm->behavior);
+  _state_double_(ppm->custom1);
+  _state_double_(ppm->custom2);
+  _state_double_(ppm->custom3);
+  _state_double_(ppm->custom4);
+  _state_double_(ppm->custom5);
+  _state_double_(ppm->custom6);
+  _state_double_(ppm->custom7);
+  _state_double_(ppm->custom8);
+  _state_double_(ppm->custom9);
+  _state_double_(ppm->custom10);
+  _state_int_(ppm->md_size);
+  _state_int_(ppm->lnk_size);
+  _state_int_(ppm->index_in_a);
+  _state_int_(ppm->index_in_phi);
+  _state_int_(ppm->index_in_dphi);
+  _state_int_(ppm->index_in_ksi_re);
+  _state_int_(ppm->index_in_ksi_im);
+  _state_int_(ppm->index_in_dksi_re);
+  _state_int_(ppm->index_in_dksi_im);
+  _state_int_(ppm->index_in_ah_re);
+  _state_int_(ppm->index_in_ah_im);
+  _state_int_(ppm->index_in_dah_re);
+  _state_int_(ppm->index_in_dah_im);
+  _state_int_(ppm->in_bg_size);
+  _state_int_(ppm->in_size);
+  _state_double_(ppm->phi_pivot);
+  _state_double_(ppm->phi_min);
+  _state_double_(ppm->phi_max);
+  _state_double_(ppm->phi_stop);
+  _state_short_(ppm->primordial_verbose);
+
+  if (ppm->primordial_spec_type == external_Pk) {
+
+    function_name = NULL;
+    if (psb->unpack == _FALSE_) {
+      if (ppm->external_function != NULL)
+        function_name = (char *)ppm->external_function->name;
+    }
+    class_call(output_state_string(psb,&function_name,error_message),
+               error_message,
+               error_message);
+
+    /* the command is owned by the structure only without a function (see primordial_free()) */
+    if (function_name == NULL) {
+      class_call(output_state_string(psb,&(ppm->command),error_message),
+                 error_message,
+                 error_message);
+    }
+    else if (psb->unpack == _TRUE_) {
+      class_call(primordial_external_function_find(function_name,&(ppm->external_function)),
+                 error_message,
+                 error_message);
+      free(function_name);
+    }
+  }
+
+  if (ppm->lnk_size == 0)
+    return _SUCCESS_;
+
+  class_call(output_state_array(psb,(void**)&(ppm->ic_size),ppm->md_size*sizeof(int),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(ppm->ic_ic_size),ppm->md_size*sizeof(int),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(ppm->lnk),ppm->lnk_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+
+  if (psb->unpack == _TRUE_) {
+    class_alloc(ppm->lnpk,ppm->md_size*sizeof(double*),error_message);
+    class_alloc(ppm->ddlnpk,ppm->md_size*sizeof(double*),error_message);
+    class_alloc(ppm->is_non_zero,ppm->md_size*sizeof(short*),error_message);
+    if (ppm->primordial_spec_type == analytic_Pk) {
+      class_alloc(ppm->amplitude,ppm->md_size*sizeof(double*),error_message);
+      class_alloc(ppm->tilt,ppm->md_size*sizeof(double*),error_message);
+      class_alloc(ppm->running,ppm->md_size*sizeof(double*),error_message);
+    }
+  }
+
+  for (index_md = 0; index_md < ppm->md_size; index_md++) {
+    class_call(output_state_array(psb,(void**)&(ppm->lnpk[index_md]),ppm->lnk_size*ppm->ic_ic_size[index_md]*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(ppm->ddlnpk[index_md]),ppm->lnk_size*ppm->ic_ic_size[index_md]*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(ppm->is_non_zero[index_md]),ppm->ic_ic_size[index_md]*sizeof(short),error_message),
+               error_message,
+               error_message);
+    if (ppm->primordial_spec_type == analytic_Pk) {
+      class_call(output_state_array(psb,(void**)&(ppm->amplitude[index_md]),ppm->ic_ic_size[index_md]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(ppm->tilt[index_md]),ppm->ic_ic_size[index_md]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(ppm->running[index_md]),ppm->ic_ic_size[index_md]*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks the nonlinear structure. The engine
+ * and its workspace are not kept: the non-linear spectra themselves
+ * are stored in the spectra structure.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param pnl           Input/Output: pointer to nonlinear structure
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_nonlinear(
+                           struct output_state_buffer * psb,
+                           struct nonlinear * pnl,
+                           ErrorMsg error_message
+                           ) {
+
+  if (psb->unpack == _TRUE_)
+    memset(pnl,0,sizeof(struct nonlinear));
+
+  _state_enum_(pnl->method);
+  _state_int_(pnl->k_size);
+  _state_int_(pnl->tau_size);
+  _state_int_(pnl->sigma_k_size);
+  _state_int_(pnl->sigma_r_size);
+  _state_short_(pnl->nonlinear_verbose);
+
+  if ((pnl->method != nl_halofit) && (pnl->method != nl_engine))
+    return _SUCCESS_;
+
+  class_call(output_state_array(psb,(void**)&(pnl->k),pnl->k_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pnl->tau),pnl->tau_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pnl->nl_corr_density),pnl->tau_size*pnl->k_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(pnl->k_nl),pnl->tau_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+
+  if (pnl->sigma_r_size > 0) {
+    class_call(output_state_array(psb,(void**)&(pnl->sigma_logr),pnl->sigma_r_size*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(pnl->sigma_kernel),pnl->sigma_r_size*3*pnl->sigma_k_size*sizeof(double),error_message),
+               error_message,
+               error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks the spectra structure: the \f$ C_l\f$
+ * tables (including the dense ones), the matter power spectra, the
+ * correlation functions and the matter transfer functions, when they
+ * have been computed.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param psp           Input/Output: pointer to spectra structure
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_spectra(
+                         struct output_state_buffer * psb,
+                         struct spectra * psp,
+                         ErrorMsg error_message
+                         ) {
+
+  int index_md;
+  size_t pk_size;
+
+  if (psb->unpack == _TRUE_)
+    memset(psp,0,sizeof(struct spectra));
+
+  _state_double_(psp->z_max_pk);
+  _state_int_(psp->non_diag);
+  _state_int_(psp->md_size);
+  _state_int_(psp->index_md_scalars);
+  _state_int_(psp->has_tt);
+  _state_int_(psp->has_ee);
+  _state_int_(psp->has_tb);
+  _state_int_(psp->has_eb);
+  _state_int_(psp->has_te);
+  _state_int_(psp->has_bb);
+  _state_int_(psp->has_pp);
+  _state_int_(psp->has_tp);
+  _state_int_(psp->has_ep);
+  _state_int_(psp->has_dd);
+  _state_int_(psp->has_td);
+  _state_int_(psp->has_pd);
+  _state_int_(psp->has_ll);
+  _state_int_(psp->has_tl);
+  _state_int_(psp->has_dl);
+  _state_int_(psp->index_ct_tt);
+  _state_int_(psp->index_ct_ee);
+  _state_int_(psp->index_ct_tb);
+  _state_int_(psp->index_ct_eb);
+  _state_int_(psp->index_ct_te);
+  _state_int_(psp->index_ct_bb);
+  _state_int_(psp->index_ct_pp);
+  _state_int_(psp->index_ct_tp);
+  _state_int_(psp->index_ct_ep);
+  _state_int_(psp->index_ct_dd);
+  _state_int_(psp->index_ct_td);
+  _state_int_(psp->index_ct_pd);
+  _state_int_(psp->index_ct_ll);
+  _state_int_(psp->index_ct_tl);
+  _state_int_(psp->index_ct_dl);
+  _state_int_(psp->d_size);
+  _state_int_(psp->ct_size);
+  _state_int_(psp->l_size_max);
+  _state_int_(psp->l_max_tot);
+  _state_double_(psp->alpha_II_2_20);
+  _state_double_(psp->alpha_RI_2_20);
+  _state_double_(psp->alpha_RR_2_20);
+  _state_double_(psp->alpha_II_21_200);
+  _state_double_(psp->alpha_RI_21_200);
+  _state_double_(psp->alpha_RR_21_200);
+  _state_double_(psp->alpha_II_201_2500);
+  _state_double_(psp->alpha_RI_201_2500);
+  _state_double_(psp->alpha_RR_201_2500);
+  _state_double_(psp->alpha_II_2_2500);
+  _state_double_(psp->alpha_RI_2_2500);
+  _state_double_(psp->alpha_RR_2_2500);
+  _state_double_(psp->alpha_kp);
+  _state_double_(psp->alpha_k1);
+  _state_double_(psp->alpha_k2);
+  _state_int_(psp->ln_k_size);
+  _state_int_(psp->ln_tau_size);
+  _state_double_(psp->chiral_par);
+  _state_double_(psp->sigma8);
+  _state_short_(psp->has_correlations);
+  _state_int_(psp->ln_r_size);
+  _state_int_(psp->index_tr_delta_g);
+  _state_int_(psp->index_tr_delta_b);
+  _state_int_(psp->index_tr_delta_cdm);
+  _state_int_(psp->index_tr_delta_dcdm);
+  _state_int_(psp->index_tr_delta_scf);
+  _state_int_(psp->index_tr_delta_fld);
+  _state_int_(psp->index_tr_delta_ur);
+  _state_int_(psp->index_tr_delta_dr);
+  _state_int_(psp->index_tr_delta_ncdm1);
+  _state_int_(psp->index_tr_delta_tot);
+  _state_int_(psp->index_tr_theta_g);
+  _state_int_(psp->index_tr_theta_b);
+  _state_int_(psp->index_tr_theta_cdm);
+  _state_int_(psp->index_tr_theta_dcdm);
+  _state_int_(psp->index_tr_theta_scf);
+  _state_int_(psp->index_tr_theta_fld);
+  _state_int_(psp->index_tr_theta_ur);
+  _state_int_(psp->index_tr_theta_dr);
+  _state_int_(psp->index_tr_theta_ncdm1);
+  _state_int_(psp->index_tr_theta_tot);
+  _state_int_(psp->index_tr_phi);
+  _state_int_(psp->index_tr_psi);
+  _state_int_(psp->tr_size);
+  _state_short_(psp->spectra_verbose);
+
+  class_call(output_state_array(psb,(void**)&(psp->ic_size),psp->md_size*sizeof(int),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(psp->ic_ic_size),psp->md_size*sizeof(int),error_message),
+             error_message,
+             error_message);
+
+  if (psb->unpack == _TRUE_)
+    class_alloc(psp->is_non_zero,psp->md_size*sizeof(short*),error_message);
+
+  for (index_md = 0; index_md < psp->md_size; index_md++) {
+    class_call(output_state_array(psb,(void**)&(psp->is_non_zero[index_md]),psp->ic_ic_size[index_md]*sizeof(short),error_message),
+               error_message,
+               error_message);
+  }
+
+  if ((psp->md_size > 0) && (psp->ct_size > 0)) {
+
+    class_call(output_state_array(psb,(void**)&(psp->l_size),psp->md_size*sizeof(int),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(psp->l_max),psp->md_size*sizeof(int),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(psp->l),psp->l_size_max*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(psp->cl_tot_dense),(psp->l_max_tot+1)*psp->ct_size*sizeof(double),error_message),
+               error_message,
+               error_message);
+
+    if (psb->unpack == _TRUE_) {
+      class_alloc(psp->l_max_ct,psp->md_size*sizeof(int*),error_message);
+      class_alloc(psp->cl,psp->md_size*sizeof(double*),error_message);
+      class_alloc(psp->ddcl,psp->md_size*sizeof(double*),error_message);
+      if (psp->cl_tot_dense != NULL) {
+        class_calloc(psp->cl_md_dense,psp->md_size,sizeof(double*),error_message);
+        class_calloc(psp->cl_md_ic_dense,psp->md_size,sizeof(double*),error_message);
+      }
+    }
+
+    for (index_md = 0; index_md < psp->md_size; index_md++) {
+      class_call(output_state_array(psb,(void**)&(psp->l_max_ct[index_md]),psp->ct_size*sizeof(int),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(psp->cl[index_md]),psp->l_size[index_md]*psp->ic_ic_size[index_md]*psp->ct_size*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      class_call(output_state_array(psb,(void**)&(psp->ddcl[index_md]),psp->l_size[index_md]*psp->ic_ic_size[index_md]*psp->ct_size*sizeof(double),error_message),
+                 error_message,
+                 error_message);
+      if (psp->cl_tot_dense != NULL) {
+        if (psp->md_size > 1)
+          class_call(output_state_array(psb,(void**)&(psp->cl_md_dense[index_md]),(psp->l_max_tot+1)*psp->ct_size*sizeof(double),error_message),
+                     error_message,
+                     error_message);
+        if (psp->ic_size[index_md] > 1)
+          class_call(output_state_array(psb,(void**)&(psp->cl_md_ic_dense[index_md]),(psp->l_max_tot+1)*psp->ic_ic_size[index_md]*psp->ct_size*sizeof(double),error_message),
+                     error_message,
+                     error_message);
+      }
+    }
+  }
+
+  if ((psp->md_size > 0) && (psp->ln_k_size > 0)) {
+
+    pk_size = psp->ln_tau_size*psp->ln_k_size*sizeof(double);
+
+    class_call(output_state_array(psb,(void**)&(psp->ln_tau),psp->ln_tau_size*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(psp->ln_k),psp->ln_k_size*sizeof(double),error_message),
+               error_message,
+               error_message);
+    class_call(output_state_array(psb,(void**)&(psp->ln_pk),pk_size*psp->ic_ic_size[psp->index_md_scalars],error_message),
+               error_message,
+               error_message);
+
+    if (psp->ln_pk != NULL) {
+
+      if (psp->ln_tau_size > 1)
+        class_call(output_state_array(psb,(void**)&(psp->ddln_pk),pk_size*psp->ic_ic_size[psp->index_md_scalars],error_message),
+                   error_message,
+                   error_message);
+
+      class_call(output_state_array(psb,(void**)&(psp->ln_pk_nl),pk_size,error_message),
+                 error_message,
+                 error_message);
+      if ((psp->ln_pk_nl != NULL) && (psp->ln_tau_size > 1))
+        class_call(output_state_array(psb,(void**)&(psp->ddln_pk_nl),pk_size,error_message),
+                   error_message,
+                   error_message);
+
+      if (psp->has_correlations == _TRUE_) {
+        class_call(output_state_array(psb,(void**)&(psp->ln_r),psp->ln_r_size*sizeof(double),error_message),
+                   error_message,
+                   error_message);
+        class_call(output_state_array(psb,(void**)&(psp->xi),psp->ln_tau_size*psp->ln_r_size*sizeof(double),error_message),
+                   error_message,
+                   error_message);
+        class_call(output_state_array(psb,(void**)&(psp->sigma_r),psp->ln_tau_size*psp->ln_r_size*sizeof(double),error_message),
+                   error_message,
+                   error_message);
+        if (psp->ln_tau_size > 1) {
+          class_call(output_state_array(psb,(void**)&(psp->ddxi),psp->ln_tau_size*psp->ln_r_size*sizeof(double),error_message),
+                     error_message,
+                     error_message);
+          class_call(output_state_array(psb,(void**)&(psp->ddsigma_r),psp->ln_tau_size*psp->ln_r_size*sizeof(double),error_message),
+                     error_message,
+                     error_message);
+        }
+      }
+    }
+
+    class_call(output_state_array(psb,(void**)&(psp->matter_transfer),pk_size*psp->ic_size[psp->index_md_scalars]*psp->tr_size,error_message),
+               error_message,
+               error_message);
+    if ((psp->matter_transfer != NULL) && (psp->ln_tau_size > 1))
+      class_call(output_state_array(psb,(void**)&(psp->ddmatter_transfer),pk_size*psp->ic_size[psp->index_md_scalars]*psp->tr_size,error_message),
+                 error_message,
+                 error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs or unpacks the lensing structure.
+ *
+ * @param psb           Input/Output: state buffer
+ * @param ple           Input/Output: pointer to lensing structure
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_lensing(
+                         struct output_state_buffer * psb,
+                         struct lensing * ple,
+                         ErrorMsg error_message
+                         ) {
+
+  if (psb->unpack == _TRUE_)
+    memset(ple,0,sizeof(struct lensing));
+
+  _state_short_(ple->has_lensed_cls);
+  _state_int_(ple->has_tt);
+  _state_int_(ple->has_ee);
+  _state_int_(ple->has_te);
+  _state_int_(ple->has_bb);
+  _state_int_(ple->has_pp);
+  _state_int_(ple->has_tp);
+  _state_int_(ple->has_dd);
+  _state_int_(ple->has_td);
+  _state_int_(ple->has_ll);
+  _state_int_(ple->has_tl);
+  _state_int_(ple->has_tb);
+  _state_int_(ple->has_eb);
+  _state_int_(ple->index_lt_tt);
+  _state_int_(ple->index_lt_ee);
+  _state_int_(ple->index_lt_te);
+  _state_int_(ple->index_lt_bb);
+  _state_int_(ple->index_lt_pp);
+  _state_int_(ple->index_lt_tp);
+  _state_int_(ple->index_lt_dd);
+  _state_int_(ple->index_lt_td);
+  _state_int_(ple->index_lt_ll);
+  _state_int_(ple->index_lt_tl);
+  _state_int_(ple->index_lt_tb);
+  _state_int_(ple->index_lt_eb);
+  _state_int_(ple->lt_size);
+  _state_int_(ple->l_unlensed_max);
+  _state_int_(ple->l_lensed_max);
+  _state_int_(ple->l_size);
+  _state_short_(ple->lensing_verbose);
+
+  if (ple->has_lensed_cls == _FALSE_)
+    return _SUCCESS_;
+
+  class_call(output_state_array(psb,(void**)&(ple->l_max_lt),ple->lt_size*sizeof(int),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(ple->l),ple->l_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(ple->cl_lens),ple->l_size*ple->lt_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(ple->ddcl_lens),ple->l_size*ple->lt_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+  class_call(output_state_array(psb,(void**)&(ple->cl_lens_dense),(ple->l_lensed_max+1)*ple->lt_size*sizeof(double),error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+}
+
+#undef _state_short_
+#undef _state_int_
+#undef _state_double_
+#undef _state_enum_
+
+/**
+ * This routine packs or unpacks the header of a state, followed by
+ * each structure flagged in has_module (see output.h for the order).
+ *
+ * @param psb           Input/Output: state buffer
+ * @param has_module    Input/Output: flags of the structures contained in the state
+ * @param pba           Input/Output: pointer to background structure
+ * @param pth           Input/Output: pointer to thermodynamics structure
+ * @param ppm           Input/Output: pointer to primordial structure
+ * @param pnl           Input/Output: pointer to nonlinear structure
+ * @param psp           Input/Output: pointer to spectra structure
+ * @param ple           Input/Output: pointer to lensing structure
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_all(
+                     struct output_state_buffer * psb,
+                     short * has_module,
+                     struct background * pba,
+                     struct thermo * pth,
+                     struct primordial * ppm,
+                     struct nonlinear * pnl,
+                     struct spectra * psp,
+                     struct lensing * ple,
+                     ErrorMsg error_message
+                     ) {
+
+  char magic[8];
+  uint32_t byte_order;
+  int32_t version;
+  uint8_t type_size[3];
+  uint8_t type_size_stored[3];
+  void * pstruct[_STATE_MODULES_];
+  int index_module;
+
+  pstruct[0] = pba;
+  pstruct[1] = pth;
+  pstruct[2] = ppm;
+  pstruct[3] = pnl;
+  pstruct[4] = psp;
+  pstruct[5] = ple;
+
+  /* the tables are stored as arrays of these types */
+  type_size[0] = sizeof(short);
+  type_size[1] = sizeof(int);
+  type_size[2] = sizeof(double);
+
+  memcpy(magic,_STATE_MAGIC_,8);
+  byte_order = _STATE_BYTE_ORDER_;
+  version = _STATE_VERSION_;
+  memcpy(type_size_stored,type_size,sizeof(type_size));
+
+  class_call(output_state_bytes(psb,magic,8,error_message),
+             error_message,
+             error_message);
+  class_test(memcmp(magic,_STATE_MAGIC_,8) != 0,
+             error_message,
+             "this buffer does not contain a state of CLASS");
+
+  class_call(output_state_bytes(psb,&byte_order,sizeof(uint32_t),error_message),
+             error_message,
+             error_message);
+  class_test(byte_order != _STATE_BYTE_ORDER_,
+             error_message,
+             "state written on a machine with another byte order");
+
+  class_call(output_state_bytes(psb,&version,sizeof(int32_t),error_message),
+             error_message,
+             error_message);
+  class_test(version != _STATE_VERSION_,
+             error_message,
+             "state written with version %d of the format, while this code reads version %d",
+             version,_STATE_VERSION_);
+
+  class_call(output_state_bytes(psb,type_size_stored,sizeof(type_size_stored),error_message),
+             error_message,
+             error_message);
+  class_test(memcmp(type_size_stored,type_size,sizeof(type_size)) != 0,
+             error_message,
+             "state written on a machine with %d-byte short, %d-byte int and %d-byte double, instead of %d, %d and %d",
+             type_size_stored[0],type_size_stored[1],type_size_stored[2],
+             type_size[0],type_size[1],type_size[2]);
+
+  for (index_module=0; index_module<_STATE_MODULES_; index_module++) {
+    class_call(output_state_short(psb,&(has_module[index_module]),error_message),
+               error_message,
+               error_message);
+    class_test((has_module[index_module] == _TRUE_) && (pstruct[index_module] == NULL),
+               error_message,
+               "the state contains structure %d, but no structure was passed to restore it",
+               index_module);
+  }
+
+  if (has_module[0] == _TRUE_)
+    class_call(output_state_background(psb,pba,error_message),
+               error_message,
+               error_message);
+  if (has_module[1] == _TRUE_)
+    class_call(output_state_thermodynamics(psb,pth,error_message),
+               error_message,
+               error_message);
+  if (has_module[2] == _TRUE_)
+    class_call(output_state_primordial(psb,ppm,error_message),
+               error_message,
+               error_message);
+  if (has_module[3] == _TRUE_)
+    class_call(output_state_nonlinear(psb,pnl,error_message),
+               error_message,
+               error_message);
+  if (has_module[4] == _TRUE_)
+    class_call(output_state_spectra(psb,psp,error_message),
+               error_message,
+               error_message);
+  if (has_module[5] == _TRUE_)
+    class_call(output_state_lensing(psb,ple,error_message),
+               error_message,
+               error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine packs the results of a run into a single buffer, from
+ * which output_state_unpack() can restore them later in other
+ * structures (possibly in another process), without computing
+ * anything. Pass NULL for the structures that were not computed.
+ *
+ * The buffer contains the fields of the structures one by one,
+ * followed by the tables they point to (see output.h): it can be
+ * unpacked by another build of CLASS reading the same version of the
+ * format, on a machine with the same byte order and sizes of numbers.
+ *
+ * @param pba           Input: pointer to background structure (or NULL)
+ * @param pth           Input: pointer to thermodynamics structure (or NULL)
+ * @param ppm           Input: pointer to primordial structure (or NULL)
+ * @param pnl           Input: pointer to nonlinear structure (or NULL)
+ * @param psp           Input: pointer to spectra structure (or NULL)
+ * @param ple           Input: pointer to lensing structure (or NULL)
+ * @param state         Output: buffer allocated here, to be freed by the caller
+ * @param state_size    Output: size of the buffer in bytes
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_pack(
+                      struct background * pba,
+                      struct thermo * pth,
+                      struct primordial * ppm,
+                      struct nonlinear * pnl,
+                      struct spectra * psp,
+                      struct lensing * ple,
+                      char ** state,
+                      size_t * state_size,
+                      ErrorMsg error_message
+                      ) {
+
+  struct output_state_buffer sb;
+  short has_module[_STATE_MODULES_];
+
+  has_module[0] = (pba != NULL);
+  has_module[1] = (pth != NULL);
+  has_module[2] = (ppm != NULL);
+  has_module[3] = (pnl != NULL);
+  has_module[4] = (psp != NULL);
+  has_module[5] = (ple != NULL);
+
+  sb.unpack = _FALSE_;
+  sb.size = 0;
+  sb.position = 0;
+  sb.capacity = 0;
+  sb.data = NULL;
+
+  if (output_state_all(&sb,has_module,pba,pth,ppm,pnl,psp,ple,error_message) == _FAILURE_) {
+    free(sb.data);
+    return _FAILURE_;
+  }
+
+  *state = sb.data;
+  *state_size = sb.size;
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine restores in fresh structures the results packed by
+ * output_state_pack(). The tables are allocated here: release them
+ * with output_state_free(), not with the free() routines of each
+ * module. Structures that were not in the state are left untouched.
+ *
+ * @param state         Input: buffer written by output_state_pack()
+ * @param state_size    Input: size of the buffer in bytes
+ * @param pba           Output: pointer to background structure (or NULL)
+ * @param pth           Output: pointer to thermodynamics structure (or NULL)
+ * @param ppm           Output: pointer to primordial structure (or NULL)
+ * @param pnl           Output: pointer to nonlinear structure (or NULL)
+ * @param psp           Output: pointer to spectra structure (or NULL)
+ * @param ple           Output: pointer to lensing structure (or NULL)
+ * @param has_module    Output: flags of the restored structures, in the order above (_STATE_MODULES_ values, or NULL)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_state_unpack(
+                        char * state,
+                        size_t state_size,
+                        struct background * pba,
+                        struct thermo * pth,
+                        struct primordial * ppm,
+                        struct nonlinear * pnl,
+                        struct spectra * psp,
+                        struct lensing * ple,
+                        short * has_module,
+                        ErrorMsg error_message
+                        ) {
+
+  struct output_state_buffer sb;
+  short has_module_local[_STATE_MODULES_];
+
+  sb.unpack = _TRUE_;
+  sb.size = state_size;
+  sb.position = 0;
+  sb.capacity = state_size;
+  sb.data = state;
+
+  class_call(output_state_all(&sb,has_module_local,pba,pth,ppm,pnl,psp,ple,error_message),
+             error_message,
+             error_message);
+
+  class_test(sb.position != sb.size,
+             error_message,
+             "%zu unexpected bytes at the end of the state",
+             sb.size-sb.position);
+
+  if (has_module != NULL)
+    memcpy(has_module,has_module_local,sizeof(has_module_local));
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine frees the tables of structures restored by
+ * output_state_unpack(). Pass NULL for the structures that were not
+ * in the state.
+ *
+ * @param pba Input: pointer to background structure (or NULL)
+ * @param pth Input: pointer to thermodynamics structure (or NULL)
+ * @param ppm Input: pointer to primordial structure (or NULL)
+ * @param pnl Input: pointer to nonlinear structure (or NULL)
+ * @param psp Input: pointer to spectra structure (or NULL)
+ * @param ple Input: pointer to lensing structure (or NULL)
+ * @return the error status
+ */
+
+int output_state_free(
+                      struct background * pba,
+                      struct thermo * pth,
+                      struct primordial * ppm,
+                      struct nonlinear * pnl,
+                      struct spectra * psp,
+                      struct lensing * ple
+                      ) {
+
+  if (ple != NULL)
+    lensing_free(ple);
+
+  if (psp != NULL)
+    spectra_free(psp);
+
+  /* not nonlinear_free(), which would call the engine */
+  if (pnl != NULL) {
+    free(pnl->k);
+    free(pnl->tau);
+    free(pnl->nl_corr_density);
+    free(pnl->k_nl);
+    free(pnl->sigma_logr);
+    free(pnl->sigma_kernel);
+  }
+
+  if (ppm != NULL)
+    primordial_free(ppm);
+
+  if (pth != NULL) {
+    thermodynamics_free(pth);
+    /* allocated by input_read_parameters() in a run, but here by output_state_unpack() */
+    free(pth->binned_reio_z);
+    free(pth->binned_reio_xe);
+    free(pth->many_tanh_z);
+    free(pth->many_tanh_xe);
+  }
+
+  if (pba != NULL)
+    background_free(pba);
+
+  return _SUCCESS_;
+}
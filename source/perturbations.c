@@ -25,6 +25,8 @@
  */
 
 #include "perturbations.h"
+#include "binary_output.h" /* binary record layout of streamed perturbations */
+#include "spectra.h" /* for spectra_firstline_and_ic_suffix() */
 
 
 /**
@@ -54,20 +56,36 @@ int perturb_sources_at_tau(
 
   /** Summary: */
 
-  /** - interpolate in pre-computed table contained in ppt */
-  class_call(array_interpolate_two_bis(ppt->tau_sampling,
-                                       1,
-                                       0,
-                                       ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type],
-                                       ppt->k_size[index_md],
-                                       ppt->tau_size,
-                                       tau,
-                                       psource,
-                                       ppt->k_size[index_md],
-                                       ppt->error_message),
+  int inf,sup,mid,index_k;
+  double weight;
+  source_t * source;
+
+  class_test(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type] == NULL,
              ppt->error_message,
-             ppt->error_message);
+             "the source functions have been freed by perturb_free_sources() (low-memory mode)");
+
+  /** - interpolate linearly in pre-computed table contained in ppt
+      (the generic array tools cannot be used, since the table can be
+      tiled or in single precision) */
+  class_test((tau < ppt->tau_sampling[0]) || (tau > ppt->tau_sampling[ppt->tau_size-1]),
+             ppt->error_message,
+             "tau=%e out of the range of sampled times [%e, %e]",
+             tau,ppt->tau_sampling[0],ppt->tau_sampling[ppt->tau_size-1]);
+
+  inf=0;
+  sup=ppt->tau_size-1;
+  while (sup-inf > 1) {
+    mid=(inf+sup)/2;
+    if (tau < ppt->tau_sampling[mid]) {sup=mid;}
+    else {inf=mid;}
+  }
+
+  weight = (tau-ppt->tau_sampling[inf])/(ppt->tau_sampling[sup]-ppt->tau_sampling[inf]);
+  source = ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type];
 
+  for (index_k=0; index_k<ppt->k_size[index_md]; index_k++)
+    psource[index_k] = (1.-weight)*source[_source_index_(inf,index_k)]
+      + weight*source[_source_index_(sup,index_k)];
 
   return _SUCCESS_;
 }
@@ -88,6 +106,12 @@ int perturb_sources_at_tau(
  *   relevant perturbations, integrate the differential system,
  *   compute and store the source functions.
  *
+ * The first two steps are performed by perturb_init_indices() and
+ * the last one by perturb_init_sources(), so that the driver (see
+ * driver.h) can start the modules which only need the indices
+ * (primordial, flat Bessel functions of the transfer module) while
+ * the sources are computed.
+ *
  * @param ppr Input: pointer to precision structure
  * @param pba Input: pointer to background structure
  * @param pth Input: pointer to thermodynamics structure
@@ -102,43 +126,47 @@ int perturb_init(
                  struct perturbs * ppt
                  ) {
 
-  /** Summary: */
+  class_call(perturb_init_indices(ppr,pba,pth,ppt),
+             ppt->error_message,
+             ppt->error_message);
 
-  /** - define local variables */
+  class_call(perturb_init_sources(ppr,pba,pth,ppt),
+             ppt->error_message,
+             ppt->error_message);
 
-  /* running index for modes */
-  int index_md;
-  /* running index for initial conditions */
-  int index_ic;
-  /* running index for wavenumbers */
-  int index_k;
-  /* pointer to one struct perturb_workspace per thread (one if no openmp) */
-  struct perturb_workspace ** pppw;
-  /* number of threads (always one if no openmp) */
-  int number_of_threads=1;
-  /* index of the thread (always 0 if no openmp) */
-  int thread=0;
+  return _SUCCESS_;
+}
 
-  /* This code can be optionally compiled with the openmp option for parallel computation.
-     Inside parallel regions, the use of the command "return" is forbidden.
-     For error management, instead of "return _FAILURE_", we will set the variable below
-     to "abort = _TRUE_". This will lead to a "return _FAILURE_" just after leaving the
-     parallel region. */
-  int abort;
+/**
+ * First step of perturb_init(): check the input, initialize all
+ * indices and the list of wavenumbers, and define the time sampling
+ * of the sources. After this step, ppt contains everything needed by
+ * primordial_init() and by transfer_init_bessel(), but no sources.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Output: perturbation structure with indices and sampling
+ * @return the error status
+ */
 
-  /* unsigned integer that will be set to the size of the workspace */
-  size_t sz;
+int perturb_init_indices(
+                         struct precision * ppr,
+                         struct background * pba,
+                         struct thermo * pth,
+                         struct perturbs * ppt
+                         ) {
 
-#ifdef _OPENMP
-  /* instrumentation times */
-  double tstart, tstop, tspent;
-#endif
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(ppt->profile));
 
   /** - perform preliminary checks */
 
   if (ppt->has_perturbations == _FALSE_) {
     if (ppt->perturbations_verbose > 0)
       printf("No sources requested. Perturbation module skipped.\n");
+    class_profile_stop(&(ppt->profile));
     return _SUCCESS_;
   }
   else {
@@ -275,6 +303,98 @@ int perturb_init(
              ppt->error_message,
              ppt->error_message);
 
+  class_profile_stop(&(ppt->profile));
+  return _SUCCESS_;
+}
+
+/**
+ * Second step of perturb_init(): integrate the differential system
+ * for each mode, initial condition and wavenumber, and store the
+ * source functions. To be called after perturb_init_indices().
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input/Output: perturbation structure, filled with the sources
+ * @return the error status
+ */
+
+int perturb_init_sources(
+                         struct precision * ppr,
+                         struct background * pba,
+                         struct thermo * pth,
+                         struct perturbs * ppt
+                         ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  /* running index for modes */
+  int index_md;
+  /* running index for wavenumbers */
+  int index_k;
+  /* running indices for initial conditions and types of sources */
+  int index_ic,index_type;
+  /* pointer to one struct perturb_workspace per mode and per thread (one per mode if no openmp) */
+  struct perturb_workspace *** pppw;
+  /* number of threads (always one if no openmp) */
+  int number_of_threads=1;
+  /* index of the thread (always 0 if no openmp) */
+  int thread=0;
+
+  /* This code can be optionally compiled with the openmp option for parallel computation.
+     Inside parallel regions, the use of the command "return" is forbidden.
+     For error management, instead of "return _FAILURE_", we will set the variable below
+     to "abort = _TRUE_". This will lead to a "return _FAILURE_" just after leaving the
+     parallel region. */
+  int abort;
+
+  /* unsigned integer that will be set to the size of the workspace */
+  size_t sz;
+
+  /* index of this MPI process, and number of processes sharing the
+     wavenumbers (always 0 and 1 if compiled without MPI) */
+  int process=0;
+  int number_of_processes=1;
+  /* first row of ppt->profile_data for a given mode */
+  int profile_row;
+  /* range of modes integrated in the same pool of tasks */
+  int index_md_first,index_md_last,index_md_previous;
+  /* for each mode, flags for the wavenumbers to integrate in the
+     current pass, and for those already integrated in previous passes */
+  short ** k_todo;
+  short ** k_done;
+  /* number of wavenumbers added for the next pass by the adaptive
+     sampling, in total and for one mode */
+  int number_of_new_k;
+  int number_of_new_k_md;
+#ifdef WITH_MPI
+  int mpi_initialized;
+#endif
+
+  if (ppt->has_perturbations == _FALSE_)
+    return _SUCCESS_;
+
+  /** - resume measuring the resources used by this module */
+
+  class_profile_resume(&(ppt->profile));
+
+  /** - place the pages of the source tables near the threads
+      integrating the corresponding wavenumbers */
+
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+      for (index_type = 0; index_type < ppt->tp_size[index_md]; index_type++) {
+        class_call(perturb_sources_first_touch(ppr,
+                                               ppt,
+                                               index_md,
+                                               ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type]),
+                   ppt->error_message,
+                   ppt->error_message);
+      }
+    }
+  }
 
   /** - create an array of workspaces in multi-thread case */
 
@@ -286,128 +406,221 @@ int perturb_init(
   }
 #endif
 
-  class_alloc(pppw,number_of_threads * sizeof(struct perturb_workspace *),ppt->error_message);
-
-  /** - loop over modes (scalar, tensors, etc). For each mode: */
+#ifdef WITH_MPI
+  MPI_Initialized(&mpi_initialized);
+  if (mpi_initialized) {
+    MPI_Comm_rank(MPI_COMM_WORLD,&process);
+    MPI_Comm_size(MPI_COMM_WORLD,&number_of_processes);
+  }
+#endif
 
-  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+  class_alloc(pppw,ppt->md_size * sizeof(struct perturb_workspace **),ppt->error_message);
+  for (index_md = 0; index_md < ppt->md_size; index_md++)
+    class_alloc(pppw[index_md],number_of_threads * sizeof(struct perturb_workspace *),ppt->error_message);
 
-    if (ppt->perturbations_verbose > 1)
-      printf("Evolving mode %d/%d\n",index_md+1,ppt->md_size);
+  if (ppt->workspace_pool != NULL) {
+    class_call(perturb_workspace_pool_resize(ppt->workspace_pool,
+                                             ppt->md_size,
+                                             number_of_threads,
+                                             ppt->error_message),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
-    abort = _FALSE_;
+  abort = _FALSE_;
 
-    sz = sizeof(struct perturb_workspace);
+  sz = sizeof(struct perturb_workspace);
 
 #pragma omp parallel                                             \
-  shared(pppw,ppr,pba,pth,ppt,index_md,abort,number_of_threads)  \
-  private(thread)                                                \
+  shared(pppw,ppr,pba,pth,ppt,abort,number_of_threads,sz)        \
+  private(index_md,thread)                                       \
   num_threads(number_of_threads)
 
-    {
+  {
 
 #ifdef _OPENMP
-      thread=omp_get_thread_num();
+    thread=omp_get_thread_num();
 #endif
 
-      /** - --> (a) create a workspace (one per thread in multi-thread case) */
+    for (index_md = 0; index_md < ppt->md_size; index_md++) {
 
-      class_alloc_parallel(pppw[thread],sz,ppt->error_message);
+      /** - --> (a) for each mode, create a workspace (one per thread in
+          multi-thread case), or recycle the one left in the pool by a
+          previous run */
 
-      /** - --> (b) initialize indices of vectors of perturbations with perturb_indices_of_current_vectors() */
+      if (ppt->workspace_pool == NULL) {
 
-      class_call_parallel(perturb_workspace_init(ppr,
-                                                 pba,
-                                                 pth,
-                                                 ppt,
-                                                 index_md,
-                                                 pppw[thread]),
-                          ppt->error_message,
-                          ppt->error_message);
+        class_alloc_parallel(pppw[index_md][thread],sz,ppt->error_message);
 
-    } /* end of parallel region */
+        /** - --> (b) initialize indices of vectors of perturbations with perturb_indices_of_current_vectors() */
 
-    if (abort == _TRUE_) return _FAILURE_;
+        class_call_parallel(perturb_workspace_init(ppr,
+                                                   pba,
+                                                   pth,
+                                                   ppt,
+                                                   index_md,
+                                                   pppw[index_md][thread]),
+                            ppt->error_message,
+                            ppt->error_message);
+      }
+      else {
 
-    /** - --> (c) loop over initial conditions and wavenumbers; for each of them, evolve perturbations and compute source functions with perturb_solve() */
+        class_call_parallel(perturb_workspace_pool_get(ppr,
+                                                       pba,
+                                                       pth,
+                                                       ppt,
+                                                       index_md,
+                                                       thread,
+                                                       &(pppw[index_md][thread])),
+                            ppt->error_message,
+                            ppt->error_message);
+      }
+    }
 
-    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+  } /* end of parallel region */
 
-      if (ppt->perturbations_verbose > 1)
-        printf("Evolving ic %d/%d\n",index_ic+1,ppt->ic_size[index_md]);
+  if (abort == _TRUE_) return _FAILURE_;
 
-        if (ppt->perturbations_verbose > 1)
-          printf("evolving %d wavenumbers\n",ppt->k_size[index_md]);
+  /** - for each mode, find the approximation switching times on a
+      coarse grid of wavenumbers, used for bracketing the switches of
+      the other wavenumbers, with perturb_switch_table_init() */
 
-      abort = _FALSE_;
+  class_calloc(ppt->switch_table,ppt->md_size,sizeof(struct perturb_switch_table),ppt->error_message);
 
-#pragma omp parallel                                                    \
-  shared(pppw,ppr,pba,pth,ppt,index_md,index_ic,abort,number_of_threads) \
-  private(index_k,thread,tstart,tstop,tspent)                           \
-  num_threads(number_of_threads)
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+    class_call(perturb_switch_table_init(ppr,
+                                         pba,
+                                         pth,
+                                         ppt,
+                                         index_md,
+                                         pppw[index_md],
+                                         number_of_threads),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
-      {
+  /** - choose the wavenumbers integrated in the first pass: all of
+      them, or with k_adaptive_sampling a coarse subset of them, which
+      is refined in the next passes where needed */
 
-#ifdef _OPENMP
-        thread=omp_get_thread_num();
-        tspent=0.;
-#endif
+  class_alloc(k_todo,ppt->md_size*sizeof(short *),ppt->error_message);
+  class_alloc(k_done,ppt->md_size*sizeof(short *),ppt->error_message);
 
-#pragma omp for schedule (dynamic)
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
 
-        /* integrating backwards is slightly more optimal for parallel runs */
-        //for (index_k = 0; index_k < ppt->k_size; index_k++) {
-        for (index_k = ppt->k_size[index_md]-1; index_k >=0; index_k--) {
+    class_alloc(k_todo[index_md],ppt->k_size[index_md]*sizeof(short),ppt->error_message);
+    class_alloc(k_done[index_md],ppt->k_size[index_md]*sizeof(short),ppt->error_message);
 
-          if ((ppt->perturbations_verbose > 2) && (abort == _FALSE_)) {
-            printf("evolving mode k=%e /Mpc  (%d/%d)",ppt->k[index_md][index_k],index_k+1,ppt->k_size[index_md]);
-            if (pba->sgnK != 0)
-              printf(" (for scalar modes, corresponds to nu=%e)",sqrt(ppt->k[index_md][index_k]*ppt->k[index_md][index_k]+pba->K)/sqrt(pba->sgnK*pba->K));
-            printf("\n");
-          }
+    for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++)
+      k_done[index_md][index_k] = _FALSE_;
 
-#ifdef _OPENMP
-          tstart = omp_get_wtime();
-#endif
+    class_call(perturb_k_adaptive_init(ppr,
+                                       ppt,
+                                       index_md,
+                                       k_todo[index_md]),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
-          class_call_parallel(perturb_solve(ppr,
-                                            pba,
-                                            pth,
-                                            ppt,
-                                            index_md,
-                                            index_ic,
-                                            index_k,
-                                            pppw[thread]),
-                              ppt->error_message,
-                              ppt->error_message);
+  /** - evolve perturbations and compute source functions with
+      perturb_solve_task_pool(). With perturb_task_pool, all modes,
+      initial conditions and wavenumbers form a single pool of tasks;
+      otherwise, there is one pool for each mode. */
 
-#ifdef _OPENMP
-          tstop = omp_get_wtime();
+  for (index_md_first = 0; index_md_first < ppt->md_size; index_md_first = index_md_last) {
 
-          tspent += tstop-tstart;
-#endif
+    if (ppr->perturb_task_pool == _TRUE_)
+      index_md_last = ppt->md_size;
+    else
+      index_md_last = index_md_first+1;
 
-#pragma omp flush(abort)
+    do {
+
+      class_call(perturb_solve_task_pool(ppr,
+                                         pba,
+                                         pth,
+                                         ppt,
+                                         index_md_first,
+                                         index_md_last,
+                                         k_todo,
+                                         k_done,
+                                         pppw,
+                                         number_of_threads,
+                                         process,
+                                         number_of_processes),
+                 ppt->error_message,
+                 ppt->error_message);
 
-        } /* end of loop over wavenumbers */
+      /** - --> with k_adaptive_sampling, check that the source
+          functions can be interpolated in k, and if not, choose new
+          wavenumbers for a next pass */
 
-#ifdef _OPENMP
-        if (ppt->perturbations_verbose>1)
-          printf("In %s: time spent in parallel region (loop over k's) = %e s for thread %d\n",
-                 __func__,tspent,omp_get_thread_num());
-#endif
+      number_of_new_k = 0;
+
+      for (index_md = index_md_first; index_md < index_md_last; index_md++) {
+
+        for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++)
+          if (k_todo[index_md][index_k] == _TRUE_)
+            k_done[index_md][index_k] = _TRUE_;
+
+        if (ppr->k_adaptive_sampling == _TRUE_) {
+          class_call(perturb_k_adaptive_refine(ppr,
+                                               ppt,
+                                               index_md,
+                                               k_done[index_md],
+                                               k_todo[index_md],
+                                               &number_of_new_k_md),
+                     ppt->error_message,
+                     ppt->error_message);
+          number_of_new_k += number_of_new_k_md;
+        }
+      }
+
+    } while (number_of_new_k > 0);
+
+    /** - --> with k_adaptive_sampling, remove the candidate
+        wavenumbers that were never integrated from the list of
+        wavenumbers and from the source tables */
 
-      } /* end of parallel region */
+    if (ppr->k_adaptive_sampling == _TRUE_) {
 
-      if (abort == _TRUE_) return _FAILURE_;
+      for (index_md = index_md_first; index_md < index_md_last; index_md++) {
 
-    } /* end of loop over initial conditions */
+        profile_row = 0;
+        for (index_md_previous = 0; index_md_previous < index_md; index_md_previous++)
+          profile_row += ppt->ic_size[index_md_previous]*ppt->k_size[index_md_previous];
+
+        class_call(perturb_k_adaptive_compact(ppr,
+                                              ppt,
+                                              index_md,
+                                              k_done[index_md],
+                                              profile_row),
+                   ppt->error_message,
+                   ppt->error_message);
+      }
+    }
+  }
+
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+    free(k_todo[index_md]);
+    free(k_done[index_md]);
+  }
+  free(k_todo);
+  free(k_done);
+
+  class_call(perturb_switch_table_free(ppt),
+             ppt->error_message,
+             ppt->error_message);
+
+  /** - free the workspaces, unless they are kept in a pool for the next run */
+
+  if (ppt->workspace_pool == NULL) {
 
     abort = _FALSE_;
 
-#pragma omp parallel                                    \
-  shared(pppw,ppt,index_md,abort,number_of_threads)     \
-  private(thread)                                       \
+#pragma omp parallel                                      \
+  shared(pppw,ppt,abort,number_of_threads)                \
+  private(index_md,thread)                                \
   num_threads(number_of_threads)
 
     {
@@ -416,18 +629,35 @@ int perturb_init(
       thread=omp_get_thread_num();
 #endif
 
-      class_call_parallel(perturb_workspace_free(ppt,index_md,pppw[thread]),
-                          ppt->error_message,
-                          ppt->error_message);
+      for (index_md = 0; index_md < ppt->md_size; index_md++) {
+        class_call_parallel(perturb_workspace_free(ppt,index_md,pppw[index_md][thread]),
+                            ppt->error_message,
+                            ppt->error_message);
+      }
 
     } /* end of parallel region */
 
     if (abort == _TRUE_) return _FAILURE_;
+  }
 
-  } /* end loop over modes */
-
+  for (index_md = 0; index_md < ppt->md_size; index_md++)
+    free(pppw[index_md]);
   free(pppw);
 
+#ifdef WITH_MPI
+  /** - with several MPI processes, gather the integration statistics
+      in the same way as the source functions */
+  if ((ppt->store_profile == _TRUE_) && (number_of_processes > 1)) {
+    MPI_Allreduce(MPI_IN_PLACE,
+                  ppt->profile_data,
+                  ppt->profile_rows*pfl_size,
+                  MPI_DOUBLE,
+                  MPI_SUM,
+                  MPI_COMM_WORLD);
+  }
+#endif
+
+  class_profile_stop(&(ppt->profile));
   return _SUCCESS_;
 }
 
@@ -490,6 +720,9 @@ int perturb_free(
     if (ppt->index_k_output_values != NULL)
       free(ppt->index_k_output_values);
 
+    if (ppt->profile_data != NULL)
+      free(ppt->profile_data);
+
     for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++){
       if (ppt->scalar_perturbations_data[filenum] != NULL)
         free(ppt->scalar_perturbations_data[filenum]);
@@ -506,65 +739,384 @@ int perturb_free(
 }
 
 /**
- * Initialize all indices and allocate most arrays in perturbs structure.
+ * Free the table of source functions only, keeping all the other
+ * fields of the perturbation structure. Called by driver_init() in
+ * low-memory mode, once the transfer and spectra modules are done.
+ * perturb_free() must still be called at the end.
  *
- * @param ppr Input: pointer to precision structure
- * @param pba Input: pointer to background structure
- * @param pth Input: pointer to thermodynamics structure
- * @param ppt Input/Output: Initialized perturbation structure
+ * @param ppt Input: perturbation structure
  * @return the error status
  */
 
-int perturb_indices_of_perturbs(
-                                struct precision * ppr,
-                                struct background * pba,
-                                struct thermo * pth,
-                                struct perturbs * ppt
-                                ) {
+int perturb_free_sources(
+                         struct perturbs * ppt
+                         ) {
 
-  /** Summary: */
+  int index_md,index_ic,index_type;
 
-  /** - define local variables */
+  if (ppt->has_perturbations == _TRUE_) {
 
-  int index_type;
-  int index_md;
-  int index_ic;
-  int index_type_common;
+    for (index_md = 0; index_md < ppt->md_size; index_md++) {
+      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+        for (index_type = 0; index_type < ppt->tp_size[index_md]; index_type++) {
+          free(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type]);
+          ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type] = NULL;
+        }
+      }
+    }
+  }
 
-  /** - count modes (scalar, vector, tensor) and assign corresponding indices */
+  return _SUCCESS_;
 
-  index_md = 0;
-  class_define_index(ppt->index_md_scalars,ppt->has_scalars,index_md,1);
-  class_define_index(ppt->index_md_vectors,ppt->has_vectors,index_md,1);
-  class_define_index(ppt->index_md_tensors,ppt->has_tensors,index_md,1);
-  ppt->md_size = index_md;
+}
 
-  class_test(index_md == 0,
-             ppt->error_message,
-             "you should have at least one out of {scalars, vectors, tensors} !!!");
+/**
+ * Place the pages of a newly allocated table of source functions on
+ * the NUMA nodes of the threads integrating the corresponding
+ * wavenumbers, following ppr->first_touch_policy. With the tiled
+ * layout, the table is split in blocks of consecutive tiles of k;
+ * without it, each row of given tau is split in blocks of k.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ppt      Input: pointer to the perturbation structure
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param source   Input/Output: table of source functions, not filled yet
+ * @return the error status
+ */
 
-  /** - allocate array of number of types for each mode, ppt->tp_size[index_md] */
+int perturb_sources_first_touch(
+                                struct precision * ppr,
+                                struct perturbs * ppt,
+                                int index_md,
+                                source_t * source
+                                ) {
 
-  class_alloc(ppt->tp_size,ppt->md_size*sizeof(int),ppt->error_message);
+  if (ppt->tile_k_size == 0)
+    class_first_touch(source,
+                      ppt->tau_size,
+                      ppt->k_size[index_md]*sizeof(source_t),
+                      ppr->first_touch_policy);
+  else
+    class_first_touch(source,
+                      1,
+                      _source_table_size_*sizeof(source_t),
+                      ppr->first_touch_policy);
 
-  /** - allocate array of number of initial conditions for each mode, ppt->ic_size[index_md] */
+  return _SUCCESS_;
 
-  class_alloc(ppt->ic_size,ppt->md_size*sizeof(int),ppt->error_message);
+}
 
-  /** - allocate array of arrays of source functions for each mode, ppt->source[index_md] */
+/**
+ * Initialize an empty pool of workspaces.
+ *
+ * The pool can then be attached to the perturbation structure
+ * (ppt->workspace_pool = pool) before each call to perturb_init(), so
+ * that workspaces are allocated only once for a sequence of runs.
+ *
+ * @param pool Output: pool to be initialized
+ * @return the error status
+ */
 
-  class_alloc(ppt->sources,ppt->md_size * sizeof(double *),ppt->error_message);
+int perturb_workspace_pool_init(
+                                struct perturb_workspace_pool * pool
+                                ) {
 
-  /** - initialization of all flags to false (will eventually be set to true later) */
+  pool->md_size = 0;
+  pool->number_of_threads = 0;
+  pool->ppw = NULL;
+  pool->key = NULL;
+  pool->key_size = NULL;
 
-  ppt->has_cmb = _FALSE_;
-  ppt->has_lss = _FALSE_;
+  return _SUCCESS_;
+}
 
-  ppt->has_source_t = _FALSE_;
-  ppt->has_source_p = _FALSE_;
-  ppt->has_source_delta_m = _FALSE_;
-  ppt->has_source_delta_g = _FALSE_;
-  ppt->has_source_delta_b = _FALSE_;
+/**
+ * Free all workspaces kept in a pool. To be called once, after the
+ * last run using this pool.
+ *
+ * @param pool Input: pool to be freed
+ * @return the error status
+ */
+
+int perturb_workspace_pool_free(
+                                struct perturb_workspace_pool * pool
+                                ) {
+
+  int index;
+
+  for (index=0; index<pool->md_size*pool->number_of_threads; index++) {
+    if (pool->ppw[index] != NULL) {
+      /* the content of a workspace can be freed without referring to the perturbation structure */
+      perturb_workspace_free(NULL,0,pool->ppw[index]);
+      free(pool->key[index]);
+    }
+  }
+
+  if (pool->ppw != NULL) {
+    free(pool->ppw);
+    free(pool->key);
+    free(pool->key_size);
+  }
+
+  return perturb_workspace_pool_init(pool);
+}
+
+/**
+ * Make sure that a pool has room for the given number of modes and
+ * threads. If these numbers changed since the previous run, the pool
+ * is emptied.
+ *
+ * @param pool              Input/Output: pool of workspaces
+ * @param md_size           Input: number of modes
+ * @param number_of_threads Input: number of threads
+ * @param error_message     Output: error message
+ * @return the error status
+ */
+
+int perturb_workspace_pool_resize(
+                                  struct perturb_workspace_pool * pool,
+                                  int md_size,
+                                  int number_of_threads,
+                                  ErrorMsg error_message
+                                  ) {
+
+  int index;
+
+  if ((pool->md_size == md_size) && (pool->number_of_threads == number_of_threads))
+    return _SUCCESS_;
+
+  class_call(perturb_workspace_pool_free(pool),
+             error_message,
+             error_message);
+
+  class_alloc(pool->ppw,md_size*number_of_threads*sizeof(struct perturb_workspace *),error_message);
+  class_alloc(pool->key,md_size*number_of_threads*sizeof(int *),error_message);
+  class_alloc(pool->key_size,md_size*number_of_threads*sizeof(int),error_message);
+
+  for (index=0; index<md_size*number_of_threads; index++) {
+    pool->ppw[index] = NULL;
+    pool->key[index] = NULL;
+    pool->key_size[index] = 0;
+  }
+
+  pool->md_size = md_size;
+  pool->number_of_threads = number_of_threads;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Get the workspace of a given mode and thread from the pool
+ * ppt->workspace_pool. It is recycled if it was built for the same
+ * parameters (as summarized by perturb_workspace_key()); otherwise it
+ * is replaced by a new one, allocated with perturb_workspace_init().
+ *
+ * Several threads can call this function at the same time, as long as
+ * they pass different values of thread.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input: pointer to the thermodynamics structure
+ * @param ppt      Input: pointer to the perturbation structure, with a pool already sized by perturb_workspace_pool_resize()
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param thread   Input: index of thread
+ * @param ppw      Output: pointer to the workspace
+ * @return the error status
+ */
+
+int perturb_workspace_pool_get(
+                               struct precision * ppr,
+                               struct background * pba,
+                               struct thermo * pth,
+                               struct perturbs * ppt,
+                               int index_md,
+                               int thread,
+                               struct perturb_workspace ** ppw
+                               ) {
+
+  struct perturb_workspace_pool * pool;
+  int * key;
+  int key_size;
+  int index,i;
+  short same_key;
+
+  pool = ppt->workspace_pool;
+  index = index_md*pool->number_of_threads+thread;
+
+  class_call(perturb_workspace_key(ppr,pba,pth,ppt,index_md,&key,&key_size),
+             ppt->error_message,
+             ppt->error_message);
+
+  if (pool->ppw[index] != NULL) {
+
+    same_key = (key_size == pool->key_size[index]) ? _TRUE_ : _FALSE_;
+    for (i=0; (i<key_size) && (same_key == _TRUE_); i++)
+      if (key[i] != pool->key[index][i])
+        same_key = _FALSE_;
+
+    if (same_key == _TRUE_) {
+      free(key);
+      /* the background and thermodynamics vectors of the workspace
+         belong to the previous run */
+      pool->ppw[index]->lookup_content = 0;
+      *ppw = pool->ppw[index];
+      return _SUCCESS_;
+    }
+
+    class_call(perturb_workspace_free(ppt,index_md,pool->ppw[index]),
+               ppt->error_message,
+               ppt->error_message);
+    pool->ppw[index] = NULL;
+    free(pool->key[index]);
+    pool->key[index] = NULL;
+  }
+
+  class_alloc(pool->ppw[index],sizeof(struct perturb_workspace),ppt->error_message);
+
+  class_call(perturb_workspace_init(ppr,
+                                    pba,
+                                    pth,
+                                    ppt,
+                                    index_md,
+                                    pool->ppw[index]),
+             ppt->error_message,
+             ppt->error_message);
+
+  pool->key[index] = key;
+  pool->key_size[index] = key_size;
+
+  *ppw = pool->ppw[index];
+
+  return _SUCCESS_;
+}
+
+/**
+ * Summarize in a few integers all the parameters read by
+ * perturb_workspace_init() (they fix the sizes of the arrays of a
+ * workspace, the meaning of its indices and the kernel used by
+ * perturb_derivs()), together with the number of momenta of each
+ * non-cold dark matter species (which fixes the size of the
+ * perturbation vectors whose Jacobian orderings a workspace
+ * remembers). Two workspaces with the same key are interchangeable.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input: pointer to the thermodynamics structure
+ * @param ppt      Input: pointer to the perturbation structure
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param key      Output: newly allocated array of key_size integers, to be freed by the caller
+ * @param key_size Output: _PERTURB_WORKSPACE_KEY_SIZE_ plus the number of non-cold dark matter species
+ * @return the error status
+ */
+
+int perturb_workspace_key(
+                          struct precision * ppr,
+                          struct background * pba,
+                          struct thermo * pth,
+                          struct perturbs * ppt,
+                          int index_md,
+                          int ** key,
+                          int * key_size
+                          ) {
+
+  int i=0;
+  int n_ncdm;
+
+  *key_size = _PERTURB_WORKSPACE_KEY_SIZE_ + pba->N_ncdm;
+  class_alloc(*key,*key_size*sizeof(int),ppt->error_message);
+
+  (*key)[i++] = (_scalars_) + 2*(_vectors_) + 4*(_tensors_);
+  (*key)[i++] = ppt->gauge;
+  (*key)[i++] = ppt->has_density_transfers;
+  (*key)[i++] = ppt->has_velocity_transfers;
+  (*key)[i++] = ppt->has_source_delta_m;
+  (*key)[i++] = ppt->has_perturbed_recombination;
+  (*key)[i++] = pba->bg_size_normal;
+  (*key)[i++] = pth->th_size;
+  (*key)[i++] = pba->has_curvature;
+  (*key)[i++] = pba->has_cdm;
+  (*key)[i++] = pba->has_ur;
+  (*key)[i++] = pba->has_ncdm;
+  (*key)[i++] = pba->N_ncdm;
+  (*key)[i++] = pba->has_dcdm;
+  (*key)[i++] = pba->has_dr;
+  (*key)[i++] = pba->has_fld;
+  (*key)[i++] = pba->has_scf;
+  (*key)[i++] = ppr->l_max_g;
+  (*key)[i++] = ppr->l_max_pol_g;
+  (*key)[i++] = ppr->l_max_ur;
+  (*key)[i++] = ppr->l_max_ncdm;
+  (*key)[i++] = ppr->l_max_dr;
+  (*key)[i++] = ppr->l_max_g_ten;
+  (*key)[i++] = ppr->l_max_pol_g_ten;
+  (*key)[i++] = ppr->perturb_specialised_derivs;
+
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++)
+    (*key)[i++] = pba->q_size_ncdm[n_ncdm];
+
+  return _SUCCESS_;
+}
+
+/**
+ * Initialize all indices and allocate most arrays in perturbs structure.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input/Output: Initialized perturbation structure
+ * @return the error status
+ */
+
+int perturb_indices_of_perturbs(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermo * pth,
+                                struct perturbs * ppt
+                                ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_type;
+  int index_md;
+  int index_ic;
+  int index_type_common;
+
+  /** - count modes (scalar, vector, tensor) and assign corresponding indices */
+
+  index_md = 0;
+  class_define_index(ppt->index_md_scalars,ppt->has_scalars,index_md,1);
+  class_define_index(ppt->index_md_vectors,ppt->has_vectors,index_md,1);
+  class_define_index(ppt->index_md_tensors,ppt->has_tensors,index_md,1);
+  ppt->md_size = index_md;
+
+  class_test(index_md == 0,
+             ppt->error_message,
+             "you should have at least one out of {scalars, vectors, tensors} !!!");
+
+  /** - allocate array of number of types for each mode, ppt->tp_size[index_md] */
+
+  class_alloc(ppt->tp_size,ppt->md_size*sizeof(int),ppt->error_message);
+
+  /** - allocate array of number of initial conditions for each mode, ppt->ic_size[index_md] */
+
+  class_alloc(ppt->ic_size,ppt->md_size*sizeof(int),ppt->error_message);
+
+  /** - allocate array of arrays of source functions for each mode, ppt->source[index_md] */
+
+  class_alloc(ppt->sources,ppt->md_size * sizeof(source_t **),ppt->error_message);
+
+  /** - initialization of all flags to false (will eventually be set to true later) */
+
+  ppt->has_cmb = _FALSE_;
+  ppt->has_lss = _FALSE_;
+
+  ppt->has_source_t = _FALSE_;
+  ppt->has_source_p = _FALSE_;
+  ppt->has_source_delta_m = _FALSE_;
+  ppt->has_source_delta_g = _FALSE_;
+  ppt->has_source_delta_b = _FALSE_;
   ppt->has_source_delta_cdm = _FALSE_;
   ppt->has_source_delta_dcdm = _FALSE_;
   ppt->has_source_delta_fld = _FALSE_;
@@ -809,7 +1361,7 @@ int perturb_indices_of_perturbs(
     /** - (d) for each mode, allocate array of arrays of source functions for each initial conditions and wavenumber, (ppt->source[index_md])[index_ic][index_type] */
 
     class_alloc(ppt->sources[index_md],
-                ppt->ic_size[index_md] * ppt->tp_size[index_md] * sizeof(double *),
+                ppt->ic_size[index_md] * ppt->tp_size[index_md] * sizeof(source_t *),
                 ppt->error_message);
 
   }
@@ -1179,6 +1731,19 @@ int perturb_timesampling_for_sources(
   free(pvecback);
   free(pvecthermo);
 
+  /** - choose the layout of the tables of source functions */
+
+  if ((ppr->perturb_sources_tile_tau > 0) && (ppr->perturb_sources_tile_k > 0)) {
+    ppt->tile_tau_size = ppr->perturb_sources_tile_tau;
+    ppt->tile_k_size = ppr->perturb_sources_tile_k;
+    ppt->tau_tile_number = (ppt->tau_size + ppt->tile_tau_size - 1) / ppt->tile_tau_size;
+  }
+  else {
+    ppt->tile_tau_size = 0;
+    ppt->tile_k_size = 0;
+    ppt->tau_tile_number = 0;
+  }
+
   /** - loop over modes, initial conditions and types. For each of
       them, allocate array of source functions. */
 
@@ -1186,9 +1751,18 @@ int perturb_timesampling_for_sources(
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
       for (index_type = 0; index_type < ppt->tp_size[index_md]; index_type++) {
 
+#ifdef WITH_MPI
+        /* each MPI process only fills the wavenumbers it integrates:
+           the tables are summed over processes by perturb_init() */
+        class_calloc(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type],
+                     _source_table_size_,
+                     sizeof(source_t),
+                     ppt->error_message);
+#else
         class_alloc(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type],
-                    ppt->k_size[index_md] * ppt->tau_size * sizeof(double),
+                    _source_table_size_ * sizeof(source_t),
                     ppt->error_message);
+#endif
 
       }
     }
@@ -1222,6 +1796,7 @@ int perturb_get_k_list(
   double scale2;
   double *tmp_k_list;
   int newk_size, index_newk, add_k_output_value;
+  int l_max_cmb;
 
   /** Summary: */
 
@@ -1295,7 +1870,21 @@ int perturb_get_k_list(
          pi/lmax: this is equivalent to
          k_max_cl[ppt->index_md_scalars]*[comvoving.ang.diameter.distance] > l_max */
 
-      k_max_cmb[ppt->index_md_scalars] = ppr->k_max_tau0_over_l_max*ppt->l_scalar_max
+      /* l_max is the largest one actually needed by the CMB spectra
+         (l_scalar_max unless smaller values were declared for some of
+         them) */
+
+      l_max_cmb = 0;
+      if (ppt->has_cl_cmb_temperature == _TRUE_)
+        l_max_cmb = MAX(l_max_cmb,ppt->l_scalar_max_cmb_temperature);
+      if (ppt->has_cl_cmb_polarization == _TRUE_)
+        l_max_cmb = MAX(l_max_cmb,ppt->l_scalar_max_cmb_polarization);
+      if (ppt->has_cl_cmb_lensing_potential == _TRUE_)
+        l_max_cmb = MAX(l_max_cmb,ppt->l_scalar_max_cmb_lensing_potential);
+      if (l_max_cmb == 0)
+        l_max_cmb = ppt->l_scalar_max;
+
+      k_max_cmb[ppt->index_md_scalars] = ppr->k_max_tau0_over_l_max*l_max_cmb
         /pba->conformal_age/pth->angular_rescaling;
       k_max_cl[ppt->index_md_scalars] = k_max_cmb[ppt->index_md_scalars];
       k_max     = k_max_cmb[ppt->index_md_scalars];
@@ -1654,7 +2243,7 @@ int perturb_get_k_list(
 
     /* allocate array with, for the moment, the largest possible size */
     class_alloc(ppt->k[ppt->index_md_tensors],
-                ((int)((k_max_cmb[ppt->index_md_tensors]-k_min)/k_rec/MIN(ppr->k_step_super,ppr->k_step_sub))+1)
+                ((int)((k_max_cmb[ppt->index_md_tensors]-k_min)/k_rec/MIN(ppr->k_step_super,ppr->k_step_sub)/ppr->k_step_tensors_factor)+1)
                 *sizeof(double),ppt->error_message);
 
     /* first value */
@@ -1675,7 +2264,7 @@ int perturb_get_k_list(
 
       step = (ppr->k_step_super
               + 0.5 * (tanh((k-k_rec)/k_rec/ppr->k_step_transition)+1.)
-              * (ppr->k_step_sub-ppr->k_step_super)) * k_rec;
+              * (ppr->k_step_sub-ppr->k_step_super)) * k_rec * ppr->k_step_tensors_factor;
 
       /* there is one other thing to take into account in the step
          size. There are two other characteristic scales that matter for
@@ -1814,123 +2403,471 @@ int perturb_get_k_list(
 }
 
 /**
- * Initialize a perturb_workspace structure. All fields are allocated
- * here, with the exception of the perturb_vector '-->pv' field, which
- * is allocated separately in perturb_vector_init. We allocate one
- * such perturb_workspace structure per thread and per mode
- * (scalar/../tensor). Then, for each thread, all initial conditions
- * and wavenumbers will use the same workspace.
+ * Choose the wavenumbers integrated in the first pass of the loop
+ * over wavenumbers of perturb_init().
  *
- * @param ppr        Input: pointer to precision structure
- * @param pba        Input: pointer to background structure
- * @param pth        Input: pointer to the thermodynamics structure
- * @param ppt        Input: pointer to the perturbation structure
+ * Without k_adaptive_sampling, these are all the wavenumbers of
+ * ppt->k[index_md]. Otherwise, the list ppt->k[index_md] contains
+ * candidate wavenumbers, and the first pass only integrates one
+ * candidate out of k_adaptive_coarsening, together with the
+ * wavenumbers that must be kept in any case: the first and last
+ * values of ppt->k[index_md], the last values used for the CMB and
+ * for the other \f$ C_l \f$'s, and the k_output_values.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ppt      Input: pointer to the perturbation structure
  * @param index_md Input: index of mode under consideration (scalar/.../tensor)
- * @param ppw        Input/Output: pointer to perturb_workspace structure which fields are allocated or filled here
+ * @param k_todo   Output: for each wavenumber, _TRUE_ if it is integrated in the first pass (already allocated)
  * @return the error status
  */
 
-int perturb_workspace_init(
-                           struct precision * ppr,
-                           struct background * pba,
-                           struct thermo * pth,
-                           struct perturbs * ppt,
-                           int index_md,
-                           struct perturb_workspace * ppw
-                           ) {
-
-  /** Summary: */
-
-  /** - define local variables */
+int perturb_k_adaptive_init(
+                            struct precision * ppr,
+                            struct perturbs * ppt,
+                            int index_md,
+                            short * k_todo
+                            ) {
 
-  int index_mt=0;
-  int index_ap;
-  int l;
+  int index_k;
+  int index_ikout;
 
-  /** - Compute maximum l_max for any multipole */;
-  if (_scalars_) {
-    ppw->max_l_max = MAX(ppr->l_max_g, ppr->l_max_pol_g);
-    if (pba->has_ur == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ur);
-    if (pba->has_ncdm == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ncdm);
-    if (pba->has_dr == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_dr);
-  }
-  if (_tensors_) {
-    ppw->max_l_max = MAX(ppr->l_max_g_ten, ppr->l_max_pol_g_ten);
-    if (pba->has_ur == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ur);
-    if (pba->has_ncdm == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ncdm);
+  if (ppr->k_adaptive_sampling == _FALSE_) {
+    for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++)
+      k_todo[index_k] = _TRUE_;
+    return _SUCCESS_;
   }
 
-  /** - Allocate \f$ s_l\f$[ ] array for freestreaming of multipoles (see arXiv:1305.3261) and initialize
-      to 1.0, which is the K=0 value. */
-  class_alloc(ppw->s_l, sizeof(double)*(ppw->max_l_max+1),ppt->error_message);
-  for (l=0; l<=ppw->max_l_max; l++){
-    ppw->s_l[l] = 1.0;
-  }
+  class_test(ppr->k_adaptive_coarsening < 1,
+             ppt->error_message,
+             "k_adaptive_coarsening=%d should be a positive integer",
+             ppr->k_adaptive_coarsening);
 
-  /** - define indices of metric perturbations obeying constraint
-      equations (this can be done once and for all, because the
-      vector of metric perturbations is the same whatever the
-      approximation scheme, unlike the vector of quantities to
-      be integrated, which is allocated separately in
-      perturb_vector_init) */
+  for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++)
+    k_todo[index_k] = ((index_k % ppr->k_adaptive_coarsening) == 0 ? _TRUE_ : _FALSE_);
 
-  if (_scalars_) {
+  k_todo[ppt->k_size[index_md]-1] = _TRUE_;
+  k_todo[ppt->k_size_cmb[index_md]-1] = _TRUE_;
+  k_todo[ppt->k_size_cl[index_md]-1] = _TRUE_;
 
-    /* newtonian gauge */
+  for (index_ikout = 0; index_ikout < ppt->k_output_values_num; index_ikout++)
+    k_todo[ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]] = _TRUE_;
 
-    if (ppt->gauge == newtonian) {
-      class_define_index(ppw->index_mt_psi,_TRUE_,index_mt,1); /* psi */
-      class_define_index(ppw->index_mt_phi_prime,_TRUE_,index_mt,1); /* phi' */
-    }
+  return _SUCCESS_;
+}
 
-    /* synchronous gauge (note that eta is counted in the vector of
-       quantities to be integrated, while here we only consider
-       quantities obeying to constraint equations) */
+/**
+ * Estimate how well the source functions computed so far can be
+ * interpolated in k, and choose the wavenumbers to add in the next
+ * pass of the loop over wavenumbers of perturb_init().
+ *
+ * For each wavenumber already integrated, the source functions are
+ * predicted by cubic interpolation between the four nearest
+ * integrated wavenumbers (two on each side when possible), and
+ * compared to their actual values. Since the step between these
+ * neighbours is the double of the final step, this overestimates the
+ * error of the spline interpolation made in the transfer module. The
+ * error is the largest difference over all initial conditions, types
+ * and times, relative to the largest absolute value of the same
+ * source over all times and over the five wavenumbers involved. Where
+ * it exceeds k_adaptive_tol, the candidate wavenumbers in the middle
+ * of the two adjacent intervals are added, as long as some remain.
+ *
+ * @param ppr             Input: pointer to precision structure
+ * @param ppt             Input: pointer to the perturbation structure
+ * @param index_md        Input: index of mode under consideration (scalar/.../tensor)
+ * @param k_done          Input: for each wavenumber, _TRUE_ if it has been integrated
+ * @param k_todo          Output: for each wavenumber, _TRUE_ if it should be integrated in the next pass
+ * @param number_of_new_k Output: number of wavenumbers to integrate in the next pass
+ * @return the error status
+ */
 
-    if (ppt->gauge == synchronous) {
-      class_define_index(ppw->index_mt_h_prime,_TRUE_,index_mt,1);       /* h' */
-      class_define_index(ppw->index_mt_h_prime_prime,_TRUE_,index_mt,1); /* h'' */
-      class_define_index(ppw->index_mt_eta_prime,_TRUE_,index_mt,1);     /* eta' */
-      class_define_index(ppw->index_mt_alpha,_TRUE_,index_mt,1);         /* alpha = (h' + 6 tau') / (2 k**2) */
-      class_define_index(ppw->index_mt_alpha_prime,_TRUE_,index_mt,1);   /* alpha' */
+int perturb_k_adaptive_refine(
+                              struct precision * ppr,
+                              struct perturbs * ppt,
+                              int index_md,
+                              short * k_done,
+                              short * k_todo,
+                              int * number_of_new_k
+                              ) {
+
+  int index_k,index_done,number_done;
+  int index_ic,index_tp,index_tau;
+  int first,index_p,index_q,n;
+  int * done;
+  int stencil[4];
+  double weight[4];
+  double * k = ppt->k[index_md];
+  double k_j,value,prediction,scale,difference,error;
+  source_t * source;
+
+  *number_of_new_k = 0;
+
+  class_alloc(done,ppt->k_size[index_md]*sizeof(int),ppt->error_message);
+
+  number_done = 0;
+  for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++) {
+    k_todo[index_k] = _FALSE_;
+    if (k_done[index_k] == _TRUE_)
+      done[number_done++] = index_k;
+  }
 
-    }
+  /** - with less than five wavenumbers, no estimate is possible: take all of them */
 
+  if (number_done < 5) {
+    for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++) {
+      if (k_done[index_k] == _FALSE_) {
+        k_todo[index_k] = _TRUE_;
+        (*number_of_new_k)++;
+      }
+    }
+    free(done);
+    return _SUCCESS_;
   }
 
-  if (_vectors_) {
+  for (index_done = 0; index_done < number_done; index_done++) {
 
-    /* newtonian gauge */
+    /** - find the four neighbours and the weights of the cubic interpolation at their centre */
 
-    if (ppt->gauge == newtonian) {
+    first = MIN(MAX(index_done-2,0),number_done-5);
 
-      class_define_index(ppw->index_mt_V_prime,_TRUE_,index_mt,1);
+    n = 0;
+    for (index_p = first; index_p < first+5; index_p++)
+      if (index_p != index_done)
+        stencil[n++] = done[index_p];
 
+    k_j = k[done[index_done]];
+
+    for (index_p = 0; index_p < 4; index_p++) {
+      weight[index_p] = 1.;
+      for (index_q = 0; index_q < 4; index_q++)
+        if (index_q != index_p)
+          weight[index_p] *= (k_j-k[stencil[index_q]])/(k[stencil[index_p]]-k[stencil[index_q]]);
     }
 
-    if (ppt->gauge == synchronous) {
+    /** - compare the prediction with the actual source functions */
 
-      class_define_index(ppw->index_mt_hv_prime_prime,_TRUE_,index_mt,1);
+    error = 0.;
 
-    }
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+      for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
 
-  }
+        source = ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp];
 
-  if (_tensors_) {
-    class_define_index(ppw->index_mt_gw_prime_prime,_TRUE_,index_mt,1);
-  }
+        scale = 0.;
+        difference = 0.;
 
-  ppw->mt_size = index_mt;
+        for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
 
-  /** - allocate some workspace in which we will store temporarily the
-      values of background, thermodynamics, metric and source
-      quantities at a given time */
+          value = source[_source_index_(index_tau,done[index_done])];
+          scale = MAX(scale,fabs(value));
 
-  class_alloc(ppw->pvecback,pba->bg_size_normal*sizeof(double),ppt->error_message);
-  class_alloc(ppw->pvecthermo,pth->th_size*sizeof(double),ppt->error_message);
-  class_alloc(ppw->pvecmetric,ppw->mt_size*sizeof(double),ppt->error_message);
+          prediction = 0.;
+          for (index_p = 0; index_p < 4; index_p++) {
+            prediction += weight[index_p]*source[_source_index_(index_tau,stencil[index_p])];
+            scale = MAX(scale,fabs(source[_source_index_(index_tau,stencil[index_p])]));
+          }
 
-  /** - count number of approximations, initialize their indices, and allocate their flags */
+          difference = MAX(difference,fabs(value-prediction));
+        }
+
+        if (scale > 0.)
+          error = MAX(error,difference/scale);
+      }
+    }
+
+    /** - if needed, bisect the intervals on both sides */
+
+    if (error > ppr->k_adaptive_tol) {
+
+      if (index_done > 0) {
+        index_k = (done[index_done-1]+done[index_done])/2;
+        if ((index_k != done[index_done-1]) && (k_todo[index_k] == _FALSE_)) {
+          k_todo[index_k] = _TRUE_;
+          (*number_of_new_k)++;
+        }
+      }
+
+      if (index_done < number_done-1) {
+        index_k = (done[index_done]+done[index_done+1])/2;
+        if ((index_k != done[index_done]) && (k_todo[index_k] == _FALSE_)) {
+          k_todo[index_k] = _TRUE_;
+          (*number_of_new_k)++;
+        }
+      }
+    }
+  }
+
+  free(done);
+
+  if (ppt->perturbations_verbose > 1)
+    printf("Adaptive k sampling: %d wavenumbers integrated, %d added\n",number_done,*number_of_new_k);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Once the adaptive sampling is converged, remove the candidate
+ * wavenumbers that were never integrated from ppt->k[index_md], from
+ * the source tables, and from the table of integration statistics,
+ * and update the numbers and indices of wavenumbers accordingly. The
+ * modes must be compacted in increasing order.
+ *
+ * @param ppr         Input: pointer to precision structure
+ * @param ppt         Input/Output: pointer to the perturbation structure
+ * @param index_md    Input: index of mode under consideration (scalar/.../tensor)
+ * @param k_done      Input: for each wavenumber, _TRUE_ if it has been integrated
+ * @param profile_row Input: first row of ppt->profile_data for this mode
+ * @return the error status
+ */
+
+int perturb_k_adaptive_compact(
+                               struct precision * ppr,
+                               struct perturbs * ppt,
+                               int index_md,
+                               short * k_done,
+                               int profile_row
+                               ) {
+
+  int index_k,index_new_k;
+  int index_ic,index_tp,index_tau;
+  int index_ikout;
+  int old_k_size,new_k_size;
+  int removed_rows,next_row;
+  int * new_index;
+  source_t * buffer;
+  source_t * source;
+
+  old_k_size = ppt->k_size[index_md];
+
+  class_alloc(new_index,old_k_size*sizeof(int),ppt->error_message);
+
+  new_k_size = 0;
+  for (index_k = 0; index_k < old_k_size; index_k++)
+    new_index[index_k] = (k_done[index_k] == _TRUE_ ? new_k_size++ : -1);
+
+  if (ppt->perturbations_verbose > 0)
+    printf(" -> adaptive k sampling kept %d out of %d wavenumbers for mode %d/%d\n",
+           new_k_size,old_k_size,index_md+1,ppt->md_size);
+
+  if (new_k_size == old_k_size) {
+    free(new_index);
+    return _SUCCESS_;
+  }
+
+  /** - list of wavenumbers and numbers of wavenumbers used for Cl's
+      (the last wavenumber of each range is always integrated) */
+
+  for (index_k = 0; index_k < old_k_size; index_k++)
+    if (new_index[index_k] >= 0)
+      ppt->k[index_md][new_index[index_k]] = ppt->k[index_md][index_k];
+
+  ppt->k_size_cmb[index_md] = new_index[ppt->k_size_cmb[index_md]-1]+1;
+  ppt->k_size_cl[index_md] = new_index[ppt->k_size_cl[index_md]-1]+1;
+
+  for (index_ikout = 0; index_ikout < ppt->k_output_values_num; index_ikout++)
+    ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout] =
+      new_index[ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
+
+  /** - source tables: the layout of the tables depends on
+      ppt->k_size[index_md], which is switched between the old and new
+      values while copying each table through an untiled buffer */
+
+  class_alloc(buffer,ppt->tau_size*new_k_size*sizeof(source_t),ppt->error_message);
+
+  for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+    for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
+
+      ppt->k_size[index_md] = old_k_size;
+
+      source = ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp];
+
+      for (index_tau = 0; index_tau < ppt->tau_size; index_tau++)
+        for (index_k = 0; index_k < old_k_size; index_k++)
+          if (new_index[index_k] >= 0)
+            buffer[index_tau*new_k_size+new_index[index_k]] = source[_source_index_(index_tau,index_k)];
+
+      free(source);
+
+      ppt->k_size[index_md] = new_k_size;
+
+      class_calloc(source,
+                   _source_table_size_,
+                   sizeof(source_t),
+                   ppt->error_message);
+
+      class_call(perturb_sources_first_touch(ppr,ppt,index_md,source),
+                 ppt->error_message,
+                 ppt->error_message);
+
+      for (index_tau = 0; index_tau < ppt->tau_size; index_tau++)
+        for (index_new_k = 0; index_new_k < new_k_size; index_new_k++)
+          source[_source_index_(index_tau,index_new_k)] = buffer[index_tau*new_k_size+index_new_k];
+
+      ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp] = source;
+    }
+  }
+
+  free(buffer);
+
+  ppt->k_size[index_md] = new_k_size;
+
+  /** - rows of the table of integration statistics: those of this
+      mode move towards the beginning of its block, the rows of the
+      next modes follow, and the rows left free at the end are
+      cleared */
+
+  if (ppt->store_profile == _TRUE_) {
+
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++)
+      for (index_k = 0; index_k < old_k_size; index_k++)
+        if (new_index[index_k] >= 0)
+          memmove(ppt->profile_data+(profile_row+index_ic*new_k_size+new_index[index_k])*pfl_size,
+                  ppt->profile_data+(profile_row+index_ic*old_k_size+index_k)*pfl_size,
+                  pfl_size*sizeof(double));
+
+    removed_rows = ppt->ic_size[index_md]*(old_k_size-new_k_size);
+    next_row = profile_row+ppt->ic_size[index_md]*old_k_size;
+
+    memmove(ppt->profile_data+(next_row-removed_rows)*pfl_size,
+            ppt->profile_data+next_row*pfl_size,
+            (ppt->profile_rows-next_row)*pfl_size*sizeof(double));
+
+    ppt->profile_rows -= removed_rows;
+
+    memset(ppt->profile_data+ppt->profile_rows*pfl_size,
+           0,
+           removed_rows*pfl_size*sizeof(double));
+  }
+
+  free(new_index);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Initialize a perturb_workspace structure. All fields are allocated
+ * here, with the exception of the perturb_vector '-->pv' field, which
+ * is allocated separately in perturb_vector_init. We allocate one
+ * such perturb_workspace structure per thread and per mode
+ * (scalar/../tensor). Then, for each thread, all initial conditions
+ * and wavenumbers will use the same workspace.
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input: pointer to the thermodynamics structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param ppw        Input/Output: pointer to perturb_workspace structure which fields are allocated or filled here
+ * @return the error status
+ */
+
+int perturb_workspace_init(
+                           struct precision * ppr,
+                           struct background * pba,
+                           struct thermo * pth,
+                           struct perturbs * ppt,
+                           int index_md,
+                           struct perturb_workspace * ppw
+                           ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_mt=0;
+  int index_ap;
+  int l;
+
+  /** - Compute maximum l_max for any multipole */;
+  if (_scalars_) {
+    ppw->max_l_max = MAX(ppr->l_max_g, ppr->l_max_pol_g);
+    if (pba->has_ur == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ur);
+    if (pba->has_ncdm == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ncdm);
+    if (pba->has_dr == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_dr);
+  }
+  if (_tensors_) {
+    ppw->max_l_max = MAX(ppr->l_max_g_ten, ppr->l_max_pol_g_ten);
+    if (pba->has_ur == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ur);
+    if (pba->has_ncdm == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ncdm);
+  }
+
+  /** - Allocate \f$ s_l\f$[ ] array for freestreaming of multipoles (see arXiv:1305.3261) and initialize
+      to 1.0, which is the K=0 value. */
+  class_alloc(ppw->s_l, sizeof(double)*(ppw->max_l_max+1),ppt->error_message);
+  for (l=0; l<=ppw->max_l_max; l++){
+    ppw->s_l[l] = 1.0;
+  }
+
+  /** - define indices of metric perturbations obeying constraint
+      equations (this can be done once and for all, because the
+      vector of metric perturbations is the same whatever the
+      approximation scheme, unlike the vector of quantities to
+      be integrated, which is allocated separately in
+      perturb_vector_init) */
+
+  if (_scalars_) {
+
+    /* newtonian gauge */
+
+    if (ppt->gauge == newtonian) {
+      class_define_index(ppw->index_mt_psi,_TRUE_,index_mt,1); /* psi */
+      class_define_index(ppw->index_mt_phi_prime,_TRUE_,index_mt,1); /* phi' */
+    }
+
+    /* synchronous gauge (note that eta is counted in the vector of
+       quantities to be integrated, while here we only consider
+       quantities obeying to constraint equations) */
+
+    if (ppt->gauge == synchronous) {
+      class_define_index(ppw->index_mt_h_prime,_TRUE_,index_mt,1);       /* h' */
+      class_define_index(ppw->index_mt_h_prime_prime,_TRUE_,index_mt,1); /* h'' */
+      class_define_index(ppw->index_mt_eta_prime,_TRUE_,index_mt,1);     /* eta' */
+      class_define_index(ppw->index_mt_alpha,_TRUE_,index_mt,1);         /* alpha = (h' + 6 tau') / (2 k**2) */
+      class_define_index(ppw->index_mt_alpha_prime,_TRUE_,index_mt,1);   /* alpha' */
+
+    }
+
+  }
+
+  if (_vectors_) {
+
+    /* newtonian gauge */
+
+    if (ppt->gauge == newtonian) {
+
+      class_define_index(ppw->index_mt_V_prime,_TRUE_,index_mt,1);
+
+    }
+
+    if (ppt->gauge == synchronous) {
+
+      class_define_index(ppw->index_mt_hv_prime_prime,_TRUE_,index_mt,1);
+
+    }
+
+  }
+
+  if (_tensors_) {
+    class_define_index(ppw->index_mt_gw_prime_prime,_TRUE_,index_mt,1);
+  }
+
+  ppw->mt_size = index_mt;
+
+  /** - allocate some workspace in which we will store temporarily the
+      values of background, thermodynamics, metric and source
+      quantities at a given time */
+
+  class_alloc(ppw->pvecback,pba->bg_size_normal*sizeof(double),ppt->error_message);
+  class_alloc(ppw->pvecthermo,pth->th_size*sizeof(double),ppt->error_message);
+  class_alloc(ppw->pvecmetric,ppw->mt_size*sizeof(double),ppt->error_message);
+  ppw->lookup_content = 0;
+  ppw->ordering_cache = NULL;
+  ndf15_arena_init(&(ppw->ndf15_arena));
+  ppw->profile = NULL;
+  ppw->perturb_output_file = NULL;
+  ppw->perturb_output_row = NULL;
+
+  /** - count number of approximations, initialize their indices, and allocate their flags */
   index_ap=0;
 
   class_define_index(ppw->index_ap_tca,_TRUE_,index_ap,1);
@@ -1972,6 +2909,10 @@ int perturb_workspace_init(
 
   /** - allocate fields where some of the perturbations are stored */
 
+  ppw->delta_ncdm = NULL;
+  ppw->theta_ncdm = NULL;
+  ppw->shear_ncdm = NULL;
+
   if (_scalars_) {
 
     if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_) || (ppt->has_source_delta_m == _TRUE_)) {
@@ -1984,6 +2925,31 @@ int perturb_workspace_init(
 
   }
 
+  /** - choose once and for all the kernel used by perturb_derivs() for
+      this mode: a specialised one when this is requested and the model
+      belongs to one of the classes listed in enum derivs_kernels, the
+      generic one otherwise */
+
+  ppw->derivs_kernel = dk_generic;
+
+  if ((ppr->perturb_specialised_derivs == _TRUE_) &&
+      (_scalars_) &&
+      (ppt->gauge == synchronous) &&
+      (pba->has_curvature == _FALSE_) &&
+      (ppt->has_perturbed_recombination == _FALSE_) &&
+      (pba->has_cdm == _TRUE_) &&
+      (pba->has_ur == _TRUE_) &&
+      (pba->has_dcdm == _FALSE_) &&
+      (pba->has_dr == _FALSE_) &&
+      (pba->has_fld == _FALSE_) &&
+      (pba->has_scf == _FALSE_)) {
+
+    if (pba->has_ncdm == _TRUE_)
+      ppw->derivs_kernel = dk_lcdm_ncdm_synchronous;
+    else
+      ppw->derivs_kernel = dk_lcdm_synchronous;
+  }
+
   return _SUCCESS_;
 }
 
@@ -1992,8 +2958,8 @@ int perturb_workspace_init(
  * perturb_vector '-->pv' field, which is freed separately in
  * perturb_vector_free).
  *
- * @param ppt        Input: pointer to the perturbation structure
- * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param ppt        Input: pointer to the perturbation structure (not used: may be NULL)
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor) (not used)
  * @param ppw        Input: pointer to perturb_workspace structure to be freed
  * @return the error status
  */
@@ -2008,16 +2974,21 @@ int perturb_workspace_free (
   free(ppw->pvecback);
   free(ppw->pvecthermo);
   free(ppw->pvecmetric);
+  sp_ord_free(ppw->ordering_cache);
+  ndf15_arena_free(&(ppw->ndf15_arena));
   if (ppw->ap_size > 0)
     free(ppw->approx);
 
-  if (_scalars_) {
+  /* file of streamed perturbations left open by an integration that failed */
+  if (ppw->perturb_output_file != NULL) {
+    fclose(ppw->perturb_output_file);
+    free(ppw->perturb_output_row);
+  }
 
-    if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_) || (ppt->has_source_delta_m == _TRUE_)) {
-      free(ppw->delta_ncdm);
-      free(ppw->theta_ncdm);
-      free(ppw->shear_ncdm);
-    }
+  if (ppw->delta_ncdm != NULL) {
+    free(ppw->delta_ncdm);
+    free(ppw->theta_ncdm);
+    free(ppw->shear_ncdm);
   }
 
   free(ppw);
@@ -2025,6 +2996,362 @@ int perturb_workspace_free (
   return _SUCCESS_;
 }
 
+/**
+ * Evolve the perturbations and compute the source functions for all
+ * the tasks of a pool. A task is a triplet (mode, initial condition,
+ * wavenumber), for all modes from index_md_first to index_md_last-1,
+ * all initial conditions, and the wavenumbers flagged in k_todo. All
+ * tasks are distributed to threads in a single parallel region, so
+ * that no thread waits for the others between two modes or initial
+ * conditions.
+ *
+ * By default, tasks are ordered by mode, initial condition, and
+ * decreasing wavenumber. If perturb_cost_scheduling is set, the cost
+ * of each wavenumber is estimated with perturb_estimate_cost(), and
+ * the most expensive tasks are integrated first, so that no thread is
+ * left alone with a long-lasting task at the end of the loop.
+ *
+ * @param ppr                 Input: pointer to precision structure
+ * @param pba                 Input: pointer to background structure
+ * @param pth                 Input: pointer to the thermodynamics structure
+ * @param ppt                 Input/Output: pointer to the perturbation structure (output source functions S(k,tau) written here)
+ * @param index_md_first      Input: first mode of the pool
+ * @param index_md_last       Input: last mode of the pool plus one
+ * @param k_todo              Input: k_todo[index_md][index_k] is _TRUE_ for the wavenumbers to integrate
+ * @param k_done              Input: k_done[index_md][index_k] is _TRUE_ for the wavenumbers integrated in previous pools
+ * @param pppw                Input: pppw[index_md][thread], workspaces of all modes and threads
+ * @param number_of_threads   Input: number of threads
+ * @param process             Input: index of this MPI process (0 without MPI)
+ * @param number_of_processes Input: number of MPI processes (1 without MPI)
+ * @return the error status
+ */
+
+int perturb_solve_task_pool(
+                            struct precision * ppr,
+                            struct background * pba,
+                            struct thermo * pth,
+                            struct perturbs * ppt,
+                            int index_md_first,
+                            int index_md_last,
+                            short ** k_todo,
+                            short ** k_done,
+                            struct perturb_workspace *** pppw,
+                            int number_of_threads,
+                            int process,
+                            int number_of_processes
+                            ) {
+
+  int index_md,index_ic,index_k;
+  int index_task,task_size;
+  int index_pair,pair_size;
+  int thread=0;
+  int abort;
+
+  /* for each task, (estimated cost, index_md, index_ic, index_k),
+     sorted by decreasing cost when costs are estimated */
+  double * task;
+  /* measured time spent in perturb_solve() for each task */
+  double * task_time;
+  /* index of the MPI process integrating each task */
+  int * task_process;
+  /* estimated cost of each pair (index_md, index_k), and index of the
+     first pair of each mode */
+  double * k_cost;
+  int * pair_of_md;
+  /* first row of ppt->profile_data for each mode */
+  int * profile_row;
+  /* do we order the tasks according to their estimated cost? */
+  short use_k_cost;
+
+  /* instrumentation times */
+  double tstart=0., tstop=0., tspent=0.;
+
+#ifdef WITH_MPI
+  int abort_here;
+  int index_type;
+  int index_tau;
+  int index_ikout;
+#endif
+
+  class_alloc(pair_of_md,(ppt->md_size+1)*sizeof(int),ppt->error_message);
+  class_alloc(profile_row,ppt->md_size*sizeof(int),ppt->error_message);
+
+  pair_size = 0;
+  task_size = 0;
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+    profile_row[index_md] = (index_md == 0 ? 0 : profile_row[index_md-1]+ppt->ic_size[index_md-1]*ppt->k_size[index_md-1]);
+    pair_of_md[index_md] = pair_size;
+    if ((index_md >= index_md_first) && (index_md < index_md_last)) {
+      pair_size += ppt->k_size[index_md];
+      for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++)
+        if (k_todo[index_md][index_k] == _TRUE_)
+          task_size += ppt->ic_size[index_md];
+    }
+  }
+  pair_of_md[ppt->md_size] = pair_size;
+
+  if (ppt->perturbations_verbose > 1) {
+    for (index_md = index_md_first; index_md < index_md_last; index_md++)
+      printf("Evolving mode %d/%d\n",index_md+1,ppt->md_size);
+    printf("evolving %d tasks (modes, initial conditions and wavenumbers)\n",task_size);
+  }
+
+  /** - estimate the cost of each wavenumber if needed */
+
+  class_alloc(k_cost,MAX(pair_size,1)*sizeof(double),ppt->error_message);
+
+  for (index_pair = 0; index_pair < pair_size; index_pair++)
+    k_cost[index_pair] = 0.;
+
+  use_k_cost = ((ppr->perturb_cost_scheduling == _TRUE_) &&
+                ((number_of_threads > 1) || (number_of_processes > 1) || (ppt->perturbations_verbose > 2)));
+
+  if (use_k_cost == _TRUE_) {
+
+    abort = _FALSE_;
+
+#pragma omp parallel                                                    \
+  shared(pppw,ppr,pba,pth,ppt,index_md_first,abort,pair_size,pair_of_md,k_cost,k_todo) \
+  private(index_pair,index_md,index_k,thread)                           \
+  num_threads(number_of_threads)
+
+    {
+
+#ifdef _OPENMP
+      thread=omp_get_thread_num();
+#endif
+
+#pragma omp for schedule (dynamic)
+
+      for (index_pair = 0; index_pair < pair_size; index_pair++) {
+
+        index_md = index_md_first;
+        while (index_pair >= pair_of_md[index_md+1])
+          index_md++;
+        index_k = index_pair-pair_of_md[index_md];
+
+        if (k_todo[index_md][index_k] == _FALSE_)
+          continue;
+
+        class_call_parallel(perturb_estimate_cost(ppr,
+                                                  pba,
+                                                  pth,
+                                                  ppt,
+                                                  index_md,
+                                                  index_k,
+                                                  pppw[index_md][thread],
+                                                  &(k_cost[index_pair])),
+                            ppt->error_message,
+                            ppt->error_message);
+
+#pragma omp flush(abort)
+
+      }
+
+    } /* end of parallel region */
+
+    if (abort == _TRUE_) return _FAILURE_;
+  }
+
+  /** - list and order the tasks */
+
+  class_alloc(task,4*MAX(task_size,1)*sizeof(double),ppt->error_message);
+  class_alloc(task_time,MAX(task_size,1)*sizeof(double),ppt->error_message);
+  class_alloc(task_process,MAX(task_size,1)*sizeof(int),ppt->error_message);
+
+  index_task = 0;
+  for (index_md = index_md_first; index_md < index_md_last; index_md++) {
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+      for (index_k = ppt->k_size[index_md]-1; index_k >= 0; index_k--) {
+        if (k_todo[index_md][index_k] == _TRUE_) {
+          task[4*index_task] = k_cost[pair_of_md[index_md]+index_k];
+          task[4*index_task+1] = index_md;
+          task[4*index_task+2] = index_ic;
+          task[4*index_task+3] = index_k;
+          index_task++;
+        }
+      }
+    }
+  }
+
+  if (use_k_cost == _TRUE_)
+    qsort(task,task_size,4*sizeof(double),perturb_compare_cost);
+
+  /** - with several MPI processes, deal the ordered tasks to them in
+      turn, which balances the estimated cost. The wavenumbers for
+      which perturbations are written in files go to the first
+      process, which writes the output. */
+
+  for (index_task = 0; index_task < task_size; index_task++) {
+    task_process[index_task] = index_task % number_of_processes;
+    task_time[index_task] = 0.;
+  }
+
+#ifdef WITH_MPI
+  for (index_task = 0; index_task < task_size; index_task++) {
+    index_md = (int)task[4*index_task+1];
+    index_k = (int)task[4*index_task+3];
+    for (index_ikout = 0; index_ikout < ppt->k_output_values_num; index_ikout++)
+      if (ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout] == index_k)
+        task_process[index_task] = 0;
+  }
+#endif
+
+  /** - loop over tasks; for each of them, evolve perturbations and
+      compute source functions with perturb_solve() */
+
+  abort = _FALSE_;
+
+#pragma omp parallel                                                    \
+  shared(pppw,ppr,pba,pth,ppt,abort,task_size,task,task_time,task_process,process,profile_row) \
+  private(index_task,index_md,index_ic,index_k,thread,tstart,tstop,tspent) \
+  num_threads(number_of_threads)
+
+  {
+
+#ifdef _OPENMP
+    thread=omp_get_thread_num();
+    tspent=0.;
+#endif
+
+#pragma omp for schedule (dynamic)
+
+    for (index_task = 0; index_task < task_size; index_task++) {
+
+      if (task_process[index_task] != process)
+        continue;
+
+      index_md = (int)task[4*index_task+1];
+      index_ic = (int)task[4*index_task+2];
+      index_k = (int)task[4*index_task+3];
+
+      if ((ppt->perturbations_verbose > 2) && (abort == _FALSE_)) {
+        printf("evolving mode k=%e /Mpc  (%d/%d)",ppt->k[index_md][index_k],index_k+1,ppt->k_size[index_md]);
+        if (pba->sgnK != 0)
+          printf(" (for scalar modes, corresponds to nu=%e)",sqrt(ppt->k[index_md][index_k]*ppt->k[index_md][index_k]+pba->K)/sqrt(pba->sgnK*pba->K));
+        printf("\n");
+      }
+
+#ifdef _OPENMP
+      tstart = omp_get_wtime();
+#endif
+
+      if (ppt->store_profile == _TRUE_)
+        pppw[index_md][thread]->profile = ppt->profile_data
+          + (profile_row[index_md]+index_ic*ppt->k_size[index_md]+index_k)*pfl_size;
+      else
+        pppw[index_md][thread]->profile = NULL;
+
+      class_call_parallel(perturb_solve(ppr,
+                                        pba,
+                                        pth,
+                                        ppt,
+                                        index_md,
+                                        index_ic,
+                                        index_k,
+                                        pppw[index_md][thread]),
+                          ppt->error_message,
+                          ppt->error_message);
+
+#ifdef _OPENMP
+      tstop = omp_get_wtime();
+
+      tspent += tstop-tstart;
+#endif
+
+      task_time[index_task] = tstop-tstart;
+
+      if (pppw[index_md][thread]->profile != NULL) {
+        pppw[index_md][thread]->profile[pfl_process] = process;
+        pppw[index_md][thread]->profile[pfl_thread] = thread;
+        pppw[index_md][thread]->profile[pfl_time] = tstop-tstart;
+      }
+
+#pragma omp flush(abort)
+
+    } /* end of loop over tasks */
+
+#ifdef _OPENMP
+    if (ppt->perturbations_verbose>1)
+      printf("In %s: time spent in parallel region (loop over tasks) = %e s for thread %d\n",
+             __func__,tspent,omp_get_thread_num());
+#endif
+
+  } /* end of parallel region */
+
+#ifdef WITH_MPI
+  /* all processes must stop together, or the others would wait
+     forever for the failing one in the next collective call */
+  if (number_of_processes > 1) {
+    abort_here = abort;
+    MPI_Allreduce(&abort_here,&abort,1,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+    if ((abort == _TRUE_) && (abort_here == _FALSE_))
+      sprintf(ppt->error_message,"%s(L:%d) : perturbations failed on another MPI process",__func__,__LINE__);
+  }
+#endif
+
+  if (abort == _TRUE_) return _FAILURE_;
+
+#ifdef WITH_MPI
+  /** - with several MPI processes, gather the source functions: each
+      process has filled the rows of its own tasks and left zeros
+      elsewhere, so that a sum gives the complete tables to every
+      process. The rows of the wavenumbers integrated in previous
+      pools are already complete on every process: they are kept only
+      on the first one, so that the sum counts them once. */
+  if (number_of_processes > 1) {
+    for (index_md = index_md_first; index_md < index_md_last; index_md++) {
+      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+        for (index_type = 0; index_type < ppt->tp_size[index_md]; index_type++) {
+          if (process != 0) {
+            for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++) {
+              if (k_done[index_md][index_k] == _TRUE_) {
+                for (index_tau = 0; index_tau < ppt->tau_size; index_tau++)
+                  ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type][_source_index_(index_tau,index_k)] = 0.;
+              }
+            }
+          }
+          MPI_Allreduce(MPI_IN_PLACE,
+                        ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_type],
+                        _source_table_size_,
+                        _MPI_SOURCE_T_,
+                        MPI_SUM,
+                        MPI_COMM_WORLD);
+        }
+      }
+    }
+  }
+#endif
+
+  /** - if requested, compare the estimated cost of each task with the
+      time actually spent on it */
+
+  if ((use_k_cost == _TRUE_) && (ppt->perturbations_verbose > 2)) {
+    printf("Estimated cost and measured time:\n");
+    for (index_task = 0; index_task < task_size; index_task++) {
+      index_md = (int)task[4*index_task+1];
+      index_k = (int)task[4*index_task+3];
+      printf(" mode %d/%d, ic %d/%d, k=%e /Mpc, estimated cost=%e, time spent=%e s\n",
+             index_md+1,
+             ppt->md_size,
+             (int)task[4*index_task+2]+1,
+             ppt->ic_size[index_md],
+             ppt->k[index_md][index_k],
+             task[4*index_task],
+             task_time[index_task]);
+    }
+  }
+
+  free(task);
+  free(task_time);
+  free(task_process);
+  free(k_cost);
+  free(pair_of_md);
+  free(profile_row);
+
+  return _SUCCESS_;
+}
+
 /**
  * Solve the perturbation evolution for a given mode, initial
  * condition and wavenumber, and compute the corresponding source
@@ -2068,7 +3395,7 @@ int perturb_solve(
   struct perturb_parameters_and_workspace ppaw;
 
   /* conformal time */
-  double tau,tau_lower,tau_upper,tau_mid;
+  double tau;
 
   /* multipole */
   int l;
@@ -2106,157 +3433,65 @@ int perturb_solve(
   /* approximation scheme within previous interval: previous_approx[index_ap] */
   int * previous_approx;
 
-  int n_ncdm,is_early_enough;
-
   /* function pointer to ODE evolver and names of possible evolvers */
 
   extern int evolver_rk();
+  extern int evolver_rk_dense();
   extern int evolver_ndf15();
   int (*generic_evolver)();
 
+  /* Jacobian passed to the evolver (NULL if it should be estimated numerically) */
+  int (*perhaps_jacobian)();
 
   /* Related to the perturbation output */
   int (*perhaps_print_variables)();
   int index_ikout;
 
-  /** - initialize indices relevant for back/thermo tables search */
+  /* integration statistics summed over intervals, and pointer passed
+     to the evolver (NULL if they are not stored) */
+  int stepstat[6]={0,0,0,0,0,0};
+  int * perhaps_stepstat;
+  int index_stat;
+  int column;
+
+  /** - initialize indices relevant for back/thermo tables search, and
+      forget the vectors memorized by perturb_vectors_at_tau() */
   ppw->last_index_back=0;
   ppw->last_index_thermo=0;
   ppw->inter_mode = pba->inter_normal;
+  ppw->lookup_content = 0;
 
   /** - get wavenumber value */
   k = ppt->k[index_md][index_k];
 
   class_test(k == 0.,
-             ppt->error_message,
-             "stop to avoid division by zero");
-
-  /** - If non-zero curvature, update array of free-streaming coefficients ppw->s_l */
-  if (pba->has_curvature == _TRUE_){
-    for (l = 0; l<=ppw->max_l_max; l++){
-      ppw->s_l[l] = sqrt(MAX(1.0-pba->K*(l*l-1.0)/k/k,0.));
-    }
-  }
-
-  /** - maximum value of tau for which sources are calculated for this wavenumber */
-
-  /* by default, today */
-  tau_actual_size = ppt->tau_size;
-
-  /** - using bisection, compute minimum value of tau for which this
-      wavenumber is integrated */
-
-  /* will be at least the first time in the background table */
-  tau_lower = pba->tau_table[0];
-
-  class_call(background_at_tau(pba,
-                               tau_lower,
-                               pba->normal_info,
-                               pba->inter_normal,
-                               &(ppw->last_index_back),
-                               ppw->pvecback),
-             pba->error_message,
-             ppt->error_message);
-
-  class_call(thermodynamics_at_z(pba,
-                                 pth,
-                                 1./ppw->pvecback[pba->index_bg_a]-1.,
-                                 pth->inter_normal,
-                                 &(ppw->last_index_thermo),
-                                 ppw->pvecback,
-                                 ppw->pvecthermo),
-             pth->error_message,
-             ppt->error_message);
-
-  /* check that this initial time is indeed OK given imposed
-     conditions on kappa' and on k/aH */
-
-  class_test(ppw->pvecback[pba->index_bg_a]*
-             ppw->pvecback[pba->index_bg_H]/
-             ppw->pvecthermo[pth->index_th_dkappa] >
-             ppr->start_small_k_at_tau_c_over_tau_h, ppt->error_message, "your choice of initial time for integrating wavenumbers is inappropriate: it corresponds to a time before that at which the background has been integrated. You should increase 'start_small_k_at_tau_c_over_tau_h' up to at least %g, or decrease 'a_ini_over_a_today_default'\n",
-             ppw->pvecback[pba->index_bg_a]*
-             ppw->pvecback[pba->index_bg_H]/
-             ppw->pvecthermo[pth->index_th_dkappa]);
-
-  class_test(k/ppw->pvecback[pba->index_bg_a]/ppw->pvecback[pba->index_bg_H] >
-             ppr->start_large_k_at_tau_h_over_tau_k,
-             ppt->error_message,
-             "your choice of initial time for integrating wavenumbers is inappropriate: it corresponds to a time before that at which the background has been integrated. You should increase 'start_large_k_at_tau_h_over_tau_k' up to at least %g, or decrease 'a_ini_over_a_today_default'\n",
-             ppt->k[index_md][ppt->k_size[index_md]-1]/ppw->pvecback[pba->index_bg_a]/ ppw->pvecback[pba->index_bg_H]);
-
-  if (pba->has_ncdm == _TRUE_) {
-    for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++) {
-      class_test(fabs(ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm]/ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm]-1./3.)>ppr->tol_ncdm_initial_w,
-                 ppt->error_message,
-                 "your choice of initial time for integrating wavenumbers is inappropriate: it corresponds to a time at which the ncdm species number %d is not ultra-relativistic anymore, with w=%g, p=%g and rho=%g\n",
-                 n_ncdm,
-                 ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm]/ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm],
-                 ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm],
-                 ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm]);
-    }
-  }
-
-  /* is at most the time at which sources must be sampled */
-  tau_upper = ppt->tau_sampling[0];
-
-  /* start bisection */
-  tau_mid = 0.5*(tau_lower + tau_upper);
-
-  while ((tau_upper - tau_lower)/tau_lower > ppr->tol_tau_approx) {
-
-    is_early_enough = _TRUE_;
-
-    class_call(background_at_tau(pba,
-                                 tau_mid,
-                                 pba->normal_info,
-                                 pba->inter_normal,
-                                 &(ppw->last_index_back),
-                                 ppw->pvecback),
-               pba->error_message,
-               ppt->error_message);
-
-    /* if there are non-cold relics, check that they are relativistic enough */
-    if (pba->has_ncdm == _TRUE_) {
-      for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++) {
-        if (fabs(ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm]/ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm]-1./3.) > ppr->tol_ncdm_initial_w)
-          is_early_enough = _FALSE_;
-      }
-    }
-
-    /* also check that the two conditions on (aH/kappa') and (aH/k) are fulfilled */
-    if (is_early_enough == _TRUE_) {
-
-      class_call(thermodynamics_at_z(pba,
-                                     pth,
-                                     1./ppw->pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                     pth->inter_normal,
-                                     &(ppw->last_index_thermo),
-                                     ppw->pvecback,
-                                     ppw->pvecthermo),
-                 pth->error_message,
-                 ppt->error_message);
-
-      if ((ppw->pvecback[pba->index_bg_a]*
-           ppw->pvecback[pba->index_bg_H]/
-           ppw->pvecthermo[pth->index_th_dkappa] >
-           ppr->start_small_k_at_tau_c_over_tau_h) ||
-          (k/ppw->pvecback[pba->index_bg_a]/ppw->pvecback[pba->index_bg_H] >
-           ppr->start_large_k_at_tau_h_over_tau_k))
+             ppt->error_message,
+             "stop to avoid division by zero");
 
-        is_early_enough = _FALSE_;
+  /** - If non-zero curvature, update array of free-streaming coefficients ppw->s_l */
+  if (pba->has_curvature == _TRUE_){
+    for (l = 0; l<=ppw->max_l_max; l++){
+      ppw->s_l[l] = sqrt(MAX(1.0-pba->K*(l*l-1.0)/k/k,0.));
     }
+  }
 
-    if (is_early_enough == _TRUE_)
-      tau_lower = tau_mid;
-    else
-      tau_upper = tau_mid;
-
-    tau_mid = 0.5*(tau_lower + tau_upper);
+  /** - maximum value of tau for which sources are calculated for this wavenumber */
 
-  }
+  /* by default, today */
+  tau_actual_size = ppt->tau_size;
 
-  tau = tau_mid;
+  /** - using bisection, compute minimum value of tau for which this
+      wavenumber is integrated, with perturb_find_initial_time() */
+
+  class_call(perturb_find_initial_time(ppr,
+                                       pba,
+                                       pth,
+                                       ppt,
+                                       k,
+                                       ppw,
+                                       &tau),
+             ppt->error_message,
+             ppt->error_message);
 
   /** - find the number of intervals over which approximation scheme is constant */
 
@@ -2298,7 +3533,8 @@ int perturb_solve(
                                                  interval_number,
                                                  interval_number_of,
                                                  interval_limit,
-                                                 interval_approx),
+                                                 interval_approx,
+                                                 NULL),
              ppt->error_message,
              ppt->error_message);
 
@@ -2320,6 +3556,13 @@ int perturb_solve(
   ppaw.ppw->last_index_back = 0;
   ppaw.ppw->last_index_thermo = 0;
 
+  /** - check whether the stiff evolver should use the Jacobian computed by perturb_jacobian() */
+
+  if (ppr->perturb_analytic_jacobian == _TRUE_)
+    perhaps_jacobian = perturb_jacobian;
+  else
+    perhaps_jacobian = NULL;
+
   /** - check whether we need to print perturbations to a file for this wavenumber */
 
   perhaps_print_variables = NULL;
@@ -2328,13 +3571,50 @@ int perturb_solve(
     if (ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout] == index_k){
       ppw->index_ikout = index_ikout;
       perhaps_print_variables = perturb_print_variables;
-      /* class_call(perturb_prepare_output_file(
-         pba,ppt,ppw,index_ikout,index_md),
-         ppt->error_message,
-         ppt->error_message);
-      */
+      if (ppt->stream_perturbations == _TRUE_) {
+        class_call(perturb_prepare_output_file(pba,ppt,ppw,index_ikout,index_md,index_ic,k),
+                   ppt->error_message,
+                   ppt->error_message);
+      }
+    }
+  }
+
+  /** - if integration statistics are stored, record the initial time
+      and the times at which each approximation changes */
+
+  if (ppw->profile != NULL) {
+
+    perhaps_stepstat = stepstat;
+
+    ppw->profile[pfl_md] = index_md;
+    ppw->profile[pfl_ic] = index_ic;
+    ppw->profile[pfl_k] = k;
+    ppw->profile[pfl_intervals] = interval_number;
+    ppw->profile[pfl_tau_ini] = interval_limit[0];
+    ppw->profile[pfl_tau_tca] = 0.;
+    ppw->profile[pfl_tau_rsa] = 0.;
+    ppw->profile[pfl_tau_ufa] = 0.;
+    ppw->profile[pfl_tau_ncdmfa] = 0.;
+
+    for (index_interval=1; index_interval<interval_number; index_interval++) {
+      for (index_ap=0; index_ap<ppw->ap_size; index_ap++) {
+        if (interval_approx[index_interval][index_ap] != interval_approx[index_interval-1][index_ap]) {
+          if (index_ap == ppw->index_ap_tca)
+            column = pfl_tau_tca;
+          else if (index_ap == ppw->index_ap_rsa)
+            column = pfl_tau_rsa;
+          else if ((_scalars_) && (pba->has_ur == _TRUE_) && (index_ap == ppw->index_ap_ufa))
+            column = pfl_tau_ufa;
+          else
+            column = pfl_tau_ncdmfa;
+          ppw->profile[column] = interval_limit[index_interval];
+        }
+      }
     }
   }
+  else {
+    perhaps_stepstat = NULL;
+  }
 
   /** - loop over intervals over which approximation scheme is uniform. For each interval: */
 
@@ -2381,20 +3661,26 @@ int perturb_solve(
     /** - --> (d) integrate the perturbations over the current interval. */
 
     if(ppr->evolver == rk){
-      generic_evolver = evolver_rk;
+      if (ppr->perturb_rk_dense_output == _TRUE_)
+        generic_evolver = evolver_rk_dense;
+      else
+        generic_evolver = evolver_rk;
     }
     else{
       generic_evolver = evolver_ndf15;
     }
 
     class_call(generic_evolver(perturb_derivs,
+                               perhaps_jacobian,
+                               &(ppw->ordering_cache),
+                               &(ppw->ndf15_arena),
                                interval_limit[index_interval],
                                interval_limit[index_interval+1],
                                ppw->pv->y,
                                ppw->pv->used_in_sources,
                                ppw->pv->pt_size,
                                &ppaw,
-                               ppr->tol_perturb_integration,
+                               (_tensors_ ? ppr->tol_perturb_integration*ppr->tol_perturb_integration_tensors_factor : ppr->tol_perturb_integration),
                                ppr->smallest_allowed_variation,
                                perturb_timescale,
                                ppr->perturb_integration_stepsize,
@@ -2402,16 +3688,25 @@ int perturb_solve(
                                tau_actual_size,
                                perturb_sources,
                                perhaps_print_variables,
+                               perhaps_stepstat,
                                ppt->error_message),
                ppt->error_message,
                ppt->error_message);
 
   }
 
-  /** - if perturbations were printed in a file, close the file */
+  if (ppw->profile != NULL) {
+    for (index_stat=0; index_stat<6; index_stat++)
+      ppw->profile[pfl_steps+index_stat] = stepstat[index_stat];
+  }
+
+  /** - if perturbations were streamed to a file, close the file */
 
-  //if (perhaps_print_variables != NULL)
-  //  fclose(ppw->perturb_output_file);
+  if (ppw->perturb_output_file != NULL) {
+    class_call(perturb_close_output_file(ppt,ppw),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
   /** - fill the source terms array with zeros for all times between
       the last integrated time tau_max and tau_today. */
@@ -2420,7 +3715,7 @@ int perturb_solve(
     for (index_type = 0; index_type < ppt->tp_size[index_md]; index_type++) {
       ppt->sources[index_md]
         [index_ic * ppt->tp_size[index_md] + index_type]
-        [index_tau * ppt->k_size[index_md] + index_k] = 0.;
+        [_source_index_(index_tau,index_k)] = 0.;
     }
   }
 
@@ -2437,7 +3732,322 @@ int perturb_solve(
 
   free(interval_limit);
 
-  return _SUCCESS_;
+  return _SUCCESS_;
+}
+
+/**
+ * For a given wavenumber, find the initial time of the perturbation
+ * integration.
+ *
+ * Using bisection, compute the earliest value of conformal time such
+ * that the conditions on (aH/kappa') and (k/aH) imposed by the
+ * precision parameters start_small_k_at_tau_c_over_tau_h and
+ * start_large_k_at_tau_h_over_tau_k are fulfilled, and such that
+ * non-cold relics are still ultra-relativistic.
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input: pointer to the thermodynamics structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param k          Input: wavenumber
+ * @param ppw        Input: pointer to perturb_workspace structure containing index values and workspaces
+ * @param tau_ini    Output: initial time of the perturbation integration
+ * @return the error status
+ */
+
+int perturb_find_initial_time(
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermo * pth,
+                              struct perturbs * ppt,
+                              double k,
+                              struct perturb_workspace * ppw,
+                              double * tau_ini
+                              ) {
+
+  double tau_lower,tau_upper,tau_mid;
+  int n_ncdm,is_early_enough;
+
+  /* will be at least the first time in the background table */
+  tau_lower = pba->tau_table[0];
+
+  class_call(perturb_vectors_at_tau(pba,pth,ppw,tau_lower,pba->inter_normal,_TRUE_,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+
+  /* check that this initial time is indeed OK given imposed
+     conditions on kappa' and on k/aH */
+
+  class_test(ppw->pvecback[pba->index_bg_a]*
+             ppw->pvecback[pba->index_bg_H]/
+             ppw->pvecthermo[pth->index_th_dkappa] >
+             ppr->start_small_k_at_tau_c_over_tau_h, ppt->error_message, "your choice of initial time for integrating wavenumbers is inappropriate: it corresponds to a time before that at which the background has been integrated. You should increase 'start_small_k_at_tau_c_over_tau_h' up to at least %g, or decrease 'a_ini_over_a_today_default'\n",
+             ppw->pvecback[pba->index_bg_a]*
+             ppw->pvecback[pba->index_bg_H]/
+             ppw->pvecthermo[pth->index_th_dkappa]);
+
+  class_test(k/ppw->pvecback[pba->index_bg_a]/ppw->pvecback[pba->index_bg_H] >
+             ppr->start_large_k_at_tau_h_over_tau_k,
+             ppt->error_message,
+             "your choice of initial time for integrating wavenumbers is inappropriate: it corresponds to a time before that at which the background has been integrated. You should increase 'start_large_k_at_tau_h_over_tau_k' up to at least %g, or decrease 'a_ini_over_a_today_default'\n",
+             k/ppw->pvecback[pba->index_bg_a]/ ppw->pvecback[pba->index_bg_H]);
+
+  if (pba->has_ncdm == _TRUE_) {
+    for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++) {
+      class_test(fabs(ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm]/ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm]-1./3.)>ppr->tol_ncdm_initial_w,
+                 ppt->error_message,
+                 "your choice of initial time for integrating wavenumbers is inappropriate: it corresponds to a time at which the ncdm species number %d is not ultra-relativistic anymore, with w=%g, p=%g and rho=%g\n",
+                 n_ncdm,
+                 ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm]/ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm],
+                 ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm],
+                 ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm]);
+    }
+  }
+
+  /* is at most the time at which sources must be sampled */
+  tau_upper = ppt->tau_sampling[0];
+
+  /* start bisection */
+  tau_mid = 0.5*(tau_lower + tau_upper);
+
+  while ((tau_upper - tau_lower)/tau_lower > ppr->tol_tau_approx) {
+
+    is_early_enough = _TRUE_;
+
+    class_call(perturb_vectors_at_tau(pba,pth,ppw,tau_mid,pba->inter_normal,_FALSE_,ppt->error_message),
+               ppt->error_message,
+               ppt->error_message);
+
+    /* if there are non-cold relics, check that they are relativistic enough */
+    if (pba->has_ncdm == _TRUE_) {
+      for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++) {
+        if (fabs(ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm]/ppw->pvecback[pba->index_bg_rho_ncdm1+n_ncdm]-1./3.) > ppr->tol_ncdm_initial_w)
+          is_early_enough = _FALSE_;
+      }
+    }
+
+    /* also check that the two conditions on (aH/kappa') and (aH/k) are fulfilled */
+    if (is_early_enough == _TRUE_) {
+
+      class_call(perturb_vectors_at_tau(pba,pth,ppw,tau_mid,pba->inter_normal,_TRUE_,ppt->error_message),
+                 ppt->error_message,
+                 ppt->error_message);
+
+      if ((ppw->pvecback[pba->index_bg_a]*
+           ppw->pvecback[pba->index_bg_H]/
+           ppw->pvecthermo[pth->index_th_dkappa] >
+           ppr->start_small_k_at_tau_c_over_tau_h) ||
+          (k/ppw->pvecback[pba->index_bg_a]/ppw->pvecback[pba->index_bg_H] >
+           ppr->start_large_k_at_tau_h_over_tau_k))
+
+        is_early_enough = _FALSE_;
+    }
+
+    if (is_early_enough == _TRUE_)
+      tau_lower = tau_mid;
+    else
+      tau_upper = tau_mid;
+
+    tau_mid = 0.5*(tau_lower + tau_upper);
+
+  }
+
+  *tau_ini = tau_mid;
+
+  return _SUCCESS_;
+}
+
+/**
+ * For a given mode and wavenumber, estimate the relative cost of
+ * perturb_solve().
+ *
+ * The time range of integration is split into intervals of uniform
+ * approximation scheme with perturb_find_approximation_switches(),
+ * exactly like in perturb_solve(). In each interval, the cost is
+ * assumed to scale like the number of integrated equations (inferred
+ * from the hierarchy sizes l_max and from the approximation flags)
+ * times the number of steps, which is itself assumed to scale like
+ * the number of e-folds in conformal time plus the number of
+ * oscillation periods of the mode. Only the ordering of the costs
+ * matters, since they are used to schedule the loop over wavenumbers.
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input: pointer to the thermodynamics structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param index_md   Input: index of mode under consideration (scalar/.../tensor)
+ * @param index_k    Input: index of wavenumber
+ * @param ppw        Input: pointer to perturb_workspace structure containing index values and workspaces
+ * @param cost       Output: estimated cost (arbitrary units)
+ * @return the error status
+ */
+
+int perturb_estimate_cost(
+                          struct precision * ppr,
+                          struct background * pba,
+                          struct thermo * pth,
+                          struct perturbs * ppt,
+                          int index_md,
+                          int index_k,
+                          struct perturb_workspace * ppw,
+                          double * cost
+                          ) {
+
+  double k,tau_ini,tau_end,delta_tau;
+  int interval_number,index_interval,index_ap;
+  int * interval_number_of;
+  double * interval_limit;
+  int ** interval_approx;
+  int size,n_ncdm;
+
+  k = ppt->k[index_md][index_k];
+  tau_end = ppt->tau_sampling[ppt->tau_size-1];
+
+  ppw->last_index_back=0;
+  ppw->last_index_thermo=0;
+  ppw->inter_mode = pba->inter_normal;
+
+  class_call(perturb_find_initial_time(ppr,
+                                       pba,
+                                       pth,
+                                       ppt,
+                                       k,
+                                       ppw,
+                                       &tau_ini),
+             ppt->error_message,
+             ppt->error_message);
+
+  class_alloc(interval_number_of,ppw->ap_size*sizeof(int),ppt->error_message);
+
+  class_call(perturb_find_approximation_number(ppr,
+                                               pba,
+                                               pth,
+                                               ppt,
+                                               index_md,
+                                               k,
+                                               ppw,
+                                               tau_ini,
+                                               tau_end,
+                                               &interval_number,
+                                               interval_number_of),
+             ppt->error_message,
+             ppt->error_message);
+
+  class_alloc(interval_limit,(interval_number+1)*sizeof(double),ppt->error_message);
+  class_alloc(interval_approx,interval_number*sizeof(int*),ppt->error_message);
+  for (index_interval=0; index_interval<interval_number; index_interval++)
+    class_alloc(interval_approx[index_interval],ppw->ap_size*sizeof(int),ppt->error_message);
+
+  class_call(perturb_find_approximation_switches(ppr,
+                                                 pba,
+                                                 pth,
+                                                 ppt,
+                                                 index_md,
+                                                 k,
+                                                 ppw,
+                                                 tau_ini,
+                                                 tau_end,
+                                                 ppr->tol_tau_approx,
+                                                 interval_number,
+                                                 interval_number_of,
+                                                 interval_limit,
+                                                 interval_approx,
+                                                 NULL),
+             ppt->error_message,
+             ppt->error_message);
+
+  *cost = 0.;
+
+  for (index_interval=0; index_interval<interval_number; index_interval++) {
+
+    for (index_ap=0; index_ap<ppw->ap_size; index_ap++)
+      ppw->approx[index_ap]=interval_approx[index_interval][index_ap];
+
+    /* approximate number of integrated equations in this interval */
+    size = 4;
+
+    if (ppw->approx[ppw->index_ap_rsa] == (int)rsa_off) {
+      if (ppw->approx[ppw->index_ap_tca] == (int)tca_off) {
+        if (_scalars_)
+          size += ppr->l_max_g + ppr->l_max_pol_g + 2;
+        else
+          size += ppr->l_max_g_ten + ppr->l_max_pol_g_ten + 2;
+      }
+      else {
+        size += 2;
+      }
+    }
+
+    if (_scalars_) {
+
+      if ((pba->has_ur == _TRUE_) && (ppw->approx[ppw->index_ap_rsa] == (int)rsa_off)) {
+        if (ppw->approx[ppw->index_ap_ufa] == (int)ufa_off)
+          size += ppr->l_max_ur + 1;
+        else
+          size += 3;
+      }
+
+      if (pba->has_dr == _TRUE_)
+        size += ppr->l_max_dr + 1;
+
+      if (pba->has_ncdm == _TRUE_) {
+        for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++) {
+          if (ppw->approx[ppw->index_ap_ncdmfa] == (int)ncdmfa_off)
+            size += (ppr->l_max_ncdm + 1) * pba->q_size_ncdm[n_ncdm];
+          else
+            size += 3;
+        }
+      }
+    }
+
+    if (_tensors_) {
+
+      if (ppt->evolve_tensor_ur == _TRUE_)
+        size += ppr->l_max_ur + 1;
+
+      if (ppt->evolve_tensor_ncdm == _TRUE_) {
+        for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++)
+          size += (ppr->l_max_ncdm + 1) * pba->q_size_ncdm[n_ncdm];
+      }
+    }
+
+    /* approximate number of steps in this interval */
+    delta_tau = interval_limit[index_interval+1]-interval_limit[index_interval];
+
+    *cost += size * (log(interval_limit[index_interval+1]/interval_limit[index_interval])
+                     + k*delta_tau/_TWOPI_);
+  }
+
+  for (index_interval=0; index_interval<interval_number; index_interval++)
+    free(interval_approx[index_interval]);
+  free(interval_approx);
+  free(interval_limit);
+  free(interval_number_of);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Comparison function for sorting records of doubles starting with a
+ * cost (e.g. the tasks of perturb_solve_task_pool()) by decreasing
+ * cost with qsort().
+ *
+ * @param a Input: pointer to first record
+ * @param b Input: pointer to second record
+ * @return negative if the first record should come first
+ */
+
+int perturb_compare_cost(const void * a,
+                         const void * b) {
+
+  double cost_a = ((const double *)a)[0];
+  double cost_b = ((const double *)b)[0];
+
+  if (cost_a > cost_b)
+    return -1;
+  if (cost_a < cost_b)
+    return 1;
+  return 0;
 }
 
 int perturb_prepare_output(struct background * pba,
@@ -2445,6 +4055,7 @@ int perturb_prepare_output(struct background * pba,
 
   int n_ncdm;
   char tmp[40];
+  int index_md;
 
   ppt->scalar_titles[0]='\0';
   ppt->vector_titles[0]='\0';
@@ -2540,6 +4151,172 @@ int perturb_prepare_output(struct background * pba,
     }
 
   }
+
+  /** If requested, write the titles of the table of integration
+      statistics (in the order of enum profile_columns) and allocate
+      it, with zeros for wavenumbers not integrated by this process */
+
+  ppt->profile_titles[0]='\0';
+  ppt->profile_data = NULL;
+
+  if (ppt->store_profile == _TRUE_) {
+
+    class_store_columntitle(ppt->profile_titles,"mode",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"ic",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"k [1/Mpc]",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"process",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"thread",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"time [s]",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"intervals",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"tau_ini [Mpc]",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"tau_tca_off [Mpc]",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"tau_rsa_on [Mpc]",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"tau_ufa_on [Mpc]",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"tau_ncdmfa_on [Mpc]",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"steps",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"failed_steps",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"derivs_calls",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"jacobians",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"lu_decompositions",_TRUE_);
+    class_store_columntitle(ppt->profile_titles,"linear_solves",_TRUE_);
+
+    ppt->profile_rows = 0;
+    for (index_md = 0; index_md < ppt->md_size; index_md++)
+      ppt->profile_rows += ppt->ic_size[index_md]*ppt->k_size[index_md];
+
+    class_calloc(ppt->profile_data,
+                 ppt->profile_rows*pfl_size,
+                 sizeof(double),
+                 ppt->error_message);
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Open the file to which the perturbations of one mode, initial
+ * condition and selected wavenumber are streamed while this
+ * wavenumber is integrated (when 'stream perturbations = yes'), and
+ * write its header in the binary layout described in output.h.
+ *
+ * Each task (mode, initial condition, wavenumber) is integrated by a
+ * single thread, and has its own file, so that no central buffer and
+ * no synchronisation is needed. The number of rows is not known in
+ * advance: it is written as zero here and set by
+ * perturb_close_output_file().
+ *
+ * The file is called <root>perturbations_k<index_ikout>_s.bin (_t.bin
+ * for tensors), with the suffix of the initial condition appended
+ * when there are several of them. Vector modes are not streamed,
+ * since no vector perturbations are stored.
+ *
+ * @param pba         Input: pointer to background structure
+ * @param ppt         Input: pointer to the perturbation structure
+ * @param ppw         Input/Output: pointer to perturb_workspace structure, in which the file and row buffer are stored
+ * @param index_ikout Input: index of wavenumber in k_output_values
+ * @param index_md    Input: index of mode
+ * @param index_ic    Input: index of initial condition
+ * @param k           Input: wavenumber
+ * @return the error status
+ */
+
+int perturb_prepare_output_file(struct background * pba,
+                                struct perturbs * ppt,
+                                struct perturb_workspace * ppw,
+                                int index_ikout,
+                                int index_md,
+                                int index_ic,
+                                double k) {
+
+  FileName file_name;
+  FileName ic_suffix;
+  char first_line[_LINE_LENGTH_MAX_];
+  char description[_LINE_LENGTH_MAX_];
+  char * titles;
+  char * mode_name;
+  char mode_letter;
+  int columns;
+
+  if (_scalars_) {
+    titles = ppt->scalar_titles;
+    columns = ppt->number_of_scalar_titles;
+    mode_name = "scalar";
+    mode_letter = 's';
+  }
+  else if (_tensors_) {
+    titles = ppt->tensor_titles;
+    columns = ppt->number_of_tensor_titles;
+    mode_name = "tensor";
+    mode_letter = 't';
+  }
+  else {
+    ppw->perturb_output_file = NULL;
+    return _SUCCESS_;
+  }
+
+  ic_suffix[0]='\0';
+  if (ppt->ic_size[index_md] > 1) {
+    class_call(spectra_firstline_and_ic_suffix(ppt, index_ic, first_line, ic_suffix),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
+  sprintf(file_name,"%s%s%d_%c%s%s%s",
+          ppt->stream_root,"perturbations_k",index_ikout,mode_letter,
+          (ic_suffix[0] == '\0') ? "" : "_",ic_suffix,".bin");
+
+  class_open(ppw->perturb_output_file, file_name, "wb", ppt->error_message);
+
+  sprintf(description,"%s perturbations for mode k = %.*e Mpc^(-1)",mode_name,_OUTPUTPRECISION_,k);
+
+  class_call(binary_output_header(ppw->perturb_output_file,
+                                  description,
+                                  titles,
+                                  0,
+                                  columns,
+                                  ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+
+  class_alloc(ppw->perturb_output_row,columns*sizeof(double),ppt->error_message);
+  ppw->perturb_output_rows = 0;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Write the final number of rows in the header of a file opened by
+ * perturb_prepare_output_file(), close it and free the row buffer.
+ *
+ * @param ppt Input: pointer to the perturbation structure
+ * @param ppw Input/Output: pointer to perturb_workspace structure
+ * @return the error status
+ */
+
+int perturb_close_output_file(struct perturbs * ppt,
+                              struct perturb_workspace * ppw) {
+
+  int32_t rows;
+
+  /* the number of rows follows the 8 characters of the magic string
+     and the version number */
+  class_test(fseek(ppw->perturb_output_file,8+sizeof(int32_t),SEEK_SET) != 0,
+             ppt->error_message,
+             "could not rewind file of streamed perturbations");
+
+  rows = ppw->perturb_output_rows;
+  class_call(binary_output_write(ppw->perturb_output_file,&rows,sizeof(int32_t),1,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+
+  fclose(ppw->perturb_output_file);
+  ppw->perturb_output_file = NULL;
+
+  free(ppw->perturb_output_row);
+  ppw->perturb_output_row = NULL;
+
   return _SUCCESS_;
 
 }
@@ -2650,6 +4427,7 @@ int perturb_find_approximation_number(
  * @param interval_number_of Input: number of intervals with respect to each particular approximation
  * @param interval_limit     Output: value of time at the boundary of the intervals: tau_ini, tau_switch1, ..., tau_end
  * @param interval_approx    Output: value of approximations in each interval
+ * @param tau_switch         Output: if not NULL, switching times of each approximation, tau_switch[index_ap*_PERTURB_SWITCHES_MAX_+index_switch] (for the first _PERTURB_SWITCHES_MAX_ switches)
  * @return the error status
  */
 
@@ -2667,7 +4445,8 @@ int perturb_find_approximation_switches(
                                         int interval_number,
                                         int * interval_number_of,
                                         double * interval_limit, /* interval_limit[index_interval] (already allocated) */
-                                        int ** interval_approx   /* interval_approx[index_interval][index_ap] (already allocated) */
+                                        int ** interval_approx,  /* interval_approx[index_interval][index_ap] (already allocated) */
+                                        double * tau_switch      /* tau_switch[index_ap*_PERTURB_SWITCHES_MAX_+index_switch] (already allocated, or NULL) */
                                         ){
 
   /** Summary: */
@@ -2682,6 +4461,26 @@ int perturb_find_approximation_switches(
   double next_tau_switch;
   int flag_ini;
   int num_switching_at_given_time;
+  struct perturb_switch_table * pst;
+  int index_coarse,offset_lo,offset_hi;
+  short bracketed;
+  int attempt;
+  double tau_guess,bracket_lo=0.,bracket_hi=0.;
+
+  /** - find the two coarse wavenumbers enclosing k in the switch
+      table, if there is one */
+
+  index_coarse = -1;
+  pst = NULL;
+
+  if (ppt->switch_table != NULL) {
+    pst = &(ppt->switch_table[index_md]);
+    if ((pst->k_size > 1) && (k >= pst->k[0]) && (k <= pst->k[pst->k_size-1])) {
+      index_coarse = 0;
+      while ((index_coarse < pst->k_size-2) && (k > pst->k[index_coarse+1]))
+        index_coarse++;
+    }
+  }
 
   /** - write in output arrays the initial time and approximation */
 
@@ -2735,24 +4534,103 @@ int perturb_find_approximation_switches(
           upper_bound=tau_end;
           mid = 0.5*(lower_bound+upper_bound);
 
-          while (upper_bound - lower_bound > precision) {
+          /* if the two enclosing coarse wavenumbers have the same
+             number of switches for this approximation, this switch
+             should be close to the interpolation (linear in ln(k)) of
+             their switching times, and at least between them: check
+             such a bracket with two calls (first a narrow one around
+             the interpolated time, then the full one), and then skip
+             the calls of the bisection outside this bracket, whose
+             outcome is known (the approximation flags can only
+             increase with time). The result is the same as with the
+             full bisection. */
 
-            class_call(perturb_approximations(ppr,
-                                              pba,
-                                              pth,
-                                              ppt,
-                                              index_md,
-                                              k,
-                                              mid,
-                                              ppw),
-                       ppt->error_message,
-                       ppt->error_message);
+          bracketed = _FALSE_;
+
+          if ((index_coarse >= 0) && (index_switch < _PERTURB_SWITCHES_MAX_)) {
+
+            offset_lo = (index_coarse*pst->ap_size+index_ap)*_PERTURB_SWITCHES_MAX_+index_switch;
+            offset_hi = ((index_coarse+1)*pst->ap_size+index_ap)*_PERTURB_SWITCHES_MAX_+index_switch;
+
+            if ((pst->number[index_coarse*pst->ap_size+index_ap] == num_switch) &&
+                (pst->number[(index_coarse+1)*pst->ap_size+index_ap] == num_switch)) {
+
+              tau_guess = pst->tau[offset_lo] + (pst->tau[offset_hi]-pst->tau[offset_lo])
+                * log(k/pst->k[index_coarse])/log(pst->k[index_coarse+1]/pst->k[index_coarse]);
+
+              for (attempt=0; (attempt<2) && (bracketed == _FALSE_); attempt++) {
+
+                if (attempt == 0) {
+                  bracket_lo = tau_guess - _PERTURB_SWITCH_BRACKET_*fabs(pst->tau[offset_hi]-pst->tau[offset_lo]) - 2.*precision;
+                  bracket_hi = tau_guess + _PERTURB_SWITCH_BRACKET_*fabs(pst->tau[offset_hi]-pst->tau[offset_lo]) + 2.*precision;
+                }
+                else {
+                  bracket_lo = MIN(pst->tau[offset_lo],pst->tau[offset_hi]) - 2.*precision;
+                  bracket_hi = MAX(pst->tau[offset_lo],pst->tau[offset_hi]) + 2.*precision;
+                }
+
+                bracketed = _TRUE_;
+
+                if (bracket_lo > lower_bound) {
+                  class_call(perturb_approximations(ppr,
+                                                    pba,
+                                                    pth,
+                                                    ppt,
+                                                    index_md,
+                                                    k,
+                                                    bracket_lo,
+                                                    ppw),
+                             ppt->error_message,
+                             ppt->error_message);
+                  if (ppw->approx[index_ap] > flag_ini+index_switch)
+                    bracketed = _FALSE_;
+                }
+
+                if ((bracketed == _TRUE_) && (bracket_hi < upper_bound)) {
+                  class_call(perturb_approximations(ppr,
+                                                    pba,
+                                                    pth,
+                                                    ppt,
+                                                    index_md,
+                                                    k,
+                                                    bracket_hi,
+                                                    ppw),
+                             ppt->error_message,
+                             ppt->error_message);
+                  if (ppw->approx[index_ap] <= flag_ini+index_switch)
+                    bracketed = _FALSE_;
+                }
+              }
+            }
+          }
+
+          while (upper_bound - lower_bound > precision) {
 
-            if (ppw->approx[index_ap] > flag_ini+index_switch) {
+            if ((bracketed == _TRUE_) && (mid < bracket_lo)) {
+              lower_bound=mid;
+            }
+            else if ((bracketed == _TRUE_) && (mid > bracket_hi)) {
               upper_bound=mid;
             }
             else {
-              lower_bound=mid;
+
+              class_call(perturb_approximations(ppr,
+                                                pba,
+                                                pth,
+                                                ppt,
+                                                index_md,
+                                                k,
+                                                mid,
+                                                ppw),
+                         ppt->error_message,
+                         ppt->error_message);
+
+              if (ppw->approx[index_ap] > flag_ini+index_switch) {
+                upper_bound=mid;
+              }
+              else {
+                lower_bound=mid;
+              }
             }
 
             mid = 0.5*(lower_bound+upper_bound);
@@ -2760,6 +4638,8 @@ int perturb_find_approximation_switches(
           }
 
           unsorted_tau_switch[index_switch_tot]=mid;
+          if ((tau_switch != NULL) && (index_switch < _PERTURB_SWITCHES_MAX_))
+            tau_switch[index_ap*_PERTURB_SWITCHES_MAX_+index_switch]=mid;
           index_switch_tot++;
 
           tau_min=mid;
@@ -2902,6 +4782,235 @@ int perturb_find_approximation_switches(
   return _SUCCESS_;
 }
 
+/**
+ * For a given mode, fill the table of approximation switching times
+ * on a coarse grid of wavenumbers, made of one wavenumber every
+ * ppr->tau_approx_k_step in ppt->k[index_md] (plus the last one). The
+ * wavenumbers of the grid are shared between threads. The table
+ * remains empty (k_size=0) when tau_approx_k_step is smaller than 2 or
+ * when there are too few wavenumbers.
+ *
+ * @param ppr               Input: pointer to precision structure
+ * @param pba               Input: pointer to background structure
+ * @param pth               Input: pointer to the thermodynamics structure
+ * @param ppt               Input/Output: pointer to the perturbation structure, with ppt->switch_table already allocated
+ * @param index_md          Input: index of mode under consideration (scalar/.../tensor)
+ * @param ppw               Input: workspaces of this mode, ppw[thread]
+ * @param number_of_threads Input: number of threads
+ * @return the error status
+ */
+
+int perturb_switch_table_init(
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermo * pth,
+                              struct perturbs * ppt,
+                              int index_md,
+                              struct perturb_workspace ** ppw,
+                              int number_of_threads
+                              ) {
+
+  struct perturb_switch_table * pst;
+  int k_size,index_k;
+  int thread=0;
+  int abort;
+
+  pst = &(ppt->switch_table[index_md]);
+
+  pst->k_size = 0;
+  pst->ap_size = ppw[0]->ap_size;
+  pst->k = NULL;
+  pst->number = NULL;
+  pst->tau = NULL;
+
+  if ((ppr->tau_approx_k_step < 2) || (ppt->k_size[index_md] < 2*ppr->tau_approx_k_step))
+    return _SUCCESS_;
+
+  k_size = (ppt->k_size[index_md]-1)/ppr->tau_approx_k_step+1;
+  if ((ppt->k_size[index_md]-1)%ppr->tau_approx_k_step != 0)
+    k_size++;
+
+  class_alloc(pst->k,k_size*sizeof(double),ppt->error_message);
+  class_alloc(pst->number,k_size*pst->ap_size*sizeof(int),ppt->error_message);
+  class_alloc(pst->tau,k_size*pst->ap_size*_PERTURB_SWITCHES_MAX_*sizeof(double),ppt->error_message);
+
+  for (index_k=0; index_k<k_size; index_k++)
+    pst->k[index_k] = ppt->k[index_md][MIN(index_k*ppr->tau_approx_k_step,ppt->k_size[index_md]-1)];
+
+  /* pst->k_size is still zero here: perturb_find_approximation_switches() does a full bisection */
+
+  abort = _FALSE_;
+
+#pragma omp parallel                                    \
+  shared(ppr,pba,pth,ppt,index_md,ppw,pst,k_size,abort) \
+  private(index_k,thread)                               \
+  num_threads(number_of_threads)
+
+  {
+
+#ifdef _OPENMP
+    thread=omp_get_thread_num();
+#endif
+
+#pragma omp for schedule (dynamic)
+
+    for (index_k=0; index_k<k_size; index_k++) {
+
+      class_call_parallel(perturb_switch_table_at_k(ppr,
+                                                    pba,
+                                                    pth,
+                                                    ppt,
+                                                    index_md,
+                                                    index_k,
+                                                    ppw[thread],
+                                                    pst),
+                          ppt->error_message,
+                          ppt->error_message);
+    }
+
+  } /* end of parallel region */
+
+  if (abort == _TRUE_) return _FAILURE_;
+
+  pst->k_size = k_size;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill one line of a table of approximation switching times, in the
+ * same way as perturb_solve() finds these times.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input: pointer to the thermodynamics structure
+ * @param ppt      Input: pointer to the perturbation structure
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param index_k  Input: index of coarse wavenumber in the table
+ * @param ppw      Input: pointer to perturb_workspace structure containing index values and workspaces
+ * @param pst      Input/Output: table of switching times
+ * @return the error status
+ */
+
+int perturb_switch_table_at_k(
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermo * pth,
+                              struct perturbs * ppt,
+                              int index_md,
+                              int index_k,
+                              struct perturb_workspace * ppw,
+                              struct perturb_switch_table * pst
+                              ) {
+
+  double k,tau_ini,tau_end;
+  int interval_number,index_interval,index_ap;
+  int * interval_number_of;
+  double * interval_limit;
+  int ** interval_approx;
+
+  k = pst->k[index_k];
+  tau_end = ppt->tau_sampling[ppt->tau_size-1];
+
+  ppw->last_index_back=0;
+  ppw->last_index_thermo=0;
+  ppw->inter_mode = pba->inter_normal;
+
+  class_call(perturb_find_initial_time(ppr,
+                                       pba,
+                                       pth,
+                                       ppt,
+                                       k,
+                                       ppw,
+                                       &tau_ini),
+             ppt->error_message,
+             ppt->error_message);
+
+  class_alloc(interval_number_of,ppw->ap_size*sizeof(int),ppt->error_message);
+
+  class_call(perturb_find_approximation_number(ppr,
+                                               pba,
+                                               pth,
+                                               ppt,
+                                               index_md,
+                                               k,
+                                               ppw,
+                                               tau_ini,
+                                               tau_end,
+                                               &interval_number,
+                                               interval_number_of),
+             ppt->error_message,
+             ppt->error_message);
+
+  class_alloc(interval_limit,(interval_number+1)*sizeof(double),ppt->error_message);
+  class_alloc(interval_approx,interval_number*sizeof(int*),ppt->error_message);
+  for (index_interval=0; index_interval<interval_number; index_interval++)
+    class_alloc(interval_approx[index_interval],ppw->ap_size*sizeof(int),ppt->error_message);
+
+  class_call(perturb_find_approximation_switches(ppr,
+                                                 pba,
+                                                 pth,
+                                                 ppt,
+                                                 index_md,
+                                                 k,
+                                                 ppw,
+                                                 tau_ini,
+                                                 tau_end,
+                                                 ppr->tol_tau_approx,
+                                                 interval_number,
+                                                 interval_number_of,
+                                                 interval_limit,
+                                                 interval_approx,
+                                                 pst->tau+index_k*pst->ap_size*_PERTURB_SWITCHES_MAX_),
+             ppt->error_message,
+             ppt->error_message);
+
+  for (index_ap=0; index_ap<ppw->ap_size; index_ap++) {
+    if (interval_number_of[index_ap]-1 <= _PERTURB_SWITCHES_MAX_)
+      pst->number[index_k*pst->ap_size+index_ap] = interval_number_of[index_ap]-1;
+    else
+      pst->number[index_k*pst->ap_size+index_ap] = -1;
+  }
+
+  for (index_interval=0; index_interval<interval_number; index_interval++)
+    free(interval_approx[index_interval]);
+  free(interval_approx);
+  free(interval_limit);
+  free(interval_number_of);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the tables of approximation switching times of all modes.
+ *
+ * @param ppt Input/Output: pointer to the perturbation structure
+ * @return the error status
+ */
+
+int perturb_switch_table_free(
+                              struct perturbs * ppt
+                              ) {
+
+  int index_md;
+
+  if (ppt->switch_table == NULL)
+    return _SUCCESS_;
+
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+    if (ppt->switch_table[index_md].k != NULL) {
+      free(ppt->switch_table[index_md].k);
+      free(ppt->switch_table[index_md].number);
+      free(ppt->switch_table[index_md].tau);
+    }
+  }
+
+  free(ppt->switch_table);
+  ppt->switch_table = NULL;
+
+  return _SUCCESS_;
+}
+
 /**
  * Initialize the field '-->pv' of a perturb_workspace structure, which
  * is a perturb_vector structure. This structure contains indices and
@@ -4036,13 +6145,8 @@ int perturb_initial_conditions(struct precision * ppr,
         rho_m, rho_nu (= all relativistic except photons), and their
         ratio. */
 
-    class_call(background_at_tau(pba,
-                                 tau,
-                                 pba->normal_info,
-                                 pba->inter_normal,
-                                 &(ppw->last_index_back),
-                                 ppw->pvecback),
-               pba->error_message,
+    class_call(perturb_vectors_at_tau(pba,NULL,ppw,tau,pba->inter_normal,_FALSE_,ppt->error_message),
+               ppt->error_message,
                ppt->error_message);
 
     a = ppw->pvecback[pba->index_bg_a];
@@ -4627,6 +6731,80 @@ int perturb_initial_conditions(struct precision * ppr,
   return _SUCCESS_;
 }
 
+/**
+ * Fill the background and thermodynamics vectors of the workspace,
+ * ppw->pvecback and (if with_thermo is _TRUE_) ppw->pvecthermo, at
+ * conformal time tau.
+ *
+ * This is the only function writing these two vectors. It remembers
+ * at which time, with which interpolation mode and with which content
+ * it last filled them, and only does the lookups which are still
+ * missing: the many calls to perturb_derivs() at the same time (in a
+ * Newton iteration, or for each column of a Jacobian) thus share a
+ * single lookup, and perturb_timescale() or perturb_approximations()
+ * only add the thermodynamical quantities to the background ones when
+ * they need them. This memory is cleared at the start of each
+ * perturb_solve(), and when a pooled workspace is handed out for a
+ * new run.
+ *
+ * @param pba           Input: pointer to background structure
+ * @param pth           Input: pointer to thermodynamics structure (only used if with_thermo is _TRUE_)
+ * @param ppw           Input/Output: pointer to perturbation workspace
+ * @param tau           Input: conformal time
+ * @param inter_mode    Input: interpolation mode (pba->inter_normal or pba->inter_closeby)
+ * @param with_thermo   Input: whether ppw->pvecthermo is needed too
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int perturb_vectors_at_tau(
+                           struct background * pba,
+                           struct thermo * pth,
+                           struct perturb_workspace * ppw,
+                           double tau,
+                           short inter_mode,
+                           short with_thermo,
+                           ErrorMsg error_message
+                           ) {
+
+  if ((ppw->lookup_content == 0) ||
+      (tau != ppw->lookup_tau) ||
+      (inter_mode != ppw->lookup_inter_mode)) {
+
+    ppw->lookup_content = 0;
+
+    class_call(background_at_tau(pba,
+                                 tau,
+                                 pba->normal_info,
+                                 inter_mode,
+                                 &(ppw->last_index_back),
+                                 ppw->pvecback),
+               pba->error_message,
+               error_message);
+
+    ppw->lookup_tau = tau;
+    ppw->lookup_inter_mode = inter_mode;
+    ppw->lookup_content = 1;
+  }
+
+  if ((with_thermo == _TRUE_) && (ppw->lookup_content == 1)) {
+
+    class_call(thermodynamics_at_z(pba,
+                                   pth,
+                                   1./ppw->pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
+                                   inter_mode,
+                                   &(ppw->last_index_thermo),
+                                   ppw->pvecback,
+                                   ppw->pvecthermo),
+               pth->error_message,
+               error_message);
+
+    ppw->lookup_content = 2;
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Evaluate background/thermodynamics at \f$ \tau \f$, infer useful flags / time scales for integrating perturbations.
  *
@@ -4696,8 +6874,8 @@ int perturb_approximations(
   /** - evaluate background quantities with background_at_tau() and
       Hubble time scale \f$ \tau_h = a/a' \f$ */
 
-  class_call(background_at_tau(pba,tau, pba->normal_info, ppw->inter_mode, &(ppw->last_index_back), ppw->pvecback),
-             pba->error_message,
+  class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,ppw->inter_mode,_FALSE_,ppt->error_message),
+             ppt->error_message,
              ppt->error_message);
 
   class_test(ppw->pvecback[pba->index_bg_H]*ppw->pvecback[pba->index_bg_a] == 0.,
@@ -4712,14 +6890,8 @@ int perturb_approximations(
 
     /** - --> (a) evaluate thermodynamical quantities with thermodynamics_at_z() */
 
-    class_call(thermodynamics_at_z(pba,
-                                   pth,
-                                   1./ppw->pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                   ppw->inter_mode,
-                                   &(ppw->last_index_thermo),
-                                   ppw->pvecback,
-                                   ppw->pvecthermo),
-               pth->error_message,
+    class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,ppw->inter_mode,_TRUE_,ppt->error_message),
+               ppt->error_message,
                ppt->error_message);
 
     /** - ---> (b.1.) if \f$ \kappa'=0 \f$, recombination is finished; tight-coupling approximation must be off */
@@ -4800,14 +6972,8 @@ int perturb_approximations(
 
     /** - --> (a) evaluate thermodynamical quantities with thermodynamics_at_z() */
 
-    class_call(thermodynamics_at_z(pba,
-                                   pth,
-                                   1./ppw->pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                   ppw->inter_mode,
-                                   &(ppw->last_index_thermo),
-                                   ppw->pvecback,
-                                   ppw->pvecthermo),
-               pth->error_message,
+    class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,ppw->inter_mode,_TRUE_,ppt->error_message),
+               ppt->error_message,
                ppt->error_message);
 
     /** - ---> (b.1.) if \f$ \kappa'=0 \f$, recombination is finished; tight-coupling approximation must be off */
@@ -4915,8 +7081,8 @@ int perturb_timescale(
   /** - evaluate background quantities with background_at_tau() and
       Hubble time scale \f$ \tau_h = a/a' \f$ */
 
-  class_call(background_at_tau(pba,tau, pba->normal_info, ppw->inter_mode, &(ppw->last_index_back), pvecback),
-             pba->error_message,
+  class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,ppw->inter_mode,_FALSE_,error_message),
+             error_message,
              error_message);
 
   class_test(pvecback[pba->index_bg_H]*pvecback[pba->index_bg_a] == 0.,
@@ -4936,14 +7102,8 @@ int perturb_timescale(
 
     if (ppw->approx[ppw->index_ap_tca] == (int)tca_off) {
 
-      class_call(thermodynamics_at_z(pba,
-                                     pth,
-                                     1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                     ppw->inter_mode,
-                                     &(ppw->last_index_thermo),
-                                     pvecback,
-                                     pvecthermo),
-                 pth->error_message,
+      class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,ppw->inter_mode,_TRUE_,error_message),
+                 error_message,
                  error_message);
 
       if (pvecthermo[pth->index_th_dkappa] != 0.) {
@@ -4967,14 +7127,8 @@ int perturb_timescale(
 
     if (ppw->approx[ppw->index_ap_tca] == (int)tca_off) {
 
-      class_call(thermodynamics_at_z(pba,
-                                     pth,
-                                     1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                     ppw->inter_mode,
-                                     &(ppw->last_index_thermo),
-                                     pvecback,
-                                     pvecthermo),
-                 pth->error_message,
+      class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,ppw->inter_mode,_TRUE_,error_message),
+                 error_message,
                  error_message);
 
       if (pvecthermo[pth->index_th_dkappa] != 0.) {
@@ -4997,14 +7151,8 @@ int perturb_timescale(
 
     if (ppw->approx[ppw->index_ap_tca] == (int)tca_off) {
 
-      class_call(thermodynamics_at_z(pba,
-                                     pth,
-                                     1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                     ppw->inter_mode,
-                                     &(ppw->last_index_thermo),
-                                     pvecback,
-                                     pvecthermo),
-                 pth->error_message,
+      class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,ppw->inter_mode,_TRUE_,error_message),
+                 error_message,
                  error_message);
 
       if (pvecthermo[pth->index_th_dkappa] != 0.) {
@@ -5781,27 +7929,12 @@ int perturb_sources(
 
   /** - get background/thermo quantities in this point */
 
-  class_call(background_at_tau(pba,
-                               tau,
-                               pba->normal_info,
-                               pba->inter_closeby,
-                               &(ppw->last_index_back),
-                               pvecback),
-             pba->error_message,
+  class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,pba->inter_closeby,_TRUE_,error_message),
+             error_message,
              error_message);
 
   z = pba->a_today/pvecback[pba->index_bg_a]-1.;
 
-  class_call(thermodynamics_at_z(pba,
-                                 pth,
-                                 z,  /* redshift z=1/a-1 */
-                                 pth->inter_closeby,
-                                 &(ppw->last_index_thermo),
-                                 pvecback,
-                                 pvecthermo),
-             pth->error_message,
-             error_message);
-
   a_rel = ppw->pvecback[pba->index_bg_a]/pba->a_today;
   a2_rel = a_rel * a_rel;
 
@@ -6218,7 +8351,7 @@ int perturb_print_variables(double tau,
   double delta_temp=0., delta_chi=0.;
 
   double a,a2,H;
-  int idx,index_q, storeidx;
+  int idx,index_q, storeidx=0;
   double *dataptr;
 
 
@@ -6480,22 +8613,27 @@ int perturb_print_variables(double tau,
     }
 
     //    fprintf(ppw->perturb_output_file," ");
-    /** - --> Handle (re-)allocation */
-    if (ppt->scalar_perturbations_data[ppw->index_ikout] == NULL){
-      class_alloc(ppt->scalar_perturbations_data[ppw->index_ikout],
-                  sizeof(double)*ppt->number_of_scalar_titles,
-                  error_message);
-      ppt->size_scalar_perturbation_data[ppw->index_ikout] = 0;
+    /** - --> Handle (re-)allocation, or fill the row buffer when perturbations are streamed */
+    if (ppw->perturb_output_file != NULL) {
+      dataptr = ppw->perturb_output_row;
     }
-    else{
-      ppt->scalar_perturbations_data[ppw->index_ikout] =
-        realloc(ppt->scalar_perturbations_data[ppw->index_ikout],
-                sizeof(double)*(ppt->size_scalar_perturbation_data[ppw->index_ikout]+ppt->number_of_scalar_titles));
+    else {
+      if (ppt->scalar_perturbations_data[ppw->index_ikout] == NULL){
+        class_alloc(ppt->scalar_perturbations_data[ppw->index_ikout],
+                    sizeof(double)*ppt->number_of_scalar_titles,
+                    error_message);
+        ppt->size_scalar_perturbation_data[ppw->index_ikout] = 0;
+      }
+      else{
+        ppt->scalar_perturbations_data[ppw->index_ikout] =
+          realloc(ppt->scalar_perturbations_data[ppw->index_ikout],
+                  sizeof(double)*(ppt->size_scalar_perturbation_data[ppw->index_ikout]+ppt->number_of_scalar_titles));
+      }
+      dataptr = ppt->scalar_perturbations_data[ppw->index_ikout]+
+        ppt->size_scalar_perturbation_data[ppw->index_ikout];
+      ppt->size_scalar_perturbation_data[ppw->index_ikout] += ppt->number_of_scalar_titles;
     }
     storeidx = 0;
-    dataptr = ppt->scalar_perturbations_data[ppw->index_ikout]+
-      ppt->size_scalar_perturbation_data[ppw->index_ikout];
-    ppt->size_scalar_perturbation_data[ppw->index_ikout] += ppt->number_of_scalar_titles;
 
     class_store_double(dataptr, tau, _TRUE_, storeidx);
     class_store_double(dataptr, pvecback[pba->index_bg_a], _TRUE_, storeidx);
@@ -6579,22 +8717,27 @@ int perturb_print_variables(double tau,
       l4_ur = y[ppw->pv->index_pt_delta_ur+4];
     }
 
-    /** - --> Handle (re-)allocation */
-    if (ppt->tensor_perturbations_data[ppw->index_ikout] == NULL){
-      class_alloc(ppt->tensor_perturbations_data[ppw->index_ikout],
-                  sizeof(double)*ppt->number_of_tensor_titles,
-                  error_message);
-      ppt->size_tensor_perturbation_data[ppw->index_ikout] = 0;
+    /** - --> Handle (re-)allocation, or fill the row buffer when perturbations are streamed */
+    if (ppw->perturb_output_file != NULL) {
+      dataptr = ppw->perturb_output_row;
     }
-    else{
-      ppt->tensor_perturbations_data[ppw->index_ikout] =
-        realloc(ppt->tensor_perturbations_data[ppw->index_ikout],
-                sizeof(double)*(ppt->size_tensor_perturbation_data[ppw->index_ikout]+ppt->number_of_tensor_titles));
+    else {
+      if (ppt->tensor_perturbations_data[ppw->index_ikout] == NULL){
+        class_alloc(ppt->tensor_perturbations_data[ppw->index_ikout],
+                    sizeof(double)*ppt->number_of_tensor_titles,
+                    error_message);
+        ppt->size_tensor_perturbation_data[ppw->index_ikout] = 0;
+      }
+      else{
+        ppt->tensor_perturbations_data[ppw->index_ikout] =
+          realloc(ppt->tensor_perturbations_data[ppw->index_ikout],
+                  sizeof(double)*(ppt->size_tensor_perturbation_data[ppw->index_ikout]+ppt->number_of_tensor_titles));
+      }
+      dataptr = ppt->tensor_perturbations_data[ppw->index_ikout]+
+        ppt->size_tensor_perturbation_data[ppw->index_ikout];
+      ppt->size_tensor_perturbation_data[ppw->index_ikout] += ppt->number_of_tensor_titles;
     }
     storeidx = 0;
-    dataptr = ppt->tensor_perturbations_data[ppw->index_ikout]+
-      ppt->size_tensor_perturbation_data[ppw->index_ikout];
-    ppt->size_tensor_perturbation_data[ppw->index_ikout] += ppt->number_of_tensor_titles;
 
     //fprintf(ppw->perturb_output_file," ");
     class_store_double(dataptr, tau, _TRUE_, storeidx);
@@ -6669,38 +8812,50 @@ int perturb_print_variables(double tau,
     free(delta_p_over_delta_rho_ncdm);
   }
 
+  /** - when perturbations are streamed, append the row to the file of this wavenumber */
+
+  if ((ppw->perturb_output_file != NULL) && (storeidx > 0)) {
+    class_call(binary_output_write(ppw->perturb_output_file,
+                                   ppw->perturb_output_row,
+                                   sizeof(double),
+                                   storeidx,
+                                   error_message),
+               error_message,
+               error_message);
+    ppw->perturb_output_rows++;
+  }
+
   return _SUCCESS_;
 
   }
 
 /**
- * Compute derivative of all perturbations to be integrated
- *
- * For each mode (scalar/vector/tensor) and each wavenumber k, this
- * function computes the derivative of all values in the vector of
- * perturbed variables to be integrated.
- *
- * This is one of the few functions in the code which is passed to the generic_integrator() routine.
- * Since generic_integrator() should work with functions passed from various modules, the format of the arguments
- * is a bit special:
- * - fixed parameters and workspaces are passed through a generic pointer.
- *   generic_integrator() doesn't know what the content of this pointer is.
- * - errors are not written as usual in pth->error_message, but in a generic
- *   error_message passed in the list of arguments.
+ * Model test inside perturb_derivs_kernel(): in the generic kernel,
+ * evaluate the run-time test; in a specialised kernel, use the value
+ * that the test takes for all models of this class.
+ */
+
+#define _dk_model_(test,specialised_value) ((kernel == dk_generic) ? (test) : (specialised_value))
+
+/**
+ * Body of perturb_derivs(), for one of the kernels listed in enum
+ * derivs_kernels.
  *
  * @param tau                      Input: conformal time
  * @param y                        Input: vector of perturbations
  * @param dy                       Output: vector of its derivatives (already allocated)
  * @param parameters_and_workspace Input/Output: in input, fixed parameters (e.g. indices); in output, background and thermo quantities evaluated at tau.
  * @param error_message            Output: error message
+ * @param kernel                   Input: kernel, always passed as a constant
  */
 
-int perturb_derivs(double tau,
-                   double * y,
-                   double * dy,
-                   void * parameters_and_workspace,
-                   ErrorMsg error_message
-                   ) {
+static _ALWAYS_INLINE_ int perturb_derivs_kernel(double tau,
+                                                 double * y,
+                                                 double * dy,
+                                                 void * parameters_and_workspace,
+                                                 ErrorMsg error_message,
+                                                 enum derivs_kernels kernel
+                                                 ) {
   /** Summary: */
 
   /** - define local variables */
@@ -6778,25 +8933,13 @@ int perturb_derivs(double tau,
   pvecmetric = ppw->pvecmetric;
   pv = ppw->pv;
 
-  /** - get background/thermo quantities in this point */
-
-  class_call(background_at_tau(pba,
-                               tau,
-                               pba->normal_info,
-                               pba->inter_closeby,
-                               &(ppw->last_index_back),
-                               pvecback),
-             pba->error_message,
-             error_message);
+  /** - get background/thermo quantities in this point (only looked
+      up once for all the calls at the same time, e.g. during a
+      Newton iteration or when the evolver estimates the Jacobian
+      column by column; see perturb_vectors_at_tau()) */
 
-  class_call(thermodynamics_at_z(pba,
-                                 pth,
-                                 1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                 pth->inter_closeby,
-                                 &(ppw->last_index_thermo),
-                                 pvecback,
-                                 pvecthermo),
-             pth->error_message,
+  class_call(perturb_vectors_at_tau(pba,pth,ppw,tau,pba->inter_closeby,_TRUE_,error_message),
+             error_message,
              error_message);
 
   /** - get metric perturbations with perturb_einstein() */
@@ -6821,7 +8964,7 @@ int perturb_derivs(double tau,
 
   /** - Compute 'generalised cotK function of argument \f$ \sqrt{|K|}*\tau \f$, for closing hierarchy.
       (see equation 2.34 in arXiv:1305.3261): */
-  if (pba->has_curvature == _FALSE_){
+  if (_dk_model_(pba->has_curvature == _FALSE_,_TRUE_)){
     cotKgen = 1.0/(k*tau);
   }
   else{
@@ -6835,7 +8978,7 @@ int perturb_derivs(double tau,
   s2_squared = 1.-3.*pba->K/k2;
 
   /** - for scalar modes: */
-  if (_scalars_) {
+  if (_dk_model_(_scalars_,_TRUE_)) {
 
     /** - --> (a) define short-cut notations for the scalar perturbations */
     if (ppw->approx[ppw->index_ap_rsa] == (int)rsa_off) {
@@ -6848,7 +8991,7 @@ int perturb_derivs(double tau,
 
     /** - --> (b) perturbed recombination **/
 
-    if ((ppt->has_perturbed_recombination == _TRUE_)&&(ppw->approx[ppw->index_ap_tca]==(int)tca_off)){
+    if ((_dk_model_(ppt->has_perturbed_recombination == _TRUE_,_FALSE_))&&(ppw->approx[ppw->index_ap_tca]==(int)tca_off)){
 
       delta_temp= y[ppw->pv->index_pt_perturbed_recombination_delta_temp];
       delta_chi= y[ppw->pv->index_pt_perturbed_recombination_delta_chi];
@@ -6899,7 +9042,7 @@ int perturb_derivs(double tau,
             - In the ufa_class approximation, the leading-order source term is (h_prime/2) in synchronous gauge,
              (-3 (phi_prime+psi_prime)) in newtonian gauge: we approximate the later by (-6 phi_prime) */
 
-    if (ppt->gauge == synchronous) {
+    if (_dk_model_(ppt->gauge == synchronous,_TRUE_)) {
 
       metric_continuity = pvecmetric[ppw->index_mt_h_prime]/2.;
       metric_euler = 0.;
@@ -6908,7 +9051,7 @@ int perturb_derivs(double tau,
       metric_ufa_class = pvecmetric[ppw->index_mt_h_prime]/2.;
     }
 
-    if (ppt->gauge == newtonian) {
+    if (_dk_model_(ppt->gauge == newtonian,_FALSE_)) {
 
       metric_continuity = -3.*pvecmetric[ppw->index_mt_phi_prime];
       metric_euler = k2*pvecmetric[ppw->index_mt_psi];
@@ -7065,11 +9208,11 @@ int perturb_derivs(double tau,
 
     /** - ---> cdm */
 
-    if (pba->has_cdm == _TRUE_) {
+    if (_dk_model_(pba->has_cdm == _TRUE_,_TRUE_)) {
 
       /** - ----> newtonian gauge: cdm density and velocity */
 
-      if (ppt->gauge == newtonian) {
+      if (_dk_model_(ppt->gauge == newtonian,_FALSE_)) {
         dy[pv->index_pt_delta_cdm] = -(y[pv->index_pt_theta_cdm]+metric_continuity); /* cdm density */
 
         dy[pv->index_pt_theta_cdm] = - a_prime_over_a*y[pv->index_pt_theta_cdm] + metric_euler; /* cdm velocity */
@@ -7077,7 +9220,7 @@ int perturb_derivs(double tau,
 
       /** - ----> synchronous gauge: cdm density only (velocity set to zero by definition of the gauge) */
 
-      if (ppt->gauge == synchronous) {
+      if (_dk_model_(ppt->gauge == synchronous,_TRUE_)) {
         dy[pv->index_pt_delta_cdm] = -metric_continuity; /* cdm density */
       }
 
@@ -7086,7 +9229,7 @@ int perturb_derivs(double tau,
     /* perturbed recombination */
     /* computes the derivatives of delta x_e and delta T_b */
 
-    if((ppt->has_perturbed_recombination == _TRUE_)&&(ppw->approx[ppw->index_ap_tca] == (int)tca_off)){
+    if((_dk_model_(ppt->has_perturbed_recombination == _TRUE_,_FALSE_))&&(ppw->approx[ppw->index_ap_tca] == (int)tca_off)){
 
       // alpha * n_H is in inverse seconds, so we have to multiply it by Mpc_in_sec
       dy[ppw->pv->index_pt_perturbed_recombination_delta_chi] = - alpha_rec* a * chi*n_H  *(delta_alpha_rec + delta_chi + delta_b) * _Mpc_over_m_ / _c_ ;
@@ -7098,7 +9241,7 @@ int perturb_derivs(double tau,
 
     /** - ---> dcdm and dr */
 
-    if (pba->has_dcdm == _TRUE_) {
+    if (_dk_model_(pba->has_dcdm == _TRUE_,_FALSE_)) {
 
       /** - ----> dcdm */
 
@@ -7110,7 +9253,7 @@ int perturb_derivs(double tau,
 
     /** - ---> dr */
 
-    if ((pba->has_dcdm == _TRUE_)&&(pba->has_dr == _TRUE_)) {
+    if ((_dk_model_(pba->has_dcdm == _TRUE_,_FALSE_))&&(_dk_model_(pba->has_dr == _TRUE_,_FALSE_))) {
 
 
       /* f = rho_dr*a^4/rho_crit_today. In CLASS density units
@@ -7151,7 +9294,7 @@ int perturb_derivs(double tau,
 
     /** - ---> fluid (fld) */
 
-    if (pba->has_fld == _TRUE_) {
+    if (_dk_model_(pba->has_fld == _TRUE_,_FALSE_)) {
 
       /** - ----> factors w, w_prime, adiabatic sound speed ca2 (all three background-related),
           plus actual sound speed in the fluid rest frame cs2 */
@@ -7179,7 +9322,7 @@ int perturb_derivs(double tau,
 
     /** - ---> scalar field (scf) */
 
-    if (pba->has_scf == _TRUE_) {
+    if (_dk_model_(pba->has_scf == _TRUE_,_FALSE_)) {
 
       /** - ----> field value */
 
@@ -7195,7 +9338,7 @@ int perturb_derivs(double tau,
 
     /** - ---> ultra-relativistic neutrino/relics (ur) */
 
-    if (pba->has_ur == _TRUE_) {
+    if (_dk_model_(pba->has_ur == _TRUE_,_TRUE_)) {
 
       /** - ----> if radiation streaming approximation is off */
 
@@ -7279,7 +9422,7 @@ int perturb_derivs(double tau,
 
     /** - ---> non-cold dark matter (ncdm): massive neutrinos, WDM, etc. */
     //TBC: curvature in all ncdm
-    if (pba->has_ncdm == _TRUE_) {
+    if (_dk_model_(pba->has_ncdm == _TRUE_,kernel == dk_lcdm_ncdm_synchronous)) {
 
       idx = pv->index_pt_psi0_ncdm1;
 
@@ -7415,13 +9558,13 @@ int perturb_derivs(double tau,
 
     /** - ---> eta of synchronous gauge */
 
-    if (ppt->gauge == synchronous) {
+    if (_dk_model_(ppt->gauge == synchronous,_TRUE_)) {
 
       dy[pv->index_pt_eta] = pvecmetric[ppw->index_mt_eta_prime];
 
     }
 
-    if (ppt->gauge == newtonian) {
+    if (_dk_model_(ppt->gauge == newtonian,_FALSE_)) {
 
       dy[pv->index_pt_phi] = pvecmetric[ppw->index_mt_phi_prime];
 
@@ -7430,7 +9573,7 @@ int perturb_derivs(double tau,
   }
 
   /** - vector mode */
-  if (_vectors_) {
+  if (_dk_model_(_vectors_,_FALSE_)) {
 
     fprintf(stderr,"we are in vectors\n");
 
@@ -7439,14 +9582,14 @@ int perturb_derivs(double tau,
 
     /** - --> baryon velocity */
 
-    if (ppt->gauge == synchronous) {
+    if (_dk_model_(ppt->gauge == synchronous,_TRUE_)) {
 
       dy[pv->index_pt_theta_b] = -(1-3.*cb2)*a_prime_over_a*y[pv->index_pt_theta_b]
         - pvecthermo[pth->index_th_dkappa]*(_SQRT2_/4.*delta_g + y[pv->index_pt_theta_b]);
 
     }
 
-    else if (ppt->gauge == newtonian) {
+    else if (_dk_model_(ppt->gauge == newtonian,_FALSE_)) {
 
       dy[pv->index_pt_theta_b] = -(1-3.*cb2)*a_prime_over_a*y[pv->index_pt_theta_b]
         - _SQRT2_/4.*pvecthermo[pth->index_th_dkappa]*(delta_g+2.*_SQRT2_*y[pv->index_pt_theta_b])
@@ -7473,7 +9616,7 @@ int perturb_derivs(double tau,
                        +10./7.*y[pv->index_pt_pol2_g]
                        -4./7.*y[pv->index_pt_pol0_g+4]);
 
-    if (ppt->gauge == synchronous) {
+    if (_dk_model_(ppt->gauge == synchronous,_TRUE_)) {
 
       /* photon density (delta_g = F_0) */
       dy[pv->index_pt_delta_g] =
@@ -7488,7 +9631,7 @@ int perturb_derivs(double tau,
 
     }
 
-    else if (ppt->gauge == newtonian) {
+    else if (_dk_model_(ppt->gauge == newtonian,_FALSE_)) {
 
       /* photon density (delta_g = F_0) */
       dy[pv->index_pt_delta_g] =
@@ -7551,13 +9694,13 @@ int perturb_derivs(double tau,
       }
     */
 
-    if (ppt->gauge == synchronous) {
+    if (_dk_model_(ppt->gauge == synchronous,_TRUE_)) {
 
       /* Vector metric perturbation in synchronous gauge: */
       dy[pv->index_pt_hv_prime] = pvecmetric[ppw->index_mt_hv_prime_prime];
 
     }
-    else if (ppt->gauge == newtonian){
+    else if (_dk_model_(ppt->gauge == newtonian,_FALSE_)){
 
       /* Vector metric perturbation in Newtonian gauge: */
       dy[pv->index_pt_V] = pvecmetric[ppw->index_mt_V_prime];
@@ -7568,7 +9711,7 @@ int perturb_derivs(double tau,
 
 
   /** - tensor modes: */
-  if (_tensors_) {
+  if (_dk_model_(_tensors_,_FALSE_)) {
 
     if (ppw->approx[ppw->index_ap_rsa] == (int)rsa_off) {
       if (ppw->approx[ppw->index_ap_tca]==(int)tca_off) {
@@ -7735,6 +9878,317 @@ int perturb_derivs(double tau,
   return _SUCCESS_;
 }
 
+#undef _dk_model_
+
+/**
+ * Compute derivative of all perturbations to be integrated
+ *
+ * For each mode (scalar/vector/tensor) and each wavenumber k, this
+ * function computes the derivative of all values in the vector of
+ * perturbed variables to be integrated.
+ *
+ * This is one of the few functions in the code which is passed to the generic_integrator() routine.
+ * Since generic_integrator() should work with functions passed from various modules, the format of the arguments
+ * is a bit special:
+ * - fixed parameters and workspaces are passed through a generic pointer.
+ *   generic_integrator() doesn't know what the content of this pointer is.
+ * - errors are not written as usual in pth->error_message, but in a generic
+ *   error_message passed in the list of arguments.
+ *
+ * @param tau                      Input: conformal time
+ * @param y                        Input: vector of perturbations
+ * @param dy                       Output: vector of its derivatives (already allocated)
+ * @param parameters_and_workspace Input/Output: in input, fixed parameters (e.g. indices); in output, background and thermo quantities evaluated at tau.
+ * @param error_message            Output: error message
+ */
+
+int perturb_derivs(double tau,
+                   double * y,
+                   double * dy,
+                   void * parameters_and_workspace,
+                   ErrorMsg error_message
+                   ) {
+
+  int status;
+
+  /** - count hardware events in this kernel (only with -DCLASS_PAPI) */
+  class_kernel_start(kernel_perturb_derivs);
+
+  /** - call the kernel chosen for this mode in perturb_workspace_init(); each
+      call below passes a constant kernel, so that the compiler can emit one
+      copy of perturb_derivs_kernel() per model class, stripped of the tests
+      on model flags that are fixed for this class. These copies are not
+      bitwise equivalent to the generic kernel: with -ffast-math, the
+      compiler orders the folded operations differently, and the results
+      move at the level of the integration tolerance (see
+      perturb_specialised_derivs in struct precision) */
+
+  switch (((struct perturb_parameters_and_workspace *)parameters_and_workspace)->ppw->derivs_kernel) {
+
+  case dk_lcdm_synchronous:
+    status = perturb_derivs_kernel(tau,y,dy,parameters_and_workspace,error_message,dk_lcdm_synchronous);
+    break;
+
+  case dk_lcdm_ncdm_synchronous:
+    status = perturb_derivs_kernel(tau,y,dy,parameters_and_workspace,error_message,dk_lcdm_ncdm_synchronous);
+    break;
+
+  default:
+    status = perturb_derivs_kernel(tau,y,dy,parameters_and_workspace,error_message,dk_generic);
+  }
+
+  class_kernel_stop(kernel_perturb_derivs);
+
+  return status;
+}
+
+/**
+ * Compute the Jacobian of perturb_derivs() in sparse format
+ *
+ * This function can be passed to evolver_ndf15() instead of letting
+ * the evolver estimate the Jacobian by finite differences. It relies
+ * on two properties of the perturbation equations:
+ *
+ * - they are linear in the perturbations, so column j of the
+ *   Jacobian is exactly the derivative computed for a unit vector in
+ *   direction j (minus the derivative of the null vector, which
+ *   vanishes but is subtracted anyway);
+ *
+ * - the free-streaming multipoles l>=3 of the photon temperature,
+ *   photon polarization, ultra-relativistic species and each momentum
+ *   bin of non-cold dark matter are only coupled to their neighbours
+ *   l-1 and l+1 (and to themselves through damping or the truncation
+ *   of the hierarchy). Columns whose indices differ by three or more
+ *   thus never touch the same rows, and all these columns can be
+ *   obtained with three calls to perturb_derivs() only.
+ *
+ * All other columns (low multipoles, matter, metric) are obtained
+ * one by one. Hence the cost is 4 + (number of such columns) calls
+ * instead of the pt_size calls needed by a dense finite-difference
+ * estimate, with no need for the evolver to learn the sparsity
+ * pattern first. If the structure assumed here was ever violated by
+ * new equations, the only consequence would be a less accurate
+ * Jacobian, i.e. slower Newton iterations, not wrong results.
+ *
+ * The calls to perturb_derivs() overwrite the quantities stored in
+ * the workspace (metric, approximated slips and shears...); the
+ * evolver always evaluates the derivative at the current point again
+ * before calling perturb_sources().
+ *
+ * @param tau                      Input: conformal time
+ * @param y                        Input: vector of perturbations (unused, since equations are linear)
+ * @param dy                       Input: vector of its derivatives (unused, since equations are linear)
+ * @param J                        Output: Jacobian in compressed column format (already allocated with J->maxnz entries)
+ * @param has_jacobian             Output: set to _FALSE_ if the Jacobian has more than J->maxnz non-zero entries
+ * @param nfe                      Input/Output: number of calls to perturb_derivs(), incremented
+ * @param parameters_and_workspace Input/Output: fixed parameters (e.g. indices), workspace
+ * @param error_message            Output: error message
+ * @return the error status
+ */
+
+int perturb_jacobian(double tau,
+                     double * y,
+                     double * dy,
+                     sp_mat * J,
+                     short * has_jacobian,
+                     int * nfe,
+                     void * parameters_and_workspace,
+                     ErrorMsg error_message
+                     ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  struct perturb_parameters_and_workspace * pppaw;
+  struct background * pba;
+  struct perturbs * ppt;
+  struct perturb_workspace * ppw;
+  struct perturb_vector * pv;
+  int index_md;
+  int pt_size;
+  int index_pt,index_row,index_group,n_ncdm,index_q,idx,nz;
+  short has_hierarchy = _FALSE_;
+
+  /* for each column, first and last row in which it can appear, when
+     it is a free-streaming multipole (row_min=-1 otherwise) */
+  int * row_min;
+  int * row_max;
+
+  /* probe vector, derivative of the null vector, derivatives of the three groups of multipoles */
+  double * probe;
+  double * dy_zero;
+  double * dy_group;
+  double * dy_probe;
+
+  /** - rename the fields of the input structure (just to avoid heavy notations) */
+
+  pppaw = parameters_and_workspace;
+  index_md = pppaw->index_md;
+  pba = pppaw->pba;
+  ppt = pppaw->ppt;
+  ppw = pppaw->ppw;
+  pv = ppw->pv;
+  pt_size = pv->pt_size;
+
+  class_alloc(row_min,2*pt_size*sizeof(int),error_message);
+  row_max = row_min + pt_size;
+  class_alloc(probe,6*pt_size*sizeof(double),error_message);
+  dy_zero = probe + pt_size;
+  dy_probe = dy_zero + pt_size;
+  dy_group = dy_probe + pt_size;
+
+  /** - identify the free-streaming multipoles l>=3 (only for scalars,
+      other modes are simply treated column by column) */
+
+  for (index_pt=0; index_pt<pt_size; index_pt++)
+    row_min[index_pt] = -1;
+
+  if (_scalars_) {
+
+    if ((ppw->approx[ppw->index_ap_rsa] == (int)rsa_off) &&
+        (ppw->approx[ppw->index_ap_tca] == (int)tca_off)) {
+
+      perturb_jacobian_hierarchy(pv->index_pt_delta_g,pv->l_max_g,row_min,row_max);
+      perturb_jacobian_hierarchy(pv->index_pt_pol0_g,pv->l_max_pol_g,row_min,row_max);
+    }
+
+    if ((pba->has_ur == _TRUE_) &&
+        (ppw->approx[ppw->index_ap_rsa] == (int)rsa_off) &&
+        (ppw->approx[ppw->index_ap_ufa] == (int)ufa_off)) {
+
+      perturb_jacobian_hierarchy(pv->index_pt_delta_ur,pv->l_max_ur,row_min,row_max);
+    }
+
+    /* in the fluid approximation, l_max_ncdm=2 and there is nothing to do */
+    if (pba->has_ncdm == _TRUE_) {
+
+      idx = pv->index_pt_psi0_ncdm1;
+
+      for (n_ncdm=0; n_ncdm < pv->N_ncdm; n_ncdm++) {
+        for (index_q=0; index_q < pv->q_size_ncdm[n_ncdm]; index_q++) {
+          perturb_jacobian_hierarchy(idx,pv->l_max_ncdm[n_ncdm],row_min,row_max);
+          idx += pv->l_max_ncdm[n_ncdm]+1;
+        }
+      }
+    }
+  }
+
+  for (index_pt=0; index_pt<pt_size; index_pt++)
+    if (row_min[index_pt] >= 0)
+      has_hierarchy = _TRUE_;
+
+  /** - derivative of the null vector */
+
+  for (index_pt=0; index_pt<pt_size; index_pt++)
+    probe[index_pt] = 0.;
+
+  class_call(perturb_derivs(tau,probe,dy_zero,parameters_and_workspace,error_message),
+             error_message,
+             error_message);
+  (*nfe)++;
+
+  /** - derivatives of the three groups of multipoles with index_pt%3 = 0, 1, 2 */
+
+  if (has_hierarchy == _TRUE_) {
+    for (index_group=0; index_group<3; index_group++) {
+      for (index_pt=0; index_pt<pt_size; index_pt++)
+        probe[index_pt] = ((row_min[index_pt] >= 0) && (index_pt%3 == index_group)) ? 1. : 0.;
+
+      class_call(perturb_derivs(tau,probe,dy_group+index_group*pt_size,parameters_and_workspace,error_message),
+                 error_message,
+                 error_message);
+      (*nfe)++;
+    }
+  }
+
+  /** - fill the Jacobian column by column. The diagonal is always
+      kept, as in the pattern built by the evolver itself */
+
+  for (index_pt=0; index_pt<pt_size; index_pt++)
+    probe[index_pt] = 0.;
+
+  nz = 0;
+  J->Ap[0] = 0;
+  *has_jacobian = _TRUE_;
+
+  for (index_pt=0; index_pt<pt_size; index_pt++) {
+
+    if (row_min[index_pt] >= 0) {
+
+      index_group = index_pt%3;
+
+      for (index_row=row_min[index_pt]; index_row<=row_max[index_pt]; index_row++) {
+        if (nz >= J->maxnz) {
+          *has_jacobian = _FALSE_;
+          break;
+        }
+        J->Ai[nz] = index_row;
+        J->Ax[nz] = dy_group[index_group*pt_size+index_row] - dy_zero[index_row];
+        nz++;
+      }
+    }
+    else {
+
+      probe[index_pt] = 1.;
+
+      class_call(perturb_derivs(tau,probe,dy_probe,parameters_and_workspace,error_message),
+                 error_message,
+                 error_message);
+      (*nfe)++;
+
+      probe[index_pt] = 0.;
+
+      for (index_row=0; index_row<pt_size; index_row++) {
+        if ((index_row == index_pt) || (dy_probe[index_row] != dy_zero[index_row])) {
+          if (nz >= J->maxnz) {
+            *has_jacobian = _FALSE_;
+            break;
+          }
+          J->Ai[nz] = index_row;
+          J->Ax[nz] = dy_probe[index_row] - dy_zero[index_row];
+          nz++;
+        }
+      }
+    }
+
+    if (*has_jacobian == _FALSE_)
+      break;
+
+    J->Ap[index_pt+1] = nz;
+  }
+
+  free(row_min);
+  free(probe);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Flag the multipoles l>=3 of one Boltzmann hierarchy for perturb_jacobian()
+ *
+ * @param index_l0 Input: index of the l=0 multipole in the vector of perturbations
+ * @param l_max    Input: multipole at which the hierarchy is truncated
+ * @param row_min  Output: first row coupled to each flagged column (l-1)
+ * @param row_max  Output: last row coupled to each flagged column (l+1, or l_max)
+ * @return the error status
+ */
+
+int perturb_jacobian_hierarchy(int index_l0,
+                               int l_max,
+                               int * row_min,
+                               int * row_max
+                               ) {
+  int l;
+
+  for (l=3; l<=l_max; l++) {
+    row_min[index_l0+l] = index_l0+l-1;
+    row_max[index_l0+l] = index_l0+MIN(l+1,l_max);
+  }
+
+  return _SUCCESS_;
+}
+
 int perturb_tca_slip_and_shear(double * y,
                                void * parameters_and_workspace,
                                ErrorMsg error_message
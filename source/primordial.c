@@ -16,6 +16,10 @@
 
 #include "primordial.h"
 
+/** list of all external spectrum functions registered in this process */
+
+static struct primordial_external_function * primordial_external_function_list = NULL;
+
 /**
  * Primordial spectra for arbitrary argument and for all initial conditions.
  *
@@ -174,6 +178,207 @@ int primordial_spectrum_at_k(
 
 }
 
+/**
+ * Array version of primordial_spectrum_at_k(): fill the primordial
+ * spectra for a whole list of wavenumbers in one call.
+ *
+ * In the analytic case the power law is evaluated directly for each
+ * pair of initial conditions, with ln(k/k_pivot) computed once per
+ * wavenumber and no exp()/log() round trip in logarithmic mode; this
+ * also removes the need to switch to a direct computation outside the
+ * tabulated range. Otherwise the table is interpolated with a hunting
+ * search starting from the previous wavenumber, so that a list sorted
+ * in growing order is swept through the table only once.
+ *
+ * Same conventions as primordial_spectrum_at_k() for the linear and
+ * logarithmic modes and for the cross-correlation angles.
+ *
+ * @param ppm        Input: pointer to primordial structure containing tabulated primordial spectrum
+ * @param index_md   Input: index of mode (scalar, tensor, ...)
+ * @param mode       Input: linear or logarithmic
+ * @param input      Input: array of wavenumbers in 1/Mpc (linear mode) or of their logarithms (logarithmic mode)
+ * @param input_size Input: number of wavenumbers
+ * @param output     Output: primordial spectra in the same format as for primordial_spectrum_at_k(), in output[index_k*ic_ic_size+index_ic1_ic2]
+ * @return the error status
+ */
+
+int primordial_spectrum_at_k_vector(
+                                    struct primordial * ppm,
+                                    int index_md,
+                                    enum linear_or_logarithmic mode,
+                                    double * input,
+                                    int input_size,
+                                    double * output /* array with argument output[index_k*ic_ic_size+index_ic1_ic2] (must be already allocated) */
+                                    ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_k,index_ic1,index_ic2,index_ic1_ic2,index_ic1_ic1,index_ic2_ic2;
+  int ic_size,ic_ic_size;
+  int last_index=0;
+  double lnk,x,ln_k_pivot;
+  double * pk;
+
+  ic_size = ppm->ic_size[index_md];
+  ic_ic_size = ppm->ic_ic_size[index_md];
+
+  /** - analytic spectrum: evaluate the power law directly, pair by
+      pair, with k in the inner loop */
+
+  if (ppm->primordial_spec_type == analytic_Pk) {
+
+    ln_k_pivot = log(ppm->k_pivot);
+
+    /* first store x=ln(k/k_pivot) in the diagonal entries, which are
+       overwritten last */
+
+    for (index_k=0; index_k<input_size; index_k++) {
+      if (mode == linear) {
+        class_test(input[index_k]<=0.,
+                   ppm->error_message,
+                   "k = %e",input[index_k]);
+        x = log(input[index_k]) - ln_k_pivot;
+      }
+      else {
+        x = input[index_k] - ln_k_pivot;
+      }
+      for (index_ic1_ic2 = 0; index_ic1_ic2 < ic_ic_size; index_ic1_ic2++)
+        output[index_k*ic_ic_size+index_ic1_ic2] = x;
+    }
+
+    /* the exponent (n-1)x+alpha/2 x^2 of each pair is computed in
+       place, diagonal pairs last since off-diagonal ones need them */
+
+    for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+      for (index_ic2 = index_ic1+1; index_ic2 < ic_size; index_ic2++) {
+
+        index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,ic_size);
+        index_ic1_ic1 = index_symmetric_matrix(index_ic1,index_ic1,ic_size);
+        index_ic2_ic2 = index_symmetric_matrix(index_ic2,index_ic2,ic_size);
+
+        for (index_k=0; index_k<input_size; index_k++) {
+
+          pk = output+index_k*ic_ic_size;
+
+          if (ppm->is_non_zero[index_md][index_ic1_ic2] == _FALSE_) {
+            pk[index_ic1_ic2] = 0.;
+            continue;
+          }
+
+          x = pk[index_ic1_ic2];
+
+          /* in logarithmic mode, the exponent of the cross-correlation
+             angle P12/sqrt(P11 P22) is that of P12 minus the mean of the
+             diagonal exponents */
+
+          if (mode == logarithmic) {
+            pk[index_ic1_ic2] = ppm->amplitude[index_md][index_ic1_ic2]
+              /sqrt(ppm->amplitude[index_md][index_ic1_ic1]*ppm->amplitude[index_md][index_ic2_ic2])
+              *exp(x*(ppm->tilt[index_md][index_ic1_ic2]
+                      -0.5*(ppm->tilt[index_md][index_ic1_ic1]+ppm->tilt[index_md][index_ic2_ic2])
+                      +0.5*x*(ppm->running[index_md][index_ic1_ic2]
+                              -0.5*(ppm->running[index_md][index_ic1_ic1]+ppm->running[index_md][index_ic2_ic2]))));
+          }
+          else {
+            pk[index_ic1_ic2] = ppm->amplitude[index_md][index_ic1_ic2]
+              *exp(x*(ppm->tilt[index_md][index_ic1_ic2]-1.
+                      +0.5*x*ppm->running[index_md][index_ic1_ic2]));
+          }
+        }
+      }
+    }
+
+    for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+
+      index_ic1_ic1 = index_symmetric_matrix(index_ic1,index_ic1,ic_size);
+
+      for (index_k=0; index_k<input_size; index_k++) {
+
+        pk = output+index_k*ic_ic_size;
+        x = pk[index_ic1_ic1];
+
+        if (ppm->is_non_zero[index_md][index_ic1_ic1] == _FALSE_) {
+          pk[index_ic1_ic1] = (mode == linear) ? 0. : log(0.);
+        }
+        else if (mode == logarithmic) {
+          pk[index_ic1_ic1] = log(ppm->amplitude[index_md][index_ic1_ic1])
+            + x*(ppm->tilt[index_md][index_ic1_ic1]-1.
+                 +0.5*x*ppm->running[index_md][index_ic1_ic1]);
+        }
+        else {
+          pk[index_ic1_ic1] = ppm->amplitude[index_md][index_ic1_ic1]
+            *exp(x*(ppm->tilt[index_md][index_ic1_ic1]-1.
+                    +0.5*x*ppm->running[index_md][index_ic1_ic1]));
+        }
+      }
+    }
+
+    return _SUCCESS_;
+  }
+
+  /** - tabulated spectrum: interpolate with a search starting from
+      the last interval found */
+
+  for (index_k=0; index_k<input_size; index_k++) {
+
+    pk = output+index_k*ic_ic_size;
+
+    if (mode == linear) {
+      class_test(input[index_k]<=0.,
+                 ppm->error_message,
+                 "k = %e",input[index_k]);
+      lnk=log(input[index_k]);
+    }
+    else {
+      lnk = input[index_k];
+    }
+
+    class_test((lnk > ppm->lnk[ppm->lnk_size-1]) || (lnk < ppm->lnk[0]),
+               ppm->error_message,
+               "k=%e out of range [%e : %e]",exp(lnk),exp(ppm->lnk[0]),exp(ppm->lnk[ppm->lnk_size-1]));
+
+    class_call(array_interpolate_spline_growing_hunt(ppm->lnk,
+                                                     ppm->lnk_size,
+                                                     ppm->lnpk[index_md],
+                                                     ppm->ddlnpk[index_md],
+                                                     ic_ic_size,
+                                                     lnk,
+                                                     &last_index,
+                                                     pk,
+                                                     ic_ic_size,
+                                                     ppm->error_message),
+               ppm->error_message,
+               ppm->error_message);
+
+    /* if mode==logarithmic, output is already in the correct format. Otherwise, apply necessary transformation. */
+
+    if (mode == linear) {
+
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic1,ic_size);
+        pk[index_ic1_ic2]=exp(pk[index_ic1_ic2]);
+      }
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        for (index_ic2 = index_ic1+1; index_ic2 < ic_size; index_ic2++) {
+          index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,ic_size);
+          if (ppm->is_non_zero[index_md][index_ic1_ic2] == _TRUE_) {
+            pk[index_ic1_ic2] *= sqrt(pk[index_symmetric_matrix(index_ic1,index_ic1,ic_size)]*
+                                      pk[index_symmetric_matrix(index_ic2,index_ic2,ic_size)]);
+          }
+          else {
+            pk[index_ic1_ic2] = 0.;
+          }
+        }
+      }
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
 /**
  * This routine initializes the primordial structure (in particular, it computes table of primordial spectrum values)
  *
@@ -201,12 +406,17 @@ int primordial_init(
      (for correlated isocurvature modes) */
   //double cos_delta_k;
 
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(ppm->profile));
+
   /** - check that we really need to compute the primordial spectra */
 
   if (ppt->has_perturbations == _FALSE_) {
     ppm->lnk_size=0;
     if (ppm->primordial_verbose > 0)
       printf("No perturbations requested. Primordial module skipped.\n");
+    class_profile_stop(&(ppm->profile));
     return _SUCCESS_;
   }
   else {
@@ -385,13 +595,26 @@ int primordial_init(
                ppm->error_message,
                "external Pk module cannot work if you ask for isocurvature modes (but that could be implemented easily in the future!)");
 
-    if (ppm->primordial_verbose > 0)
-      printf(" (Pk calculated externally)\n");
+    if (ppm->external_function != NULL) {
 
-    class_call_except(primordial_external_spectrum_init(ppt,ppm),
-                      ppm->error_message,
-                      ppm->error_message,
-                      primordial_free(ppm));
+      if (ppm->primordial_verbose > 0)
+        printf(" (Pk calculated by function '%s')\n",ppm->external_function->name);
+
+      class_call_except(primordial_external_function_spectrum_init(ppt,ppm),
+                        ppm->error_message,
+                        ppm->error_message,
+                        primordial_free(ppm));
+    }
+    else {
+
+      if (ppm->primordial_verbose > 0)
+        printf(" (Pk calculated externally)\n");
+
+      class_call_except(primordial_external_spectrum_init(ppt,ppm),
+                        ppm->error_message,
+                        ppm->error_message,
+                        primordial_free(ppm));
+    }
   }
 
   else {
@@ -535,6 +758,7 @@ int primordial_init(
 
   }
 
+  class_profile_stop(&(ppm->profile));
   return _SUCCESS_;
 
 }
@@ -566,7 +790,7 @@ int primordial_free(
       free(ppm->tilt);
       free(ppm->running);
     }
-    else if (ppm->primordial_spec_type == external_Pk) {
+    else if ((ppm->primordial_spec_type == external_Pk) && (ppm->external_function == NULL)) {
       free(ppm->command);
     }
 
@@ -1576,7 +1800,9 @@ int primordial_inflation_analytic_spectra(
 
 /**
  * Routine with a loop over wavenumbers for the computation of the primordial
- * spectrum. For each wavenumber it calls primordial_inflation_one_wavenumber()
+ * spectrum. For each wavenumber it calls primordial_inflation_one_wavenumber(),
+ * either on the whole ln(k) grid, or on an adaptive subset of it
+ * (see primordial_inflation_spectra_adaptive()).
  *
  * @param ppt   Input: pointer to perturbation structure
  * @param ppm   Input/output: pointer to primordial structure
@@ -1592,6 +1818,58 @@ int primordial_inflation_spectra(
                                  double * y_ini
                                  ) {
   int index_k;
+  int * index_k_list;
+
+  if (ppr->primordial_inflation_adaptive_tol > 0.) {
+
+    class_call(primordial_inflation_spectra_adaptive(ppt,ppm,ppr,y_ini),
+               ppm->error_message,
+               ppm->error_message);
+  }
+  else {
+
+    class_alloc(index_k_list,ppm->lnk_size*sizeof(int),ppm->error_message);
+
+    for (index_k=0; index_k < ppm->lnk_size; index_k++)
+      index_k_list[index_k] = index_k;
+
+    class_call_except(primordial_inflation_spectra_list(ppt,ppm,ppr,y_ini,index_k_list,ppm->lnk_size),
+                      ppm->error_message,
+                      ppm->error_message,
+                      free(index_k_list));
+
+    free(index_k_list);
+  }
+
+  ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
+  ppm->is_non_zero[ppt->index_md_tensors][ppt->index_ic_ten] = _TRUE_;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Routine calling primordial_inflation_one_wavenumber() in parallel
+ * for a list of indices in the ln(k) grid.
+ *
+ * @param ppt          Input: pointer to perturbation structure
+ * @param ppm          Input/output: pointer to primordial structure
+ * @param ppr          Input: pointer to precision structure
+ * @param y_ini        Input: initial conditions for the vector of background/perturbations, already allocated and filled
+ * @param index_k_list Input: list of indices of wavenumbers to be computed
+ * @param list_size    Input: size of this list
+ * @return the error status
+ */
+
+int primordial_inflation_spectra_list(
+                                      struct perturbs * ppt,
+                                      struct primordial * ppm,
+                                      struct precision * ppr,
+                                      double * y_ini,
+                                      int * index_k_list,
+                                      int list_size
+                                      ) {
+  int index_list;
 
   /* number of threads (always one if no openmp) */
   int number_of_threads=1;
@@ -1621,7 +1899,7 @@ int primordial_inflation_spectra(
 
   abort = _FALSE_;
 
-#pragma omp parallel shared(ppt,ppm,ppr,abort,y_ini) private(index_k,thread,tspent,tstart,tstop) num_threads(number_of_threads)
+#pragma omp parallel shared(ppt,ppm,ppr,abort,y_ini,index_k_list,list_size) private(index_list,thread,tspent,tstart,tstop) num_threads(number_of_threads)
 
   {
 
@@ -1633,13 +1911,13 @@ int primordial_inflation_spectra(
 #pragma omp for schedule (dynamic)
 
     /* loop over Fourier wavenumbers */
-    for (index_k=0; index_k < ppm->lnk_size; index_k++) {
+    for (index_list=0; index_list < list_size; index_list++) {
 
 #ifdef _OPENMP
       tstart = omp_get_wtime();
 #endif
 
-      class_call_parallel(primordial_inflation_one_wavenumber(ppt,ppm,ppr,y_ini,index_k),
+      class_call_parallel(primordial_inflation_one_wavenumber(ppt,ppm,ppr,y_ini,index_k_list[index_list]),
                           ppm->error_message,
                           ppm->error_message);
 
@@ -1661,13 +1939,165 @@ int primordial_inflation_spectra(
 
   if (abort == _TRUE_) return _FAILURE_;
 
-  ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
-  ppm->is_non_zero[ppt->index_md_tensors][ppt->index_ic_ten] = _TRUE_;
-
   return _SUCCESS_;
 
 }
 
+/**
+ * Routine computing the primordial spectra on an adaptive subset of
+ * the ln(k) grid.
+ *
+ * The mode equations are first integrated every
+ * primordial_inflation_adaptive_stride points of the grid (and at its
+ * last point). Then, at each level of refinement, they are integrated
+ * in the middle of each interval between computed points which is not
+ * yet converged. The interval is considered as converged when the
+ * value of ln(P) at its middle for scalars and tensors matches, within
+ * primordial_inflation_adaptive_tol, the cubic interpolation between
+ * the four closest points computed at previous levels. Each level is
+ * computed in parallel.
+ *
+ * Finally the lists of ln(k) and ln(P) are reduced to the computed
+ * points, so that primordial_init() splines the spectra on this
+ * non-uniform grid. Smooth spectra then need only a fraction of the
+ * mode integrations, while features in the potential get the full
+ * resolution of the grid.
+ *
+ * @param ppt   Input: pointer to perturbation structure
+ * @param ppm   Input/output: pointer to primordial structure
+ * @param ppr   Input: pointer to precision structure
+ * @param y_ini Input: initial conditions for the vector of background/perturbations, already allocated and filled
+ * @return the error status
+ */
+
+int primordial_inflation_spectra_adaptive(
+                                          struct perturbs * ppt,
+                                          struct primordial * ppm,
+                                          struct precision * ppr,
+                                          double * y_ini
+                                          ) {
+  short * is_computed;  /* is_computed[index_k]: has this point been integrated? */
+  short * is_converged; /* is_converged[index_k]: is the interval starting at this computed point converged? */
+  int * node;           /* list of computed points, in increasing order */
+  int * index_k_list;   /* points to compute at a given level */
+  int * left_list;      /* position in node[] of the left end of their interval */
+  double * prediction;  /* interpolated ln(P) for scalars and tensors at these points */
+  int node_size,list_size;
+  int stride,index_k,index_list,index_node,index_mid;
+  int index_md,p,q,first,last;
+  double lnk,lnpk,weight;
+  double * lnpk_md;
+  int lnk_size_full;
+
+  stride = MAX(ppr->primordial_inflation_adaptive_stride,1);
+
+  class_calloc(is_computed,ppm->lnk_size,sizeof(short),ppm->error_message);
+  class_calloc(is_converged,ppm->lnk_size,sizeof(short),ppm->error_message);
+  class_alloc(node,ppm->lnk_size*sizeof(int),ppm->error_message);
+  class_alloc(index_k_list,ppm->lnk_size*sizeof(int),ppm->error_message);
+  class_alloc(left_list,ppm->lnk_size*sizeof(int),ppm->error_message);
+  class_alloc(prediction,2*ppm->lnk_size*sizeof(double),ppm->error_message);
+
+  /** - first points, evenly spaced, including both ends */
+
+  list_size = 0;
+  for (index_k=0; index_k < ppm->lnk_size; index_k+=stride)
+    index_k_list[list_size++] = index_k;
+  if (index_k_list[list_size-1] != ppm->lnk_size-1)
+    index_k_list[list_size++] = ppm->lnk_size-1;
+
+  class_call(primordial_inflation_spectra_list(ppt,ppm,ppr,y_ini,index_k_list,list_size),
+             ppm->error_message,
+             ppm->error_message);
+
+  for (index_list=0; index_list < list_size; index_list++)
+    is_computed[index_k_list[index_list]] = _TRUE_;
+
+  /** - refine the intervals which are not converged, until all are */
+
+  while (_TRUE_) {
+
+    node_size = 0;
+    for (index_k=0; index_k < ppm->lnk_size; index_k++)
+      if (is_computed[index_k] == _TRUE_)
+        node[node_size++] = index_k;
+
+    /* middle of each interval to be refined, and interpolated value there */
+    list_size = 0;
+    for (index_node=0; index_node < node_size-1; index_node++) {
+
+      if ((node[index_node+1]-node[index_node] < 2) || (is_converged[node[index_node]] == _TRUE_))
+        continue;
+
+      index_mid = (node[index_node]+node[index_node+1])/2;
+      lnk = ppm->lnk[index_mid];
+
+      first = MAX(index_node-1,0);
+      last = MIN(index_node+2,node_size-1);
+
+      for (index_md=0; index_md<2; index_md++) {
+        lnpk_md = ppm->lnpk[(index_md == 0) ? ppt->index_md_scalars : ppt->index_md_tensors];
+        lnpk = 0.;
+        for (p=first; p<=last; p++) {
+          weight = 1.;
+          for (q=first; q<=last; q++)
+            if (q != p)
+              weight *= (lnk-ppm->lnk[node[q]])/(ppm->lnk[node[p]]-ppm->lnk[node[q]]);
+          lnpk += weight*lnpk_md[node[p]];
+        }
+        prediction[2*list_size+index_md] = lnpk;
+      }
+
+      index_k_list[list_size] = index_mid;
+      left_list[list_size] = node[index_node];
+      list_size++;
+    }
+
+    if (list_size == 0)
+      break;
+
+    class_call(primordial_inflation_spectra_list(ppt,ppm,ppr,y_ini,index_k_list,list_size),
+               ppm->error_message,
+               ppm->error_message);
+
+    for (index_list=0; index_list < list_size; index_list++) {
+
+      index_mid = index_k_list[index_list];
+      is_computed[index_mid] = _TRUE_;
+
+      if ((fabs(ppm->lnpk[ppt->index_md_scalars][index_mid]-prediction[2*index_list]) < ppr->primordial_inflation_adaptive_tol) &&
+          (fabs(ppm->lnpk[ppt->index_md_tensors][index_mid]-prediction[2*index_list+1]) < ppr->primordial_inflation_adaptive_tol)) {
+        is_converged[left_list[index_list]] = _TRUE_;
+        is_converged[index_mid] = _TRUE_;
+      }
+    }
+  }
+
+  /** - keep only the computed points in the tables */
+
+  lnk_size_full = ppm->lnk_size;
+
+  for (index_node=0; index_node < node_size; index_node++) {
+    ppm->lnk[index_node] = ppm->lnk[node[index_node]];
+    ppm->lnpk[ppt->index_md_scalars][index_node] = ppm->lnpk[ppt->index_md_scalars][node[index_node]];
+    ppm->lnpk[ppt->index_md_tensors][index_node] = ppm->lnpk[ppt->index_md_tensors][node[index_node]];
+  }
+  ppm->lnk_size = node_size;
+
+  if (ppm->primordial_verbose > 1)
+    printf(" -> adaptive sampling: mode equations integrated for %d of %d wavenumbers\n",
+           ppm->lnk_size,lnk_size_full);
+
+  free(is_computed);
+  free(is_converged);
+  free(node);
+  free(index_k_list);
+  free(left_list);
+  free(prediction);
+
+  return _SUCCESS_;
+}
+
 /**
  * Routine coordinating the computation of the primordial
  * spectrum for one wavenumber. It calls primordial_inflation_one_k() to
@@ -3423,6 +3853,137 @@ int primordial_external_spectrum_init(
   return _SUCCESS_;
 }
 
+/**
+ * This routine fills the primordial spectrum with a function
+ * registered with primordial_external_function_register(), on the
+ * list of ln(k) values already computed by primordial_init(). Unlike
+ * primordial_external_spectrum_init(), it does not spawn any process.
+ *
+ * @param ppt  Input: pointer to perturbation structure
+ * @param ppm  Input/output: pointer to primordial structure
+ * @return the error status
+ */
+
+int primordial_external_function_spectrum_init(
+                                               struct perturbs * ppt,
+                                               struct primordial * ppm
+                                               ) {
+
+  struct primordial_external_function * pef;
+  double * lnpk_tensors = NULL;
+  int index_k;
+
+  pef = ppm->external_function;
+
+  /* with only adiabatic scalars and tensors, each table has one
+     column, so that the function can fill them directly */
+  if (ppt->has_tensors == _TRUE_)
+    lnpk_tensors = ppm->lnpk[ppt->index_md_tensors];
+
+  class_call(pef->spectrum(pef,
+                           ppm,
+                           ppm->lnk_size,
+                           ppm->lnk,
+                           ppm->lnpk[ppt->index_md_scalars],
+                           lnpk_tensors,
+                           ppm->error_message),
+             ppm->error_message,
+             ppm->error_message);
+
+  for (index_k=0; index_k<ppm->lnk_size; index_k++) {
+    class_test(isnan(ppm->lnpk[ppt->index_md_scalars][index_k]) || isinf(ppm->lnpk[ppt->index_md_scalars][index_k]),
+               ppm->error_message,
+               "the function '%s' returned ln P_R(k)=%e at k=%e",
+               pef->name,ppm->lnpk[ppt->index_md_scalars][index_k],exp(ppm->lnk[index_k]));
+    if (ppt->has_tensors == _TRUE_)
+      class_test(isnan(lnpk_tensors[index_k]) || isinf(lnpk_tensors[index_k]),
+                 ppm->error_message,
+                 "the function '%s' returned ln P_h(k)=%e at k=%e",
+                 pef->name,lnpk_tensors[index_k],exp(ppm->lnk[index_k]));
+  }
+
+  /** - Tell CLASS that there are scalar (and tensor) modes */
+  ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
+  if (ppt->has_tensors == _TRUE_)
+    ppm->is_non_zero[ppt->index_md_tensors][ppt->index_ic_ten] = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Register a function computing the primordial spectra in the
+ * 'external_Pk' mode. The structure is not copied: it must remain
+ * valid as long as it can be used. Registering a function with the
+ * name of an already registered one replaces it.
+ *
+ * @param pef           Input: pointer to function with name and callback filled
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int primordial_external_function_register(
+                                          struct primordial_external_function * pef,
+                                          ErrorMsg error_message
+                                          ) {
+
+  struct primordial_external_function ** ppef;
+
+  class_test((pef->name == NULL) || (pef->name[0] == '\0'),
+             error_message,
+             "an external primordial spectrum function needs a name");
+
+  class_test(pef->spectrum == NULL,
+             error_message,
+             "the external primordial spectrum function '%s' has no spectrum() callback",pef->name);
+
+#pragma omp critical (primordial_external_function_list)
+  {
+    for (ppef = &primordial_external_function_list; *ppef != NULL; ppef = &((*ppef)->next)) {
+      if (strcmp((*ppef)->name,pef->name) == 0)
+        break;
+    }
+
+    if (*ppef != NULL) {
+      /* replace the function with the same name */
+      pef->next = (*ppef)->next;
+    }
+    else {
+      pef->next = NULL;
+    }
+    *ppef = pef;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find a registered external primordial spectrum function by its name.
+ *
+ * @param name Input: name of the function
+ * @param ppef Output: pointer to the function, or NULL if none has this name
+ * @return the error status
+ */
+
+int primordial_external_function_find(
+                                      char * name,
+                                      struct primordial_external_function ** ppef
+                                      ) {
+
+  struct primordial_external_function * pef;
+
+#pragma omp critical (primordial_external_function_list)
+  {
+    for (pef = primordial_external_function_list; pef != NULL; pef = pef->next) {
+      if (strcmp(pef->name,name) == 0)
+        break;
+    }
+  }
+
+  *ppef = pef;
+
+  return _SUCCESS_;
+}
+
 int primordial_output_titles(struct perturbs * ppt,
                              struct primordial * ppm,
                              char titles[_MAXTITLESTRINGLENGTH_]
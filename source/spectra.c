@@ -77,9 +77,12 @@ int spectra_bandpower(struct spectra * psp,
 /**
  * Anisotropy power spectra \f$ C_l\f$'s for all types, modes and initial conditions.
  *
- * This routine evaluates all the \f$C_l\f$'s at a given value of l by
- * interpolating in the pre-computed table. When relevant, it also
- * sums over all initial conditions for each mode, and over all modes.
+ * This routine returns all the \f$C_l\f$'s at a given value of l.
+ * For integer values of l between 2 and l_max_tot, they are copied
+ * from the dense tables filled once by spectra_cl_dense(); for other
+ * values of l, they are obtained by spectra_cl_at_l_spline(). When
+ * relevant, they are also summed over all initial conditions for each
+ * mode, and over all modes.
  *
  * This function can be
  * called from whatever module at whatever time, provided that
@@ -102,6 +105,70 @@ int spectra_cl_at_l(
                     double * * cl_md_ic /* array with argument cl_md_ic[index_md][index_ic1_ic2*psp->ct_size+index_ct] (must be already allocated for a given mode only if several ic's) */
                     ) {
 
+  int index_l;
+  int index_md;
+
+  /** - if l is an integer covered by the dense tables, copy the
+      relevant entries, filling the same output arrays as
+      spectra_cl_at_l_spline() */
+
+  index_l = (int)l;
+
+  if ((psp->cl_tot_dense != NULL) && ((double)index_l == l) && (index_l >= 2) && (index_l <= psp->l_max_tot)) {
+
+    memcpy(cl_tot,psp->cl_tot_dense+index_l*psp->ct_size,psp->ct_size*sizeof(double));
+
+    for (index_md = 0; index_md < psp->md_size; index_md++) {
+
+      if (psp->md_size > 1)
+        memcpy(cl_md[index_md],
+               psp->cl_md_dense[index_md]+index_l*psp->ct_size,
+               psp->ct_size*sizeof(double));
+
+      if (psp->ic_size[index_md] > 1)
+        memcpy(cl_md_ic[index_md],
+               psp->cl_md_ic_dense[index_md]+index_l*psp->ic_ic_size[index_md]*psp->ct_size,
+               psp->ic_ic_size[index_md]*psp->ct_size*sizeof(double));
+    }
+
+    return _SUCCESS_;
+  }
+
+  /** - otherwise, interpolate */
+
+  class_call(spectra_cl_at_l_spline(psp,l,cl_tot,cl_md,cl_md_ic),
+             psp->error_message,
+             psp->error_message);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Anisotropy power spectra \f$ C_l\f$'s for all types, modes and
+ * initial conditions, interpolated at any (non necessarily integer)
+ * value of l in the pre-computed table. When relevant, it also sums
+ * over all initial conditions for each mode, and over all modes.
+ *
+ * Same arguments as spectra_cl_at_l(), which should be preferred
+ * for integer l.
+ *
+ * @param psp        Input: pointer to spectra structure (containing pre-computed table)
+ * @param l          Input: multipole number
+ * @param cl_tot     Output: total \f$C_l\f$'s for all types (TT, TE, EE, etc..)
+ * @param cl_md      Output: \f$C_l\f$'s for all types (TT, TE, EE, etc..) decomposed mode by mode (scalar, tensor, ...) when relevant
+ * @param cl_md_ic   Output: \f$C_l\f$'s for all types (TT, TE, EE, etc..) decomposed by pairs of initial conditions (adiabatic, isocurvatures) for each mode (usually, only for the scalar mode) when relevant
+ * @return the error status
+ */
+
+int spectra_cl_at_l_spline(
+                           struct spectra * psp,
+                           double l,
+                           double * cl_tot,    /* array with argument cl_tot[index_ct] (must be already allocated) */
+                           double * * cl_md,   /* array with argument cl_md[index_md][index_ct] (must be already allocated only if several modes) */
+                           double * * cl_md_ic /* array with argument cl_md_ic[index_md][index_ic1_ic2*psp->ct_size+index_ct] (must be already allocated for a given mode only if several ic's) */
+                           ) {
+
   /** Summary: */
 
   /** - define local variables */
@@ -999,6 +1066,371 @@ int spectra_pk_nl_at_k_and_z(
 
 }
 
+/**
+ * Total matter power spectrum, linear or non-linear, for several
+ * wavenumbers and redshifts at once.
+ *
+ * The result is the same as with spectra_pk_at_k_and_z() or
+ * spectra_pk_nl_at_k_and_z() called for each pair (k,z), but each
+ * spectrum at a given z is interpolated in time and splined in k only
+ * once, and the position of each k in the table psp->ln_k is found
+ * only once for all redshifts. Positions are searched starting from
+ * the one of the previous k, so that sorted k values are located in
+ * a single pass over the table.
+ *
+ * This function can be
+ * called from whatever module at whatever time, provided that
+ * spectra_init() has been called before, and spectra_free() has not
+ * been called yet.
+ *
+ * @param pba        Input: pointer to background structure (used for converting z into tau)
+ * @param ppm        Input: pointer to primordial structure (used only in the case 0 < k < kmin)
+ * @param psp        Input: pointer to spectra structure (containing pre-computed table)
+ * @param nonlinear  Input: _TRUE_ for the non-linear spectrum, _FALSE_ for the linear one
+ * @param k          Input: wavenumbers in 1/Mpc, sorted or not
+ * @param k_size     Input: number of wavenumbers
+ * @param z          Input: redshifts, sorted or not
+ * @param z_size     Input: number of redshifts
+ * @param pk_tot     Output: total matter power spectrum in \f$ Mpc^3 \f$, pk_tot[index_z*k_size+index_k] (must be already allocated)
+ * @return the error status
+ */
+
+int spectra_pk_at_k_and_z_vector(
+                                 struct background * pba,
+                                 struct primordial * ppm,
+                                 struct spectra * psp,
+                                 short nonlinear,
+                                 double * k,
+                                 int k_size,
+                                 double * z,
+                                 int z_size,
+                                 double * pk_tot
+                                 ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_md;
+  int index_k;
+  int index_z;
+  int index_ic1,index_ic2,index_ic1_ic2;
+  int ic_ic_size;
+  int columns;
+  int inf;
+  double kmin,kmax;
+  double pk;
+  struct array_interpolation interpolation;
+
+  int * k_position;            /* index of the interval of psp->ln_k containing k[index_k] (-1 when k < kmin) */
+  double * k_weight;           /* relative position b of k[index_k] in this interval */
+  double * k_ratio = NULL;     /* k P_primordial(k) / (kmin P_primordial(kmin)) when 0 < k < kmin */
+  double * spectrum_at_z;      /* ln P(k,z) in logarithmic format, for each pair of initial conditions */
+  double * spectrum_at_z_tot;
+  double * spline;
+  double * pk_ic;
+  double * pk_primordial_kmin = NULL;
+
+  index_md = psp->index_md_scalars;
+
+  /* the non-linear spectrum is only known for the total matter */
+  ic_ic_size = (nonlinear == _TRUE_) ? 1 : psp->ic_ic_size[index_md];
+  columns = ((nonlinear == _TRUE_) || (psp->ic_size[index_md] == 1)) ? 1 : ic_ic_size;
+
+  class_test((nonlinear == _TRUE_) && (psp->ln_pk_nl == NULL),
+             psp->error_message,
+             "non-linear power spectrum requested but not computed");
+
+  kmin = exp(psp->ln_k[0]);
+  kmax = exp(psp->ln_k[psp->ln_k_size-1]);
+
+  class_alloc(k_position,MAX(k_size,1)*sizeof(int),psp->error_message);
+  class_alloc(k_weight,MAX(k_size,1)*sizeof(double),psp->error_message);
+  class_alloc(spectrum_at_z,psp->ln_k_size*ic_ic_size*sizeof(double),psp->error_message);
+  class_alloc(spectrum_at_z_tot,psp->ln_k_size*sizeof(double),psp->error_message);
+  class_alloc(spline,psp->ln_k_size*ic_ic_size*sizeof(double),psp->error_message);
+  class_alloc(pk_ic,ic_ic_size*sizeof(double),psp->error_message);
+
+  /** - first step: locate each k in the table, once for all redshifts */
+
+  class_call(array_interpolation_init(psp->ln_k,
+                                      psp->ln_k_size,
+                                      &interpolation,
+                                      psp->error_message),
+             psp->error_message,
+             psp->error_message);
+
+  inf = -1;
+
+  for (index_k=0; index_k<k_size; index_k++) {
+
+    if (nonlinear == _TRUE_) {
+      class_test((k[index_k] < kmin) || (k[index_k] > kmax),
+                 psp->error_message,
+                 "k=%e out of bounds [%e:%e]",k[index_k],kmin,kmax);
+    }
+    else {
+      class_test((k[index_k] < 0.) || (k[index_k] > kmax),
+                 psp->error_message,
+                 "k=%e out of bounds [%e:%e]",k[index_k],0.,kmax);
+    }
+
+    if (k[index_k] < kmin) {
+      k_position[index_k] = -1;
+      k_weight[index_k] = 0.;
+      continue;
+    }
+
+    /* the search starts from the interval of the previous k */
+    class_call(array_interpolation_locate(&interpolation,
+                                          MIN(MAX(log(k[index_k]),psp->ln_k[0]),psp->ln_k[psp->ln_k_size-1]),
+                                          &inf,
+                                          k_weight+index_k,
+                                          psp->error_message),
+               psp->error_message,
+               psp->error_message);
+
+    k_position[index_k] = inf;
+  }
+
+  /** - second step: for 0 < k < kmin, the ratio of primordial spectra used for extrapolating P(k), see spectra_pk_at_k_and_z() */
+
+  for (index_k=0; index_k<k_size; index_k++) {
+
+    if ((k_position[index_k] >= 0) || (k[index_k] == 0.))
+      continue;
+
+    if (k_ratio == NULL) {
+      class_alloc(k_ratio,k_size*ic_ic_size*sizeof(double),psp->error_message);
+      class_alloc(pk_primordial_kmin,ic_ic_size*sizeof(double),psp->error_message);
+      class_call(primordial_spectrum_at_k(ppm,
+                                          index_md,
+                                          linear,
+                                          kmin,
+                                          pk_primordial_kmin),
+                 ppm->error_message,
+                 psp->error_message);
+    }
+
+    class_call(primordial_spectrum_at_k(ppm,
+                                        index_md,
+                                        linear,
+                                        k[index_k],
+                                        k_ratio+index_k*ic_ic_size),
+               ppm->error_message,
+               psp->error_message);
+
+    for (index_ic1_ic2 = 0; index_ic1_ic2 < ic_ic_size; index_ic1_ic2++) {
+      k_ratio[index_k*ic_ic_size+index_ic1_ic2] *= k[index_k]/kmin/pk_primordial_kmin[index_ic1_ic2];
+    }
+  }
+
+  /** - third step: for each z, get the spectrum in logarithmic
+      format, spline it in ln(k), and evaluate it at each k */
+
+  for (index_z=0; index_z<z_size; index_z++) {
+
+    if (nonlinear == _TRUE_) {
+      class_call(spectra_pk_nl_at_z(pba,
+                                    psp,
+                                    logarithmic,
+                                    z[index_z],
+                                    spectrum_at_z),
+                 psp->error_message,
+                 psp->error_message);
+    }
+    else {
+      class_call(spectra_pk_at_z(pba,
+                                 psp,
+                                 logarithmic,
+                                 z[index_z],
+                                 (columns == 1) ? spectrum_at_z : spectrum_at_z_tot,
+                                 spectrum_at_z),
+                 psp->error_message,
+                 psp->error_message);
+    }
+
+    class_call(array_spline_table_lines(psp->ln_k,
+                                        psp->ln_k_size,
+                                        spectrum_at_z,
+                                        columns,
+                                        spline,
+                                        _SPLINE_NATURAL_,
+                                        psp->error_message),
+               psp->error_message,
+               psp->error_message);
+
+    for (index_k=0; index_k<k_size; index_k++) {
+
+      if (k[index_k] == 0.) {
+        pk_tot[index_z*k_size+index_k] = 0.;
+        continue;
+      }
+
+      /* logarithmic format, as in spectra_pk_at_z(): ln P for the
+         diagonal terms, cross-correlation angle otherwise */
+
+      inf = k_position[index_k];
+
+      if (inf >= 0) {
+        array_interpolation_evaluate(&interpolation,
+                                     spectrum_at_z,
+                                     spline,
+                                     columns,
+                                     inf,
+                                     k_weight[index_k],
+                                     pk_ic,
+                                     columns);
+      }
+      else {
+        for (index_ic1_ic2 = 0; index_ic1_ic2 < columns; index_ic1_ic2++) {
+          pk_ic[index_ic1_ic2] = spectrum_at_z[index_ic1_ic2];
+        }
+      }
+
+      /* convert to linear format and sum over initial conditions */
+
+      if (columns == 1) {
+        pk = exp(pk_ic[0]);
+        if (inf < 0)
+          pk *= k_ratio[index_k*ic_ic_size];
+      }
+      else {
+        for (index_ic1 = 0; index_ic1 < psp->ic_size[index_md]; index_ic1++) {
+          index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic1,psp->ic_size[index_md]);
+          pk_ic[index_ic1_ic2] = exp(pk_ic[index_ic1_ic2]);
+        }
+        pk = 0.;
+        for (index_ic1 = 0; index_ic1 < psp->ic_size[index_md]; index_ic1++) {
+          for (index_ic2 = index_ic1; index_ic2 < psp->ic_size[index_md]; index_ic2++) {
+            index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,psp->ic_size[index_md]);
+            if (psp->is_non_zero[index_md][index_ic1_ic2] == _FALSE_)
+              continue;
+            if (index_ic1 == index_ic2) {
+              pk += pk_ic[index_ic1_ic2] * ((inf < 0) ? k_ratio[index_k*ic_ic_size+index_ic1_ic2] : 1.);
+            }
+            else {
+              pk += 2.*pk_ic[index_ic1_ic2]*
+                sqrt(pk_ic[index_symmetric_matrix(index_ic1,index_ic1,psp->ic_size[index_md])]*
+                     pk_ic[index_symmetric_matrix(index_ic2,index_ic2,psp->ic_size[index_md])])
+                * ((inf < 0) ? k_ratio[index_k*ic_ic_size+index_ic1_ic2] : 1.);
+            }
+          }
+        }
+
+        class_test(pk <= 0.,
+                   psp->error_message,
+                   "for k=%e, the matrix of initial condition amplitudes was not positive definite, hence P(k)_total results negative",k[index_k]);
+      }
+
+      pk_tot[index_z*k_size+index_k] = pk;
+    }
+  }
+
+  free(k_position);
+  free(k_weight);
+  free(spectrum_at_z);
+  free(spectrum_at_z_tot);
+  free(spline);
+  array_interpolation_free(&interpolation);
+  free(pk_ic);
+  if (k_ratio != NULL) {
+    free(k_ratio);
+    free(pk_primordial_kmin);
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Linear matter correlation function \f$ \xi(r) \f$ and r.m.s. fluctuation
+ * \f$ \sigma(R) \f$ in spheres of radius R=r, for arbitrary redshift, on the
+ * grid of radii psp->ln_r.
+ *
+ * This routine interpolates the tables computed by
+ * spectra_correlations() at the requested value of z (or reads them
+ * directly if only z=0 has been stored). It can be called from
+ * whatever module at whatever time, provided that spectra_init() has
+ * been called before with psp->has_correlations set to _TRUE_, and
+ * spectra_free() has not been called yet.
+ *
+ * @param pba     Input: pointer to background structure (used for converting z into tau)
+ * @param psp     Input: pointer to spectra structure (containing pre-computed table)
+ * @param z       Input: redshift
+ * @param xi      Output: correlation function xi[index_r] (must be already allocated)
+ * @param sigma_r Output: sigma(R) at R=exp(psp->ln_r[index_r]), sigma_r[index_r] (must be already allocated)
+ * @return the error status
+ */
+
+int spectra_correlations_at_z(
+                              struct background * pba,
+                              struct spectra * psp,
+                              double z,
+                              double * xi,
+                              double * sigma_r
+                              ) {
+
+  int last_index;
+  int index_r;
+  double tau;
+
+  class_test(psp->has_correlations == _FALSE_,
+             psp->error_message,
+             "correlation functions requested but not computed");
+
+  if (psp->ln_tau_size == 1) {
+
+    class_test(z != 0.,
+               psp->error_message,
+               "asked z=%e but only xi(r,z=0) has been tabulated",z);
+
+    for (index_r=0; index_r<psp->ln_r_size; index_r++) {
+      xi[index_r] = psp->xi[index_r];
+      sigma_r[index_r] = psp->sigma_r[index_r];
+    }
+  }
+  else {
+
+    class_call(background_tau_of_z(pba,z,&tau),
+               pba->error_message,
+               psp->error_message);
+
+    class_test(tau <= 0.,
+               psp->error_message,
+               "negative or null value of conformal time: cannot interpolate");
+
+    class_call(array_interpolate_spline(psp->ln_tau,
+                                        psp->ln_tau_size,
+                                        psp->xi,
+                                        psp->ddxi,
+                                        psp->ln_r_size,
+                                        log(tau),
+                                        &last_index,
+                                        xi,
+                                        psp->ln_r_size,
+                                        psp->error_message),
+               psp->error_message,
+               psp->error_message);
+
+    class_call(array_interpolate_spline(psp->ln_tau,
+                                        psp->ln_tau_size,
+                                        psp->sigma_r,
+                                        psp->ddsigma_r,
+                                        psp->ln_r_size,
+                                        log(tau),
+                                        &last_index,
+                                        sigma_r,
+                                        psp->ln_r_size,
+                                        psp->error_message),
+               psp->error_message,
+               psp->error_message);
+  }
+
+  return _SUCCESS_;
+
+}
+
 
 /**
  * Matter transfer functions \f$ T_i(k) \f$ for arbitrary redshift and for all
@@ -1193,6 +1625,15 @@ int spectra_tk_at_k_and_z(
  * This routine initializes the spectra structure (in particular,
  * computes table of anisotropy and Fourier spectra \f$ C_l^{X}, P(k), ... \f$)
  *
+ * When only Fourier spectra are requested (e.g. output=mPk), nothing
+ * related to the \f$ C_l \f$'s is computed anywhere: the perturbation
+ * module only stores the matter sources, from z_max_pk+1 to today;
+ * the transfer and lensing modules return immediately (no Bessel
+ * functions); and spectra_pk() and spectra_matter_transfers() read
+ * these sources at their sampling times, without interpolating in
+ * tau. The cost of such runs is then almost entirely the integration
+ * of the perturbations.
+ *
  * @param ppr Input: pointer to precision structure
  * @param pba Input: pointer to background structure (will provide H, Omega_m at redshift of interest)
  * @param ppt Input: pointer to perturbation structure
@@ -1218,6 +1659,10 @@ int spectra_init(
   double TT_II,TT_RI,TT_RR;
   int l1,l2;
 
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(psp->profile));
+
   /** - check that we really want to compute at least one spectrum */
 
   if ((ppt->has_cls == _FALSE_) &&
@@ -1227,6 +1672,7 @@ int spectra_init(
     psp->md_size = 0;
     if (psp->spectra_verbose > 0)
       printf("No spectra requested. Spectra module skipped.\n");
+    class_profile_stop(&(psp->profile));
     return _SUCCESS_;
   }
   else {
@@ -1268,9 +1714,16 @@ int spectra_init(
                  psp->error_message,
                  psp->error_message);
 
+      if (psp->has_correlations == _TRUE_) {
+
+        class_call(spectra_correlations(ppr,psp),
+                   psp->error_message,
+                   psp->error_message);
+      }
     }
     else {
       psp->ln_pk=NULL;
+      psp->has_correlations = _FALSE_;
     }
 
     if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_)) {
@@ -1393,6 +1846,7 @@ int spectra_init(
     }
   }
 
+  class_profile_stop(&(psp->profile));
   return _SUCCESS_;
 }
 
@@ -1421,6 +1875,17 @@ int spectra_free(
         free(psp->cl[index_md]);
         free(psp->ddcl[index_md]);
       }
+      if (psp->cl_tot_dense != NULL) {
+        for (index_md = 0; index_md < psp->md_size; index_md++) {
+          if (psp->md_size > 1)
+            free(psp->cl_md_dense[index_md]);
+          if (psp->ic_size[index_md] > 1)
+            free(psp->cl_md_ic_dense[index_md]);
+        }
+        free(psp->cl_md_dense);
+        free(psp->cl_md_ic_dense);
+        free(psp->cl_tot_dense);
+      }
       free(psp->l);
       free(psp->l_size);
       free(psp->l_max_ct);
@@ -1450,6 +1915,18 @@ int spectra_free(
             free(psp->ddln_pk_nl);
           }
         }
+
+        if (psp->has_correlations == _TRUE_) {
+
+          free(psp->ln_r);
+          free(psp->xi);
+          free(psp->sigma_r);
+
+          if (psp->ln_tau_size > 1) {
+            free(psp->ddxi);
+            free(psp->ddsigma_r);
+          }
+        }
       }
 
       if (psp->matter_transfer != NULL) {
@@ -1708,18 +2185,20 @@ int spectra_indices(
 
     if (ppt->has_scalars == _TRUE_) {
 
-      /* spectra computed up to l_scalar_max */
+      /* spectra computed up to l_scalar_max, or up to the smaller
+         values declared for temperature, polarization and lensing
+         potential (the smallest of the two for cross-correlations) */
 
-      if (psp->has_tt == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_tt] = ppt->l_scalar_max;
-      if (psp->has_ee == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_ee] = ppt->l_scalar_max;
-      if (psp->has_te == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_te] = ppt->l_scalar_max;
-      if (psp->has_pp == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_pp] = ppt->l_scalar_max;
-      if (psp->has_tp == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_tp] = ppt->l_scalar_max;
-      if (psp->has_ep == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_ep] = ppt->l_scalar_max;
+      if (psp->has_tt == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_tt] = ppt->l_scalar_max_cmb_temperature;
+      if (psp->has_ee == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_ee] = ppt->l_scalar_max_cmb_polarization;
+      if (psp->has_te == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_te] = MIN(ppt->l_scalar_max_cmb_temperature,ppt->l_scalar_max_cmb_polarization);
+      if (psp->has_pp == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_pp] = ppt->l_scalar_max_cmb_lensing_potential;
+      if (psp->has_tp == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_tp] = MIN(ppt->l_scalar_max_cmb_temperature,ppt->l_scalar_max_cmb_lensing_potential);
+      if (psp->has_ep == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_ep] = MIN(ppt->l_scalar_max_cmb_polarization,ppt->l_scalar_max_cmb_lensing_potential);
 
       /* Added this */
-      if (psp->has_tb == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_tb] = ppt->l_scalar_max;
-      if (psp->has_eb == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_eb] = ppt->l_scalar_max;
+      if (psp->has_tb == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_tb] = MIN(ppt->l_scalar_max_cmb_temperature,ppt->l_scalar_max_cmb_polarization);
+      if (psp->has_eb == _TRUE_) psp->l_max_ct[ppt->index_md_scalars][psp->index_ct_eb] = ppt->l_scalar_max_cmb_polarization;
       /* Ends here */
 
 
@@ -1735,13 +2214,13 @@ int spectra_indices(
         for (index_ct=psp->index_ct_td;
              index_ct<psp->index_ct_td+psp->d_size;
              index_ct++)
-          psp->l_max_ct[ppt->index_md_scalars][index_ct] = MIN(ppt->l_scalar_max,ppt->l_lss_max);
+          psp->l_max_ct[ppt->index_md_scalars][index_ct] = MIN(ppt->l_scalar_max_cmb_temperature,ppt->l_lss_max);
 
       if (psp->has_pd == _TRUE_)
         for (index_ct=psp->index_ct_pd;
              index_ct<psp->index_ct_pd+psp->d_size;
              index_ct++)
-          psp->l_max_ct[ppt->index_md_scalars][index_ct] = MIN(ppt->l_scalar_max,ppt->l_lss_max);
+          psp->l_max_ct[ppt->index_md_scalars][index_ct] = MIN(ppt->l_scalar_max_cmb_lensing_potential,ppt->l_lss_max);
 
       if (psp->has_ll == _TRUE_)
         for (index_ct=psp->index_ct_ll;
@@ -1753,7 +2232,7 @@ int spectra_indices(
         for (index_ct=psp->index_ct_tl;
              index_ct<psp->index_ct_tl+psp->d_size;
              index_ct++)
-          psp->l_max_ct[ppt->index_md_scalars][index_ct] = MIN(ppt->l_scalar_max,ppt->l_lss_max);
+          psp->l_max_ct[ppt->index_md_scalars][index_ct] = MIN(ppt->l_scalar_max_cmb_temperature,ppt->l_lss_max);
 
       if (psp->has_dl == _TRUE_)
         for (index_ct=psp->index_ct_dl;
@@ -1851,12 +2330,12 @@ int spectra_cls(
   int index_ic1,index_ic2,index_ic1_ic2;
   int index_l;
   int index_ct;
-  int cl_integrand_num_columns;
+  int index_l_last;
+  int index_cl;
+  short extrapolate;
 
-  double * cl_integrand; /* array with argument cl_integrand[index_k*cl_integrand_num_columns+1+psp->index_ct] */
-  double * transfer_ic1; /* array with argument transfer_ic1[index_tt] */
-  double * transfer_ic2; /* idem */
-  double * primordial_pk;  /* array with argument primordial_pk[index_ic_ic]*/
+  double * cl_weight; /* array with argument cl_weight[index_ic1_ic2*ptr->q_size+index_q] */
+  double * cl_workspace; /* workspace of each thread, see spectra_compute_cl() */
 
   /* This code can be optionally compiled with the openmp option for parallel computation.
      Inside parallel regions, the use of the command "return" is forbidden.
@@ -1876,6 +2355,9 @@ int spectra_cls(
   class_alloc(psp->cl,sizeof(double *)*psp->md_size,psp->error_message);
   class_alloc(psp->ddcl,sizeof(double *)*psp->md_size,psp->error_message);
 
+  /* the dense tables are filled at the end, see spectra_cl_dense() */
+  psp->cl_tot_dense = NULL;
+
   psp->l_size_max = ptr->l_size_max;
   class_alloc(psp->l,sizeof(double)*psp->l_size_max,psp->error_message);
 
@@ -1896,9 +2378,16 @@ int spectra_cls(
 
     class_alloc(psp->cl[index_md],sizeof(double)*psp->l_size[index_md]*psp->ct_size*psp->ic_ic_size[index_md],psp->error_message);
     class_alloc(psp->ddcl[index_md],sizeof(double)*psp->l_size[index_md]*psp->ct_size*psp->ic_ic_size[index_md],psp->error_message);
-    cl_integrand_num_columns = 1+psp->ct_size*2; /* one for k, ct_size for each type, ct_size for each second derivative of each type */
 
-    /** - --> (c) loop over initial conditions */
+    /** - --> (c) compute once for all l's the weights of the integral over q */
+
+    class_alloc(cl_weight,sizeof(double)*psp->ic_ic_size[index_md]*ptr->q_size,psp->error_message);
+
+    class_call(spectra_cl_weights(pba,ptr,ppm,psp,index_md,cl_weight),
+               psp->error_message,
+               psp->error_message);
+
+    /** - --> (d) loop over initial conditions */
 
     for (index_ic1 = 0; index_ic1 < psp->ic_size[index_md]; index_ic1++) {
       for (index_ic2 = index_ic1; index_ic2 < psp->ic_size[index_md]; index_ic2++) {
@@ -1913,8 +2402,8 @@ int spectra_cls(
           /* beginning of parallel region */
 
 #pragma omp parallel                                                    \
-  shared(ptr,ppm,index_md,psp,ppt,cl_integrand_num_columns,index_ic1,index_ic2,abort) \
-  private(tstart,cl_integrand,primordial_pk,transfer_ic1,transfer_ic2,index_l,tstop)
+  shared(ptr,index_md,psp,ppt,cl_weight,index_ic1,index_ic2,index_ic1_ic2,abort) \
+  private(tstart,cl_workspace,index_l,tstop)
 
           {
 
@@ -1922,20 +2411,8 @@ int spectra_cls(
             tstart = omp_get_wtime();
 #endif
 
-            class_alloc_parallel(cl_integrand,
-                                 ptr->q_size*cl_integrand_num_columns*sizeof(double),
-                                 psp->error_message);
-
-            class_alloc_parallel(primordial_pk,
-                                 psp->ic_ic_size[index_md]*sizeof(double),
-                                 psp->error_message);
-
-            class_alloc_parallel(transfer_ic1,
-                                 ptr->tt_size[index_md]*sizeof(double),
-                                 psp->error_message);
-
-            class_alloc_parallel(transfer_ic2,
-                                 ptr->tt_size[index_md]*sizeof(double),
+            class_alloc_parallel(cl_workspace,
+                                 ptr->q_size*(2+2*psp->d_size)*sizeof(double),
                                  psp->error_message);
 
 #pragma omp for schedule (dynamic)
@@ -1949,20 +2426,15 @@ int spectra_cls(
 
 #pragma omp flush(abort)
 
-              class_call_parallel(spectra_compute_cl(pba,
-                                                     ppt,
+              class_call_parallel(spectra_compute_cl(ppt,
                                                      ptr,
-                                                     ppm,
                                                      psp,
                                                      index_md,
                                                      index_ic1,
                                                      index_ic2,
                                                      index_l,
-                                                     cl_integrand_num_columns,
-                                                     cl_integrand,
-                                                     primordial_pk,
-                                                     transfer_ic1,
-                                                     transfer_ic2),
+                                                     cl_weight+index_ic1_ic2*ptr->q_size,
+                                                     cl_workspace),
                                   psp->error_message,
                                   psp->error_message);
 
@@ -1974,17 +2446,14 @@ int spectra_cls(
               printf("In %s: time spent in parallel region (loop over l's) = %e s for thread %d\n",
                      __func__,tstop-tstart,omp_get_thread_num());
 #endif
-            free(cl_integrand);
-
-            free(primordial_pk);
-
-            free(transfer_ic1);
-
-            free(transfer_ic2);
+            free(cl_workspace);
 
           } /* end of parallel region */
 
-          if (abort == _TRUE_) return _FAILURE_;
+          if (abort == _TRUE_) {
+            free(cl_weight);
+            return _FAILURE_;
+          }
 
         }
         else {
@@ -2002,7 +2471,57 @@ int spectra_cls(
       }
     }
 
-    /** - --> (d) now that for a given mode, all possible \f$ C_l\f$'s have been computed,
+    free(cl_weight);
+
+    /** - --> (e) scalar CMB spectra for which a smaller l_max was
+        declared (l_max_tCl, l_max_pCl, l_max_lCl) are only computed
+        up to two values of l beyond l_max; at larger l they vanish.
+        In order for the spline to be valid up to l_max, replace these
+        zeros by a linear extrapolation of the last computed values.
+        They are never returned, since spectra_cl_at_l() sets the
+        \f$ C_l\f$'s to zero above l_max_ct. The other types with a
+        smaller l_max than the mode (LSS spectra up to l_max_lss) keep
+        their zeros, as before these parameters were introduced. */
+
+    for (index_ct=0; index_ct<psp->ct_size; index_ct++) {
+
+      extrapolate = _FALSE_;
+      if ((ppt->has_scalars == _TRUE_) && (index_md == ppt->index_md_scalars)) {
+        if (((psp->has_tt == _TRUE_) && (index_ct == psp->index_ct_tt)) ||
+            ((psp->has_ee == _TRUE_) && (index_ct == psp->index_ct_ee)) ||
+            ((psp->has_te == _TRUE_) && (index_ct == psp->index_ct_te)) ||
+            ((psp->has_pp == _TRUE_) && (index_ct == psp->index_ct_pp)) ||
+            ((psp->has_tp == _TRUE_) && (index_ct == psp->index_ct_tp)) ||
+            ((psp->has_ep == _TRUE_) && (index_ct == psp->index_ct_ep)) ||
+            ((psp->has_tb == _TRUE_) && (index_ct == psp->index_ct_tb)) ||
+            ((psp->has_eb == _TRUE_) && (index_ct == psp->index_ct_eb)))
+          extrapolate = _TRUE_;
+      }
+
+      if ((extrapolate == _FALSE_) || (psp->l_max_ct[index_md][index_ct] <= 0))
+        continue;
+
+      index_l_last = 0;
+      while ((index_l_last < psp->l_size[index_md]-1) && (psp->l[index_l_last] < psp->l_max_ct[index_md][index_ct]))
+        index_l_last++;
+      index_l_last = MIN(index_l_last+2,psp->l_size[index_md]-1);
+
+      if (index_l_last < 1)
+        continue;
+
+      for (index_l=index_l_last+1; index_l < psp->l_size[index_md]; index_l++) {
+        for (index_ic1_ic2 = 0; index_ic1_ic2 < psp->ic_ic_size[index_md]; index_ic1_ic2++) {
+          index_cl = index_ic1_ic2 * psp->ct_size + index_ct;
+          psp->cl[index_md][index_l * psp->ic_ic_size[index_md] * psp->ct_size + index_cl] =
+            psp->cl[index_md][index_l_last * psp->ic_ic_size[index_md] * psp->ct_size + index_cl]
+            + (psp->cl[index_md][index_l_last * psp->ic_ic_size[index_md] * psp->ct_size + index_cl]
+               - psp->cl[index_md][(index_l_last-1) * psp->ic_ic_size[index_md] * psp->ct_size + index_cl])
+            * (psp->l[index_l]-psp->l[index_l_last])/(psp->l[index_l_last]-psp->l[index_l_last-1]);
+        }
+      }
+    }
+
+    /** - --> (f) now that for a given mode, all possible \f$ C_l\f$'s have been computed,
         compute second derivative of the array in which they are stored,
         in view of spline interpolation. */
 
@@ -2017,177 +2536,163 @@ int spectra_cls(
                psp->error_message);
   }
 
+  /** - interpolate once for all the spectra at each integer l, so
+      that later calls to spectra_cl_at_l() only copy them */
+
+  class_call(spectra_cl_dense(psp),
+             psp->error_message,
+             psp->error_message);
+
   return _SUCCESS_;
 
 }
 
 /**
- * This routine computes the \f$ C_l\f$'s for a given mode, pair of initial conditions
- * and multipole, but for all types (TT, TE...), by convolving the
- * transfer functions with the primordial spectra.
+ * This routine fills the tables cl_tot_dense, cl_md_dense and
+ * cl_md_ic_dense of the \f$ C_l\f$'s at each integer l from 2 to
+ * l_max_tot, by interpolating the spline tables of spectra_cls(). The
+ * entries l=0,1 are set to zero.
  *
- * @param pba           Input: pointer to background structure
- * @param ppt           Input: pointer to perturbation structure
- * @param ptr           Input: pointer to transfers structure
- * @param ppm           Input: pointer to primordial structure
- * @param psp           Input/Output: pointer to spectra structure (result stored here)
- * @param index_md      Input: index of mode under consideration
- * @param index_ic1     Input: index of first initial condition in the correlator
- * @param index_ic2     Input: index of second initial condition in the correlator
- * @param index_l       Input: index of multipole under consideration
- * @param cl_integrand_num_columns Input: number of columns in cl_integrand
- * @param cl_integrand  Input: an allocated workspace
- * @param primordial_pk Input: table of primordial spectrum values
- * @param transfer_ic1  Input: table of transfer function values for first initial condition
- * @param transfer_ic2  Input: table of transfer function values for second initial condition
+ * @param psp Input/Output: pointer to spectra structure
  * @return the error status
  */
 
-int spectra_compute_cl(
-                       struct background * pba,
-                       struct perturbs * ppt,
-                       struct transfers * ptr,
-                       struct primordial * ppm,
-                       struct spectra * psp,
-                       int index_md,
-                       int index_ic1,
-                       int index_ic2,
-                       int index_l,
-                       int cl_integrand_num_columns,
-                       double * cl_integrand,
-                       double * primordial_pk,
-                       double * transfer_ic1,
-                       double * transfer_ic2
-                       ) {
+int spectra_cl_dense(
+                     struct spectra * psp
+                     ) {
 
-  int index_q;
-  int index_tt;
-  int index_ct;
-  int index_d1,index_d2;
-  double k;
-  double clvalue;
-  int index_ic1_ic2;
-  double transfer_ic1_temp=0.;
-  double transfer_ic2_temp=0.;
-  double * transfer_ic1_nc=NULL;
-  double * transfer_ic2_nc=NULL;
-  double factor;
-  int index_q_spline=0;
+  int index_md;
+  int l;
+  double ** cl_md;
+  double ** cl_md_ic;
 
-  index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,psp->ic_size[index_md]);
+  class_calloc(psp->cl_tot_dense,(psp->l_max_tot+1)*psp->ct_size,sizeof(double),psp->error_message);
+  class_calloc(psp->cl_md_dense,psp->md_size,sizeof(double *),psp->error_message);
+  class_calloc(psp->cl_md_ic_dense,psp->md_size,sizeof(double *),psp->error_message);
 
-  if (ppt->has_cl_number_count == _TRUE_) {
-    class_alloc(transfer_ic1_nc,psp->d_size*sizeof(double),psp->error_message);
-    class_alloc(transfer_ic2_nc,psp->d_size*sizeof(double),psp->error_message);
+  for (index_md = 0; index_md < psp->md_size; index_md++) {
+    if (psp->md_size > 1)
+      class_calloc(psp->cl_md_dense[index_md],(psp->l_max_tot+1)*psp->ct_size,sizeof(double),psp->error_message);
+    if (psp->ic_size[index_md] > 1)
+      class_calloc(psp->cl_md_ic_dense[index_md],(psp->l_max_tot+1)*psp->ic_ic_size[index_md]*psp->ct_size,sizeof(double),psp->error_message);
   }
 
-  for (index_q=0; index_q < ptr->q_size; index_q++) {
-
-    //q = ptr->q[index_q];
-    k = ptr->k[index_md][index_q];
-
-    cl_integrand[index_q*cl_integrand_num_columns+0] = k;
-
-    class_call(primordial_spectrum_at_k(ppm,index_md,linear,k,primordial_pk),
-               ppm->error_message,
-               psp->error_message);
-
-    /* above routine checks that k>0: no possible division by zero below */
-
-    for (index_tt=0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+  /* arrays of pointers to the rows of the dense tables for a given l */
+  class_calloc(cl_md,psp->md_size,sizeof(double *),psp->error_message);
+  class_calloc(cl_md_ic,psp->md_size,sizeof(double *),psp->error_message);
 
-      transfer_ic1[index_tt] =
-        ptr->transfer[index_md]
-        [((index_ic1 * ptr->tt_size[index_md] + index_tt)
-          * ptr->l_size[index_md] + index_l)
-         * ptr->q_size + index_q];
+  for (l=2; l<=psp->l_max_tot; l++) {
 
-      if (index_ic1 == index_ic2) {
-        transfer_ic2[index_tt] = transfer_ic1[index_tt];
-      }
-      else {
-        transfer_ic2[index_tt] = ptr->transfer[index_md]
-          [((index_ic2 * ptr->tt_size[index_md] + index_tt)
-            * ptr->l_size[index_md] + index_l)
-           * ptr->q_size + index_q];
-      }
+    for (index_md = 0; index_md < psp->md_size; index_md++) {
+      if (psp->md_size > 1)
+        cl_md[index_md] = psp->cl_md_dense[index_md]+l*psp->ct_size;
+      if (psp->ic_size[index_md] > 1)
+        cl_md_ic[index_md] = psp->cl_md_ic_dense[index_md]+l*psp->ic_ic_size[index_md]*psp->ct_size;
     }
 
-    /* define combinations of transfer functions */
-
-    if (ppt->has_cl_cmb_temperature == _TRUE_) {
-
-      if (_scalars_) {
-
-        transfer_ic1_temp = transfer_ic1[ptr->index_tt_t0] + transfer_ic1[ptr->index_tt_t1] + transfer_ic1[ptr->index_tt_t2];
-        transfer_ic2_temp = transfer_ic2[ptr->index_tt_t0] + transfer_ic2[ptr->index_tt_t1] + transfer_ic2[ptr->index_tt_t2];
-
-      }
-
-      if (_vectors_) {
-
-        transfer_ic1_temp = transfer_ic1[ptr->index_tt_t1] + transfer_ic1[ptr->index_tt_t2];
-        transfer_ic2_temp = transfer_ic2[ptr->index_tt_t1] + transfer_ic2[ptr->index_tt_t2];
-
-      }
+    class_call(spectra_cl_at_l_spline(psp,
+                                      (double)l,
+                                      psp->cl_tot_dense+l*psp->ct_size,
+                                      cl_md,
+                                      cl_md_ic),
+               psp->error_message,
+               psp->error_message);
+  }
 
-      if (_tensors_) {
+  free(cl_md);
+  free(cl_md_ic);
 
-        transfer_ic1_temp = transfer_ic1[ptr->index_tt_t2];
-        transfer_ic2_temp = transfer_ic2[ptr->index_tt_t2];
+  return _SUCCESS_;
 
-      }
-    }
+}
 
-    if (ppt->has_cl_number_count == _TRUE_) {
+/**
+ * This routine computes, for a given mode, the weights with which
+ * the products of transfer functions must be summed over q in order
+ * to get the \f$ C_l\f$'s, for each pair of initial conditions.
+ *
+ * The weights do not depend on l nor on the type (TT, TE...): they
+ * combine the primordial spectrum, the measure \f$ 4 \pi / k \f$ and the
+ * weights of the spline integral over q, computed once here instead
+ * of splining the integrand for each l and each type.
+ *
+ * @param pba       Input: pointer to background structure
+ * @param ptr       Input: pointer to transfers structure
+ * @param ppm       Input: pointer to primordial structure
+ * @param psp       Input: pointer to spectra structure
+ * @param index_md  Input: index of mode under consideration
+ * @param cl_weight Output: allocated array of size ic_ic_size[index_md]*q_size, filled with cl_weight[index_ic1_ic2*q_size+index_q]
+ * @return the error status
+ */
 
-      for (index_d1=0; index_d1<psp->d_size; index_d1++) {
+int spectra_cl_weights(
+                       struct background * pba,
+                       struct transfers * ptr,
+                       struct primordial * ppm,
+                       struct spectra * psp,
+                       int index_md,
+                       double * cl_weight
+                       ) {
 
-        transfer_ic1_nc[index_d1] = 0.;
-        transfer_ic2_nc[index_d1] = 0.;
+  int index_q;
+  int index_ic1_ic2;
+  int index_q_spline=0;
+  double k;
+  double factor;
+  double * q_weight;
+  double * primordial_pk;
+
+  class_alloc(q_weight,ptr->q_size*sizeof(double),psp->error_message);
+  class_alloc(primordial_pk,ptr->q_size*psp->ic_ic_size[index_md]*sizeof(double),psp->error_message);
+
+  /* Technical point: we will do a spline integral over the whole
+     range of k's, excepted in the closed (K>0) case. In that case, it
+     is a bad idea to spline over the values of k corresponding to
+     nu<nu_flat_approximation. In this region, nu values are integer
+     values, so the steps dq and dk have some discrete jumps. This
+     makes the spline routine less accurate than a trapezoidal
+     integral with finer sampling. So, in the closed case, we set
+     index_q_spline to ptr->index_q_flat_approximation, to tell the
+     integration routine that below this index, it should treat the
+     integral as a trapezoidal one. For testing, one is free to set
+     index_q_spline to 0, to enforce spline integration everywhere,
+     or to (ptr->q_size-1), to enforce trapezoidal integration
+     everywhere. */
+
+  if (pba->sgnK == 1) {
+    index_q_spline = ptr->index_q_flat_approximation;
+  }
 
-        if (ppt->has_nc_density == _TRUE_) {
-          transfer_ic1_nc[index_d1] += transfer_ic1[ptr->index_tt_density+index_d1];
-          transfer_ic2_nc[index_d1] += transfer_ic2[ptr->index_tt_density+index_d1];
-        }
+  class_call(array_integrate_all_trapzd_or_spline_weights(ptr->k[index_md],
+                                                          ptr->q_size,
+                                                          index_q_spline,
+                                                          q_weight,
+                                                          psp->error_message),
+             psp->error_message,
+             psp->error_message);
 
-        if (ppt->has_nc_rsd     == _TRUE_) {
-          transfer_ic1_nc[index_d1]
-            += transfer_ic1[ptr->index_tt_rsd+index_d1]
-            + transfer_ic1[ptr->index_tt_d0+index_d1]
-            + transfer_ic1[ptr->index_tt_d1+index_d1];
-          transfer_ic2_nc[index_d1]
-            += transfer_ic2[ptr->index_tt_rsd+index_d1]
-            + transfer_ic2[ptr->index_tt_d0+index_d1]
-            + transfer_ic2[ptr->index_tt_d1+index_d1];
-        }
+  /* in the closed case, instead of an integral, we have a discrete
+     sum. In practice, this does not matter: the previous routine
+     does give a correct approximation of the discrete sum, both in
+     the trapezoidal and spline regions. The only error comes from
+     the first point: the previous routine assumes a weight for the
+     first point which is too small compared to what it would be in
+     the an actual discrete sum. The line below correct this problem
+     in an exact way. */
+
+  if (pba->sgnK == 1) {
+    q_weight[0] += ptr->q[0]/ptr->k[0][0]*sqrt(pba->K)/2.;
+  }
 
-        if (ppt->has_nc_lens == _TRUE_) {
-          transfer_ic1_nc[index_d1] +=
-            psp->l[index_l]*(psp->l[index_l]+1.)*transfer_ic1[ptr->index_tt_nc_lens+index_d1];
-          transfer_ic2_nc[index_d1] +=
-            psp->l[index_l]*(psp->l[index_l]+1.)*transfer_ic2[ptr->index_tt_nc_lens+index_d1];
-        }
+  class_call(primordial_spectrum_at_k_vector(ppm,index_md,linear,ptr->k[index_md],ptr->q_size,primordial_pk),
+             ppm->error_message,
+             psp->error_message);
 
-        if (ppt->has_nc_gr == _TRUE_) {
-          transfer_ic1_nc[index_d1]
-            += transfer_ic1[ptr->index_tt_nc_g1+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g2+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g3+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g4+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g5+index_d1];
-          transfer_ic2_nc[index_d1]
-            += transfer_ic2[ptr->index_tt_nc_g1+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g2+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g3+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g4+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g5+index_d1];
-        }
+  for (index_q=0; index_q < ptr->q_size; index_q++) {
 
-      }
-    }
+    k = ptr->k[index_md][index_q];
 
-    /* integrand of Cl's */
+    /* above routine checks that k>0: no possible division by zero below */
 
     /* note: we must integrate
 
@@ -2230,246 +2735,364 @@ int spectra_compute_cl(
 
     */
 
-    factor = 4. * _PI_ / k;
-
-    if (psp->has_tt == _TRUE_)
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_tt]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1_temp
-        * transfer_ic2_temp
-        * factor;
-
-    if (psp->has_ee == _TRUE_)
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_ee]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1[ptr->index_tt_e]
-        * transfer_ic2[ptr->index_tt_e]
-        * factor;
-
-    if (psp->has_te == _TRUE_)
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_te]=
-        primordial_pk[index_ic1_ic2]
-        * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_e] +
-               transfer_ic1[ptr->index_tt_e] * transfer_ic2_temp)
-        * factor;
-
-    if (_tensors_ && (psp->has_bb == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_bb]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1[ptr->index_tt_b]
-        * transfer_ic2[ptr->index_tt_b]
-        * factor;
-
-    if (_scalars_ && (psp->has_pp == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_pp]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1[ptr->index_tt_lcmb]
-        * transfer_ic2[ptr->index_tt_lcmb]
-        * factor;
-
-    if (_scalars_ && (psp->has_tp == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_tp]=
-        primordial_pk[index_ic1_ic2]
-        * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_lcmb] +
-               transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2_temp)
-        * factor;
-
-    if (_scalars_ && (psp->has_ep == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_ep]=
-        primordial_pk[index_ic1_ic2]
-        * 0.5*(transfer_ic1[ptr->index_tt_e] * transfer_ic2[ptr->index_tt_lcmb] +
-               transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2[ptr->index_tt_e])
-        * factor;
-
-    /* Modification */
-
-    if (_tensors_ && (psp->has_tb == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_tb]=
-        -primordial_pk[index_ic1_ic2] * psp->chiral_par
-        * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_b] +
-               transfer_ic1[ptr->index_tt_b] * transfer_ic2_temp)
-        * factor;
-
-    if (_tensors_ && (psp->has_eb == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_eb]=
-        -primordial_pk[index_ic1_ic2] * psp->chiral_par
-        * 0.5*(transfer_ic1[ptr->index_tt_b] * transfer_ic2[ptr->index_tt_e] +
-               transfer_ic1[ptr->index_tt_e] * transfer_ic2[ptr->index_tt_b])
-        * factor;
-
-    /* Ends here */
+    factor = 4. * _PI_ / k * q_weight[index_q];
 
-    if (_scalars_ && (psp->has_dd == _TRUE_)) {
-      index_ct=0;
-      for (index_d1=0; index_d1<psp->d_size; index_d1++) {
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
-          cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_dd+index_ct]=
-            primordial_pk[index_ic1_ic2]
-            * transfer_ic1_nc[index_d1]
-            * transfer_ic2_nc[index_d2]
-            * factor;
-          index_ct++;
-        }
-      }
+    for (index_ic1_ic2=0; index_ic1_ic2 < psp->ic_ic_size[index_md]; index_ic1_ic2++) {
+      cl_weight[index_ic1_ic2*ptr->q_size+index_q] = primordial_pk[index_q*psp->ic_ic_size[index_md]+index_ic1_ic2] * factor;
     }
+  }
 
-    if (_scalars_ && (psp->has_td == _TRUE_)) {
-      for (index_d1=0; index_d1<psp->d_size; index_d1++) {
-        cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_td+index_d1]=
-          primordial_pk[index_ic1_ic2]
-          * 0.5*(transfer_ic1_temp * transfer_ic2_nc[index_d1] +
-                 transfer_ic1_nc[index_d1] * transfer_ic2_temp)
-          * factor;
-      }
-    }
+  free(q_weight);
+  free(primordial_pk);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine computes the \f$ C_l\f$'s for a given mode, pair of initial conditions
+ * and multipole, but for all types (TT, TE...), by convolving the
+ * transfer functions with the primordial spectra.
+ *
+ * Each \f$ C_l\f$ is a weighted sum over q of the product of two
+ * combinations of transfer functions, which are contiguous in q in
+ * the transfer structure. Combinations involving several transfer
+ * types (temperature, number count) are first summed in the
+ * workspace, then all types are obtained from spectra_cl_integral().
+ *
+ * @param ppt           Input: pointer to perturbation structure
+ * @param ptr           Input: pointer to transfers structure
+ * @param psp           Input/Output: pointer to spectra structure (result stored here)
+ * @param index_md      Input: index of mode under consideration
+ * @param index_ic1     Input: index of first initial condition in the correlator
+ * @param index_ic2     Input: index of second initial condition in the correlator
+ * @param index_l       Input: index of multipole under consideration
+ * @param cl_weight     Input: weights of this pair of initial conditions computed by spectra_cl_weights(), size q_size
+ * @param cl_workspace  Input: an allocated workspace of size (2+2*d_size)*q_size
+ * @return the error status
+ */
+
+int spectra_compute_cl(
+                       struct perturbs * ppt,
+                       struct transfers * ptr,
+                       struct spectra * psp,
+                       int index_md,
+                       int index_ic1,
+                       int index_ic2,
+                       int index_l,
+                       double * cl_weight,
+                       double * cl_workspace
+                       ) {
+
+  int index_q;
+  int index_ct;
+  int index_ic;
+  int index_d1,index_d2;
+  int q_size;
+  int tt_stride;
+  double * clvalue;
+  int index_ic1_ic2;
+  double * transfer_ic1; /* transfer_ic1[index_tt*tt_stride+index_q] */
+  double * transfer_ic2; /* idem */
+  double * transfer_ic1_temp=NULL;
+  double * transfer_ic2_temp=NULL;
+  double * transfer_ic1_nc=NULL; /* transfer_ic1_nc[index_d1*q_size+index_q] */
+  double * transfer_ic2_nc=NULL; /* idem */
+  double * tr;
+  double * nc;
+  double factor;
+
+  class_kernel_start(kernel_spectra_compute_cl);
+
+  index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,psp->ic_size[index_md]);
+
+  q_size = ptr->q_size;
+  tt_stride = ptr->l_size[index_md]*q_size;
+
+  transfer_ic1 = ptr->transfer[index_md] + (index_ic1 * ptr->tt_size[index_md] * ptr->l_size[index_md] + index_l) * q_size;
+  transfer_ic2 = ptr->transfer[index_md] + (index_ic2 * ptr->tt_size[index_md] * ptr->l_size[index_md] + index_l) * q_size;
+
+  clvalue = psp->cl[index_md] + (index_l * psp->ic_ic_size[index_md] + index_ic1_ic2) * psp->ct_size;
+
+  /** - define combinations of transfer functions. When the two
+      initial conditions are the same, the second combination points
+      to the first one. */
+
+  if (ppt->has_cl_cmb_temperature == _TRUE_) {
+
+    if (_tensors_) {
+
+      transfer_ic1_temp = transfer_ic1 + ptr->index_tt_t2*tt_stride;
+      transfer_ic2_temp = transfer_ic2 + ptr->index_tt_t2*tt_stride;
 
-    if (_scalars_ && (psp->has_pd == _TRUE_)) {
-      for (index_d1=0; index_d1<psp->d_size; index_d1++) {
-        cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_pd+index_d1]=
-          primordial_pk[index_ic1_ic2]
-          * 0.5*(transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2_nc[index_d1] +
-                 transfer_ic1_nc[index_d1] * transfer_ic2[ptr->index_tt_lcmb])
-          * factor;
-      }
     }
+    else {
 
-    if (_scalars_ && (psp->has_ll == _TRUE_)) {
-      index_ct=0;
-      for (index_d1=0; index_d1<psp->d_size; index_d1++) {
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
-          cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_ll+index_ct]=
-            primordial_pk[index_ic1_ic2]
-            * transfer_ic1[ptr->index_tt_lensing+index_d1]
-            * transfer_ic2[ptr->index_tt_lensing+index_d2]
-            * factor;
-          index_ct++;
+      transfer_ic1_temp = cl_workspace;
+      transfer_ic2_temp = cl_workspace + q_size;
+
+      if (index_ic1 == index_ic2)
+        transfer_ic2_temp = transfer_ic1_temp;
+
+      for (index_ic=0; index_ic < ((index_ic1 == index_ic2) ? 1 : 2); index_ic++) {
+
+        tr = (index_ic == 0) ? transfer_ic1 : transfer_ic2;
+        nc = (index_ic == 0) ? transfer_ic1_temp : transfer_ic2_temp;
+
+        if (_scalars_) {
+#pragma omp simd
+          for (index_q=0; index_q < q_size; index_q++)
+            nc[index_q] = tr[ptr->index_tt_t0*tt_stride+index_q] + tr[ptr->index_tt_t1*tt_stride+index_q] + tr[ptr->index_tt_t2*tt_stride+index_q];
         }
-      }
-    }
 
-    if (_scalars_ && (psp->has_tl == _TRUE_)) {
-      for (index_d1=0; index_d1<psp->d_size; index_d1++) {
-        cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_tl+index_d1]=
-          primordial_pk[index_ic1_ic2]
-          * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_lensing+index_d1] +
-                 transfer_ic1[ptr->index_tt_lensing+index_d1] * transfer_ic2_temp)
-          * factor;
+        if (_vectors_) {
+#pragma omp simd
+          for (index_q=0; index_q < q_size; index_q++)
+            nc[index_q] = tr[ptr->index_tt_t1*tt_stride+index_q] + tr[ptr->index_tt_t2*tt_stride+index_q];
+        }
       }
     }
+  }
+
+  if (ppt->has_cl_number_count == _TRUE_) {
+
+    transfer_ic1_nc = cl_workspace + 2*q_size;
+    transfer_ic2_nc = cl_workspace + (2+psp->d_size)*q_size;
+
+    if (index_ic1 == index_ic2)
+      transfer_ic2_nc = transfer_ic1_nc;
+
+    for (index_ic=0; index_ic < ((index_ic1 == index_ic2) ? 1 : 2); index_ic++) {
+
+      tr = (index_ic == 0) ? transfer_ic1 : transfer_ic2;
 
-    if (_scalars_ && (psp->has_dl == _TRUE_)) {
-      index_ct=0;
       for (index_d1=0; index_d1<psp->d_size; index_d1++) {
-        for (index_d2=MAX(index_d1-psp->non_diag,0); index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
-          cl_integrand[index_q*cl_integrand_num_columns+1+psp->index_ct_dl+index_ct]=
-            primordial_pk[index_ic1_ic2]
-            * transfer_ic1_nc[index_d1] * transfer_ic2[ptr->index_tt_lensing+index_d2]
-            * factor;
-          index_ct++;
+
+        nc = ((index_ic == 0) ? transfer_ic1_nc : transfer_ic2_nc) + index_d1*q_size;
+        factor = psp->l[index_l]*(psp->l[index_l]+1.);
+
+#pragma omp simd
+        for (index_q=0; index_q < q_size; index_q++) {
+
+          nc[index_q] = 0.;
+
+          if (ppt->has_nc_density == _TRUE_)
+            nc[index_q] += tr[(ptr->index_tt_density+index_d1)*tt_stride+index_q];
+
+          if (ppt->has_nc_rsd == _TRUE_)
+            nc[index_q]
+              += tr[(ptr->index_tt_rsd+index_d1)*tt_stride+index_q]
+              + tr[(ptr->index_tt_d0+index_d1)*tt_stride+index_q]
+              + tr[(ptr->index_tt_d1+index_d1)*tt_stride+index_q];
+
+          if (ppt->has_nc_lens == _TRUE_)
+            nc[index_q] += factor*tr[(ptr->index_tt_nc_lens+index_d1)*tt_stride+index_q];
+
+          if (ppt->has_nc_gr == _TRUE_)
+            nc[index_q]
+              += tr[(ptr->index_tt_nc_g1+index_d1)*tt_stride+index_q]
+              + tr[(ptr->index_tt_nc_g2+index_d1)*tt_stride+index_q]
+              + tr[(ptr->index_tt_nc_g3+index_d1)*tt_stride+index_q]
+              + tr[(ptr->index_tt_nc_g4+index_d1)*tt_stride+index_q]
+              + tr[(ptr->index_tt_nc_g5+index_d1)*tt_stride+index_q];
         }
       }
     }
   }
 
+  /** - null spectra (C_l^BB of scalars, C_l^pp of tensors, etc.) are
+      set to zero, all other ones are overwritten below */
+
   for (index_ct=0; index_ct<psp->ct_size; index_ct++) {
+    clvalue[index_ct] = 0.;
+  }
 
-    /* treat null spectra (C_l^BB of scalars, C_l^pp of tensors, etc. */
-
-    if ((_scalars_ && (psp->has_bb == _TRUE_) && (index_ct == psp->index_ct_bb)) ||
-        (_tensors_ && (psp->has_pp == _TRUE_) && (index_ct == psp->index_ct_pp)) ||
-        (_tensors_ && (psp->has_tp == _TRUE_) && (index_ct == psp->index_ct_tp)) ||
-        /* Modification starts here */
-        (_scalars_ && (psp->has_tb == _TRUE_) && (index_ct == psp->index_ct_tb)) ||
-        (_scalars_ && (psp->has_eb == _TRUE_) && (index_ct == psp->index_ct_eb)) ||
-        /* Ends here */
-        (_tensors_ && (psp->has_ep == _TRUE_) && (index_ct == psp->index_ct_ep)) ||
-        (_tensors_ && (psp->has_dd == _TRUE_) && (index_ct == psp->index_ct_dd)) ||
-        (_tensors_ && (psp->has_td == _TRUE_) && (index_ct == psp->index_ct_td)) ||
-        (_tensors_ && (psp->has_pd == _TRUE_) && (index_ct == psp->index_ct_pd)) ||
-        (_tensors_ && (psp->has_ll == _TRUE_) && (index_ct == psp->index_ct_ll)) ||
-        (_tensors_ && (psp->has_tl == _TRUE_) && (index_ct == psp->index_ct_tl)) ||
-        (_tensors_ && (psp->has_dl == _TRUE_) && (index_ct == psp->index_ct_dl))
-        ) {
-
-      psp->cl[index_md]
-        [(index_l * psp->ic_ic_size[index_md] + index_ic1_ic2) * psp->ct_size + index_ct] = 0.;
-
-    }
-    /* for non-zero spectra, integrate over q */
-    else {
+  /** - for non-zero spectra, sum over q */
+
+  if (psp->has_tt == _TRUE_)
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1_temp,transfer_ic2_temp,
+                        transfer_ic1_temp,transfer_ic2_temp,
+                        &(clvalue[psp->index_ct_tt]));
+
+  if (psp->has_ee == _TRUE_)
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1+ptr->index_tt_e*tt_stride,transfer_ic2+ptr->index_tt_e*tt_stride,
+                        transfer_ic1+ptr->index_tt_e*tt_stride,transfer_ic2+ptr->index_tt_e*tt_stride,
+                        &(clvalue[psp->index_ct_ee]));
+
+  if (psp->has_te == _TRUE_)
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1_temp,transfer_ic2+ptr->index_tt_e*tt_stride,
+                        transfer_ic1+ptr->index_tt_e*tt_stride,transfer_ic2_temp,
+                        &(clvalue[psp->index_ct_te]));
+
+  if (_tensors_ && (psp->has_bb == _TRUE_))
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1+ptr->index_tt_b*tt_stride,transfer_ic2+ptr->index_tt_b*tt_stride,
+                        transfer_ic1+ptr->index_tt_b*tt_stride,transfer_ic2+ptr->index_tt_b*tt_stride,
+                        &(clvalue[psp->index_ct_bb]));
+
+  if (_scalars_ && (psp->has_pp == _TRUE_))
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1+ptr->index_tt_lcmb*tt_stride,transfer_ic2+ptr->index_tt_lcmb*tt_stride,
+                        transfer_ic1+ptr->index_tt_lcmb*tt_stride,transfer_ic2+ptr->index_tt_lcmb*tt_stride,
+                        &(clvalue[psp->index_ct_pp]));
+
+  if (_scalars_ && (psp->has_tp == _TRUE_))
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1_temp,transfer_ic2+ptr->index_tt_lcmb*tt_stride,
+                        transfer_ic1+ptr->index_tt_lcmb*tt_stride,transfer_ic2_temp,
+                        &(clvalue[psp->index_ct_tp]));
+
+  if (_scalars_ && (psp->has_ep == _TRUE_))
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1+ptr->index_tt_e*tt_stride,transfer_ic2+ptr->index_tt_lcmb*tt_stride,
+                        transfer_ic1+ptr->index_tt_lcmb*tt_stride,transfer_ic2+ptr->index_tt_e*tt_stride,
+                        &(clvalue[psp->index_ct_ep]));
+
+  /* Modification */
+
+  if (_tensors_ && (psp->has_tb == _TRUE_)) {
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1_temp,transfer_ic2+ptr->index_tt_b*tt_stride,
+                        transfer_ic1+ptr->index_tt_b*tt_stride,transfer_ic2_temp,
+                        &(clvalue[psp->index_ct_tb]));
+    clvalue[psp->index_ct_tb] *= -psp->chiral_par;
+  }
 
-      /* spline the integrand over the whole range of k's */
+  if (_tensors_ && (psp->has_eb == _TRUE_)) {
+    spectra_cl_integral(q_size,cl_weight,
+                        transfer_ic1+ptr->index_tt_b*tt_stride,transfer_ic2+ptr->index_tt_e*tt_stride,
+                        transfer_ic1+ptr->index_tt_e*tt_stride,transfer_ic2+ptr->index_tt_b*tt_stride,
+                        &(clvalue[psp->index_ct_eb]));
+    clvalue[psp->index_ct_eb] *= -psp->chiral_par;
+  }
 
-      class_call(array_spline(cl_integrand,
-                              cl_integrand_num_columns,
-                              ptr->q_size,
-                              0,
-                              1+index_ct,
-                              1+psp->ct_size+index_ct,
-                              _SPLINE_EST_DERIV_,
-                              psp->error_message),
-                 psp->error_message,
-                 psp->error_message);
+  /* Ends here */
 
-      /* Technical point: we will now do a spline integral over the
-         whole range of k's, excepted in the closed (K>0) case. In
-         that case, it is a bad idea to spline over the values of k
-         corresponding to nu<nu_flat_approximation. In this region, nu
-         values are integer values, so the steps dq and dk have some
-         discrete jumps. This makes the spline routine less accurate
-         than a trapezoidal integral with finer sampling. So, in the
-         closed case, we set index_q_spline to
-         ptr->index_q_flat_approximation, to tell the integration
-         routine that below this index, it should treat the integral
-         as a trapezoidal one. For testing, one is free to set
-         index_q_spline to 0, to enforce spline integration
-         everywhere, or to (ptr->q_size-1), to enforce trapezoidal
-         integration everywhere. */
-
-      if (pba->sgnK == 1) {
-        index_q_spline = ptr->index_q_flat_approximation;
+  if (_scalars_ && (psp->has_dd == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<psp->d_size; index_d1++) {
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
+        spectra_cl_integral(q_size,cl_weight,
+                            transfer_ic1_nc+index_d1*q_size,transfer_ic2_nc+index_d2*q_size,
+                            transfer_ic1_nc+index_d1*q_size,transfer_ic2_nc+index_d2*q_size,
+                            &(clvalue[psp->index_ct_dd+index_ct]));
+        index_ct++;
       }
+    }
+  }
 
-      class_call(array_integrate_all_trapzd_or_spline(cl_integrand,
-                                                      cl_integrand_num_columns,
-                                                      ptr->q_size,
-                                                      index_q_spline,
-                                                      0,
-                                                      1+index_ct,
-                                                      1+psp->ct_size+index_ct,
-                                                      &clvalue,
-                                                      psp->error_message),
-                 psp->error_message,
-                 psp->error_message);
+  if (_scalars_ && (psp->has_td == _TRUE_)) {
+    for (index_d1=0; index_d1<psp->d_size; index_d1++) {
+      spectra_cl_integral(q_size,cl_weight,
+                          transfer_ic1_temp,transfer_ic2_nc+index_d1*q_size,
+                          transfer_ic1_nc+index_d1*q_size,transfer_ic2_temp,
+                          &(clvalue[psp->index_ct_td+index_d1]));
+    }
+  }
 
-      /* in the closed case, instead of an integral, we have a
-         discrete sum. In practice, this does not matter: the previous
-         routine does give a correct approximation of the discrete
-         sum, both in the trapezoidal and spline regions. The only
-         error comes from the first point: the previous routine
-         assumes a weight for the first point which is too small
-         compared to what it would be in the an actual discrete
-         sum. The line below correct this problem in an exact way.
-      */
-
-      if (pba->sgnK == 1) {
-        clvalue += cl_integrand[1+index_ct] * ptr->q[0]/ptr->k[0][0]*sqrt(pba->K)/2.;
-      }
+  if (_scalars_ && (psp->has_pd == _TRUE_)) {
+    for (index_d1=0; index_d1<psp->d_size; index_d1++) {
+      spectra_cl_integral(q_size,cl_weight,
+                          transfer_ic1+ptr->index_tt_lcmb*tt_stride,transfer_ic2_nc+index_d1*q_size,
+                          transfer_ic1_nc+index_d1*q_size,transfer_ic2+ptr->index_tt_lcmb*tt_stride,
+                          &(clvalue[psp->index_ct_pd+index_d1]));
+    }
+  }
 
-      /* we have the correct C_l now. We can store it in the transfer structure. */
+  if (_scalars_ && (psp->has_ll == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<psp->d_size; index_d1++) {
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
+        spectra_cl_integral(q_size,cl_weight,
+                            transfer_ic1+(ptr->index_tt_lensing+index_d1)*tt_stride,transfer_ic2+(ptr->index_tt_lensing+index_d2)*tt_stride,
+                            transfer_ic1+(ptr->index_tt_lensing+index_d1)*tt_stride,transfer_ic2+(ptr->index_tt_lensing+index_d2)*tt_stride,
+                            &(clvalue[psp->index_ct_ll+index_ct]));
+        index_ct++;
+      }
+    }
+  }
 
-      psp->cl[index_md]
-        [(index_l * psp->ic_ic_size[index_md] + index_ic1_ic2) * psp->ct_size + index_ct]
-        = clvalue;
+  if (_scalars_ && (psp->has_tl == _TRUE_)) {
+    for (index_d1=0; index_d1<psp->d_size; index_d1++) {
+      spectra_cl_integral(q_size,cl_weight,
+                          transfer_ic1_temp,transfer_ic2+(ptr->index_tt_lensing+index_d1)*tt_stride,
+                          transfer_ic1+(ptr->index_tt_lensing+index_d1)*tt_stride,transfer_ic2_temp,
+                          &(clvalue[psp->index_ct_tl+index_d1]));
+    }
+  }
 
+  if (_scalars_ && (psp->has_dl == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<psp->d_size; index_d1++) {
+      for (index_d2=MAX(index_d1-psp->non_diag,0); index_d2<=MIN(index_d1+psp->non_diag,psp->d_size-1); index_d2++) {
+        spectra_cl_integral(q_size,cl_weight,
+                            transfer_ic1_nc+index_d1*q_size,transfer_ic2+(ptr->index_tt_lensing+index_d2)*tt_stride,
+                            transfer_ic1_nc+index_d1*q_size,transfer_ic2+(ptr->index_tt_lensing+index_d2)*tt_stride,
+                            &(clvalue[psp->index_ct_dl+index_ct]));
+        index_ct++;
+      }
     }
   }
 
-  if (ppt->has_cl_number_count == _TRUE_) {
-    free(transfer_ic1_nc);
-    free(transfer_ic2_nc);
+  class_kernel_stop(kernel_spectra_compute_cl);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Weighted sum over q of a symmetrised product of transfer functions,
+ *
+ * \f$ C = \sum_q w_q (a_1 b_2 + b_1 a_2)/2 \f$,
+ *
+ * reducing to \f$ \sum_q w_q a_1 b_2 \f$ when (b1,a2) point to (a1,b2).
+ * Since the four functions may alias each other, only the weights
+ * are declared restrict; the functions are only read.
+ * This is the innermost kernel of the \f$ C_l\f$ computation; it is
+ * compiled for several instruction sets, in order to use vector
+ * fused multiply-add instructions when available.
+ *
+ * @param q_size    Input: number of values of q
+ * @param cl_weight Input: weights w_q
+ * @param a1        Input: first function for first initial condition
+ * @param b2        Input: second function for second initial condition
+ * @param b1        Input: second function for first initial condition
+ * @param a2        Input: first function for second initial condition
+ * @param cl        Output: result
+ * @return the error status
+ */
+
+_TARGET_CLONES_
+int spectra_cl_integral(
+                        int q_size,
+                        double * __restrict__ cl_weight,
+                        double * a1,
+                        double * b2,
+                        double * b1,
+                        double * a2,
+                        double * cl
+                        ) {
+
+  int index_q;
+  double sum=0.;
+
+  if ((b1 == a1) && (a2 == b2)) {
+#pragma omp simd reduction(+:sum)
+    for (index_q=0; index_q < q_size; index_q++)
+      sum += cl_weight[index_q]*a1[index_q]*b2[index_q];
+  }
+  else {
+#pragma omp simd reduction(+:sum)
+    for (index_q=0; index_q < q_size; index_q++)
+      sum += cl_weight[index_q]*(a1[index_q]*b2[index_q]+b1[index_q]*a2[index_q]);
+    sum *= 0.5;
   }
 
+  *cl = sum;
+
   return _SUCCESS_;
 
 }
@@ -2603,7 +3226,8 @@ int spectra_pk(
   int index_ic1,index_ic2,index_ic1_ic2;
   int index_k;
   int index_tau;
-  double * primordial_pk; /* array with argument primordial_pk[index_ic_ic] */
+  double * primordial_pk; /* array with argument primordial_pk[index_k*ic_ic_size+index_ic_ic] */
+  double * pk_primordial;
   double source_ic1;
   double source_ic2;
   double ln_pk_tot;
@@ -2618,7 +3242,14 @@ int spectra_pk(
 
   /** - allocate temporary vectors where the primordial spectrum and the background quantities will be stored */
 
-  class_alloc(primordial_pk,psp->ic_ic_size[index_md]*sizeof(double),psp->error_message);
+  class_alloc(primordial_pk,psp->ln_k_size*psp->ic_ic_size[index_md]*sizeof(double),psp->error_message);
+
+  /** - the primordial spectrum does not depend on time: compute it
+      once for all wavenumbers */
+
+  class_call(primordial_spectrum_at_k_vector(ppm,index_md,logarithmic,psp->ln_k,psp->ln_k_size,primordial_pk),
+             ppm->error_message,
+             psp->error_message);
 
   /** - allocate and fill array of \f$P(k,\tau)\f$ values */
 
@@ -2638,9 +3269,7 @@ int spectra_pk(
   for (index_tau=0 ; index_tau < psp->ln_tau_size; index_tau++) {
     for (index_k=0; index_k<psp->ln_k_size; index_k++) {
 
-      class_call(primordial_spectrum_at_k(ppm,index_md,logarithmic,psp->ln_k[index_k],primordial_pk),
-                 ppm->error_message,
-                 psp->error_message);
+      pk_primordial = primordial_pk+index_k*psp->ic_ic_size[index_md];
 
       ln_pk_tot =0;
 
@@ -2661,12 +3290,12 @@ int spectra_pk(
 
         source_ic1 = ppt->sources[index_md]
           [index_ic1 * ppt->tp_size[index_md] + ppt->index_tp_delta_m]
-          [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+          [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
         psp->ln_pk[(index_tau * psp->ln_k_size + index_k)* psp->ic_ic_size[index_md] + index_ic1_ic2] =
           log(2.*_PI_*_PI_/exp(3.*psp->ln_k[index_k])
               *source_ic1*source_ic1
-              *exp(primordial_pk[index_ic1_ic2]));
+              *exp(pk_primordial[index_ic1_ic2]));
 
         ln_pk_tot += psp->ln_pk[(index_tau * psp->ln_k_size + index_k)* psp->ic_ic_size[index_md] + index_ic1_ic2];
 
@@ -2682,14 +3311,14 @@ int spectra_pk(
 
             source_ic1 = ppt->sources[index_md]
               [index_ic1 * ppt->tp_size[index_md] + ppt->index_tp_delta_m]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             source_ic2 = ppt->sources[index_md]
               [index_ic2 * ppt->tp_size[index_md] + ppt->index_tp_delta_m]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->ln_pk[(index_tau * psp->ln_k_size + index_k)* psp->ic_ic_size[index_md] + index_ic1_ic2] =
-              primordial_pk[index_ic1_ic2]*SIGN(source_ic1)*SIGN(source_ic2);
+              pk_primordial[index_ic1_ic2]*SIGN(source_ic1)*SIGN(source_ic2);
 
             ln_pk_tot += psp->ln_pk[(index_tau * psp->ln_k_size + index_k)* psp->ic_ic_size[index_md] + index_ic1_ic2];
 
@@ -2768,6 +3397,262 @@ int spectra_pk(
   return _SUCCESS_;
 }
 
+/**
+ * This routine computes the linear matter correlation function
+ * \f$ \xi(r) \f$ and the r.m.s. fluctuation \f$ \sigma(R) \f$ in spheres
+ * of radius R, on a logarithmic grid of radii and for all values of
+ * tau at which P(k) is stored, using FFTLog (see tools/fftlog.c):
+ *
+ * \f$ \xi(r) = \int dk/k \; \Delta^2(k) \; j_0(kr) \f$,
+ * \f$ \sigma^2(R) = \int dk/k \; \Delta^2(k) \; W^2(kR) \f$,
+ *
+ * with \f$ \Delta^2(k) = k^3 P(k)/(2\pi^2) \f$. The spectrum is
+ * resampled on ppr->fftlog_size/2 points equally spaced in ln(k)
+ * between kmin and kmax, and extrapolated as a power law over
+ * ppr->fftlog_size/4 points on each side, with a smooth taper to zero
+ * at both ends. The radii stored in psp->ln_r are the reciprocals
+ * of the resampled wavenumbers.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param psp Input/Output: pointer to spectra structure
+ * @return the error status
+ */
+
+int spectra_correlations(
+                         struct precision * ppr,
+                         struct spectra * psp
+                         ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_md;
+  int index_tau;
+  int index_k;
+  int index_r;
+  int index_ic1,index_ic2,index_ic1_ic2;
+  int ic_ic_size;
+  int N,pad,last_index;
+  double dlnk,ln_k,ln_k_min,ln_k_max,slope_min,slope_max,taper,pk;
+  double * ln_pk_tot;   /* total ln P(k) on the grid psp->ln_k */
+  double * ddln_pk_tot;
+  double * ln_pk_fft;   /* total ln P(k) on the FFTLog grid */
+  double * delta2;      /* k^3 P(k) / (2 pi^2) on the FFTLog grid, tapered */
+  double * result;
+  double * pk_ic;
+  struct fftlog_plan fp_xi;
+  struct fftlog_plan fp_sigma;
+
+  /* power-law bias of the transforms: the integrands behave as
+     k^(4-q) at small k and at most k^(-q) at large k, and the Mellin
+     transforms of both kernels converge for 0 < q < 2 */
+  double q = 1.5;
+
+  index_md = psp->index_md_scalars;
+  ic_ic_size = psp->ic_ic_size[index_md];
+
+  N = ppr->fftlog_size;
+  pad = N/4;
+  psp->ln_r_size = N/2;
+
+  ln_k_min = psp->ln_k[0];
+  ln_k_max = psp->ln_k[psp->ln_k_size-1];
+  dlnk = (ln_k_max-ln_k_min)/(psp->ln_r_size-1);
+
+  if (psp->spectra_verbose > 0)
+    printf(" -> computing xi(r) and sigma(R) for R=%g to %g Mpc\n",exp(-ln_k_max),exp(-ln_k_min));
+
+  class_alloc(psp->ln_r,psp->ln_r_size*sizeof(double),psp->error_message);
+  class_alloc(psp->xi,psp->ln_tau_size*psp->ln_r_size*sizeof(double),psp->error_message);
+  class_alloc(psp->sigma_r,psp->ln_tau_size*psp->ln_r_size*sizeof(double),psp->error_message);
+
+  class_alloc(ln_pk_tot,psp->ln_k_size*sizeof(double),psp->error_message);
+  class_alloc(ddln_pk_tot,psp->ln_k_size*sizeof(double),psp->error_message);
+  class_alloc(ln_pk_fft,N*sizeof(double),psp->error_message);
+  class_alloc(delta2,N*sizeof(double),psp->error_message);
+  class_alloc(result,N*sizeof(double),psp->error_message);
+  class_alloc(pk_ic,ic_ic_size*sizeof(double),psp->error_message);
+
+  /** - the output grid of both transforms is r_m = exp(m dlnk)/k_{N-1},
+      so that the resampled r and k grids are reciprocal */
+
+  class_call(fftlog_plan_init(N,
+                              exp(ln_k_min-pad*dlnk),
+                              dlnk,
+                              exp(-ln_k_min-(N-1-pad)*dlnk),
+                              q,
+                              fftlog_spherical_bessel,
+                              0.,
+                              &fp_xi,
+                              psp->error_message),
+             psp->error_message,
+             psp->error_message);
+
+  class_call(fftlog_plan_init(N,
+                              exp(ln_k_min-pad*dlnk),
+                              dlnk,
+                              exp(-ln_k_min-(N-1-pad)*dlnk),
+                              q,
+                              fftlog_tophat_squared,
+                              0.,
+                              &fp_sigma,
+                              psp->error_message),
+             psp->error_message,
+             psp->error_message);
+
+  for (index_r=0; index_r<psp->ln_r_size; index_r++) {
+    psp->ln_r[index_r] = -ln_k_min-(N-1-pad)*dlnk + (pad+index_r)*dlnk;
+  }
+
+  /** - loop over tau values */
+
+  for (index_tau=0; index_tau<psp->ln_tau_size; index_tau++) {
+
+    /** - --> total ln P(k), summed over initial conditions as in spectra_pk_at_z() */
+
+    for (index_k=0; index_k<psp->ln_k_size; index_k++) {
+
+      if (psp->ic_size[index_md] == 1) {
+        ln_pk_tot[index_k] = psp->ln_pk[index_tau * psp->ln_k_size + index_k];
+      }
+      else {
+        for (index_ic1_ic2=0; index_ic1_ic2<ic_ic_size; index_ic1_ic2++) {
+          pk_ic[index_ic1_ic2] = psp->ln_pk[(index_tau * psp->ln_k_size + index_k) * ic_ic_size + index_ic1_ic2];
+        }
+        pk = 0.;
+        for (index_ic1=0; index_ic1 < psp->ic_size[index_md]; index_ic1++) {
+          for (index_ic2 = index_ic1; index_ic2 < psp->ic_size[index_md]; index_ic2++) {
+            index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,psp->ic_size[index_md]);
+            if (index_ic1 == index_ic2) {
+              pk += exp(pk_ic[index_ic1_ic2]);
+            }
+            else if (psp->is_non_zero[index_md][index_ic1_ic2] == _TRUE_) {
+              pk += 2. * pk_ic[index_ic1_ic2] *
+                sqrt(exp(pk_ic[index_symmetric_matrix(index_ic1,index_ic1,psp->ic_size[index_md])]) *
+                     exp(pk_ic[index_symmetric_matrix(index_ic2,index_ic2,psp->ic_size[index_md])]));
+            }
+          }
+        }
+        class_test(pk <= 0.,
+                   psp->error_message,
+                   "for k=%e, the matrix of initial condition amplitudes was not positive definite, hence P(k)_total=%e results negative",
+                   exp(psp->ln_k[index_k]),pk);
+        ln_pk_tot[index_k] = log(pk);
+      }
+    }
+
+    /** - --> resample it on the FFTLog grid, and extrapolate it as a power law */
+
+    class_call(array_spline_table_lines(psp->ln_k,
+                                        psp->ln_k_size,
+                                        ln_pk_tot,
+                                        1,
+                                        ddln_pk_tot,
+                                        _SPLINE_NATURAL_,
+                                        psp->error_message),
+               psp->error_message,
+               psp->error_message);
+
+    for (index_k=pad; index_k<pad+psp->ln_r_size; index_k++) {
+      ln_k = MIN(ln_k_min+(index_k-pad)*dlnk,ln_k_max);
+      class_call(array_interpolate_spline(psp->ln_k,
+                                          psp->ln_k_size,
+                                          ln_pk_tot,
+                                          ddln_pk_tot,
+                                          1,
+                                          ln_k,
+                                          &last_index,
+                                          &(ln_pk_fft[index_k]),
+                                          1,
+                                          psp->error_message),
+                 psp->error_message,
+                 psp->error_message);
+    }
+
+    slope_min = (ln_pk_fft[pad+1]-ln_pk_fft[pad])/dlnk;
+    slope_max = (ln_pk_fft[pad+psp->ln_r_size-1]-ln_pk_fft[pad+psp->ln_r_size-2])/dlnk;
+
+    for (index_k=0; index_k<N; index_k++) {
+
+      ln_k = ln_k_min+(index_k-pad)*dlnk;
+
+      if (index_k < pad) {
+        ln_pk_fft[index_k] = ln_pk_fft[pad] + slope_min*(index_k-pad)*dlnk;
+        taper = 0.5*(1.-cos(_PI_*index_k/pad));
+      }
+      else if (index_k >= pad+psp->ln_r_size) {
+        ln_pk_fft[index_k] = ln_pk_fft[pad+psp->ln_r_size-1] + slope_max*(index_k-pad-psp->ln_r_size+1)*dlnk;
+        taper = 0.5*(1.-cos(_PI_*(N-1-index_k)/(N-pad-psp->ln_r_size)));
+      }
+      else {
+        taper = 1.;
+      }
+
+      delta2[index_k] = exp(3.*ln_k+ln_pk_fft[index_k])/(2.*_PI_*_PI_)*taper;
+    }
+
+    /** - --> transforms */
+
+    class_call(fftlog_execute(&fp_xi,delta2,result,psp->error_message),
+               psp->error_message,
+               psp->error_message);
+
+    for (index_r=0; index_r<psp->ln_r_size; index_r++) {
+      psp->xi[index_tau*psp->ln_r_size+index_r] = result[pad+index_r];
+    }
+
+    class_call(fftlog_execute(&fp_sigma,delta2,result,psp->error_message),
+               psp->error_message,
+               psp->error_message);
+
+    for (index_r=0; index_r<psp->ln_r_size; index_r++) {
+      psp->sigma_r[index_tau*psp->ln_r_size+index_r] = sqrt(MAX(result[pad+index_r],0.));
+    }
+  }
+
+  /** - spline the tables with respect to ln(tau) */
+
+  if (psp->ln_tau_size > 1) {
+
+    class_alloc(psp->ddxi,psp->ln_tau_size*psp->ln_r_size*sizeof(double),psp->error_message);
+    class_alloc(psp->ddsigma_r,psp->ln_tau_size*psp->ln_r_size*sizeof(double),psp->error_message);
+
+    class_call(array_spline_table_lines(psp->ln_tau,
+                                        psp->ln_tau_size,
+                                        psp->xi,
+                                        psp->ln_r_size,
+                                        psp->ddxi,
+                                        _SPLINE_EST_DERIV_,
+                                        psp->error_message),
+               psp->error_message,
+               psp->error_message);
+
+    class_call(array_spline_table_lines(psp->ln_tau,
+                                        psp->ln_tau_size,
+                                        psp->sigma_r,
+                                        psp->ln_r_size,
+                                        psp->ddsigma_r,
+                                        _SPLINE_EST_DERIV_,
+                                        psp->error_message),
+               psp->error_message,
+               psp->error_message);
+  }
+
+  fftlog_plan_free(&fp_xi);
+  fftlog_plan_free(&fp_sigma);
+
+  free(ln_pk_tot);
+  free(ddln_pk_tot);
+  free(ln_pk_fft);
+  free(delta2);
+  free(result);
+  free(pk_ic);
+
+  return _SUCCESS_;
+
+}
+
 /**
  * This routine computes sigma(R) given P(k) (does not check that k_max is large
  * enough)
@@ -2789,8 +3674,8 @@ int spectra_sigma(
                   double * sigma
                   ) {
 
-  double pk;
-  double * pk_ic = NULL;
+  double * k_array;
+  double * pk_array;
 
   double * array_for_sigma;
   int index_num;
@@ -2801,11 +3686,6 @@ int spectra_sigma(
 
   double k,W,x;
 
-  if (psp->ic_ic_size[psp->index_md_scalars]>1)
-    class_alloc(pk_ic,
-                psp->ic_ic_size[psp->index_md_scalars]*sizeof(double),
-                psp->error_message);
-
   i=0;
   index_k=i;
   i++;
@@ -2819,18 +3699,34 @@ int spectra_sigma(
               psp->ln_k_size*index_num*sizeof(double),
               psp->error_message);
 
+  class_alloc(k_array,
+              psp->ln_k_size*sizeof(double),
+              psp->error_message);
+  class_alloc(pk_array,
+              psp->ln_k_size*sizeof(double),
+              psp->error_message);
+
   for (i=0;i<psp->ln_k_size;i++) {
-    k=exp(psp->ln_k[i]);
-    if (i == (psp->ln_k_size-1)) k *= 0.9999999; // to prevent rounding error leading to k being bigger than maximum value
+    k_array[i]=exp(psp->ln_k[i]);
+    if (i == (psp->ln_k_size-1)) k_array[i] *= 0.9999999; // to prevent rounding error leading to k being bigger than maximum value
+  }
+
+  /* the spectrum at z is interpolated in time once for all k */
+  class_call(spectra_pk_at_k_and_z_vector(pba,ppm,psp,_FALSE_,k_array,psp->ln_k_size,&z,1,pk_array),
+             psp->error_message,
+             psp->error_message);
+
+  for (i=0;i<psp->ln_k_size;i++) {
+    k=k_array[i];
     x=k*R;
     W=3./x/x/x*(sin(x)-x*cos(x));
-    class_call(spectra_pk_at_k_and_z(pba,ppm,psp,k,z,&pk,pk_ic),
-               psp->error_message,
-               psp->error_message);
     array_for_sigma[i*index_num+index_k]=k;
-    array_for_sigma[i*index_num+index_y]=k*k*pk*W*W;
+    array_for_sigma[i*index_num+index_y]=k*k*pk_array[i]*W*W;
   }
 
+  free(k_array);
+  free(pk_array);
+
   class_call(array_spline(array_for_sigma,
                           index_num,
                           psp->ln_k_size,
@@ -2855,9 +3751,6 @@ int spectra_sigma(
 
   free(array_for_sigma);
 
-  if (psp->ic_ic_size[psp->index_md_scalars]>1)
-    free(pk_ic);
-
   *sigma = sqrt(*sigma/(2.*_PI_*_PI_));
 
   return _SUCCESS_;
@@ -2942,7 +3835,7 @@ int spectra_matter_transfers(
 
           delta_i = ppt->sources[index_md]
             [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_g]
-            [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
           psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_g] = delta_i;
 
@@ -2956,7 +3849,7 @@ int spectra_matter_transfers(
 
           theta_i = ppt->sources[index_md]
             [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_g]
-            [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
           psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_g] = theta_i;
 
@@ -2974,7 +3867,7 @@ int spectra_matter_transfers(
 
           delta_i = ppt->sources[index_md]
             [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_b]
-            [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
           psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_b] = delta_i;
 
@@ -2988,7 +3881,7 @@ int spectra_matter_transfers(
 
           theta_i = ppt->sources[index_md]
             [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_b]
-            [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
           psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_b] = theta_i;
 
@@ -3008,7 +3901,7 @@ int spectra_matter_transfers(
 
             delta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_cdm]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_cdm] = delta_i;
 
@@ -3022,7 +3915,7 @@ int spectra_matter_transfers(
 
             theta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_cdm]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_cdm] = theta_i;
 
@@ -3044,7 +3937,7 @@ int spectra_matter_transfers(
 
             delta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_dcdm]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_dcdm] = delta_i;
 
@@ -3058,7 +3951,7 @@ int spectra_matter_transfers(
 
             theta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_dcdm]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_dcdm] = theta_i;
 
@@ -3080,7 +3973,7 @@ int spectra_matter_transfers(
 
             delta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_scf]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_scf] = delta_i;
 
@@ -3094,7 +3987,7 @@ int spectra_matter_transfers(
 
             theta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_scf]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_scf] = theta_i;
 
@@ -3117,7 +4010,7 @@ int spectra_matter_transfers(
 
             delta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_fld]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_fld] = delta_i;
 
@@ -3131,7 +4024,7 @@ int spectra_matter_transfers(
 
             theta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_fld]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_fld] = theta_i;
 
@@ -3153,7 +4046,7 @@ int spectra_matter_transfers(
 
             delta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_ur]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_ur] = delta_i;
 
@@ -3167,7 +4060,7 @@ int spectra_matter_transfers(
 
             theta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_ur]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_ur] = theta_i;
 
@@ -3189,7 +4082,7 @@ int spectra_matter_transfers(
 
             delta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_dr]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_dr] = delta_i;
 
@@ -3203,7 +4096,7 @@ int spectra_matter_transfers(
 
             theta_i = ppt->sources[index_md]
               [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_dr]
-              [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+              [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
             psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_dr] = theta_i;
 
@@ -3227,7 +4120,7 @@ int spectra_matter_transfers(
 
               delta_i = ppt->sources[index_md]
                 [index_ic * ppt->tp_size[index_md] + ppt->index_tp_delta_ncdm1+n_ncdm]
-                [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+                [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
               psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_delta_ncdm1+n_ncdm] = delta_i;
 
@@ -3241,7 +4134,7 @@ int spectra_matter_transfers(
 
               theta_i = ppt->sources[index_md]
                 [index_ic * ppt->tp_size[index_md] + ppt->index_tp_theta_ncdm1+n_ncdm]
-                [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+                [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
               psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_theta_ncdm1+n_ncdm] = theta_i;
 
@@ -3259,7 +4152,7 @@ int spectra_matter_transfers(
 
           psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_phi] = ppt->sources[index_md]
             [index_ic * ppt->tp_size[index_md] + ppt->index_tp_phi]
-            [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
         }
 
@@ -3267,7 +4160,7 @@ int spectra_matter_transfers(
 
           psp->matter_transfer[((index_tau*psp->ln_k_size + index_k) * psp->ic_size[index_md] + index_ic) * psp->tr_size + psp->index_tr_psi] = ppt->sources[index_md]
             [index_ic * ppt->tp_size[index_md] + ppt->index_tp_psi]
-            [(index_tau-psp->ln_tau_size+ppt->tau_size) * ppt->k_size[index_md] + index_k];
+            [_source_index_(index_tau-psp->ln_tau_size+ppt->tau_size,index_k)];
 
         }
 
@@ -73,9 +73,60 @@
  */
 
 #include "thermodynamics.h"
+#include "evolver_ndf15.h"
 
 #ifdef HYREC
 #include "hyrec.h"
+#include "shared_table.h"
+
+/**
+ * HyRec effective rates and two-photon tables (only doubles, so that
+ * they can be stored in a shared_table)
+ */
+
+struct hyrec_table_data {
+
+  double logAlpha[2][NTM][NTR];    /**< logarithm of effective recombination coefficients to 2s and 2p */
+  double logR2p2s[NTR];            /**< logarithm of effective transfer rate R_{2p,2s} */
+  TWO_PHOTON_PARAMS twog_params;   /**< two-photon rates, with 2s--1s decay rate normalized to L2s1s */
+
+};
+
+/**
+ * Names of the files from which the HyRec tables are read, used as a
+ * key for sharing them between processes
+ */
+
+struct hyrec_tables_key {
+
+  FileName Alpha_inf_file;         /**< file from which logAlpha was read */
+  FileName R_inf_file;             /**< file from which logR2p2s was read */
+  FileName two_photon_tables_file; /**< file from which twog_params was read */
+  int sizes[3];                    /**< dimensions NTR, NTM and NVIRT of the tables */
+
+};
+
+/**
+ * HyRec tables, read once per process for each set of file names, and
+ * never modified afterwards: all runs and threads share them (see
+ * thermodynamics_hyrec_tables()), and they can also be shared between
+ * processes (see shared_table_get()).
+ */
+
+struct hyrec_tables {
+
+  struct hyrec_tables_key key;     /**< files from which the tables were read */
+  struct shared_table shared;      /**< storage of the tables */
+  struct hyrec_table_data * data;  /**< the tables, inside shared */
+
+  struct hyrec_tables * next;      /**< next set of tables read in this process */
+
+};
+
+/** list of all sets of tables read in this process */
+
+static struct hyrec_tables * hyrec_tables_list = NULL;
+
 #endif
 
 /**
@@ -200,7 +251,26 @@ int thermodynamics_at_z(
     /* in the "normal" case, use spline interpolation */
     else {
 
-      if (inter_mode == pth->inter_normal) {
+      if ((inter_mode == pth->inter_normal) && (pth->z_lookup.index != NULL)) {
+
+        class_call(array_interpolate_spline_lookup(
+                                                   &(pth->z_lookup),
+                                                   pth->z_table,
+                                                   pth->tt_size,
+                                                   pth->thermodynamics_table,
+                                                   pth->d2thermodynamics_dz2_table,
+                                                   pth->th_size,
+                                                   z,
+                                                   z,
+                                                   last_index,
+                                                   pvecthermo,
+                                                   pth->th_size,
+                                                   pth->error_message),
+                   pth->error_message,
+                   pth->error_message);
+      }
+
+      else if (inter_mode == pth->inter_normal) {
 
         class_call(array_interpolate_spline(
                                             pth->z_table,
@@ -239,6 +309,86 @@ int thermodynamics_at_z(
   return _SUCCESS_;
 }
 
+/**
+ * Thermodynamics quantities at several redshifts.
+ *
+ * Same as calling thermodynamics_at_z() for each z[i], but when the
+ * redshifts are sorted (in growing or decreasing order) the position
+ * found in the table for each of them is the starting point of the
+ * search for the next one. The background quantities needed above
+ * the largest redshift of the table are computed internally.
+ *
+ * @param pba              Input: pointer to background structure
+ * @param pth              Input: pointer to the thermodynamics structure (containing pre-computed table)
+ * @param z                Input: redshifts, sorted or not
+ * @param z_size           Input: number of redshifts
+ * @param pvecthermo_table Output: table pvecthermo_table[i*pth->th_size+index_th] (must be already allocated)
+ * @return the error status
+ */
+
+int thermodynamics_at_z_vector(
+                               struct background * pba,
+                               struct thermo * pth,
+                               double * z,
+                               int z_size,
+                               double * pvecthermo_table
+                               ) {
+
+  int i;
+  int last_index=0;
+  int last_index_back=0;
+  short growing=_TRUE_,decreasing=_TRUE_;
+  short inter_mode;
+  double tau;
+  double * pvecback;
+
+  class_alloc(pvecback,pba->bg_size*sizeof(double),pth->error_message);
+
+  for (i=1; i<z_size; i++) {
+    if (z[i] < z[i-1]) growing = _FALSE_;
+    if (z[i] > z[i-1]) decreasing = _FALSE_;
+  }
+
+  for (i=0; i<z_size; i++) {
+
+    /* background quantities are only used above the table */
+    if (z[i] >= pth->z_table[pth->tt_size-1]) {
+
+      class_call(background_tau_of_z(pba,z[i],&tau),
+                 pba->error_message,
+                 pth->error_message);
+
+      class_call(background_at_tau(pba,
+                                   tau,
+                                   pba->normal_info,
+                                   pba->inter_normal,
+                                   &last_index_back,
+                                   pvecback),
+                 pba->error_message,
+                 pth->error_message);
+    }
+
+    if ((i > 0) && ((growing == _TRUE_) || (decreasing == _TRUE_)))
+      inter_mode = pth->inter_closeby;
+    else
+      inter_mode = pth->inter_normal;
+
+    class_call(thermodynamics_at_z(pba,
+                                   pth,
+                                   z[i],
+                                   inter_mode,
+                                   &last_index,
+                                   pvecback,
+                                   pvecthermo_table+i*pth->th_size),
+               pth->error_message,
+               pth->error_message);
+  }
+
+  free(pvecback);
+
+  return _SUCCESS_;
+}
+
 /**
  * Initialize the thermo structure, and in particular the
  * thermodynamics interpolation table.
@@ -266,6 +416,13 @@ int thermodynamics_init(
   double * pvecback;
   /* index for calling background_at_tau() */
   int last_index_back;
+  /* same for each thread, in the parallel passes over the table */
+  double * pvecback_thread;
+  int last_index_thread;
+  /* error flag for these parallel passes */
+  int abort;
+  /* interval between two lines of the table, for the derivative of dkappa */
+  double h;
   /* temporary table of values of tau associated with z values in pth->z_table */
   double * tau_table;
   /* same ordered in growing time rather than growing redshift */
@@ -283,11 +440,16 @@ int thermodynamics_init(
   double g_max;
   int index_tau_max;
 
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(pth->profile));
+
   /** - initialize pointers, allocate background vector */
 
   preco=&reco;
   preio=&reio;
   class_alloc(pvecback,pba->bg_size*sizeof(double),pba->error_message);
+  pth->z_lookup.index = NULL;
 
   if (pth->thermodynamics_verbose > 0)
     printf("Computing thermodynamics");
@@ -405,45 +567,66 @@ int thermodynamics_init(
              pth->error_message,
              pth->error_message);
 
-  /** - compute table of corresponding conformal times */
+  /** - compute table of corresponding conformal times, and fill
+      the first missing column (quantities not computed previously
+      but related): baryon drag interaction rate time minus one,
+      -[R * kappa'], stored temporarily in column ddkappa. Both are
+      obtained in a single pass over the table, shared between
+      threads for large tables (each thread with its own background
+      vector and interpolation index) */
 
   class_alloc(tau_table,pth->tt_size*sizeof(double),pth->error_message);
 
-  for (index_tau=0; index_tau < pth->tt_size; index_tau++) {
-    class_call(background_tau_of_z(pba,
-                                   pth->z_table[index_tau],
-                                   tau_table+index_tau),
-               pba->error_message,
-               pth->error_message);
-  }
+  abort = _FALSE_;
 
-  /** - store initial value of conformal time in the structure */
+#pragma omp parallel                                    \
+  shared(pba,pth,tau_table,abort)                       \
+  private(index_tau,pvecback_thread,last_index_thread)  \
+  if (pth->tt_size >= _THERMO_TABLE_PARALLEL_MIN_SIZE_)
+  {
+    class_alloc_parallel(pvecback_thread,pba->bg_size*sizeof(double),pth->error_message);
 
-  pth->tau_ini = tau_table[pth->tt_size-1];
+    last_index_thread = pba->bg_size-1;
 
-  /** - fill missing columns (quantities not computed previously but related) */
+#pragma omp for schedule (static)
+    for (index_tau=0; index_tau < pth->tt_size; index_tau++) {
 
-  /** - --> baryon drag interaction rate time minus one, -[R * kappa'], stored temporarily in column ddkappa */
+      if (abort == _TRUE_) continue;
 
-  last_index_back = pba->bg_size-1;
+      class_call_parallel(background_tau_of_z(pba,
+                                              pth->z_table[index_tau],
+                                              tau_table+index_tau),
+                          pba->error_message,
+                          pth->error_message);
 
-  for (index_tau=0; index_tau < pth->tt_size; index_tau++) {
+      class_call_parallel(background_at_tau(pba,
+                                            tau_table[index_tau],
+                                            pba->normal_info,
+                                            pba->inter_closeby,
+                                            &last_index_thread,
+                                            pvecback_thread),
+                          pba->error_message,
+                          pth->error_message);
 
-    class_call(background_at_tau(pba,
-                                 tau_table[index_tau],
-                                 pba->normal_info,
-                                 pba->inter_closeby,
-                                 &last_index_back,
-                                 pvecback),
-               pba->error_message,
-               pth->error_message);
+      if (abort == _TRUE_) continue;
+
+      pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_ddkappa] =
+        -4./3.*pvecback_thread[pba->index_bg_rho_g]/pvecback_thread[pba->index_bg_rho_b]
+        *pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa];
+    }
 
-    pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_ddkappa] =
-      -4./3.*pvecback[pba->index_bg_rho_g]/pvecback[pba->index_bg_rho_b]
-      *pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa];
+    free(pvecback_thread);
+  }
 
+  if (abort == _TRUE_) {
+    free(tau_table);
+    return _FAILURE_;
   }
 
+  /** - store initial value of conformal time in the structure */
+
+  pth->tau_ini = tau_table[pth->tt_size-1];
+
   /** - --> second derivative of this rate, -[R * kappa']'', stored temporarily in column dddkappa */
   class_call(array_spline_table_line_to_line(tau_table,
                                              pth->tt_size,
@@ -542,18 +725,6 @@ int thermodynamics_init(
              pth->error_message,
              pth->error_message);
 
-  /** - --> first derivative with respect to tau of dkappa (using spline interpolation) */
-  class_call(array_derive_spline_table_line_to_line(tau_table,
-                                                    pth->tt_size,
-                                                    pth->thermodynamics_table,
-                                                    pth->th_size,
-                                                    pth->index_th_dkappa,
-                                                    pth->index_th_dddkappa,
-                                                    pth->index_th_ddkappa,
-                                                    pth->error_message),
-             pth->error_message,
-             pth->error_message);
-
   /** - --> compute -kappa = [int_{tau_today}^{tau} dtau dkappa/dtau], store temporarily in column "g" */
   class_call(array_integrate_spline_table_line_to_line(tau_table,
                                                        pth->tt_size,
@@ -595,13 +766,51 @@ int thermodynamics_init(
                pth->error_message);
   }
 
-  free(tau_table);
+  /** - --> compute visibility: \f$ g= (d \kappa/d \tau) e^{- \kappa} \f$,
+      in a single pass over the table computing also the first
+      derivative with respect to tau of dkappa (using spline
+      interpolation, like array_derive_spline_table_line_to_line()),
+      exp(-kappa), g', g'' and the variation rate, shared between
+      threads for large tables */
 
-  /** - --> compute visibility: \f$ g= (d \kappa/d \tau) e^{- \kappa} \f$ */
+  abort = _FALSE_;
 
-  /* loop on z (decreasing z, increasing time) */
+#pragma omp parallel for schedule (static)              \
+  shared(pth,tau_table,abort)                           \
+  private(index_tau,g,h)                                \
+  if (pth->tt_size >= _THERMO_TABLE_PARALLEL_MIN_SIZE_)
   for (index_tau=pth->tt_size-1; index_tau>=0; index_tau--) {
 
+    if (abort == _TRUE_) continue;
+
+    /** - ---> compute kappa'' from the spline of kappa' */
+    if (index_tau < pth->tt_size-1) {
+
+      h = tau_table[index_tau+1] - tau_table[index_tau];
+
+      class_test_parallel(h == 0.,
+                          pth->error_message,
+                          "h=0, stop to avoid division by zero");
+
+      pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_ddkappa] =
+        (pth->thermodynamics_table[(index_tau+1)*pth->th_size+pth->index_th_dkappa] -
+         pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa])/h
+        - h / 6. * (pth->thermodynamics_table[(index_tau+1)*pth->th_size+pth->index_th_dddkappa] +
+                    2. * pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dddkappa]);
+    }
+    else {
+
+      h = tau_table[index_tau] - tau_table[index_tau-1];
+
+      pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_ddkappa] =
+        (pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa] -
+         pth->thermodynamics_table[(index_tau-1)*pth->th_size+pth->index_th_dkappa])/h
+        + h / 6. * (2. * pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dddkappa] +
+                    pth->thermodynamics_table[(index_tau-1)*pth->th_size+pth->index_th_dddkappa]);
+    }
+
+    if (abort == _TRUE_) continue;
+
     /** - ---> compute g */
     g = pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa] *
       exp(pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_g]);
@@ -631,9 +840,11 @@ int thermodynamics_init(
     pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_g] = g;
 
     /** - ---> compute variation rate */
-    class_test(pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa] == 0.,
-               pth->error_message,
-               "variation rate diverges");
+    class_test_parallel(pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa] == 0.,
+                        pth->error_message,
+                        "variation rate diverges");
+
+    if (abort == _TRUE_) continue;
 
     pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_rate] =
       sqrt(pow(pth->thermodynamics_table[index_tau*pth->th_size+pth->index_th_dkappa],2)
@@ -644,6 +855,10 @@ int thermodynamics_init(
 
   }
 
+  free(tau_table);
+
+  if (abort == _TRUE_) return _FAILURE_;
+
   /** - smooth the rate (details of smoothing unimportant: only the
       order of magnitude of the rate matters) */
   class_call(array_smooth(pth->thermodynamics_table,
@@ -667,6 +882,17 @@ int thermodynamics_init(
              pth->error_message,
              pth->error_message);
 
+  /** - build a uniform grid in z for finding positions in these tables */
+  if (ppr->uniform_grid_lookup == _TRUE_) {
+    class_call(array_lookup_init(pth->z_table,
+                                 pth->tt_size,
+                                 _LOOKUP_MAX_BINS_PER_LINE_*pth->tt_size,
+                                 &(pth->z_lookup),
+                                 pth->error_message),
+               pth->error_message,
+               pth->error_message);
+  }
+
   /** - find maximum of g */
 
   index_tau=pth->tt_size-1;
@@ -817,6 +1043,7 @@ int thermodynamics_init(
 
   free(pvecback);
 
+  class_profile_stop(&(pth->profile));
   return _SUCCESS_;
 }
 
@@ -835,6 +1062,7 @@ int thermodynamics_free(
   free(pth->z_table);
   free(pth->thermodynamics_table);
   free(pth->d2thermodynamics_dz2_table);
+  array_lookup_free(&(pth->z_lookup));
 
   return _SUCCESS_;
 }
@@ -2148,6 +2376,12 @@ int thermodynamics_reionization_sample(
   reio_vector[preio->index_re_z]=z;
   preio->index_reco_when_reio_start=i;
 
+  /** - --> reserve room in the growTable for at least one row per step of the thermodynamics table until z=0 (the maximum step below) */
+  class_call(gt_reserve(&gTable,
+                        (long)(z/(z-preco->recombination_table[(i-1)*preco->re_size+preco->index_re_z])+2.)*preio->re_size*sizeof(double)),
+             gTable.error_message,
+             pth->error_message);
+
   /** - --> get \f$ X_e \f$ */
   class_call(thermodynamics_reionization_function(z,pth,preio,&xe),
              pth->error_message,
@@ -2411,6 +2645,18 @@ int thermodynamics_reionization_sample(
 /**
  * Integrate thermodynamics with your favorite recombination code.
  *
+ * If pth->recombination_cache is not NULL, the recombination history
+ * is first searched in this cache, and the history which is computed
+ * otherwise is stored there. If pth->recombination_response is not
+ * NULL, a RECFAST history may then be obtained from its linear
+ * expansion around a fiducial model instead of an integration.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input/Output: pointer to thermodynamics structure
+ * @param preco    Output: pointer to recombination structure
+ * @param pvecback Input: pointer to an allocated (but empty) vector of background variables
+ * @return the error status
  */
 
 int thermodynamics_recombination(
@@ -2421,200 +2667,848 @@ int thermodynamics_recombination(
                                  double * pvecback
                                  ) {
 
-  if (pth->recombination==hyrec) {
+  struct recombination_cache * cache;
+  struct recombination_response * response;
+  double key[_RECOMBINATION_CACHE_KEY_SIZE_];
+  double response_key[_RECOMBINATION_CACHE_KEY_SIZE_];
+  double ln_param[_RECOMBINATION_RESPONSE_PARAMETERS_];
+  unsigned long long hash=0;
+  int index_entry,index_lru,index_param,i;
+  short same_key,usable=_FALSE_,computed=_FALSE_;
+  size_t table_size;
 
-    class_call(thermodynamics_recombination_with_hyrec(ppr,pba,pth,preco,pvecback),
-               pth->error_message,
-               pth->error_message);
+  cache = pth->recombination_cache;
+  response = pth->recombination_response;
 
-  }
+  /** - look for a history computed with the same inputs in the cache */
 
-  if (pth->recombination==recfast) {
+  if (cache != NULL) {
 
-    class_call(thermodynamics_recombination_with_recfast(ppr,pba,pth,preco,pvecback),
+    class_call(thermodynamics_recombination_cache_key(ppr,pba,pth,_FALSE_,key,&hash),
                pth->error_message,
                pth->error_message);
 
-  }
+    cache->clock++;
 
-  return _SUCCESS_;
+    for (index_entry=0; index_entry<cache->number; index_entry++) {
 
-}
+      if (cache->hash[index_entry] != hash)
+        continue;
 
-/**
- * Integrate thermodynamics with HyRec.
- *
- * Integrate thermodynamics with HyRec, allocate and fill the part
- * of the thermodynamics interpolation table (the rest is filled in
- * thermodynamics_init()). Called once by
- * thermodynamics_recombination(), from thermodynamics_init().
- *
- *************************************************************************************************
- *                 HYREC: Hydrogen and Helium Recombination Code
- *         Written by Yacine Ali-Haimoud and Chris Hirata (Caltech)
- *************************************************************************************************
- *
- *
- * @param ppr      Input: pointer to precision structure
- * @param pba      Input: pointer to background structure
- * @param pth      Input: pointer to thermodynamics structure
- * @param preco    Output: pointer to recombination structure
- * @param pvecback Input: pointer to an allocated (but empty) vector of background variables
- */
+      same_key = _TRUE_;
+      for (i=0; i<_RECOMBINATION_CACHE_KEY_SIZE_; i++)
+        if (cache->key[index_entry*_RECOMBINATION_CACHE_KEY_SIZE_+i] != key[i])
+          same_key = _FALSE_;
 
-int thermodynamics_recombination_with_hyrec(
-                                            struct precision * ppr,
-                                            struct background * pba,
-                                            struct thermo * pth,
-                                            struct recombination * preco,
-                                            double * pvecback
-                                            ) {
-  /** Summary: */
-#ifdef HYREC
+      if (same_key == _TRUE_) {
 
-  REC_COSMOPARAMS param;
-  HRATEEFF rate_table;
-  TWO_PHOTON_PARAMS twog_params;
-  double *xe_output, *Tm_output;
-  int i,j,l,Nz,b;
-  double z, xe, Tm, Hz;
-  FILE *fA;
-  FILE *fR;
-  double L2s1s_current;
-  void * buffer;
-  int buf_size;
-  double tau;
-  int last_index_back;
+        table_size = cache->reco[index_entry].rt_size*cache->reco[index_entry].re_size*sizeof(double);
 
-  /** - Fill hyrec parameter structure */
+        *preco = cache->reco[index_entry];
+        class_alloc(preco->recombination_table,table_size,pth->error_message);
+        memcpy(preco->recombination_table,cache->reco[index_entry].recombination_table,table_size);
 
-  param.T0 = pba->T_cmb;
-  param.obh2 = pba->Omega0_b*pba->h*pba->h;
-  param.omh2 = (pba->Omega0_b+pba->Omega0_cdm+pba->Omega0_ncdm_tot)*pba->h*pba->h;
-  param.okh2 = pba->Omega0_k*pba->h*pba->h;
-  param.odeh2 = (pba->Omega0_lambda+pba->Omega0_fld)*pba->h*pba->h;
-  param.w0 = pba->w0_fld;
-  param.wa = pba->wa_fld;
-  param.Y = pth->YHe;
-  param.Nnueff = pba->Neff;
-  param.nH0 = 11.223846333047*param.obh2*(1.-param.Y);  /* number density of hydrogen today in m-3 */
-  param.fHe = param.Y/(1-param.Y)/3.97153;              /* abundance of helium by number */
-  param.zstart = ppr->recfast_z_initial; /* Redshift range */
-  param.zend = 0.;
-  param.dlna = 8.49e-5;
-  param.nz = (long) floor(2+log((1.+param.zstart)/(1.+param.zend))/param.dlna);
-  param.annihilation = pth->annihilation;
-  param.has_on_the_spot = pth->has_on_the_spot;
-  param.decay = pth->decay;
-  param.annihilation_variation = pth->annihilation_variation;
-  param.annihilation_z = pth->annihilation_z;
-  param.annihilation_zmax = pth->annihilation_zmax;
-  param.annihilation_zmin = pth->annihilation_zmin;
-  param.annihilation_f_halo = pth->annihilation_f_halo;
-  param.annihilation_z_halo = pth->annihilation_z_halo;
+        pth->n_e = cache->n_e[index_entry];
 
-  /** - Build effective rate tables */
+        cache->last_use[index_entry] = cache->clock;
+        cache->hits++;
 
-  /* allocate contiguous memory zone */
+        if (pth->thermodynamics_verbose > 1)
+          printf(" -> recombination history taken from cache (%d hits, %d misses)\n",cache->hits,cache->misses);
 
-  buf_size = (2*NTR+NTM+2*NTR*NTM+2*param.nz)*sizeof(double) + 2*NTM*sizeof(double*);
+        return _SUCCESS_;
+      }
+    }
 
-  class_alloc(buffer,
-              buf_size,
-              pth->error_message);
+    cache->misses++;
+  }
 
-  /** - distribute addresses for each table */
+  /** - otherwise, expand it around the fiducial RECFAST history of
+      pth->recombination_response when the other inputs are the same
+      and the parameters lie within the trust region */
 
-  rate_table.logTR_tab = (double*)buffer;
-  rate_table.TM_TR_tab = (double*)(rate_table.logTR_tab + NTR);
-  rate_table.logAlpha_tab[0] = (double**)(rate_table.TM_TR_tab+NTM);
-  rate_table.logAlpha_tab[1] = (double**)(rate_table.logAlpha_tab[0]+NTM);
-  rate_table.logAlpha_tab[0][0] = (double*)(rate_table.logAlpha_tab[1]+NTM);
-  for (j=1;j<NTM;j++) {
-    rate_table.logAlpha_tab[0][j] = (double*)(rate_table.logAlpha_tab[0][j-1]+NTR);
-  }
-  rate_table.logAlpha_tab[1][0] = (double*)(rate_table.logAlpha_tab[0][NTM-1]+NTR);
-  for (j=1;j<NTM;j++) {
-    rate_table.logAlpha_tab[1][j] = (double*)(rate_table.logAlpha_tab[1][j-1]+NTR);
-  }
-  rate_table.logR2p2s_tab = (double*)(rate_table.logAlpha_tab[1][NTM-1]+NTR);
+  if ((response != NULL) && (pth->recombination == recfast)) {
 
-  xe_output = (double*)(rate_table.logR2p2s_tab+NTR);
-  Tm_output = (double*)(xe_output+param.nz);
+    class_call(thermodynamics_recombination_response_parameters(ppr,pba,pth,response_key,ln_param,&usable),
+               pth->error_message,
+               pth->error_message);
 
-  /* store sampled values of temperatures */
+    if ((usable == _TRUE_) && (response->has_fiducial == _TRUE_)) {
 
-  for (i = 0; i < NTR; i++)
-    rate_table.logTR_tab[i] = log(TR_MIN) + i * (log(TR_MAX)-log(TR_MIN))/(NTR-1.);
-  for (i = 0; i < NTM; i++)
-    rate_table.TM_TR_tab[i] = TM_TR_MIN + i * (TM_TR_MAX-TM_TR_MIN)/(NTM-1.);
+      same_key = _TRUE_;
+      for (i=0; i<_RECOMBINATION_CACHE_KEY_SIZE_; i++)
+        if (fabs(response->key[i]-response_key[i]) > _RECOMBINATION_RESPONSE_TOLERANCE_*fabs(response->key[i]))
+          same_key = _FALSE_;
 
-  rate_table.DlogTR = rate_table.logTR_tab[1] - rate_table.logTR_tab[0];
-  rate_table.DTM_TR = rate_table.TM_TR_tab[1] - rate_table.TM_TR_tab[0];
+      for (index_param=0; index_param<_RECOMBINATION_RESPONSE_PARAMETERS_; index_param++)
+        if (fabs(ln_param[index_param]-response->ln_param[index_param]) > response->trust_region)
+          same_key = _FALSE_;
 
-  /* read in file */
+      if ((response->vary_T_cmb == _FALSE_) && (ln_param[_RECOMBINATION_RESPONSE_PARAMETERS_-1] != response->ln_param[_RECOMBINATION_RESPONSE_PARAMETERS_-1]))
+        same_key = _FALSE_;
 
-  class_open(fA,ppr->hyrec_Alpha_inf_file, "r",pth->error_message);
-  class_open(fR,ppr->hyrec_R_inf_file, "r",pth->error_message);
+      if (same_key == _TRUE_) {
 
-  for (i = 0; i < NTR; i++) {
-    for (j = 0; j < NTM; j++) {
-      for (l = 0; l <= 1; l++) {
-        if (fscanf(fA, "%le", &(rate_table.logAlpha_tab[l][j][i])) != 1)
-          class_stop(pth->error_message,"Error reading hyrec data file %s",ppr->hyrec_Alpha_inf_file);
-        rate_table.logAlpha_tab[l][j][i] = log(rate_table.logAlpha_tab[l][j][i]);
-      }
-    }
+        class_call(thermodynamics_recombination_response_apply(ppr,pba,pth,preco,response,ln_param),
+                   pth->error_message,
+                   pth->error_message);
 
-    if (fscanf(fR, "%le", &(rate_table.logR2p2s_tab[i])) !=1)
-      class_stop(pth->error_message,"Error reading hyrec data file %s",ppr->hyrec_R_inf_file);
-    rate_table.logR2p2s_tab[i] = log(rate_table.logR2p2s_tab[i]);
+        response->hits++;
+        computed = _TRUE_;
 
+        if (pth->thermodynamics_verbose > 1)
+          printf(" -> recombination history expanded around fiducial model (%d hits, %d fallbacks)\n",response->hits,response->fallbacks);
+      }
+      else {
+        response->fallbacks++;
+      }
+    }
   }
-  fclose(fA);
-  fclose(fR);
 
-  /* Read two-photon rate tables */
+  /** - or compute it */
 
-  class_open(fA,ppr->hyrec_two_photon_tables_file, "r",pth->error_message);
+  if (computed == _FALSE_) {
 
-  for (b = 0; b < NVIRT; b++) {
-    if ((fscanf(fA, "%le", &(twog_params.Eb_tab[b])) != 1) ||
-        (fscanf(fA, "%le", &(twog_params.A1s_tab[b])) != 1) ||
-        (fscanf(fA, "%le", &(twog_params.A2s_tab[b])) != 1) ||
-        (fscanf(fA, "%le", &(twog_params.A3s3d_tab[b])) != 1) ||
-        (fscanf(fA, "%le", &(twog_params.A4s4d_tab[b])) != 1))
-      class_stop(pth->error_message,"Error reading hyrec data file %s",ppr->hyrec_two_photon_tables_file);
-  }
+    if (pth->recombination==hyrec) {
 
-  fclose(fA);
+      class_call(thermodynamics_recombination_with_hyrec(ppr,pba,pth,preco,pvecback),
+                 pth->error_message,
+                 pth->error_message);
 
-  /** - Normalize 2s--1s differential decay rate to L2s1s (can be set by user in hydrogen.h) */
-  L2s1s_current = 0.;
-  for (b = 0; b < NSUBLYA; b++) L2s1s_current += twog_params.A2s_tab[b];
-  for (b = 0; b < NSUBLYA; b++) twog_params.A2s_tab[b] *= L2s1s/L2s1s_current;
+    }
 
-  /*  In CLASS, we have neutralized the switches for the various
-      effects considered in Hirata (2008), keeping the full
-      calculation as a default; but you could restore their
-      functionality by copying a few lines from hyrec/hyrec.c to
-      here */
+    if (pth->recombination==recfast) {
 
-  /** - Compute the recombination history by calling a function in hyrec (no CLASS-like error management here) */
+      class_call(thermodynamics_recombination_with_recfast(ppr,pba,pth,preco,pvecback),
+                 pth->error_message,
+                 pth->error_message);
 
-  if (pth->thermodynamics_verbose > 0)
-    printf(" -> calling HyRec version %s,\n",HYREC_VERSION);
+      /* the first usable history becomes the fiducial model of the response */
+      if ((response != NULL) && (usable == _TRUE_) && (response->has_fiducial == _FALSE_)) {
 
-  rec_build_history(&param, &rate_table, &twog_params, xe_output, Tm_output);
+        class_call(thermodynamics_recombination_response_build(ppr,pba,pth,preco,pvecback,response,response_key,ln_param),
+                   pth->error_message,
+                   pth->error_message);
 
-  if (pth->thermodynamics_verbose > 0)
-    printf("    by Y. Ali-Haïmoud & C. Hirata\n");
+      }
+    }
+  }
 
-  /** - fill a few parameters in preco and pth */
+  /** - and store it in the cache, in a free entry or in place of the
+      least recently used one */
 
-  Nz=ppr->recfast_Nz0;
+  if ((cache != NULL) && (cache->size > 0)) {
 
-  preco->rt_size = Nz;
+    if (cache->number < cache->size) {
+      index_lru = cache->number;
+      cache->number++;
+    }
+    else {
+      index_lru = 0;
+      for (index_entry=1; index_entry<cache->number; index_entry++)
+        if (cache->last_use[index_entry] < cache->last_use[index_lru])
+          index_lru = index_entry;
+      free(cache->reco[index_lru].recombination_table);
+    }
+
+    table_size = preco->rt_size*preco->re_size*sizeof(double);
+
+    cache->reco[index_lru] = *preco;
+    class_alloc(cache->reco[index_lru].recombination_table,table_size,pth->error_message);
+    memcpy(cache->reco[index_lru].recombination_table,preco->recombination_table,table_size);
+
+    for (i=0; i<_RECOMBINATION_CACHE_KEY_SIZE_; i++)
+      cache->key[index_lru*_RECOMBINATION_CACHE_KEY_SIZE_+i] = key[i];
+    cache->hash[index_lru] = hash;
+    cache->n_e[index_lru] = pth->n_e;
+    cache->last_use[index_lru] = cache->clock;
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Initialize a cache of recombination histories (see struct
+ * recombination_cache), which a caller can then attach to
+ * pth->recombination_cache before each call to thermodynamics_init().
+ *
+ * @param cache         Output: cache to be initialized
+ * @param size          Input: maximum number of histories kept
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_init(
+                                            struct recombination_cache * cache,
+                                            int size,
+                                            ErrorMsg error_message
+                                            ) {
+
+  class_test(size < 0,
+             error_message,
+             "the size of a recombination cache cannot be negative (%d)",size);
+
+  cache->size = size;
+  cache->number = 0;
+  cache->clock = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+
+  class_alloc(cache->key,MAX(size,1)*_RECOMBINATION_CACHE_KEY_SIZE_*sizeof(double),error_message);
+  class_alloc(cache->hash,MAX(size,1)*sizeof(unsigned long long),error_message);
+  class_alloc(cache->last_use,MAX(size,1)*sizeof(int),error_message);
+  class_alloc(cache->n_e,MAX(size,1)*sizeof(double),error_message);
+  class_alloc(cache->reco,MAX(size,1)*sizeof(struct recombination),error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free all histories kept in a cache. To be called once, after the
+ * last run using this cache.
+ *
+ * @param cache Input: cache to be freed
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_free(
+                                            struct recombination_cache * cache
+                                            ) {
+
+  int index_entry;
+
+  for (index_entry=0; index_entry<cache->number; index_entry++)
+    free(cache->reco[index_entry].recombination_table);
+
+  free(cache->key);
+  free(cache->hash);
+  free(cache->last_use);
+  free(cache->n_e);
+  free(cache->reco);
+
+  cache->size = 0;
+  cache->number = 0;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Summarize all the inputs of the recombination codes: the parameters
+ * read directly by thermodynamics_recombination_with_recfast(),
+ * thermodynamics_recombination_with_hyrec() and the functions they
+ * call, and, through a hash, the background tables from which they
+ * interpolate the expansion rate, and the names of the HyRec tables.
+ *
+ * With for_response set to _TRUE_, the parameters with respect to
+ * which a struct recombination_response is expanded (Omega0_b,
+ * Omega0_cdm, YHe and T_cmb), as well as Omega0_lambda which absorbs
+ * their variations, are set to zero in the key: the remaining entries
+ * are then the ones which must match the fiducial model.
+ *
+ * @param ppr          Input: pointer to precision structure
+ * @param pba          Input: pointer to background structure
+ * @param pth          Input: pointer to thermodynamics structure
+ * @param for_response Input: whether the key is used by a struct recombination_response
+ * @param key          Output: vector of _RECOMBINATION_CACHE_KEY_SIZE_ parameters
+ * @param hash         Output: hash of the background tables and file names
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_key(
+                                           struct precision * ppr,
+                                           struct background * pba,
+                                           struct thermo * pth,
+                                           short for_response,
+                                           double * key,
+                                           unsigned long long * hash
+                                           ) {
+
+  int i=0;
+
+  /* thermodynamics parameters */
+  key[i++] = pth->recombination;
+  key[i++] = (for_response == _TRUE_ ? 0. : pth->YHe);
+  key[i++] = pth->annihilation;
+  key[i++] = pth->annihilation_variation;
+  key[i++] = pth->annihilation_z;
+  key[i++] = pth->annihilation_zmax;
+  key[i++] = pth->annihilation_zmin;
+  key[i++] = pth->annihilation_f_halo;
+  key[i++] = pth->annihilation_z_halo;
+  key[i++] = pth->decay;
+  key[i++] = pth->has_on_the_spot;
+
+  /* background parameters */
+  key[i++] = pba->H0;
+  key[i++] = pba->h;
+  key[i++] = (for_response == _TRUE_ ? 0. : pba->Omega0_b);
+  key[i++] = (for_response == _TRUE_ ? 0. : pba->Omega0_cdm);
+  key[i++] = (for_response == _TRUE_ ? 0. : pba->T_cmb);
+  key[i++] = pba->Neff;
+  key[i++] = pba->Omega0_fld;
+  key[i++] = pba->Omega0_k;
+  key[i++] = (for_response == _TRUE_ ? 0. : pba->Omega0_lambda);
+  key[i++] = pba->Omega0_ncdm_tot;
+  key[i++] = pba->w0_fld;
+  key[i++] = pba->wa_fld;
+
+  /* precision parameters */
+  key[i++] = ppr->recfast_Nz0;
+  key[i++] = ppr->recfast_z_initial;
+  key[i++] = ppr->recfast_H_frac;
+  key[i++] = ppr->recfast_Hswitch;
+  key[i++] = ppr->recfast_Heswitch;
+  key[i++] = ppr->recfast_fudge_H;
+  key[i++] = ppr->recfast_delta_fudge_H;
+  key[i++] = ppr->recfast_fudge_He;
+  key[i++] = ppr->recfast_AGauss1;
+  key[i++] = ppr->recfast_AGauss2;
+  key[i++] = ppr->recfast_zGauss1;
+  key[i++] = ppr->recfast_zGauss2;
+  key[i++] = ppr->recfast_wGauss1;
+  key[i++] = ppr->recfast_wGauss2;
+  key[i++] = ppr->recfast_x_H0_trigger;
+  key[i++] = ppr->recfast_x_H0_trigger_delta;
+  key[i++] = ppr->recfast_x_He0_trigger;
+  key[i++] = ppr->recfast_x_He0_trigger2;
+  key[i++] = ppr->recfast_x_He0_trigger_delta;
+  key[i++] = ppr->recfast_z_He_1;
+  key[i++] = ppr->recfast_z_He_2;
+  key[i++] = ppr->recfast_z_He_3;
+  key[i++] = ppr->recfast_delta_z_He_1;
+  key[i++] = ppr->recfast_delta_z_He_2;
+  key[i++] = ppr->recfast_delta_z_He_3;
+  key[i++] = ppr->tol_thermo_integration;
+  key[i++] = ppr->recfast_evolver;
+  key[i++] = ppr->tol_thermo_integration_ndf15;
+  key[i++] = ppr->smallest_allowed_variation;
+
+  class_test(i != _RECOMBINATION_CACHE_KEY_SIZE_,
+             pth->error_message,
+             "stop to avoid overflow: %d parameters in key of size %d",i,_RECOMBINATION_CACHE_KEY_SIZE_);
+
+  /* background tables and HyRec file names */
+  *hash = thermodynamics_hash_bytes(0,&(pba->bt_size),sizeof(int));
+  *hash = thermodynamics_hash_bytes(*hash,&(pba->bg_size),sizeof(int));
+  *hash = thermodynamics_hash_bytes(*hash,pba->tau_table,pba->bt_size*sizeof(double));
+  *hash = thermodynamics_hash_bytes(*hash,pba->background_table,pba->bt_size*pba->bg_size*sizeof(double));
+  *hash = thermodynamics_hash_bytes(*hash,ppr->hyrec_Alpha_inf_file,strlen(ppr->hyrec_Alpha_inf_file));
+  *hash = thermodynamics_hash_bytes(*hash,ppr->hyrec_R_inf_file,strlen(ppr->hyrec_R_inf_file));
+  *hash = thermodynamics_hash_bytes(*hash,ppr->hyrec_two_photon_tables_file,strlen(ppr->hyrec_two_photon_tables_file));
+
+  return _SUCCESS_;
+}
+
+/**
+ * Update a 64-bit FNV-1a hash with a block of bytes.
+ *
+ * @param hash Input: hash of the previous blocks (0 for the first one)
+ * @param data Input: block of bytes
+ * @param size Input: number of bytes
+ * @return the updated hash
+ */
+
+unsigned long long thermodynamics_hash_bytes(
+                                             unsigned long long hash,
+                                             const void * data,
+                                             size_t size
+                                             ) {
+
+  const unsigned char * byte = (const unsigned char *)data;
+  size_t i;
+
+  if (hash == 0)
+    hash = 14695981039346656037ULL;
+
+  for (i=0; i<size; i++) {
+    hash ^= byte[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/**
+ * Initialize the linear response of the RECFAST history (see struct
+ * recombination_response), which a caller can then attach to
+ * pth->recombination_response before each call to
+ * thermodynamics_init(). The fiducial model is the first RECFAST run
+ * using it.
+ *
+ * @param response      Output: response to be initialized
+ * @param trust_region  Input: largest change of the logarithm of omega_b, omega_cdm, YHe or T_cmb for which the expansion is used
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int thermodynamics_recombination_response_init(
+                                               struct recombination_response * response,
+                                               double trust_region,
+                                               ErrorMsg error_message
+                                               ) {
+
+  class_test(trust_region <= 0.,
+             error_message,
+             "the trust region of a recombination response must be positive (%g)",trust_region);
+
+  response->trust_region = trust_region;
+  response->has_fiducial = _FALSE_;
+  response->vary_T_cmb = _FALSE_;
+  response->dln_table = NULL;
+  response->hits = 0;
+  response->fallbacks = 0;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the fiducial history and derivatives kept in a response. To
+ * be called once, after the last run using it.
+ *
+ * @param response Input: response to be freed
+ * @return the error status
+ */
+
+int thermodynamics_recombination_response_free(
+                                               struct recombination_response * response
+                                               ) {
+
+  if (response->has_fiducial == _TRUE_) {
+    free(response->reco.recombination_table);
+    free(response->dln_table);
+  }
+
+  response->has_fiducial = _FALSE_;
+  response->dln_table = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the inputs of a RECFAST run which must match the fiducial
+ * model of a struct recombination_response, and the logarithms
+ * of the four parameters with respect to which it is expanded. The
+ * variations of these parameters in the finite differences are
+ * absorbed by Omega0_lambda at fixed h and Omega0_k, so the expansion
+ * is only usable for models without decaying dark matter, dark
+ * radiation or scalar field, and whose budget is closed by a
+ * cosmological constant.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input: pointer to thermodynamics structure
+ * @param key      Output: vector of _RECOMBINATION_CACHE_KEY_SIZE_ parameters which must match
+ * @param ln_param Output: logarithms of omega_b, omega_cdm, YHe and T_cmb
+ * @param usable   Output: whether the expansion can be used for this model
+ * @return the error status
+ */
+
+int thermodynamics_recombination_response_parameters(
+                                                     struct precision * ppr,
+                                                     struct background * pba,
+                                                     struct thermo * pth,
+                                                     double * key,
+                                                     double * ln_param,
+                                                     short * usable
+                                                     ) {
+
+  unsigned long long hash;
+
+  class_call(thermodynamics_recombination_cache_key(ppr,pba,pth,_TRUE_,key,&hash),
+             pth->error_message,
+             pth->error_message);
+
+  *usable = _TRUE_;
+
+  if ((pth->recombination != recfast) ||
+      (pba->has_dcdm == _TRUE_) ||
+      (pba->has_dr == _TRUE_) ||
+      (pba->has_scf == _TRUE_) ||
+      (pba->Omega0_lambda == 0.) ||
+      (pba->Omega0_b <= 0.) ||
+      (pba->Omega0_cdm <= 0.) ||
+      (pth->YHe <= 0.)) {
+    *usable = _FALSE_;
+    return _SUCCESS_;
+  }
+
+  ln_param[0] = log(pba->Omega0_b*pba->h*pba->h);
+  ln_param[1] = log(pba->Omega0_cdm*pba->h*pba->h);
+  ln_param[2] = log(pth->YHe);
+  ln_param[3] = log(pba->T_cmb);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Make the RECFAST history just computed the fiducial model of a
+ * struct recombination_response, and tabulate the derivatives of the
+ * logarithms of x_e, T_b and c_b^2 by centred finite differences
+ * over half the trust region. For each parameter, the background is
+ * recomputed in a copy of pba,
+ * Omega0_lambda absorbing the change of the budget (of Omega0_b,
+ * Omega0_cdm, or Omega0_g and Omega0_ur together for T_cmb).
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input: pointer to thermodynamics structure
+ * @param preco    Input: pointer to recombination structure of the fiducial model
+ * @param pvecback Input: pointer to an allocated (but empty) vector of background variables
+ * @param response Input/Output: response to be filled
+ * @param key      Input: inputs which must match (from thermodynamics_recombination_response_parameters())
+ * @param ln_param Input: logarithms of the parameters of the fiducial model
+ * @return the error status
+ */
+
+int thermodynamics_recombination_response_build(
+                                                struct precision * ppr,
+                                                struct background * pba,
+                                                struct thermo * pth,
+                                                struct recombination * preco,
+                                                double * pvecback,
+                                                struct recombination_response * response,
+                                                double * key,
+                                                double * ln_param
+                                                ) {
+
+  struct background ba;
+  struct thermo th;
+  struct recombination reco[2];
+  int index_param,index_side,index_z,index_re,i;
+  int size;
+  double step,ratio,dOmega;
+  double * dln;
+
+  size = preco->rt_size*preco->re_size;
+
+  /* the derivatives are centred finite differences over half the trust region */
+  step = 0.5*response->trust_region;
+
+  response->vary_T_cmb = _TRUE_;
+  if ((pba->N_ncdm > 0) ||
+      (pba->T_cmb*exp(-step) < _TCMB_SMALL_) ||
+      (pba->T_cmb*exp(step) > _TCMB_BIG_))
+    response->vary_T_cmb = _FALSE_;
+
+  class_calloc(response->dln_table,
+               _RECOMBINATION_RESPONSE_PARAMETERS_*size,
+               sizeof(double),
+               pth->error_message);
+
+  for (index_param=0; index_param<_RECOMBINATION_RESPONSE_PARAMETERS_; index_param++) {
+
+    if ((index_param == 3) && (response->vary_T_cmb == _FALSE_))
+      continue;
+
+    /** - integrate RECFAST on each side of the fiducial model */
+
+    for (index_side=0; index_side<2; index_side++) {
+
+      ratio = exp((2*index_side-1)*step);
+
+      ba = *pba;
+      th = *pth;
+      ba.background_verbose = 0;
+
+      switch (index_param) {
+      case 0:
+        dOmega = pba->Omega0_b*(ratio-1.);
+        ba.Omega0_b += dOmega;
+        break;
+      case 1:
+        dOmega = pba->Omega0_cdm*(ratio-1.);
+        ba.Omega0_cdm += dOmega;
+        break;
+      case 2:
+        dOmega = 0.;
+        th.YHe *= ratio;
+        break;
+      default:
+        dOmega = (pba->Omega0_g+pba->Omega0_ur)*(pow(ratio,4)-1.);
+        ba.T_cmb *= ratio;
+        ba.Omega0_g *= pow(ratio,4);
+        ba.Omega0_ur *= pow(ratio,4);
+        break;
+      }
+      ba.Omega0_lambda -= dOmega;
+
+      if (index_param != 2) {
+        class_call(background_init(ppr,&ba),
+                   ba.error_message,
+                   pth->error_message);
+      }
+
+      reco[index_side] = *preco;
+
+      class_call(thermodynamics_recombination_with_recfast(ppr,&ba,&th,&(reco[index_side]),pvecback),
+                 th.error_message,
+                 pth->error_message);
+
+      if (index_param != 2) {
+        class_call(background_free_noinput(&ba),
+                   ba.error_message,
+                   pth->error_message);
+      }
+    }
+
+    /** - difference the logarithms of the expanded columns */
+
+    dln = response->dln_table + index_param*size;
+
+    for (index_z=0; index_z<preco->rt_size; index_z++) {
+      for (index_re=0; index_re<preco->re_size; index_re++) {
+
+        if ((index_re != preco->index_re_xe) &&
+            (index_re != preco->index_re_Tb) &&
+            (index_re != preco->index_re_cb2))
+          continue;
+
+        i = index_z*preco->re_size+index_re;
+
+        class_test((reco[0].recombination_table[i] <= 0.) || (reco[1].recombination_table[i] <= 0.),
+                   pth->error_message,
+                   "cannot expand the logarithm of a non-positive entry of the recombination table");
+
+        dln[i] = (log(reco[1].recombination_table[i])-log(reco[0].recombination_table[i]))/2./step;
+      }
+    }
+
+    free(reco[0].recombination_table);
+    free(reco[1].recombination_table);
+  }
+
+  /** - keep the fiducial model */
+
+  response->reco = *preco;
+  class_alloc(response->reco.recombination_table,size*sizeof(double),pth->error_message);
+  memcpy(response->reco.recombination_table,preco->recombination_table,size*sizeof(double));
+
+  for (i=0; i<_RECOMBINATION_CACHE_KEY_SIZE_; i++)
+    response->key[i] = key[i];
+  for (index_param=0; index_param<_RECOMBINATION_RESPONSE_PARAMETERS_; index_param++)
+    response->ln_param[index_param] = ln_param[index_param];
+
+  response->has_fiducial = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill the recombination structure with the first-order expansion of
+ * the fiducial history of a struct recombination_response: x_e, T_b
+ * and c_b^2 are expanded in logarithm, while the parameters of
+ * RECFAST, the electron density today and dkappa/dtau are computed
+ * exactly for the new model (H0 and the other inputs being those of
+ * the fiducial model).
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input/Output: pointer to thermodynamics structure
+ * @param preco    Output: pointer to recombination structure
+ * @param response Input: response with a fiducial model
+ * @param ln_param Input: logarithms of the parameters of the new model
+ * @return the error status
+ */
+
+int thermodynamics_recombination_response_apply(
+                                                struct precision * ppr,
+                                                struct background * pba,
+                                                struct thermo * pth,
+                                                struct recombination * preco,
+                                                struct recombination_response * response,
+                                                double * ln_param
+                                                ) {
+
+  double dln_param[_RECOMBINATION_RESPONSE_PARAMETERS_];
+  double mu_H,lnx,z,xe;
+  double * fiducial;
+  double * row;
+  int index_param,index_z,index_re,i;
+  int size;
+
+  size = response->reco.rt_size*response->reco.re_size;
+
+  for (index_param=0; index_param<_RECOMBINATION_RESPONSE_PARAMETERS_; index_param++)
+    dln_param[index_param] = ln_param[index_param]-response->ln_param[index_param];
+
+  *preco = response->reco;
+  class_alloc(preco->recombination_table,size*sizeof(double),pth->error_message);
+
+  /* parameters of RECFAST depending on the expanded parameters, as in
+     thermodynamics_recombination_with_recfast() (the others are the
+     same as in the fiducial model) */
+  preco->YHe = pth->YHe;
+  preco->Tnow = pba->T_cmb;
+  mu_H = 1./(1.-preco->YHe);
+  preco->fHe = preco->YHe/(_not4_ *(1.-preco->YHe));
+  preco->Nnow = 3.*preco->H0*preco->H0*pba->Omega0_b/(8.*_PI_*_G_*mu_H*_m_H_);
+  pth->n_e = preco->Nnow;
+
+  for (index_z=0; index_z<preco->rt_size; index_z++) {
+
+    fiducial = response->reco.recombination_table + index_z*preco->re_size;
+    row = preco->recombination_table + index_z*preco->re_size;
+
+    for (index_re=0; index_re<preco->re_size; index_re++) {
+
+      if ((index_re != preco->index_re_xe) &&
+          (index_re != preco->index_re_Tb) &&
+          (index_re != preco->index_re_cb2)) {
+        row[index_re] = fiducial[index_re];
+        continue;
+      }
+
+      i = index_z*preco->re_size+index_re;
+
+      lnx = log(fiducial[index_re]);
+      for (index_param=0; index_param<_RECOMBINATION_RESPONSE_PARAMETERS_; index_param++)
+        lnx += response->dln_table[index_param*size+i]*dln_param[index_param];
+
+      row[index_re] = exp(lnx);
+    }
+
+    /* dkappa/dtau = a n_e x_e sigma_T = a^{-2} n_e(today) x_e sigma_T (in units of 1/Mpc) */
+    z = row[preco->index_re_z];
+    xe = row[preco->index_re_xe];
+    row[preco->index_re_dkappadtau] = (1.+z) * (1.+z) * preco->Nnow * xe * _sigma_ * _Mpc_over_m_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Integrate thermodynamics with HyRec.
+ *
+ * Integrate thermodynamics with HyRec, allocate and fill the part
+ * of the thermodynamics interpolation table (the rest is filled in
+ * thermodynamics_init()). Called once by
+ * thermodynamics_recombination(), from thermodynamics_init().
+ *
+ *************************************************************************************************
+ *                 HYREC: Hydrogen and Helium Recombination Code
+ *         Written by Yacine Ali-Haimoud and Chris Hirata (Caltech)
+ *************************************************************************************************
+ *
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input: pointer to thermodynamics structure
+ * @param preco    Output: pointer to recombination structure
+ * @param pvecback Input: pointer to an allocated (but empty) vector of background variables
+ */
+
+int thermodynamics_recombination_with_hyrec(
+                                            struct precision * ppr,
+                                            struct background * pba,
+                                            struct thermo * pth,
+                                            struct recombination * preco,
+                                            double * pvecback
+                                            ) {
+  /** Summary: */
+#ifdef HYREC
+
+  REC_COSMOPARAMS param;
+  HRATEEFF rate_table;
+  struct hyrec_tables * tables;
+  double *xe_output, *Tm_output;
+  int i,j,l,Nz;
+  double z, xe, Tm, Hz;
+  void * buffer;
+  int buf_size;
+  double tau;
+  int last_index_back;
+
+  /** - Fill hyrec parameter structure */
+
+  param.T0 = pba->T_cmb;
+  param.obh2 = pba->Omega0_b*pba->h*pba->h;
+  param.omh2 = (pba->Omega0_b+pba->Omega0_cdm+pba->Omega0_ncdm_tot)*pba->h*pba->h;
+  param.okh2 = pba->Omega0_k*pba->h*pba->h;
+  param.odeh2 = (pba->Omega0_lambda+pba->Omega0_fld)*pba->h*pba->h;
+  param.w0 = pba->w0_fld;
+  param.wa = pba->wa_fld;
+  param.Y = pth->YHe;
+  param.Nnueff = pba->Neff;
+  param.nH0 = 11.223846333047*param.obh2*(1.-param.Y);  /* number density of hydrogen today in m-3 */
+  param.fHe = param.Y/(1-param.Y)/3.97153;              /* abundance of helium by number */
+  param.zstart = ppr->recfast_z_initial; /* Redshift range */
+  param.zend = 0.;
+  param.dlna = 8.49e-5;
+  param.nz = (long) floor(2+log((1.+param.zstart)/(1.+param.zend))/param.dlna);
+  param.annihilation = pth->annihilation;
+  param.has_on_the_spot = pth->has_on_the_spot;
+  param.decay = pth->decay;
+  param.annihilation_variation = pth->annihilation_variation;
+  param.annihilation_z = pth->annihilation_z;
+  param.annihilation_zmax = pth->annihilation_zmax;
+  param.annihilation_zmin = pth->annihilation_zmin;
+  param.annihilation_f_halo = pth->annihilation_f_halo;
+  param.annihilation_z_halo = pth->annihilation_z_halo;
+
+  /** - Build effective rate tables */
+
+  /* get the tables read from files, shared by all runs */
+
+  class_call(thermodynamics_hyrec_tables(ppr,&tables,pth->error_message),
+             pth->error_message,
+             pth->error_message);
+
+  /* allocate contiguous memory zone */
+
+  buf_size = (NTR+NTM+2*param.nz)*sizeof(double) + 2*NTM*sizeof(double*);
+
+  class_alloc(buffer,
+              buf_size,
+              pth->error_message);
+
+  /** - distribute addresses for each table */
+
+  rate_table.logTR_tab = (double*)buffer;
+  rate_table.TM_TR_tab = (double*)(rate_table.logTR_tab + NTR);
+  rate_table.logAlpha_tab[0] = (double**)(rate_table.TM_TR_tab+NTM);
+  rate_table.logAlpha_tab[1] = (double**)(rate_table.logAlpha_tab[0]+NTM);
+  for (l=0;l<=1;l++) {
+    for (j=0;j<NTM;j++) {
+      rate_table.logAlpha_tab[l][j] = tables->data->logAlpha[l][j];
+    }
+  }
+  rate_table.logR2p2s_tab = tables->data->logR2p2s;
+
+  xe_output = (double*)(rate_table.logAlpha_tab[1]+NTM);
+  Tm_output = (double*)(xe_output+param.nz);
+
+  /* store sampled values of temperatures */
+
+  for (i = 0; i < NTR; i++)
+    rate_table.logTR_tab[i] = log(TR_MIN) + i * (log(TR_MAX)-log(TR_MIN))/(NTR-1.);
+  for (i = 0; i < NTM; i++)
+    rate_table.TM_TR_tab[i] = TM_TR_MIN + i * (TM_TR_MAX-TM_TR_MIN)/(NTM-1.);
+
+  rate_table.DlogTR = rate_table.logTR_tab[1] - rate_table.logTR_tab[0];
+  rate_table.DTM_TR = rate_table.TM_TR_tab[1] - rate_table.TM_TR_tab[0];
+
+  /*  In CLASS, we have neutralized the switches for the various
+      effects considered in Hirata (2008), keeping the full
+      calculation as a default; but you could restore their
+      functionality by copying a few lines from hyrec/hyrec.c to
+      here */
+
+  /** - Compute the recombination history by calling a function in hyrec (no CLASS-like error management here) */
+
+  if (pth->thermodynamics_verbose > 0)
+    printf(" -> calling HyRec version %s,\n",HYREC_VERSION);
+
+  rec_build_history(&param, &rate_table, &(tables->data->twog_params), xe_output, Tm_output);
+
+  if (pth->thermodynamics_verbose > 0)
+    printf("    by Y. Ali-Haïmoud & C. Hirata\n");
+
+  /** - fill a few parameters in preco and pth */
+
+  Nz=ppr->recfast_Nz0;
+
+  preco->rt_size = Nz;
   preco->H0 = pba->H0 * _c_ / _Mpc_over_m_;
   /* preco->H0 in inverse seconds (while pba->H0 is [H0/c] in inverse Mpcs) */
   preco->YHe = pth->YHe;
@@ -2724,6 +3618,213 @@ int thermodynamics_recombination_with_hyrec(
   return _SUCCESS_;
 }
 
+#ifdef HYREC
+
+/**
+ * Return the HyRec tables read from the files named in the precision
+ * structure. They are read only the first time that these file names
+ * are encountered in the process; later calls, from any run or
+ * thread, return the same read-only tables, which are never freed. If
+ * ppr->shared_tables_directory is not empty, the tables are also
+ * shared with the other processes through this directory.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param ptables       Output: pointer to the shared tables
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int thermodynamics_hyrec_tables(
+                                struct precision * ppr,
+                                struct hyrec_tables ** ptables,
+                                ErrorMsg error_message
+                                ) {
+
+  struct hyrec_tables * tables;
+  struct hyrec_tables_key key;
+  int status = _SUCCESS_;
+  ErrorMsg error_read;
+
+  memset(&key,0,sizeof(struct hyrec_tables_key));
+  strcpy(key.Alpha_inf_file,ppr->hyrec_Alpha_inf_file);
+  strcpy(key.R_inf_file,ppr->hyrec_R_inf_file);
+  strcpy(key.two_photon_tables_file,ppr->hyrec_two_photon_tables_file);
+  key.sizes[0] = NTR;
+  key.sizes[1] = NTM;
+  key.sizes[2] = NVIRT;
+
+#pragma omp critical (hyrec_tables)
+  {
+    for (tables = hyrec_tables_list; tables != NULL; tables = tables->next) {
+      if (memcmp(&(tables->key),&key,sizeof(struct hyrec_tables_key)) == 0)
+        break;
+    }
+
+    if (tables == NULL) {
+      tables = (struct hyrec_tables *)malloc(sizeof(struct hyrec_tables));
+      if (tables == NULL) {
+        sprintf(error_read,"could not allocate HyRec tables");
+        status = _FAILURE_;
+      }
+      else {
+        tables->key = key;
+        status = shared_table_get(ppr->shared_tables_directory,
+                                  "hyrec",
+                                  &key,
+                                  sizeof(struct hyrec_tables_key),
+                                  sizeof(struct hyrec_table_data)/sizeof(double),
+                                  thermodynamics_hyrec_tables_read,
+                                  ppr,
+                                  &(tables->shared),
+                                  error_read);
+        if (status == _SUCCESS_) {
+          tables->data = (struct hyrec_table_data *)tables->shared.data;
+          tables->next = hyrec_tables_list;
+          hyrec_tables_list = tables;
+        }
+        else {
+          free(tables);
+          tables = NULL;
+        }
+      }
+    }
+  }
+
+  class_test(status == _FAILURE_,
+             error_message,
+             "%s",error_read);
+
+  *ptables = tables;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read the HyRec tables, either from the binary file
+ * ppr->hyrec_tables_binary_file when it exists and was written from
+ * the same text files, or else from these text files. In the latter
+ * case, the binary file is then written (if its name is not empty),
+ * so that later processes do not need to parse the text files. This
+ * is the shared_table_builder of thermodynamics_hyrec_tables().
+ *
+ * @param context       Input: pointer to precision structure
+ * @param data          Output: tables, as a struct hyrec_table_data
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int thermodynamics_hyrec_tables_read(
+                                     void * context,
+                                     double * data,
+                                     ErrorMsg error_message
+                                     ) {
+
+  struct precision * ppr;
+  struct hyrec_table_data * tables;
+  FILE * fA;
+  FILE * fR;
+  FileName names[3];
+  int sizes[3];
+  int i,j,l,b;
+  double L2s1s_current;
+  short read_binary = _FALSE_;
+
+  ppr = (struct precision *)context;
+  tables = (struct hyrec_table_data *)data;
+
+  /** - try the binary file: it starts with the names of the text
+      files and the dimensions of the tables, which must match */
+
+  if ((ppr->hyrec_tables_binary_file[0] != '\0') &&
+      ((fA = fopen(ppr->hyrec_tables_binary_file,"rb")) != NULL)) {
+
+    if ((fread(names,sizeof(FileName),3,fA) == 3) &&
+        (fread(sizes,sizeof(int),3,fA) == 3) &&
+        (strcmp(names[0],ppr->hyrec_Alpha_inf_file) == 0) &&
+        (strcmp(names[1],ppr->hyrec_R_inf_file) == 0) &&
+        (strcmp(names[2],ppr->hyrec_two_photon_tables_file) == 0) &&
+        (sizes[0] == NTR) && (sizes[1] == NTM) && (sizes[2] == NVIRT) &&
+        (fread(tables->logAlpha,sizeof(tables->logAlpha),1,fA) == 1) &&
+        (fread(tables->logR2p2s,sizeof(tables->logR2p2s),1,fA) == 1) &&
+        (fread(&(tables->twog_params),sizeof(TWO_PHOTON_PARAMS),1,fA) == 1))
+      read_binary = _TRUE_;
+
+    fclose(fA);
+  }
+
+  if (read_binary == _TRUE_)
+    return _SUCCESS_;
+
+  /** - otherwise read the effective rates */
+
+  class_open(fA,ppr->hyrec_Alpha_inf_file, "r",error_message);
+  class_open(fR,ppr->hyrec_R_inf_file, "r",error_message);
+
+  for (i = 0; i < NTR; i++) {
+    for (j = 0; j < NTM; j++) {
+      for (l = 0; l <= 1; l++) {
+        if (fscanf(fA, "%le", &(tables->logAlpha[l][j][i])) != 1)
+          class_stop(error_message,"Error reading hyrec data file %s",ppr->hyrec_Alpha_inf_file);
+        tables->logAlpha[l][j][i] = log(tables->logAlpha[l][j][i]);
+      }
+    }
+
+    if (fscanf(fR, "%le", &(tables->logR2p2s[i])) !=1)
+      class_stop(error_message,"Error reading hyrec data file %s",ppr->hyrec_R_inf_file);
+    tables->logR2p2s[i] = log(tables->logR2p2s[i]);
+
+  }
+  fclose(fA);
+  fclose(fR);
+
+  /** - read two-photon rate tables */
+
+  class_open(fA,ppr->hyrec_two_photon_tables_file, "r",error_message);
+
+  for (b = 0; b < NVIRT; b++) {
+    if ((fscanf(fA, "%le", &(tables->twog_params.Eb_tab[b])) != 1) ||
+        (fscanf(fA, "%le", &(tables->twog_params.A1s_tab[b])) != 1) ||
+        (fscanf(fA, "%le", &(tables->twog_params.A2s_tab[b])) != 1) ||
+        (fscanf(fA, "%le", &(tables->twog_params.A3s3d_tab[b])) != 1) ||
+        (fscanf(fA, "%le", &(tables->twog_params.A4s4d_tab[b])) != 1))
+      class_stop(error_message,"Error reading hyrec data file %s",ppr->hyrec_two_photon_tables_file);
+  }
+
+  fclose(fA);
+
+  /** - normalize 2s--1s differential decay rate to L2s1s (can be set by user in hydrogen.h) */
+  L2s1s_current = 0.;
+  for (b = 0; b < NSUBLYA; b++) L2s1s_current += tables->twog_params.A2s_tab[b];
+  for (b = 0; b < NSUBLYA; b++) tables->twog_params.A2s_tab[b] *= L2s1s/L2s1s_current;
+
+  /** - write the binary file; failing to do so (e.g. in a read-only
+      directory) is not an error, since it only serves to speed up
+      later runs */
+
+  if ((ppr->hyrec_tables_binary_file[0] != '\0') &&
+      ((fA = fopen(ppr->hyrec_tables_binary_file,"wb")) != NULL)) {
+
+    strcpy(names[0],ppr->hyrec_Alpha_inf_file);
+    strcpy(names[1],ppr->hyrec_R_inf_file);
+    strcpy(names[2],ppr->hyrec_two_photon_tables_file);
+    sizes[0] = NTR;
+    sizes[1] = NTM;
+    sizes[2] = NVIRT;
+
+    fwrite(names,sizeof(FileName),3,fA);
+    fwrite(sizes,sizeof(int),3,fA);
+    fwrite(tables->logAlpha,sizeof(tables->logAlpha),1,fA);
+    fwrite(tables->logR2p2s,sizeof(tables->logR2p2s),1,fA);
+    fwrite(&(tables->twog_params),sizeof(TWO_PHOTON_PARAMS),1,fA);
+
+    fclose(fA);
+  }
+
+  return _SUCCESS_;
+}
+
+#endif
+
 /**
  * Integrate thermodynamics with RECFAST.
  *
@@ -3056,6 +4157,17 @@ int thermodynamics_recombination_with_recfast(
 
     /** - --> last case: full evolution for H and Helium */
 
+    /* with the stiff evolver, the remaining steps are integrated at
+       once, and the table is filled by thermodynamics_recfast_ndf15_output() */
+    else if (ppr->recfast_evolver == ndf15) {
+
+      class_call(thermodynamics_recombination_with_recfast_ndf15(ppr,pth,preco,&tpaw,y,i),
+                 pth->error_message,
+                 pth->error_message);
+
+      break;
+    }
+
     else {
 
       /* quantities used for smoothed transition */
@@ -3136,6 +4248,182 @@ int thermodynamics_recombination_with_recfast(
   return _SUCCESS_;
 }
 
+/**
+ * Integrate the last phase of RECFAST (full evolution for H and
+ * Helium) with the stiff evolver, from the beginning of the step
+ * index_step of thermodynamics_recombination_with_recfast() down to
+ * z=0, and fill the remaining lines of the recombination table at the
+ * same redshifts as the Runge-Kutta integration. The evolver then
+ * chooses its own steps, instead of being restarted at each of the
+ * recfast_Nz0 steps. Since evolver_ndf15() expects a growing time
+ * variable, the equations are integrated in -z.
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pth        Input: pointer to thermodynamics structure
+ * @param preco      Input/Output: pointer to recombination structure
+ * @param ptpaw      Input: pointer to the parameters and workspace of thermodynamics_derivs_with_recfast()
+ * @param y          Input/Output: x_H, x_He, Tmat at the beginning of step index_step (at z=0 on output)
+ * @param index_step Input: first step integrated
+ * @return the error status
+ */
+
+int thermodynamics_recombination_with_recfast_ndf15(
+                                                    struct precision * ppr,
+                                                    struct thermo * pth,
+                                                    struct recombination * preco,
+                                                    struct thermodynamics_parameters_and_workspace * ptpaw,
+                                                    double * y,
+                                                    int index_step
+                                                    ) {
+
+  int Nz,i;
+  double zstart;
+  double * mz_output;
+  int used_in_output[_RECFAST_INTEG_SIZE_];
+
+  Nz = ppr->recfast_Nz0;
+
+  zstart = ppr->recfast_z_initial * (double)(Nz-index_step) / (double)Nz;
+
+  /* output at the end of each remaining step, in growing order of -z */
+  class_alloc(mz_output,(Nz-index_step)*sizeof(double),pth->error_message);
+  for (i=index_step; i<Nz; i++)
+    mz_output[i-index_step] = -ppr->recfast_z_initial * (double)(Nz-i-1) / (double)Nz;
+
+  for (i=0; i<_RECFAST_INTEG_SIZE_; i++)
+    used_in_output[i] = _TRUE_;
+
+  ptpaw->index_first_row = Nz-index_step-1;
+
+  class_call(evolver_ndf15(thermodynamics_derivs_with_recfast_ndf15,
+                           NULL,
+                           NULL,
+                           NULL,
+                           -zstart,
+                           mz_output[Nz-index_step-1],
+                           y,
+                           used_in_output,
+                           _RECFAST_INTEG_SIZE_,
+                           ptpaw,
+                           ppr->tol_thermo_integration_ndf15,
+                           ppr->smallest_allowed_variation,
+                           NULL,
+                           0.,
+                           mz_output,
+                           Nz-index_step,
+                           thermodynamics_recfast_ndf15_output,
+                           NULL,
+                           NULL,
+                           pth->error_message),
+             pth->error_message,
+             pth->error_message);
+
+  free(mz_output);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Derivative of x_H, x_He and Tmat with respect to -z, for
+ * thermodynamics_recombination_with_recfast_ndf15().
+ *
+ * @param mz                       Input: minus the redshift
+ * @param y                        Input: vector of variable to integrate
+ * @param dy                       Output: its derivative with respect to -z (already allocated)
+ * @param parameters_and_workspace Input: pointer to a struct thermodynamics_parameters_and_workspace
+ * @param error_message            Output: error message
+ * @return the error status
+ */
+
+int thermodynamics_derivs_with_recfast_ndf15(
+                                             double mz,
+                                             double * y,
+                                             double * dy,
+                                             void * parameters_and_workspace,
+                                             ErrorMsg error_message
+                                             ) {
+
+  int i;
+
+  class_call(thermodynamics_derivs_with_recfast(-mz,y,dy,parameters_and_workspace,error_message),
+             error_message,
+             error_message);
+
+  for (i=0; i<_RECFAST_INTEG_SIZE_; i++)
+    dy[i] = -dy[i];
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill one line of the recombination table from the variables
+ * interpolated by evolver_ndf15() at the end of a RECFAST step, as done
+ * in thermodynamics_recombination_with_recfast() for the last case
+ * (full evolution for H and Helium).
+ *
+ * @param mz                       Input: minus the redshift
+ * @param y                        Input: x_H, x_He and Tmat
+ * @param dy                       Input: their derivative with respect to -z
+ * @param index_mz                 Input: index of the output point, counted from the first remaining step
+ * @param parameters_and_workspace Input: pointer to a struct thermodynamics_parameters_and_workspace
+ * @param error_message            Output: error message
+ * @return the error status
+ */
+
+int thermodynamics_recfast_ndf15_output(
+                                        double mz,
+                                        double * y,
+                                        double * dy,
+                                        int index_mz,
+                                        void * parameters_and_workspace,
+                                        ErrorMsg error_message
+                                        ) {
+
+  struct thermodynamics_parameters_and_workspace * ptpaw;
+  struct precision * ppr;
+  struct recombination * preco;
+  double z,rhs,x_H0,s,weight,x0,dTbdz;
+  double * row;
+
+  ptpaw = parameters_and_workspace;
+  ppr = ptpaw->ppr;
+  preco = ptpaw->preco;
+
+  z = -mz;
+  dTbdz = -dy[2];
+
+  /* smoothed transition from the analytic approximation for hydrogen */
+  if (ppr->recfast_x_H0_trigger - y[0] < ppr->recfast_x_H0_trigger_delta) {
+    rhs = exp(1.5*log(preco->CR*preco->Tnow/(1.+z)) - preco->CB1/(preco->Tnow*(1.+z)))/preco->Nnow;
+    x_H0 = 0.5*(sqrt(pow(rhs,2)+4.*rhs) - rhs);
+    /* get s from 0 to 1 */
+    s = (ppr->recfast_x_H0_trigger - y[0])/ppr->recfast_x_H0_trigger_delta;
+    /* infer f2(s) = smooth function interpolating from 0 to 1 */
+    weight = f2(s);
+
+    x0 = weight*y[0]+(1.-weight)*x_H0 + preco->fHe*y[1];
+  }
+  /* transition finished */
+  else {
+    x0 = y[0] + preco->fHe*y[1];
+  }
+
+  /* results are obtained in order of decreasing z, and stored in order of growing z */
+  row = preco->recombination_table + (ptpaw->index_first_row-index_mz)*preco->re_size;
+
+  row[preco->index_re_z] = z;
+  row[preco->index_re_xe] = x0;
+  row[preco->index_re_Tb] = y[2];
+
+  /* cb2 = (k_B/mu) Tb (1-1/3 dlnTb/dlna) = (k_B/mu) Tb (1+1/3 (1+z) dlnTb/dz) */
+  row[preco->index_re_cb2] = _k_B_ / ( _c_ * _c_ * _m_H_ ) * (1. + (1./_not4_ - 1.) * preco->YHe + x0 * (1.-preco->YHe)) * y[2] * (1. + (1.+z) * dTbdz / y[2] / 3.);
+
+  /* dkappa/dtau = a n_e x_e sigma_T = a^{-2} n_e(today) x_e sigma_T (in units of 1/Mpc) */
+  row[preco->index_re_dkappadtau] = (1.+z) * (1.+z) * preco->Nnow * x0 * _sigma_ * _Mpc_over_m_;
+
+  return _SUCCESS_;
+}
+
 /**
  * Subroutine evaluating the derivative with respect to redshift of
  * thermodynamical quantities (from RECFAST version 1.4).
@@ -3457,8 +4745,9 @@ int thermodynamics_merge_reco_and_reio(
   class_alloc(pth->thermodynamics_table,pth->th_size*pth->tt_size*sizeof(double),pth->error_message);
   class_alloc(pth->d2thermodynamics_dz2_table,pth->th_size*pth->tt_size*sizeof(double),pth->error_message);
 
-  /** - fill these arrays */
+  /** - fill these arrays (sharing the copies between threads for large tables) */
 
+#pragma omp parallel for schedule (static) if (pth->tt_size >= _THERMO_TABLE_PARALLEL_MIN_SIZE_)
   for (i=0; i < preio->rt_size; i++) {
     pth->z_table[i]=
       preio->reionization_table[i*preio->re_size+preio->index_re_z];
@@ -3471,6 +4760,8 @@ int thermodynamics_merge_reco_and_reio(
     pth->thermodynamics_table[i*pth->th_size+pth->index_th_cb2]=
       preio->reionization_table[i*preio->re_size+preio->index_re_cb2];
   }
+
+#pragma omp parallel for schedule (static) private(index_th,index_re) if (pth->tt_size >= _THERMO_TABLE_PARALLEL_MIN_SIZE_)
   for (i=0; i < ppr->recfast_Nz0 - preio->index_reco_when_reio_start - 1; i++) {
     index_th=i+preio->rt_size;
     index_re=i+preio->index_reco_when_reio_start+1;
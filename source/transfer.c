@@ -29,6 +29,91 @@
 
 #include "transfer.h"
 
+/**
+ * Chunk of the arena of the transfer structure: its blocks follow this header.
+ */
+
+struct transfer_arena_chunk {
+  struct transfer_arena_chunk * next; /**< next chunk of the list */
+  size_t capacity;                    /**< bytes available after the header */
+  size_t used;                        /**< bytes already handed out */
+};
+
+/* header size rounded up to the alignment of the blocks */
+#define _TRANSFER_ARENA_HEADER_ ((sizeof(struct transfer_arena_chunk)+_TRANSFER_ARENA_ALIGNMENT_-1)/_TRANSFER_ARENA_ALIGNMENT_*_TRANSFER_ARENA_ALIGNMENT_)
+
+static void transfer_arena_init(struct transfer_arena * parena) {
+  parena->chunk = NULL;
+  parena->size = 0;
+}
+
+static void * transfer_arena_malloc(struct transfer_arena * parena, size_t size) {
+
+  struct transfer_arena_chunk * chunk;
+  size_t capacity;
+  char * base;
+  void * block;
+
+  size = (MAX(size,1)+_TRANSFER_ARENA_ALIGNMENT_-1)/_TRANSFER_ARENA_ALIGNMENT_*_TRANSFER_ARENA_ALIGNMENT_;
+
+  chunk = parena->chunk;
+
+  if ((chunk == NULL) || (chunk->used+size > chunk->capacity)) {
+
+    /* large blocks get a chunk of their own, placed after the one being
+       filled so that its remaining space is still used */
+    capacity = (size > _TRANSFER_ARENA_CHUNK_SIZE_/4) ? size : _TRANSFER_ARENA_CHUNK_SIZE_;
+
+    /* malloc() only guarantees 16 bytes: room for aligning the first block */
+    base = malloc(_TRANSFER_ARENA_HEADER_+capacity+_TRANSFER_ARENA_ALIGNMENT_);
+    if (base == NULL)
+      return NULL;
+
+    chunk = (struct transfer_arena_chunk *)base;
+    chunk->capacity = capacity;
+    chunk->used = (_TRANSFER_ARENA_ALIGNMENT_-((size_t)(base+_TRANSFER_ARENA_HEADER_))%_TRANSFER_ARENA_ALIGNMENT_)%_TRANSFER_ARENA_ALIGNMENT_;
+    chunk->capacity += chunk->used;
+
+    if ((parena->chunk != NULL) && (capacity == size)) {
+      chunk->next = parena->chunk->next;
+      parena->chunk->next = chunk;
+    }
+    else {
+      chunk->next = parena->chunk;
+      parena->chunk = chunk;
+    }
+  }
+
+  block = (char *)chunk+_TRANSFER_ARENA_HEADER_+chunk->used;
+  chunk->used += size;
+  parena->size += size;
+
+  return block;
+}
+
+static void transfer_arena_free(struct transfer_arena * parena) {
+
+  struct transfer_arena_chunk * chunk;
+
+  while (parena->chunk != NULL) {
+    chunk = parena->chunk;
+    parena->chunk = chunk->next;
+    free(chunk);
+  }
+  parena->size = 0;
+}
+
+/* same as class_alloc(), taking the memory from the arena parena */
+#define transfer_alloc_arena(pointer, size, parena, error_message_output)  {                                     \
+  pointer=transfer_arena_malloc(parena,size);                                                                    \
+  if (pointer == NULL) {                                                                                         \
+    int size_int;                                                                                                \
+    size_int = size;                                                                                             \
+    class_alloc_message(error_message_output,#pointer, size_int);                                                \
+    return _FAILURE_;                                                                                            \
+  }                                                                                                              \
+}
+
 /**
  * Transfer function \f$ \Delta_l^{X} (q) \f$ at a given wavenumber q.
  *
@@ -69,6 +154,10 @@ int transfer_functions_at_q(
                             ) {
   /** Summary: */
 
+  class_test(ptr->transfer[index_md] == NULL,
+             ptr->error_message,
+             "the transfer functions have been freed by transfer_free_functions() (low-memory mode)");
+
   /** - interpolate in pre-computed table using array_interpolate_two() */
   class_call(array_interpolate_two(
                                    ptr->q,
@@ -96,13 +185,20 @@ int transfer_functions_at_q(
  * Main steps:
  *
  * - initialize all indices in the transfers structure
- *   and allocate all its arrays using transfer_indices_of_transfers().
+ *   and allocate all its arrays using transfer_indices_of_transfers(),
+ *   and compute the flat spherical Bessel functions
+ *   (in transfer_init_bessel()).
  *
  * - for each thread (in case of parallel run), initialize the fields of a memory zone called the transfer_workspace with transfer_workspace_init()
  *
- * - loop over q values. For each q, compute the Bessel functions if needed with transfer_update_HIS(), and defer the calculation of all transfer functions to transfer_compute_for_each_q()
+ * - loop over (q, l-block) tasks. For each of them, compute the Bessel functions if needed with transfer_update_HIS(), and defer the calculation of all transfer functions in the block to transfer_compute_for_each_q(). In low-memory mode, this loop is repeated for each source function (see transfer_get_passes())
  * - for each thread, free the the workspace with transfer_workspace_free()
  *
+ * The last three steps are performed by transfer_init_compute(). The
+ * first one only needs the indices of the perturbation module, so
+ * that the driver (see driver.h) can run it while the sources are
+ * computed.
+ *
  * @param ppr Input: pointer to precision structure
  * @param pba Input: pointer to background structure
  * @param pth Input: pointer to thermodynamics structure
@@ -121,35 +217,191 @@ int transfer_init(
                   struct transfers * ptr
                   ) {
 
+  class_call(transfer_init_bessel(ppr,pba,pth,ppt,ptr),
+             ptr->error_message,
+             ptr->error_message);
+
+  class_call(transfer_init_compute(ppr,pba,pth,ppt,pnl,ptr),
+             ptr->error_message,
+             ptr->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * First step of transfer_init(): initialize the indices and the
+ * sampling in l and q of the transfers structure, and compute the
+ * flat spherical Bessel functions in ptr->BIS. Only needs the
+ * indices of the perturbation module (see perturb_init_indices()),
+ * not its sources.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param ptr Output: pointer to transfers structure with indices and Bessel functions
+ * @return the error status
+ */
+
+int transfer_init_bessel(
+                         struct precision * ppr,
+                         struct background * pba,
+                         struct thermo * pth,
+                         struct perturbs * ppt,
+                         struct transfers * ptr
+                         ) {
+
+  /* conformal time today */
+  double tau0;
+  /* conformal time at recombination */
+  double tau_rec;
+  /* order of magnitude of the oscillation period of transfer functions */
+  double q_period;
+  /* largest argument of the flat spherical bessel functions */
+  double xmax;
+
+  /** - start measuring the resources used by this module (see class_profile) */
+
+  class_profile_start(&(ptr->profile));
+
+  /** - check whether any spectrum in harmonic space (i.e., any \f$C_l\f$'s) is actually requested */
+
+  if (ppt->has_cls == _FALSE_) {
+    ptr->has_cls = _FALSE_;
+    if (ptr->transfer_verbose > 0)
+      printf("No harmonic space transfer functions to compute. Transfer module skipped.\n");
+    class_profile_stop(&(ptr->profile));
+    return _SUCCESS_;
+  }
+  else
+    ptr->has_cls = _TRUE_;
+
+  transfer_arena_init(&(ptr->arena));
+
+  if (ptr->transfer_verbose > 0)
+    fprintf(stdout,"Computing transfers\n");
+
+  /** - get number of modes (scalars, tensors...) */
+
+  ptr->md_size = ppt->md_size;
+
+  /** - get conformal age / recombination time
+      from background / thermodynamics structures */
+
+  tau0 = pba->conformal_age;
+  tau_rec = pth->tau_rec;
+
+  /** - correspondence between k and l depend on angular diameter
+      distance, i.e. on curvature. */
+
+  ptr->angular_rescaling = pth->angular_rescaling;
+
+  /** - order of magnitude of the oscillation period of transfer functions */
+
+  q_period = 2.*_PI_/(tau0-tau_rec)*ptr->angular_rescaling;
+
+  /** - initialize all indices in the transfers structure and
+      allocate all its arrays using transfer_indices_of_transfers() */
+
+  class_call(transfer_indices_of_transfers(ppr,ppt,ptr,q_period,pba->K,pba->sgnK),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - compute flat spherical bessel functions */
+
+  xmax = ptr->q[ptr->q_size-1]*tau0;
+  if (pba->sgnK == -1)
+    xmax *= (ptr->l[ptr->l_size_max-1]/ppr->hyper_flat_approximation_nu)/asinh(ptr->l[ptr->l_size_max-1]/ppr->hyper_flat_approximation_nu)*1.01;
+
+  /** - when these functions are cached on disk, round xmax up to a
+      grid of 16 values per octave, so that models with slightly
+      different tau0 share the same table */
+  if (ppr->hyper_cache_directory[0] != '\0')
+    xmax = pow(2.,ceil(16.*log(xmax)/log(2.))/16.);
+
+  class_call(hyperspherical_HIS_create_cached(ppr->hyper_cache_directory,
+                                              0,
+                                              1.,
+                                              ptr->l_size_max,
+                                              ptr->l,
+                                              ppr->hyper_x_min,
+                                              xmax,
+                                              ppr->hyper_sampling_flat,
+                                              ptr->l[ptr->l_size_max-1]+1,
+                                              ppr->hyper_phi_min_abs,
+                                              &(ptr->BIS),
+                                              ptr->error_message),
+             ptr->error_message,
+             ptr->error_message);
+
+  class_profile_stop(&(ptr->profile));
+  return _SUCCESS_;
+}
+
+/**
+ * Second step of transfer_init(): compute the table of transfer
+ * functions, using the sources of the perturbation module, the
+ * non-linear corrections and the Bessel functions computed by
+ * transfer_init_bessel().
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param pnl Input: pointer to nonlinear structure
+ * @param ptr Input/Output: pointer to transfers structure, filled with the transfer functions
+ * @return the error status
+ */
+
+int transfer_init_compute(
+                          struct precision * ppr,
+                          struct background * pba,
+                          struct thermo * pth,
+                          struct perturbs * ppt,
+                          struct nonlinear * pnl,
+                          struct transfers * ptr
+                          ) {
+
   /** Summary: */
 
   /** - define local variables */
 
+  /* running index for modes */
+  int index_md;
   /* running index for wavenumbers */
   int index_q;
 
+  /* parallel tasks are pairs (index_q, block of multipoles) */
+  int index_task;
+  int l_blocks;
+  int l_block_size;
+  int index_l_start;
+  int number_of_threads;
+
   /* conformal time today */
   double tau0;
   /* conformal time at recombination */
   double tau_rec;
-  /* order of magnitude of the oscillation period of transfer functions */
-  double q_period;
 
   /* maximum number of sampling times for transfer sources */
   int tau_size_max;
 
   /* array of sources S(k,tau), just taken from perturbation module,
      or transformed if non-linear corrections are needed
-     sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp][index_tau * ppt->k_size[index_md] + index_k]
+     sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp][_source_index_(index_tau,index_k)]
   */
-  double *** sources;
+  source_t *** sources;
 
   /* array of source derivatives S''(k,tau)
      (second derivative with respect to k, not tau!),
      used to interpolate sources at the right values of k,
-     sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp][index_tau * ppt->k_size[index_md] + index_k]
+     sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp][_source_index_(index_tau,index_k)]
   */
-  double *** sources_spline;
+  source_t *** sources_spline;
+
+  /* in low-memory mode, the sources are neither copied nor splined
+     here, but interpolated in k on demand by each thread */
+  short low_memory_sources;
 
   /* pointer on workspace (one per thread if openmp) */
   struct transfer_workspace * ptw;
@@ -160,10 +412,17 @@ int transfer_init(
   */
   int ** tp_of_tt;
 
-  /* structure containing the flat spherical bessel functions */
+  /* in the non-flat case with several blocks of multipoles, cache of
+     hyperspherical Bessel functions shared by all threads */
+  struct transfer_HIS_cache HIS_cache;
+  short use_HIS_cache;
 
-  HyperInterpStruct BIS;
-  double xmax;
+  /* passes over the sources: in low-memory mode, one per source,
+     so that a single source is splined at a time */
+  struct transfer_pass * pass;
+  struct transfer_pass * ppass;
+  int pass_size;
+  int index_pass;
 
   /* This code can be optionally compiled with the openmp option for parallel computation.
      Inside parallel regions, the use of the command "return" is forbidden.
@@ -179,66 +438,53 @@ int transfer_init(
 
 #endif
 
-  /** - check whether any spectrum in harmonic space (i.e., any \f$C_l\f$'s) is actually requested */
-
-  if (ppt->has_cls == _FALSE_) {
-    ptr->has_cls = _FALSE_;
-    if (ptr->transfer_verbose > 0)
-      printf("No harmonic space transfer functions to compute. Transfer module skipped.\n");
+  if (ptr->has_cls == _FALSE_)
     return _SUCCESS_;
-  }
-  else
-    ptr->has_cls = _TRUE_;
-
-  if (ptr->transfer_verbose > 0)
-    fprintf(stdout,"Computing transfers\n");
-
-  /** - get number of modes (scalars, tensors...) */
-
-  ptr->md_size = ppt->md_size;
-
-  /** - get conformal age / recombination time
-      from background / thermodynamics structures
-      (only place where these structures are used in this module) */
 
-  tau0 = pba->conformal_age;
-  tau_rec = pth->tau_rec;
-
-  /** - correspondence between k and l depend on angular diameter
-      distance, i.e. on curvature. */
+  /** - resume measuring the resources used by this module */
 
-  ptr->angular_rescaling = pth->angular_rescaling;
+  class_profile_resume(&(ptr->profile));
 
-  /** - order of magnitude of the oscillation period of transfer functions */
+  /** - place the pages of the table of transfer functions near the
+      threads of the spectra module: for each initial condition and
+      type, the multipoles are split in blocks, one per thread */
 
-  q_period = 2.*_PI_/(tau0-tau_rec)*ptr->angular_rescaling;
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    class_first_touch(ptr->transfer[index_md],
+                      ppt->ic_size[index_md]*ptr->tt_size[index_md],
+                      ptr->l_size[index_md]*ptr->q_size*sizeof(double),
+                      ppr->first_touch_policy);
+  }
 
-  /** - initialize all indices in the transfers structure and
-      allocate all its arrays using transfer_indices_of_transfers() */
+  /** - same for the flat Bessel functions, which transfer_init_bessel()
+      may have computed with a single thread */
 
-  class_call(transfer_indices_of_transfers(ppr,ppt,ptr,q_period,pba->K,pba->sgnK),
+  class_call(hyperspherical_HIS_first_touch(&(ptr->BIS),
+                                            ppr->first_touch_policy,
+                                            ptr->error_message),
              ptr->error_message,
              ptr->error_message);
 
-  /** - copy sources to a local array sources (in fact, only the pointers are copied, not the data), and eventually apply non-linear corrections to the sources */
-
-  class_alloc(sources,
-              ptr->md_size*sizeof(double**),
-              ptr->error_message);
+  /** - with -DCLASS_OFFLOAD, copy the flat Bessel functions to the
+      offload device (unless a previous run already did it), for the
+      convolutions of transfer_integrate() and transfer_integrate_l_block() */
 
-  class_call(transfer_perturbation_copy_sources_and_nl_corrections(ppt,pnl,ptr,sources),
-             ptr->error_message,
-             ptr->error_message);
+  ptr->BIS_device = NULL;
+  if (pba->sgnK == 0) {
+    class_call(hyperspherical_HIS_device_get(&(ptr->BIS),
+                                             &(ptr->BIS_device),
+                                             ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+  }
 
-  /** - spline all the sources passed by the perturbation module with respect to k (in order to interpolate later at a given value of k) */
+  /** - get conformal age / recombination time
+      from background / thermodynamics structures */
 
-  class_alloc(sources_spline,
-              ptr->md_size*sizeof(double**),
-              ptr->error_message);
+  tau0 = pba->conformal_age;
+  tau_rec = pth->tau_rec;
 
-  class_call(transfer_perturbation_source_spline(ppt,ptr,sources,sources_spline),
-             ptr->error_message,
-             ptr->error_message);
+  low_memory_sources = (ppr->transfer_source_k_window > 0 ? _TRUE_ : _FALSE_);
 
   /** - allocate and fill array describing the correspondence between perturbation types and transfer types */
 
@@ -250,31 +496,17 @@ int transfer_init(
              ptr->error_message,
              ptr->error_message);
 
-  /** - evaluate maximum number of sampled times in the transfer
-      sources: needs to be known here, in order to allocate a large
-      enough workspace */
+  /** - list the passes over the sources (several ones in low-memory mode only) */
 
-  class_call(transfer_source_tau_size_max(ppr,pba,ppt,ptr,tau_rec,tau0,&tau_size_max),
+  class_call(transfer_get_passes(ppr,ppt,ptr,tp_of_tt,low_memory_sources,&pass,&pass_size),
              ptr->error_message,
              ptr->error_message);
 
-  /** - compute flat spherical bessel functions */
-
-  xmax = ptr->q[ptr->q_size-1]*tau0;
-  if (pba->sgnK == -1)
-    xmax *= (ptr->l[ptr->l_size_max-1]/ppr->hyper_flat_approximation_nu)/asinh(ptr->l[ptr->l_size_max-1]/ppr->hyper_flat_approximation_nu)*1.01;
+  /** - evaluate maximum number of sampled times in the transfer
+      sources: needs to be known here, in order to allocate a large
+      enough workspace */
 
-  class_call(hyperspherical_HIS_create(0,
-                                       1.,
-                                       ptr->l_size_max,
-                                       ptr->l,
-                                       ppr->hyper_x_min,
-                                       xmax,
-                                       ppr->hyper_sampling_flat,
-                                       ptr->l[ptr->l_size_max-1]+1,
-                                       ppr->hyper_phi_min_abs,
-                                       &BIS,
-                                       ptr->error_message),
+  class_call(transfer_source_tau_size_max(ppr,pba,ppt,ptr,tau_rec,tau0,&tau_size_max),
              ptr->error_message,
              ptr->error_message);
 
@@ -292,116 +524,248 @@ int transfer_init(
              ptr->error_message,
              ptr->error_message);
 
-  /* (a.3.) workspace, allocated in a parallel zone since in openmp
-      version there is one workspace per thread */
+  /** - tabulate the time sampling and window functions of the number
+      count and galaxy lensing sources, shared by all wavenumbers */
+
+  class_call(transfer_selection_table_init(ppr,pba,ppt,ptr,tau_rec),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - split the list of multipoles into blocks, so that there
+      are enough independent (q, l-block) tasks to keep all threads
+      busy even when there are few wavenumbers. In the non-flat case,
+      the hyperspherical Bessel functions depend on q: those of each q
+      are then computed once and shared by the threads working on its
+      blocks through a transfer_HIS_cache. */
+
+  number_of_threads = 1;
+#ifdef _OPENMP
+  number_of_threads = omp_get_max_threads();
+#endif
+
+  l_blocks = ppr->transfer_l_blocks;
+  if (l_blocks <= 0) {
+    l_blocks = 1;
+    while ((l_blocks < ptr->l_size_max) &&
+           (ptr->q_size*l_blocks < _TRANSFER_TASKS_PER_THREAD_*number_of_threads))
+      l_blocks++;
+  }
+  l_blocks = MIN(l_blocks,ptr->l_size_max);
+  l_block_size = (ptr->l_size_max+l_blocks-1)/l_blocks;
+  l_blocks = (ptr->l_size_max+l_block_size-1)/l_block_size;
+
+  use_HIS_cache = ((pba->sgnK != 0) && (l_blocks > 1)) ? _TRUE_ : _FALSE_;
+
+  if (ptr->transfer_verbose > 1)
+    printf(" -> %zu wavenumbers times %d blocks of multipoles, in %d pass(es)\n",ptr->q_size,l_blocks,pass_size);
 
   /* initialize error management flag */
   abort = _FALSE_;
 
-  /* beginning of parallel region */
+  /** - loop over passes. For each of them: */
+
+  for (index_pass = 0; (index_pass < pass_size) && (abort == _FALSE_); index_pass++) {
+
+    ppass = &(pass[index_pass]);
+
+    /** - copy the sources of this pass to a local array sources (in fact, only the pointers are copied, not the data), and eventually apply non-linear corrections to the sources (unless we are in low-memory mode, where they are applied on demand) */
+
+    class_alloc(sources,
+                ptr->md_size*sizeof(source_t**),
+                ptr->error_message);
+
+    class_call(transfer_perturbation_copy_sources_and_nl_corrections(ppr,ppt,pnl,ptr,!low_memory_sources,ppass,sources),
+               ptr->error_message,
+               ptr->error_message);
+
+    /** - spline these sources with respect to k (in order to interpolate later at a given value of k), unless we are in low-memory mode */
+
+    if (low_memory_sources == _FALSE_) {
+
+      class_alloc(sources_spline,
+                  ptr->md_size*sizeof(source_t**),
+                  ptr->error_message);
+
+      class_call(transfer_perturbation_source_spline(ppt,ptr,ppass,sources,sources_spline),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+    else {
+      sources_spline = NULL;
+    }
+
+    if (use_HIS_cache == _TRUE_) {
+      class_call(transfer_HIS_cache_init(ptr,l_blocks,&HIS_cache),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+
+    /* (a.3.) workspace, allocated in a parallel zone since in openmp
+       version there is one workspace per thread */
+
+    /* beginning of parallel region */
 
 #pragma omp parallel                                                    \
-  shared(tau_size_max,ptr,ppr,pba,ppt,tp_of_tt,tau_rec,sources_spline,abort,BIS,tau0) \
-  private(ptw,index_q,tstart,tstop,tspent)
-  {
+  shared(tau_size_max,ptr,ppr,pba,ppt,pnl,tp_of_tt,tau_rec,ppass,sources,sources_spline,low_memory_sources,abort,tau0,l_blocks,l_block_size,use_HIS_cache,HIS_cache) \
+  private(ptw,index_task,index_q,index_l_start,tstart,tstop,tspent)
+    {
 
 #ifdef _OPENMP
-    tspent = 0.;
+      tspent = 0.;
 #endif
 
-    /* allocate workspace */
+      /* allocate workspace */
+
+      class_call_parallel(transfer_workspace_init(ptr,
+                                                  ppr,
+                                                  &ptw,
+                                                  ppt->tau_size,
+                                                  tau_size_max,
+                                                  pba->K,
+                                                  pba->sgnK,
+                                                  tau0-pth->tau_cut,
+                                                  &(ptr->BIS)),
+                          ptr->error_message,
+                          ptr->error_message);
 
-    class_call_parallel(transfer_workspace_init(ptr,
-                                                ppr,
-                                                &ptw,
-                                                ppt->tau_size,
-                                                tau_size_max,
-                                                pba->K,
-                                                pba->sgnK,
-                                                tau0-pth->tau_cut,
-                                                &BIS),
-                        ptr->error_message,
-                        ptr->error_message);
+      if (low_memory_sources == _TRUE_) {
+        class_call_parallel(transfer_workspace_init_source_window(ppr,ppt,pnl,ptr,ptw),
+                            ptr->error_message,
+                            ptr->error_message);
+      }
 
-    /** - loop over all wavenumbers (parallelized).*/
-    /* For each wavenumber: */
+      /** - loop over all (wavenumber, block of multipoles) pairs
+          (parallelized). Blocks of a given wavenumber are consecutive,
+          so that the hyperspherical Bessel functions shared by them stay
+          in the cache for a short time only. */
+      /* For each pair: */
 
 #pragma omp for schedule (dynamic)
 
-    for (index_q = 0; index_q < ptr->q_size; index_q++) {
+      for (index_task = 0; index_task < (int)ptr->q_size*l_blocks; index_task++) {
 
 #ifdef _OPENMP
-      tstart = omp_get_wtime();
+        tstart = omp_get_wtime();
 #endif
 
-      if (ptr->transfer_verbose > 2)
-        printf("Compute transfer for wavenumber [%d/%zu]\n",index_q,ptr->q_size-1);
+        index_q = index_task / l_blocks;
+        index_l_start = (index_task % l_blocks) * l_block_size;
 
-      /* Update interpolation structure: */
-      class_call_parallel(transfer_update_HIS(ppr,
-                                              ptr,
-                                              ptw,
-                                              index_q,
-                                              tau0),
-                          ptr->error_message,
-                          ptr->error_message);
+        if ((ptr->transfer_verbose > 2) && (index_l_start == 0))
+          printf("Compute transfer for wavenumber [%d/%zu]\n",index_q,ptr->q_size-1);
 
-      class_call_parallel(transfer_compute_for_each_q(ppr,
-                                                      pba,
-                                                      ppt,
-                                                      ptr,
-                                                      tp_of_tt,
-                                                      index_q,
-                                                      tau_size_max,
-                                                      tau_rec,
-                                                      sources,
-                                                      sources_spline,
-                                                      ptw),
-                          ptr->error_message,
-                          ptr->error_message);
+        /* Update interpolation structure: */
+        if (use_HIS_cache == _TRUE_) {
+          class_call_parallel(transfer_HIS_cache_get(ppr,
+                                                     ptr,
+                                                     ptw,
+                                                     &HIS_cache,
+                                                     index_q,
+                                                     tau0),
+                              ptr->error_message,
+                              ptr->error_message);
+        }
+        else {
+          class_call_parallel(transfer_update_HIS(ppr,
+                                                  ptr,
+                                                  ptw,
+                                                  index_q,
+                                                  tau0),
+                              ptr->error_message,
+                              ptr->error_message);
+        }
+
+        class_call_parallel(transfer_compute_for_each_q(ppr,
+                                                        pba,
+                                                        ppt,
+                                                        ptr,
+                                                        tp_of_tt,
+                                                        index_q,
+                                                        index_l_start,
+                                                        index_l_start+l_block_size,
+                                                        tau_size_max,
+                                                        tau_rec,
+                                                        ppass,
+                                                        sources,
+                                                        sources_spline,
+                                                        ptw),
+                            ptr->error_message,
+                            ptr->error_message);
+
+        if (use_HIS_cache == _TRUE_) {
+          class_call_parallel(transfer_HIS_cache_release(ptr,
+                                                         &HIS_cache,
+                                                         index_q),
+                              ptr->error_message,
+                              ptr->error_message);
+        }
 
 #ifdef _OPENMP
-      tstop = omp_get_wtime();
+        tstop = omp_get_wtime();
 
-      tspent += tstop-tstart;
+        tspent += tstop-tstart;
 #endif
 
 #pragma omp flush(abort)
 
-    } /* end of loop over wavenumber */
+      } /* end of loop over (wavenumber, block of multipoles) */
 
-    /* free workspace allocated inside parallel zone */
-    class_call_parallel(transfer_workspace_free(ptr,ptw),
-                        ptr->error_message,
-                        ptr->error_message);
+      /* free workspace allocated inside parallel zone */
+      class_call_parallel(transfer_workspace_free(ptr,ptw),
+                          ptr->error_message,
+                          ptr->error_message);
 
 #ifdef _OPENMP
-    if (ptr->transfer_verbose>1)
-      printf("In %s: time spent in parallel region (loop over k's) = %e s for thread %d\n",
-             __func__,tspent,omp_get_thread_num());
+      if (ptr->transfer_verbose>1)
+        printf("In %s: time spent in parallel region (loop over k's and l's) = %e s for thread %d\n",
+               __func__,tspent,omp_get_thread_num());
 #endif
 
-  } /* end of parallel region */
+    } /* end of parallel region */
 
-  if (abort == _TRUE_) return _FAILURE_;
+    /** - free the arrays of this pass */
 
-  /** - finally, free arrays allocated outside parallel zone */
+    if (use_HIS_cache == _TRUE_) {
+      class_call(transfer_HIS_cache_free(ptr,&HIS_cache),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
 
-  class_call(transfer_perturbation_sources_spline_free(ppt,ptr,sources_spline),
-             ptr->error_message,
-             ptr->error_message);
+    if (low_memory_sources == _FALSE_) {
+      class_call(transfer_perturbation_sources_spline_free(ppt,ptr,sources_spline),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
 
-  class_call(transfer_perturbation_sources_free(ppt,pnl,ptr,sources),
-             ptr->error_message,
-             ptr->error_message);
+    class_call(transfer_perturbation_sources_free(ppt,pnl,ptr,!low_memory_sources,sources),
+               ptr->error_message,
+               ptr->error_message);
+
+  } /* end of loop over passes */
+
+  class_call(hyperspherical_HIS_device_release(ptr->BIS_device),
+             ptr->error_message,
+             ptr->error_message);
+  ptr->BIS_device = NULL;
+
+  if (abort == _TRUE_) return _FAILURE_;
+
+  /** - finally, free arrays allocated outside parallel zone */
+
+  free(pass);
 
   class_call(transfer_free_source_correspondence(ptr,tp_of_tt),
              ptr->error_message,
              ptr->error_message);
 
-  class_call(hyperspherical_HIS_free(&BIS,ptr->error_message),
+  class_call(transfer_selection_table_free(ppt,ptr),
+             ptr->error_message,
+             ptr->error_message);
+
+  class_call(hyperspherical_HIS_free(&(ptr->BIS),ptr->error_message),
              ptr->error_message,
              ptr->error_message);
+  class_profile_stop(&(ptr->profile));
   return _SUCCESS_;
 }
 
@@ -419,35 +783,42 @@ int transfer_free(
                   struct transfers * ptr
                   ) {
 
-  int index_md;
-
   if (ptr->has_cls == _TRUE_) {
 
-    for (index_md = 0; index_md < ptr->md_size; index_md++) {
-      free(ptr->l_size_tt[index_md]);
-      free(ptr->transfer[index_md]);
-      free(ptr->k[index_md]);
-    }
+    class_call(transfer_free_functions(ptr),
+               ptr->error_message,
+               ptr->error_message);
 
-    free(ptr->tt_size);
-    free(ptr->l_size_tt);
-    free(ptr->l_size);
-    free(ptr->l);
+    /* all other tables of the structure are in its arena */
     free(ptr->q);
-    free(ptr->k);
-    free(ptr->transfer);
+    transfer_arena_free(&(ptr->arena));
+  }
 
-    if (ptr->nz_size > 0) {
-      free(ptr->nz_z);
-      free(ptr->nz_nz);
-      free(ptr->nz_ddnz);
-    }
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine frees the table of transfer functions only, keeping
+ * the other fields of the transfers structure. Called by
+ * driver_init() in low-memory mode, once the spectra module is done.
+ * transfer_free() must still be called at the end.
+ *
+ * @param ptr Input: pointer to transfers structure
+ * @return the error status
+ */
 
-    if (ptr->nz_evo_size > 0) {
-      free(ptr->nz_evo_z);
-      free(ptr->nz_evo_nz);
-      free(ptr->nz_evo_dlog_nz);
-      free(ptr->nz_evo_dd_dlog_nz);
+int transfer_free_functions(
+                            struct transfers * ptr
+                            ) {
+
+  int index_md;
+
+  if (ptr->has_cls == _TRUE_) {
+
+    for (index_md = 0; index_md < ptr->md_size; index_md++) {
+      free(ptr->transfer[index_md]);
+      ptr->transfer[index_md] = NULL;
     }
   }
 
@@ -489,7 +860,7 @@ int transfer_indices_of_transfers(
 
   /** - define indices for transfer types */
 
-  class_alloc(ptr->tt_size,ptr->md_size * sizeof(int),ptr->error_message);
+  transfer_alloc_arena(ptr->tt_size,ptr->md_size * sizeof(int),&(ptr->arena),ptr->error_message);
 
   /** - type indices common to scalars and tensors */
 
@@ -556,17 +927,17 @@ int transfer_indices_of_transfers(
      l_size_tt[index_md][index_tt], and maximized for each mode,
      l_size[index_md] */
 
-  class_alloc(ptr->l_size,ptr->md_size * sizeof(int),ptr->error_message);
+  transfer_alloc_arena(ptr->l_size,ptr->md_size * sizeof(int),&(ptr->arena),ptr->error_message);
 
-  class_alloc(ptr->l_size_tt,ptr->md_size * sizeof(int *),ptr->error_message);
+  transfer_alloc_arena(ptr->l_size_tt,ptr->md_size * sizeof(int *),&(ptr->arena),ptr->error_message);
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
-    class_alloc(ptr->l_size_tt[index_md],ptr->tt_size[index_md] * sizeof(int),ptr->error_message);
+    transfer_alloc_arena(ptr->l_size_tt[index_md],ptr->tt_size[index_md] * sizeof(int),&(ptr->arena),ptr->error_message);
   }
 
   /* array (of array) of transfer functions for each mode, transfer[index_md] */
 
-  class_alloc(ptr->transfer,ptr->md_size * sizeof(double *),ptr->error_message);
+  transfer_alloc_arena(ptr->transfer,ptr->md_size * sizeof(double *),&(ptr->arena),ptr->error_message);
 
   /** - get q values using transfer_get_q_list() */
 
@@ -608,7 +979,9 @@ int transfer_indices_of_transfers(
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
-    /** - allocate arrays of transfer functions, (ptr->transfer[index_md])[index_ic][index_tt][index_l][index_k] */
+    /** - allocate arrays of transfer functions, (ptr->transfer[index_md])[index_ic][index_tt][index_l][index_k],
+        outside of the arena, so that they can be freed before the
+        rest of the structure by transfer_free_functions() */
     class_alloc(ptr->transfer[index_md],
                 ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md] * ptr->q_size * sizeof(double),
                 ptr->error_message);
@@ -620,47 +993,59 @@ int transfer_indices_of_transfers(
 }
 
 int transfer_perturbation_copy_sources_and_nl_corrections(
+                                                          struct precision * ppr,
                                                           struct perturbs * ppt,
                                                           struct nonlinear * pnl,
                                                           struct transfers * ptr,
-                                                          double *** sources
+                                                          short apply_nl_corrections,
+                                                          struct transfer_pass * ppass,
+                                                          source_t *** sources
                                                           ) {
   int index_md;
   int index_ic;
   int index_tp;
   int index_k;
   int index_tau;
+  short has_nl_correction;
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
     class_alloc(sources[index_md],
-                ppt->ic_size[index_md]*ppt->tp_size[index_md]*sizeof(double*),
+                ppt->ic_size[index_md]*ppt->tp_size[index_md]*sizeof(source_t*),
                 ptr->error_message);
 
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
 
       for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
 
-        if ((pnl->method != nl_none) && (_scalars_) &&
-            (((ppt->has_source_delta_m == _TRUE_) && (index_tp == ppt->index_tp_delta_m)) ||
-             ((ppt->has_source_theta_m == _TRUE_) && (index_tp == ppt->index_tp_theta_m)) ||
-             ((ppt->has_source_phi == _TRUE_) && (index_tp == ppt->index_tp_phi)) ||
-             ((ppt->has_source_phi_prime == _TRUE_) && (index_tp == ppt->index_tp_phi_prime)) ||
-             ((ppt->has_source_phi_plus_psi == _TRUE_) && (index_tp == ppt->index_tp_phi_plus_psi)) ||
-             ((ppt->has_source_psi == _TRUE_) && (index_tp == ppt->index_tp_psi)))) {
+        /* sources of other passes are not needed now */
+        if (!_transfer_pass_includes_(ppass,index_md,index_ic,index_tp)) {
+          sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp] = NULL;
+          continue;
+        }
+
+        class_call(transfer_perturbation_source_has_nl_correction(ppt,pnl,index_md,index_tp,&has_nl_correction),
+                   ptr->error_message,
+                   ptr->error_message);
+
+        if ((apply_nl_corrections == _TRUE_) && (has_nl_correction == _TRUE_)) {
 
           class_alloc(sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
-                      ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
+                      _source_table_size_*sizeof(source_t),
                       ptr->error_message);
 
+          class_call(perturb_sources_first_touch(ppr,ppt,index_md,sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp]),
+                     ppt->error_message,
+                     ptr->error_message);
+
           for (index_tau=0; index_tau<ppt->tau_size; index_tau++) {
             for (index_k=0; index_k<ppt->k_size[index_md]; index_k++) {
               sources[index_md]
                 [index_ic * ppt->tp_size[index_md] + index_tp]
-                [index_tau * ppt->k_size[index_md] + index_k] =
+                [_source_index_(index_tau,index_k)] =
                 ppt->sources[index_md]
                 [index_ic * ppt->tp_size[index_md] + index_tp]
-                [index_tau * ppt->k_size[index_md] + index_k]
+                [_source_index_(index_tau,index_k)]
                 * pnl->nl_corr_density[index_tau * ppt->k_size[index_md] + index_k];
             }
           }
@@ -677,43 +1062,141 @@ int transfer_perturbation_copy_sources_and_nl_corrections(
 
 }
 
+/**
+ * Find whether a given perturbation source must be multiplied by the
+ * non-linear correction factor of the nonlinear module before being
+ * used by the transfer module.
+ *
+ * @param ppt               Input: pointer to perturbation structure
+ * @param pnl               Input: pointer to nonlinear structure
+ * @param index_md          Input: index of mode
+ * @param index_tp          Input: index of source type (in perturbation module)
+ * @param has_nl_correction Output: _TRUE_ if the correction applies
+ * @return the error status
+ */
+
+int transfer_perturbation_source_has_nl_correction(
+                                                   struct perturbs * ppt,
+                                                   struct nonlinear * pnl,
+                                                   int index_md,
+                                                   int index_tp,
+                                                   short * has_nl_correction
+                                                   ) {
+
+  if ((pnl->method != nl_none) && (_scalars_) &&
+      (((ppt->has_source_delta_m == _TRUE_) && (index_tp == ppt->index_tp_delta_m)) ||
+       ((ppt->has_source_theta_m == _TRUE_) && (index_tp == ppt->index_tp_theta_m)) ||
+       ((ppt->has_source_phi == _TRUE_) && (index_tp == ppt->index_tp_phi)) ||
+       ((ppt->has_source_phi_prime == _TRUE_) && (index_tp == ppt->index_tp_phi_prime)) ||
+       ((ppt->has_source_phi_plus_psi == _TRUE_) && (index_tp == ppt->index_tp_phi_plus_psi)) ||
+       ((ppt->has_source_psi == _TRUE_) && (index_tp == ppt->index_tp_psi))))
+    *has_nl_correction = _TRUE_;
+  else
+    *has_nl_correction = _FALSE_;
+
+  return _SUCCESS_;
+
+}
 
 int transfer_perturbation_source_spline(
                                         struct perturbs * ppt,
                                         struct transfers * ptr,
-                                        double *** sources,
-                                        double *** sources_spline
+                                        struct transfer_pass * ppass,
+                                        source_t *** sources,
+                                        source_t *** sources_spline
                                         ) {
   int index_md;
   int index_ic;
   int index_tp;
+  int index_tau;
+  int index_k;
+  short use_buffer;
+  /* the spline routine works on untiled tables in double precision:
+     if the source tables are different, each of them is copied to
+     (and its derivative copied back from) these buffers */
+  double * source_buffer;
+  double * source_spline_buffer;
+  source_t * source;
+  source_t * source_spline;
+
+#ifdef SINGLE_PRECISION_SOURCES
+  use_buffer = _TRUE_;
+#else
+  use_buffer = (ppt->tile_k_size > 0 ? _TRUE_ : _FALSE_);
+#endif
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
     class_alloc(sources_spline[index_md],
-                ppt->ic_size[index_md]*ppt->tp_size[index_md]*sizeof(double*),
+                ppt->ic_size[index_md]*ppt->tp_size[index_md]*sizeof(source_t*),
                 ptr->error_message);
 
+    if (use_buffer == _TRUE_) {
+      class_alloc(source_buffer,
+                  ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
+                  ptr->error_message);
+      class_alloc(source_spline_buffer,
+                  ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
+                  ptr->error_message);
+    }
+
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
 
       for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
 
+        if (!_transfer_pass_includes_(ppass,index_md,index_ic,index_tp)) {
+          sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp] = NULL;
+          continue;
+        }
+
         class_alloc(sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
-                    ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
+                    _source_table_size_*sizeof(source_t),
                     ptr->error_message);
 
-        class_call(array_spline_table_columns2(ppt->k[index_md],
-                                               ppt->k_size[index_md],
-                                               sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
-                                               ppt->tau_size,
-                                               sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
-                                               _SPLINE_EST_DERIV_,
-                                               ptr->error_message),
-                   ptr->error_message,
-                   ptr->error_message);
+        source = sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+        source_spline = sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
 
+        if (use_buffer == _TRUE_) {
+
+          for (index_tau=0; index_tau<ppt->tau_size; index_tau++)
+            for (index_k=0; index_k<ppt->k_size[index_md]; index_k++)
+              source_buffer[index_tau*ppt->k_size[index_md]+index_k] = source[_source_index_(index_tau,index_k)];
+
+          class_call(array_spline_table_columns2(ppt->k[index_md],
+                                                 ppt->k_size[index_md],
+                                                 source_buffer,
+                                                 ppt->tau_size,
+                                                 source_spline_buffer,
+                                                 _SPLINE_EST_DERIV_,
+                                                 ptr->error_message),
+                     ptr->error_message,
+                     ptr->error_message);
+
+          for (index_tau=0; index_tau<ppt->tau_size; index_tau++)
+            for (index_k=0; index_k<ppt->k_size[index_md]; index_k++)
+              source_spline[_source_index_(index_tau,index_k)] = source_spline_buffer[index_tau*ppt->k_size[index_md]+index_k];
+        }
+#ifndef SINGLE_PRECISION_SOURCES
+        else {
+
+          class_call(array_spline_table_columns2(ppt->k[index_md],
+                                                 ppt->k_size[index_md],
+                                                 source,
+                                                 ppt->tau_size,
+                                                 source_spline,
+                                                 _SPLINE_EST_DERIV_,
+                                                 ptr->error_message),
+                     ptr->error_message,
+                     ptr->error_message);
+        }
+#endif
       }
     }
+
+    if (use_buffer == _TRUE_) {
+      free(source_buffer);
+      free(source_spline_buffer);
+    }
   }
 
   return _SUCCESS_;
@@ -724,22 +1207,23 @@ int transfer_perturbation_sources_free(
                                        struct perturbs * ppt,
                                        struct nonlinear * pnl,
                                        struct transfers * ptr,
-                                       double *** sources
+                                       short apply_nl_corrections,
+                                       source_t *** sources
                                        ) {
   int index_md;
   int index_ic;
   int index_tp;
+  short has_nl_correction;
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
       for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
-        if ((pnl->method != nl_none) && (_scalars_) &&
-            (((ppt->has_source_delta_m == _TRUE_) && (index_tp == ppt->index_tp_delta_m)) ||
-             ((ppt->has_source_theta_m == _TRUE_) && (index_tp == ppt->index_tp_theta_m)) ||
-             ((ppt->has_source_phi == _TRUE_) && (index_tp == ppt->index_tp_phi)) ||
-             ((ppt->has_source_phi_prime == _TRUE_) && (index_tp == ppt->index_tp_phi_prime)) ||
-             ((ppt->has_source_phi_plus_psi == _TRUE_) && (index_tp == ppt->index_tp_phi_plus_psi)) ||
-             ((ppt->has_source_psi == _TRUE_) && (index_tp == ppt->index_tp_psi)))) {
+
+        class_call(transfer_perturbation_source_has_nl_correction(ppt,pnl,index_md,index_tp,&has_nl_correction),
+                   ptr->error_message,
+                   ptr->error_message);
+
+        if ((apply_nl_corrections == _TRUE_) && (has_nl_correction == _TRUE_)) {
 
           free(sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp]);
         }
@@ -755,7 +1239,7 @@ int transfer_perturbation_sources_free(
 int transfer_perturbation_sources_spline_free(
                                               struct perturbs * ppt,
                                               struct transfers * ptr,
-                                              double *** sources_spline
+                                              source_t *** sources_spline
                                               ) {
   int index_md;
   int index_ic;
@@ -774,6 +1258,78 @@ int transfer_perturbation_sources_spline_free(
   return _SUCCESS_;
 }
 
+/**
+ * List the passes of transfer_init_compute(). In low-memory mode
+ * (unless the sources are interpolated on demand, in which case they
+ * are never copied nor splined), there is one pass for each mode,
+ * initial condition and source type used by the transfer functions:
+ * only one source is then splined at a time, instead of all of them.
+ * Otherwise there is a single pass.
+ *
+ * @param ppr                Input: pointer to precision structure
+ * @param ppt                Input: pointer to perturbation structure
+ * @param ptr                Input: pointer to transfers structure
+ * @param tp_of_tt           Input: correspondence between transfer and perturbation source indices
+ * @param low_memory_sources Input: whether the sources are interpolated on demand by each thread
+ * @param pass               Output: list of passes, allocated here
+ * @param pass_size          Output: number of passes
+ * @return the error status
+ */
+
+int transfer_get_passes(
+                        struct precision * ppr,
+                        struct perturbs * ppt,
+                        struct transfers * ptr,
+                        int ** tp_of_tt,
+                        short low_memory_sources,
+                        struct transfer_pass ** pass,
+                        int * pass_size
+                        ) {
+
+  int index_md;
+  int index_ic;
+  int index_tp;
+  int index_tt;
+  int size;
+
+  size = 1;
+  for (index_md = 0; index_md < ptr->md_size; index_md++)
+    size += ppt->ic_size[index_md]*ppt->tp_size[index_md];
+
+  class_alloc(*pass,size*sizeof(struct transfer_pass),ptr->error_message);
+
+  *pass_size = 0;
+
+  if ((ppr->low_memory == _FALSE_) || (low_memory_sources == _TRUE_)) {
+    (*pass)[0].index_md = -1;
+    (*pass)[0].index_ic = -1;
+    (*pass)[0].index_tp = -1;
+    *pass_size = 1;
+    return _SUCCESS_;
+  }
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+      for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
+
+        /* sources which no transfer type needs get no pass */
+        for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++)
+          if (tp_of_tt[index_md][index_tt] == index_tp)
+            break;
+
+        if (index_tt < ptr->tt_size[index_md]) {
+          (*pass)[*pass_size].index_md = index_md;
+          (*pass)[*pass_size].index_ic = index_ic;
+          (*pass)[*pass_size].index_tp = index_tp;
+          (*pass_size)++;
+        }
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine defines the number and values of multipoles l for all modes.
  *
@@ -808,10 +1364,14 @@ int transfer_get_l_list(
 
     if (ppt->has_scalars == _TRUE_) {
 
-      if ((ppt->has_cl_cmb_temperature == _TRUE_) ||
-          (ppt->has_cl_cmb_polarization == _TRUE_) ||
-          (ppt->has_cl_cmb_lensing_potential == _TRUE_))
-        l_max=MAX(ppt->l_scalar_max,l_max);
+      /* only up to the largest l_max actually needed by the CMB
+         spectra (l_scalar_max unless smaller values were declared) */
+      if (ppt->has_cl_cmb_temperature == _TRUE_)
+        l_max=MAX(ppt->l_scalar_max_cmb_temperature,l_max);
+      if (ppt->has_cl_cmb_polarization == _TRUE_)
+        l_max=MAX(ppt->l_scalar_max_cmb_polarization,l_max);
+      if (ppt->has_cl_cmb_lensing_potential == _TRUE_)
+        l_max=MAX(ppt->l_scalar_max_cmb_lensing_potential,l_max);
 
       if ((ppt->has_cl_lensing_potential == _TRUE_) ||
           (ppt->has_cl_number_count == _TRUE_))
@@ -866,7 +1426,7 @@ int transfer_get_l_list(
   /** - so far we just counted the number of values. Now repeat the
       whole thing but fill array with values. */
 
-  class_alloc(ptr->l,ptr->l_size_max*sizeof(int),ptr->error_message);
+  transfer_alloc_arena(ptr->l,ptr->l_size_max*sizeof(int),&(ptr->arena),ptr->error_message);
 
   index_l = 0;
   ptr->l[0] = 2;
@@ -912,13 +1472,13 @@ int transfer_get_l_list(
 
         if ((ppt->has_cl_cmb_temperature == _TRUE_) &&
             ((index_tt == ptr->index_tt_t0) || (index_tt == ptr->index_tt_t1) || (index_tt == ptr->index_tt_t2)))
-          l_max=ppt->l_scalar_max;
+          l_max=ppt->l_scalar_max_cmb_temperature;
 
         if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e))
-          l_max=ppt->l_scalar_max;
+          l_max=ppt->l_scalar_max_cmb_polarization;
 
         if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb))
-          l_max=ppt->l_scalar_max;
+          l_max=ppt->l_scalar_max_cmb_lensing_potential;
 
         if ((_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density)) ||
             (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd)) ||
@@ -1223,11 +1783,11 @@ int transfer_get_k_list(
   int index_q;
   double m=0.;
 
-  class_alloc(ptr->k,ptr->md_size*sizeof(double*),ptr->error_message);
+  transfer_alloc_arena(ptr->k,ptr->md_size*sizeof(double*),&(ptr->arena),ptr->error_message);
 
   for (index_md = 0; index_md <  ptr->md_size; index_md++) {
 
-    class_alloc(ptr->k[index_md],ptr->q_size*sizeof(double),ptr->error_message);
+    transfer_alloc_arena(ptr->k[index_md],ptr->q_size*sizeof(double),&(ptr->arena),ptr->error_message);
 
     if (_scalars_) {
       m=0.;
@@ -1656,6 +2216,28 @@ int transfer_source_tau_size(
   return _SUCCESS_;
 }
 
+/**
+ * Compute all transfer functions for a given wavenumber and for the
+ * multipoles index_l_start <= index_l < index_l_end (the upper bound
+ * being clipped to the number of multipoles of each mode).
+ *
+ * @param ppr                 Input: pointer to precision structure
+ * @param pba                 Input: pointer to background structure
+ * @param ppt                 Input: pointer to perturbation structure
+ * @param ptr                 Input/output: pointer to transfers structure
+ * @param tp_of_tt            Input: correspondence between transfer and perturbation source indices
+ * @param index_q             Input: index of wavenumber
+ * @param index_l_start       Input: index of first multipole in the block
+ * @param index_l_end         Input: one plus index of last multipole in the block
+ * @param tau_size_max        Input: maximum number of sampling times for transfer sources
+ * @param tau_rec             Input: conformal time at recombination
+ * @param ppass               Input: pass of transfer_init_compute(): only the transfer types whose source belongs to it are computed
+ * @param pert_sources        Input: perturbation sources
+ * @param pert_sources_spline Input: second derivative of perturbation sources with respect to k (NULL in low-memory mode)
+ * @param ptw                 Input/output: pointer to transfer workspace
+ * @return the error status
+ */
+
 int transfer_compute_for_each_q(
                                 struct precision * ppr,
                                 struct background * pba,
@@ -1663,10 +2245,13 @@ int transfer_compute_for_each_q(
                                 struct transfers * ptr,
                                 int ** tp_of_tt,
                                 int index_q,
+                                int index_l_start,
+                                int index_l_end,
                                 int tau_size_max,
                                 double tau_rec,
-                                double *** pert_sources,
-                                double *** pert_sources_spline,
+                                struct transfer_pass * ppass,
+                                source_t *** pert_sources,
+                                source_t *** pert_sources_spline,
                                 struct transfer_workspace * ptw
                                 ) {
 
@@ -1682,6 +2267,10 @@ int transfer_compute_for_each_q(
   int index_tt;
   /* running index for multipoles */
   int index_l;
+  /* end of the block of multipoles for the current mode */
+  int index_l_stop;
+  /* number of multipoles computed together, starting from index_l */
+  int l_block_size;
 
   /** - we deal with workspaces, i.e. with contiguous memory zones (one
      per thread) containing various fields used by the integration
@@ -1728,6 +2317,14 @@ int transfer_compute_for_each_q(
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
+    /* restrict the block of multipoles to those of this mode; if
+       none is left, there is nothing to be done */
+
+    index_l_stop = MIN(index_l_end,ptr->l_size[index_md]);
+
+    if (index_l_start >= index_l_stop)
+      continue;
+
     /* if we reached q_max for this mode, there is nothing to be done */
 
     if (ptr->k[index_md][index_q] <= ppt->k[index_md][ppt->k_size_cl[index_md]-1]) {
@@ -1744,6 +2341,9 @@ int transfer_compute_for_each_q(
 
         for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
 
+          if (!_transfer_pass_includes_(ppass,index_md,index_ic,tp_of_tt[index_md][index_tt]))
+            continue;
+
           /** - check if we must now deal with a new source with a
               new index ppt->index_type. If yes, interpolate it at the
               right values of k. */
@@ -1752,12 +2352,14 @@ int transfer_compute_for_each_q(
 
             class_call(transfer_interpolate_sources(ppt,
                                                     ptr,
+                                                    ptw,
                                                     index_q,
                                                     index_md,
                                                     index_ic,
                                                     tp_of_tt[index_md][index_tt],
                                                     pert_sources[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
-                                                    pert_sources_spline[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
+                                                    (pert_sources_spline == NULL ? NULL :
+                                                     pert_sources_spline[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]]),
                                                     interpolated_sources),
                        ptr->error_message,
                        ptr->error_message);
@@ -1799,6 +2401,9 @@ int transfer_compute_for_each_q(
                      ptr->error_message,
                      ptr->error_message);
 
+          /* the Limber interpolations of this source start from tau0 */
+          ptw->index_tau_limber = 1;
+
           /** - Select radial function type */
           class_call(transfer_select_radial_function(
                                                      ppt,
@@ -1809,9 +2414,10 @@ int transfer_compute_for_each_q(
                      ptr->error_message,
                      ptr->error_message);
 
-          for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
+          for (index_l = index_l_start; index_l < index_l_stop; index_l += l_block_size) {
 
             l = (double)ptr->l[index_l];
+            l_block_size = 1;
 
             /* neglect transfer function when l is much smaller than k*tau0 */
             class_call(transfer_can_be_neglected(ppr,
@@ -1867,7 +2473,28 @@ int transfer_compute_for_each_q(
                          ptr->error_message,
                          ptr->error_message);
 
-              /* compute the transfer function for this l */
+              /* number of consecutive multipoles, starting from this
+                 one, that can share the same interpolation of the
+                 Bessel functions */
+              class_call(transfer_l_block_size(ppr,
+                                               ppt,
+                                               ptr,
+                                               ptw,
+                                               index_q,
+                                               index_md,
+                                               index_ic,
+                                               index_tt,
+                                               index_l,
+                                               index_l_stop,
+                                               (pba->conformal_age-tau_rec)*ptr->angular_rescaling,
+                                               q_max_bessel,
+                                               radial_type,
+                                               &l_block_size),
+                         ptr->error_message,
+                         ptr->error_message);
+
+              /* compute the transfer function for this l (and the
+                 next ones in the block) */
               class_call(transfer_compute_for_each_l(
                                                      ptw,
                                                      ppr,
@@ -1878,6 +2505,7 @@ int transfer_compute_for_each_q(
                                                      index_ic,
                                                      index_tt,
                                                      index_l,
+                                                     l_block_size,
                                                      l,
                                                      q_max_bessel,
                                                      radial_type
@@ -1898,7 +2526,11 @@ int transfer_compute_for_each_q(
 
       for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
         for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
-          for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
+
+          if (!_transfer_pass_includes_(ppass,index_md,index_ic,tp_of_tt[index_md][index_tt]))
+            continue;
+
+          for (index_l = index_l_start; index_l < index_l_stop; index_l++) {
 
             ptr->transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt)
                                      * ptr->l_size[index_md] + index_l)
@@ -1959,14 +2591,21 @@ int transfer_radial_coordinates(
  * initial condition and type (of perturbation module), to get them at
  * the right values of k, using the spline interpolation method.
  *
+ * When no spline table is passed (low-memory mode), the spline is
+ * computed on demand through a window of ptw->window_k_size rows of
+ * the source table around the requested k. The window of each source
+ * is kept in the workspace, and reused as long as the successive
+ * wavenumbers handled by the thread fall in the same range.
+ *
  * @param ppt                   Input: pointer to perturbation structure
  * @param ptr                   Input: pointer to transfers structure
+ * @param ptw                   Input/output: pointer to transfer workspace (only used in low-memory mode)
  * @param index_q               Input: index of wavenumber
  * @param index_md              Input: index of mode
  * @param index_ic              Input: index of initial condition
  * @param index_type            Input: index of type of source (in perturbation module)
  * @param pert_source           Input: array of sources
- * @param pert_source_spline    Input: array of second derivative of sources
+ * @param pert_source_spline    Input: array of second derivative of sources (or NULL in low-memory mode)
  * @param interpolated_sources  Output: array of interpolated sources (filled here but allocated in transfer_init() to avoid numerous reallocation)
  * @return the error status
  */
@@ -1974,12 +2613,13 @@ int transfer_radial_coordinates(
 int transfer_interpolate_sources(
                                  struct perturbs * ppt,
                                  struct transfers * ptr,
+                                 struct transfer_workspace * ptw,
                                  int index_q,
                                  int index_md,
                                  int index_ic,
                                  int index_type,
-                                 double * pert_source,       /* array with argument pert_source[index_tau*ppt->k_size[index_md]+index_k] (must be allocated) */
-                                 double * pert_source_spline, /* array with argument pert_source_spline[index_tau*ppt->k_size[index_md]+index_k] (must be allocated) */
+                                 source_t * pert_source,       /* array with argument pert_source[_source_index_(index_tau,index_k)] (must be allocated) */
+                                 source_t * pert_source_spline, /* array with argument pert_source_spline[_source_index_(index_tau,index_k)] (must be allocated) */
                                  double * interpolated_sources /* array with argument interpolated_sources[index_q*ppt->tau_size+index_tau] (must be allocated) */
                                  ) {
 
@@ -1996,6 +2636,14 @@ int transfer_interpolate_sources(
   /* variables used for spline interpolation algorithm */
   double h, a, b;
 
+  /* variables used to walk through tiled tables */
+  int tile_size, offset1, offset2, index_tau_in_tile, tau_max_in_tile;
+
+  /* variables used in low-memory mode */
+  int index_slot, k_min, index_k_in_window;
+  double * window_source;
+  double * window_spline;
+
   /** - interpolate at each k value using the usual
       spline interpolation algorithm. */
 
@@ -2016,14 +2664,100 @@ int transfer_interpolate_sources(
   b = (ptr->k[index_md][index_q] - ppt->k[index_md][index_k])/h;
   a = 1.-b;
 
-  for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+  if (pert_source_spline == NULL) {
+
+    /** - in low-memory mode, find the window of rows centered on
+        index_k; if it differs from the one kept in the workspace,
+        copy these rows (applying non-linear corrections if needed) and
+        spline them with respect to k */
+
+    index_slot = ptw->window_slot_of_md[index_md] + index_ic * ppt->tp_size[index_md] + index_type;
+
+    k_min = MAX(0,MIN(index_k+1-ptw->window_k_size/2,ppt->k_size[index_md]-ptw->window_k_size));
+
+    window_source = ptw->window_sources[index_slot];
+    window_spline = ptw->window_splines[index_slot];
+
+    if (window_source == NULL) {
+      class_alloc(window_source,ptw->window_k_size*ppt->tau_size*sizeof(double),ptr->error_message);
+      class_alloc(window_spline,ptw->window_k_size*ppt->tau_size*sizeof(double),ptr->error_message);
+      ptw->window_sources[index_slot] = window_source;
+      ptw->window_splines[index_slot] = window_spline;
+    }
+
+    if (ptw->window_k_min[index_slot] != k_min) {
 
-    interpolated_sources[index_tau] =
-      a * pert_source[index_tau*ppt->k_size[index_md]+index_k]
-      + b * pert_source[index_tau*ppt->k_size[index_md]+index_k+1]
-      + ((a*a*a-a) * pert_source_spline[index_tau*ppt->k_size[index_md]+index_k]
-         +(b*b*b-b) * pert_source_spline[index_tau*ppt->k_size[index_md]+index_k+1])*h*h/6.0;
+      for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+        for (index_k_in_window = 0; index_k_in_window < ptw->window_k_size; index_k_in_window++) {
+          window_source[index_tau*ptw->window_k_size+index_k_in_window] =
+            pert_source[_source_index_(index_tau,k_min+index_k_in_window)];
+          if (ptw->window_nl_corr[index_slot] == _TRUE_)
+            window_source[index_tau*ptw->window_k_size+index_k_in_window] *=
+              ptw->nl_corr_density[index_tau * ppt->k_size[index_md] + k_min+index_k_in_window];
+        }
+      }
+
+      class_call(array_spline_table_columns2(ppt->k[index_md]+k_min,
+                                             ptw->window_k_size,
+                                             window_source,
+                                             ppt->tau_size,
+                                             window_spline,
+                                             _SPLINE_EST_DERIV_,
+                                             ptr->error_message),
+                 ptr->error_message,
+                 ptr->error_message);
+
+      ptw->window_k_min[index_slot] = k_min;
+    }
 
+    index_k_in_window = index_k - k_min;
+
+    for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+
+      interpolated_sources[index_tau] =
+        a * window_source[index_tau*ptw->window_k_size+index_k_in_window]
+        + b * window_source[index_tau*ptw->window_k_size+index_k_in_window+1]
+        + ((a*a*a-a) * window_spline[index_tau*ptw->window_k_size+index_k_in_window]
+           +(b*b*b-b) * window_spline[index_tau*ptw->window_k_size+index_k_in_window+1])*h*h/6.0;
+    }
+  }
+  else if (ppt->tile_k_size == 0) {
+
+    for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+
+      interpolated_sources[index_tau] =
+        a * pert_source[index_tau*ppt->k_size[index_md]+index_k]
+        + b * pert_source[index_tau*ppt->k_size[index_md]+index_k+1]
+        + ((a*a*a-a) * pert_source_spline[index_tau*ppt->k_size[index_md]+index_k]
+           +(b*b*b-b) * pert_source_spline[index_tau*ppt->k_size[index_md]+index_k+1])*h*h/6.0;
+
+    }
+  }
+  else {
+
+    /* tiled tables: at fixed k, the values are contiguous in tau
+       inside each tile, and the tiles of a given range of k follow
+       each other with a stride tile_size */
+    tile_size = ppt->tile_tau_size*ppt->tile_k_size;
+    offset1 = _source_index_(0,index_k);
+    offset2 = _source_index_(0,index_k+1);
+
+    for (index_tau = 0; index_tau < ppt->tau_size; index_tau += ppt->tile_tau_size) {
+
+      tau_max_in_tile = MIN(ppt->tile_tau_size,ppt->tau_size-index_tau);
+
+      for (index_tau_in_tile = 0; index_tau_in_tile < tau_max_in_tile; index_tau_in_tile++) {
+
+        interpolated_sources[index_tau+index_tau_in_tile] =
+          a * pert_source[offset1+index_tau_in_tile]
+          + b * pert_source[offset2+index_tau_in_tile]
+          + ((a*a*a-a) * pert_source_spline[offset1+index_tau_in_tile]
+             +(b*b*b-b) * pert_source_spline[offset2+index_tau_in_tile])*h*h/6.0;
+      }
+
+      offset1 += tile_size;
+      offset2 += tile_size;
+    }
   }
 
   return _SUCCESS_;
@@ -2078,15 +2812,318 @@ int transfer_sources(
   /* index running on time */
   int index_tau;
 
+  /* number of tau values */
+  int tau_size;
+
+  /* conformal time today */
+  double tau0;
+
+  /* table of a source redefined by a window function, and factor depending on k multiplying it */
+  struct transfer_selection_table * pst;
+  double k_factor;
+
+  /* flag: is there any difference between the perturbation and transfer source? */
+  short redefine_source;
+
+  /** - in which cases are perturbation and transfer sources are different?
+     I.e., in which case do we need to multiply the sources by some
+     background and/or window function, and eventually to resample it,
+     or redefine its time limits? */
+
+  redefine_source = _FALSE_;
+
+  if (_scalars_) {
+
+    /* cmb lensing potential */
+    if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb))
+      redefine_source = _TRUE_;
+
+    /* number count Cl's */
+    if ((_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density)) ||
+        (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd)) ||
+        (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
+        (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
+        (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens))||
+        (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))  ||
+        (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))  ||
+        (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))  ||
+        (_index_tt_in_range_(ptr->index_tt_nc_g4,   ppt->selection_num, ppt->has_nc_gr))  ||
+        (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr))
+        )
+      redefine_source = _TRUE_;
+
+    /* galaxy lensing potential */
+    if ((ppt->has_cl_lensing_potential == _TRUE_) && (index_tt >= ptr->index_tt_lensing) && (index_tt < ptr->index_tt_lensing+ppt->selection_num))
+      redefine_source = _TRUE_;
+
+  }
+
+  /* conformal time today */
+  tau0 = pba->conformal_age;
+
+  /** - case where we need to redefine by a window function (or any
+     function of the background and of k): the time sampling, the
+     integration weights and the window function have been tabulated
+     by transfer_selection_table_init() */
+  if (redefine_source == _TRUE_) {
+
+    pst = &(ptr->selection_table[index_tt]);
+
+    tau_size = pst->tau_size;
+
+    memcpy(tau0_minus_tau,pst->tau0_minus_tau,tau_size*sizeof(double));
+    memcpy(w_trapz,pst->w_trapz,tau_size*sizeof(double));
+
+    /* lensing source: throw away times before recombination, and multiply psi by window function */
+
+    if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb)) {
+
+      k_factor = pow(ptr->k[index_md][index_q]/ptr->lcmb_pivot,ptr->lcmb_tilt);
+
+      for (index_tau = 0; index_tau < tau_size; index_tau++) {
+        sources[index_tau] =
+          interpolated_sources[pst->index_tau_sampling[index_tau]]
+          * pst->rescaling[index_tau]
+          * ptr->lcmb_rescale
+          * k_factor;
+      }
+    }
+
+    /* number count and galaxy lensing sources: resample the source
+       linearly at the tabulated times, and multiply it by the window
+       function and power of k */
+
+    else {
+
+      k_factor = pow(ptr->k[index_md][index_q],pst->k_power);
+
+      for (index_tau = 0; index_tau < tau_size; index_tau++) {
+        sources[index_tau] =
+          interpolated_sources[pst->index_tau_sampling[index_tau]] * (1.-pst->weight[index_tau])
+          + pst->weight[index_tau] * interpolated_sources[pst->index_tau_sampling[index_tau]+1];
+        sources[index_tau] *= pst->rescaling[index_tau]*k_factor;
+      }
+    }
+  }
+
+  /** - case where we do not need to redefine */
+
+  else {
+
+    /* number of sampled time values */
+    tau_size = ppt->tau_size;
+
+    /* plain copy from input array to output array */
+    memcpy(sources,
+           interpolated_sources,
+           ppt->tau_size*sizeof(double));
+
+    /* store values of (tau0-tau) */
+    for (index_tau=0; index_tau < ppt->tau_size; index_tau++) {
+      tau0_minus_tau[index_tau] = tau0 - ppt->tau_sampling[index_tau];
+    }
+
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau,
+                                          tau_size,
+                                          w_trapz,
+                                          ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  /** - return tau_size value that will be stored in the workspace (the
+     workspace wants a double) */
+
+  *tau_size_out = tau_size;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Fill the tables of the CMB lensing, number count and galaxy lensing
+ * transfer types. The time sampling of these sources, their
+ * integration weights, the window function multiplying them and the
+ * coefficients of their interpolation in time do not depend on the
+ * wavenumber, except for an overall factor depending on k: they are
+ * computed here once per type by transfer_selection_table_compute(),
+ * instead of once per wavenumber in transfer_sources().
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input/Output: pointer to transfers structure
+ * @param tau_rec  Input: recombination time
+ * @return the error status
+ */
+
+int transfer_selection_table_init(
+                                  struct precision * ppr,
+                                  struct background * pba,
+                                  struct perturbs * ppt,
+                                  struct transfers * ptr,
+                                  double tau_rec
+                                  ) {
+
+  int index_md;
+  int index_tt;
+  short needed = _FALSE_;
+  int abort;
+
+  ptr->selection_table = NULL;
+
+  if (ppt->has_scalars == _FALSE_)
+    return _SUCCESS_;
+
+  index_md = ppt->index_md_scalars;
+
+  for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+    if (transfer_selection_table_needed(ppt,ptr,index_tt) == _TRUE_)
+      needed = _TRUE_;
+  }
+
+  if (needed == _FALSE_)
+    return _SUCCESS_;
+
+  class_alloc(ptr->selection_table,
+              ptr->tt_size[index_md]*sizeof(struct transfer_selection_table),
+              ptr->error_message);
+
+  for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+    ptr->selection_table[index_tt].tau_size = 0;
+    ptr->selection_table[index_tt].tau0_minus_tau = NULL;
+    ptr->selection_table[index_tt].w_trapz = NULL;
+    ptr->selection_table[index_tt].rescaling = NULL;
+    ptr->selection_table[index_tt].index_tau_sampling = NULL;
+    ptr->selection_table[index_tt].weight = NULL;
+  }
+
+  /* the types are independent: with many bins, each of them is
+     computed by a different thread */
+
+  abort = _FALSE_;
+
+#pragma omp parallel for schedule(dynamic) shared(ppr,pba,ppt,ptr,tau_rec,index_md,abort)
+  for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+    if (transfer_selection_table_needed(ppt,ptr,index_tt) == _TRUE_) {
+      class_call_parallel(transfer_selection_table_compute(ppr,
+                                                           pba,
+                                                           ppt,
+                                                           ptr,
+                                                           tau_rec,
+                                                           index_tt,
+                                                           &(ptr->selection_table[index_tt])),
+                          ptr->error_message,
+                          ptr->error_message);
+    }
+  }
+
+  if (abort == _TRUE_) return _FAILURE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the tables filled by transfer_selection_table_init()
+ *
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input/Output: pointer to transfers structure
+ * @return the error status
+ */
+
+int transfer_selection_table_free(
+                                  struct perturbs * ppt,
+                                  struct transfers * ptr
+                                  ) {
+
+  int index_tt;
+
+  if (ptr->selection_table == NULL)
+    return _SUCCESS_;
+
+  for (index_tt = 0; index_tt < ptr->tt_size[ppt->index_md_scalars]; index_tt++) {
+    free(ptr->selection_table[index_tt].tau0_minus_tau);
+    free(ptr->selection_table[index_tt].w_trapz);
+    free(ptr->selection_table[index_tt].rescaling);
+    free(ptr->selection_table[index_tt].index_tau_sampling);
+    free(ptr->selection_table[index_tt].weight);
+  }
+
+  free(ptr->selection_table);
+  ptr->selection_table = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Is the given scalar transfer type multiplied by a window function,
+ * i.e. does it have an entry in ptr->selection_table?
+ *
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input: pointer to transfers structure
+ * @param index_tt Input: index of scalar transfer type
+ * @return _TRUE_ or _FALSE_
+ */
+
+short transfer_selection_table_needed(
+                                      struct perturbs * ppt,
+                                      struct transfers * ptr,
+                                      int index_tt
+                                      ) {
+
+  if (((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb)) ||
+      (_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density)) ||
+      (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd)) ||
+      (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
+      (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
+      (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens))||
+      (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))  ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))  ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))  ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g4,   ppt->selection_num, ppt->has_nc_gr))  ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr))  ||
+      (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential)))
+    return _TRUE_;
+
+  return _FALSE_;
+}
+
+/**
+ * Compute the time sampling, the integration weights, the rescaling
+ * factor and the interpolation coefficients of one CMB lensing,
+ * number count or galaxy lensing transfer type (see struct
+ * transfer_selection_table).
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input: pointer to transfers structure
+ * @param tau_rec  Input: recombination time
+ * @param index_tt Input: index of scalar transfer type
+ * @param pst      Output: table of this type
+ * @return the error status
+ */
+
+int transfer_selection_table_compute(
+                                     struct precision * ppr,
+                                     struct background * pba,
+                                     struct perturbs * ppt,
+                                     struct transfers * ptr,
+                                     double tau_rec,
+                                     int index_tt,
+                                     struct transfer_selection_table * pst
+                                     ) {
+
+  /* index running on time */
+  int index_tau;
+
   /* bin for computation of cl_density */
   int bin=0;
 
   /* number of tau values */
   int tau_size;
 
-  /* minimum tau index kept in transfer sources */
-  int index_tau_min;
-
   /* for calling background_at_eta */
   int last_index;
   double * pvecback = NULL;
@@ -2094,18 +3131,15 @@ int transfer_sources(
   /* conformal time */
   double tau, tau0;
 
-  /* geometrical quantities */
-  double sinKgen_source=0.;
-  double sinKgen_source_to_lens=0.;
-  double cotKgen_source=0.;
-  double cscKgen_lens=0.;
+  /* geometrical quantities, with the factors of k of transfer_sources() removed */
+  double sinK_source=0.;
+  double sinK_source_to_lens=0.;
+  double cotK_source=0.;
+  double sinK_lens=0.;
 
   /* rescaling factor depending on the background at a given time */
   double rescaling=0.;
 
-  /* flag: is there any difference between the perturbation and transfer source? */
-  short redefine_source;
-
   /* array of selection function values at different times */
   double * selection;
 
@@ -2129,712 +3163,652 @@ int transfer_sources(
   double dNdz;
   double dln_dNdz_dz;
 
-  /** - in which cases are perturbation and transfer sources are different?
-     I.e., in which case do we need to multiply the sources by some
-     background and/or window function, and eventually to resample it,
-     or redefine its time limits? */
+  /* first time kept for the CMB lensing source */
+  int index_tau_min;
 
-  redefine_source = _FALSE_;
+  /* bisection in ppt->tau_sampling */
+  int inf,sup,mid;
 
-  if (_scalars_) {
+  /* shorter names */
+  double * tau0_minus_tau;
+  double * w_trapz;
 
-    /* cmb lensing potential */
-    if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb))
-      redefine_source = _TRUE_;
+  /* conformal time today */
+  tau0 = pba->conformal_age;
 
-    /* number count Cl's */
-    if ((_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density)) ||
-        (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd)) ||
-        (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
-        (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
-        (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens))||
-        (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))  ||
-        (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))  ||
-        (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))  ||
-        (_index_tt_in_range_(ptr->index_tt_nc_g4,   ppt->selection_num, ppt->has_nc_gr))  ||
-        (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr))
-        )
-      redefine_source = _TRUE_;
+  class_call(transfer_source_tau_size(ppr,
+                                      pba,
+                                      ppt,
+                                      ptr,
+                                      tau_rec,
+                                      tau0,
+                                      ppt->index_md_scalars,
+                                      index_tt,
+                                      &tau_size),
+             ptr->error_message,
+             ptr->error_message);
 
-    /* galaxy lensing potential */
-    if ((ppt->has_cl_lensing_potential == _TRUE_) && (index_tt >= ptr->index_tt_lensing) && (index_tt < ptr->index_tt_lensing+ppt->selection_num))
-      redefine_source = _TRUE_;
+  class_alloc(pst->tau0_minus_tau,tau_size*sizeof(double),ptr->error_message);
+  class_alloc(pst->w_trapz,tau_size*sizeof(double),ptr->error_message);
+  class_alloc(pst->rescaling,tau_size*sizeof(double),ptr->error_message);
+  class_alloc(pst->index_tau_sampling,tau_size*sizeof(int),ptr->error_message);
+  class_alloc(pst->weight,tau_size*sizeof(double),ptr->error_message);
+  pst->tau_size = tau_size;
+  pst->k_power = 0;
 
-  }
+  tau0_minus_tau = pst->tau0_minus_tau;
+  w_trapz = pst->w_trapz;
 
-  /* conformal time today */
-  tau0 = pba->conformal_age;
+  /* CMB lensing source: throw away times before recombination, and multiply psi by window function */
 
-  /** - case where we need to redefine by a window function (or any
-     function of the background and of k) */
-  if (redefine_source == _TRUE_) {
+  if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb)) {
 
-    class_call(transfer_source_tau_size(ppr,
-                                        pba,
-                                        ppt,
-                                        ptr,
-                                        tau_rec,
-                                        tau0,
-                                        index_md,
-                                        index_tt,
-                                        &tau_size),
+    /* first time step after removing early times */
+    index_tau_min =  ppt->tau_size - tau_size;
+
+    /* loop over time and rescale */
+    for (index_tau = index_tau_min; index_tau < ppt->tau_size; index_tau++) {
+
+      /* conformal time */
+      tau = ppt->tau_sampling[index_tau];
+
+      /* lensing source =  - W(tau) (phi(k,tau) + psi(k,tau)) Heaviside(tau-tau_rec)
+         with
+         psi,phi = metric perturbation in newtonian gauge (phi+psi = Phi_A-Phi_H of Bardeen)
+         W = (tau-tau_rec)/(tau_0-tau)/(tau_0-tau_rec)
+         H(x) = Heaviside
+         (in tau = tau_0, set source = 0 to avoid division by zero;
+         regulated anyway by Bessel).
+      */
+
+      if (index_tau == ppt->tau_size-1) {
+        rescaling=0.;
+      }
+      else {
+        switch (pba->sgnK){
+        case 1:
+          rescaling = sqrt(pba->K)
+            *sin((tau_rec-tau)*sqrt(pba->K))
+            /sin((tau0-tau)*sqrt(pba->K))
+            /sin((tau0-tau_rec)*sqrt(pba->K));
+          break;
+        case 0:
+          rescaling = (tau_rec-tau)/(tau0-tau)/(tau0-tau_rec);
+          break;
+        case -1:
+          rescaling = sqrt(-pba->K)
+            *sinh((tau_rec-tau)*sqrt(-pba->K))
+            /sinh((tau0-tau)*sqrt(-pba->K))
+            /sinh((tau0-tau_rec)*sqrt(-pba->K));
+          break;
+        }
+        // Note: until 2.4.3 there was a bug here: the curvature effects had been omitted.
+      }
+
+      /* the source is taken at the sampled times, without interpolation */
+      pst->rescaling[index_tau-index_tau_min] = rescaling;
+      pst->index_tau_sampling[index_tau-index_tau_min] = index_tau;
+      pst->weight[index_tau-index_tau_min] = 0.;
+
+      /* store value of (tau0-tau) */
+      tau0_minus_tau[index_tau-index_tau_min] = tau0 - tau;
+
+    }
+
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau,
+                                          tau_size,
+                                          w_trapz,
+                                          ptr->error_message),
                ptr->error_message,
                ptr->error_message);
 
-    if (_scalars_) {
+    return _SUCCESS_;
+  }
 
-      /* lensing source: throw away times before recombination, and multiply psi by window function */
+  /* density source: redefine the time sampling, multiply by
+     coefficient of Poisson equation, and multiply by selection
+     function */
 
-      if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb)) {
+  if ((_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density)) ||
+      (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd)) ||
+      (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
+      (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))  ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))  ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
+      ) {
 
-        /* first time step after removing early times */
-        index_tau_min =  ppt->tau_size - tau_size;
+    /* bin number associated to particular redshift bin and selection function */
+    if (_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density))
+      bin = index_tt - ptr->index_tt_density;
 
-        /* loop over time and rescale */
-        for (index_tau = index_tau_min; index_tau < ppt->tau_size; index_tau++) {
+    if (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd))
+      bin = index_tt - ptr->index_tt_rsd;
 
-          /* conformal time */
-          tau = ppt->tau_sampling[index_tau];
+    if (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd))
+      bin = index_tt - ptr->index_tt_d0;
 
-          /* lensing source =  - W(tau) (phi(k,tau) + psi(k,tau)) Heaviside(tau-tau_rec)
-             with
-             psi,phi = metric perturbation in newtonian gauge (phi+psi = Phi_A-Phi_H of Bardeen)
-             W = (tau-tau_rec)/(tau_0-tau)/(tau_0-tau_rec)
-             H(x) = Heaviside
-             (in tau = tau_0, set source = 0 to avoid division by zero;
-             regulated anyway by Bessel).
-          */
+    if (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd))
+      bin = index_tt - ptr->index_tt_d1;
 
-          if (index_tau == ppt->tau_size-1) {
-            rescaling=0.;
-          }
-          else {
-            switch (pba->sgnK){
-            case 1:
-              rescaling = sqrt(pba->K)
-                *sin((tau_rec-tau)*sqrt(pba->K))
-                /sin((tau0-tau)*sqrt(pba->K))
-                /sin((tau0-tau_rec)*sqrt(pba->K));
-              break;
-            case 0:
-              rescaling = (tau_rec-tau)/(tau0-tau)/(tau0-tau_rec);
-              break;
-            case -1:
-              rescaling = sqrt(-pba->K)
-                *sinh((tau_rec-tau)*sqrt(-pba->K))
-                /sinh((tau0-tau)*sqrt(-pba->K))
-                /sinh((tau0-tau_rec)*sqrt(-pba->K));
-              break;
-            }
-            // Note: until 2.4.3 there was a bug here: the curvature effects had been omitted.
-          }
+    if (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))
+      bin = index_tt - ptr->index_tt_nc_g1;
 
-          /* copy from input array to output array */
-          sources[index_tau-index_tau_min] =
-            interpolated_sources[index_tau]
-            * rescaling
-            * ptr->lcmb_rescale
-            * pow(ptr->k[index_md][index_q]/ptr->lcmb_pivot,ptr->lcmb_tilt);
+    if (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))
+      bin = index_tt - ptr->index_tt_nc_g2;
 
-          /* store value of (tau0-tau) */
-          tau0_minus_tau[index_tau-index_tau_min] = tau0 - tau;
+    if (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
+      bin = index_tt - ptr->index_tt_nc_g3;
 
-        }
+    /* allocate temporary arrays for storing sources and for calling background */
+    class_alloc(selection,tau_size*sizeof(double),ptr->error_message);
+    class_alloc(pvecback,pba->bg_size*sizeof(double),ptr->error_message);
 
-        /* Compute trapezoidal weights for integration over tau */
-        class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                              tau_size,
-                                              w_trapz,
-                                              ptr->error_message),
-                   ptr->error_message,
-                   ptr->error_message);
+    /* redefine the time sampling */
+    class_call(transfer_selection_sampling(ppr,
+                                           pba,
+                                           ppt,
+                                           ptr,
+                                           bin,
+                                           tau0_minus_tau,
+                                           tau_size),
+               ptr->error_message,
+               ptr->error_message);
+
+    class_test(tau0 - tau0_minus_tau[0] > ppt->tau_sampling[ppt->tau_size-1],
+               ptr->error_message,
+               "this should not happen, there was probably a rounding error, if this error occurred, then this must be coded more carefully");
+
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau,
+                                          tau_size,
+                                          w_trapz,
+                                          ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+
+    /* compute values of selection function at sampled values of tau */
+    class_call(transfer_selection_compute(ppr,
+                                          pba,
+                                          ppt,
+                                          ptr,
+                                          selection,
+                                          tau0_minus_tau,
+                                          w_trapz,
+                                          tau_size,
+                                          pvecback,
+                                          tau0,
+                                          bin),
+               ptr->error_message,
+               ptr->error_message);
+
+    /* powers of k in the terms below */
+
+    if (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd))
+      pst->k_power = -2;
+
+    if (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd))
+      pst->k_power = -1;
+
+    /* loop over time and rescale */
+    for (index_tau = 0; index_tau < tau_size; index_tau++) {
+
+      /* conformal time */
+      tau = tau0 - tau0_minus_tau[index_tau];
+
+      /* geometrical quantity */
+      switch (pba->sgnK){
+      case 1:
+        cotK_source = sqrt(pba->K)
+          *cos(tau0_minus_tau[index_tau]*sqrt(pba->K))
+          /sin(tau0_minus_tau[index_tau]*sqrt(pba->K));
+        break;
+      case 0:
+        cotK_source = 1./tau0_minus_tau[index_tau];
+        break;
+      case -1:
+        cotK_source = sqrt(-pba->K)
+          *cosh(tau0_minus_tau[index_tau]*sqrt(-pba->K))
+          /sinh(tau0_minus_tau[index_tau]*sqrt(-pba->K));
+        break;
       }
 
-      /* density source: redefine the time sampling, multiply by
-         coefficient of Poisson equation, and multiply by selection
-         function */
+      /* corresponding background quantities */
+      class_call(background_at_tau(pba,
+                                   tau,
+                                   pba->long_info,
+                                   pba->inter_normal,
+                                   &last_index,
+                                   pvecback),
+                 pba->error_message,
+                 ptr->error_message);
+
+      /* Source evolution, used by number counf rsd and number count gravity terms */
 
-      if ((_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density)) ||
-          (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd)) ||
-          (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
+      if ((_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
           (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
-          (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))  ||
-          (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))  ||
-          (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
-          ) {
+          (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))) {
 
-        /* bin number associated to particular redshift bin and selection function */
-        if (_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density))
-          bin = index_tt - ptr->index_tt_density;
+        if((ptr->has_nz_evo_file == _TRUE_) || (ptr->has_nz_evo_analytic == _TRUE_)){
 
-        if (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd))
-          bin = index_tt - ptr->index_tt_rsd;
+          f_evo = 2./pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a]/tau0_minus_tau[index_tau]
+            + pvecback[pba->index_bg_H_prime]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
 
-        if (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd))
-          bin = index_tt - ptr->index_tt_d0;
+          z = pba->a_today/pvecback[pba->index_bg_a]-1.;
 
-        if (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd))
-          bin = index_tt - ptr->index_tt_d1;
-
-        if (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))
-          bin = index_tt - ptr->index_tt_nc_g1;
+          if (ptr->has_nz_evo_file ==_TRUE_) {
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))
-          bin = index_tt - ptr->index_tt_nc_g2;
+            class_test((z<ptr->nz_evo_z[0]) || (z>ptr->nz_evo_z[ptr->nz_evo_size-1]),
+                       ptr->error_message,
+                       "Your input file for the selection function only covers the redshift range [%f : %f]. However, your input for the selection function requires z=%f",
+                       ptr->nz_evo_z[0],
+                       ptr->nz_evo_z[ptr->nz_evo_size-1],
+                       z);
+
+
+            class_call(array_interpolate_spline(
+                                                ptr->nz_evo_z,
+                                                ptr->nz_evo_size,
+                                                ptr->nz_evo_dlog_nz,
+                                                ptr->nz_evo_dd_dlog_nz,
+                                                1,
+                                                z,
+                                                &last_index,
+                                                &dln_dNdz_dz,
+                                                1,
+                                                ptr->error_message),
+                       ptr->error_message,
+                       ptr->error_message);
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
-          bin = index_tt - ptr->index_tt_nc_g3;
+          }
+          else {
 
-        /* allocate temporary arrays for storing sources and for calling background */
-        class_alloc(selection,tau_size*sizeof(double),ptr->error_message);
-        class_alloc(pvecback,pba->bg_size*sizeof(double),ptr->error_message);
+            class_call(transfer_dNdz_analytic(ptr,
+                                              z,
+                                              &dNdz,
+                                              &dln_dNdz_dz),
+                       ptr->error_message,
+                       ptr->error_message);
+          }
 
-        /* redefine the time sampling */
-        class_call(transfer_selection_sampling(ppr,
-                                               pba,
-                                               ppt,
-                                               ptr,
-                                               bin,
-                                               tau0_minus_tau,
-                                               tau_size),
-                   ptr->error_message,
-                   ptr->error_message);
+          f_evo -= dln_dNdz_dz/pvecback[pba->index_bg_a];
+        }
+        else {
+          f_evo = 0.;
+        }
 
-        class_test(tau0 - tau0_minus_tau[0] > ppt->tau_sampling[ppt->tau_size-1],
-                   ptr->error_message,
-                   "this should not happen, there was probably a rounding error, if this error occurred, then this must be coded more carefully");
-
-        /* resample the source at those times */
-        class_call(transfer_source_resample(ppr,
-                                            pba,
-                                            ppt,
-                                            ptr,
-                                            bin,
-                                            tau0_minus_tau,
-                                            tau_size,
-                                            index_md,
-                                            tau0,
-                                            interpolated_sources,
-                                            sources),
-                   ptr->error_message,
-                   ptr->error_message);
+      }
 
-        /* Compute trapezoidal weights for integration over tau */
-        class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                              tau_size,
-                                              w_trapz,
-                                              ptr->error_message),
-                   ptr->error_message,
-                   ptr->error_message);
+      /* matter density source =  [- (dz/dtau) W(z)] * delta_m(k,tau)
+         = W(tau) delta_m(k,tau)
+         with
+         delta_m = total matter perturbation (defined in gauge-independent way, see arXiv 1307.1459)
+         W(z) = redshift space selection function = dN/dz
+         W(tau) = same wrt conformal time = dN/dtau
+         (in tau = tau_0, set source = 0 to avoid division by zero;
+         regulated anyway by Bessel).
+      */
 
-        /* compute values of selection function at sampled values of tau */
-        class_call(transfer_selection_compute(ppr,
-                                              pba,
-                                              ppt,
-                                              ptr,
-                                              selection,
-                                              tau0_minus_tau,
-                                              w_trapz,
-                                              tau_size,
-                                              pvecback,
-                                              tau0,
-                                              bin),
-                   ptr->error_message,
-                   ptr->error_message);
+      if (_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density))
+        rescaling = ptr->selection_bias[bin]*selection[index_tau];
 
-        /* loop over time and rescale */
-        for (index_tau = 0; index_tau < tau_size; index_tau++) {
+      /* redshift space distortion source = - [- (dz/dtau) W(z)] * (k/H) * theta(k,tau) */
 
-          /* conformal time */
-          tau = tau0 - tau0_minus_tau[index_tau];
+      if (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd))
+        rescaling = selection[index_tau]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
 
-          /* geometrical quantity */
-          switch (pba->sgnK){
-          case 1:
-            cotKgen_source = sqrt(pba->K)/ptr->k[index_md][index_q]
-              *cos(tau0_minus_tau[index_tau]*sqrt(pba->K))
-              /sin(tau0_minus_tau[index_tau]*sqrt(pba->K));
-            break;
-          case 0:
-            cotKgen_source = 1./(ptr->k[index_md][index_q]*tau0_minus_tau[index_tau]);
-            break;
-          case -1:
-            cotKgen_source = sqrt(-pba->K)/ptr->k[index_md][index_q]
-              *cosh(tau0_minus_tau[index_tau]*sqrt(-pba->K))
-              /sinh(tau0_minus_tau[index_tau]*sqrt(-pba->K));
-            break;
-          }
+      /* times 1/k^2 */
+      if (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd))
+        rescaling = (f_evo-3.)*selection[index_tau]*pvecback[pba->index_bg_H]*pvecback[pba->index_bg_a];
 
-          /* corresponding background quantities */
-          class_call(background_at_tau(pba,
-                                       tau,
-                                       pba->long_info,
-                                       pba->inter_normal,
-                                       &last_index,
-                                       pvecback),
-                     pba->error_message,
-                     ptr->error_message);
+      /* times 1/k */
+      if (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd))
 
-          /* Source evolution, used by number counf rsd and number count gravity terms */
+        rescaling = selection[index_tau]*(1.
+                                          +pvecback[pba->index_bg_H_prime]
+                                          /pvecback[pba->index_bg_a]
+                                          /pvecback[pba->index_bg_H]
+                                          /pvecback[pba->index_bg_H]
+                                          +(2.-5.*ptr->selection_magnification_bias[bin])
+                                          *cotK_source
+                                          /pvecback[pba->index_bg_a]
+                                          /pvecback[pba->index_bg_H]
+                                          +5.*ptr->selection_magnification_bias[bin]
+                                          -f_evo
+                                          );
 
-          if ((_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
-              (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
-              (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))) {
+      if (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))
 
-            if((ptr->has_nz_evo_file == _TRUE_) || (ptr->has_nz_evo_analytic == _TRUE_)){
+        rescaling = selection[index_tau];
 
-              f_evo = 2./pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a]/tau0_minus_tau[index_tau]
-                + pvecback[pba->index_bg_H_prime]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
+      if (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))
 
-              z = pba->a_today/pvecback[pba->index_bg_a]-1.;
+        rescaling = -selection[index_tau]*(3.
+                                           +pvecback[pba->index_bg_H_prime]
+                                           /pvecback[pba->index_bg_a]
+                                           /pvecback[pba->index_bg_H]
+                                           /pvecback[pba->index_bg_H]
+                                           +(2.-5.*ptr->selection_magnification_bias[bin])
+                                           *cotK_source
+                                           /pvecback[pba->index_bg_a]
+                                           /pvecback[pba->index_bg_H]
+                                           -f_evo
+                                           );
 
-              if (ptr->has_nz_evo_file ==_TRUE_) {
+      if (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
+        rescaling = selection[index_tau]/pvecback[pba->index_bg_a]/pvecback[pba->index_bg_H];
 
-                class_test((z<ptr->nz_evo_z[0]) || (z>ptr->nz_evo_z[ptr->nz_evo_size-1]),
-                           ptr->error_message,
-                           "Your input file for the selection function only covers the redshift range [%f : %f]. However, your input for the selection function requires z=%f",
-                           ptr->nz_evo_z[0],
-                           ptr->nz_evo_z[ptr->nz_evo_size-1],
-                           z);
+      pst->rescaling[index_tau] = rescaling;
 
+    }
 
-                class_call(array_interpolate_spline(
-                                                    ptr->nz_evo_z,
-                                                    ptr->nz_evo_size,
-                                                    ptr->nz_evo_dlog_nz,
-                                                    ptr->nz_evo_dd_dlog_nz,
-                                                    1,
-                                                    z,
-                                                    &last_index,
-                                                    &dln_dNdz_dz,
-                                                    1,
-                                                    ptr->error_message),
-                           ptr->error_message,
-                           ptr->error_message);
+    /* deallocate temporary arrays */
+    free(pvecback);
+    free(selection);
+  }
 
-              }
-              else {
+  /* lensing potential: eliminate early times, and multiply by selection
+     function */
 
-                class_call(transfer_dNdz_analytic(ptr,
-                                                  z,
-                                                  &dNdz,
-                                                  &dln_dNdz_dz),
-                           ptr->error_message,
-                           ptr->error_message);
-              }
+  if ((_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential)) ||
+      (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens)) ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g4,   ppt->selection_num, ppt->has_nc_gr)) ||
+      (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr))
+      ) {
 
-              f_evo -= dln_dNdz_dz/pvecback[pba->index_bg_a];
-            }
-            else {
-              f_evo = 0.;
-            }
+    /* bin number associated to particular redshift bin and selection function */
+    if (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential))
+      bin = index_tt - ptr->index_tt_lensing;
 
-          }
+    if (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens))
+      bin = index_tt - ptr->index_tt_nc_lens;
 
-          /* matter density source =  [- (dz/dtau) W(z)] * delta_m(k,tau)
-             = W(tau) delta_m(k,tau)
-             with
-             delta_m = total matter perturbation (defined in gauge-independent way, see arXiv 1307.1459)
-             W(z) = redshift space selection function = dN/dz
-             W(tau) = same wrt conformal time = dN/dtau
-             (in tau = tau_0, set source = 0 to avoid division by zero;
-             regulated anyway by Bessel).
-          */
-
-          if (_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density))
-            rescaling = ptr->selection_bias[bin]*selection[index_tau];
-
-          /* redshift space distortion source = - [- (dz/dtau) W(z)] * (k/H) * theta(k,tau) */
-
-          if (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd))
-            rescaling = selection[index_tau]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
-
-          if (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd))
-            rescaling = (f_evo-3.)*selection[index_tau]*pvecback[pba->index_bg_H]*pvecback[pba->index_bg_a]
-              /ptr->k[index_md][index_q]/ptr->k[index_md][index_q];
-
-          if (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd))
-
-            rescaling = selection[index_tau]*(1.
-                                              +pvecback[pba->index_bg_H_prime]
-                                              /pvecback[pba->index_bg_a]
-                                              /pvecback[pba->index_bg_H]
-                                              /pvecback[pba->index_bg_H]
-                                              +(2.-5.*ptr->selection_magnification_bias[bin])
-                                              // /tau0_minus_tau[index_tau] // in flat space
-                                              *cotKgen_source*ptr->k[index_md][index_q]  // in general case
-                                              /pvecback[pba->index_bg_a]
-                                              /pvecback[pba->index_bg_H]
-                                              +5.*ptr->selection_magnification_bias[bin]
-                                              -f_evo
-                                              )/ptr->k[index_md][index_q];
-
-          if (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))
-
-            rescaling = selection[index_tau];
-
-          if (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))
-
-            rescaling = -selection[index_tau]*(3.
-                                               +pvecback[pba->index_bg_H_prime]
-                                               /pvecback[pba->index_bg_a]
-                                               /pvecback[pba->index_bg_H]
-                                               /pvecback[pba->index_bg_H]
-                                               +(2.-5.*ptr->selection_magnification_bias[bin])
-                                               // /tau0_minus_tau[index_tau]  // in flat space
-                                               *cotKgen_source*ptr->k[index_md][index_q]  // in general case
-                                               /pvecback[pba->index_bg_a]
-                                               /pvecback[pba->index_bg_H]
-                                               -f_evo
-                                               );
-
-          if (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
-            rescaling = selection[index_tau]/pvecback[pba->index_bg_a]/pvecback[pba->index_bg_H];
-
-          sources[index_tau] *= rescaling;
+    if (_index_tt_in_range_(ptr->index_tt_nc_g4,   ppt->selection_num, ppt->has_nc_gr))
+      bin = index_tt - ptr->index_tt_nc_g4;
 
-        }
+    /* times k */
+    if (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr)) {
+      bin = index_tt - ptr->index_tt_nc_g5;
+      pst->k_power = 1;
+    }
 
-        /* deallocate temporary arrays */
-        free(pvecback);
-        free(selection);
-      }
+    /* allocate temporary arrays for storing sources and for calling background */
+    class_alloc(pvecback,
+                pba->bg_size*sizeof(double),
+                ptr->error_message);
 
-      /* lensing potential: eliminate early times, and multiply by selection
-         function */
+    /* dirac case */
+    if (ppt->selection == dirac) {
+      tau_sources_size=1;
+    }
+    /* other cases (gaussian, tophat...) */
+    else {
+      tau_sources_size=ppr->selection_sampling;
+    }
 
-      if ((_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential)) ||
-          (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens)) ||
-          (_index_tt_in_range_(ptr->index_tt_nc_g4,   ppt->selection_num, ppt->has_nc_gr)) ||
-          (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr))
-          ) {
+    class_alloc(selection,
+                tau_sources_size*sizeof(double),
+                ptr->error_message);
 
-        /* bin number associated to particular redshift bin and selection function */
-        if (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential))
-          bin = index_tt - ptr->index_tt_lensing;
+    class_alloc(tau0_minus_tau_lensing_sources,
+                tau_sources_size*sizeof(double),
+                ptr->error_message);
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens))
-          bin = index_tt - ptr->index_tt_nc_lens;
+    class_alloc(w_trapz_lensing_sources,
+                tau_sources_size*sizeof(double),
+                ptr->error_message);
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_g4,   ppt->selection_num, ppt->has_nc_gr))
-          bin = index_tt - ptr->index_tt_nc_g4;
+    /* time sampling for source selection function */
+    class_call(transfer_selection_sampling(ppr,
+                                           pba,
+                                           ppt,
+                                           ptr,
+                                           bin,
+                                           tau0_minus_tau_lensing_sources,
+                                           tau_sources_size),
+               ptr->error_message,
+               ptr->error_message);
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr))
-          bin = index_tt - ptr->index_tt_nc_g5;
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau_lensing_sources,
+                                          tau_sources_size,
+                                          w_trapz_lensing_sources,
+                                          ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
 
-        /* allocate temporary arrays for storing sources and for calling background */
-        class_alloc(pvecback,
-                    pba->bg_size*sizeof(double),
-                    ptr->error_message);
+    /* compute values of selection function at sampled values of tau */
+    class_call(transfer_selection_compute(ppr,
+                                          pba,
+                                          ppt,
+                                          ptr,
+                                          selection,
+                                          tau0_minus_tau_lensing_sources,
+                                          w_trapz_lensing_sources,
+                                          tau_sources_size,
+                                          pvecback,
+                                          tau0,
+                                          bin),
+               ptr->error_message,
+               ptr->error_message);
 
-        /* dirac case */
-        if (ppt->selection == dirac) {
-          tau_sources_size=1;
-        }
-        /* other cases (gaussian, tophat...) */
-        else {
-          tau_sources_size=ppr->selection_sampling;
-        }
+    /* redefine the time sampling */
+    class_call(transfer_lensing_sampling(ppr,
+                                         pba,
+                                         ppt,
+                                         ptr,
+                                         bin,
+                                         tau0,
+                                         tau0_minus_tau,
+                                         tau_size),
+               ptr->error_message,
+               ptr->error_message);
 
-        class_alloc(selection,
-                    tau_sources_size*sizeof(double),
-                    ptr->error_message);
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau,
+                                          tau_size,
+                                          w_trapz,
+                                          ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
 
-        class_alloc(tau0_minus_tau_lensing_sources,
-                    tau_sources_size*sizeof(double),
-                    ptr->error_message);
+    /* loop over time and rescale */
+    for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
-        class_alloc(w_trapz_lensing_sources,
-                    tau_sources_size*sizeof(double),
-                    ptr->error_message);
+      /* lensing source =  - W(tau) (phi(k,tau) + psi(k,tau)) Heaviside(tau-tau_rec)
+         with
+         psi,phi = metric perturbation in newtonian gauge (phi+psi = Phi_A-Phi_H of Bardeen)
+         W = (tau-tau_rec)/(tau_0-tau)/(tau_0-tau_rec)
+         H(x) = Heaviside
+         (in tau = tau_0, set source = 0 to avoid division by zero;
+         regulated anyway by Bessel).
+      */
+
+      if (index_tau == tau_size-1) {
+        rescaling=0.;
+      }
+      else {
 
-        /* time sampling for source selection function */
-        class_call(transfer_selection_sampling(ppr,
-                                               pba,
-                                               ppt,
-                                               ptr,
-                                               bin,
-                                               tau0_minus_tau_lensing_sources,
-                                               tau_sources_size),
-                   ptr->error_message,
-                   ptr->error_message);
+        rescaling = 0.;
 
-        /* Compute trapezoidal weights for integration over tau */
-        class_call(array_trapezoidal_mweights(tau0_minus_tau_lensing_sources,
-                                              tau_sources_size,
-                                              w_trapz_lensing_sources,
-                                              ptr->error_message),
-                   ptr->error_message,
-                   ptr->error_message);
+        for (index_tau_sources=0;
+             index_tau_sources < tau_sources_size;
+             index_tau_sources++) {
 
-        /* compute values of selection function at sampled values of tau */
-        class_call(transfer_selection_compute(ppr,
-                                              pba,
-                                              ppt,
-                                              ptr,
-                                              selection,
-                                              tau0_minus_tau_lensing_sources,
-                                              w_trapz_lensing_sources,
-                                              tau_sources_size,
-                                              pvecback,
-                                              tau0,
-                                              bin),
-                   ptr->error_message,
-                   ptr->error_message);
+          switch (pba->sgnK){
+          case 1:
+            sinK_source = sin(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sqrt(pba->K);
+            sinK_source_to_lens = sin((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(pba->K))/sqrt(pba->K);
+            cotK_source = cos(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sinK_source;
+            sinK_lens = sin(sqrt(pba->K)*tau0_minus_tau[index_tau])/sqrt(pba->K);
+            break;
+          case 0:
+            sinK_source = tau0_minus_tau_lensing_sources[index_tau_sources];
+            sinK_source_to_lens = tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources];
+            cotK_source = 1./tau0_minus_tau_lensing_sources[index_tau_sources];
+            sinK_lens = tau0_minus_tau[index_tau];
+            break;
+          case -1:
+            sinK_source = sinh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sqrt(-pba->K);
+            sinK_source_to_lens = sinh((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(-pba->K))/sqrt(-pba->K);
+            cotK_source = cosh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sinK_source;
+            sinK_lens = sinh(sqrt(-pba->K)*tau0_minus_tau[index_tau])/sqrt(-pba->K);
+            break;
+          }
 
-        /* redefine the time sampling */
-        class_call(transfer_lensing_sampling(ppr,
-                                             pba,
-                                             ppt,
-                                             ptr,
-                                             bin,
-                                             tau0,
-                                             tau0_minus_tau,
-                                             tau_size),
-                   ptr->error_message,
-                   ptr->error_message);
+          /* condition for excluding from the sum the sources located in z=zero */
+          if ((tau0_minus_tau_lensing_sources[index_tau_sources] > 0.) && (tau0_minus_tau_lensing_sources[index_tau_sources]-tau0_minus_tau[index_tau] > 0.)) {
 
-        /* resample the source at those times */
-        class_call(transfer_source_resample(ppr,
-                                            pba,
-                                            ppt,
-                                            ptr,
-                                            bin,
-                                            tau0_minus_tau,
-                                            tau_size,
-                                            index_md,
-                                            tau0,
-                                            interpolated_sources,
-                                            sources),
-                   ptr->error_message,
-                   ptr->error_message);
+            if (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential)) {
 
-        /* Compute trapezoidal weights for integration over tau */
-        class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                              tau_size,
-                                              w_trapz,
-                                              ptr->error_message),
-                   ptr->error_message,
-                   ptr->error_message);
+              rescaling +=
+                sinK_source_to_lens
+                /sinK_lens
+                /sinK_source
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
+            }
 
-        /* loop over time and rescale */
-        for (index_tau = 0; index_tau < tau_size; index_tau++) {
+            if (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens)) {
 
-          /* lensing source =  - W(tau) (phi(k,tau) + psi(k,tau)) Heaviside(tau-tau_rec)
-             with
-             psi,phi = metric perturbation in newtonian gauge (phi+psi = Phi_A-Phi_H of Bardeen)
-             W = (tau-tau_rec)/(tau_0-tau)/(tau_0-tau_rec)
-             H(x) = Heaviside
-             (in tau = tau_0, set source = 0 to avoid division by zero;
-             regulated anyway by Bessel).
-          */
+              rescaling -=
+                (2.-5.*ptr->selection_magnification_bias[bin])/2.
+                *sinK_source_to_lens
+                /sinK_lens
+                /sinK_source
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
+            }
 
-          if (index_tau == tau_size-1) {
-            rescaling=0.;
-          }
-          else {
+            if (_index_tt_in_range_(ptr->index_tt_nc_g4, ppt->selection_num, ppt->has_nc_gr)) {
 
-            rescaling = 0.;
-
-
-            for (index_tau_sources=0;
-                 index_tau_sources < tau_sources_size;
-                 index_tau_sources++) {
-
-              switch (pba->sgnK){
-              case 1:
-                sinKgen_source = ptr->k[index_md][index_q]*sin(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sqrt(pba->K);
-                sinKgen_source_to_lens = ptr->k[index_md][index_q]*sin((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(pba->K))/sqrt(pba->K);
-                cotKgen_source = cos(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sinKgen_source;
-                cscKgen_lens = sqrt(pba->K)/ptr->k[index_md][index_q]/sin(sqrt(pba->K)*tau0_minus_tau[index_tau]);
-                break;
-              case 0:
-                sinKgen_source = ptr->k[index_md][index_q]*tau0_minus_tau_lensing_sources[index_tau_sources];
-                sinKgen_source_to_lens = ptr->k[index_md][index_q]*(tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources]);
-                cotKgen_source = 1./(ptr->k[index_md][index_q]*tau0_minus_tau_lensing_sources[index_tau_sources]);
-                cscKgen_lens = 1./(ptr->k[index_md][index_q]*tau0_minus_tau[index_tau]);
-                break;
-              case -1:
-                sinKgen_source = ptr->k[index_md][index_q]*sinh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sqrt(-pba->K);
-                sinKgen_source_to_lens = ptr->k[index_md][index_q]*sinh((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(-pba->K))/sqrt(-pba->K);
-                cotKgen_source = cosh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sinKgen_source;
-                cscKgen_lens = sqrt(-pba->K)/ptr->k[index_md][index_q]/sinh(sqrt(-pba->K)*tau0_minus_tau[index_tau]);
-                break;
-              }
+              rescaling +=
+                (2.-5.*ptr->selection_magnification_bias[bin])
+                * cotK_source
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
 
+            }
 
-              /* condition for excluding from the sum the sources located in z=zero */
-              if ((tau0_minus_tau_lensing_sources[index_tau_sources] > 0.) && (tau0_minus_tau_lensing_sources[index_tau_sources]-tau0_minus_tau[index_tau] > 0.)) {
+            if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr)) {
 
-                if (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential)) {
+              /* background quantities at time tau_lensing_source */
 
-                  rescaling +=
-                    //  *(tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])
-                    //  /tau0_minus_tau[index_tau]
-                    //  /tau0_minus_tau_lensing_sources[index_tau_sources]
-                    ptr->k[index_md][index_q]
-                    *sinKgen_source_to_lens
-                    *cscKgen_lens
-                    /sinKgen_source
-                    * selection[index_tau_sources]
-                    * w_trapz_lensing_sources[index_tau_sources];
-                }
+              class_call(background_at_tau(pba,
+                                           tau0-tau0_minus_tau_lensing_sources[index_tau_sources],
+                                           pba->long_info,
+                                           pba->inter_normal,
+                                           &last_index,
+                                           pvecback),
+                         pba->error_message,
+                         ptr->error_message);
 
-                if (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens)) {
-
-                  rescaling -=
-                    (2.-5.*ptr->selection_magnification_bias[bin])/2.
-                    //  *(tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])
-                    //  /tau0_minus_tau[index_tau]
-                    //  /tau0_minus_tau_lensing_sources[index_tau_sources]
-                    *ptr->k[index_md][index_q]
-                    *sinKgen_source_to_lens
-                    *cscKgen_lens
-                    /sinKgen_source
-                    * selection[index_tau_sources]
-                    * w_trapz_lensing_sources[index_tau_sources];
-                }
+              /* Source evolution at time tau_lensing_source */
 
-                if (_index_tt_in_range_(ptr->index_tt_nc_g4, ppt->selection_num, ppt->has_nc_gr)) {
+              if ((ptr->has_nz_evo_file == _TRUE_) || (ptr->has_nz_evo_analytic == _TRUE_)) {
 
-                  rescaling +=
-                    (2.-5.*ptr->selection_magnification_bias[bin])
-                    // /tau0_minus_tau_lensing_sources[index_tau_sources]
-                    * cotKgen_source*ptr->k[index_md][index_q]
-                    * selection[index_tau_sources]
-                    * w_trapz_lensing_sources[index_tau_sources];
+                f_evo = 2./pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a]*cotK_source
+                  + pvecback[pba->index_bg_H_prime]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
 
-                }
+                z = pba->a_today/pvecback[pba->index_bg_a]-1.;
 
-                if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr)) {
+                if (ptr->has_nz_evo_file == _TRUE_) {
 
-                  /* background quantities at time tau_lensing_source */
+                  class_test((z<ptr->nz_evo_z[0]) || (z>ptr->nz_evo_z[ptr->nz_evo_size-1]),
+                             ptr->error_message,
+                             "Your input file for the selection function only covers the redshift range [%f : %f]. However, your input for the selection function requires z=%f",
+                             ptr->nz_evo_z[0],
+                             ptr->nz_evo_z[ptr->nz_evo_size-1],
+                             z);
 
-                  class_call(background_at_tau(pba,
-                                               tau0-tau0_minus_tau_lensing_sources[index_tau_sources],
-                                               pba->long_info,
-                                               pba->inter_normal,
-                                               &last_index,
-                                               pvecback),
-                             pba->error_message,
+                  class_call(array_interpolate_spline(
+                                                      ptr->nz_evo_z,
+                                                      ptr->nz_evo_size,
+                                                      ptr->nz_evo_dlog_nz,
+                                                      ptr->nz_evo_dd_dlog_nz,
+                                                      1,
+                                                      z,
+                                                      &last_index,
+                                                      &dln_dNdz_dz,
+                                                      1,
+                                                      ptr->error_message),
+                             ptr->error_message,
                              ptr->error_message);
 
-                  /* Source evolution at time tau_lensing_source */
-
-                  if ((ptr->has_nz_evo_file == _TRUE_) || (ptr->has_nz_evo_analytic == _TRUE_)) {
-
-                    f_evo = 2./pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a]*cotKgen_source*ptr->k[index_md][index_q]
-                      + pvecback[pba->index_bg_H_prime]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
-
-                    z = pba->a_today/pvecback[pba->index_bg_a]-1.;
-
-                    if (ptr->has_nz_evo_file == _TRUE_) {
-
-                      class_test((z<ptr->nz_evo_z[0]) || (z>ptr->nz_evo_z[ptr->nz_evo_size-1]),
-                                 ptr->error_message,
-                                 "Your input file for the selection function only covers the redshift range [%f : %f]. However, your input for the selection function requires z=%f",
-                                 ptr->nz_evo_z[0],
-                                 ptr->nz_evo_z[ptr->nz_evo_size-1],
-                                 z);
-
-                      class_call(array_interpolate_spline(
-                                                          ptr->nz_evo_z,
-                                                          ptr->nz_evo_size,
-                                                          ptr->nz_evo_dlog_nz,
-                                                          ptr->nz_evo_dd_dlog_nz,
-                                                          1,
-                                                          z,
-                                                          &last_index,
-                                                          &dln_dNdz_dz,
-                                                          1,
-                                                          ptr->error_message),
-                                 ptr->error_message,
-                                 ptr->error_message);
-
-                    }
-                    else {
-
-                      class_call(transfer_dNdz_analytic(ptr,
-                                                        z,
-                                                        &dNdz,
-                                                        &dln_dNdz_dz),
-                                 ptr->error_message,
-                                 ptr->error_message);
-                    }
-
-                    f_evo -= dln_dNdz_dz/pvecback[pba->index_bg_a];
-                  }
-                  else {
-                    f_evo = 0.;
-                  }
-
-                  rescaling +=
-                    (1.
-                     + pvecback[pba->index_bg_H_prime]
-                     /pvecback[pba->index_bg_a]
-                     /pvecback[pba->index_bg_H]
-                     /pvecback[pba->index_bg_H]
-                     + (2.-5.*ptr->selection_magnification_bias[bin])
-                     //  /tau0_minus_tau_lensing_sources[index_tau_sources]
-                     * cotKgen_source*ptr->k[index_md][index_q]
-                     /pvecback[pba->index_bg_a]
-                     /pvecback[pba->index_bg_H]
-                     + 5.*ptr->selection_magnification_bias[bin]
-                     - f_evo)
-                    * ptr->k[index_md][index_q]
-                    * selection[index_tau_sources]
-                    * w_trapz_lensing_sources[index_tau_sources];
+                }
+                else {
+
+                  class_call(transfer_dNdz_analytic(ptr,
+                                                    z,
+                                                    &dNdz,
+                                                    &dln_dNdz_dz),
+                             ptr->error_message,
+                             ptr->error_message);
                 }
 
+                f_evo -= dln_dNdz_dz/pvecback[pba->index_bg_a];
+              }
+              else {
+                f_evo = 0.;
               }
-            }
-          }
 
-          /* copy from input array to output array */
-          sources[index_tau] *= rescaling;
+              rescaling +=
+                (1.
+                 + pvecback[pba->index_bg_H_prime]
+                 /pvecback[pba->index_bg_a]
+                 /pvecback[pba->index_bg_H]
+                 /pvecback[pba->index_bg_H]
+                 + (2.-5.*ptr->selection_magnification_bias[bin])
+                 * cotK_source
+                 /pvecback[pba->index_bg_a]
+                 /pvecback[pba->index_bg_H]
+                 + 5.*ptr->selection_magnification_bias[bin]
+                 - f_evo)
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
+            }
 
+          }
         }
+      }
 
-        /* deallocate temporary arrays */
-        free(pvecback);
-        free(selection);
-        free(tau0_minus_tau_lensing_sources);
-        free(w_trapz_lensing_sources);
+      pst->rescaling[index_tau] = rescaling;
 
-      }
     }
-  }
 
-  /** - case where we do not need to redefine */
+    /* deallocate temporary arrays */
+    free(pvecback);
+    free(selection);
+    free(tau0_minus_tau_lensing_sources);
+    free(w_trapz_lensing_sources);
 
-  else {
+  }
 
-    /* number of sampled time values */
-    tau_size = ppt->tau_size;
+  /* coefficients for interpolating linearly the perturbation sources
+     at the new times, as array_interpolate_two() would do */
 
-    /* plain copy from input array to output array */
-    memcpy(sources,
-           interpolated_sources,
-           ppt->tau_size*sizeof(double));
+  for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
-    /* store values of (tau0-tau) */
-    for (index_tau=0; index_tau < ppt->tau_size; index_tau++) {
-      tau0_minus_tau[index_tau] = tau0 - ppt->tau_sampling[index_tau];
-    }
+    tau = tau0-tau0_minus_tau[index_tau];
 
-    /* Compute trapezoidal weights for integration over tau */
-    class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                          tau_size,
-                                          w_trapz,
-                                          ptr->error_message),
+    class_test((tau < ppt->tau_sampling[0]) || (tau > ppt->tau_sampling[ppt->tau_size-1]),
                ptr->error_message,
-               ptr->error_message);
-  }
+               "tau=%e out of the range [%e, %e] where sources are sampled",
+               tau,ppt->tau_sampling[0],ppt->tau_sampling[ppt->tau_size-1]);
 
-  /** - return tau_size value that will be stored in the workspace (the
-     workspace wants a double) */
+    inf=0;
+    sup=ppt->tau_size-1;
 
-  *tau_size_out = tau_size;
+    while (sup-inf > 1) {
+      mid=(int)(0.5*(inf+sup));
+      if (tau < ppt->tau_sampling[mid]) {sup=mid;}
+      else {inf=mid;}
+    }
+
+    pst->index_tau_sampling[index_tau] = inf;
+    pst->weight[index_tau] = (tau-ppt->tau_sampling[inf])/(ppt->tau_sampling[sup]-ppt->tau_sampling[inf]);
+  }
 
   return _SUCCESS_;
 
@@ -3146,76 +4120,6 @@ int transfer_lensing_sampling(
 }
 
 
-/**
- * For sources that need to be multiplied by a selection function,
- * redefine a finer time sampling in a small range, and resample the
- * perturbation sources at the new value by linear interpolation
- *
- * @param ppr                   Input: pointer to precision structure
- * @param pba                   Input: pointer to background structure
- * @param ppt                   Input: pointer to perturbation structure
- * @param ptr                   Input: pointer to transfers structure
- * @param bin                   Input: redshift bin number
- * @param tau0_minus_tau        Output: values of (tau0-tau) at which source are sample
- * @param tau_size              Output: pointer to size of previous array
- * @param index_md              Input: index of mode
- * @param tau0                  Input: time today
- * @param interpolated_sources  Input: interpolated perturbation source
- * @param sources               Output: resampled transfer source
- * @return the error status
- */
-
-int transfer_source_resample(
-                             struct precision * ppr,
-                             struct background * pba,
-                             struct perturbs * ppt,
-                             struct transfers * ptr,
-                             int bin,
-                             double * tau0_minus_tau,
-                             int tau_size,
-                             int index_md,
-                             double tau0,
-                             double * interpolated_sources,
-                             double * sources) {
-
-  /* running index on time */
-  int index_tau;
-
-  /* array of values of source */
-  double * source_at_tau;
-
-  /* array of source values for a given time and for all k's */
-  class_alloc(source_at_tau,
-              sizeof(double),
-              ptr->error_message);
-
-  /* interpolate the sources linearly at the new time values */
-  for (index_tau=0; index_tau<tau_size; index_tau++) {
-
-    class_call(array_interpolate_two(ppt->tau_sampling,
-                                     1,
-                                     0,
-                                     interpolated_sources,
-                                     1,
-                                     ppt->tau_size,
-                                     tau0-tau0_minus_tau[index_tau],
-                                     source_at_tau,
-                                     1,
-                                     ptr->error_message),
-               ptr->error_message,
-               ptr->error_message);
-
-    /* copy the new values in the output sources array */
-    sources[index_tau] = source_at_tau[0];
-  }
-
-  /* deallocate the temporary array */
-  free(source_at_tau);
-
-  return _SUCCESS_;
-
-}
-
 /**
  * For each selection function, compute the min, mean and max values
  * of conformal time (associated to the min, mean and max values of
@@ -3371,32 +4275,143 @@ int transfer_selection_compute(
                  ptr->error_message,
                  ptr->error_message);
 
-      /* get corresponding dN/dtau = dN/dz * dz/dtau = dN/dz * H */
-      selection[index_tau] *= pvecback[pba->index_bg_H];
+      /* get corresponding dN/dtau = dN/dz * dz/dtau = dN/dz * H */
+      selection[index_tau] *= pvecback[pba->index_bg_H];
+
+    }
+
+    /* compute norm = \int W(tau) dtau */
+    class_call(array_trapezoidal_integral(selection,
+                                          tau_size,
+                                          w_trapz,
+                                          &norm,
+                                          ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+
+
+    /* divide W by norm so that \int W(tau) dtau = 1 */
+    for (index_tau = 0; index_tau < tau_size; index_tau++) {
+      selection[index_tau]/=norm;
+    }
+
+  }
+
+  /* trivial case: dirac distribution */
+  else {
+    selection[0] = 1.;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine finds how many consecutive multipoles, starting from
+ * index_l, can be computed together by transfer_integrate_l_block():
+ * in the flat case and for the radial function \f$ j_l \f$, the same
+ * source is convolved with Bessel functions at the same points
+ * k(tau0-tau), so that the interpolation intervals and the Hermite
+ * coefficients can be shared by all multipoles. The block stops at the
+ * first multipole which is neglected, above l_max for this type,
+ * computed with the Limber approximation, or for which the time cut of
+ * late sources differs. The block contains at least the multipole
+ * index_l and at most _TRANSFER_L_BLOCK_ multipoles.
+ *
+ * @param ppr                   Input: pointer to precision structure
+ * @param ppt                   Input: pointer to perturbation structure
+ * @param ptr                   Input: pointer to transfers structure
+ * @param ptw                   Input: pointer to transfer_workspace structure
+ * @param index_q               Input: index of wavenumber
+ * @param index_md              Input: index of mode
+ * @param index_ic              Input: index of initial condition
+ * @param index_tt              Input: index of type of transfer
+ * @param index_l               Input: index of first multipole
+ * @param index_l_stop          Input: end of the range of multipoles
+ * @param ra_rec                Input: comoving angular diameter distance to recombination (rescaled)
+ * @param q_max_bessel          Input: maximum value of argument q at which Bessel functions are computed
+ * @param radial_type           Input: type of radial (Bessel) functions to convolve with
+ * @param l_block_size          Output: number of multipoles in the block
+ * @return the error status
+ */
+
+int transfer_l_block_size(
+                          struct precision * ppr,
+                          struct perturbs * ppt,
+                          struct transfers * ptr,
+                          struct transfer_workspace * ptw,
+                          int index_q,
+                          int index_md,
+                          int index_ic,
+                          int index_tt,
+                          int index_l,
+                          int index_l_stop,
+                          double ra_rec,
+                          double q_max_bessel,
+                          radial_function_type radial_type,
+                          int * l_block_size
+                          ) {
+
+  int index_l_next;
+  double l_next;
+  short neglect, neglect_late_source, use_limber;
+
+  *l_block_size = 1;
+
+  if ((ptw->sgnK != 0) || (radial_type != SCALAR_TEMPERATURE_0) || (ptw->tau_size == 1))
+    return _SUCCESS_;
 
-    }
+  for (index_l_next = index_l;
+       (index_l_next < index_l_stop) && (index_l_next-index_l < _TRANSFER_L_BLOCK_);
+       index_l_next++) {
 
-    /* compute norm = \int W(tau) dtau */
-    class_call(array_trapezoidal_integral(selection,
-                                          tau_size,
-                                          w_trapz,
-                                          &norm,
-                                          ptr->error_message),
+    if (index_l_next >= ptr->l_size_tt[index_md][index_tt])
+      break;
+
+    l_next = (double)ptr->l[index_l_next];
+
+    class_call(transfer_can_be_neglected(ppr,
+                                         ppt,
+                                         ptr,
+                                         index_md,
+                                         index_ic,
+                                         index_tt,
+                                         ra_rec,
+                                         ptr->q[index_q],
+                                         l_next,
+                                         &neglect),
                ptr->error_message,
                ptr->error_message);
+    if (neglect == _TRUE_)
+      break;
 
+    class_call(transfer_late_source_can_be_neglected(ppr,
+                                                     ppt,
+                                                     ptr,
+                                                     index_md,
+                                                     index_tt,
+                                                     l_next,
+                                                     &neglect_late_source),
+               ptr->error_message,
+               ptr->error_message);
+    if (neglect_late_source != ptw->neglect_late_source)
+      break;
 
-    /* divide W by norm so that \int W(tau) dtau = 1 */
-    for (index_tau = 0; index_tau < tau_size; index_tau++) {
-      selection[index_tau]/=norm;
-    }
-
+    class_call(transfer_use_limber(ppr,
+                                   ppt,
+                                   ptr,
+                                   q_max_bessel,
+                                   index_md,
+                                   index_tt,
+                                   ptr->q[index_q],
+                                   l_next,
+                                   &use_limber),
+               ptr->error_message,
+               ptr->error_message);
+    if (use_limber == _TRUE_)
+      break;
   }
 
-  /* trivial case: dirac distribution */
-  else {
-    selection[0] = 1.;
-  }
+  *l_block_size = MAX(1,index_l_next-index_l);
 
   return _SUCCESS_;
 }
@@ -3417,6 +4432,11 @@ int transfer_selection_compute(
  * compromise between execution time and precision. The approximation scheme
  * is defined by parameters in the precision structure.
  *
+ * When l_block_size is larger than one, the transfer functions of the
+ * multipoles index_l to index_l+l_block_size-1 are computed together by
+ * transfer_integrate_l_block(). The caller must have checked with
+ * transfer_l_block_size() that this is possible.
+ *
  * @param ptw                   Input: pointer to transfer_workspace structure (allocated in transfer_init() to avoid numerous reallocation)
  * @param ppr                   Input: pointer to precision structure
  * @param ppt                   Input: pointer to perturbation structure
@@ -3426,6 +4446,7 @@ int transfer_selection_compute(
  * @param index_ic              Input: index of initial condition
  * @param index_tt              Input: index of type of transfer
  * @param index_l               Input: index of multipole
+ * @param l_block_size          Input: number of consecutive multipoles to compute
  * @param l                     Input: multipole
  * @param q_max_bessel          Input: maximum value of argument q at which Bessel functions are computed
  * @param radial_type           Input: type of radial (Bessel) functions to convolve with
@@ -3442,6 +4463,7 @@ int transfer_compute_for_each_l(
                                 int index_ic,
                                 int index_tt,
                                 int index_l,
+                                int l_block_size,
                                 double l,
                                 double q_max_bessel,
                                 radial_function_type radial_type
@@ -3457,6 +4479,10 @@ int transfer_compute_for_each_l(
   /* value of transfer function */
   double transfer_function;
 
+  /* values of transfer function for a block of multipoles */
+  double transfer_function_block[_TRANSFER_L_BLOCK_];
+  int index_l_block;
+
   /* whether to use the Limber approximation */
   short use_limber;
 
@@ -3475,6 +4501,35 @@ int transfer_compute_for_each_l(
   if (ptr->transfer_verbose > 3)
     printf("Compute transfer for l=%d type=%d\n",(int)l,index_tt);
 
+  /** - for a block of multipoles, convolve the source with all the
+      Bessel functions at once and store the results */
+  if (l_block_size > 1) {
+
+    class_kernel_start(kernel_transfer_integrate);
+
+    class_call(transfer_integrate_l_block(ptr,
+                                          ptw,
+                                          index_q,
+                                          index_md,
+                                          index_l,
+                                          l_block_size,
+                                          k,
+                                          transfer_function_block),
+               ptr->error_message,
+               ptr->error_message);
+
+    class_kernel_stop(kernel_transfer_integrate);
+
+    for (index_l_block = 0; index_l_block < l_block_size; index_l_block++) {
+      ptr->transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt)
+                               * ptr->l_size[index_md] + index_l + index_l_block)
+                              * ptr->q_size + index_q]
+        = transfer_function_block[index_l_block];
+    }
+
+    return _SUCCESS_;
+  }
+
   class_call(transfer_use_limber(ppr,
                                  ppt,
                                  ptr,
@@ -3502,6 +4557,8 @@ int transfer_compute_for_each_l(
 
   }
   else {
+    class_kernel_start(kernel_transfer_integrate);
+
     class_call(transfer_integrate(
                                   ppt,
                                   ptr,
@@ -3517,6 +4574,8 @@ int transfer_compute_for_each_l(
                                   ),
                ptr->error_message,
                ptr->error_message);
+
+    class_kernel_stop(kernel_transfer_integrate);
   }
 
   /** - store transfer function in transfer structure */
@@ -3650,6 +4709,9 @@ int transfer_integrate(
 
   double x_turning_point;
 
+  /* number of points of the convolution done on the offload device */
+  int nxi;
+
   /** - find minimum value of (tau0-tau) at which \f$ j_l(k[\tau_0-\tau]) \f$ is known, given that \f$ j_l(x) \f$ is sampled above some finite value \f$ x_{\min} \f$ (below which it can be approximated by zero) */
   //tau0_minus_tau_min_bessel = x_min_l/k; /* segmentation fault impossible, checked before that k != 0 */
   //printf("index_l=%d\n",index_l);
@@ -3708,32 +4770,65 @@ int transfer_integrate(
 
   /** - --> other cases */
 
-  /** - ---> (a) find index in the source's tau list corresponding to the last point in the overlapping region. After this step, index_tau_max can be as small as zero, but not negative. */
-  index_tau_max = ptw->tau_size-1;
-  while (tau0_minus_tau[index_tau_max] < tau0_minus_tau_min_bessel)
-    index_tau_max--;
-  /* Set index so we know if the truncation of the convolution integral is due to Bessel and not
-     due to the source. */
-  index_tau_max_Bessel = index_tau_max;
+  /** - ---> find index in the source's tau list corresponding to the last point in the overlapping region (see transfer_integration_range()) */
+  transfer_integration_range(ptw,
+                             tau0_minus_tau_min_bessel,
+                             &index_tau_max,
+                             &index_tau_max_Bessel);
 
-  /** - ---> (b) the source function can vanish at large \f$ \tau \f$. Check if further points can be eliminated. After this step and if we did not return a null transfer function, index_tau_max can be as small as zero, but not negative. */
-  while (sources[index_tau_max] == 0.) {
-    index_tau_max--;
-    if (index_tau_max < 0) {
-      *trsf = 0.;
-      return _SUCCESS_;
-    }
+  if (index_tau_max < 0) {
+    *trsf = 0.;
+    return _SUCCESS_;
   }
 
-  if (ptw->neglect_late_source == _TRUE_) {
+  /** - In the flat case with \f$ j_l \f$ as radial function, the
+      Bessel function is interpolated and multiplied by the source and
+      the trapezoidal weights in a single vectorised pass (see
+      hyperspherical_Hermite4_convolution_Phi(), or its offloaded
+      version for blocks of multipoles), without storing the
+      radial function. The correction for the Bessel cut-off below is
+      applied with one more interpolation. */
+  if ((ptw->sgnK == 0) && (radial_type == SCALAR_TEMPERATURE_0)) {
+
+    if (ptr->BIS_device != NULL) {
+      nxi = index_tau_max+1;
+      class_call(hyperspherical_Hermite4_convolution_Phi_block_device(ptw->pBIS,
+                                                                      ptr->BIS_device,
+                                                                      index_l,
+                                                                      1,
+                                                                      &nxi,
+                                                                      ptw->chi,
+                                                                      sources,
+                                                                      w_trapz,
+                                                                      trsf,
+                                                                      ptr->error_message),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+    else {
+      hyperspherical_Hermite4_convolution_Phi(ptw->pBIS,
+                                              index_tau_max+1,
+                                              index_l,
+                                              ptw->chi,
+                                              sources,
+                                              w_trapz,
+                                              trsf);
+    }
 
-    while (tau0_minus_tau[index_tau_max] < ptw->tau0_minus_tau_cut) {
-      index_tau_max--;
-      if (index_tau_max < 0) {
-        *trsf = 0.;
-        return _SUCCESS_;
-      }
+    if ((index_tau_max!=(ptw->tau_size-1))&&(index_tau_max==index_tau_max_Bessel)){
+      class_call(hyperspherical_Hermite4_interpolation_vector_Phi(ptw->pBIS,
+                                                                  1,
+                                                                  index_l,
+                                                                  &(ptw->chi[index_tau_max]),
+                                                                  &bessel,
+                                                                  ptr->error_message),
+                 ptr->error_message,
+                 ptr->error_message);
+      *trsf -= 0.5*(tau0_minus_tau[index_tau_max+1]-tau0_minus_tau_min_bessel)*
+        bessel*sources[index_tau_max];
     }
+
+    return _SUCCESS_;
   }
 
   /** - Compute the radial function: */
@@ -3780,6 +4875,164 @@ int transfer_integrate(
   return _SUCCESS_;
 }
 
+/**
+ * This routine finds the last point of the time sampling over which
+ * the source should be convolved with the radial function, given the
+ * minimum value of (tau0-tau) at which the radial function is known.
+ *
+ * @param ptw                       Input: pointer to transfer_workspace structure
+ * @param tau0_minus_tau_min_bessel Input: minimum value of (tau0-tau) at which the radial function is non-zero
+ * @param index_tau_max             Output: index of the last point of the integral (-1 if the integral vanishes)
+ * @param index_tau_max_Bessel      Output: index of the last point before the Bessel cut-off
+ * @return the error status
+ */
+
+int transfer_integration_range(
+                               struct transfer_workspace * ptw,
+                               double tau0_minus_tau_min_bessel,
+                               int * index_tau_max,
+                               int * index_tau_max_Bessel
+                               ) {
+
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
+  double * sources = ptw->sources;
+
+  /** - (a) find index in the source's tau list corresponding to the last point in the overlapping region. After this step, index_tau_max can be as small as zero, but not negative. */
+  *index_tau_max = ptw->tau_size-1;
+  while (tau0_minus_tau[*index_tau_max] < tau0_minus_tau_min_bessel)
+    (*index_tau_max)--;
+  /* Set index so we know if the truncation of the convolution integral is due to Bessel and not
+     due to the source. */
+  *index_tau_max_Bessel = *index_tau_max;
+
+  /** - (b) the source function can vanish at large \f$ \tau \f$. Check if further points can be eliminated. After this step, index_tau_max is negative if the transfer function vanishes. */
+  while (sources[*index_tau_max] == 0.) {
+    (*index_tau_max)--;
+    if (*index_tau_max < 0)
+      return _SUCCESS_;
+  }
+
+  if (ptw->neglect_late_source == _TRUE_) {
+
+    while (tau0_minus_tau[*index_tau_max] < ptw->tau0_minus_tau_cut) {
+      (*index_tau_max)--;
+      if (*index_tau_max < 0)
+        return _SUCCESS_;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the transfer functions of l_block_size
+ * consecutive multipoles in the flat case, for the radial function
+ * \f$ j_l \f$, like transfer_integrate() does for one of them. The
+ * source is convolved with all the Bessel functions of the block by
+ * hyperspherical_Hermite4_convolution_Phi_block(), which locates each
+ * point of the time sampling in the Bessel table only once.
+ *
+ * @param ptr            Input: pointer to transfers structure
+ * @param ptw            Input: pointer to transfer_workspace structure
+ * @param index_q        Input: index of wavenumber
+ * @param index_md       Input: index of mode
+ * @param index_l        Input: index of first multipole
+ * @param l_block_size   Input: number of multipoles (at most _TRANSFER_L_BLOCK_)
+ * @param k              Input: wavenumber
+ * @param trsf           Output: transfer functions \f$ \Delta_l(k) \f$ of the multipoles of the block
+ * @return the error status
+ */
+
+int transfer_integrate_l_block(
+                               struct transfers * ptr,
+                               struct transfer_workspace *ptw,
+                               int index_q,
+                               int index_md,
+                               int index_l,
+                               int l_block_size,
+                               double k,
+                               double * trsf
+                               ) {
+
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
+  double tau0_minus_tau_min_bessel[_TRANSFER_L_BLOCK_];
+  int index_tau_max[_TRANSFER_L_BLOCK_];
+  int index_tau_max_Bessel[_TRANSFER_L_BLOCK_];
+  int nxi[_TRANSFER_L_BLOCK_];
+  int index_l_block;
+  double bessel;
+
+  class_test(l_block_size > _TRANSFER_L_BLOCK_,
+             ptr->error_message,
+             "block of %d multipoles larger than _TRANSFER_L_BLOCK_=%d",
+             l_block_size,_TRANSFER_L_BLOCK_);
+
+  /** - find the range of integration of each multipole (none if
+      bessels and sources do not overlap) */
+  for (index_l_block = 0; index_l_block < l_block_size; index_l_block++) {
+
+    tau0_minus_tau_min_bessel[index_l_block] = ptw->pBIS->chi_at_phimin[index_l+index_l_block]/k;
+    index_tau_max[index_l_block] = -1;
+
+    if (tau0_minus_tau_min_bessel[index_l_block] < tau0_minus_tau[0]) {
+      transfer_integration_range(ptw,
+                                 tau0_minus_tau_min_bessel[index_l_block],
+                                 &(index_tau_max[index_l_block]),
+                                 &(index_tau_max_Bessel[index_l_block]));
+    }
+    nxi[index_l_block] = index_tau_max[index_l_block]+1;
+  }
+
+  /** - do most of the convolution integrals at once, on the offload
+      device if the Bessel functions were copied there */
+  if (ptr->BIS_device != NULL) {
+    class_call(hyperspherical_Hermite4_convolution_Phi_block_device(ptw->pBIS,
+                                                                    ptr->BIS_device,
+                                                                    index_l,
+                                                                    l_block_size,
+                                                                    nxi,
+                                                                    ptw->chi,
+                                                                    ptw->sources,
+                                                                    ptw->w_trapz,
+                                                                    trsf,
+                                                                    ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+  }
+  else {
+    hyperspherical_Hermite4_convolution_Phi_block(ptw->pBIS,
+                                                  index_l,
+                                                  l_block_size,
+                                                  nxi,
+                                                  ptw->chi,
+                                                  ptw->sources,
+                                                  ptw->w_trapz,
+                                                  trsf);
+  }
+
+  /** - correct each of them for the Bessel cut-off, as in transfer_integrate() */
+  for (index_l_block = 0; index_l_block < l_block_size; index_l_block++) {
+
+    if ((index_tau_max[index_l_block] >= 0) &&
+        (index_tau_max[index_l_block] != (ptw->tau_size-1)) &&
+        (index_tau_max[index_l_block] == index_tau_max_Bessel[index_l_block])) {
+
+      class_call(hyperspherical_Hermite4_interpolation_vector_Phi(ptw->pBIS,
+                                                                  1,
+                                                                  index_l+index_l_block,
+                                                                  &(ptw->chi[index_tau_max[index_l_block]]),
+                                                                  &bessel,
+                                                                  ptr->error_message),
+                 ptr->error_message,
+                 ptr->error_message);
+      trsf[index_l_block] -= 0.5*(tau0_minus_tau[index_tau_max[index_l_block]+1]-tau0_minus_tau_min_bessel[index_l_block])*
+        bessel*ptw->sources[index_tau_max[index_l_block]];
+    }
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine computes the transfer functions \f$ \Delta_l^{X} (k) \f$)
  * for each mode, initial condition, type, multipole l and wavenumber k,
@@ -3849,6 +5102,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            tau0_minus_tau_limber,
+                                           &(ptw->index_tau_limber),
                                            &S),
                ptr->error_message,
                ptr->error_message);
@@ -3883,6 +5137,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l+1.5)/q,
+                                           &(ptw->index_tau_limber),
                                            &Sp),
                ptr->error_message,
                ptr->error_message);
@@ -3892,6 +5147,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l-0.5)/q,
+                                           &(ptw->index_tau_limber),
                                            &Sm),
                ptr->error_message,
                ptr->error_message);
@@ -3915,6 +5171,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l+2.5)/q,
+                                           &(ptw->index_tau_limber),
                                            &Sp),
                ptr->error_message,
                ptr->error_message);
@@ -3924,6 +5181,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l-1.5)/q,
+                                           &(ptw->index_tau_limber),
                                            &Sm),
                ptr->error_message,
                ptr->error_message);
@@ -3933,6 +5191,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l+0.5)/q,
+                                           &(ptw->index_tau_limber),
                                            &S),
                ptr->error_message,
                ptr->error_message);
@@ -3962,6 +5221,7 @@ int transfer_limber_interpolate(
                                 double * sources,
                                 int tau_size,
                                 double tau0_minus_tau_limber,
+                                int * index_tau_limber,
                                 double * S
                                 ){
 
@@ -3971,10 +5231,19 @@ int transfer_limber_interpolate(
   /** - find  bracketing indices.
       index_tau must be at least 1 (so that index_tau-1 is at least 0)
       and at most tau_size-2 (so that index_tau+1 is at most tau_size-1).
+      It is the first index such that tau0_minus_tau[index_tau] <=
+      tau0_minus_tau_limber (or tau_size-2 if there is none).  Since
+      transfer_compute_for_each_q() calls this routine for successive
+      multipoles, i.e. nearly monotonic values of tau0_minus_tau_limber,
+      we hunt for it starting from the index found in the previous
+      call, instead of scanning the whole array from tau0.
   */
-  index_tau=1;
+  index_tau = MAX(1,MIN(*index_tau_limber,tau_size-2));
+  while ((index_tau > 1) && (tau0_minus_tau[index_tau-1] <= tau0_minus_tau_limber))
+    index_tau--;
   while ((tau0_minus_tau[index_tau] > tau0_minus_tau_limber) && (index_tau<tau_size-2))
     index_tau++;
+  *index_tau_limber = index_tau;
 
   /** - interpolate by fitting a polynomial of order two; get source
       and its first two derivatives. Note that we are not
@@ -4612,9 +5881,9 @@ int transfer_global_selection_read(
     ptr->nz_size = row-1;
 
     /* Allocate room for interpolation table */
-    class_alloc(ptr->nz_z,sizeof(double)*ptr->nz_size,ptr->error_message);
-    class_alloc(ptr->nz_nz,sizeof(double)*ptr->nz_size,ptr->error_message);
-    class_alloc(ptr->nz_ddnz,sizeof(double)*ptr->nz_size,ptr->error_message);
+    transfer_alloc_arena(ptr->nz_z,sizeof(double)*ptr->nz_size,&(ptr->arena),ptr->error_message);
+    transfer_alloc_arena(ptr->nz_nz,sizeof(double)*ptr->nz_size,&(ptr->arena),ptr->error_message);
+    transfer_alloc_arena(ptr->nz_ddnz,sizeof(double)*ptr->nz_size,&(ptr->arena),ptr->error_message);
 
     for (row=0; row<ptr->nz_size; row++){
       status = fscanf(input_file,"%lf %lf",
@@ -4652,10 +5921,10 @@ int transfer_global_selection_read(
     ptr->nz_evo_size = row-1;
 
     /* Allocate room for interpolation table */
-    class_alloc(ptr->nz_evo_z,sizeof(double)*ptr->nz_evo_size,ptr->error_message);
-    class_alloc(ptr->nz_evo_nz,sizeof(double)*ptr->nz_evo_size,ptr->error_message);
-    class_alloc(ptr->nz_evo_dlog_nz,sizeof(double)*ptr->nz_evo_size,ptr->error_message);
-    class_alloc(ptr->nz_evo_dd_dlog_nz,sizeof(double)*ptr->nz_evo_size,ptr->error_message);
+    transfer_alloc_arena(ptr->nz_evo_z,sizeof(double)*ptr->nz_evo_size,&(ptr->arena),ptr->error_message);
+    transfer_alloc_arena(ptr->nz_evo_nz,sizeof(double)*ptr->nz_evo_size,&(ptr->arena),ptr->error_message);
+    transfer_alloc_arena(ptr->nz_evo_dlog_nz,sizeof(double)*ptr->nz_evo_size,&(ptr->arena),ptr->error_message);
+    transfer_alloc_arena(ptr->nz_evo_dd_dlog_nz,sizeof(double)*ptr->nz_evo_size,&(ptr->arena),ptr->error_message);
 
     for (row=0; row<ptr->nz_evo_size; row++){
       status = fscanf(input_file,"%lf %lf",
@@ -4719,6 +5988,7 @@ int transfer_workspace_init(
   (*ptw)->sgnK = sgnK;
   (*ptw)->tau0_minus_tau_cut = tau0_minus_tau_cut;
   (*ptw)->neglect_late_source = _FALSE_;
+  (*ptw)->index_tau_limber = 1;
 
   class_alloc((*ptw)->interpolated_sources,perturb_tau_size*sizeof(double),ptr->error_message);
   class_alloc((*ptw)->sources,tau_size_max*sizeof(double),ptr->error_message);
@@ -4731,11 +6001,78 @@ int transfer_workspace_init(
   return _SUCCESS_;
 }
 
+/**
+ * Prepare the sliding windows of perturbation sources used by
+ * transfer_interpolate_sources() in low-memory mode. The windows
+ * themselves are only allocated when a source is first needed.
+ *
+ * @param ppr  Input: pointer to precision structure
+ * @param ppt  Input: pointer to perturbation structure
+ * @param pnl  Input: pointer to nonlinear structure
+ * @param ptr  Input: pointer to transfers structure
+ * @param ptw  Input/output: pointer to transfer workspace
+ * @return the error status
+ */
+
+int transfer_workspace_init_source_window(
+                                          struct precision * ppr,
+                                          struct perturbs * ppt,
+                                          struct nonlinear * pnl,
+                                          struct transfers * ptr,
+                                          struct transfer_workspace * ptw
+                                          ) {
+
+  int index_md;
+  int index_ic;
+  int index_tp;
+  int index_slot;
+  int k_size_min;
+
+  /* at least rows index_k and index_k+1 are needed, and the window
+     cannot extend beyond the smallest source table */
+  k_size_min = ppt->k_size[0];
+  for (index_md = 1; index_md < ptr->md_size; index_md++)
+    k_size_min = MIN(k_size_min,ppt->k_size[index_md]);
+
+  ptw->window_k_size = MAX(2,MIN(2*ppr->transfer_source_k_window,k_size_min));
+
+  class_alloc(ptw->window_slot_of_md,ptr->md_size*sizeof(int),ptr->error_message);
+
+  ptw->window_slot_size = 0;
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    ptw->window_slot_of_md[index_md] = ptw->window_slot_size;
+    ptw->window_slot_size += ppt->ic_size[index_md]*ppt->tp_size[index_md];
+  }
+
+  class_alloc(ptw->window_k_min,ptw->window_slot_size*sizeof(int),ptr->error_message);
+  class_alloc(ptw->window_nl_corr,ptw->window_slot_size*sizeof(short),ptr->error_message);
+  class_calloc(ptw->window_sources,ptw->window_slot_size,sizeof(double*),ptr->error_message);
+  class_calloc(ptw->window_splines,ptw->window_slot_size,sizeof(double*),ptr->error_message);
+
+  ptw->nl_corr_density = (pnl->method != nl_none ? pnl->nl_corr_density : NULL);
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+      for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
+        index_slot = ptw->window_slot_of_md[index_md] + index_ic * ppt->tp_size[index_md] + index_tp;
+        ptw->window_k_min[index_slot] = -1;
+        class_call(transfer_perturbation_source_has_nl_correction(ppt,pnl,index_md,index_tp,&(ptw->window_nl_corr[index_slot])),
+                   ptr->error_message,
+                   ptr->error_message);
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
 int transfer_workspace_free(
                             struct transfers * ptr,
                             struct transfer_workspace *ptw
                             ) {
 
+  int index_slot;
+
   if (ptw->HIS_allocated==_TRUE_){
     //Free HIS structure:
     class_call(hyperspherical_HIS_free(&(ptw->HIS),ptr->error_message),
@@ -4750,10 +6087,206 @@ int transfer_workspace_free(
   free(ptw->cscKgen);
   free(ptw->cotKgen);
 
+  if (ptw->window_k_size > 0) {
+    for (index_slot = 0; index_slot < ptw->window_slot_size; index_slot++) {
+      free(ptw->window_sources[index_slot]);
+      free(ptw->window_splines[index_slot]);
+    }
+    free(ptw->window_sources);
+    free(ptw->window_splines);
+    free(ptw->window_k_min);
+    free(ptw->window_nl_corr);
+    free(ptw->window_slot_of_md);
+  }
+
   free(ptw);
   return _SUCCESS_;
 }
 
+/**
+ * Allocate an empty cache of hyperspherical Bessel functions (see
+ * struct transfer_HIS_cache).
+ *
+ * @param ptr   Input: pointer to transfers structure
+ * @param users Input: number of tasks reading the structure of each wavenumber
+ * @param phc   Output: pointer to cache
+ * @return the error status
+ */
+
+int transfer_HIS_cache_init(
+                            struct transfers * ptr,
+                            int users,
+                            struct transfer_HIS_cache * phc
+                            ) {
+
+  int index_q;
+
+  phc->q_size = ptr->q_size;
+
+  class_alloc(phc->HIS,phc->q_size*sizeof(HyperInterpStruct),ptr->error_message);
+  class_alloc(phc->status,phc->q_size*sizeof(enum transfer_HIS_status),ptr->error_message);
+  class_alloc(phc->users,phc->q_size*sizeof(int),ptr->error_message);
+
+  for (index_q = 0; index_q < phc->q_size; index_q++) {
+    phc->status[index_q] = his_empty;
+    phc->users[index_q] = users;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Make the hyperspherical Bessel functions of a given wavenumber
+ * available in the workspace, through the shared cache. The first
+ * thread asking for them computes them with transfer_update_HIS() and
+ * hands them over to the cache; the other ones wait for this
+ * computation to be completed, and get a read-only copy of the
+ * structure (the tables themselves are not copied).
+ *
+ * @param ppr     Input: pointer to precision structure
+ * @param ptr     Input: pointer to transfers structure
+ * @param ptw     Input/output: pointer to transfer workspace
+ * @param phc     Input/output: pointer to cache
+ * @param index_q Input: index of wavenumber
+ * @param tau0    Input: conformal time today
+ * @return the error status
+ */
+
+int transfer_HIS_cache_get(
+                           struct precision * ppr,
+                           struct transfers * ptr,
+                           struct transfer_workspace * ptw,
+                           struct transfer_HIS_cache * phc,
+                           int index_q,
+                           double tau0
+                           ) {
+
+  short build;
+  int status;
+  enum transfer_HIS_status current;
+
+  /* in the flat approximation, only the flat Bessel functions are used */
+  if (index_q >= ptr->index_q_flat_approximation)
+    return _SUCCESS_;
+
+#pragma omp critical (transfer_HIS_cache)
+  {
+    build = (phc->status[index_q] == his_empty ? _TRUE_ : _FALSE_);
+    if (build == _TRUE_)
+      phc->status[index_q] = his_building;
+  }
+
+  if (build == _TRUE_) {
+
+    status = transfer_update_HIS(ppr,ptr,ptw,index_q,tau0);
+
+#pragma omp critical (transfer_HIS_cache)
+    {
+      if (status == _SUCCESS_) {
+        phc->HIS[index_q] = ptw->HIS;
+        phc->status[index_q] = his_ready;
+      }
+      else {
+        phc->status[index_q] = his_failed;
+      }
+    }
+
+    /* the tables now belong to the cache */
+    ptw->HIS_allocated = _FALSE_;
+
+    /* (the error message has been written by transfer_update_HIS()) */
+    if (status == _FAILURE_)
+      return _FAILURE_;
+  }
+  else {
+
+    /* wait until the thread computing the structure is done */
+    do {
+#pragma omp critical (transfer_HIS_cache)
+      {
+        current = phc->status[index_q];
+        if (current == his_ready)
+          ptw->HIS = phc->HIS[index_q];
+      }
+    } while (current == his_building);
+
+    class_test(current == his_failed,
+               ptr->error_message,
+               "could not compute hyperspherical Bessel functions for index_q=%d in another thread",index_q);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Tell the cache that a task reading the hyperspherical Bessel
+ * functions of a given wavenumber is over; the last one frees them.
+ *
+ * @param ptr     Input: pointer to transfers structure
+ * @param phc     Input/output: pointer to cache
+ * @param index_q Input: index of wavenumber
+ * @return the error status
+ */
+
+int transfer_HIS_cache_release(
+                               struct transfers * ptr,
+                               struct transfer_HIS_cache * phc,
+                               int index_q
+                               ) {
+
+  short last;
+
+  if (index_q >= ptr->index_q_flat_approximation)
+    return _SUCCESS_;
+
+#pragma omp critical (transfer_HIS_cache)
+  {
+    phc->users[index_q]--;
+    last = ((phc->users[index_q] == 0) && (phc->status[index_q] == his_ready)) ? _TRUE_ : _FALSE_;
+    if (last == _TRUE_)
+      phc->status[index_q] = his_empty;
+  }
+
+  if (last == _TRUE_) {
+    class_call(hyperspherical_HIS_free(&(phc->HIS[index_q]),ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the cache of hyperspherical Bessel functions, including the
+ * structures that are still there (only after a failure).
+ *
+ * @param ptr Input: pointer to transfers structure
+ * @param phc Input/output: pointer to cache
+ * @return the error status
+ */
+
+int transfer_HIS_cache_free(
+                            struct transfers * ptr,
+                            struct transfer_HIS_cache * phc
+                            ) {
+
+  int index_q;
+
+  for (index_q = 0; index_q < phc->q_size; index_q++) {
+    if ((phc->status[index_q] == his_ready) && (phc->users[index_q] > 0)) {
+      class_call(hyperspherical_HIS_free(&(phc->HIS[index_q]),ptr->error_message),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+  }
+
+  free(phc->HIS);
+  free(phc->status);
+  free(phc->users);
+
+  return _SUCCESS_;
+}
+
 int transfer_update_HIS(
                         struct precision * ppr,
                         struct transfers * ptr,
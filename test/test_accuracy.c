@@ -0,0 +1,586 @@
+/** @file test_accuracy.c
+ *
+ * Runs all modules for a given set of input files, and compares the
+ * resulting C_l's and P(k) with those of a reference run (typically
+ * with cl_ref.pre or pk_ref.pre), stored in a file by a previous call
+ * with the option -w:
+ *
+ *   ./test_accuracy -w reference.dat file.ini file.pre
+ *   ./test_accuracy [-cl reference_cl.dat] [-pk reference_pk.dat] [-o results.json] file.ini [file.pre]
+ *
+ * For each C_l type (TT, EE, TE, BB, phiphi; lensed when lensing is
+ * computed) the maximum relative error is given (relative to
+ * sqrt(C_l^TT C_l^EE) for TE), together with the chi2 of the difference
+ * for an ideal full-sky experiment limited by cosmic variance,
+ *
+ *   chi2 = sum_l (2l+1)/2 Tr[(C_l^-1 Delta C_l)^2],
+ *
+ * for TT alone and for the TT, TE, EE covariance matrix. For P(k) at
+ * z=0, the maximum relative error at the wavenumbers of the reference.
+ * The results and the wall-clock time of the run are written as a JSON
+ * object, either on the standard output or appended to the file given
+ * with -o. output_init() is not called. 'make accuracy' runs this
+ * program for a list of precision files.
+ */
+
+#include "class.h"
+#include <time.h>
+
+#define _ACCURACY_CL_TYPES_ 5   /**< number of C_l types compared: TT, EE, TE, BB, phiphi */
+#define _ACCURACY_PK_SIZE_ 200  /**< number of wavenumbers at which P(k) is stored in a reference */
+
+enum accuracy_cl_type {act_tt, act_ee, act_te, act_bb, act_pp};
+
+/**
+ * spectra computed by one run, or read from a reference file
+ */
+
+struct accuracy_spectra {
+
+  short lensed;                    /**< whether the C_l's are lensed */
+  int l_max;                       /**< last multipole (1 if no C_l's) */
+  short has[_ACCURACY_CL_TYPES_];  /**< which C_l types are available */
+  double * cl;                     /**< cl[(l-2)*_ACCURACY_CL_TYPES_+index_type] for 2 <= l <= l_max */
+
+  int k_size;                      /**< number of wavenumbers (0 if no P(k)) */
+  double * k;                      /**< k[index_k] in 1/Mpc */
+  double * pk;                     /**< pk[index_k] in Mpc^3 */
+
+};
+
+const char * accuracy_cl_name[_ACCURACY_CL_TYPES_] = {"tt","ee","te","bb","pp"};
+
+/* wall-clock time in seconds */
+double accuracy_wtime() {
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+1.e-9*now.tv_nsec;
+#endif
+}
+
+/**
+ * Fill the spectra of a run. P(k) is sampled on a logarithmic grid
+ * covering the wavenumbers of the run, or at the wavenumbers of the
+ * reference pk_reference (when not NULL) which are inside this range.
+ */
+
+int accuracy_get_spectra(
+                         struct background * pba,
+                         struct perturbs * ppt,
+                         struct primordial * ppm,
+                         struct spectra * psp,
+                         struct lensing * ple,
+                         struct output * pop,
+                         struct accuracy_spectra * pk_reference,
+                         struct accuracy_spectra * pas,
+                         ErrorMsg errmsg
+                         ) {
+
+  int l, index_type, index_k;
+  int index[_ACCURACY_CL_TYPES_];
+  double * cl;
+  double k_min, k_max;
+
+  /** - C_l's, as in the output files */
+  pas->lensed = ple->has_lensed_cls;
+  pas->l_max = 1;
+  for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++)
+    pas->has[index_type] = _FALSE_;
+
+  if (ppt->has_cls == _TRUE_) {
+
+    if (pas->lensed == _TRUE_) {
+      pas->l_max = ple->l_lensed_max;
+      pas->has[act_tt] = ple->has_tt; index[act_tt] = ple->index_lt_tt;
+      pas->has[act_ee] = ple->has_ee; index[act_ee] = ple->index_lt_ee;
+      pas->has[act_te] = ple->has_te; index[act_te] = ple->index_lt_te;
+      pas->has[act_bb] = ple->has_bb; index[act_bb] = ple->index_lt_bb;
+      pas->has[act_pp] = ple->has_pp; index[act_pp] = ple->index_lt_pp;
+      class_alloc(cl,ple->lt_size*sizeof(double),errmsg);
+    }
+    else {
+      pas->l_max = psp->l_max_tot;
+      pas->has[act_tt] = psp->has_tt; index[act_tt] = psp->index_ct_tt;
+      pas->has[act_ee] = psp->has_ee; index[act_ee] = psp->index_ct_ee;
+      pas->has[act_te] = psp->has_te; index[act_te] = psp->index_ct_te;
+      pas->has[act_bb] = psp->has_bb; index[act_bb] = psp->index_ct_bb;
+      pas->has[act_pp] = psp->has_pp; index[act_pp] = psp->index_ct_pp;
+      class_alloc(cl,psp->ct_size*sizeof(double),errmsg);
+    }
+
+    class_alloc(pas->cl,MAX(pas->l_max-1,1)*_ACCURACY_CL_TYPES_*sizeof(double),errmsg);
+
+    for (l = 2; l <= pas->l_max; l++) {
+      class_call(output_total_cl_at_l(psp,ple,pop,l,cl),
+                 pop->error_message,
+                 errmsg);
+      for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++)
+        pas->cl[(l-2)*_ACCURACY_CL_TYPES_+index_type] = (pas->has[index_type] == _TRUE_) ? cl[index[index_type]] : 0.;
+    }
+
+    free(cl);
+  }
+  else {
+    class_alloc(pas->cl,_ACCURACY_CL_TYPES_*sizeof(double),errmsg);
+  }
+
+  /** - P(k) at z=0 */
+  pas->k_size = 0;
+
+  if (ppt->has_pk_matter == _TRUE_) {
+
+    k_min = exp(psp->ln_k[0]);
+    k_max = exp(psp->ln_k[psp->ln_k_size-1]);
+
+    if (pk_reference == NULL) {
+      class_alloc(pas->k,_ACCURACY_PK_SIZE_*sizeof(double),errmsg);
+      for (index_k = 0; index_k < _ACCURACY_PK_SIZE_; index_k++)
+        pas->k[index_k] = k_min*exp(index_k*log(k_max/k_min)/(_ACCURACY_PK_SIZE_-1));
+      pas->k[_ACCURACY_PK_SIZE_-1] = k_max;
+      pas->k_size = _ACCURACY_PK_SIZE_;
+    }
+    else {
+      class_alloc(pas->k,MAX(pk_reference->k_size,1)*sizeof(double),errmsg);
+      for (index_k = 0; index_k < pk_reference->k_size; index_k++) {
+        if ((pk_reference->k[index_k] >= k_min) && (pk_reference->k[index_k] <= k_max))
+          pas->k[pas->k_size++] = pk_reference->k[index_k];
+      }
+    }
+
+    class_alloc(pas->pk,MAX(pas->k_size,1)*sizeof(double),errmsg);
+
+    for (index_k = 0; index_k < pas->k_size; index_k++) {
+      class_call(spectra_pk_at_k_and_z(pba,ppm,psp,pas->k[index_k],0.,&(pas->pk[index_k]),NULL),
+                 psp->error_message,
+                 errmsg);
+    }
+  }
+  else {
+    class_alloc(pas->k,sizeof(double),errmsg);
+    class_alloc(pas->pk,sizeof(double),errmsg);
+  }
+
+  return _SUCCESS_;
+}
+
+int accuracy_write_spectra(
+                           char * file_name,
+                           int argc,
+                           char ** argv,
+                           struct accuracy_spectra * pas,
+                           ErrorMsg errmsg
+                           ) {
+
+  FILE * out;
+  int l, index_type, index_arg, index_k;
+
+  class_open(out,file_name,"w",errmsg);
+
+  fprintf(out,"# reference spectra written by test_accuracy for:");
+  for (index_arg = 1; index_arg < argc; index_arg++)
+    fprintf(out," %s",argv[index_arg]);
+  fprintf(out,"\ncl %d %d",pas->lensed,pas->l_max);
+  for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++)
+    fprintf(out," %d",pas->has[index_type]);
+  fprintf(out,"\n");
+
+  for (l = 2; l <= pas->l_max; l++) {
+    fprintf(out,"%d",l);
+    for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++)
+      fprintf(out," %.16e",pas->cl[(l-2)*_ACCURACY_CL_TYPES_+index_type]);
+    fprintf(out,"\n");
+  }
+
+  fprintf(out,"pk %d\n",pas->k_size);
+  for (index_k = 0; index_k < pas->k_size; index_k++)
+    fprintf(out,"%.16e %.16e\n",pas->k[index_k],pas->pk[index_k]);
+
+  fclose(out);
+
+  return _SUCCESS_;
+}
+
+int accuracy_read_spectra(
+                          char * file_name,
+                          struct accuracy_spectra * pas,
+                          ErrorMsg errmsg
+                          ) {
+
+  FILE * in;
+  char line[_LINE_LENGTH_MAX_];
+  int l, index_type, index_k, lensed, has[_ACCURACY_CL_TYPES_], read;
+
+  class_open(in,file_name,"r",errmsg);
+
+  class_test(fgets(line,_LINE_LENGTH_MAX_,in) == NULL,
+             errmsg,
+             "%s is empty",file_name);
+
+  read = fscanf(in,"cl %d %d %d %d %d %d %d",&lensed,&(pas->l_max),&has[0],&has[1],&has[2],&has[3],&has[4]);
+  class_test(read != 2+_ACCURACY_CL_TYPES_,
+             errmsg,
+             "%s is not a file written by test_accuracy -w",file_name);
+  pas->lensed = lensed;
+  for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++)
+    pas->has[index_type] = has[index_type];
+
+  class_alloc(pas->cl,MAX(pas->l_max-1,1)*_ACCURACY_CL_TYPES_*sizeof(double),errmsg);
+
+  for (l = 2; l <= pas->l_max; l++) {
+    class_test(fscanf(in,"%*d") != 0,
+               errmsg,
+               "could not read line l=%d of %s",l,file_name);
+    for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++) {
+      class_test(fscanf(in,"%lf",&(pas->cl[(l-2)*_ACCURACY_CL_TYPES_+index_type])) != 1,
+                 errmsg,
+                 "could not read line l=%d of %s",l,file_name);
+    }
+  }
+
+  class_test(fscanf(in," pk %d",&(pas->k_size)) != 1,
+             errmsg,
+             "could not read the P(k) section of %s",file_name);
+
+  class_alloc(pas->k,MAX(pas->k_size,1)*sizeof(double),errmsg);
+  class_alloc(pas->pk,MAX(pas->k_size,1)*sizeof(double),errmsg);
+
+  for (index_k = 0; index_k < pas->k_size; index_k++) {
+    class_test(fscanf(in,"%lf %lf",&(pas->k[index_k]),&(pas->pk[index_k])) != 2,
+               errmsg,
+               "could not read line %d of the P(k) section of %s",index_k,file_name);
+  }
+
+  fclose(in);
+
+  return _SUCCESS_;
+}
+
+void accuracy_free_spectra(struct accuracy_spectra * pas) {
+  free(pas->cl);
+  free(pas->k);
+  free(pas->pk);
+}
+
+/**
+ * Write the comparison of the C_l's of a run with those of a reference
+ */
+
+int accuracy_compare_cl(
+                        FILE * json,
+                        struct accuracy_spectra * pas,
+                        struct accuracy_spectra * pref,
+                        ErrorMsg errmsg
+                        ) {
+
+  int l, l_max, index_type;
+  double max_error[_ACCURACY_CL_TYPES_];
+  double * cl, * cl_ref;
+  double norm, delta;
+  double chi2_tt=0., chi2_tteete=0.;
+  double det, m00, m01, m10, m11;
+  short has_tteete;
+
+  class_test(pas->lensed != pref->lensed,
+             errmsg,
+             "cannot compare %s C_l's with %s reference C_l's",
+             (pas->lensed == _TRUE_ ? "lensed" : "unlensed"),
+             (pref->lensed == _TRUE_ ? "lensed" : "unlensed"));
+
+  l_max = MIN(pas->l_max,pref->l_max);
+  has_tteete = (pas->has[act_tt] && pas->has[act_ee] && pas->has[act_te] &&
+                pref->has[act_tt] && pref->has[act_ee] && pref->has[act_te]);
+
+  for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++)
+    max_error[index_type] = 0.;
+
+  for (l = 2; l <= l_max; l++) {
+
+    cl = pas->cl+(l-2)*_ACCURACY_CL_TYPES_;
+    cl_ref = pref->cl+(l-2)*_ACCURACY_CL_TYPES_;
+
+    for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++) {
+      if ((pas->has[index_type] == _FALSE_) || (pref->has[index_type] == _FALSE_))
+        continue;
+      if (index_type == act_te)
+        norm = sqrt(fabs(cl_ref[act_tt]*cl_ref[act_ee]));
+      else
+        norm = fabs(cl_ref[index_type]);
+      if (norm > 0.)
+        max_error[index_type] = MAX(max_error[index_type],fabs(cl[index_type]-cl_ref[index_type])/norm);
+    }
+
+    if ((pas->has[act_tt] == _TRUE_) && (pref->has[act_tt] == _TRUE_) && (cl_ref[act_tt] > 0.)) {
+      delta = (cl[act_tt]-cl_ref[act_tt])/cl_ref[act_tt];
+      chi2_tt += 0.5*(2.*l+1.)*delta*delta;
+    }
+
+    /* Tr[(C^-1 Delta C)^2] with the 2x2 matrices of TT, TE, EE */
+    if (has_tteete == _TRUE_) {
+      det = cl_ref[act_tt]*cl_ref[act_ee]-cl_ref[act_te]*cl_ref[act_te];
+      if (det > 0.) {
+        m00 = (cl_ref[act_ee]*(cl[act_tt]-cl_ref[act_tt])-cl_ref[act_te]*(cl[act_te]-cl_ref[act_te]))/det;
+        m01 = (cl_ref[act_ee]*(cl[act_te]-cl_ref[act_te])-cl_ref[act_te]*(cl[act_ee]-cl_ref[act_ee]))/det;
+        m10 = (cl_ref[act_tt]*(cl[act_te]-cl_ref[act_te])-cl_ref[act_te]*(cl[act_tt]-cl_ref[act_tt]))/det;
+        m11 = (cl_ref[act_tt]*(cl[act_ee]-cl_ref[act_ee])-cl_ref[act_te]*(cl[act_te]-cl_ref[act_te]))/det;
+        chi2_tteete += 0.5*(2.*l+1.)*(m00*m00+2.*m01*m10+m11*m11);
+      }
+    }
+  }
+
+  fprintf(json,",\n   \"cl\": {\"lensed\": %s, \"l_max\": %d",(pas->lensed == _TRUE_ ? "true" : "false"),l_max);
+  for (index_type = 0; index_type < _ACCURACY_CL_TYPES_; index_type++) {
+    if ((pas->has[index_type] == _TRUE_) && (pref->has[index_type] == _TRUE_))
+      fprintf(json,", \"max_error_%s\": %.6e",accuracy_cl_name[index_type],max_error[index_type]);
+  }
+  if ((pas->has[act_tt] == _TRUE_) && (pref->has[act_tt] == _TRUE_))
+    fprintf(json,", \"chi2_tt\": %.6e",chi2_tt);
+  if (has_tteete == _TRUE_)
+    fprintf(json,", \"chi2_tteete\": %.6e",chi2_tteete);
+  fprintf(json,"}");
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the comparison of the P(k) of a run with that of a reference
+ * (the run has been sampled at the wavenumbers of the reference)
+ */
+
+int accuracy_compare_pk(
+                        FILE * json,
+                        struct accuracy_spectra * pas,
+                        struct accuracy_spectra * pref,
+                        ErrorMsg errmsg
+                        ) {
+
+  int index_k, index_k_ref=0;
+  double max_error=0.;
+
+  for (index_k = 0; index_k < pas->k_size; index_k++) {
+    while ((index_k_ref < pref->k_size) && (pref->k[index_k_ref] < pas->k[index_k]))
+      index_k_ref++;
+    class_test(index_k_ref == pref->k_size,
+               errmsg,
+               "wavenumber k=%e not found in the reference",pas->k[index_k]);
+    max_error = MAX(max_error,fabs(pas->pk[index_k]/pref->pk[index_k_ref]-1.));
+  }
+
+  fprintf(json,",\n   \"pk\": {\"k_size\": %d, \"max_error\": %.6e}",pas->k_size,max_error);
+
+  return _SUCCESS_;
+}
+
+int main(int argc, char **argv) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermo th;           /* for thermodynamics */
+  struct perturbs pt;         /* for source functions */
+  struct transfers tr;        /* for transfer functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct spectra sp;          /* for output spectra */
+  struct nonlinear nl;        /* for non-linear spectra */
+  struct lensing le;          /* for lensed spectra */
+  struct output op;           /* for output files */
+  ErrorMsg errmsg;            /* for error messages */
+
+  struct accuracy_spectra spectra, cl_reference, pk_reference;
+  char * write_name = NULL;
+  char * cl_name = NULL;
+  char * pk_name = NULL;
+  char * json_name = NULL;
+  char ** option;
+  FILE * json;
+  double start, run_time;
+  int index_arg;
+
+  /** - remove the options from the arguments passed to input_init_from_arguments() */
+  while ((argc > 2) && (argv[1][0] == '-')) {
+    if (strcmp(argv[1],"-w") == 0)
+      option = &write_name;
+    else if (strcmp(argv[1],"-cl") == 0)
+      option = &cl_name;
+    else if (strcmp(argv[1],"-pk") == 0)
+      option = &pk_name;
+    else if (strcmp(argv[1],"-o") == 0)
+      option = &json_name;
+    else {
+      printf("\n\nError: unknown option %s\n",argv[1]);
+      return _FAILURE_;
+    }
+    *option = argv[2];
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+
+  if (pk_name != NULL) {
+    if (accuracy_read_spectra(pk_name,&pk_reference,errmsg) == _FAILURE_) {
+      printf("\n\nError in accuracy_read_spectra \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  if (cl_name != NULL) {
+    if (accuracy_read_spectra(cl_name,&cl_reference,errmsg) == _FAILURE_) {
+      printf("\n\nError in accuracy_read_spectra \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  /** - run all modules, measuring the total wall-clock time */
+
+  start = accuracy_wtime();
+
+  if (input_init_from_arguments(argc, argv,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&op,errmsg) == _FAILURE_) {
+    printf("\n\nError running input_init_from_arguments \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  if (background_init(&pr,&ba) == _FAILURE_) {
+    printf("\n\nError running background_init \n=>%s\n",ba.error_message);
+    return _FAILURE_;
+  }
+
+  if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
+    printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
+    return _FAILURE_;
+  }
+
+  if (perturb_init(&pr,&ba,&th,&pt) == _FAILURE_) {
+    printf("\n\nError in perturb_init \n=>%s\n",pt.error_message);
+    return _FAILURE_;
+  }
+
+  if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
+    printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
+    return _FAILURE_;
+  }
+
+  if (nonlinear_init(&pr,&ba,&th,&pt,&pm,&nl) == _FAILURE_) {
+    printf("\n\nError in nonlinear_init \n=>%s\n",nl.error_message);
+    return _FAILURE_;
+  }
+
+  if (transfer_init(&pr,&ba,&th,&pt,&nl,&tr) == _FAILURE_) {
+    printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
+    return _FAILURE_;
+  }
+
+  if (spectra_init(&pr,&ba,&pt,&pm,&nl,&tr,&sp) == _FAILURE_) {
+    printf("\n\nError in spectra_init \n=>%s\n",sp.error_message);
+    return _FAILURE_;
+  }
+
+  if (lensing_init(&pr,&pt,&sp,&nl,&le) == _FAILURE_) {
+    printf("\n\nError in lensing_init \n=>%s\n",le.error_message);
+    return _FAILURE_;
+  }
+
+  run_time = accuracy_wtime()-start;
+
+  /** - get the spectra, and write them as a reference or compare them */
+
+  if (accuracy_get_spectra(&ba,&pt,&pm,&sp,&le,&op,(pk_name == NULL ? NULL : &pk_reference),&spectra,errmsg) == _FAILURE_) {
+    printf("\n\nError in accuracy_get_spectra \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  if (write_name != NULL) {
+    if (accuracy_write_spectra(write_name,argc,argv,&spectra,errmsg) == _FAILURE_) {
+      printf("\n\nError in accuracy_write_spectra \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  if (json_name == NULL) {
+    json = stdout;
+  }
+  else {
+    json = fopen(json_name,"a");
+    if (json == NULL) {
+      printf("\n\nError: could not open %s for writing\n",json_name);
+      return _FAILURE_;
+    }
+  }
+
+  fprintf(json,"  {\"version\": \"%s\", \"input\": [",_VERSION_);
+  for (index_arg = 1; index_arg < argc; index_arg++)
+    fprintf(json,"%s\"%s\"",(index_arg > 1 ? ", " : ""),argv[index_arg]);
+  fprintf(json,"], \"time\": %.6f",run_time);
+
+  if (cl_name != NULL) {
+    fprintf(json,", \"cl_reference\": \"%s\"",cl_name);
+    if (accuracy_compare_cl(json,&spectra,&cl_reference,errmsg) == _FAILURE_) {
+      printf("\n\nError in accuracy_compare_cl \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  if (pk_name != NULL) {
+    fprintf(json,",\n   \"pk_reference\": \"%s\"",pk_name);
+    if (accuracy_compare_pk(json,&spectra,&pk_reference,errmsg) == _FAILURE_) {
+      printf("\n\nError in accuracy_compare_pk \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  fprintf(json,"}\n");
+
+  if (json != stdout)
+    fclose(json);
+
+  accuracy_free_spectra(&spectra);
+  if (cl_name != NULL)
+    accuracy_free_spectra(&cl_reference);
+  if (pk_name != NULL)
+    accuracy_free_spectra(&pk_reference);
+
+  /****** all calculations done, now free the structures ******/
+
+  if (lensing_free(&le) == _FAILURE_) {
+    printf("\n\nError in lensing_free \n=>%s\n",le.error_message);
+    return _FAILURE_;
+  }
+
+  if (spectra_free(&sp) == _FAILURE_) {
+    printf("\n\nError in spectra_free \n=>%s\n",sp.error_message);
+    return _FAILURE_;
+  }
+
+  if (transfer_free(&tr) == _FAILURE_) {
+    printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
+    return _FAILURE_;
+  }
+
+  if (nonlinear_free(&nl) == _FAILURE_) {
+    printf("\n\nError in nonlinear_free \n=>%s\n",nl.error_message);
+    return _FAILURE_;
+  }
+
+  if (primordial_free(&pm) == _FAILURE_) {
+    printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
+    return _FAILURE_;
+  }
+
+  if (perturb_free(&pt) == _FAILURE_) {
+    printf("\n\nError in perturb_free \n=>%s\n",pt.error_message);
+    return _FAILURE_;
+  }
+
+  if (thermodynamics_free(&th) == _FAILURE_) {
+    printf("\n\nError in thermodynamics_free \n=>%s\n",th.error_message);
+    return _FAILURE_;
+  }
+
+  if (background_free(&ba) == _FAILURE_) {
+    printf("\n\nError in background_free \n=>%s\n",ba.error_message);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+
+}
@@ -0,0 +1,519 @@
+/** @file test_derivatives.c
+ *
+ * Derivatives of the C_l's with respect to cosmological parameters, for
+ * Fisher matrix forecasts, by centered finite differences:
+ *
+ *   ./test_derivatives [-t instances] -d name step [-d name step ...] file.ini [file.pre]
+ *
+ * Each parameter 'name' must be set in file.ini: its value there is the
+ * fiducial one, and the model is also computed at value +/- step. For
+ * each parameter, the derivatives dC_l/dname of the lensed C_l's (or of
+ * the unlensed ones without lensing) are written in
+ * <root>dcl_d<name>.dat, and the fiducial C_l's in <root>dcl_fiducial.dat.
+ *
+ * The 2N perturbed models do not repeat the stages that a parameter
+ * does not touch: once read by input_init(), the input fields of the
+ * precision, background, thermo, perturbs and transfers structures are
+ * compared with the fiducial ones, and the modules upstream of the
+ * first difference are taken from the fiducial run (e.g. only the
+ * primordial, nonlinear, spectra and lensing modules are recomputed for
+ * A_s or n_s without non-linear corrections). The perturbed models are
+ * computed concurrently by several CLASS instances (by default, as many
+ * as the models or the available threads), which share the threads of
+ * OMP_NUM_THREADS; the tables depending only on precision parameters
+ * are computed once for all of them.
+ */
+
+#include "class.h"
+
+#define _DERIVATIVE_CL_TYPES_ 5         /**< number of C_l types written: TT, EE, TE, BB, phiphi */
+#define _DERIVATIVE_PARAMETERS_MAX_ 32  /**< maximum number of parameters */
+
+const char * derivative_cl_name[_DERIVATIVE_CL_TYPES_] = {"TT","EE","TE","BB","phiphi"};
+
+/**
+ * All structures of one CLASS run
+ */
+
+struct derivative_run {
+
+  struct precision pr;
+  struct background ba;
+  struct thermo th;
+  struct perturbs pt;
+  struct transfers tr;
+  struct primordial pm;
+  struct spectra sp;
+  struct nonlinear nl;
+  struct lensing le;
+  struct output op;
+
+  /* input fields of the first structures, as set by input_init() */
+  struct precision pr_input;
+  struct background ba_input;
+  struct thermo th_input;
+  struct perturbs pt_input;
+  struct transfers tr_input;
+
+  /* modules used by this run: its own ones, or those of the fiducial run */
+  struct background * pba;
+  struct thermo * pth;
+  struct perturbs * ppt;
+  struct transfers * ptr;
+
+  short has[_DERIVATIVE_CL_TYPES_];  /**< which C_l types are available */
+  short lensed;                      /**< whether the C_l's are lensed */
+  int l_max;                         /**< last multipole */
+  double * cl;                       /**< cl[l*_DERIVATIVE_CL_TYPES_+index_type] (zero for l<2) */
+
+  ErrorMsg error_message;
+
+};
+
+/**
+ * Copy a file_content structure, with all occurrences of one parameter
+ * set to a new value (no change if name is NULL)
+ */
+
+int derivative_copy_content(
+                            struct file_content * pfc,
+                            char * name,
+                            double value,
+                            struct file_content * pfc_copy,
+                            ErrorMsg errmsg
+                            ) {
+
+  int i;
+
+  class_call(parser_init(pfc_copy,pfc->size,pfc->filename,errmsg),
+             errmsg,
+             errmsg);
+
+  for (i=0; i < pfc->size; i++) {
+    strcpy(pfc_copy->name[i],pfc->name[i]);
+    if ((name != NULL) && (strcmp(pfc->name[i],name) == 0))
+      sprintf(pfc_copy->value[i],"%.15e",value);
+    else
+      strcpy(pfc_copy->value[i],pfc->value[i]);
+    pfc_copy->read[i] = _FALSE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Run CLASS for one model, and store its C_l's. When pfid is not NULL,
+ * the background, thermodynamics, perturbations and transfer modules are
+ * taken from the fiducial run as long as their input does not differ.
+ * The structures remain allocated until derivative_free().
+ */
+
+int derivative_run(
+                   struct file_content * pfc,
+                   struct derivative_run * pfid,
+                   struct derivative_run * prun
+                   ) {
+
+  int index[_DERIVATIVE_CL_TYPES_];
+  int index_type, l;
+  double * cl;
+  short reuse;
+
+  /** - read the input, in zeroed structures so that their input
+      fields can be compared byte by byte (a pointer set by
+      input_init(), e.g. to the ncdm parameters, always counts as a
+      difference) */
+  memset(prun,0,sizeof(struct derivative_run));
+
+  class_call(input_init(pfc,&(prun->pr),&(prun->ba),&(prun->th),&(prun->pt),&(prun->tr),&(prun->pm),
+                        &(prun->sp),&(prun->nl),&(prun->le),&(prun->op),prun->error_message),
+             prun->error_message,
+             prun->error_message);
+
+  memcpy(&(prun->pr_input),&(prun->pr),sizeof(struct precision));
+  memcpy(&(prun->ba_input),&(prun->ba),sizeof(struct background));
+  memcpy(&(prun->th_input),&(prun->th),sizeof(struct thermo));
+  memcpy(&(prun->pt_input),&(prun->pt),sizeof(struct perturbs));
+  memcpy(&(prun->tr_input),&(prun->tr),sizeof(struct transfers));
+
+  reuse = ((pfid != NULL) &&
+           (memcmp(&(prun->pr_input),&(pfid->pr_input),sizeof(struct precision)) == 0));
+
+  /** - background, thermodynamics, perturbations: from the fiducial
+      run until the first module whose input differs */
+  reuse = reuse && (memcmp(&(prun->ba_input),&(pfid->ba_input),sizeof(struct background)) == 0);
+  if (reuse == _TRUE_) {
+    prun->pba = pfid->pba;
+  }
+  else {
+    prun->pba = &(prun->ba);
+    class_call(background_init(&(prun->pr),prun->pba),
+               prun->pba->error_message,
+               prun->error_message);
+  }
+
+  reuse = reuse && (memcmp(&(prun->th_input),&(pfid->th_input),sizeof(struct thermo)) == 0);
+  if (reuse == _TRUE_) {
+    prun->pth = pfid->pth;
+  }
+  else {
+    prun->pth = &(prun->th);
+    class_call(thermodynamics_init(&(prun->pr),prun->pba,prun->pth),
+               prun->pth->error_message,
+               prun->error_message);
+  }
+
+  reuse = reuse && (memcmp(&(prun->pt_input),&(pfid->pt_input),sizeof(struct perturbs)) == 0);
+  if (reuse == _TRUE_) {
+    prun->ppt = pfid->ppt;
+  }
+  else {
+    prun->ppt = &(prun->pt);
+    class_call(perturb_init(&(prun->pr),prun->pba,prun->pth,prun->ppt),
+               prun->ppt->error_message,
+               prun->error_message);
+  }
+
+  /** - primordial spectrum and non-linear corrections: always recomputed */
+  class_call(primordial_init(&(prun->pr),prun->ppt,&(prun->pm)),
+             prun->pm.error_message,
+             prun->error_message);
+
+  class_call(nonlinear_init(&(prun->pr),prun->pba,prun->pth,prun->ppt,&(prun->pm),&(prun->nl)),
+             prun->nl.error_message,
+             prun->error_message);
+
+  /** - transfer functions: from the fiducial run if they do not depend
+      on the non-linear corrections (which depend on the primordial
+      spectrum) */
+  reuse = reuse && (prun->nl.method == nl_none) &&
+    (memcmp(&(prun->tr_input),&(pfid->tr_input),sizeof(struct transfers)) == 0);
+  if (reuse == _TRUE_) {
+    prun->ptr = pfid->ptr;
+  }
+  else {
+    prun->ptr = &(prun->tr);
+    class_call(transfer_init(&(prun->pr),prun->pba,prun->pth,prun->ppt,&(prun->nl),prun->ptr),
+               prun->ptr->error_message,
+               prun->error_message);
+  }
+
+  class_call(spectra_init(&(prun->pr),prun->pba,prun->ppt,&(prun->pm),&(prun->nl),prun->ptr,&(prun->sp)),
+             prun->sp.error_message,
+             prun->error_message);
+
+  class_call(lensing_init(&(prun->pr),prun->ppt,&(prun->sp),&(prun->nl),&(prun->le)),
+             prun->le.error_message,
+             prun->error_message);
+
+  /** - store the C_l's, as in the output files */
+  class_test(prun->ppt->has_cls == _FALSE_,
+             prun->error_message,
+             "no C_l's requested in the input file");
+
+  prun->lensed = prun->le.has_lensed_cls;
+
+  if (prun->lensed == _TRUE_) {
+    prun->l_max = prun->le.l_lensed_max;
+    prun->has[0] = prun->le.has_tt; index[0] = prun->le.index_lt_tt;
+    prun->has[1] = prun->le.has_ee; index[1] = prun->le.index_lt_ee;
+    prun->has[2] = prun->le.has_te; index[2] = prun->le.index_lt_te;
+    prun->has[3] = prun->le.has_bb; index[3] = prun->le.index_lt_bb;
+    prun->has[4] = prun->le.has_pp; index[4] = prun->le.index_lt_pp;
+  }
+  else {
+    prun->l_max = prun->sp.l_max_tot;
+    prun->has[0] = prun->sp.has_tt; index[0] = prun->sp.index_ct_tt;
+    prun->has[1] = prun->sp.has_ee; index[1] = prun->sp.index_ct_ee;
+    prun->has[2] = prun->sp.has_te; index[2] = prun->sp.index_ct_te;
+    prun->has[3] = prun->sp.has_bb; index[3] = prun->sp.index_ct_bb;
+    prun->has[4] = prun->sp.has_pp; index[4] = prun->sp.index_ct_pp;
+  }
+
+  class_alloc(cl,prun->sp.ct_size*sizeof(double),prun->error_message);
+  class_calloc(prun->cl,(prun->l_max+1)*_DERIVATIVE_CL_TYPES_,sizeof(double),prun->error_message);
+
+  for (l=2; l<=prun->l_max; l++) {
+    class_call(output_total_cl_at_l(&(prun->sp),&(prun->le),&(prun->op),l,cl),
+               prun->op.error_message,
+               prun->error_message);
+    for (index_type=0; index_type<_DERIVATIVE_CL_TYPES_; index_type++)
+      if (prun->has[index_type] == _TRUE_)
+        prun->cl[l*_DERIVATIVE_CL_TYPES_+index_type] = cl[index[index_type]];
+  }
+
+  free(cl);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the modules computed by one run (not those taken from the fiducial one)
+ */
+
+int derivative_free(
+                    struct derivative_run * prun
+                    ) {
+
+  class_call(lensing_free(&(prun->le)),prun->le.error_message,prun->error_message);
+  class_call(spectra_free(&(prun->sp)),prun->sp.error_message,prun->error_message);
+  if (prun->ptr == &(prun->tr))
+    class_call(transfer_free(prun->ptr),prun->ptr->error_message,prun->error_message);
+  class_call(nonlinear_free(&(prun->nl)),prun->nl.error_message,prun->error_message);
+  class_call(primordial_free(&(prun->pm)),prun->pm.error_message,prun->error_message);
+  if (prun->ppt == &(prun->pt))
+    class_call(perturb_free(prun->ppt),prun->ppt->error_message,prun->error_message);
+  if (prun->pth == &(prun->th))
+    class_call(thermodynamics_free(prun->pth),prun->pth->error_message,prun->error_message);
+  if (prun->pba == &(prun->ba))
+    class_call(background_free(prun->pba),prun->pba->error_message,prun->error_message);
+
+  free(prun->cl);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the C_l's of a run (pminus=NULL), or the centered derivatives
+ * (C_l[pplus]-C_l[pminus])/(2 step)
+ */
+
+int derivative_write(
+                     char * file_name,
+                     char * title,
+                     struct derivative_run * pplus,
+                     struct derivative_run * pminus,
+                     double step,
+                     ErrorMsg errmsg
+                     ) {
+
+  FILE * out;
+  int l, l_max, index_type;
+
+  class_open(out,file_name,"w",errmsg);
+
+  l_max = pplus->l_max;
+  if (pminus != NULL)
+    l_max = MIN(l_max,pminus->l_max);
+
+  fprintf(out,"# %s of the %s C_l's (dimensionless, not multiplied by l(l+1)/2pi)\n",
+          title,(pplus->lensed == _TRUE_ ? "lensed" : "unlensed"));
+  fprintf(out,"# %4s","l");
+  for (index_type=0; index_type<_DERIVATIVE_CL_TYPES_; index_type++)
+    if (pplus->has[index_type] == _TRUE_)
+      fprintf(out," %23s",derivative_cl_name[index_type]);
+  fprintf(out,"\n");
+
+  for (l=2; l<=l_max; l++) {
+    fprintf(out,"%6d",l);
+    for (index_type=0; index_type<_DERIVATIVE_CL_TYPES_; index_type++) {
+      if (pplus->has[index_type] == _TRUE_) {
+        if (pminus == NULL)
+          fprintf(out," %23.15e",pplus->cl[l*_DERIVATIVE_CL_TYPES_+index_type]);
+        else
+          fprintf(out," %23.15e",(pplus->cl[l*_DERIVATIVE_CL_TYPES_+index_type]
+                                  -pminus->cl[l*_DERIVATIVE_CL_TYPES_+index_type])/(2.*step));
+      }
+    }
+    fprintf(out,"\n");
+  }
+
+  fclose(out);
+
+  return _SUCCESS_;
+}
+
+int main(int argc, char **argv) {
+
+  struct file_content fc, fc_input, fc_precision;
+  struct derivative_run * fid;
+  struct derivative_run ** run;
+  ErrorMsg errmsg;
+
+  char * parameter_name[_DERIVATIVE_PARAMETERS_MAX_];
+  double parameter_step[_DERIVATIVE_PARAMETERS_MAX_];
+  double parameter_value[_DERIVATIVE_PARAMETERS_MAX_];
+  char * input_file = NULL;
+  char * precision_file = NULL;
+  int parameter_size = 0;
+  int instances = 0;
+  int total_number_of_threads = 1;
+  int index_arg, index_parameter, index_run, i, found, failures=0;
+  FileArg root;
+  char file_name[_FILENAMESIZE_+_ARGUMENT_LENGTH_MAX_];
+  char title[_ARGUMENT_LENGTH_MAX_];
+
+  /** - read the arguments */
+  for (index_arg=1; index_arg<argc; index_arg++) {
+    if ((strcmp(argv[index_arg],"-d") == 0) && (index_arg+2 < argc)) {
+      if (parameter_size == _DERIVATIVE_PARAMETERS_MAX_) {
+        printf("\n\nError: more than %d parameters\n",_DERIVATIVE_PARAMETERS_MAX_);
+        return _FAILURE_;
+      }
+      parameter_name[parameter_size] = argv[index_arg+1];
+      parameter_step[parameter_size] = atof(argv[index_arg+2]);
+      if (parameter_step[parameter_size] == 0.) {
+        printf("\n\nError: step of %s should not be zero\n",parameter_name[parameter_size]);
+        return _FAILURE_;
+      }
+      parameter_size++;
+      index_arg += 2;
+    }
+    else if ((strcmp(argv[index_arg],"-t") == 0) && (index_arg+1 < argc)) {
+      instances = atoi(argv[index_arg+1]);
+      index_arg++;
+    }
+    else if ((strlen(argv[index_arg]) > 4) && (strcmp(argv[index_arg]+strlen(argv[index_arg])-4,".ini") == 0)) {
+      input_file = argv[index_arg];
+    }
+    else if ((strlen(argv[index_arg]) > 4) && (strcmp(argv[index_arg]+strlen(argv[index_arg])-4,".pre") == 0)) {
+      precision_file = argv[index_arg];
+    }
+    else {
+      printf("usage: %s [-t instances] -d name step [-d name step ...] file.ini [file.pre]\n",argv[0]);
+      return _FAILURE_;
+    }
+  }
+
+  if ((input_file == NULL) || (parameter_size == 0)) {
+    printf("usage: %s [-t instances] -d name step [-d name step ...] file.ini [file.pre]\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /** - merge the input and precision parameters, like input_init_from_arguments() */
+  fc_precision.size = 0;
+  if ((parser_read_file(input_file,&fc_input,errmsg) == _FAILURE_) ||
+      ((precision_file != NULL) && (parser_read_file(precision_file,&fc_precision,errmsg) == _FAILURE_)) ||
+      (parser_cat(&fc_input,&fc_precision,&fc,errmsg) == _FAILURE_)) {
+    printf("\n\nError in reading the input files\n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  parser_free(&fc_input);
+  parser_free(&fc_precision);
+
+  if (parser_read_string(&fc,"root",&root,&found,errmsg) == _FAILURE_) {
+    printf("\n\nError in parser_read_string\n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  if (found == _FALSE_)
+    strcpy(root,"output/");
+
+  /** - fiducial values, which must be in the input file */
+  for (index_parameter=0; index_parameter<parameter_size; index_parameter++) {
+    found = _FALSE_;
+    for (i=0; i<fc.size; i++) {
+      if (strcmp(fc.name[i],parameter_name[index_parameter]) == 0) {
+        found = (sscanf(fc.value[i],"%lf",&(parameter_value[index_parameter])) == 1);
+      }
+    }
+    if (found == _FALSE_) {
+      printf("\n\nError: %s should be set to a number in %s\n",parameter_name[index_parameter],input_file);
+      return _FAILURE_;
+    }
+  }
+
+  /** - fiducial model, with all threads */
+  fid = calloc(1,sizeof(struct derivative_run));
+  run = calloc(2*parameter_size,sizeof(struct derivative_run *));
+  if ((fid == NULL) || (run == NULL)) {
+    printf("\n\nError: could not allocate the runs\n");
+    return _FAILURE_;
+  }
+
+  if ((derivative_copy_content(&fc,NULL,0.,&fc_input,errmsg) == _FAILURE_) ||
+      (derivative_run(&fc_input,NULL,fid) == _FAILURE_)) {
+    printf("\n\nError in the fiducial run\n=>%s%s\n",errmsg,fid->error_message);
+    return _FAILURE_;
+  }
+  parser_free(&fc_input);
+
+  /** - 2N perturbed models, run concurrently (nested parallelism) */
+#ifdef _OPENMP
+  total_number_of_threads = omp_get_max_threads();
+  omp_set_nested(1);
+  omp_set_max_active_levels(2);
+#endif
+  if (instances <= 0)
+    instances = MIN(2*parameter_size,total_number_of_threads);
+
+#pragma omp parallel num_threads(instances) private(index_parameter,i) reduction(+:failures)
+  {
+    struct file_content fc_local;
+    ErrorMsg errmsg_local;
+
+#ifdef _OPENMP
+    omp_set_num_threads(MAX(total_number_of_threads/instances,1));
+#endif
+
+#pragma omp for schedule(dynamic,1)
+    for (index_run=0; index_run<2*parameter_size; index_run++) {
+
+      index_parameter = index_run/2;
+      run[index_run] = calloc(1,sizeof(struct derivative_run));
+
+      if ((run[index_run] == NULL) ||
+          (derivative_copy_content(&fc,
+                                   parameter_name[index_parameter],
+                                   parameter_value[index_parameter]+(index_run%2 == 0 ? 1. : -1.)*parameter_step[index_parameter],
+                                   &fc_local,
+                                   errmsg_local) == _FAILURE_)) {
+        printf("\n\nError: could not prepare the run with %s %s step\n",parameter_name[index_parameter],(index_run%2 == 0 ? "+" : "-"));
+        failures++;
+        continue;
+      }
+
+      if (derivative_run(&fc_local,fid,run[index_run]) == _FAILURE_) {
+        printf("\n\nError in the run with %s %s step\n=>%s\n",parameter_name[index_parameter],(index_run%2 == 0 ? "+" : "-"),run[index_run]->error_message);
+        failures++;
+      }
+
+      parser_free(&fc_local);
+    }
+  }
+
+  if (failures > 0)
+    return _FAILURE_;
+
+  /** - write the fiducial C_l's and the derivatives */
+  sprintf(file_name,"%sdcl_fiducial.dat",root);
+  if (derivative_write(file_name,"fiducial values",fid,NULL,0.,errmsg) == _FAILURE_) {
+    printf("\n\nError in derivative_write\n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  for (index_parameter=0; index_parameter<parameter_size; index_parameter++) {
+    sprintf(file_name,"%sdcl_d%s.dat",root,parameter_name[index_parameter]);
+    sprintf(title,"derivatives with respect to %s (fiducial %g, step %g)",
+            parameter_name[index_parameter],parameter_value[index_parameter],parameter_step[index_parameter]);
+    if (derivative_write(file_name,title,run[2*index_parameter],run[2*index_parameter+1],parameter_step[index_parameter],errmsg) == _FAILURE_) {
+      printf("\n\nError in derivative_write\n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+    printf("Wrote %s (reusing:%s%s%s%s)\n",file_name,
+           (run[2*index_parameter]->pba == fid->pba ? " background" : ""),
+           (run[2*index_parameter]->pth == fid->pth ? " thermodynamics" : ""),
+           (run[2*index_parameter]->ppt == fid->ppt ? " perturbations" : ""),
+           (run[2*index_parameter]->ptr == fid->ptr ? " transfer" : ""));
+  }
+
+  /** - free the perturbed runs before the fiducial one, whose modules they may use */
+  for (index_run=0; index_run<2*parameter_size; index_run++) {
+    if (derivative_free(run[index_run]) == _FAILURE_) {
+      printf("\n\nError in derivative_free\n=>%s\n",run[index_run]->error_message);
+      return _FAILURE_;
+    }
+    free(run[index_run]);
+  }
+
+  if (derivative_free(fid) == _FAILURE_) {
+    printf("\n\nError in derivative_free\n=>%s\n",fid->error_message);
+    return _FAILURE_;
+  }
+
+  free(fid);
+  free(run);
+  parser_free(&fc);
+
+  return _SUCCESS_;
+
+}
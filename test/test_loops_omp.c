@@ -1,311 +1,439 @@
-/** @file class.c
- * Julien Lesgourgues, 17.04.2011
- */
-
-/* this main calls CLASS several times in a loop, with different input
-   parameters. It illustrates how the code could be interfaced with a
-   parameter extraction code. */
-
-/* JL 17.03.2016: implemented here nested openMP loops. The user
-   chooses how many instances of CLASS are run in parallel (by setting
-   the variable number_of_class_instances below). Each of them uses a
-   number of thread such that all cores are used. */
-
-#include "class.h"
-
-int class(
-          struct file_content *pfc,
-          struct precision * ppr,
-          struct background * pba,
-          struct thermo * pth,
-          struct perturbs * ppt,
-          struct primordial * ppm,
-          struct nonlinear * pnl,
-          struct transfers * ptr,
-          struct spectra * psp,
-          struct lensing * ple,
-          struct output * pop,
-          int l_max,
-          double ** cl,
-          ErrorMsg errmsg) {
-
-  int l;
-
-  class_call(input_init(pfc,ppr,pba,pth,ppt,ptr,ppm,psp,pnl,ple,pop,errmsg),
-             errmsg,
-             errmsg);
-
-  class_call(background_init(ppr,pba),
-             pba->error_message,
-             errmsg);
-
-  class_call(thermodynamics_init(ppr,pba,pth),
-             pth->error_message,
-             errmsg);
-
-  class_call(perturb_init(ppr,pba,pth,ppt),
-             ppt->error_message,
-             errmsg);
-
-  class_call(primordial_init(ppr,ppt,ppm),
-             ppm->error_message,
-             errmsg);
-
-  class_call(nonlinear_init(ppr,pba,pth,ppt,ppm,pnl),
-             pnl->error_message,
-             errmsg);
-
-  class_call(transfer_init(ppr,pba,pth,ppt,pnl,ptr),
-             ptr->error_message,
-             errmsg);
-
-  class_call(spectra_init(ppr,pba,ppt,ppm,pnl,ptr,psp),
-             psp->error_message,
-             errmsg);
-
-  class_call(lensing_init(ppr,ppt,psp,pnl,ple),
-             ple->error_message,
-             errmsg);
-
-  /****** write the Cl values in the input array cl[l]  *******/
-
-  for (l=2; l <= l_max; l++) {
-
-    class_call(output_total_cl_at_l(psp,ple,pop,(double)l,cl[l]),
-               psp->error_message,
-               errmsg);
-  }
-
-  /****** all calculations done, now free the structures ******/
-
-  class_call(lensing_free(ple),
-             ple->error_message,
-             errmsg);
-
-  class_call(spectra_free(psp),
-             psp->error_message,
-             errmsg);
-
-  class_call(transfer_free(ptr),
-             ptr->error_message,
-             errmsg);
-
-  class_call(nonlinear_free(pnl),
-             pnl->error_message,
-             errmsg);
-
-  class_call(primordial_free(ppm),
-             ppm->error_message,
-             errmsg);
-
-  class_call(perturb_free(ppt),
-             ppt->error_message,
-             errmsg);
-
-  class_call(thermodynamics_free(pth),
-             pth->error_message,
-             errmsg);
-
-  class_call(background_free(pba),
-             pba->error_message,
-             errmsg);
-
-  return _SUCCESS_;
-
-}
-
-int main() {
-
-  /* shared variable that will be common to all CLASS instances */
-  int i;
-  int l,l_max;
-  int num_ct_max=7;
-  int num_loops=10;
-
-  struct file_content fc;
-  ErrorMsg errmsg_parser;
-
-  int total_number_of_threads;
-  int number_of_class_instances;
-  int number_of_threads_inside_class;
-
-  int index_ct_tt;
-  int index_ct_ee;
-  int index_ct_te;
-
-  /* dealing with the openMP part (number of instances, number of
-     threads per instance...) */
-
-#ifdef _OPENMP
-
-  /* Determine the number of threads, class instances and nested
-     threads */
-  total_number_of_threads = omp_get_max_threads();
-
-  /* User-fixed number of CLASS instances to be run in parallel (Total
-     number of threads should be dividable by this number) */
-  number_of_class_instances=2;
-
-  if ((total_number_of_threads % number_of_class_instances) != 0)
-    printf("The total number of threads, %d, is not a mutiple of the requested number of CLASS instances, %d\n",total_number_of_threads,number_of_class_instances);
-  number_of_threads_inside_class = total_number_of_threads/number_of_class_instances;
-
-  /* inferred number of threads per instance */
-  printf("# Total number of available threads = %d, used to run\n",
-         total_number_of_threads);
-  printf("# -> %d CLASS executables in parallel\n",
-         number_of_class_instances);
-  printf("# -> %d threads inside each CLASS executables\n",
-         number_of_threads_inside_class);
-
-  /* Turn on nested parallelism */
-  omp_set_nested(1);
-#endif
-
-  /* choose a value of l_max in C_l's */
-  l_max=3000;
-
-  /* all parameters for which we don't want to keep default values
-     should be passed to the code through a file_content
-     structure. Create such a structure with the size you need: 10 in
-     this exemple */
-  parser_init(&fc,10,"",errmsg_parser);
-
-  /* assign values to these 9 parameters. Some will be fixed, some
-     will be varied in the loop. */
-  strcpy(fc.name[0],"output");
-  strcpy(fc.value[0],"tCl,pCl,lCl");
-
-  strcpy(fc.name[1],"l_max_scalars");
-  sprintf(fc.value[1],"%d",l_max);
-
-  strcpy(fc.name[2],"lensing");
-  sprintf(fc.value[2],"yes");
-
-  strcpy(fc.name[3],"H0");
-  sprintf(fc.value[3],"%e",72.);
-
-  strcpy(fc.name[4],"omega_b");
-  sprintf(fc.value[4],"%e",0.024);
-
-  strcpy(fc.name[5],"omega_cdm");
-  sprintf(fc.value[5],"%e",0.05);
-
-  strcpy(fc.name[6],"z_reio");
-  sprintf(fc.value[6],"%e",10.);
-
-  strcpy(fc.name[7],"A_s");
-  sprintf(fc.value[7],"%e",2.3e-9);
-
-  strcpy(fc.name[8],"n_s");
-  sprintf(fc.value[8],"%e",1.);
-
-  strcpy(fc.name[9],"perturbations_verbose");
-  sprintf(fc.value[9],"%d",0); // Trick: set to 2 to cross-check actual number of threads per CLASS instance
-
-  /* Create an array of Cl's where all results will be stored for each parameter value in the loop */
-  double *** cl;
-  cl = malloc(num_loops*sizeof(double**));
-
-  /* Create one thread for each instance of CLASS */
-#pragma omp parallel num_threads(number_of_class_instances)
-  {
-
-    /* set the number of threads inside each CLASS instance */
-#ifdef _OPENMP
-    omp_set_num_threads(number_of_threads_inside_class);
-#endif
-
-    /* for each thread/instance, create all CLASS input/output
-       structures (these variables are being declared insode the
-       parallel zone, hence they are openMP private variables) */
-
-    struct precision pr;        /* for precision parameters */
-    struct background ba;       /* for cosmological background */
-    struct thermo th;           /* for thermodynamics */
-    struct perturbs pt;         /* for source functions */
-    struct transfers tr;        /* for transfer functions */
-    struct primordial pm;       /* for primordial spectra */
-    struct spectra sp;          /* for output spectra */
-    struct nonlinear nl;        /* for non-linear spectra */
-    struct lensing le;          /* for lensed spectra */
-    struct output op;           /* for output files */
-    ErrorMsg errmsg;            /* for error messages */
-
-    struct file_content fc_local;
-    int j,iam;
-
-    /* copy the shared file content into the local file content used by each instance */
-    parser_init(&fc_local,fc.size,"",errmsg);
-    for (j=0; j < fc.size; j++) {
-      strcpy(fc_local.value[j],fc.value[j]);
-      strcpy(fc_local.name[j],fc.name[j]);
-      fc_local.read[j]=fc.read[j];
-    }
-
-    /* loop over (num_loops) values of some parameters: in this exemple, omega_b */
-#pragma omp for schedule(static,1)
-    for (i=0; i<=num_loops; i++) {
-
-#ifdef _OPENMP
-      iam=omp_get_thread_num();
-#else
-      iam=0;
-#endif
-
-      /* assign one value to omega_b */
-      sprintf(fc_local.value[4],"%e",0.01+i*0.002);
-
-      printf("# %d\tthread=%d : running with omega_b = %s\n",i,iam,fc_local.value[4]);
-
-      /* allocate the array where the Cl's calculated by one instance
-         will be written (we could add another array with P(k), or
-         extract other results from the code - here we assume that we
-         are interested in the C_l's only */
-      cl[i]=malloc((l_max+1)*sizeof(double*));
-      for (l=0;l<=l_max;l++)
-        cl[i][l]=malloc(num_ct_max*sizeof(double));
-
-      /* calls class and return the C_l's*/
-      if (class(&fc_local,&pr,&ba,&th,&pt,&pm,&nl,&tr,&sp,&le,&op,l_max,cl[i],errmsg) == _FAILURE_) {
-        printf("\n\nError in class \n=>%s\n",errmsg);
-        //return _FAILURE_;
-      }
-
-      /* if this is the first call, extract dynamically the value of indices used in the output */
-      if ((i==0) && (iam==0)) {
-        index_ct_tt=sp.index_ct_tt;
-        index_ct_te=sp.index_ct_te;
-        index_ct_ee=sp.index_ct_ee;
-      }
-
-    } // end of loop over parameters
-  } // end parallel zone
-
-  /* write in file the lensed C_l^TT, C_l^EE, C_l^TE's obtained in all runs */
-
-  FILE * out=fopen("output/test_loops_omp.dat","w");
-
-  for (i=0; i<num_loops; i++) {
-    for (l=2;l<=l_max;l++) {
-      fprintf(out,"%d  %e  %e  %e\n",
-              l,
-              l*(l+1)*cl[i][l][index_ct_tt],
-              l*(l+1)*cl[i][l][index_ct_ee],
-              l*(l+1)*cl[i][l][index_ct_te]);
-    }
-    fprintf(out,"\n");
-  }
-
-  /* free Cl's array */
-  for (i=0; i<num_loops; i++) {
-    for (l=0;l<l_max;l++) {
-      free(cl[i][l]);
-    }
-    free(cl[i]);
-  }
-  free(cl);
-
-  return _SUCCESS_;
-
-}
+/** @file test_loops_omp.c
+ * Julien Lesgourgues, 17.04.2011
+ */
+
+/* this main calls CLASS several times in a loop, with different input
+   parameters. It illustrates how the code could be interfaced with a
+   parameter extraction code. */
+
+/* JL 17.03.2016: implemented here nested openMP loops. Several
+   instances of CLASS are run in parallel, each of them using a number
+   of threads such that all cores are used. */
+
+/* The same set of cosmologies is now computed for each way of
+   splitting the available threads between CLASS instances (outer
+   threads) and threads inside each instance (inner threads), giving
+   the throughput in cosmologies per second for each split and the best
+   one for this node:
+
+     ./test_loops_omp [-n cosmologies] [-t threads] [-o results.json]
+
+   By default, the number of threads is given by OMP_NUM_THREADS and
+   the number of cosmologies is twice this number. With -o, the results
+   are also appended to a file as a JSON object. Only splits for which
+   the number of instances divides the number of threads are tested.
+   The C_l's of each split are compared with those of the first one
+   (maximum relative difference), as a check that the instances do not
+   interfere, and those of the last split are written in
+   output/test_loops_omp.dat. 'make scaling' runs this program. */
+
+#include "class.h"
+#include <time.h>
+
+int class(
+          struct file_content *pfc,
+          struct precision * ppr,
+          struct background * pba,
+          struct thermo * pth,
+          struct perturbs * ppt,
+          struct primordial * ppm,
+          struct nonlinear * pnl,
+          struct transfers * ptr,
+          struct spectra * psp,
+          struct lensing * ple,
+          struct output * pop,
+          int l_max,
+          int ct_max,
+          double ** cl,
+          int * index_ct,
+          ErrorMsg errmsg) {
+
+  int l;
+
+  class_call(input_init(pfc,ppr,pba,pth,ppt,ptr,ppm,psp,pnl,ple,pop,errmsg),
+             errmsg,
+             errmsg);
+
+  class_call(background_init(ppr,pba),
+             pba->error_message,
+             errmsg);
+
+  class_call(thermodynamics_init(ppr,pba,pth),
+             pth->error_message,
+             errmsg);
+
+  class_call(perturb_init(ppr,pba,pth,ppt),
+             ppt->error_message,
+             errmsg);
+
+  class_call(primordial_init(ppr,ppt,ppm),
+             ppm->error_message,
+             errmsg);
+
+  class_call(nonlinear_init(ppr,pba,pth,ppt,ppm,pnl),
+             pnl->error_message,
+             errmsg);
+
+  class_call(transfer_init(ppr,pba,pth,ppt,pnl,ptr),
+             ptr->error_message,
+             errmsg);
+
+  class_call(spectra_init(ppr,pba,ppt,ppm,pnl,ptr,psp),
+             psp->error_message,
+             errmsg);
+
+  class_call(lensing_init(ppr,ppt,psp,pnl,ple),
+             ple->error_message,
+             errmsg);
+
+  /****** write the Cl values in the input array cl[l]  *******/
+
+  class_test(psp->ct_size > ct_max,
+             errmsg,
+             "%d types of C_l's, but room for %d only",psp->ct_size,ct_max);
+
+  for (l=2; l <= l_max; l++) {
+
+    class_call(output_total_cl_at_l(psp,ple,pop,(double)l,cl[l]),
+               pop->error_message,
+               errmsg);
+  }
+
+  /* the lensed C_l's are ordered like in the lensing module */
+  index_ct[0]=ple->index_lt_tt;
+  index_ct[1]=ple->index_lt_ee;
+  index_ct[2]=ple->index_lt_te;
+
+  /****** all calculations done, now free the structures ******/
+
+  class_call(lensing_free(ple),
+             ple->error_message,
+             errmsg);
+
+  class_call(spectra_free(psp),
+             psp->error_message,
+             errmsg);
+
+  class_call(transfer_free(ptr),
+             ptr->error_message,
+             errmsg);
+
+  class_call(nonlinear_free(pnl),
+             pnl->error_message,
+             errmsg);
+
+  class_call(primordial_free(ppm),
+             ppm->error_message,
+             errmsg);
+
+  class_call(perturb_free(ppt),
+             ppt->error_message,
+             errmsg);
+
+  class_call(thermodynamics_free(pth),
+             pth->error_message,
+             errmsg);
+
+  class_call(background_free(pba),
+             pba->error_message,
+             errmsg);
+
+  return _SUCCESS_;
+
+}
+
+/* wall-clock time in seconds */
+double loops_wtime() {
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+1.e-9*now.tv_nsec;
+#endif
+}
+
+int main(int argc, char **argv) {
+
+  /* shared variable that will be common to all CLASS instances */
+  int i;
+  int l,l_max;
+  int num_ct_max=9;
+  int num_loops=0;
+
+  struct file_content fc;
+  ErrorMsg errmsg_parser;
+
+  int total_number_of_threads=0;
+  int number_of_class_instances;
+  int number_of_threads_inside_class;
+
+  int index_ct[3]={0,1,2};
+  int index_arg,index_type,failures;
+  int best_instances=1;
+  double start,time,throughput,best_throughput=0.,difference,max_difference;
+  char * json_name = NULL;
+  FILE * json = NULL;
+
+  /* read the options */
+  for (index_arg=1; index_arg<argc; index_arg+=2) {
+    if (index_arg+1 == argc) {
+      printf("usage: %s [-n cosmologies] [-t threads] [-o results.json]\n",argv[0]);
+      return _FAILURE_;
+    }
+    if (strcmp(argv[index_arg],"-n") == 0)
+      num_loops=atoi(argv[index_arg+1]);
+    else if (strcmp(argv[index_arg],"-t") == 0)
+      total_number_of_threads=atoi(argv[index_arg+1]);
+    else if (strcmp(argv[index_arg],"-o") == 0)
+      json_name=argv[index_arg+1];
+    else {
+      printf("usage: %s [-n cosmologies] [-t threads] [-o results.json]\n",argv[0]);
+      return _FAILURE_;
+    }
+  }
+
+  /* dealing with the openMP part (number of instances, number of
+     threads per instance...) */
+
+#ifdef _OPENMP
+
+  /* Determine the total number of threads, to be split between class
+     instances and nested threads */
+  if (total_number_of_threads <= 0)
+    total_number_of_threads = omp_get_max_threads();
+
+  /* Turn on nested parallelism */
+  omp_set_nested(1);
+  omp_set_max_active_levels(2);
+#else
+  total_number_of_threads = 1;
+#endif
+
+  if (num_loops <= 0)
+    num_loops = 2*total_number_of_threads;
+
+  printf("# Total number of available threads = %d, %d cosmologies per split\n",
+         total_number_of_threads,num_loops);
+
+  /* choose a value of l_max in C_l's */
+  l_max=3000;
+
+  /* all parameters for which we don't want to keep default values
+     should be passed to the code through a file_content
+     structure. Create such a structure with the size you need: 10 in
+     this exemple */
+  parser_init(&fc,10,"",errmsg_parser);
+
+  /* assign values to these 9 parameters. Some will be fixed, some
+     will be varied in the loop. */
+  strcpy(fc.name[0],"output");
+  strcpy(fc.value[0],"tCl,pCl,lCl");
+
+  strcpy(fc.name[1],"l_max_scalars");
+  sprintf(fc.value[1],"%d",l_max);
+
+  strcpy(fc.name[2],"lensing");
+  sprintf(fc.value[2],"yes");
+
+  strcpy(fc.name[3],"H0");
+  sprintf(fc.value[3],"%e",72.);
+
+  strcpy(fc.name[4],"omega_b");
+  sprintf(fc.value[4],"%e",0.024);
+
+  strcpy(fc.name[5],"omega_cdm");
+  sprintf(fc.value[5],"%e",0.05);
+
+  strcpy(fc.name[6],"z_reio");
+  sprintf(fc.value[6],"%e",10.);
+
+  strcpy(fc.name[7],"A_s");
+  sprintf(fc.value[7],"%e",2.3e-9);
+
+  strcpy(fc.name[8],"n_s");
+  sprintf(fc.value[8],"%e",1.);
+
+  strcpy(fc.name[9],"perturbations_verbose");
+  sprintf(fc.value[9],"%d",0); // Trick: set to 2 to cross-check actual number of threads per CLASS instance
+
+  /* Create arrays of Cl's where all results will be stored for each
+     parameter value in the loop, for the current split and for the
+     first one (reference for the comparison) */
+  double *** cl;
+  double *** cl_first;
+  cl = malloc(num_loops*sizeof(double**));
+  cl_first = malloc(num_loops*sizeof(double**));
+  for (i=0; i<num_loops; i++) {
+    cl[i]=malloc((l_max+1)*sizeof(double*));
+    cl_first[i]=malloc((l_max+1)*sizeof(double*));
+    for (l=0;l<=l_max;l++) {
+      cl[i][l]=malloc(num_ct_max*sizeof(double));
+      cl_first[i][l]=malloc(num_ct_max*sizeof(double));
+    }
+  }
+
+  if (json_name != NULL) {
+    json = fopen(json_name,"a");
+    if (json == NULL) {
+      printf("\n\nError: could not open %s for writing\n",json_name);
+      return _FAILURE_;
+    }
+  }
+
+  if (json_name != NULL)
+    fprintf(json,"  {\"version\": \"%s\", \"threads\": %d, \"cosmologies\": %d,\n   \"splits\": [",
+            _VERSION_,total_number_of_threads,num_loops);
+
+  printf("# instances\tthreads/instance\ttime (s)\tcosmologies/s\tmax rel. diff.\n");
+
+  /* loop over the numbers of CLASS instances run in parallel */
+  for (number_of_class_instances=1;
+       number_of_class_instances<=total_number_of_threads;
+       number_of_class_instances++) {
+
+    if ((total_number_of_threads % number_of_class_instances) != 0)
+      continue;
+
+    number_of_threads_inside_class = total_number_of_threads/number_of_class_instances;
+    failures=0;
+
+    start=loops_wtime();
+
+    /* Create one thread for each instance of CLASS */
+#pragma omp parallel num_threads(number_of_class_instances) reduction(+:failures)
+    {
+
+      /* set the number of threads inside each CLASS instance */
+#ifdef _OPENMP
+      omp_set_num_threads(number_of_threads_inside_class);
+#endif
+
+      /* for each thread/instance, create all CLASS input/output
+         structures (these variables are being declared insode the
+         parallel zone, hence they are openMP private variables) */
+
+      struct precision pr;        /* for precision parameters */
+      struct background ba;       /* for cosmological background */
+      struct thermo th;           /* for thermodynamics */
+      struct perturbs pt;         /* for source functions */
+      struct transfers tr;        /* for transfer functions */
+      struct primordial pm;       /* for primordial spectra */
+      struct spectra sp;          /* for output spectra */
+      struct nonlinear nl;        /* for non-linear spectra */
+      struct lensing le;          /* for lensed spectra */
+      struct output op;           /* for output files */
+      ErrorMsg errmsg;            /* for error messages */
+
+      struct file_content fc_local;
+      int j,index_ct_local[3];
+
+      /* copy the shared file content into the local file content used by each instance */
+      parser_init(&fc_local,fc.size,"",errmsg);
+      for (j=0; j < fc.size; j++) {
+        strcpy(fc_local.value[j],fc.value[j]);
+        strcpy(fc_local.name[j],fc.name[j]);
+        fc_local.read[j]=fc.read[j];
+      }
+
+      /* loop over (num_loops) values of some parameters: in this exemple, omega_b */
+#pragma omp for schedule(dynamic,1)
+      for (i=0; i<num_loops; i++) {
+
+        /* assign one value to omega_b */
+        sprintf(fc_local.value[4],"%e",0.01+i*0.002);
+
+        /* calls class and return the C_l's*/
+        if (class(&fc_local,&pr,&ba,&th,&pt,&pm,&nl,&tr,&sp,&le,&op,l_max,num_ct_max,cl[i],index_ct_local,errmsg) == _FAILURE_) {
+          printf("\n\nError in class \n=>%s\n",errmsg);
+          failures++;
+        }
+        else if (i==0) {
+          for (j=0; j<3; j++)
+            index_ct[j]=index_ct_local[j];
+        }
+
+      } // end of loop over parameters
+
+      parser_free(&fc_local);
+
+    } // end parallel zone
+
+    time=loops_wtime()-start;
+    throughput=(num_loops-failures)/time;
+
+    /* compare with the C_l's of the first split */
+    max_difference=0.;
+    for (i=0; i<num_loops; i++) {
+      for (l=2;l<=l_max;l++) {
+        for (index_type=0; index_type<3; index_type++) {
+          if (number_of_class_instances == 1) {
+            cl_first[i][l][index_ct[index_type]]=cl[i][l][index_ct[index_type]];
+          }
+          else if (cl_first[i][l][index_ct[index_type]] != 0.) {
+            difference=fabs(cl[i][l][index_ct[index_type]]/cl_first[i][l][index_ct[index_type]]-1.);
+            max_difference=MAX(max_difference,difference);
+          }
+        }
+      }
+    }
+
+    printf("  %d\t\t%d\t\t\t%.3f\t\t%.4f\t\t%.2e%s\n",
+           number_of_class_instances,number_of_threads_inside_class,time,throughput,max_difference,
+           (failures > 0 ? "\t(failures)" : ""));
+
+    if (json_name != NULL)
+      fprintf(json,"%s\n    {\"instances\": %d, \"threads_per_instance\": %d, \"time\": %.6f, \"cosmologies_per_second\": %.6f, \"failures\": %d, \"max_difference\": %.6e}",
+              (number_of_class_instances > 1 ? "," : ""),
+              number_of_class_instances,number_of_threads_inside_class,time,throughput,failures,max_difference);
+
+    if (throughput > best_throughput) {
+      best_throughput=throughput;
+      best_instances=number_of_class_instances;
+    }
+  }
+
+  printf("# best split: %d CLASS instances with %d threads each, %.4f cosmologies per second\n",
+         best_instances,total_number_of_threads/best_instances,best_throughput);
+
+  if (json_name != NULL) {
+    fprintf(json,"],\n   \"best\": {\"instances\": %d, \"threads_per_instance\": %d, \"cosmologies_per_second\": %.6f}}\n",
+            best_instances,total_number_of_threads/best_instances,best_throughput);
+    fclose(json);
+  }
+
+  /* write in file the lensed C_l^TT, C_l^EE, C_l^TE's obtained in all runs */
+
+  FILE * out=fopen("output/test_loops_omp.dat","w");
+
+  if (out != NULL) {
+    for (i=0; i<num_loops; i++) {
+      for (l=2;l<=l_max;l++) {
+        fprintf(out,"%d  %e  %e  %e\n",
+                l,
+                l*(l+1)*cl[i][l][index_ct[0]],
+                l*(l+1)*cl[i][l][index_ct[1]],
+                l*(l+1)*cl[i][l][index_ct[2]]);
+      }
+      fprintf(out,"\n");
+    }
+    fclose(out);
+  }
+
+  /* free Cl's array */
+  for (i=0; i<num_loops; i++) {
+    for (l=0;l<=l_max;l++) {
+      free(cl[i][l]);
+      free(cl_first[i][l]);
+    }
+    free(cl[i]);
+    free(cl_first[i]);
+  }
+  free(cl);
+  free(cl_first);
+
+  parser_free(&fc);
+
+  return _SUCCESS_;
+
+}
@@ -1,137 +1,183 @@
-/** @file class.c 
- * Julien Lesgourgues, 20.04.2010    
+/** @file test_timing.c
+ * Julien Lesgourgues, 20.04.2010
+ *
+ * Runs all modules like class.c does, and measures the wall-clock time
+ * spent in each *_init function. The results are written as a JSON
+ * object, either on the standard output or appended to the file given
+ * with the option -o:
+ *
+ *   ./test_timing [-o results.json] file.ini [file.pre]
+ *
+ * output_init() is not called, so that the timings do not depend on the
+ * file system. The number of threads is set as usual by OMP_NUM_THREADS.
+ * 'make bench' runs this program over a fixed set of input files and
+ * numbers of threads.
  */
- 
+
 #include "class.h"
 #include <time.h>
 
+#define _TIMING_STAGES_ 9
+
+/* wall-clock time in seconds */
+double timing_wtime() {
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+1.e-9*now.tv_nsec;
+#endif
+}
+
 int main(int argc, char **argv) {
 
   struct precision pr;        /* for precision parameters */
   struct background ba;       /* for cosmological background */
   struct thermo th;           /* for thermodynamics */
   struct perturbs pt;         /* for source functions */
-  struct bessels bs;          /* for bessel functions */
   struct transfers tr;        /* for transfer functions */
   struct primordial pm;       /* for primordial spectra */
   struct spectra sp;          /* for output spectra */
   struct nonlinear nl;        /* for non-linear spectra */
   struct lensing le;          /* for lensed spectra */
   struct output op;           /* for output files */
-  ErrorMsg errmsg;
+  ErrorMsg errmsg;            /* for error messages */
 
-  double start_perturb, end_perturb; 
-  double cpu_time_perturb; 
-  double start_other, end_other; 
-  double cpu_time_other; 
-  double start_lensing, end_lensing; 
-  double cpu_time_lensing; 
+  const char * stage_name[_TIMING_STAGES_] = {"input_init","background_init","thermodynamics_init",
+                                              "perturb_init","primordial_init","nonlinear_init",
+                                              "transfer_init","spectra_init","lensing_init"};
+  double stage_time[_TIMING_STAGES_];
+  double start, total=0.;
+  int index_stage, index_arg, threads=1;
+  char * json_name = NULL;
+  FILE * json;
 
-  if (input_init_from_arguments(argc, argv,&pr,&ba,&th,&pt,&bs,&tr,&pm,&sp,&nl,&le,&op,errmsg) == _FAILURE_) {
-    printf("\n\nError running input_init_from_arguments \n=>%s\n",errmsg); 
-    return _FAILURE_;
+  /* remove the option -o from the arguments passed to input_init_from_arguments() */
+  if ((argc > 2) && (strcmp(argv[1],"-o") == 0)) {
+    json_name = argv[2];
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
   }
 
-  start_other = omp_get_wtime();
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
 
+  start = timing_wtime();
+  if (input_init_from_arguments(argc, argv,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&op,errmsg) == _FAILURE_) {
+    printf("\n\nError running input_init_from_arguments \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  stage_time[0] = timing_wtime()-start;
+
+  start = timing_wtime();
   if (background_init(&pr,&ba) == _FAILURE_) {
     printf("\n\nError running background_init \n=>%s\n",ba.error_message);
     return _FAILURE_;
   }
+  stage_time[1] = timing_wtime()-start;
 
+  start = timing_wtime();
   if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
     printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
     return _FAILURE_;
   }
+  stage_time[2] = timing_wtime()-start;
 
-  start_perturb = omp_get_wtime(); 
-
+  start = timing_wtime();
   if (perturb_init(&pr,&ba,&th,&pt) == _FAILURE_) {
     printf("\n\nError in perturb_init \n=>%s\n",pt.error_message);
     return _FAILURE_;
   }
+  stage_time[3] = timing_wtime()-start;
 
-  end_perturb = omp_get_wtime(); 
-
-  cpu_time_perturb =  (end_perturb-start_perturb);
-
-  printf("time in perturb=%4.3f s\n",cpu_time_perturb); 
-
-  if (bessel_init(&pr,&bs) == _FAILURE_) {
-    printf("\n\nError in bessel_init \n =>%s\n",bs.error_message);
+  start = timing_wtime();
+  if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
+    printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
     return _FAILURE_;
   }
+  stage_time[4] = timing_wtime()-start;
 
-  if (transfer_init(&pr,&ba,&th,&pt,&bs,&tr) == _FAILURE_) {
-    printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
+  start = timing_wtime();
+  if (nonlinear_init(&pr,&ba,&th,&pt,&pm,&nl) == _FAILURE_) {
+    printf("\n\nError in nonlinear_init \n=>%s\n",nl.error_message);
     return _FAILURE_;
   }
+  stage_time[5] = timing_wtime()-start;
 
-  if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
-    printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
+  start = timing_wtime();
+  if (transfer_init(&pr,&ba,&th,&pt,&nl,&tr) == _FAILURE_) {
+    printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
     return _FAILURE_;
   }
+  stage_time[6] = timing_wtime()-start;
 
-  if (spectra_init(&pr,&ba,&pt,&tr,&pm,&sp) == _FAILURE_) {
+  start = timing_wtime();
+  if (spectra_init(&pr,&ba,&pt,&pm,&nl,&tr,&sp) == _FAILURE_) {
     printf("\n\nError in spectra_init \n=>%s\n",sp.error_message);
     return _FAILURE_;
   }
+  stage_time[7] = timing_wtime()-start;
 
-  if (nonlinear_init(&pr,&ba,&th,&pm,&sp,&nl) == _FAILURE_) {
-    printf("\n\nError in nonlinear_init \n=>%s\n",nl.error_message);
-    return _FAILURE_;
-  }
-
-  end_other = omp_get_wtime();
-  start_lensing = end_other;
-
+  start = timing_wtime();
   if (lensing_init(&pr,&pt,&sp,&nl,&le) == _FAILURE_) {
     printf("\n\nError in lensing_init \n=>%s\n",le.error_message);
     return _FAILURE_;
   }
+  stage_time[8] = timing_wtime()-start;
 
-  end_lensing = omp_get_wtime();
+  /****** write the timings ******/
 
-  cpu_time_other =  (end_other-start_other);
-  cpu_time_lensing =  (end_lensing-start_lensing);
-  printf("time in other   = %4.3f s\n",cpu_time_other); 
-  printf("time in lensing = %4.3f s\n",cpu_time_lensing); 
-  
+  if (json_name == NULL) {
+    json = stdout;
+  }
+  else {
+    json = fopen(json_name,"a");
+    if (json == NULL) {
+      printf("\n\nError: could not open %s for writing\n",json_name);
+      return _FAILURE_;
+    }
+  }
 
-  if (output_init(&ba,&pt,&sp,&nl,&le,&op) == _FAILURE_) {
-    printf("\n\nError in output_init \n=>%s\n",op.error_message);
-    return _FAILURE_;
+  fprintf(json,"  {\"version\": \"%s\", \"input\": [",_VERSION_);
+  for (index_arg = 1; index_arg < argc; index_arg++)
+    fprintf(json,"%s\"%s\"",(index_arg > 1 ? ", " : ""),argv[index_arg]);
+  fprintf(json,"], \"threads\": %d,\n   \"stages\": {",threads);
+  for (index_stage = 0; index_stage < _TIMING_STAGES_; index_stage++) {
+    fprintf(json,"%s\"%s\": %.6f",(index_stage > 0 ? ", " : ""),stage_name[index_stage],stage_time[index_stage]);
+    total += stage_time[index_stage];
   }
+  fprintf(json,"},\n   \"total\": %.6f}\n",total);
+
+  if (json != stdout)
+    fclose(json);
 
-  /****** done ******/
+  /****** all calculations done, now free the structures ******/
 
   if (lensing_free(&le) == _FAILURE_) {
     printf("\n\nError in lensing_free \n=>%s\n",le.error_message);
     return _FAILURE_;
   }
 
-  if (nonlinear_free(&nl) == _FAILURE_) {
-    printf("\n\nError in nonlinear_free \n=>%s\n",nl.error_message);
-    return _FAILURE_;
-  }
-
   if (spectra_free(&sp) == _FAILURE_) {
     printf("\n\nError in spectra_free \n=>%s\n",sp.error_message);
     return _FAILURE_;
   }
 
-  if (primordial_free(&pm) == _FAILURE_) {
-    printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
+  if (transfer_free(&tr) == _FAILURE_) {
+    printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
     return _FAILURE_;
   }
 
-  if (transfer_free(&tr) == _FAILURE_) {
-    printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
+  if (nonlinear_free(&nl) == _FAILURE_) {
+    printf("\n\nError in nonlinear_free \n=>%s\n",nl.error_message);
     return _FAILURE_;
   }
 
-  if (bessel_free(&bs) == _FAILURE_)  {
-    printf("\n\nError in bessel_free \n=>%s\n",bs.error_message);
+  if (primordial_free(&pm) == _FAILURE_) {
+    printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
     return _FAILURE_;
   }
 
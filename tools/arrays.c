@@ -449,100 +449,180 @@ int array_spline(
   return _SUCCESS_;
 }
 
-int array_spline_table_line_to_line(
-				    double * x, /* vector of size x_size */
-				    int n_lines,
-				    double * array,
-				    int n_columns,
-				    int index_y,
-				    int index_ddydx2,
-				    short spline_mode,
-				    ErrorMsg errmsg) {
+/**
+ * Second derivative of one splined column: its value on line index_x
+ * is y[index_x*x_stride], and its second derivative is written at the
+ * same position of ddy. The forward elimination is stored in ddy and
+ * in the workspace u of x_size-1 numbers. The operations are those of
+ * array_spline_table_lines(), written in the same way, so that the
+ * second derivatives do not depend on the layout of the table.
+ */
 
-  int i,k;
-  double p,qn,sig,un;
-  double * u;
-  double dy_first;
-  double dy_last;
+static void array_spline_solve(
+                               double * x,
+                               int x_size,
+                               double * y,
+                               double * ddy,
+                               double * u,
+                               int x_stride,
+                               short spline_mode) {
 
-  u = malloc((n_lines-1) * sizeof(double));
-  if (u == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
-    return _FAILURE_;
-  }
+  double sig,p,qn,un,dy_first,dy_last;
+  int index_x;
+
+  index_x=0;
 
   if (spline_mode == _SPLINE_NATURAL_) {
-    *(array+0*n_columns+index_ddydx2) = u[0] = 0.0;
+    ddy[index_x*x_stride] = 0.0;
+    u[index_x] = 0.0;
   }
   else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
-      dy_first =
-	((x[2]-x[0])*(x[2]-x[0])*
-	 (*(array+1*n_columns+index_y)-*(array+0*n_columns+index_y))-
-	 (x[1]-x[0])*(x[1]-x[0])*
-	 (*(array+2*n_columns+index_y)-*(array+0*n_columns+index_y)))/
-	((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
-      *(array+0*n_columns+index_ddydx2) = -0.5;
-      u[0] =
-	(3./(x[1] -  x[0]))*
-	((*(array+1*n_columns+index_y) -  *(array+0*n_columns+index_y))/
-	 (x[1] - x[0])-dy_first);
-    }
-    else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
-    }
+    dy_first =
+      ((x[2]-x[0])*(x[2]-x[0])*
+       (y[1*x_stride]-y[0*x_stride])-
+       (x[1]-x[0])*(x[1]-x[0])*
+       (y[2*x_stride]-y[0*x_stride]))/
+      ((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
+
+    ddy[index_x*x_stride] = -0.5;
+
+    u[index_x] =
+      (3./(x[1] -  x[0]))*
+      ((y[1*x_stride]-y[0*x_stride])/
+       (x[1] - x[0])-dy_first);
   }
 
-  for (i=1; i < n_lines-1; i++) {
+  for (index_x=1; index_x < x_size-1; index_x++) {
 
-      sig = (x[i] - x[i-1]) / (x[i+1] - x[i-1]);
+    sig = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
 
-      p = sig * *(array+(i-1)*n_columns+index_ddydx2) + 2.0;
-      *(array+i*n_columns+index_ddydx2) = (sig-1.0)/p;
-      u[i] = (*(array+(i+1)*n_columns+index_y) - *(array+i*n_columns+index_y))
-	/ (x[i+1] - x[i])
-	- (*(array+i*n_columns+index_y) - *(array+(i-1)*n_columns+index_y))
-	/ (x[i] - x[i-1]);
-      u[i]= (6.0 * u[i] /
-	     (x[i+1] - x[i-1])
-	     - sig * u[i-1]) / p;
+    p = sig * ddy[(index_x-1)*x_stride] + 2.0;
+
+    ddy[index_x*x_stride] = (sig-1.0)/p;
+
+    u[index_x] =
+      (y[(index_x+1)*x_stride] - y[index_x*x_stride])
+      / (x[index_x+1] - x[index_x])
+      - (y[index_x*x_stride] - y[(index_x-1)*x_stride])
+      / (x[index_x] - x[index_x-1]);
 
+    u[index_x] = (6.0 * u[index_x] /
+                  (x[index_x+1] - x[index_x-1])
+                  - sig * u[index_x-1]) / p;
   }
 
   if (spline_mode == _SPLINE_NATURAL_) {
-    qn=0.;
-    un=0.;
+    qn=un=0.0;
   }
   else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
-      dy_last =
-	((x[n_lines-3]-x[n_lines-1])*(x[n_lines-3]-x[n_lines-1])*
-	 (*(array+(n_lines-2)*n_columns+index_y)-*(array+(n_lines-1)*n_columns+index_y))-
-	 (x[n_lines-2]-x[n_lines-1])*(x[n_lines-2]-x[n_lines-1])*
-	 (*(array+(n_lines-3)*n_columns+index_y)-*(array+(n_lines-1)*n_columns+index_y)))/
-	((x[n_lines-3]-x[n_lines-1])*(x[n_lines-2]-x[n_lines-1])*(x[n_lines-3]-x[n_lines-2]));
-      qn=0.5;
-      un =
-	(3./(x[n_lines-1] - x[n_lines-2]))*
-	(dy_last-(*(array+(n_lines-1)*n_columns+index_y) -  *(array+(n_lines-2)*n_columns+index_y))/
-	 (x[n_lines-1] - x[n_lines-2]));
-    }
-    else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
-    }
+    dy_last =
+      ((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
+       (y[(x_size-2)*x_stride]-y[(x_size-1)*x_stride])-
+       (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
+       (y[(x_size-3)*x_stride]-y[(x_size-1)*x_stride]))/
+      ((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
+
+    qn=0.5;
+
+    un=
+      (3./(x[x_size-1] - x[x_size-2]))*
+      (dy_last-(y[(x_size-1)*x_stride] - y[(x_size-2)*x_stride])/
+       (x[x_size-1] - x[x_size-2]));
   }
 
-  *(array+(n_lines-1)*n_columns+index_ddydx2) =
-    (un-qn*u[n_lines-2])/(qn* *(array+(n_lines-2)*n_columns+index_ddydx2)+1.0);
+  index_x=x_size-1;
 
-  for (k=n_lines-2; k>=0; k--)
-    *(array+k*n_columns+index_ddydx2) = *(array+k*n_columns+index_ddydx2) *
-      *(array+(k+1)*n_columns+index_ddydx2) + u[k];
+  ddy[index_x*x_stride] =
+    (un - qn * u[index_x-1]) /
+    (qn * ddy[(index_x-1)*x_stride] + 1.0);
+
+  for (index_x=x_size-2; index_x >= 0; index_x--) {
+    ddy[index_x*x_stride] = ddy[index_x*x_stride] * ddy[(index_x+1)*x_stride] + u[index_x];
+  }
+}
+
+/**
+ * Spline y_size columns, the first value of column index_y being at
+ * y_array[index_y*y_stride] and the next ones every x_stride numbers.
+ * Columns are shared between threads for tables of at least
+ * _SPLINE_PARALLEL_MIN_SIZE_ elements (when not already inside a
+ * parallel region, where this runs on the calling thread only).
+ */
+
+static int array_spline_table(
+                              double * x,
+                              int x_size,
+                              double * y_array,
+                              double * ddy_array,
+                              int x_stride,
+                              int y_stride,
+                              int y_size,
+                              short spline_mode,
+                              ErrorMsg errmsg) {
+
+  double * u;
+  int index_y;
+
+  class_test((spline_mode != _SPLINE_NATURAL_) && (spline_mode != _SPLINE_EST_DERIV_),
+             errmsg,
+             "Spline mode not identified: %d",spline_mode);
+
+  class_test(x_size < ((spline_mode == _SPLINE_EST_DERIV_) ? 3 : 2),
+             errmsg,
+             "cannot spline a table of %d lines",x_size);
+
+  if (spline_mode == _SPLINE_EST_DERIV_) {
+    class_test(x[2]-x[0]==0.,
+               errmsg,
+               "x[2]=%g, x[0]=%g, stop to avoid seg fault",x[2],x[0]);
+    class_test(x[1]-x[0]==0.,
+               errmsg,
+               "x[1]=%g, x[0]=%g, stop to avoid seg fault",x[1],x[0]);
+    class_test(x[2]-x[1]==0.,
+               errmsg,
+               "x[2]=%g, x[1]=%g, stop to avoid seg fault",x[2],x[1]);
+  }
+
+  class_alloc(u,(size_t)y_size*(x_size-1)*sizeof(double),errmsg);
+
+#pragma omp parallel for schedule (static) if ((double)x_size*y_size >= _SPLINE_PARALLEL_MIN_SIZE_)
+  for (index_y=0; index_y<y_size; index_y++) {
+    array_spline_solve(x,
+                       x_size,
+                       y_array+index_y*y_stride,
+                       ddy_array+index_y*y_stride,
+                       u+(size_t)index_y*(x_size-1),
+                       x_stride,
+                       spline_mode);
+  }
 
   free(u);
 
+  return _SUCCESS_;
+}
+
+int array_spline_table_line_to_line(
+				    double * x, /* vector of size x_size */
+				    int n_lines,
+				    double * array,
+				    int n_columns,
+				    int index_y,
+				    int index_ddydx2,
+				    short spline_mode,
+				    ErrorMsg errmsg) {
+
+  class_call(array_spline_table(x,
+                                n_lines,
+                                array+index_y,
+                                array+index_ddydx2,
+                                n_columns,
+                                0,
+                                1,
+                                spline_mode,
+                                errmsg),
+             errmsg,
+             errmsg);
+
   return _SUCCESS_;
  }
 
@@ -1048,128 +1128,17 @@ int array_spline_table_columns2(
 		       ErrorMsg errmsg
 		       ) {
 
-  double * p;
-  double * qn;
-  double * un;
-  double * u;
-  double sig;
-  int index_x;
-  int index_y;
-  double dy_first;
-  double dy_last;
-
-  u = malloc((x_size-1) * y_size * sizeof(double));
-  p = malloc(y_size * sizeof(double));
-  qn = malloc(y_size * sizeof(double));
-  un = malloc(y_size * sizeof(double));
-  if (u == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (p == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate p",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (qn == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate qn",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (un == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate un",__func__,__LINE__);
-    return _FAILURE_;
-  }
-
-#pragma omp parallel                                                \
-  shared(x,x_size,y_array,y_size,ddy_array,spline_mode,p,qn,un,u)   \
-  private(index_y,index_x,sig,dy_first,dy_last)
-  {
-
-#pragma omp for schedule (dynamic)
-
-    for (index_y=0; index_y < y_size; index_y++) {
-
-      if (spline_mode == _SPLINE_NATURAL_) {
-        ddy_array[index_y*x_size+0] = 0.0;
-        u[0*y_size+index_y] = 0.0;
-      }
-      else {
-        dy_first =
-          ((x[2]-x[0])*(x[2]-x[0])*
-           (y_array[index_y*x_size+1]-y_array[index_y*x_size+0])-
-           (x[1]-x[0])*(x[1]-x[0])*
-           (y_array[index_y*x_size+2]-y_array[index_y*x_size+0]))/
-          ((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
-
-        ddy_array[index_y*x_size+0] = -0.5;
-
-        u[0*y_size+index_y] =
-          (3./(x[1] -  x[0]))*
-          ((y_array[index_y*x_size+1]-y_array[index_y*x_size+0])/
-           (x[1] - x[0])-dy_first);
-
-      }
-
-      for (index_x=1; index_x < x_size-1; index_x++) {
-
-        sig = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
-
-        p[index_y] = sig * ddy_array[index_y*x_size+(index_x-1)] + 2.0;
-
-        ddy_array[index_y*x_size+index_x] = (sig-1.0)/p[index_y];
-
-        u[index_x*y_size+index_y] =
-          (y_array[index_y*x_size+(index_x+1)] - y_array[index_y*x_size+index_x])
-          / (x[index_x+1] - x[index_x])
-          - (y_array[index_y*x_size+index_x] - y_array[index_y*x_size+(index_x-1)])
-          / (x[index_x] - x[index_x-1]);
-
-        u[index_x*y_size+index_y] = (6.0 * u[index_x*y_size+index_y] /
-                                     (x[index_x+1] - x[index_x-1])
-                                     - sig * u[(index_x-1)*y_size+index_y]) / p[index_y];
-
-      }
-
-      if (spline_mode == _SPLINE_NATURAL_) {
-
-        qn[index_y]=un[index_y]=0.0;
-
-      }
-      else {
-
-        dy_last =
-          ((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
-           (y_array[index_y*x_size+(x_size-2)]-y_array[index_y*x_size+(x_size-1)])-
-           (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
-           (y_array[index_y*x_size+(x_size-3)]-y_array[index_y*x_size+(x_size-1)]))/
-          ((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
-
-        qn[index_y]=0.5;
-
-        un[index_y]=
-          (3./(x[x_size-1] - x[x_size-2]))*
-          (dy_last-(y_array[index_y*x_size+(x_size-1)] - y_array[index_y*x_size+(x_size-2)])/
-           (x[x_size-1] - x[x_size-2]));
-
-      }
-
-      index_x=x_size-1;
-
-      ddy_array[index_y*x_size+index_x] =
-        (un[index_y] - qn[index_y] * u[(index_x-1)*y_size+index_y]) /
-        (qn[index_y] * ddy_array[index_y*x_size+(index_x-1)] + 1.0);
-
-      for (index_x=x_size-2; index_x >= 0; index_x--) {
-
-        ddy_array[index_y*x_size+index_x] = ddy_array[index_y*x_size+index_x] *
-          ddy_array[index_y*x_size+(index_x+1)] + u[index_x*y_size+index_y];
-
-      }
-    }
-  }
-  free(qn);
-  free(p);
-  free(u);
-  free(un);
+  class_call(array_spline_table(x,
+                                x_size,
+                                y_array,
+                                ddy_array,
+                                1,
+                                x_size,
+                                y_size,
+                                spline_mode,
+                                errmsg),
+             errmsg,
+             errmsg);
 
   return _SUCCESS_;
  }
@@ -1186,6 +1155,34 @@ int array_spline_table_one_column(
 		       ErrorMsg errmsg
 		       ) {
 
+  class_call(array_spline_table(x,
+                                x_size,
+                                y_array+index_y*x_size,
+                                ddy_array+index_y*x_size,
+                                1,
+                                0,
+                                1,
+                                spline_mode,
+                                errmsg),
+             errmsg,
+             errmsg);
+
+  return _SUCCESS_;
+}
+
+int array_logspline_table_one_column(
+		       double * x, /* vector of size x_size */
+		       int x_size,
+		       int x_stop,
+		       double * y_array, /* array of size x_size*y_size with elements
+					  y_array[index_y*x_size+index_x] */
+		       int y_size,
+		       int index_y,
+		       double * ddlogy_array, /* array of size x_size*y_size */
+		       short spline_mode,
+		       ErrorMsg errmsg
+		       ) {
+
   double p;
   double qn;
   double un;
@@ -1195,7 +1192,7 @@ int array_spline_table_one_column(
   double dy_first;
   double dy_last;
 
-  u = malloc((x_size-1) * sizeof(double));
+  u = malloc((x_stop-1) * sizeof(double));
   if (u == NULL) {
     sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
     return _FAILURE_;
@@ -1206,25 +1203,25 @@ int array_spline_table_one_column(
   index_x=0;
 
   if (spline_mode == _SPLINE_NATURAL_) {
-    ddy_array[index_y*x_size+index_x] = 0.0;
+    ddlogy_array[index_y*x_size+index_x] = 0.0;
     u[index_x] = 0.0;
   }
   else {
     if (spline_mode == _SPLINE_EST_DERIV_) {
 
       dy_first =
-	((x[2]-x[0])*(x[2]-x[0])*
-	 (y_array[index_y*x_size+1]-y_array[index_y*x_size+0])-
-	 (x[1]-x[0])*(x[1]-x[0])*
-	 (y_array[index_y*x_size+2]-y_array[index_y*x_size+0]))/
-	((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
+	((log(x[2])-log(x[0]))*(log(x[2])-log(x[0]))*
+	 (log(y_array[index_y*x_size+1])-log(y_array[index_y*x_size+0]))-
+	 (log(x[1])-log(x[0]))*(log(x[1])-log(x[0]))*
+	 (log(y_array[index_y*x_size+2])-log(y_array[index_y*x_size+0])))/
+	((log(x[2])-log(x[0]))*(log(x[1])-log(x[0]))*(log(x[2])-log(x[1])));
 
-      ddy_array[index_y*x_size+index_x] = -0.5;
+      ddlogy_array[index_y*x_size+index_x] = -0.5;
 
       u[index_x] =
-	(3./(x[1] -  x[0]))*
-	((y_array[index_y*x_size+1]-y_array[index_y*x_size+0])/
-	 (x[1] - x[0])-dy_first);
+	(3./(log(x[1]) -  log(x[0])))*
+	((log(y_array[index_y*x_size+1])-log(y_array[index_y*x_size+0]))/
+	 (log(x[1]) - log(x[0]))-dy_first);
 
     }
     else {
@@ -1235,22 +1232,22 @@ int array_spline_table_one_column(
 
   /************************************************/
 
-  for (index_x=1; index_x < x_size-1; index_x++) {
+  for (index_x=1; index_x < x_stop-1; index_x++) {
 
-    sig = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
+    sig = (log(x[index_x]) - log(x[index_x-1]))/(log(x[index_x+1]) - log(x[index_x-1]));
 
-    p = sig * ddy_array[index_y*x_size+(index_x-1)] + 2.0;
+    p = sig * ddlogy_array[index_y*x_size+(index_x-1)] + 2.0;
 
-    ddy_array[index_y*x_size+index_x] = (sig-1.0)/p;
+    ddlogy_array[index_y*x_size+index_x] = (sig-1.0)/p;
 
     u[index_x] =
-      (y_array[index_y*x_size+(index_x+1)] - y_array[index_y*x_size+index_x])
-      / (x[index_x+1] - x[index_x])
-      - (y_array[index_y*x_size+index_x] - y_array[index_y*x_size+(index_x-1)])
-      / (x[index_x] - x[index_x-1]);
+      (log(y_array[index_y*x_size+(index_x+1)]) - log(y_array[index_y*x_size+index_x]))
+      / (log(x[index_x+1]) - log(x[index_x]))
+      - (log(y_array[index_y*x_size+index_x]) - log(y_array[index_y*x_size+(index_x-1)]))
+      / (log(x[index_x]) - log(x[index_x-1]));
 
     u[index_x] = (6.0 * u[index_x] /
-		  (x[index_x+1] - x[index_x-1])
+		  (log(x[index_x+1]) - log(x[index_x-1]))
 		  - sig * u[index_x-1]) / p;
 
   }
@@ -1266,18 +1263,19 @@ int array_spline_table_one_column(
     if (spline_mode == _SPLINE_EST_DERIV_) {
 
       dy_last =
-	((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
-	 (y_array[index_y*x_size+(x_size-2)]-y_array[index_y*x_size+(x_size-1)])-
-	 (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
-	 (y_array[index_y*x_size+(x_size-3)]-y_array[index_y*x_size+(x_size-1)]))/
-	((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
+	((log(x[x_stop-3])-log(x[x_stop-1]))*(log(x[x_stop-3])-log(x[x_stop-1]))*
+	 (log(y_array[index_y*x_size+(x_stop-2)])-log(y_array[index_y*x_size+(x_stop-1)]))-
+	 (log(x[x_stop-2])-log(x[x_stop-1]))*(log(x[x_stop-2])-log(x[x_stop-1]))*
+	 (log(y_array[index_y*x_size+(x_stop-3)])-log(y_array[index_y*x_size+(x_stop-1)])))/
+	((log(x[x_stop-3])-log(x[x_stop-1]))*(log(x[x_stop-2])-log(x[x_stop-1]))*
+	 (log(x[x_stop-3])-log(x[x_stop-2])));
 
       qn=0.5;
 
       un=
-	(3./(x[x_size-1] - x[x_size-2]))*
-	(dy_last-(y_array[index_y*x_size+(x_size-1)] - y_array[index_y*x_size+(x_size-2)])/
-	 (x[x_size-1] - x[x_size-2]));
+	(3./(log(x[x_stop-1]) - log(x[x_stop-2])))*
+	(dy_last-(log(y_array[index_y*x_size+(x_stop-1)]) - log(y_array[index_y*x_size+(x_stop-2)]))/
+	 (log(x[x_stop-1]) - log(x[x_stop-2])));
 
     }
     else {
@@ -1288,150 +1286,16 @@ int array_spline_table_one_column(
 
   /************************************************/
 
-  index_x=x_size-1;
+  index_x=x_stop-1;
 
-  ddy_array[index_y*x_size+index_x] =
+  ddlogy_array[index_y*x_size+index_x] =
     (un - qn * u[index_x-1]) /
-    (qn * ddy_array[index_y*x_size+(index_x-1)] + 1.0);
+    (qn * ddlogy_array[index_y*x_size+(index_x-1)] + 1.0);
 
-  for (index_x=x_size-2; index_x >= 0; index_x--) {
+  for (index_x=x_stop-2; index_x >= 0; index_x--) {
 
-    ddy_array[index_y*x_size+index_x] = ddy_array[index_y*x_size+index_x] *
-      ddy_array[index_y*x_size+(index_x+1)] + u[index_x];
-
-  }
-
-  free(u);
-
-  return _SUCCESS_;
-}
-
-int array_logspline_table_one_column(
-		       double * x, /* vector of size x_size */
-		       int x_size,
-		       int x_stop,
-		       double * y_array, /* array of size x_size*y_size with elements
-					  y_array[index_y*x_size+index_x] */
-		       int y_size,
-		       int index_y,
-		       double * ddlogy_array, /* array of size x_size*y_size */
-		       short spline_mode,
-		       ErrorMsg errmsg
-		       ) {
-
-  double p;
-  double qn;
-  double un;
-  double * u;
-  double sig;
-  int index_x;
-  double dy_first;
-  double dy_last;
-
-  u = malloc((x_stop-1) * sizeof(double));
-  if (u == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
-    return _FAILURE_;
-  }
-
-  /************************************************/
-
-  index_x=0;
-
-  if (spline_mode == _SPLINE_NATURAL_) {
-    ddlogy_array[index_y*x_size+index_x] = 0.0;
-    u[index_x] = 0.0;
-  }
-  else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
-
-      dy_first =
-	((log(x[2])-log(x[0]))*(log(x[2])-log(x[0]))*
-	 (log(y_array[index_y*x_size+1])-log(y_array[index_y*x_size+0]))-
-	 (log(x[1])-log(x[0]))*(log(x[1])-log(x[0]))*
-	 (log(y_array[index_y*x_size+2])-log(y_array[index_y*x_size+0])))/
-	((log(x[2])-log(x[0]))*(log(x[1])-log(x[0]))*(log(x[2])-log(x[1])));
-
-      ddlogy_array[index_y*x_size+index_x] = -0.5;
-
-      u[index_x] =
-	(3./(log(x[1]) -  log(x[0])))*
-	((log(y_array[index_y*x_size+1])-log(y_array[index_y*x_size+0]))/
-	 (log(x[1]) - log(x[0]))-dy_first);
-
-    }
-    else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
-    }
-  }
-
-  /************************************************/
-
-  for (index_x=1; index_x < x_stop-1; index_x++) {
-
-    sig = (log(x[index_x]) - log(x[index_x-1]))/(log(x[index_x+1]) - log(x[index_x-1]));
-
-    p = sig * ddlogy_array[index_y*x_size+(index_x-1)] + 2.0;
-
-    ddlogy_array[index_y*x_size+index_x] = (sig-1.0)/p;
-
-    u[index_x] =
-      (log(y_array[index_y*x_size+(index_x+1)]) - log(y_array[index_y*x_size+index_x]))
-      / (log(x[index_x+1]) - log(x[index_x]))
-      - (log(y_array[index_y*x_size+index_x]) - log(y_array[index_y*x_size+(index_x-1)]))
-      / (log(x[index_x]) - log(x[index_x-1]));
-
-    u[index_x] = (6.0 * u[index_x] /
-		  (log(x[index_x+1]) - log(x[index_x-1]))
-		  - sig * u[index_x-1]) / p;
-
-  }
-
-  /************************************************/
-
-  if (spline_mode == _SPLINE_NATURAL_) {
-
-      qn=un=0.0;
-
-  }
-  else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
-
-      dy_last =
-	((log(x[x_stop-3])-log(x[x_stop-1]))*(log(x[x_stop-3])-log(x[x_stop-1]))*
-	 (log(y_array[index_y*x_size+(x_stop-2)])-log(y_array[index_y*x_size+(x_stop-1)]))-
-	 (log(x[x_stop-2])-log(x[x_stop-1]))*(log(x[x_stop-2])-log(x[x_stop-1]))*
-	 (log(y_array[index_y*x_size+(x_stop-3)])-log(y_array[index_y*x_size+(x_stop-1)])))/
-	((log(x[x_stop-3])-log(x[x_stop-1]))*(log(x[x_stop-2])-log(x[x_stop-1]))*
-	 (log(x[x_stop-3])-log(x[x_stop-2])));
-
-      qn=0.5;
-
-      un=
-	(3./(log(x[x_stop-1]) - log(x[x_stop-2])))*
-	(dy_last-(log(y_array[index_y*x_size+(x_stop-1)]) - log(y_array[index_y*x_size+(x_stop-2)]))/
-	 (log(x[x_stop-1]) - log(x[x_stop-2])));
-
-    }
-    else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
-    }
-  }
-
-  /************************************************/
-
-  index_x=x_stop-1;
-
-  ddlogy_array[index_y*x_size+index_x] =
-    (un - qn * u[index_x-1]) /
-    (qn * ddlogy_array[index_y*x_size+(index_x-1)] + 1.0);
-
-  for (index_x=x_stop-2; index_x >= 0; index_x--) {
-
-    ddlogy_array[index_y*x_size+index_x] = ddlogy_array[index_y*x_size+index_x] *
-      ddlogy_array[index_y*x_size+(index_x+1)] + u[index_x];
+    ddlogy_array[index_y*x_size+index_x] = ddlogy_array[index_y*x_size+index_x] *
+      ddlogy_array[index_y*x_size+(index_x+1)] + u[index_x];
 
   }
 
@@ -1515,6 +1379,138 @@ int array_integrate_all_trapzd_or_spline(
   return _SUCCESS_;
 }
 
+/**
+ * Compute the weights \f$ w_i \f$ such that \f$ \sum_i w_i y_i \f$ is
+ * the integral returned by array_integrate_all_trapzd_or_spline(),
+ * for second derivatives of y computed by array_spline() in
+ * _SPLINE_EST_DERIV_ mode.
+ *
+ * Both steps are linear in y. The weights follow from the transposed
+ * spline system, solved once in O(n_lines) operations; any function
+ * sampled at the same nodes can then be integrated with a single
+ * scalar product.
+ *
+ * @param x                  Input: vector of abscissas x[index], size n_lines
+ * @param n_lines            Input: number of abscissas (at least 3)
+ * @param index_start_spline Input: below this index, integration is trapezoidal
+ * @param w                  Output: vector of weights, size n_lines
+ * @param errmsg             Output: error message
+ * @return the error status
+ */
+
+int array_integrate_all_trapzd_or_spline_weights(
+                                                 double * x,
+                                                 int n_lines,
+                                                 int index_start_spline,
+                                                 double * w,
+                                                 ErrorMsg errmsg) {
+
+  int i;
+  double h,h3,bet,fac,dx10,dx20,dx21,den,c0,c1,c2;
+  double * sig;
+  double * gam;
+  double * z;
+
+  if (n_lines < 3) {
+    sprintf(errmsg,"%s(L:%d) n_lines=%d, while routine needs n_lines >= 3",__func__,__LINE__,n_lines);
+    return _FAILURE_;
+  }
+
+  if ((index_start_spline<0) || (index_start_spline>=n_lines)) {
+    sprintf(errmsg,"%s(L:%d) index_start_spline outside of range",__func__,__LINE__);
+    return _FAILURE_;
+  }
+
+  sig = malloc(3*n_lines*sizeof(double));
+  if (sig == NULL) {
+    sprintf(errmsg,"%s(L:%d) Cannot allocate sig",__func__,__LINE__);
+    return _FAILURE_;
+  }
+  gam = sig + n_lines;
+  z = gam + n_lines;
+
+  /** - weights of y (trapezoidal part) and of its second derivative
+      (spline correction) in the integral; the latter are stored in z */
+
+  for (i=0; i < n_lines; i++) {
+    w[i] = 0.;
+    z[i] = 0.;
+  }
+
+  for (i=0; i < n_lines-1; i++) {
+    h = x[i+1]-x[i];
+    w[i] += h/2.;
+    w[i+1] += h/2.;
+    if (i >= index_start_spline) {
+      h3 = h*h*h/24.;
+      z[i] += h3;
+      z[i+1] += h3;
+    }
+  }
+
+  /** - the second derivatives solve A ddy = B y, with A the
+      tridiagonal matrix of array_spline() (rows normalised to a
+      diagonal equal to 2, sub-diagonal sig[i], super-diagonal
+      1-sig[i], and 1 in the two boundary rows). Solve the transposed
+      system A^T z = z in place */
+
+  for (i=1; i < n_lines-1; i++)
+    sig[i] = (x[i]-x[i-1])/(x[i+1]-x[i-1]);
+
+  /* A^T has diagonal 2, sub-diagonal [A]_{i-1,i} and super-diagonal [A]_{i+1,i} */
+  bet = 2.;
+  z[0] /= bet;
+  for (i=1; i < n_lines; i++) {
+    gam[i] = ((i == n_lines-1) ? 1. : sig[i])/bet;
+    c0 = (i == 1) ? 1. : 1.-sig[i-1];
+    bet = 2. - c0*gam[i];
+    z[i] = (z[i]-c0*z[i-1])/bet;
+  }
+  for (i=n_lines-2; i >= 0; i--)
+    z[i] -= gam[i+1]*z[i+1];
+
+  /** - add the weights B^T z, row by row of B */
+
+  /* first row: clamped spline with the derivative estimated from the first three points */
+  dx10 = x[1]-x[0];
+  dx20 = x[2]-x[0];
+  dx21 = x[2]-x[1];
+  den = dx20*dx10*dx21;
+  c1 = dx20*dx20/den;
+  c2 = -dx10*dx10/den;
+  c0 = -(c1+c2);
+  fac = 6./dx10*z[0];
+  w[0] += fac*(-1./dx10-c0);
+  w[1] += fac*(1./dx10-c1);
+  w[2] += fac*(-c2);
+
+  /* inner rows */
+  for (i=1; i < n_lines-1; i++) {
+    fac = 6.*z[i]/(x[i+1]-x[i-1]);
+    w[i-1] += fac/(x[i]-x[i-1]);
+    w[i] -= fac*(1./(x[i+1]-x[i])+1./(x[i]-x[i-1]));
+    w[i+1] += fac/(x[i+1]-x[i]);
+  }
+
+  /* last row: clamped spline with the derivative estimated from the last three points */
+  dx10 = x[n_lines-3]-x[n_lines-1];
+  dx20 = x[n_lines-2]-x[n_lines-1];
+  dx21 = x[n_lines-3]-x[n_lines-2];
+  den = dx10*dx20*dx21;
+  c1 = dx10*dx10/den;
+  c2 = -dx20*dx20/den;
+  c0 = -(c1+c2);
+  h = x[n_lines-1]-x[n_lines-2];
+  fac = 6./h*z[n_lines-1];
+  w[n_lines-1] += fac*(c0-1./h);
+  w[n_lines-2] += fac*(c1+1./h);
+  w[n_lines-3] += fac*c2;
+
+  free(sig);
+
+  return _SUCCESS_;
+}
+
  /**
  * Not called.
  */
@@ -1667,6 +1663,295 @@ int array_interpolate(
   return _SUCCESS_;
 }
 
+/**
+ * Prepare the interpolation of tables on the grid x_array (growing or
+ * decreasing): the width of each interval, needed for the relative
+ * position of any x and for the spline correction, is computed here
+ * once. The structure is only read by array_interpolation_locate()
+ * and array_interpolation_evaluate(), so that several threads can
+ * share it, each keeping its own position in the grid.
+ *
+ * @param x_array  Input: values of x on each line (not copied, must remain allocated)
+ * @param n_lines  Input: number of lines
+ * @param pint     Output: interpolation grid
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int array_interpolation_init(
+                             double * x_array,
+                             int n_lines,
+                             struct array_interpolation * pint,
+                             ErrorMsg errmsg) {
+
+  int i;
+  double h;
+
+  class_test(n_lines < 2,
+             errmsg,
+             "cannot interpolate on a grid of %d lines",n_lines);
+
+  array_interpolation_view(x_array,n_lines,pint);
+
+  for (i=0; i<n_lines-1; i++) {
+    h = x_array[i+1]-x_array[i];
+    class_test(((pint->growing == _TRUE_) && (h <= 0.)) || ((pint->growing == _FALSE_) && (h >= 0.)),
+               errmsg,
+               "x_array should be strictly monotonic, while x[%d]=%e and x[%d]=%e",i,x_array[i],i+1,x_array[i+1]);
+  }
+
+  class_alloc(pint->h,(n_lines-1)*sizeof(double),errmsg);
+
+  for (i=0; i<n_lines-1; i++)
+    pint->h[i] = x_array[i+1]-x_array[i];
+
+  return _SUCCESS_;
+}
+
+/**
+ * Interpolation grid without precomputed widths, which are then
+ * computed at each evaluation. Nothing is allocated: used by the
+ * functions array_interpolate_xxx() called once on a given table.
+ *
+ * @param x_array  Input: values of x on each line
+ * @param n_lines  Input: number of lines
+ * @param pint     Output: interpolation grid
+ * @return the error status
+ */
+
+int array_interpolation_view(
+                             double * x_array,
+                             int n_lines,
+                             struct array_interpolation * pint) {
+
+  pint->x_array = x_array;
+  pint->n_lines = n_lines;
+  pint->growing = (x_array[0] < x_array[n_lines-1]) ? _TRUE_ : _FALSE_;
+  pint->h = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free an interpolation grid initialized with array_interpolation_init().
+ *
+ * @param pint Input: interpolation grid
+ * @return the error status
+ */
+
+int array_interpolation_free(
+                             struct array_interpolation * pint) {
+
+  free(pint->h);
+  pint->h = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the interval of the grid containing x, and the relative
+ * position of x in this interval.
+ *
+ * The search starts from the interval *last_index found for the
+ * previous point of the same caller: its neighbours are tried first,
+ * then the distance is doubled at each step until x is bracketed,
+ * and the bracket is finally bisected. A negative *last_index means
+ * no previous point, and the whole grid is bisected. The interval is
+ * always the same as with a plain bisection: the last line i (up to
+ * n_lines-2) such that x_array[i] <= x for a growing grid.
+ *
+ * @param pint       Input: interpolation grid
+ * @param x          Input: point where the interpolation is performed
+ * @param last_index Input/Output: index of the line before x (cursor of the caller)
+ * @param weight     Output: relative position b=(x-x_array[inf])/(x_array[inf+1]-x_array[inf])
+ * @param errmsg     Output: error message
+ * @return the error status
+ */
+
+int array_interpolation_locate(
+                               struct array_interpolation * pint,
+                               double x,
+                               int * last_index,
+                               double * weight,
+                               ErrorMsg errmsg) {
+
+  double * x_array = pint->x_array;
+  int n_lines = pint->n_lines;
+  double x_min,x_max;
+  double sign;
+  int inf,sup,mid,inc;
+
+  if (pint->growing == _TRUE_) {
+    x_min = x_array[0];
+    x_max = x_array[n_lines-1];
+    sign = 1.;
+  }
+  else {
+    x_min = x_array[n_lines-1];
+    x_max = x_array[0];
+    sign = -1.;
+  }
+
+  if (x < x_min) {
+    sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_min);
+    return _FAILURE_;
+  }
+
+  if (x > x_max) {
+    sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_max);
+    return _FAILURE_;
+  }
+
+  /* with sign*x, the grid is always growing */
+
+  inf = *last_index;
+
+  if ((inf < 0) || (inf > n_lines-2)) {
+    inf = 0;
+    sup = n_lines-1;
+  }
+  else if (sign*x < sign*x_array[inf]) {
+    /* hunt downward */
+    sup = inf;
+    inc = 1;
+    inf = sup-inc;
+    while ((inf > 0) && (sign*x < sign*x_array[inf])) {
+      sup = inf;
+      inc *= 2;
+      inf = MAX(sup-inc,0);
+    }
+  }
+  else {
+    /* hunt upward */
+    inc = 1;
+    sup = inf+inc;
+    while ((sup < n_lines-1) && (sign*x >= sign*x_array[sup])) {
+      inf = sup;
+      inc *= 2;
+      sup = MIN(inf+inc,n_lines-1);
+    }
+  }
+
+  /* bisect */
+  while (sup-inf > 1) {
+    mid=(int)(0.5*(inf+sup));
+    if (sign*x < sign*x_array[mid]) {sup=mid;}
+    else {inf=mid;}
+  }
+
+  *last_index = inf;
+
+  if (pint->h != NULL)
+    *weight = (x-x_array[inf])/pint->h[inf];
+  else
+    *weight = (x-x_array[inf])/(x_array[inf+1]-x_array[inf]);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Evaluate the first result_size columns of a table, interpolated at
+ * the point located by array_interpolation_locate(). The loop over
+ * columns is vectorised.
+ *
+ * @param pint          Input: interpolation grid
+ * @param array         Input: table of values (n_lines*n_columns)
+ * @param array_splined Input: table of second derivatives from array_spline_table_lines(), or NULL for a linear interpolation
+ * @param n_columns     Input: number of columns
+ * @param inf           Input: index of the line before x
+ * @param b             Input: relative position of x in the interval
+ * @param result        Output: interpolated values
+ * @param result_size   Input: number of columns to interpolate
+ * @return the error status
+ */
+
+int array_interpolation_evaluate(
+                                 struct array_interpolation * pint,
+                                 double * __restrict__ array,
+                                 double * __restrict__ array_splined,
+                                 int n_columns,
+                                 int inf,
+                                 double b,
+                                 double * __restrict__ result,
+                                 int result_size) {
+
+  double * y_inf = array+inf*n_columns;
+  double * y_sup = y_inf+n_columns;
+  double * d_inf;
+  double * d_sup;
+  double a,h;
+  int i;
+
+  a = 1-b;
+
+  if (array_splined == NULL) {
+#pragma omp simd
+    for (i=0; i<result_size; i++)
+      result[i] = a*y_inf[i] + b*y_sup[i];
+    return _SUCCESS_;
+  }
+
+  if (pint->h != NULL)
+    h = pint->h[inf];
+  else
+    h = pint->x_array[inf+1]-pint->x_array[inf];
+
+  d_inf = array_splined+inf*n_columns;
+  d_sup = d_inf+n_columns;
+
+#pragma omp simd
+  for (i=0; i<result_size; i++)
+    result[i] =
+      a*y_inf[i] + b*y_sup[i] +
+      ((a*a*a-a)*d_inf[i] + (b*b*b-b)*d_sup[i])*h*h/6.;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Interpolate the first result_size columns of a table at n_points
+ * points. Sorted points are located in a single pass over the grid.
+ *
+ * @param pint          Input: interpolation grid
+ * @param array         Input: table of values (n_lines*n_columns)
+ * @param array_splined Input: table of second derivatives, or NULL for a linear interpolation
+ * @param n_columns     Input: number of columns
+ * @param x             Input: points where the interpolation is performed
+ * @param n_points      Input: number of points
+ * @param last_index    Input/Output: cursor of the caller (negative if unknown)
+ * @param result        Output: result[index_point*result_size+index_column] (must be already allocated)
+ * @param result_size   Input: number of columns to interpolate
+ * @param errmsg        Output: error message
+ * @return the error status
+ */
+
+int array_interpolation_at_points(
+                                  struct array_interpolation * pint,
+                                  double * array,
+                                  double * array_splined,
+                                  int n_columns,
+                                  double * x,
+                                  int n_points,
+                                  int * last_index,
+                                  double * result,
+                                  int result_size,
+                                  ErrorMsg errmsg) {
+
+  int index_point;
+  double b;
+
+  for (index_point=0; index_point<n_points; index_point++) {
+
+    class_call(array_interpolation_locate(pint,x[index_point],last_index,&b,errmsg),
+               errmsg,
+               errmsg);
+
+    array_interpolation_evaluate(pint,array,array_splined,n_columns,*last_index,b,result+index_point*result_size,result_size);
+  }
+
+  return _SUCCESS_;
+}
+
  /**
   * interpolate to get y_i(x), when x and y_i are in different arrays
   *
@@ -1684,68 +1969,176 @@ int array_interpolate_spline(
                              int result_size, /** from 1 to n_columns */
                              ErrorMsg errmsg) {
 
-  int inf,sup,mid,i;
-  double h,a,b;
+  struct array_interpolation interpolation;
+  double b;
 
-  inf=0;
-  sup=n_lines-1;
+  array_interpolation_view(x_array,n_lines,&interpolation);
 
-  if (x_array[inf] < x_array[sup]){
+  *last_index = -1;
 
-    if (x < x_array[inf]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[inf]);
-      return _FAILURE_;
-    }
+  class_call(array_interpolation_locate(&interpolation,x,last_index,&b,errmsg),
+             errmsg,
+             errmsg);
 
-    if (x > x_array[sup]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[sup]);
-      return _FAILURE_;
-    }
+  array_interpolation_evaluate(&interpolation,array,array_splined,n_columns,*last_index,b,result,result_size);
 
-    while (sup-inf > 1) {
+  return _SUCCESS_;
+}
 
-      mid=(int)(0.5*(inf+sup));
-      if (x < x_array[mid]) {sup=mid;}
-      else {inf=mid;}
+/**
+ * Build a uniform grid in u for finding in O(1) the interval
+ * containing a given point of a monotonic array x_array, where
+ * u_array[i]=u(x_array[i]) is strictly growing. The bin width is the
+ * smallest step of u_array, so that most bins contain at most one
+ * line, unless this would require more than max_bins bins.
+ *
+ * @param u_array  Input: values of u on each line
+ * @param n_lines  Input: number of lines
+ * @param max_bins Input: maximum number of bins
+ * @param plookup  Output: lookup grid
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
 
-    }
+int array_lookup_init(
+                      double * u_array,
+                      int n_lines,
+                      int max_bins,
+                      struct array_lookup * plookup,
+                      ErrorMsg errmsg) {
 
+  int i,j;
+  double du_min,u_max;
+
+  class_test(n_lines < 2,
+             errmsg,
+             "cannot build a lookup grid for %d lines",n_lines);
+
+  du_min = u_array[n_lines-1]-u_array[0];
+  for (i=1; i<n_lines; i++) {
+    class_test(u_array[i] <= u_array[i-1],
+               errmsg,
+               "u_array should be strictly growing, while u[%d]=%e and u[%d]=%e",i-1,u_array[i-1],i,u_array[i]);
+    du_min = MIN(du_min,u_array[i]-u_array[i-1]);
   }
 
-  else {
+  plookup->u_min = u_array[0];
+  u_max = u_array[n_lines-1];
+  plookup->n_bins = (int)MIN((u_max-plookup->u_min)/du_min+1.,(double)max_bins);
+  plookup->n_bins = MAX(plookup->n_bins,1);
+  plookup->inv_du = plookup->n_bins/(u_max-plookup->u_min);
 
-    if (x < x_array[sup]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[sup]);
+  class_alloc(plookup->index,plookup->n_bins*sizeof(int),errmsg);
+
+  i = 0;
+  for (j=0; j<plookup->n_bins; j++) {
+    while ((i < n_lines-2) && (u_array[i+1] <= plookup->u_min+j/plookup->inv_du))
+      i++;
+    plookup->index[j] = i;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free a lookup grid initialized with array_lookup_init().
+ *
+ * @param plookup Input: lookup grid
+ * @return the error status
+ */
+
+int array_lookup_free(
+                      struct array_lookup * plookup) {
+
+  free(plookup->index);
+  plookup->index = NULL;
+  plookup->n_bins = 0;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Same as array_interpolate_spline(), but the interval containing x
+ * is found arithmetically from u=u(x) with a lookup grid, instead of
+ * bisection. The index of this interval, and hence the result, are
+ * exactly the same. x_array can grow or decrease, as long as u is a
+ * growing function of the line index.
+ *
+ * @param plookup       Input: lookup grid built by array_lookup_init() from u(x_array)
+ * @param x_array       Input: values of x on each line
+ * @param n_lines       Input: number of lines
+ * @param array         Input: table of values (n_lines*n_columns)
+ * @param array_splined Input: table of second derivatives
+ * @param n_columns     Input: number of columns
+ * @param x             Input: point where the interpolation is performed
+ * @param u             Input: u(x), computed by the caller in the same way as u_array
+ * @param last_index    Output: index of the line before x
+ * @param result        Output: interpolated values of the first result_size columns
+ * @param result_size   Input: number of columns to interpolate
+ * @param errmsg        Output: error message
+ * @return the error status
+ */
+
+int array_interpolate_spline_lookup(
+                                    struct array_lookup * plookup,
+                                    double * __restrict__ x_array,
+                                    int n_lines,
+                                    double * __restrict__ array,
+                                    double * __restrict__ array_splined,
+                                    int n_columns,
+                                    double x,
+                                    double u,
+                                    int * __restrict__ last_index,
+                                    double * __restrict__ result,
+                                    int result_size, /** from 1 to n_columns */
+                                    ErrorMsg errmsg) {
+
+  struct array_interpolation interpolation;
+  int inf,j;
+
+  j = (int)((u-plookup->u_min)*plookup->inv_du);
+  j = MAX(0,MIN(j,plookup->n_bins-1));
+  inf = plookup->index[j];
+
+  if (x_array[0] < x_array[n_lines-1]) {
+
+    if (x < x_array[0]) {
+      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[0]);
       return _FAILURE_;
     }
 
-    if (x > x_array[inf]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[inf]);
+    if (x > x_array[n_lines-1]) {
+      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[n_lines-1]);
       return _FAILURE_;
     }
 
-    while (sup-inf > 1) {
+    while ((inf < n_lines-2) && (x >= x_array[inf+1])) inf++;
+    while ((inf > 0) && (x < x_array[inf])) inf--;
 
-      mid=(int)(0.5*(inf+sup));
-      if (x > x_array[mid]) {sup=mid;}
-      else {inf=mid;}
+  }
+
+  else {
+
+    if (x < x_array[n_lines-1]) {
+      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[n_lines-1]);
+      return _FAILURE_;
+    }
 
+    if (x > x_array[0]) {
+      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[0]);
+      return _FAILURE_;
     }
 
+    while ((inf < n_lines-2) && (x <= x_array[inf+1])) inf++;
+    while ((inf > 0) && (x > x_array[inf])) inf--;
+
   }
 
   *last_index = inf;
 
-  h = x_array[sup] - x_array[inf];
-  b = (x-x_array[inf])/h;
-  a = 1-b;
-
-  for (i=0; i<result_size; i++)
-    *(result+i) =
-      a * *(array+inf*n_columns+i) +
-      b * *(array+sup*n_columns+i) +
-      ((a*a*a-a)* *(array_splined+inf*n_columns+i) +
-       (b*b*b-b)* *(array_splined+sup*n_columns+i))*h*h/6.;
+  array_interpolation_view(x_array,n_lines,&interpolation);
+  array_interpolation_evaluate(&interpolation,array,array_splined,n_columns,inf,
+                               (x-x_array[inf])/(x_array[inf+1]-x_array[inf]),result,result_size);
 
   return _SUCCESS_;
 }
@@ -1766,66 +2159,18 @@ int array_interpolate_linear(
 			     int result_size, /** from 1 to n_columns */
 			     ErrorMsg errmsg) {
 
-  int inf,sup,mid,i;
-  double h,a,b;
-
-  inf=0;
-  sup=n_lines-1;
-
-  if (x_array[inf] < x_array[sup]){
-
-    if (x < x_array[inf]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[inf]);
-      return _FAILURE_;
-    }
+  struct array_interpolation interpolation;
+  double b;
 
-    if (x > x_array[sup]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[sup]);
-      return _FAILURE_;
-    }
+  array_interpolation_view(x_array,n_lines,&interpolation);
 
-    while (sup-inf > 1) {
+  *last_index = -1;
 
-      mid=(int)(0.5*(inf+sup));
-      if (x < x_array[mid]) {sup=mid;}
-      else {inf=mid;}
+  class_call(array_interpolation_locate(&interpolation,x,last_index,&b,errmsg),
+             errmsg,
+             errmsg);
 
-    }
-
-  }
-
-  else {
-
-    if (x < x_array[sup]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[sup]);
-      return _FAILURE_;
-    }
-
-    if (x > x_array[inf]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[inf]);
-      return _FAILURE_;
-    }
-
-    while (sup-inf > 1) {
-
-      mid=(int)(0.5*(inf+sup));
-      if (x > x_array[mid]) {sup=mid;}
-      else {inf=mid;}
-
-    }
-
-  }
-
-  *last_index = inf;
-
-  h = x_array[sup] - x_array[inf];
-  b = (x-x_array[inf])/h;
-  a = 1-b;
-
-  for (i=0; i<result_size; i++)
-    *(result+i) =
-      a * *(array+inf*n_columns+i) +
-      b * *(array+sup*n_columns+i);
+  array_interpolation_evaluate(&interpolation,array,NULL,n_columns,*last_index,b,result,result_size);
 
   return _SUCCESS_;
 }
@@ -2326,55 +2671,16 @@ int array_interpolate_spline_growing_closeby(
 					     int result_size, /** from 1 to n_columns */
 					     ErrorMsg errmsg) {
 
-  int inf,sup,i;
-  double h,a,b;
+  struct array_interpolation interpolation;
+  double b;
 
-  /*
-  if (*last_index < 0) {
-    sprintf(errmsg,"%s(L:%d) problem with last_index =%d < 0",__func__,__LINE__,*last_index);
-    return _FAILURE_;
-  }
-  if (*last_index > (n_lines-1)) {
-    sprintf(errmsg,"%s(L:%d) problem with last_index =%d > %d",__func__,__LINE__,*last_index,n_lines-1);
-    return _FAILURE_;
-  }
-  */
+  array_interpolation_view(x_array,n_lines,&interpolation);
 
-  inf = *last_index;
-  class_test(inf<0 || inf>(n_lines-1),
-	     errmsg,
-	     "*lastindex=%d out of range [0:%d]\n",inf,n_lines-1);
-  while (x < x_array[inf]) {
-    inf--;
-    if (inf < 0) {
-      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,
-	      x,x_array[0]);
-      return _FAILURE_;
-    }
-  }
-  sup = inf+1;
-  while (x > x_array[sup]) {
-    sup++;
-    if (sup > (n_lines-1)) {
-      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,
-	      x,x_array[n_lines-1]);
-      return _FAILURE_;
-    }
-  }
-  inf = sup-1;
-
-  *last_index = inf;
+  class_call(array_interpolation_locate(&interpolation,x,last_index,&b,errmsg),
+             errmsg,
+             errmsg);
 
-  h = x_array[sup] - x_array[inf];
-  b = (x-x_array[inf])/h;
-  a = 1-b;
-
-  for (i=0; i<result_size; i++)
-    *(result+i) =
-      a * *(array+inf*n_columns+i) +
-      b * *(array+sup*n_columns+i) +
-      ((a*a*a-a)* *(array_splined+inf*n_columns+i) +
-       (b*b*b-b)* *(array_splined+sup*n_columns+i))*h*h/6.;
+  array_interpolation_evaluate(&interpolation,array,array_splined,n_columns,*last_index,b,result,result_size);
 
   return _SUCCESS_;
 }
@@ -2396,78 +2702,16 @@ int array_interpolate_spline_growing_hunt(
 					     int result_size, /** from 1 to n_columns */
 					     ErrorMsg errmsg) {
 
-  int inf,sup,mid,i,inc;
-  double h,a,b;
-
-  inc=1;
-
-  if (x >= x_array[*last_index]) {
-    if (x > x_array[n_lines-1]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,
-	      x,x_array[n_lines-1]);
-      return _FAILURE_;
-    }
-    /* try closest neighboor upward */
-    inf = *last_index;
-    sup = inf + inc;
-    if (x > x_array[sup]) {
-      /* hunt upward */
-      while (x > x_array[sup]) {
-	inf = sup;
-	inc += 1;
-	sup += inc;
-	if (sup > n_lines-1) {
-	  sup = n_lines-1;
-	}
-      }
-      /* bisect */
-      while (sup-inf > 1) {
-	mid=(int)(0.5*(inf+sup));
-	if (x < x_array[mid]) {sup=mid;}
-	else {inf=mid;}
-      }
-    }
-   }
-  else {
-    if (x < x_array[0]) {
-      sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,
-	      x,x_array[0]);
-      return _FAILURE_;
-    }
-    /* try closest neighboor downward */
-    sup = *last_index;
-    inf = sup - inc;
-    if (x < x_array[inf]) {
-      /* hunt downward */
-      while (x < x_array[inf]) {
-	sup = inf;
-	inc += 1;
-	inf -= inc;
-	if (inf < 0) {
-	  inf = 0;
-	}
-      }
-      /* bisect */
-      while (sup-inf > 1) {
-	mid=(int)(0.5*(inf+sup));
-	if (x < x_array[mid]) {sup=mid;}
-	else {inf=mid;}
-      }
-    }
-  }
+  struct array_interpolation interpolation;
+  double b;
 
-  *last_index = inf;
+  array_interpolation_view(x_array,n_lines,&interpolation);
 
-  h = x_array[sup] - x_array[inf];
-  b = (x-x_array[inf])/h;
-  a = 1-b;
+  class_call(array_interpolation_locate(&interpolation,x,last_index,&b,errmsg),
+             errmsg,
+             errmsg);
 
-  for (i=0; i<result_size; i++)
-    *(result+i) =
-      a * *(array+inf*n_columns+i) +
-      b * *(array+sup*n_columns+i) +
-      ((a*a*a-a)* *(array_splined+inf*n_columns+i) +
-       (b*b*b-b)* *(array_splined+sup*n_columns+i))*h*h/6.;
+  array_interpolation_evaluate(&interpolation,array,array_splined,n_columns,*last_index,b,result,result_size);
 
   return _SUCCESS_;
 }
@@ -2990,6 +3234,9 @@ int array_smooth(double * array,
     return _FAILURE_;
   }
 
+  /* each line is summed independently, in the same order, so that the
+     result does not depend on the number of threads */
+#pragma omp parallel for schedule (static) private(j,jmin,jmax,weigth) if ((double)n_lines*(2*radius+1) >= _SMOOTH_PARALLEL_MIN_SIZE_)
   for (i=0; i<n_lines; i++) {
     smooth[i]=0.;
     weigth=0.;
@@ -0,0 +1,119 @@
+/** @file binary_output.c Documented writer of binary tables
+ *
+ * Tables written in the binary format described in binary_output.h,
+ * by the output module (format = binary) and by the perturbation
+ * module (stream perturbations = yes).
+ */
+
+#include "binary_output.h"
+
+/**
+ * This routine writes the header of a file in binary format (see
+ * binary_output.h for the layout). It is written even if headers are
+ * switched off, since the data cannot be read without it.
+ *
+ * @param out           Input: file pointer
+ * @param description   Input: text describing the content of the table
+ * @param titles        Input: column titles, each followed by _DELIMITER_
+ * @param rows          Input: number of rows of the table
+ * @param columns       Input: number of columns of the table
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int binary_output_header(
+                         FILE * out,
+                         char * description,
+                         char * titles,
+                         int rows,
+                         int columns,
+                         ErrorMsg error_message
+                         ) {
+
+  int32_t header[3];
+  int32_t length;
+
+  class_test(fwrite(_BINARY_OUTPUT_MAGIC_,sizeof(char),8,out) != 8,
+             error_message,
+             "could not write binary header");
+
+  header[0] = _BINARY_OUTPUT_VERSION_;
+  header[1] = rows;
+  header[2] = columns;
+
+  class_call(binary_output_write(out,header,sizeof(int32_t),3,error_message),
+             error_message,
+             error_message);
+
+  length = strlen(description);
+  class_call(binary_output_write(out,&length,sizeof(int32_t),1,error_message),
+             error_message,
+             error_message);
+  class_call(binary_output_write(out,description,sizeof(char),length,error_message),
+             error_message,
+             error_message);
+
+  length = strlen(titles);
+  class_call(binary_output_write(out,&length,sizeof(int32_t),1,error_message),
+             error_message,
+             error_message);
+  class_call(binary_output_write(out,titles,sizeof(char),length,error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine writes an array of numbers in little-endian order with
+ * a single fwrite() (bytes are swapped first on big-endian machines).
+ *
+ * @param out           Input: file pointer
+ * @param data          Input: array of count items of item_size bytes each
+ * @param item_size     Input: size of each item in bytes
+ * @param count         Input: number of items
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int binary_output_write(
+                        FILE * out,
+                        void * data,
+                        size_t item_size,
+                        int count,
+                        ErrorMsg error_message
+                        ) {
+
+  const int32_t one = 1;
+  char * swapped;
+  char * source;
+  int index_item;
+  size_t index_byte;
+  size_t written;
+
+  if (count == 0)
+    return _SUCCESS_;
+
+  /* little-endian machine, or single bytes: write as is */
+
+  if ((*(const char*)&one == 1) || (item_size == 1)) {
+    written = fwrite(data,item_size,count,out);
+  }
+  else {
+    class_alloc(swapped,item_size*count,error_message);
+    source = (char*)data;
+    for (index_item=0; index_item<count; index_item++) {
+      for (index_byte=0; index_byte<item_size; index_byte++) {
+        swapped[index_item*item_size+index_byte] = source[index_item*item_size+item_size-1-index_byte];
+      }
+    }
+    written = fwrite(swapped,item_size,count,out);
+    free(swapped);
+  }
+
+  class_test(written != (size_t)count,
+             error_message,
+             "could not write %d items of binary data",count);
+
+  return _SUCCESS_;
+}
@@ -1,4 +1,11 @@
 #include "common.h"
+#include <time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef CLASS_PAPI
+#include <papi.h>
+#include <pthread.h>
+#endif
 
 void class_protect_sprintf(char* dest, char* tpl,...) {
   va_list args;
@@ -30,3 +37,268 @@ int get_number_of_titles(char * titlestring){
   }
   return number_of_titles;
 }
+
+/**
+ * Write a zero byte in each page of a table of slab_number slabs of
+ * slab_size bytes, from the threads of a new parallel region, so that
+ * the operating system places the pages near the threads following
+ * the policy (see enum first_touch_policy). Only meaningful for a
+ * table just allocated, whose content is undefined or zero: pages
+ * already written keep their placement. Each page boundary belongs to
+ * one slab, so that each page is written once.
+ */
+
+void class_first_touch(void * pointer, size_t slab_number, size_t slab_size, int policy) {
+
+#ifdef _OPENMP
+  char * table = pointer;
+  size_t page_size;
+  size_t begin,end;
+  long index_slab,number_of_slabs;
+  long page,first_page,last_page;
+
+  if ((policy == ft_none) || (table == NULL) || (slab_number*slab_size == 0) || (omp_get_max_threads() == 1))
+    return;
+
+  page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+  /* with the interleaved policy, the pages of the whole table are dealt out in turn */
+  if (policy == ft_interleave) {
+    slab_size *= slab_number;
+    slab_number = 1;
+  }
+  number_of_slabs = (long)slab_number;
+
+#pragma omp parallel private(index_slab,begin,end,first_page,last_page,page)
+  {
+    for (index_slab = 0; index_slab < number_of_slabs; index_slab++) {
+
+      begin = (size_t)table + index_slab*slab_size;
+      end = begin + slab_size;
+      first_page = (index_slab == 0) ? begin/page_size : (begin+page_size-1)/page_size;
+      last_page = (end-1)/page_size;
+
+      if (policy == ft_interleave) {
+#pragma omp for schedule(static,1) nowait
+        for (page = first_page; page <= last_page; page++)
+          table[MAX(page*page_size,begin)-(size_t)table] = 0;
+      }
+      else {
+#pragma omp for schedule(static) nowait
+        for (page = first_page; page <= last_page; page++)
+          table[MAX(page*page_size,begin)-(size_t)table] = 0;
+      }
+    }
+  }
+#endif
+}
+
+/* wall-clock time, CPU time of the process and its peak resident memory in bytes */
+static void class_profile_now(double * wall_time, double * cpu_time, double * peak_memory) {
+
+  struct rusage usage;
+#ifndef _OPENMP
+  struct timespec now;
+#endif
+
+#ifdef _OPENMP
+  *wall_time = omp_get_wtime();
+#else
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  *wall_time = now.tv_sec+1.e-9*now.tv_nsec;
+#endif
+
+  getrusage(RUSAGE_SELF,&usage);
+  *cpu_time = usage.ru_utime.tv_sec+1.e-6*usage.ru_utime.tv_usec
+    +usage.ru_stime.tv_sec+1.e-6*usage.ru_stime.tv_usec;
+#ifdef __APPLE__
+  *peak_memory = (double)usage.ru_maxrss;
+#else
+  *peak_memory = 1024.*usage.ru_maxrss;
+#endif
+}
+
+#ifdef CLASS_PAPI
+
+const char * class_kernel_name[_CLASS_KERNELS_] = {"perturb_derivs","transfer_integrate","spectra_compute_cl",
+                                                   "lensing_correlation","sp_lusolve"};
+const char * class_event_name[_CLASS_EVENTS_] = {"cycles","instructions","L1 d. misses","LL misses","DP operations"};
+
+/* PAPI preset events, in the order of class_event_name */
+static const int class_event_code[_CLASS_EVENTS_] = {PAPI_TOT_CYC,PAPI_TOT_INS,PAPI_L1_DCM,PAPI_L3_TCM,PAPI_DP_OPS};
+
+/* shared by all threads: state of PAPI (0 before initialisation, 1 if
+   counting, -1 if unavailable), events supported by the processor,
+   number of threads counting, and counts of each thread */
+static int class_event_state = 0;
+static short class_event_is_available[_CLASS_EVENTS_];
+static int class_event_threads = 0;
+static long long class_event_count[_CLASS_EVENT_THREADS_][_CLASS_KERNELS_][_CLASS_EVENTS_];
+
+/* private to each thread: its PAPI event set, its slot in
+   class_event_count (-1 before its first count, -2 if it cannot count),
+   the position of each event in the set, and the counts when each
+   kernel was entered */
+static int class_event_set = PAPI_NULL;
+static int class_event_thread = -1;
+static int class_event_position[_CLASS_EVENTS_];
+static long long class_event_start[_CLASS_KERNELS_][_CLASS_EVENTS_];
+#pragma omp threadprivate(class_event_set,class_event_thread,class_event_position,class_event_start)
+
+static unsigned long class_event_thread_id(void) {
+  return (unsigned long)pthread_self();
+}
+
+/* initialise PAPI for the whole process, and the event set of the calling thread */
+static void class_event_init() {
+
+  int index_event, position=0;
+
+#pragma omp critical (class_event)
+  {
+    if (class_event_state == 0) {
+      class_event_state = -1;
+      if ((PAPI_library_init(PAPI_VER_CURRENT) == PAPI_VER_CURRENT) &&
+          (PAPI_thread_init(class_event_thread_id) == PAPI_OK)) {
+        class_event_state = 1;
+        for (index_event=0; index_event<_CLASS_EVENTS_; index_event++)
+          class_event_is_available[index_event] = (PAPI_query_event(class_event_code[index_event]) == PAPI_OK);
+      }
+      else {
+        fprintf(stderr,"Warning: PAPI could not be initialised, hardware events will not be counted\n");
+      }
+    }
+    if (class_event_state == 1) {
+      class_event_thread = MIN(class_event_threads,_CLASS_EVENT_THREADS_-1);
+      class_event_threads++;
+    }
+    else {
+      class_event_thread = -2;
+    }
+  }
+
+  if (class_event_thread < 0)
+    return;
+
+  if (PAPI_create_eventset(&class_event_set) != PAPI_OK) {
+    class_event_thread = -2;
+    return;
+  }
+
+  /* events that cannot be counted together with the previous ones are skipped */
+  for (index_event=0; index_event<_CLASS_EVENTS_; index_event++) {
+    class_event_position[index_event] = -1;
+    if ((class_event_is_available[index_event] == _TRUE_) &&
+        (PAPI_add_event(class_event_set,class_event_code[index_event]) == PAPI_OK))
+      class_event_position[index_event] = position++;
+  }
+
+  if ((position == 0) || (PAPI_start(class_event_set) != PAPI_OK))
+    class_event_thread = -2;
+}
+
+void class_kernel_count_start(enum class_kernel kernel) {
+
+  long long value[_CLASS_EVENTS_];
+  int index_event;
+
+  if (class_event_thread == -1)
+    class_event_init();
+  if (class_event_thread < 0)
+    return;
+
+  if (PAPI_read(class_event_set,value) != PAPI_OK)
+    return;
+
+  for (index_event=0; index_event<_CLASS_EVENTS_; index_event++) {
+    if (class_event_position[index_event] >= 0)
+      class_event_start[kernel][index_event] = value[class_event_position[index_event]];
+  }
+}
+
+void class_kernel_count_stop(enum class_kernel kernel) {
+
+  long long value[_CLASS_EVENTS_];
+  int index_event;
+
+  if (class_event_thread < 0)
+    return;
+
+  if (PAPI_read(class_event_set,value) != PAPI_OK)
+    return;
+
+  /* atomic because the threads beyond _CLASS_EVENT_THREADS_ share the last slot */
+  for (index_event=0; index_event<_CLASS_EVENTS_; index_event++) {
+    if (class_event_position[index_event] >= 0) {
+#pragma omp atomic
+      class_event_count[class_event_thread][kernel][index_event] +=
+        value[class_event_position[index_event]]-class_event_start[kernel][index_event];
+    }
+  }
+}
+
+int class_event_available(int index_event) {
+  return ((class_event_state == 1) && (class_event_is_available[index_event] == _TRUE_));
+}
+
+#endif
+
+void class_profile_start(struct class_profile * pprof) {
+
+  double wall_time, cpu_time, peak_memory;
+
+  class_profile_now(&wall_time,&cpu_time,&peak_memory);
+  pprof->wall_time = -wall_time;
+  pprof->cpu_time = -cpu_time;
+  pprof->peak_memory = 0.;
+  pprof->memory_increase = -peak_memory;
+
+#ifdef CLASS_PAPI
+  int index_thread, kernel, index_event;
+
+  for (index_thread=0; index_thread<_CLASS_EVENT_THREADS_; index_thread++)
+    for (kernel=0; kernel<_CLASS_KERNELS_; kernel++)
+      for (index_event=0; index_event<_CLASS_EVENTS_; index_event++)
+        pprof->event_count[index_thread][kernel][index_event] = -class_event_count[index_thread][kernel][index_event];
+#endif
+}
+
+void class_profile_resume(struct class_profile * pprof) {
+
+  double wall_time, cpu_time, peak_memory;
+
+  class_profile_now(&wall_time,&cpu_time,&peak_memory);
+  pprof->wall_time -= wall_time;
+  pprof->cpu_time -= cpu_time;
+  pprof->memory_increase -= peak_memory;
+
+#ifdef CLASS_PAPI
+  int index_thread, kernel, index_event;
+
+  for (index_thread=0; index_thread<_CLASS_EVENT_THREADS_; index_thread++)
+    for (kernel=0; kernel<_CLASS_KERNELS_; kernel++)
+      for (index_event=0; index_event<_CLASS_EVENTS_; index_event++)
+        pprof->event_count[index_thread][kernel][index_event] -= class_event_count[index_thread][kernel][index_event];
+#endif
+}
+
+void class_profile_stop(struct class_profile * pprof) {
+
+  double wall_time, cpu_time, peak_memory;
+
+  class_profile_now(&wall_time,&cpu_time,&peak_memory);
+  pprof->wall_time += wall_time;
+  pprof->cpu_time += cpu_time;
+  pprof->peak_memory = peak_memory;
+  pprof->memory_increase += peak_memory;
+
+#ifdef CLASS_PAPI
+  int index_thread, kernel, index_event;
+
+  for (index_thread=0; index_thread<_CLASS_EVENT_THREADS_; index_thread++)
+    for (kernel=0; kernel<_CLASS_KERNELS_; kernel++)
+      for (index_event=0; index_event<_CLASS_EVENTS_; index_event++)
+        pprof->event_count[index_thread][kernel][index_event] += class_event_count[index_thread][kernel][index_event];
+  pprof->event_threads = MIN(class_event_threads,_CLASS_EVENT_THREADS_);
+#endif
+}
@@ -12,6 +12,10 @@ int initialize_generic_integrator(
 
   pgi->n = n_dim;
 
+  pgi->steps = 0;
+  pgi->failed_steps = 0;
+  pgi->nfe = 0;
+
   class_alloc(pgi->yscal,
 	      sizeof(double)*n_dim,
 	      pgi->error_message);
@@ -48,6 +52,19 @@ int initialize_generic_integrator(
 	      sizeof(double)*n_dim,
 	      pgi->error_message);
 
+  class_alloc(pgi->y_old,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+  class_alloc(pgi->dydx_old,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+  class_alloc(pgi->y_dense,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+  class_alloc(pgi->dydx_dense,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+
   return _SUCCESS_;
 }
 
@@ -73,6 +90,11 @@ int cleanup_generic_integrator(struct generic_integrator_workspace * pgi){
   free(pgi->ak6);
   free(pgi->ytemp);
 
+  free(pgi->y_old);
+  free(pgi->dydx_old);
+  free(pgi->y_dense);
+  free(pgi->dydx_dense);
+
   return _SUCCESS_;
 }
 
@@ -97,6 +119,7 @@ int generic_integrator(int (*derivs)(double x, double y[], double yprime[], void
     class_call((*derivs)(x,pgi->y,pgi->dydx,parameters_and_workspace_for_derivs, pgi->error_message),
 	       pgi->error_message,
 	       pgi->error_message);
+    pgi->nfe++;
     for (i=0;i<pgi->n;i++)
       pgi->yscal[i]=fabs(pgi->y[i])+fabs(pgi->dydx[i]*h)+_TINY_;
     if ((x+h-x2)*(x+h-x1) > 0.0) h=x2-x;
@@ -129,6 +152,177 @@ int generic_integrator(int (*derivs)(double x, double y[], double yprime[], void
 
 }
 
+/**
+ * Same as generic_integrator(), but with dense output: (*output) is
+ * called at each point x_sampling[*next_index_x], x_sampling[*next_index_x+1],...
+ * lying in [x1, x2], with y and dy/dx interpolated within the step
+ * which contains this point. The steps are only controlled by the
+ * accuracy eps, not by the sampling. The interpolation is the cubic
+ * Hermite polynomial matching y and dy/dx at both ends of the step,
+ * so that it does not need any additional call to (*derivs) except
+ * one at x2 (when some points lie in the last step). On output,
+ * *next_index_x is the index of the first point after x2.
+ *
+ * @param derivs        Input: function computing dy/dx
+ * @param x1            Input: initial time
+ * @param x2            Input: final time
+ * @param ystart        Input/Output: vector at x1 on input, at x2 on output
+ * @param parameters_and_workspace_for_derivs Input: parameters passed to (*derivs) and (*output)
+ * @param eps           Input: tolerance
+ * @param hmin          Input: smallest allowed step
+ * @param x_sampling    Input: sampling points
+ * @param x_size        Input: number of sampling points
+ * @param next_index_x  Input/Output: index of the next sampling point
+ * @param output        Input: function called at each sampling point
+ * @param pgi           Input/Output: integrator workspace
+ * @return the error status
+ */
+
+int generic_integrator_dense(int (*derivs)(double x, double y[], double yprime[], void * parameters_and_workspace, ErrorMsg error_message),
+			     double x1,
+			     double x2,
+			     double ystart[],
+			     void * parameters_and_workspace_for_derivs,
+			     double eps,
+			     double hmin,
+			     double * x_sampling,
+			     int x_size,
+			     int * next_index_x,
+			     int (*output)(double x, double y[], double dy[], int index_x, void * parameters_and_workspace, ErrorMsg error_message),
+			     struct generic_integrator_workspace * pgi)
+
+{
+  int nstp,i;
+  double x,hnext,hdid,h,h1;
+  double x_old=x1;
+
+  h1=x2-x1;
+  x=x1;
+  h=dsign(h1,x2-x1);
+  for (i=0;i<pgi->n;i++) pgi->y[i]=ystart[i];
+  for (nstp=1;nstp<=_MAXSTP_;nstp++) {
+    class_call((*derivs)(x,pgi->y,pgi->dydx,parameters_and_workspace_for_derivs, pgi->error_message),
+	       pgi->error_message,
+	       pgi->error_message);
+    pgi->nfe++;
+
+    /* sampling points covered by the last step */
+    if (nstp > 1) {
+      while ((*next_index_x < x_size) && (x_sampling[*next_index_x] <= x)) {
+	class_call(generic_integrator_hermite(x_sampling[*next_index_x]-x_old,x-x_old,pgi),
+		   pgi->error_message,
+		   pgi->error_message);
+	class_call((*output)(x_sampling[*next_index_x],pgi->y_dense,pgi->dydx_dense,*next_index_x,
+			     parameters_and_workspace_for_derivs,pgi->error_message),
+		   pgi->error_message,
+		   pgi->error_message);
+	(*next_index_x)++;
+      }
+    }
+
+    /* a sampling point at the initial time is output directly */
+    if ((nstp == 1) && (*next_index_x < x_size) && (x_sampling[*next_index_x] == x1)) {
+      class_call((*output)(x1,pgi->y,pgi->dydx,*next_index_x,
+			   parameters_and_workspace_for_derivs,pgi->error_message),
+		 pgi->error_message,
+		 pgi->error_message);
+      (*next_index_x)++;
+    }
+
+    for (i=0;i<pgi->n;i++)
+      pgi->yscal[i]=fabs(pgi->y[i])+fabs(pgi->dydx[i]*h)+_TINY_;
+    for (i=0;i<pgi->n;i++) {
+      pgi->y_old[i]=pgi->y[i];
+      pgi->dydx_old[i]=pgi->dydx[i];
+    }
+    x_old = x;
+    if ((x+h-x2)*(x+h-x1) > 0.0) h=x2-x;
+    class_call(rkqs(&x,
+		    h,
+		    eps,
+		    &hdid,
+		    &hnext,
+		    derivs,
+		    parameters_and_workspace_for_derivs,
+		    pgi),
+	       pgi->error_message,
+	       pgi->error_message);
+    if ((x-x2)*(x2-x1) >= 0.0) {
+      /* sampling points in the last step need dy/dx at x2 */
+      if ((*next_index_x < x_size) && (x_sampling[*next_index_x] <= x2)) {
+	class_call((*derivs)(x,pgi->y,pgi->dydx,parameters_and_workspace_for_derivs, pgi->error_message),
+		   pgi->error_message,
+		   pgi->error_message);
+	pgi->nfe++;
+	while ((*next_index_x < x_size) && (x_sampling[*next_index_x] <= x2)) {
+	  class_call(generic_integrator_hermite(x_sampling[*next_index_x]-x_old,x-x_old,pgi),
+		     pgi->error_message,
+		     pgi->error_message);
+	  class_call((*output)(x_sampling[*next_index_x],pgi->y_dense,pgi->dydx_dense,*next_index_x,
+			       parameters_and_workspace_for_derivs,pgi->error_message),
+		     pgi->error_message,
+		     pgi->error_message);
+	  (*next_index_x)++;
+	}
+      }
+      for (i=0;i<pgi->n;i++) ystart[i]=pgi->y[i];
+      return _SUCCESS_;
+    }
+    class_test(fabs(hnext/x1) <= hmin,
+	       pgi->error_message,
+	       "Step size too small: step:%g, minimum:%g, in interval: [%g:%g]",
+	       fabs(hnext/x1),
+	       hmin,
+	       x1,
+	       x2);
+    h=hnext;
+  }
+
+  class_stop(pgi->error_message,
+	     "Too many integration steps needed within interval [%g : %g],\n the system of equations is probably buggy or featuring a discontinuity",x1,x2);
+
+}
+
+/**
+ * Cubic Hermite interpolation within the last step, from
+ * (pgi->y_old, pgi->dydx_old) at its beginning to (pgi->y, pgi->dydx)
+ * at its end. The result is written in pgi->y_dense and
+ * pgi->dydx_dense.
+ *
+ * @param x   Input: distance between the beginning of the step and the requested point
+ * @param h   Input: length of the step
+ * @param pgi Input/Output: integrator workspace
+ * @return the error status
+ */
+
+int generic_integrator_hermite(double x,
+			       double h,
+			       struct generic_integrator_workspace * pgi){
+
+  int i;
+  double t,h00,h10,h01,h11,d00,d10,d01,d11;
+
+  t = x/h;
+
+  h00 = (1.+2.*t)*(1.-t)*(1.-t);
+  h10 = t*(1.-t)*(1.-t)*h;
+  h01 = t*t*(3.-2.*t);
+  h11 = t*t*(t-1.)*h;
+
+  d00 = 6.*t*(t-1.)/h;
+  d10 = (1.-t)*(1.-3.*t);
+  d01 = -d00;
+  d11 = t*(3.*t-2.);
+
+#pragma omp simd
+  for (i=0;i<pgi->n;i++) {
+    pgi->y_dense[i] = h00*pgi->y_old[i]+h10*pgi->dydx_old[i]+h01*pgi->y[i]+h11*pgi->dydx[i];
+    pgi->dydx_dense[i] = d00*pgi->y_old[i]+d10*pgi->dydx_old[i]+d01*pgi->y[i]+d11*pgi->dydx[i];
+  }
+
+  return _SUCCESS_;
+}
+
 int rkqs(double *x, double htry, double eps,
 	 double *hdid, double *hnext,
 	 int (*derivs)(double, double [], double [], void * parameters_and_workspace, ErrorMsg error_message),
@@ -147,7 +341,9 @@ int rkqs(double *x, double htry, double eps,
     errmax=0.0;
     for (i=0;i<pgi->n;i++) errmax=MAX(errmax,fabs(pgi->yerr[i]/pgi->yscal[i]));
     errmax /= eps;
+    pgi->nfe += 5;
     if (errmax <= 1.0) break;
+    pgi->failed_steps++;
     htemp=_SAFETY_*h*pow(errmax,_PSHRNK_);
     h=(h >= 0.0 ? MAX(htemp,0.1*h) : MIN(htemp,0.1*h));
     xnew=(*x)+h;
@@ -157,12 +353,16 @@ int rkqs(double *x, double htry, double eps,
   }
   if (errmax > _ERRCON_) *hnext=_SAFETY_*h*pow(errmax,_PGROW_);
   else *hnext=5.0*h;
+  pgi->steps++;
   *x += (*hdid=h);
   for (i=0;i<pgi->n;i++) pgi->y[i]=pgi->ytemp[i];
 
   return _SUCCESS_;
 }
 
+/* The loops combining the stages are independent for each equation:
+   they are marked for vectorisation by OpenMP compilers. */
+
 int rkck(
 	 double x,
 	 double h,
@@ -172,6 +372,7 @@ int rkck(
 {
   int i;
 
+#pragma omp simd
   for (i=0;i<pgi->n;i++)
     pgi->ytemp[i]=pgi->y[i]+_RKCK_b21_*h*pgi->dydx[i];
 
@@ -183,6 +384,7 @@ int rkck(
 	     pgi->error_message,
 	     pgi->error_message);
 
+#pragma omp simd
   for (i=0;i<pgi->n;i++)
     pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b31_*pgi->dydx[i]+_RKCK_b32_*pgi->ak2[i]);
 
@@ -194,6 +396,7 @@ int rkck(
 	     pgi->error_message,
 	     pgi->error_message);
 
+#pragma omp simd
   for (i=0;i<pgi->n;i++)
     pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b41_*pgi->dydx[i]+_RKCK_b42_*pgi->ak2[i]+_RKCK_b43_*pgi->ak3[i]);
 
@@ -205,6 +408,7 @@ int rkck(
 	     pgi->error_message,
 	     pgi->error_message);
 
+#pragma omp simd
   for (i=0;i<pgi->n;i++)
     pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b51_*pgi->dydx[i]+_RKCK_b52_*pgi->ak2[i]+_RKCK_b53_*pgi->ak3[i]+_RKCK_b54_*pgi->ak4[i]);
 
@@ -215,6 +419,7 @@ int rkck(
 	     pgi->error_message,
 	     pgi->error_message);
 
+#pragma omp simd
   for (i=0;i<pgi->n;i++)
     pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b61_*pgi->dydx[i]+_RKCK_b62_*pgi->ak2[i]+_RKCK_b63_*pgi->ak3[i]+_RKCK_b64_*pgi->ak4[i]+_RKCK_b65_*pgi->ak5[i]);
 
@@ -226,9 +431,11 @@ int rkck(
 	     pgi->error_message,
 	     pgi->error_message);
 
+#pragma omp simd
   for (i=0;i<pgi->n;i++)
     pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_c1_*pgi->dydx[i]+_RKCK_c3_*pgi->ak3[i]+_RKCK_c4_*pgi->ak4[i]+_RKCK_c6_*pgi->ak6[i]);
 
+#pragma omp simd
   for (i=0;i<pgi->n;i++)
     pgi->yerr[i]=h*(_RKCK_dc1_*pgi->dydx[i]+_RKCK_dc3_*pgi->ak3[i]+_RKCK_dc4_*pgi->ak4[i]+_RKCK_dc5_*pgi->ak5[i]+_RKCK_dc6_*pgi->ak6[i]);
 
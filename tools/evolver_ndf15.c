@@ -34,7 +34,8 @@
 	stepstat[4] = Number of LU decompositions.
 	stepstat[5] = Number of linear solves.
 	If ppt->perturbations_verbose > 2, this statistic is printed at the end of
-	each call to evolver.
+	each call to evolver. If statistics!=NULL, it is also added to the six
+	entries of statistics[], so that the caller can sum it over several calls.
 
 	Sparsity:
 	When the number of equations becomes high, too much times is spent on solving
@@ -53,6 +54,26 @@
 	structure of the equations are nearly optimal for the LU decomposition, so we don't
 	want to mess it up by too many row permutations if we can avoid it. This is also why
 	do not use any column permutation to pre-order the matrix.
+
+	The AMD ordering used for the sparse LU decomposition only depends on the
+	sparsity pattern. It is stored in *ordering_cache for each pattern met, and
+	reused for each new jacobian with the same pattern, also in subsequent calls
+	to the evolver if the caller keeps the cache (for instance between wavenumbers
+	sharing the same approximation scheme). If ordering_cache==NULL, orderings are
+	only shared within the current call.
+
+	Memory:
+	If arena!=NULL, the work vectors, the Jacobian and the numjac workspace are
+	carved out of the block arena->block, which is kept by the caller between
+	calls and only reallocated when a larger system is met. Otherwise they are
+	allocated at the beginning and freed at the end of each call.
+
+	Analytic Jacobian:
+	If the caller knows the structure of its equations, it can pass a function
+	(*jacobian) that fills the Jacobian directly in the compressed column format
+	of jac->spJ. It is used instead of numjac as long as the sparse method is on
+	and the function reports that it could provide the matrix. Otherwise (or when
+	jacobian==NULL) we fall back to numjac for the rest of the integration.
 */
 #include "common.h"
 #include "evolver_ndf15.h"
@@ -62,6 +83,10 @@
 int evolver_ndf15(
 		  int (*derivs)(double x,double * y,double * dy,
 				void * parameters_and_workspace, ErrorMsg error_message),
+		  int (*jacobian)(double x,double * y,double * dy,sp_mat * J,short * has_jacobian,int * nfe,
+				  void * parameters_and_workspace, ErrorMsg error_message),
+		  sp_ord ** ordering_cache,
+		  struct ndf15_arena * arena,
 		  double x_ini,
 		  double x_final,
 		  double * y_inout,
@@ -81,6 +106,7 @@ int evolver_ndf15(
 				ErrorMsg error_message),
 		  int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
 					 ErrorMsg error_message),
+		  int * statistics,
 		  ErrorMsg error_message){
 
   /* Constants: */
@@ -92,6 +118,7 @@ int evolver_ndf15(
 
   /* Logicals: */
   int Jcurrent,havrate,done,at_hmin,nofailed,gotynew,tooslow,*interpidx;
+  short use_jacobian;
 
   /* Storage: */
   double *f0,*y,*wt,*ddfddt,*pred,*ynew,*invwt,*rhs,*psi,*difkp1,*del,*yinterp;
@@ -99,6 +126,7 @@ int evolver_ndf15(
   double **dif;
   struct jacobian jac;
   struct numjac_workspace nj_ws;
+  sp_ord * local_ordering_cache = NULL;
 
   /* Method variables: */
   double t,t0,tfinal,tnew=0;
@@ -122,9 +150,15 @@ int evolver_ndf15(
     +neqp*sizeof(double*)
     +(7*neq+1)*sizeof(double);
 
-  class_alloc(buffer,
-	      buffer_size,
-	      error_message);
+  if (arena == NULL) {
+    class_alloc(buffer,
+		buffer_size,
+		error_message);
+  }
+  else {
+    class_call(ndf15_arena_setup(arena,neq,buffer_size,&buffer,&jac,&nj_ws,error_message),
+	       error_message,error_message);
+  }
 
   f0       =(double*)buffer;
   wt       =f0+neqp;
@@ -182,11 +216,18 @@ int evolver_ndf15(
   /*Set pointers:*/
   ynew = y_inout-1; /* This way y_inout is always up to date. */
 
-  /*Initialize the jacobian:*/
-  class_call(initialize_jacobian(&jac,neq,error_message),error_message,error_message);
+  /*Initialize the jacobian and the workspace for numjac (already done if they are in the arena):*/
+  if (arena == NULL) {
+    class_call(initialize_jacobian(&jac,neq,error_message),error_message,error_message);
+    class_call(initialize_numjac_workspace(&nj_ws,neq,error_message),error_message,error_message);
+  }
+  if (ordering_cache == NULL)
+    jac.ordering_cache = &local_ordering_cache;
+  else
+    jac.ordering_cache = ordering_cache;
 
-  /* Initialize workspace for numjac: */
-  class_call(initialize_numjac_workspace(&nj_ws,neq,error_message),error_message,error_message);
+  /* The analytic Jacobian is only written in the sparse format: */
+  use_jacobian = ((jacobian != NULL) && (jac.use_sparse == _TRUE_));
 
   /* Initialize some method parameters:*/
   for(ii=0;ii<5;ii++){
@@ -236,8 +277,8 @@ int evolver_ndf15(
 
 
   nfenj=0;
-  class_call(numjac((*derivs),t,y,f0,&jac,&nj_ws,abstol,neq,
-		    &nfenj,parameters_and_workspace_for_derivs,error_message),
+  class_call(evaluate_jacobian((*derivs),(*jacobian),&use_jacobian,t,y,f0,&jac,&nj_ws,abstol,neq,
+			       &nfenj,parameters_and_workspace_for_derivs,error_message),
 	     error_message,error_message);
   stepstat[3] += 1;
   stepstat[2] += nfenj;
@@ -264,11 +305,22 @@ int evolver_ndf15(
 	     error_message,error_message);
   stepstat[2] += 1;
 
-  /*I assume that a full jacobi matrix is always calculated in the beginning...*/
-  for(ii=1;ii<=neq;ii++){
-    ddfddt[ii]=0.0;
-    for(jj=1;jj<=neq;jj++){
-      ddfddt[ii]+=(jac.dfdy[ii][jj])*f0[jj];
+  /*I assume that a full jacobi matrix is always calculated in the beginning,
+    unless it was provided in sparse form by (*jacobian)...*/
+  if (use_jacobian == _TRUE_){
+    for(ii=1;ii<=neq;ii++) ddfddt[ii]=0.0;
+    for(jj=0;jj<neq;jj++){
+      for(ii=jac.spJ->Ap[jj];ii<jac.spJ->Ap[jj+1];ii++){
+	ddfddt[jac.spJ->Ai[ii]+1]+=jac.xjac[ii]*f0[jj+1];
+      }
+    }
+  }
+  else{
+    for(ii=1;ii<=neq;ii++){
+      ddfddt[ii]=0.0;
+      for(jj=1;jj<=neq;jj++){
+	ddfddt[ii]+=(jac.dfdy[ii][jj])*f0[jj];
+      }
     }
   }
 
@@ -448,8 +500,8 @@ int evolver_ndf15(
 	    class_call((*derivs)(t,y+1,f0+1,parameters_and_workspace_for_derivs,error_message),
 		       error_message,error_message);
 	    nfenj=0;
-	    class_call(numjac((*derivs),t,y,f0,&jac,&nj_ws,abstol,neq,
-			      &nfenj,parameters_and_workspace_for_derivs,error_message),
+	    class_call(evaluate_jacobian((*derivs),(*jacobian),&use_jacobian,t,y,f0,&jac,&nj_ws,abstol,neq,
+					 &nfenj,parameters_and_workspace_for_derivs,error_message),
 		       error_message,error_message);
 	    stepstat[3] += 1;
 	    stepstat[2] += (nfenj + 1);
@@ -665,9 +717,14 @@ int evolver_ndf15(
 	   stepstat[2],stepstat[3],stepstat[4],stepstat[5]);
   }
 
-  /** Deallocate memory */
+  if (statistics != NULL){
+    for(ii=0;ii<6;ii++) statistics[ii] += stepstat[ii];
+  }
+
+  /** Deallocate memory (unless it belongs to the arena) */
 
-  free(buffer);
+  if (arena == NULL)
+    free(buffer);
 
   /* 	free(f0); */
   /* 	free(wt); */
@@ -689,8 +746,11 @@ int evolver_ndf15(
   /* 	free(dif[1]); */
   /* 	free(dif); */
 
-  uninitialize_jacobian(&jac);
-  uninitialize_numjac_workspace(&nj_ws);
+  if (arena == NULL) {
+    uninitialize_jacobian(&jac);
+    uninitialize_numjac_workspace(&nj_ws);
+  }
+  sp_ord_free(local_ordering_cache);
   return _SUCCESS_;
 
 } /*End of program*/
@@ -935,7 +995,7 @@ int adjust_stepsize(double **dif, double abshdivabshlast, int neq,int k){
 
 int new_linearisation(struct jacobian *jac,double hinvGak,int neq,ErrorMsg error_message){
   double luparity, *Ax;
-  int i,j,*Ap,*Ai,funcreturn;
+  int i,j,*Ap,*Ai,funcreturn,found;
   if(jac->use_sparse==1){
     Ap = jac->spJ->Ap; Ai = jac->spJ->Ai; Ax = jac->spJ->Ax;
     /* Construct jac->spJ->Ax from jac->xjac, the jacobian:*/
@@ -955,11 +1015,19 @@ int new_linearisation(struct jacobian *jac,double hinvGak,int neq,ErrorMsg error
       /*I have a new pattern, and I have not done a LU decomposition
 	since the last jacobian calculation, so	I need to do a full
 	sparse LU-decomposition: */
-      /* Find the sparsity pattern C = J + J':*/
-      calc_C(jac);
-      /* Calculate the optimal ordering: */
-      sp_amd(jac->Cp, jac->Ci, neq, jac->cnzmax,
-	     jac->Numerical->q,jac->Numerical->wamd);
+      /* Reuse the ordering if this pattern has been seen before: */
+      class_call(sp_ord_lookup(jac->ordering_cache, jac->spJ, jac->Numerical->q, &found),
+		 error_message,error_message);
+      if (found == _FALSE_){
+	/* Find the sparsity pattern C = J + J':*/
+	calc_C(jac);
+	/* Calculate the optimal ordering: */
+	sp_amd(jac->Cp, jac->Ci, neq, jac->cnzmax,
+	       jac->Numerical->q,jac->Numerical->wamd);
+	class_call(sp_ord_store(jac->ordering_cache, jac->spJ, jac->Numerical->q,
+				ORDERING_CACHE_SIZE, error_message),
+		   error_message,error_message);
+      }
       /* if the next line is uncomented, the code uses natural ordering instead of AMD ordering */
       /*jac->Numerical->q = NULL;*/
       funcreturn = sp_ludcmp(jac->Numerical, jac->spJ, 1e-3);
@@ -1172,9 +1240,49 @@ int fzero_Newton(int (*func)(double *x,
 
 /**********************************************************************/
 /* Here are some routines related to the calculation of the jacobian: */
-/* "numjac", "initialize_jacobian", "uninitialize_jacobian",					*/
-/* "initialize_numjac_workspace", "uninitialize_numjac_workspace".		*/
+/* "evaluate_jacobian", "numjac", "initialize_jacobian",             */
+/* "uninitialize_jacobian", "initialize_numjac_workspace",            */
+/* "uninitialize_numjac_workspace".                                   */
 /**********************************************************************/
+int evaluate_jacobian(
+		      int (*derivs)(double x, double * y,double * dy,
+				    void * parameters_and_workspace, ErrorMsg error_message),
+		      int (*jacobian)(double x,double * y,double * dy,sp_mat * J,short * has_jacobian,int * nfe,
+				      void * parameters_and_workspace, ErrorMsg error_message),
+		      short * use_jacobian,
+		      double t, double *y, double *fval,
+		      struct jacobian *jac, struct numjac_workspace *nj_ws,
+		      double thresh, int neq, int *nfe, void * parameters_and_workspace_for_derivs,
+		      ErrorMsg error_message){
+  /* Get the jacobian from (*jacobian) if possible, otherwise from numjac. The
+     analytic jacobian is written in jac->spJ, and its values copied to jac->xjac,
+     exactly where numjac would have put them in the sparse case. */
+  int i;
+
+  if (*use_jacobian == _TRUE_){
+    class_call((*jacobian)(t,y+1,fval+1,jac->spJ,use_jacobian,nfe,
+			   parameters_and_workspace_for_derivs,error_message),
+	       error_message,error_message);
+
+    if (*use_jacobian == _TRUE_){
+      for(i=0;i<jac->spJ->Ap[neq];i++) jac->xjac[i] = jac->spJ->Ax[i];
+      /* The pattern may differ from the previous one: always decompose from scratch. */
+      jac->new_jacobian = _TRUE_;
+      /* If we ever have to fall back to numjac, it should learn the pattern again: */
+      jac->has_pattern = _FALSE_;
+      jac->repeated_pattern = 0;
+      jac->has_grouping = 0;
+      return _SUCCESS_;
+    }
+  }
+
+  class_call(numjac((*derivs),t,y,fval,jac,nj_ws,thresh,neq,
+		    nfe,parameters_and_workspace_for_derivs,error_message),
+	     error_message,error_message);
+
+  return _SUCCESS_;
+}
+
 int numjac(
 	   int (*derivs)(double x, double * y,double * dy,
 			 void * parameters_and_workspace, ErrorMsg error_message),
@@ -1617,6 +1725,210 @@ int initialize_numjac_workspace(struct numjac_workspace * nj_ws,int neq, ErrorMs
   return _SUCCESS_;
 }
 
+/* Take n elements of a given type from the arena block at the current offset.
+   The offset is rounded up so that each array is aligned on 16 bytes. If block is
+   NULL, the offset is only counted (this is used to find the size of the block). */
+#define ndf15_arena_take(pointer,type,n) {				\
+    pointer = (block == NULL) ? NULL : (type*)(block+offset);		\
+    offset += (((n)*sizeof(type)+15)/16)*16;				\
+  }
+
+int ndf15_arena_init(struct ndf15_arena * arena){
+  arena->size = 0;
+  arena->block = NULL;
+  return _SUCCESS_;
+}
+
+int ndf15_arena_free(struct ndf15_arena * arena){
+  if (arena->block != NULL)
+    free(arena->block);
+  return ndf15_arena_init(arena);
+}
+
+/**
+ * Set the pointers of the work buffer of evolver_ndf15, of the
+ * Jacobian and of the numjac workspace for a system of neq equations,
+ * as consecutive arrays in block, with the same sizes as in
+ * initialize_jacobian() and initialize_numjac_workspace(). The scalar
+ * parameters of the Jacobian are set as in initialize_jacobian(). If
+ * block==NULL, only the total size is computed.
+ *
+ * @param block       Input: block of memory of at least *size bytes, or NULL
+ * @param size        Output: number of bytes used
+ * @param neq         Input: number of equations
+ * @param buffer_size Input: size in bytes of the work buffer of evolver_ndf15
+ * @param buffer      Output: work buffer
+ * @param jac         Output: Jacobian structure
+ * @param nj_ws       Output: numjac workspace
+ * @return the error status
+ */
+
+int ndf15_arena_layout(char * block, size_t * size, int neq, int buffer_size, void ** buffer,
+		       struct jacobian *jac, struct numjac_workspace *nj_ws){
+
+  size_t offset=0;
+  int neqp=neq+1, maxnz, i;
+  double *dfdy_rows, *LU_rows, *ydel_Fdel_rows;
+  int *xi_rows;
+  sp_num *N, N_count;
+  sp_mat *spJ, *L, *U, mat_count[3];
+
+  /* Same parameters as in initialize_jacobian: */
+  if (neq>15){
+    jac->use_sparse = 1;
+  }
+  else{
+    jac->use_sparse = 0;
+  }
+  jac->max_nonzero = (int)(MAX(3*neq,0.20*neq*neq));
+  jac->cnzmax = 12*jac->max_nonzero/5;
+  jac->repeated_pattern = 0;
+  jac->trust_sparse = 4;
+  jac->has_grouping = 0;
+  jac->has_pattern = 0;
+  jac->sparse_stuff_initialized = jac->use_sparse;
+
+  ndf15_arena_take(*buffer,char,buffer_size);
+
+  ndf15_arena_take(jac->dfdy,double*,neqp);
+  ndf15_arena_take(dfdy_rows,double,neq*neq+1);
+  ndf15_arena_take(jac->LU,double*,neqp);
+  ndf15_arena_take(LU_rows,double,neq*neq+1);
+  ndf15_arena_take(jac->LUw,double,neqp);
+  ndf15_arena_take(jac->jacvec,double,neqp);
+  ndf15_arena_take(jac->luidx,int,neqp);
+
+  if (jac->use_sparse){
+    ndf15_arena_take(jac->xjac,double,jac->max_nonzero);
+    ndf15_arena_take(jac->col_group,int,neq);
+    ndf15_arena_take(jac->col_wi,int,neq);
+    ndf15_arena_take(jac->Cp,int,neqp);
+    ndf15_arena_take(jac->Ci,int,jac->cnzmax);
+
+    /* Same sizes as in sp_num_alloc() and sp_mat_alloc(). When only
+       counting, the fields are written in local structures. */
+    ndf15_arena_take(N,sp_num,1);
+    ndf15_arena_take(spJ,sp_mat,1);
+    ndf15_arena_take(L,sp_mat,1);
+    ndf15_arena_take(U,sp_mat,1);
+    if (block == NULL){
+      N = &N_count;
+      spJ = &(mat_count[0]);
+      L = &(mat_count[1]);
+      U = &(mat_count[2]);
+    }
+
+    maxnz = neq*(neq+1)/2;
+    mat_count[0].maxnz = jac->max_nonzero;
+    mat_count[1].maxnz = maxnz;
+    mat_count[2].maxnz = maxnz;
+    for (i=0; i<3; i++){
+      ndf15_arena_take(mat_count[i].Ax,double,mat_count[i].maxnz);
+      ndf15_arena_take(mat_count[i].Ai,int,mat_count[i].maxnz);
+      ndf15_arena_take(mat_count[i].Ap,int,neqp);
+      mat_count[i].ncols = neq;
+      mat_count[i].nrows = neq;
+    }
+    if (block != NULL){
+      *spJ = mat_count[0];
+      *L = mat_count[1];
+      *U = mat_count[2];
+    }
+
+    N->n = neq;
+    N->L = L;
+    N->U = U;
+    ndf15_arena_take(N->xi,int*,neq);
+    ndf15_arena_take(xi_rows,int,neq*neq);
+    ndf15_arena_take(N->topvec,int,neq);
+    ndf15_arena_take(N->pinv,int,neq);
+    ndf15_arena_take(N->p,int,neq);
+    ndf15_arena_take(N->q,int,neqp);
+    ndf15_arena_take(N->w,double,neq);
+    ndf15_arena_take(N->wamd,int,8*neqp);
+
+    if (block != NULL){
+      jac->Numerical = N;
+      jac->spJ = spJ;
+      N->xi[0] = xi_rows;
+    }
+  }
+
+  ndf15_arena_take(nj_ws->yscale,double,neqp);
+  ndf15_arena_take(nj_ws->del,double,neqp);
+  ndf15_arena_take(nj_ws->Difmax,double,neqp);
+  ndf15_arena_take(nj_ws->absFdelRm,double,neqp);
+  ndf15_arena_take(nj_ws->absFvalue,double,neqp);
+  ndf15_arena_take(nj_ws->absFvalueRm,double,neqp);
+  ndf15_arena_take(nj_ws->Fscale,double,neqp);
+  ndf15_arena_take(nj_ws->ffdel,double,neqp);
+  ndf15_arena_take(nj_ws->yydel,double,neqp);
+  ndf15_arena_take(nj_ws->tmp,double,neqp);
+  ndf15_arena_take(nj_ws->ydel_Fdel,double*,neqp);
+  ndf15_arena_take(ydel_Fdel_rows,double,neq*neq+1);
+  ndf15_arena_take(nj_ws->logj,int,neqp);
+  ndf15_arena_take(nj_ws->Rowmax,int,neqp);
+
+  if (block != NULL){
+    jac->dfdy[1] = dfdy_rows;
+    jac->LU[1] = LU_rows;
+    nj_ws->ydel_Fdel[1] = ydel_Fdel_rows;
+  }
+
+  *size = offset;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Prepare the arena for a call to evolver_ndf15 with neq equations:
+ * grow the block if needed, lay out all arrays in it with
+ * ndf15_arena_layout(), and initialize the row pointers and the
+ * vectors which initialize_jacobian() would initialize.
+ *
+ * @param arena         Input/Output: arena kept by the caller
+ * @param neq           Input: number of equations
+ * @param buffer_size   Input: size in bytes of the work buffer of evolver_ndf15
+ * @param buffer        Output: work buffer
+ * @param jac           Output: Jacobian structure
+ * @param nj_ws         Output: numjac workspace
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int ndf15_arena_setup(struct ndf15_arena * arena, int neq, int buffer_size, void ** buffer,
+		      struct jacobian *jac, struct numjac_workspace *nj_ws, ErrorMsg error_message){
+
+  size_t size;
+  int i;
+
+  ndf15_arena_layout(NULL,&size,neq,buffer_size,buffer,jac,nj_ws);
+
+  if (size > arena->size){
+    if (arena->block != NULL)
+      free(arena->block);
+    class_alloc(arena->block,size,error_message);
+    arena->size = size;
+  }
+
+  ndf15_arena_layout(arena->block,&size,neq,buffer_size,buffer,jac,nj_ws);
+
+  jac->dfdy[0] = NULL;
+  for(i=2;i<=neq;i++) jac->dfdy[i] = jac->dfdy[i-1]+neq;
+  jac->LU[0] = NULL;
+  for(i=2;i<=neq;i++) jac->LU[i] = jac->LU[i-1]+neq;
+  nj_ws->ydel_Fdel[0] = NULL;
+  for(i=2;i<=neq;i++) nj_ws->ydel_Fdel[i] = nj_ws->ydel_Fdel[i-1]+neq;
+  if (jac->use_sparse){
+    for (i=1;i<neq;i++) jac->Numerical->xi[i] = jac->Numerical->xi[i-1]+neq;
+  }
+
+  /* Initialize jacvec to sqrt(eps):*/
+  for (i=1;i<=neq;i++) jac->jacvec[i]=1.490116119384765597872e-8;
+
+  return _SUCCESS_;
+}
+
 int uninitialize_numjac_workspace(struct numjac_workspace * nj_ws){
   /* Deallocate vectors and matrices: */
   free(nj_ws->yscale);
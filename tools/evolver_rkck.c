@@ -1,48 +1,88 @@
 #include "evolver_rkck.h"
 
-int evolver_rk(int (*derivs)(double x,
-				  double * y,
-				  double * dy,
-				  void * parameters_and_workspace,
-				  ErrorMsg error_message),
-		    double x_ini,
-		    double x_end,
-		    double * y,
-		    int * used_in_output,
-		    int y_size,
-		    void * parameters_and_workspace_for_derivs,
-		    double tolerance,
-		    double minimum_variation,
-		    int (*evaluate_timescale)(double x,
+/**
+ * Integrate a system with the Runge-Kutta (Cash-Karp) method, for
+ * evolver_rk and evolver_rk_dense.
+ *
+ * By default, the steps stop at each point of x_sampling, where
+ * (*output) is called. If dense_output is set, they do not: y and
+ * dy/dx are interpolated with the dense output of
+ * generic_integrator_dense(), so that the step size only depends on
+ * the time scale and on the accuracy. The combinations of the
+ * Cash-Karp stages (see rkck()) are simple loops over the equations,
+ * vectorised with 'omp simd' when compiled with OpenMP.
+ *
+ * If statistics!=NULL, the numbers of successful steps, failed steps
+ * and function evaluations are added to statistics[0], [1], [2], like
+ * in evolver_ndf15 (entries [3] to [5] are left unchanged).
+ *
+ * @param derivs                    Input: function computing dy/dx
+ * @param x_ini                     Input: initial time
+ * @param x_end                     Input: final time
+ * @param y                         Input/Output: vector
+ * @param y_size                    Input: size of the vector
+ * @param parameters_and_workspace  Input: parameters passed to all functions
+ * @param tolerance                 Input: tolerance of the integrator
+ * @param minimum_variation         Input: smallest relative step
+ * @param evaluate_timescale        Input: function giving the time scale
+ * @param timestep_over_timescale   Input: ratio of the step to the time scale
+ * @param x_sampling                Input: times at which (*output) is called
+ * @param x_size                    Input: size of x_sampling
+ * @param output                    Input: output function
+ * @param print_variables           Input: function for printing variables (or NULL)
+ * @param dense_output              Input: use dense output instead of stopping at each sampling point
+ * @param statistics                Output: integration statistics (or NULL)
+ * @param error_message             Output: error message
+ * @return the error status
+ */
+
+static int evolver_rk_integrate(int (*derivs)(double x,
+					      double * y,
+					      double * dy,
 					      void * parameters_and_workspace,
-					      double * timescale,
 					      ErrorMsg error_message),
-		    double timestep_over_timescale,
-		    double * x_sampling,
-		    int x_size,
-		    int (*output)(double x,
-				  double y[],
-				  double dy[],
-				  int index_x,
-				  void * parameters_and_workspace,
-				  ErrorMsg error_message),
-		    int (*print_variables)(double x,
-					   double y[],
-					   double dy[],
-					   void * parameters_and_workspace,
-					   ErrorMsg error_message),
-		    ErrorMsg error_message) {
+				double x_ini,
+				double x_end,
+				double * y,
+				int y_size,
+				void * parameters_and_workspace,
+				double tolerance,
+				double minimum_variation,
+				int (*evaluate_timescale)(double x,
+							  void * parameters_and_workspace,
+							  double * timescale,
+							  ErrorMsg error_message),
+				double timestep_over_timescale,
+				double * x_sampling,
+				int x_size,
+				int (*output)(double x,
+					      double y[],
+					      double dy[],
+					      int index_x,
+					      void * parameters_and_workspace,
+					      ErrorMsg error_message),
+				int (*print_variables)(double x,
+						       double y[],
+						       double dy[],
+						       void * parameters_and_workspace,
+						       ErrorMsg error_message),
+				short dense_output,
+				int * statistics,
+				ErrorMsg error_message) {
 
   int next_index_x;
-  double x1,x2=0.,timestep,timescale;
+  double x1,x2,timestep,timescale;
   struct generic_integrator_workspace gi;
   double * dy;
   short call_output;
+  int nfe=0;
 
   class_test(x_ini > x_sampling[x_size-1],
 	     error_message,
 	     "called with x=%e, last x_sampling=%e",x_ini,x_sampling[x_size-1]);
 
+  class_alloc(dy,y_size*sizeof(double),error_message);
+
   next_index_x=0;
 
   while (x_sampling[next_index_x] < x_ini) next_index_x++;
@@ -51,16 +91,12 @@ int evolver_rk(int (*derivs)(double x,
 	     gi.error_message,
 	     error_message);
 
-  class_alloc(dy,y_size*sizeof(double),error_message);
-
   x1=x_ini;
 
-  call_output = _FALSE_;
-
   while ((x1 < x_end) && (next_index_x<x_size)) {
 
     class_call((*evaluate_timescale)(x1,
-				     parameters_and_workspace_for_derivs,
+				     parameters_and_workspace,
 				     &timescale,
 				     error_message),
 	       error_message,
@@ -72,7 +108,14 @@ int evolver_rk(int (*derivs)(double x,
 	       error_message,
 	       "integration step =%e < machine precision : leads either to numerical error or infinite loop",fabs(timestep/x1));
 
-    if (x1 + 2.* timestep < x_sampling[next_index_x]) {
+    call_output = _FALSE_;
+
+    if (dense_output == _TRUE_) {
+      /* the step is only limited by the time scale: the sampling
+	 points which it covers are dealt with by dense output */
+      x2 = x1 + timestep;
+    }
+    else if (x1 + 2.* timestep < x_sampling[next_index_x]) {
       x2 = x1 + timestep;
     }
     else {
@@ -89,10 +132,11 @@ int evolver_rk(int (*derivs)(double x,
 
       if (x1 == x_ini) {
 
+	nfe++;
 	class_call((*derivs)(x1,
 			     y,
 			     dy,
-			     parameters_and_workspace_for_derivs,
+			     parameters_and_workspace,
 			     error_message),
 		   error_message,
 		   error_message);
@@ -101,29 +145,50 @@ int evolver_rk(int (*derivs)(double x,
       class_call((*print_variables)(x1,
 				    y,
 				    dy,
-				    parameters_and_workspace_for_derivs,
+				    parameters_and_workspace,
 				    error_message),
 		 error_message,
 		 error_message);
     }
 
-    class_call(generic_integrator(derivs,
-				  x1,
-				  x2,
-				  y,
-				  parameters_and_workspace_for_derivs,
-				  tolerance,
-				  x1*minimum_variation,
-				  &gi),
-	       gi.error_message,
-	       error_message);
+    if (dense_output == _TRUE_) {
+
+      class_call(generic_integrator_dense(derivs,
+					  x1,
+					  x2,
+					  y,
+					  parameters_and_workspace,
+					  tolerance,
+					  x1*minimum_variation,
+					  x_sampling,
+					  x_size,
+					  &next_index_x,
+					  output,
+					  &gi),
+		 gi.error_message,
+		 error_message);
+    }
+    else {
+
+      class_call(generic_integrator(derivs,
+				    x1,
+				    x2,
+				    y,
+				    parameters_and_workspace,
+				    tolerance,
+				    x1*minimum_variation,
+				    &gi),
+		 gi.error_message,
+		 error_message);
+    }
 
     if (call_output == _TRUE_) {
 
+      nfe++;
       class_call((*derivs)(x2,
 			   y,
 			   dy,
-			   parameters_and_workspace_for_derivs,
+			   parameters_and_workspace,
 			   error_message),
 		 error_message,
 		 error_message);
@@ -132,13 +197,11 @@ int evolver_rk(int (*derivs)(double x,
 			   y,
 			   dy,
 			   next_index_x,
-			   parameters_and_workspace_for_derivs,
+			   parameters_and_workspace,
 			   error_message),
 		 error_message,
 		 error_message);
 
-      call_output = _FALSE_;
-
       next_index_x++;
 
     }
@@ -148,12 +211,13 @@ int evolver_rk(int (*derivs)(double x,
   }
 
   /* a last call is compulsory to ensure that all quantitites in
-     y,dy,parameters_and_workspace_for_derivs are updated to the last
+     y,dy,parameters_and_workspace are updated to the last
      point in the covered range */
+  nfe++;
   class_call((*derivs)(x1,
 		       y,
 		       dy,
-		       parameters_and_workspace_for_derivs,
+		       parameters_and_workspace,
 		       error_message),
 	     error_message,
 	     error_message);
@@ -162,11 +226,17 @@ int evolver_rk(int (*derivs)(double x,
     class_call((*print_variables)(x1,
 				  y,
 				  dy,
-				  parameters_and_workspace_for_derivs,
+				  parameters_and_workspace,
 				  error_message),
 	       error_message,
 	       error_message);
 
+  if (statistics != NULL) {
+    statistics[0] += gi.steps;
+    statistics[1] += gi.failed_steps;
+    statistics[2] += gi.nfe + nfe;
+  }
+
   class_call(cleanup_generic_integrator(&gi),
 	     gi.error_message,
 	     error_message);
@@ -176,3 +246,146 @@ int evolver_rk(int (*derivs)(double x,
   return _SUCCESS_;
 
 }
+
+int evolver_rk(int (*derivs)(double x,
+				  double * y,
+				  double * dy,
+				  void * parameters_and_workspace,
+				  ErrorMsg error_message),
+		    int (*jacobian)(double x,
+				    double * y,
+				    double * dy,
+				    sp_mat * J,
+				    short * has_jacobian,
+				    int * nfe,
+				    void * parameters_and_workspace,
+				    ErrorMsg error_message),
+		    sp_ord ** ordering_cache,
+		    struct ndf15_arena * arena,
+		    double x_ini,
+		    double x_end,
+		    double * y,
+		    int * used_in_output,
+		    int y_size,
+		    void * parameters_and_workspace_for_derivs,
+		    double tolerance,
+		    double minimum_variation,
+		    int (*evaluate_timescale)(double x,
+					      void * parameters_and_workspace,
+					      double * timescale,
+					      ErrorMsg error_message),
+		    double timestep_over_timescale,
+		    double * x_sampling,
+		    int x_size,
+		    int (*output)(double x,
+				  double y[],
+				  double dy[],
+				  int index_x,
+				  void * parameters_and_workspace,
+				  ErrorMsg error_message),
+		    int (*print_variables)(double x,
+					   double y[],
+					   double dy[],
+					   void * parameters_and_workspace,
+					   ErrorMsg error_message),
+		    int * statistics,
+		    ErrorMsg error_message) {
+
+  /* (*jacobian), ordering_cache and arena are not needed by this explicit method; they
+     are only arguments so that evolver_rk and evolver_ndf15 can be called in the
+     same way. */
+
+  class_call(evolver_rk_integrate(derivs,
+				  x_ini,
+				  x_end,
+				  y,
+				  y_size,
+				  parameters_and_workspace_for_derivs,
+				  tolerance,
+				  minimum_variation,
+				  evaluate_timescale,
+				  timestep_over_timescale,
+				  x_sampling,
+				  x_size,
+				  output,
+				  print_variables,
+				  _FALSE_,
+				  statistics,
+				  error_message),
+	     error_message,
+	     error_message);
+
+  return _SUCCESS_;
+
+}
+
+int evolver_rk_dense(int (*derivs)(double x,
+                                        double * y,
+                                        double * dy,
+                                        void * parameters_and_workspace,
+                                        ErrorMsg error_message),
+                          int (*jacobian)(double x,
+                                          double * y,
+                                          double * dy,
+                                          sp_mat * J,
+                                          short * has_jacobian,
+                                          int * nfe,
+                                          void * parameters_and_workspace,
+                                          ErrorMsg error_message),
+                          sp_ord ** ordering_cache,
+                          struct ndf15_arena * arena,
+                          double x_ini,
+                          double x_end,
+                          double * y,
+                          int * used_in_output,
+                          int y_size,
+                          void * parameters_and_workspace_for_derivs,
+                          double tolerance,
+                          double minimum_variation,
+                          int (*evaluate_timescale)(double x,
+                                                    void * parameters_and_workspace,
+                                                    double * timescale,
+                                                    ErrorMsg error_message),
+                          double timestep_over_timescale,
+                          double * x_sampling,
+                          int x_size,
+                          int (*output)(double x,
+                                        double y[],
+                                        double dy[],
+                                        int index_x,
+                                        void * parameters_and_workspace,
+                                        ErrorMsg error_message),
+                          int (*print_variables)(double x,
+                                                 double y[],
+                                                 double dy[],
+                                                 void * parameters_and_workspace,
+                                                 ErrorMsg error_message),
+                          int * statistics,
+                          ErrorMsg error_message) {
+
+  /* Same as evolver_rk, but the steps do not stop at each point of
+     x_sampling: see the dense output of evolver_rk_integrate(). */
+
+  class_call(evolver_rk_integrate(derivs,
+				  x_ini,
+				  x_end,
+				  y,
+				  y_size,
+				  parameters_and_workspace_for_derivs,
+				  tolerance,
+				  minimum_variation,
+				  evaluate_timescale,
+				  timestep_over_timescale,
+				  x_sampling,
+				  x_size,
+				  output,
+				  print_variables,
+				  _TRUE_,
+				  statistics,
+				  error_message),
+	     error_message,
+	     error_message);
+
+  return _SUCCESS_;
+
+}
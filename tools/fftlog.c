@@ -0,0 +1,286 @@
+/**
+ * module with tools for logarithmic Hankel-type transforms (FFTLog)
+ *
+ * Given a function f(x) sampled on a logarithmic grid, computes
+ * \f$ g(y) = \int_0^\infty f(x) K(xy) dx/x \f$ on a logarithmic grid
+ * in O(N log N) operations, for kernels K whose Mellin transform is
+ * known analytically (see Hamilton 2000, astro-ph/9905191). The
+ * function \f$ f(x) x^{-q} \f$ is expanded in Fourier series of ln(x),
+ * each mode being a power law whose transform is given by the Mellin
+ * transform of K.
+ */
+
+#include "fftlog.h"
+#include <complex.h>
+
+/**
+ * Logarithm of the Gamma function for complex arguments
+ * (Lanczos approximation, relative accuracy of order 1e-15). Only
+ * the exponential of the result is meaningful, the imaginary part
+ * being defined modulo \f$ 2\pi \f$.
+ */
+
+static double complex fftlog_lngamma(double complex z) {
+
+  static const double p[9] = {0.99999999999980993,
+                              676.5203681218851,
+                              -1259.1392167224028,
+                              771.32342877765313,
+                              -176.61502916214059,
+                              12.507343278686905,
+                              -0.13857109526572012,
+                              9.9843695780195716e-6,
+                              1.5056327351493116e-7};
+  double complex x,t,lnsin,piz;
+  int i;
+
+  /* reflection formula Gamma(z) Gamma(1-z) = pi / sin(pi z) */
+  if (creal(z) < 0.5) {
+    piz = _PI_*z;
+    /* for large imaginary parts, sin(pi z) is dominated by a single exponential */
+    if (cimag(piz) > 30.)
+      lnsin = cimag(piz) - log(2.) + I*(_PIHALF_ - creal(piz));
+    else if (cimag(piz) < -30.)
+      lnsin = -cimag(piz) - log(2.) + I*(creal(piz) - _PIHALF_);
+    else
+      lnsin = clog(csin(piz));
+    return log(_PI_) - lnsin - fftlog_lngamma(1.-z);
+  }
+
+  z -= 1.;
+  x = p[0];
+  for (i=1; i<9; i++)
+    x += p[i]/(z+i);
+  t = z + 7.5;
+
+  return 0.5*log(2.*_PI_) + (z+0.5)*clog(t) - t + clog(x);
+}
+
+/**
+ * Logarithm of the Mellin transform \f$ M(z)=\int_0^\infty x^{z-1} K(x) dx \f$
+ * of the kernels of enum fftlog_kernel.
+ */
+
+static double complex fftlog_ln_mellin(enum fftlog_kernel kernel, double nu, double complex z) {
+
+  switch (kernel) {
+
+  case fftlog_spherical_bessel:
+    /* M(z) = 2^(z-2) sqrt(pi) Gamma((nu+z)/2) / Gamma((3+nu-z)/2), for -nu < Re(z) < 2 */
+    return (z-2.)*log(2.) + 0.5*log(_PI_)
+      + fftlog_lngamma(0.5*(nu+z)) - fftlog_lngamma(0.5*(3.+nu-z));
+
+  case fftlog_tophat_squared:
+    /* M(z) = 9 sqrt(pi)/4 Gamma(z/2) Gamma((4-z)/2) / [Gamma((5-z)/2) Gamma((8-z)/2)], for 0 < Re(z) < 4 */
+    return log(9./4.) + 0.5*log(_PI_)
+      + fftlog_lngamma(0.5*z) + fftlog_lngamma(0.5*(4.-z))
+      - fftlog_lngamma(0.5*(5.-z)) - fftlog_lngamma(0.5*(8.-z));
+  }
+
+  return 0.;
+}
+
+/**
+ * In-place forward discrete Fourier transform
+ * \f$ A_m = \sum_n a_n e^{-2 \pi i m n/N} \f$ (iterative radix-2
+ * algorithm).
+ *
+ * @param re     Input/Output: real part of the array, size N
+ * @param im     Input/Output: imaginary part of the array, size N
+ * @param N      Input: size, a power of two
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int fftlog_fft(
+               double * re,
+               double * im,
+               int N,
+               ErrorMsg errmsg
+               ) {
+
+  int i,j,k,m,half;
+  double tmp,w_re,w_im,wm_re,wm_im,t_re,t_im,theta;
+
+  if ((N < 2) || ((N & (N-1)) != 0)) {
+    sprintf(errmsg,"%s(L:%d) N=%d is not a power of two",__func__,__LINE__,N);
+    return _FAILURE_;
+  }
+
+  /** - bit-reversal permutation */
+
+  for (i=1, j=0; i<N; i++) {
+    m = N >> 1;
+    while (j & m) {
+      j ^= m;
+      m >>= 1;
+    }
+    j |= m;
+    if (i < j) {
+      tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+      tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+    }
+  }
+
+  /** - butterflies */
+
+  for (m=2; m<=N; m<<=1) {
+    half = m >> 1;
+    theta = -_TWOPI_/m;
+    wm_re = cos(theta);
+    wm_im = sin(theta);
+    for (k=0; k<N; k+=m) {
+      w_re = 1.;
+      w_im = 0.;
+      for (j=0; j<half; j++) {
+        t_re = w_re*re[k+j+half] - w_im*im[k+j+half];
+        t_im = w_re*im[k+j+half] + w_im*re[k+j+half];
+        re[k+j+half] = re[k+j] - t_re;
+        im[k+j+half] = im[k+j] - t_im;
+        re[k+j] += t_re;
+        im[k+j] += t_im;
+        tmp = w_re*wm_re - w_im*wm_im;
+        w_im = w_re*wm_im + w_im*wm_re;
+        w_re = tmp;
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Prepare the transform \f$ g(y) = \int_0^\infty f(x) K(xy) dx/x \f$
+ * from the grid \f$ x_n = x_0 e^{n \Delta} \f$ to the grid
+ * \f$ y_m = y_0 e^{m \Delta} \f$ (n,m = 0...N-1).
+ *
+ * The Mellin transform of the kernel must converge on the line
+ * Re(z)=q. The bias q should be chosen such that \f$ f(x) x^{-q} \f$
+ * is small at both ends of the grid, since it is assumed periodic.
+ *
+ * @param N      Input: number of points (power of two)
+ * @param x0     Input: first point of the input grid
+ * @param dlnx   Input: logarithmic step of both grids
+ * @param y0     Input: first point of the output grid
+ * @param q      Input: power-law bias
+ * @param kernel Input: kernel K
+ * @param nu     Input: order of the spherical Bessel function (ignored for other kernels)
+ * @param pfp    Output: plan, to be freed with fftlog_plan_free()
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int fftlog_plan_init(
+                     int N,
+                     double x0,
+                     double dlnx,
+                     double y0,
+                     double q,
+                     enum fftlog_kernel kernel,
+                     double nu,
+                     struct fftlog_plan * pfp,
+                     ErrorMsg errmsg
+                     ) {
+
+  int m,m_signed;
+  double omega;
+  double complex u;
+
+  if ((N < 2) || ((N & (N-1)) != 0)) {
+    sprintf(errmsg,"%s(L:%d) N=%d is not a power of two",__func__,__LINE__,N);
+    return _FAILURE_;
+  }
+
+  pfp->N = N;
+  pfp->x0 = x0;
+  pfp->dlnx = dlnx;
+  pfp->y0 = y0;
+  pfp->q = q;
+
+  pfp->u_re = malloc(4*N*sizeof(double));
+  if (pfp->u_re == NULL) {
+    sprintf(errmsg,"%s(L:%d) Cannot allocate plan",__func__,__LINE__);
+    return _FAILURE_;
+  }
+  pfp->u_im = pfp->u_re + N;
+  pfp->work_re = pfp->u_im + N;
+  pfp->work_im = pfp->work_re + N;
+
+  /* coefficients in the order of the FFT output: m=0...N/2-1, then -N/2...-1 */
+  for (m=0; m<N; m++) {
+    m_signed = (m < N/2) ? m : m-N;
+    omega = _TWOPI_*m_signed/(N*dlnx);
+    u = cexp(fftlog_ln_mellin(kernel,nu,q+I*omega) - I*omega*log(x0*y0));
+    pfp->u_re[m] = creal(u);
+    /* the Nyquist mode must be real for the result to be real */
+    pfp->u_im[m] = (m == N/2) ? 0. : cimag(u);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the transform prepared by fftlog_plan_init().
+ *
+ * @param pfp    Input: plan
+ * @param f      Input: f(x_n), size N
+ * @param g      Output: g(y_m), size N
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int fftlog_execute(
+                   struct fftlog_plan * pfp,
+                   double * f,
+                   double * g,
+                   ErrorMsg errmsg
+                   ) {
+
+  int n,N;
+  double tmp;
+
+  N = pfp->N;
+
+  /** - Fourier coefficients of \f$ f(x) x^{-q} \f$ */
+
+  for (n=0; n<N; n++) {
+    pfp->work_re[n] = f[n]*exp(-pfp->q*(log(pfp->x0)+n*pfp->dlnx))/N;
+    pfp->work_im[n] = 0.;
+  }
+
+  if (fftlog_fft(pfp->work_re,pfp->work_im,N,errmsg) == _FAILURE_)
+    return _FAILURE_;
+
+  /** - multiply each power law by its transform, then sum them on the output grid */
+
+  for (n=0; n<N; n++) {
+    tmp = pfp->work_re[n]*pfp->u_re[n] - pfp->work_im[n]*pfp->u_im[n];
+    pfp->work_im[n] = pfp->work_re[n]*pfp->u_im[n] + pfp->work_im[n]*pfp->u_re[n];
+    pfp->work_re[n] = tmp;
+  }
+
+  if (fftlog_fft(pfp->work_re,pfp->work_im,N,errmsg) == _FAILURE_)
+    return _FAILURE_;
+
+  for (n=0; n<N; n++) {
+    g[n] = pfp->work_re[n]*exp(-pfp->q*(log(pfp->y0)+n*pfp->dlnx));
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the memory allocated by fftlog_plan_init().
+ *
+ * @param pfp Input: plan
+ * @return the error status
+ */
+
+int fftlog_plan_free(
+                     struct fftlog_plan * pfp
+                     ) {
+
+  free(pfp->u_re);
+
+  return _SUCCESS_;
+}
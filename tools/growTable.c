@@ -4,6 +4,81 @@
 
 #include "growTable.h"
 
+/* header of a chunk rounded up to 16 bytes, followed by its data */
+#define _GT_CHUNK_HEADER_ ((sizeof(struct gt_chunk)+15)/16*16)
+#define _GT_CHUNK_DATA_(chunk) ((char*)(chunk)+_GT_CHUNK_HEADER_)
+
+/**
+ * Append a chunk of sz bytes to the growTable.
+ */
+static int gt_add_chunk(
+  growTable* self, /**< a growTable*/
+  long sz          /**< size of the new chunk (in bytes)*/
+  ) {
+  struct gt_chunk* chunk;
+
+  chunk=malloc(_GT_CHUNK_HEADER_+sz);
+  class_test(chunk==NULL,
+	     self->error_message,
+	     "Cannot grow growTable");
+
+  chunk->next=NULL;
+  chunk->offset=self->sz;
+  chunk->sz=sz;
+
+  if (self->last==NULL)
+    self->chunk=chunk;
+  else
+    self->last->next=chunk;
+  self->last=chunk;
+
+  self->sz+=sz;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Copy sz bytes between data and the growTable, starting at index idx of the
+ * table (which must be already allocated up to idx+sz), in the direction
+ * given by to_table.
+ */
+static void gt_copy(
+  growTable* self, /**< a growTable*/
+  long idx,        /**< index in the table (in bytes)*/
+  char* data,      /**< data outside of the table*/
+  long sz,         /**< size of the data (in bytes)*/
+  short to_table   /**< _TRUE_ for writing in the table, _FALSE_ for reading*/
+  ) {
+  struct gt_chunk* chunk;
+  char* ptr;
+  long len;
+
+  if (idx<self->buffer_sz) {
+    len=MIN(sz,self->buffer_sz-idx);
+    ptr=(char*)self->buffer+idx;
+    if (to_table==_TRUE_) memcpy(ptr,data,len);
+    else memcpy(data,ptr,len);
+    idx+=len;
+    data+=len;
+    sz-=len;
+  }
+
+  /* data added at the end is usually in the last chunk */
+  chunk=((self->last!=NULL) && (idx>=self->last->offset)) ? self->last : self->chunk;
+
+  for (; sz>0; chunk=chunk->next) {
+    if (idx>=chunk->offset+chunk->sz)
+      continue;
+    len=MIN(sz,chunk->offset+chunk->sz-idx);
+    ptr=_GT_CHUNK_DATA_(chunk)+(idx-chunk->offset);
+    if (to_table==_TRUE_) memcpy(ptr,data,len);
+    else memcpy(data,ptr,len);
+    idx+=len;
+    data+=len;
+    sz-=len;
+  }
+}
+
 /***
  * gt_init Initialize the growTable.
  * gt_init will initialize the growTable structure. It must be already allocated.
@@ -16,11 +91,50 @@ int gt_init(
 
   class_alloc(self->buffer,_GT_INITSIZE_,self->error_message);
   self->sz=_GT_INITSIZE_;
+  self->buffer_sz=_GT_INITSIZE_;
+  self->chunk=NULL;
+  self->last=NULL;
   self->csz=0;
   self->freeze=_FALSE_;  /**< This line added by JL */
   return _SUCCESS_;
 }
 
+/**
+ * Reserve room for a total of sz bytes in the growTable, e.g. from an
+ * estimate of the number of rows to be added. If nothing has been added yet,
+ * the first chunk is replaced by one of this size, so that gt_getPtr() will
+ * not need to copy the data. This is only a hint: the table still grows
+ * beyond sz if needed.
+ *
+ * Called by background_solve(), thermodynamics_reionization_sample().
+ */
+int gt_reserve(
+  growTable* self, /**< a growTable*/
+  long sz          /**< expected total size of the data (in bytes)*/
+  ) {
+
+  class_test(self->freeze == _TRUE_,
+	     self->error_message,
+	     "cannot add any more data in the growTable (freeze is on)");
+
+  if (sz<=self->sz)
+    return _SUCCESS_;
+
+  if ((self->csz==0) && (self->chunk==NULL)) {
+    free(self->buffer);
+    class_alloc(self->buffer,sz,self->error_message);
+    self->sz=sz;
+    self->buffer_sz=sz;
+  }
+  else {
+    class_call(gt_add_chunk(self,sz-self->sz),
+	       self->error_message,
+	       self->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Add data to the growTable.
  *
@@ -33,8 +147,6 @@ int gt_add(
   long sz          /**< size of the data (in bytes)*/
   ) {
   long ridx;
-  void *res;
-  void *nbuffer;
 
   /** - assumes the growTable is correctly initialized */
 
@@ -53,19 +165,13 @@ int gt_add(
 	     "Don't know what to do with idx=%ld",ridx);
 
   if (ridx+sz>self->sz) {
-    /** - test -> pass -> ok we need to grow */
-    nbuffer=realloc(self->buffer,self->sz*_GT_FACTOR_);
-    class_test(nbuffer==NULL,
+    /** - test -> pass -> ok we need to grow: new chunk, the data already written stays in place */
+    class_call(gt_add_chunk(self,MAX(self->sz*(_GT_FACTOR_-1),ridx+sz-self->sz)),
 	       self->error_message,
-	       "Cannot grow growTable");
-    self->buffer=nbuffer;
-    self->sz=self->sz*_GT_FACTOR_;
+	       self->error_message);
   }
 
-  res=memcpy((void*) (self->buffer+ridx),(void*) data,(size_t) sz);
-  class_test(res!=self->buffer+ridx,
-	     self->error_message,
-	     "Cannot add data to growTable");
+  gt_copy(self,ridx,(char*)data,sz,_TRUE_);
   self->csz=ridx+sz;
 
   return _SUCCESS_;
@@ -82,7 +188,6 @@ int gt_retrieve(
   long sz,         /**< size of the data (in bytes)*/
   void* data       /**< OUTPUT : data must be allocated to ::sz bytes*/
   ) {
-  void *res;
 
   class_test(idx<0,
 	     self->error_message,
@@ -92,10 +197,7 @@ int gt_retrieve(
 	     self->error_message,
 	     "not enough data in growTable");
 
-  res=memcpy(data,self->buffer+idx,sz);
-  class_test(res!=self->buffer+idx,
-	     self->error_message,
-	     "cannot retrieve data from the growTable");
+  gt_copy(self,idx,(char*)data,sz,_FALSE_);
 
   return _SUCCESS_;
 }
@@ -131,6 +233,8 @@ int gt_getSize(
 /**
  * returns a pointer on the data contained in the growTable.
  * No Data can be added afterward !!!!! This is not for the faint of heart.
+ * If the table has grown beyond its first chunk, the data is gathered here
+ * into a single buffer.
  *
  * Called by background_solve().
  */
@@ -138,6 +242,24 @@ int gt_getPtr(
   growTable* self, /**< a growTable*/
   void** ptr       /**< OUTPUT : pointer on the data */
   ) {
+  void* nbuffer;
+  struct gt_chunk* chunk;
+
+  if ((self->freeze==_FALSE_) && (self->chunk!=NULL)) {
+    class_alloc(nbuffer,MAX(self->csz,1),self->error_message);
+    gt_copy(self,0,(char*)nbuffer,self->csz,_FALSE_);
+    free(self->buffer);
+    while (self->chunk!=NULL) {
+      chunk=self->chunk;
+      self->chunk=chunk->next;
+      free(chunk);
+    }
+    self->last=NULL;
+    self->buffer=nbuffer;
+    self->buffer_sz=MAX(self->csz,1);
+    self->sz=self->buffer_sz;
+  }
+
   self->freeze=_TRUE_;
   *ptr=self->buffer;
 
@@ -151,7 +273,15 @@ int gt_getPtr(
  * Called by background_solve().
  */
 int gt_free(growTable* self) {
+  struct gt_chunk* chunk;
+
   free(self->buffer);
+  while (self->chunk!=NULL) {
+    chunk=self->chunk;
+    self->chunk=chunk->next;
+    free(chunk);
+  }
+  self->last=NULL;
   self->csz=-1;
   self->sz=-1;
   self->freeze=_FALSE_;  /**< This line added by JL */
@@ -6,6 +6,21 @@
  */
 
 #include "hyperspherical.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** number of cache files written so far by this process, which makes
+    the temporary file names unique when several computations run in
+    different threads of the same process */
+static int hyperspherical_cache_writes = 0;
+
+#ifdef CLASS_OFFLOAD
+/** copies of HIS tables on the offload device, shared by all runs of
+    this process (see hyperspherical_HIS_device_get()) */
+static HyperDeviceTables * hyperspherical_device_list = NULL;
+#endif
 
 int hyperspherical_HIS_create(int K,
                               double beta,
@@ -30,6 +45,7 @@ int hyperspherical_HIS_create(int K,
   int j, k, l, nx, lmax, l_recurrence_max;
   int abort;
   int current_chunk, index_x;
+  short lmax_is_beta_minus_one;
 
   beta2 = beta*beta;
   lmax = lvec[nl-1];
@@ -45,6 +61,8 @@ int hyperspherical_HIS_create(int K,
   pHIS->l_size = nl;
   pHIS->x_size = nx;
   pHIS->K = K;
+  pHIS->mapping = NULL;
+  pHIS->mapping_size = 0;
   //Set pointervalues in pHIS:
 
   class_alloc(pHIS->l, sizeof(int)*nl,error_message);
@@ -136,44 +154,26 @@ int hyperspherical_HIS_create(int K,
 
 #pragma omp parallel                                                    \
   shared(nx,pHIS,xfwd,K,l_recurrence_max,beta,sqrtK,one_over_sqrtK,lvec,nl,xfwdidx,abort,error_message) \
-  private(j,PhiL,k,l,current_chunk,index_x)                           \
+  private(j,PhiL,k,l,current_chunk,index_x,lmax_is_beta_minus_one)    \
   firstprivate(lmax)
   {
     class_alloc_parallel(PhiL,(lmax+2)*sizeof(double)*_HYPER_CHUNK_,error_message);
 
+    lmax_is_beta_minus_one = _FALSE_;
     if ((K == 1) && ((int)(beta+0.2) == (lmax+1))) {
       /** Take care of special case lmax = beta-1.
           The routine below will try to compute
           Phi_{lmax+1} which is not allowed. However,
           the purpose is to calculate the derivative
-          Phi'_{lmax}, and the formula is correct if we set Phi_{lmax+1} = 0.
+          Phi'_{lmax}, and the formula is correct if we set Phi_{lmax+1} = 0
+          (row lmax+2 of each chunk after the decrement below).
       */
-      PhiL[lmax+1] = 0.0;
+      lmax_is_beta_minus_one = _TRUE_;
       lmax--;
     }
 
 #pragma omp for schedule (dynamic)              \
 
-
-    for (j=0; j<MIN(nx,xfwdidx); j++){
-      //Use backwards method:
-      hyperspherical_backwards_recurrence(K,
-                                          MIN(l_recurrence_max,lmax)+1,
-                                          beta,
-                                          pHIS->x[j],
-                                          pHIS->sinK[j],
-                                          pHIS->cotK[j],
-                                          sqrtK,
-                                          one_over_sqrtK,
-                                          PhiL);
-      //We have now populated PhiL at x, assign Phi and dPhi for all l in lvec:
-      for (k=0; k<=index_recurrence_max; k++){
-        l = lvec[k];
-        pHIS->phi[k*nx+j] = PhiL[l];
-        pHIS->dphi[k*nx+j] = l*pHIS->cotK[j]*PhiL[l]-sqrtK[l+1]*PhiL[l+1];
-      }
-    }
-    /**
     for (j=0; j<MIN(nx,xfwdidx); j+= _HYPER_CHUNK_){
       current_chunk = MIN(_HYPER_CHUNK_,MIN(nx,xfwdidx)-j);
       //Use backwards method:
@@ -187,6 +187,10 @@ int hyperspherical_HIS_create(int K,
                                                 sqrtK,
                                                 one_over_sqrtK,
                                                 PhiL);
+      if (lmax_is_beta_minus_one == _TRUE_){
+        for (index_x=0; index_x<current_chunk; index_x++)
+          PhiL[(lmax+2)*current_chunk+index_x] = 0.0;
+      }
       //We have now populated PhiL at x, assign Phi and dPhi for all l in lvec:
       for (k=0; k<=index_recurrence_max; k++){
         l = lvec[k];
@@ -199,8 +203,6 @@ int hyperspherical_HIS_create(int K,
       }
     }
 
-    */
-
 #pragma omp for schedule (dynamic)              \
 
     for (j=xfwdidx; j<nx; j+=_HYPER_CHUNK_){
@@ -216,6 +218,10 @@ int hyperspherical_HIS_create(int K,
                                                sqrtK,
                                                one_over_sqrtK,
                                                PhiL);
+      if (lmax_is_beta_minus_one == _TRUE_){
+        for (index_x=0; index_x<current_chunk; index_x++)
+          PhiL[(lmax+2)*current_chunk+index_x] = 0.0;
+      }
 
       //We have now populated PhiL at x, assign Phi and dPhi for all l in lvec:
       for (k=0; k<=index_recurrence_max; k++){
@@ -244,6 +250,180 @@ int hyperspherical_HIS_create(int K,
   return _SUCCESS_;
 }
 
+int hyperspherical_HIS_create_cached(char *cache_directory,
+                                     int K,
+                                     double beta,
+                                     int nl,
+                                     int *lvec,
+                                     double xmin,
+                                     double xmax,
+                                     double sampling,
+                                     int l_WKB,
+                                     double phiminabs,
+                                     HyperInterpStruct *pHIS,
+                                     ErrorMsg error_message){
+  /** Same as hyperspherical_HIS_create(), but look first for a cache
+      file in cache_directory, written by a previous call with exactly
+      the same arguments (possibly by another process). If it is found,
+      it is mapped read-only and the vectors of pHIS point into the
+      mapping, so that processes on the same node share the pages. If
+      not, the HIS is computed and written to the cache: the file is
+      first written under a temporary name and then renamed, so that
+      other processes never see it incomplete. Failing to write the
+      cache is not an error. With an empty cache_directory, this is
+      just hyperspherical_HIS_create(). */
+  struct hyperspherical_cache_header header, *pheader;
+  char filename[_FILENAMESIZE_+64], tmpname[_FILENAMESIZE_+96];
+  unsigned long long hash;
+  unsigned char *byte;
+  size_t data_size, file_size, index_byte;
+  struct stat file_stat;
+  void *mapping;
+  FILE *cache_file;
+  int fd, nx, found, written, index_write;
+
+  if (cache_directory[0] == '\0') {
+    class_call(hyperspherical_HIS_create(K,beta,nl,lvec,xmin,xmax,sampling,
+                                         l_WKB,phiminabs,pHIS,error_message),
+               error_message,
+               error_message);
+    return _SUCCESS_;
+  }
+
+  /** - the header contains everything that determines the HIS, except
+      the list of l values: hash both to get the name of the file */
+  memset(&header,0,sizeof(struct hyperspherical_cache_header));
+  memcpy(header.magic,"CLASSHIS",8);
+  header.format_version = _HIS_CACHE_VERSION_;
+  header.K = K;
+  header.l_size = nl;
+  header.l_WKB = l_WKB;
+  header.beta = beta;
+  header.xmin = xmin;
+  header.xmax = xmax;
+  header.sampling = sampling;
+  header.phiminabs = phiminabs;
+
+  hash = 14695981039346656037ULL;
+  byte = (unsigned char *) &header;
+  for (index_byte=0; index_byte<sizeof(struct hyperspherical_cache_header); index_byte++){
+    hash ^= byte[index_byte];
+    hash *= 1099511628211ULL;
+  }
+  byte = (unsigned char *) lvec;
+  for (index_byte=0; index_byte<nl*sizeof(int); index_byte++){
+    hash ^= byte[index_byte];
+    hash *= 1099511628211ULL;
+  }
+  sprintf(filename,"%s/his_%016llx.dat",cache_directory,hash);
+
+  /** - try to map an existing file, and check that it matches the request */
+  found = _FALSE_;
+  fd = open(filename,O_RDONLY);
+  if (fd >= 0){
+    if ((fstat(fd,&file_stat) == 0) &&
+        (file_stat.st_size > (off_t)sizeof(struct hyperspherical_cache_header))){
+      file_size = file_stat.st_size;
+      mapping = mmap(NULL,file_size,PROT_READ,MAP_SHARED,fd,0);
+      if (mapping != MAP_FAILED){
+        pheader = (struct hyperspherical_cache_header *) mapping;
+        if ((memcmp(pheader->magic,header.magic,8) == 0) &&
+            (pheader->format_version == header.format_version) &&
+            (pheader->K == K) && (pheader->l_size == nl) && (pheader->l_WKB == l_WKB) &&
+            (pheader->beta == beta) && (pheader->xmin == xmin) && (pheader->xmax == xmax) &&
+            (pheader->sampling == sampling) && (pheader->phiminabs == phiminabs) &&
+            (file_size == sizeof(struct hyperspherical_cache_header)+
+             hyperspherical_HIS_size(nl,pheader->x_size)) &&
+            (memcmp((char *)mapping+sizeof(struct hyperspherical_cache_header),lvec,nl*sizeof(int)) == 0)){
+          pHIS->K = K;
+          pHIS->beta = beta;
+          pHIS->delta_x = pheader->delta_x;
+          pHIS->trig_order = pheader->trig_order;
+          pHIS->l_size = nl;
+          pHIS->x_size = pheader->x_size;
+          hyperspherical_update_pointers(pHIS,(char *)mapping+sizeof(struct hyperspherical_cache_header));
+          pHIS->mapping = mapping;
+          pHIS->mapping_size = file_size;
+          found = _TRUE_;
+        }
+        else{
+          munmap(mapping,file_size);
+        }
+      }
+    }
+    close(fd);
+  }
+
+  if (found == _TRUE_)
+    return _SUCCESS_;
+
+  /** - otherwise compute the HIS and store it */
+  class_call(hyperspherical_HIS_create(K,beta,nl,lvec,xmin,xmax,sampling,
+                                       l_WKB,phiminabs,pHIS,error_message),
+             error_message,
+             error_message);
+
+  nx = pHIS->x_size;
+  header.x_size = nx;
+  header.trig_order = pHIS->trig_order;
+  header.delta_x = pHIS->delta_x;
+  data_size = sizeof(double)*nx;
+
+#pragma omp critical (hyperspherical_cache_writes)
+  index_write = hyperspherical_cache_writes++;
+
+  sprintf(tmpname,"%s.%d.%d.tmp",filename,(int)getpid(),index_write);
+  cache_file = fopen(tmpname,"wb");
+  if (cache_file != NULL){
+    written = ((fwrite(&header,sizeof(struct hyperspherical_cache_header),1,cache_file) == 1) &&
+         (fwrite(pHIS->l,sizeof(int),nl,cache_file) == nl) &&
+         (fwrite(pHIS->chi_at_phimin,sizeof(double),nl,cache_file) == nl) &&
+         (fwrite(pHIS->x,data_size,1,cache_file) == 1) &&
+         (fwrite(pHIS->sinK,data_size,1,cache_file) == 1) &&
+         (fwrite(pHIS->cotK,data_size,1,cache_file) == 1) &&
+         (fwrite(pHIS->phi,data_size,nl,cache_file) == nl) &&
+         (fwrite(pHIS->dphi,data_size,nl,cache_file) == nl));
+    if ((fclose(cache_file) != 0) || (written == _FALSE_) || (rename(tmpname,filename) != 0))
+      remove(tmpname);
+  }
+
+  return _SUCCESS_;
+}
+
+int hyperspherical_HIS_first_touch(HyperInterpStruct *pHIS,
+                                   int policy,
+                                   ErrorMsg error_message){
+  /** Move the tables phi and dphi of a HIS filled by fewer threads than
+      those which will use it (e.g. while other modules were running)
+      to new pages placed on the NUMA nodes of the current threads,
+      following policy (see enum first_touch_policy): with ft_block,
+      each thread gets a contiguous range of multipoles. Tables mapped
+      from a cache file are left in place. */
+  double *phi, *dphi;
+  size_t size;
+
+#ifdef _OPENMP
+  if ((policy == ft_none) || (pHIS->mapping != NULL) || (omp_get_max_threads() == 1))
+    return _SUCCESS_;
+#else
+  return _SUCCESS_;
+#endif
+
+  size = sizeof(double)*pHIS->x_size*pHIS->l_size;
+  class_alloc(phi,size,error_message);
+  class_alloc(dphi,size,error_message);
+  class_first_touch(phi,1,size,policy);
+  class_first_touch(dphi,1,size,policy);
+  memcpy(phi,pHIS->phi,size);
+  memcpy(dphi,pHIS->dphi,size);
+  free(pHIS->phi);
+  free(pHIS->dphi);
+  pHIS->phi = phi;
+  pHIS->dphi = dphi;
+
+  return _SUCCESS_;
+}
+
 size_t hyperspherical_HIS_size(int nl, int nx){
   return(sizeof(int)*nl+sizeof(double)*nl+3*sizeof(double)*nx+2*sizeof(double)*nx*nl);
 }
@@ -269,6 +449,11 @@ int hyperspherical_update_pointers(HyperInterpStruct *pHIS_local,
 int hyperspherical_HIS_free(HyperInterpStruct *pHIS,
                             ErrorMsg error_message){
   /** Free the Hyperspherical Interpolation Structure. */
+  if (pHIS->mapping != NULL){
+    munmap(pHIS->mapping,pHIS->mapping_size);
+    pHIS->mapping = NULL;
+    return _SUCCESS_;
+  }
   free(pHIS->l);
   free(pHIS->chi_at_phimin);
   free(pHIS->x);
@@ -280,6 +465,121 @@ int hyperspherical_HIS_free(HyperInterpStruct *pHIS,
   return _SUCCESS_;
 }
 
+#ifdef CLASS_OFFLOAD
+/* free a copy of HIS tables on the offload device, and its host part */
+static void hyperspherical_device_free(HyperDeviceTables *pdev){
+  if (pdev == NULL)
+    return;
+  if (pdev->phi != NULL)
+    omp_target_free(pdev->phi,pdev->device);
+  if (pdev->dphi != NULL)
+    omp_target_free(pdev->dphi,pdev->device);
+  free(pdev->l);
+  free(pdev);
+}
+#endif
+
+int hyperspherical_HIS_device_get(HyperInterpStruct *pHIS,
+                                  HyperDeviceTables **ppdev,
+                                  ErrorMsg error_message){
+  /** Return in *ppdev a copy of the tables phi and dphi of pHIS in the
+      memory of the default offload device (NULL if the code is compiled
+      without -DCLASS_OFFLOAD). A copy made for a HIS with the same
+      parameters and multipoles, e.g. the flat Bessel functions of a
+      previous run with the same precision settings, is reused instead
+      of being sent again. Each call must be followed by one call to
+      hyperspherical_HIS_device_release(). */
+#ifdef CLASS_OFFLOAD
+  HyperDeviceTables *pdev;
+  size_t size;
+  int status = _SUCCESS_;
+
+  size = sizeof(double)*pHIS->x_size*pHIS->l_size;
+
+#pragma omp critical (hyperspherical_device)
+  {
+    for (pdev = hyperspherical_device_list; pdev != NULL; pdev = pdev->next) {
+      if ((pdev->K == pHIS->K) && (pdev->beta == pHIS->beta) &&
+          (pdev->xmin == pHIS->x[0]) && (pdev->delta_x == pHIS->delta_x) &&
+          (pdev->l_size == pHIS->l_size) && (pdev->x_size == pHIS->x_size) &&
+          (memcmp(pdev->l,pHIS->l,sizeof(int)*pHIS->l_size) == 0))
+        break;
+    }
+
+    if (pdev == NULL) {
+      pdev = (HyperDeviceTables *)calloc(1,sizeof(HyperDeviceTables));
+      if (pdev != NULL) {
+        pdev->K = pHIS->K;
+        pdev->beta = pHIS->beta;
+        pdev->xmin = pHIS->x[0];
+        pdev->delta_x = pHIS->delta_x;
+        pdev->l_size = pHIS->l_size;
+        pdev->x_size = pHIS->x_size;
+        pdev->device = omp_get_default_device();
+        pdev->l = (int *)malloc(sizeof(int)*pHIS->l_size);
+        pdev->phi = (double *)omp_target_alloc(size,pdev->device);
+        pdev->dphi = (double *)omp_target_alloc(size,pdev->device);
+      }
+      if ((pdev == NULL) || (pdev->l == NULL) || (pdev->phi == NULL) || (pdev->dphi == NULL) ||
+          (omp_target_memcpy(pdev->phi,pHIS->phi,size,0,0,pdev->device,omp_get_initial_device()) != 0) ||
+          (omp_target_memcpy(pdev->dphi,pHIS->dphi,size,0,0,pdev->device,omp_get_initial_device()) != 0)) {
+        hyperspherical_device_free(pdev);
+        pdev = NULL;
+        status = _FAILURE_;
+      }
+      else {
+        memcpy(pdev->l,pHIS->l,sizeof(int)*pHIS->l_size);
+        pdev->next = hyperspherical_device_list;
+        hyperspherical_device_list = pdev;
+      }
+    }
+
+    if (pdev != NULL)
+      pdev->users++;
+  }
+
+  class_test(status == _FAILURE_,
+             error_message,
+             "could not copy the hyperspherical Bessel functions (%zu bytes) to the offload device",2*size);
+
+  *ppdev = pdev;
+#else
+  *ppdev = NULL;
+#endif
+
+  return _SUCCESS_;
+}
+
+int hyperspherical_HIS_device_release(HyperDeviceTables *pdev){
+  /** Release a copy returned by hyperspherical_HIS_device_get(). The
+      other copies which are no longer used are freed, so that only the
+      last one stays on the device until the next run. */
+#ifdef CLASS_OFFLOAD
+  HyperDeviceTables **ppnext, *pother;
+
+  if (pdev == NULL)
+    return _SUCCESS_;
+
+#pragma omp critical (hyperspherical_device)
+  {
+    pdev->users--;
+    ppnext = &hyperspherical_device_list;
+    while (*ppnext != NULL) {
+      pother = *ppnext;
+      if ((pother != pdev) && (pother->users == 0)) {
+        *ppnext = pother->next;
+        hyperspherical_device_free(pother);
+      }
+      else {
+        ppnext = &(pother->next);
+      }
+    }
+  }
+#endif
+
+  return _SUCCESS_;
+}
+
 int hyperspherical_Hermite_interpolation_vector(HyperInterpStruct *pHIS,
                                                 int nxi,
                                                 int lnum,
@@ -486,6 +786,12 @@ int hyperspherical_forwards_recurrence(int K,
   return _SUCCESS_;
 }
 
+/**
+ * Forwards recurrence for a chunk of x values, stored as
+ * PhiL[l*chunk+index_x]: each step in l is a loop over x, vectorised and
+ * compiled for several instruction sets (see _TARGET_CLONES_).
+ */
+_TARGET_CLONES_
 int hyperspherical_forwards_recurrence_chunk(int K,
                                              int lmax,
                                              double beta,
@@ -498,16 +804,20 @@ int hyperspherical_forwards_recurrence_chunk(int K,
                                              double * __restrict__ PhiL){
   int l;
   int index_x;
+  double a,b;
   for (index_x=0; index_x<chunk; index_x++){
     PhiL[index_x] = 1.0/beta*sin(beta*x[index_x])/sinK[index_x];
     PhiL[chunk+index_x] = PhiL[index_x]*
       (cotK[index_x]-beta/tan(beta*x[index_x]))*one_over_sqrtK[1];
   }
   for (l=2; l<=lmax; l++){
+    a = (2*l-1)*one_over_sqrtK[l];
+    b = sqrtK[l-1]*one_over_sqrtK[l];
+#pragma omp simd
     for (index_x=0; index_x<chunk; index_x++)
       PhiL[l*chunk+index_x] =
-        ((2*l-1)*cotK[index_x]*PhiL[(l-1)*chunk+index_x]-
-         PhiL[(l-2)*chunk+index_x]*sqrtK[l-1])*one_over_sqrtK[l];
+        a*cotK[index_x]*PhiL[(l-1)*chunk+index_x]-
+        b*PhiL[(l-2)*chunk+index_x];
   }
   return _SUCCESS_;
 }
@@ -601,6 +911,15 @@ int hyperspherical_backwards_recurrence(int K,
   return _SUCCESS_;
 }
 
+/**
+ * Backwards recurrence for a chunk of x values, stored as
+ * PhiL[l*chunk+index_x]. The starting ratio Phi_{lmax-1}/Phi_lmax is found
+ * for each x by continued fractions, then each step in l is a loop over x,
+ * vectorised and compiled for several instruction sets (see
+ * _TARGET_CLONES_). Values growing beyond _HYPER_OVERFLOW_ are rescaled for
+ * each x separately, before the final normalisation to Phi_0.
+ */
+_TARGET_CLONES_
 int hyperspherical_backwards_recurrence_chunk(int K,
                                               int lmax,
                                               double beta,
@@ -612,12 +931,14 @@ int hyperspherical_backwards_recurrence_chunk(int K,
                                               double * __restrict__ one_over_sqrtK,
                                               double * __restrict__ PhiL){
   double phi0, phi1, phipr1;
+  double a, b, phimax;
   int l, k, isign;
-  int funcreturn = _FAILURE_;
+  int funcreturn;
   int index_x;
   double scalevec[_HYPER_CHUNK_]={0};
 
   for (index_x=0; index_x<chunk; index_x++){
+    funcreturn = _FAILURE_;
     if (K==1){
       if (beta > 1.5*lmax) {
         funcreturn = get_CF1(K,lmax,beta,cotK[index_x], &phipr1, &isign);
@@ -640,19 +961,26 @@ int hyperspherical_backwards_recurrence_chunk(int K,
   }
   for (l=lmax-2; l>=0; l--){
     //Use recurrence Phi_{l} = --Phi_{l+1} + -- Phi_{l+2}
+    a = (2*l+3)*one_over_sqrtK[l+1];
+    b = sqrtK[l+2]*one_over_sqrtK[l+1];
+    phimax = 0.;
+#pragma omp simd reduction(max:phimax)
     for (index_x=0; index_x<chunk; index_x++){
-      PhiL[l*chunk+index_x] = one_over_sqrtK[l+1]*
-        ((2*l+3)*cotK[index_x]*PhiL[(l+1)*chunk+index_x]-
-         sqrtK[l+2]*PhiL[(l+2)*chunk+index_x]);
+      PhiL[l*chunk+index_x] =
+        a*cotK[index_x]*PhiL[(l+1)*chunk+index_x]-
+        b*PhiL[(l+2)*chunk+index_x];
+      phimax = MAX(phimax,fabs(PhiL[l*chunk+index_x]));
     }
 
-    if (fabs(PhiL[l*chunk])>_HYPER_OVERFLOW_){
-      //Rescale whole Phi vector until this point.
+    if (phimax>_HYPER_OVERFLOW_){
+      //Rescale whole Phi vector until this point, for the x values
+      //where it is large only (scaling up the others could overflow them).
       //Create scale vector:
       for (index_x=0; index_x<chunk; index_x++)
-        scalevec[index_x] = fabs(1.0/PhiL[l*chunk+index_x]);
+        scalevec[index_x] = (fabs(PhiL[l*chunk+index_x]) > 1.) ? fabs(1.0/PhiL[l*chunk+index_x]) : 1.;
       //Now do the scaling: (We do it this way to access elements in order)
       for (k=l; k<=lmax; k++){
+#pragma omp simd
         for (index_x=0; index_x<chunk; index_x++){
           PhiL[k*chunk+index_x] *= scalevec[index_x];
         }
@@ -664,6 +992,7 @@ int hyperspherical_backwards_recurrence_chunk(int K,
     scalevec[index_x] = phi0/PhiL[index_x];
   }
   for (k=0; k<=lmax; k++){
+#pragma omp simd
     for (index_x=0; index_x<chunk; index_x++){
       PhiL[k*chunk+index_x] *= scalevec[index_x];
     }
@@ -1572,6 +1901,200 @@ int hyperspherical_Hermite4_interpolation_vector_Phi(HyperInterpStruct *pHIS,
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+
+_TARGET_CLONES_
+int hyperspherical_Hermite4_convolution_Phi(HyperInterpStruct *pHIS,
+                                            int nxi,
+                                            int lnum,
+                                            double * __restrict__ xinterp,
+                                            double * __restrict__ f,
+                                            double * __restrict__ w,
+                                            double *result) {
+  /** Fused order-4 Hermite interpolation of Phi and weighted sum:
+      result = sum_j f[j] w[j] Phi(xinterp[j]). Unlike
+      hyperspherical_Hermite4_interpolation_vector_Phi(), the interpolation
+      coefficients are recomputed at each point instead of being carried
+      over from the previous one, so that the loop has no dependency and
+      is vectorised (with gathers from the table) even though the code is
+      compiled with -fno-tree-vectorize. The left node is recomputed as
+      xmin+(idx-1)*deltax, exactly as in hyperspherical_HIS_create(),
+      rather than gathered. Points outside the table
+      contribute zero. The periodicity of the closed case is not handled:
+      this kernel is meant for K=0 and K=-1. */
+  int nx = pHIS->x_size;
+  double *xvec = pHIS->x;
+  double *Phi_l = pHIS->phi+lnum*nx;
+  double *dPhi_l = pHIS->dphi+lnum*nx;
+  double deltax = pHIS->delta_x;
+  double one_over_deltax = 1.0/deltax;
+  double xmin = xvec[0];
+  double xmax = xvec[nx-1];
+  double x, z, z2, ym, yp, dym, dyp, a0, a1, a2, Phi;
+  double sum = 0.0;
+  int j, idx;
+
+#pragma omp simd private(x,z,z2,ym,yp,dym,dyp,a0,a1,a2,Phi,idx) reduction(+:sum)
+  for (j=0; j<nxi; j++){
+    x = xinterp[j];
+    idx = ((int) ((x-xmin)*one_over_deltax))+1;
+    idx = MAX(1,idx);
+    idx = MIN(nx-1,idx);
+    ym = Phi_l[idx-1];
+    yp = Phi_l[idx];
+    dym = dPhi_l[idx-1]*deltax;
+    dyp = dPhi_l[idx]*deltax;
+    a0 = dym;
+    a1 = -2*dym-dyp-3*ym+3*yp;
+    a2 = dym+dyp+2*ym-2*yp;
+    z = (x-(xmin+(idx-1)*deltax))*one_over_deltax;
+    z2 = z*z;
+    Phi = ym+a0*z+a1*z2+a2*z2*z;
+    sum += ((x >= xmin) && (x <= xmax)) ? f[j]*w[j]*Phi : 0.0;
+  }
+
+  *result = sum;
+
+  return _SUCCESS_;
+}
+
+_TARGET_CLONES_
+int hyperspherical_Hermite4_convolution_Phi_block(HyperInterpStruct *pHIS,
+                                                  int lnum,
+                                                  int l_count,
+                                                  int *nxi,
+                                                  double * __restrict__ xinterp,
+                                                  double * __restrict__ f,
+                                                  double * __restrict__ w,
+                                                  double *result) {
+  /** Same as hyperspherical_Hermite4_convolution_Phi() for the l_count
+      consecutive rows lnum, lnum+1,... of the table, convolved with the
+      same f and w at the same points: result[k] = sum_{j<nxi[k]} f[j]
+      w[j] Phi_{lnum+k}(xinterp[j]). The interval of each point and the
+      four Hermite basis polynomials (weighted by f[j] w[j]) do not depend
+      on l: they are computed once per chunk of _HYPER_CONVOLUTION_CHUNK_
+      points, and each multipole then only costs four gathers and four
+      products per point. */
+  int nx = pHIS->x_size;
+  double *xvec = pHIS->x;
+  double *Phi_l, *dPhi_l;
+  double deltax = pHIS->delta_x;
+  double one_over_deltax = 1.0/deltax;
+  double xmin = xvec[0];
+  double xmax = xvec[nx-1];
+  int index[_HYPER_CONVOLUTION_CHUNK_];
+  double hm[_HYPER_CONVOLUTION_CHUNK_], hp[_HYPER_CONVOLUTION_CHUNK_];
+  double dhm[_HYPER_CONVOLUTION_CHUNK_], dhp[_HYPER_CONVOLUTION_CHUNK_];
+  double x, z, z2, z3, fw, sum;
+  int j, j_start, j_size, k, n, idx, nxi_max=0;
+
+  for (k=0; k<l_count; k++){
+    result[k] = 0.0;
+    nxi_max = MAX(nxi_max,nxi[k]);
+  }
+
+  for (j_start=0; j_start<nxi_max; j_start+=_HYPER_CONVOLUTION_CHUNK_){
+    j_size = MIN(_HYPER_CONVOLUTION_CHUNK_,nxi_max-j_start);
+
+#pragma omp simd private(x,z,z2,z3,fw,idx)
+    for (j=0; j<j_size; j++){
+      x = xinterp[j_start+j];
+      idx = ((int) ((x-xmin)*one_over_deltax))+1;
+      idx = MAX(1,idx);
+      idx = MIN(nx-1,idx);
+      z = (x-(xmin+(idx-1)*deltax))*one_over_deltax;
+      z2 = z*z;
+      z3 = z2*z;
+      fw = ((x >= xmin) && (x <= xmax)) ? f[j_start+j]*w[j_start+j] : 0.0;
+      index[j] = idx;
+      hm[j] = fw*(1.0-3.0*z2+2.0*z3);
+      hp[j] = fw*(3.0*z2-2.0*z3);
+      dhm[j] = fw*deltax*(z-2.0*z2+z3);
+      dhp[j] = fw*deltax*(z3-z2);
+    }
+
+    for (k=0; k<l_count; k++){
+      n = MIN(nxi[k]-j_start,j_size);
+      if (n <= 0)
+        continue;
+      Phi_l = pHIS->phi+(lnum+k)*nx;
+      dPhi_l = pHIS->dphi+(lnum+k)*nx;
+      sum = 0.0;
+#pragma omp simd reduction(+:sum)
+      for (j=0; j<n; j++){
+        sum += hm[j]*Phi_l[index[j]-1]+hp[j]*Phi_l[index[j]]+
+          dhm[j]*dPhi_l[index[j]-1]+dhp[j]*dPhi_l[index[j]];
+      }
+      result[k] += sum;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+int hyperspherical_Hermite4_convolution_Phi_block_device(HyperInterpStruct *pHIS,
+                                                         HyperDeviceTables *pdev,
+                                                         int lnum,
+                                                         int l_count,
+                                                         int *nxi,
+                                                         double *xinterp,
+                                                         double *f,
+                                                         double *w,
+                                                         double *result,
+                                                         ErrorMsg error_message) {
+  /** Same as hyperspherical_Hermite4_convolution_Phi_block(), computed
+      on the offload device holding pdev (see
+      hyperspherical_HIS_device_get()): one team per multipole, whose
+      threads share the points. The Hermite basis polynomials are
+      computed again for each multipole, which is cheaper on a device
+      than storing them, and the sums are done in a different order: the
+      results agree with those of the host version up to rounding. */
+#ifdef CLASS_OFFLOAD
+  int nx = pHIS->x_size;
+  double deltax = pHIS->delta_x;
+  double one_over_deltax = 1.0/deltax;
+  double xmin = pHIS->x[0];
+  double xmax = pHIS->x[nx-1];
+  double *phi = pdev->phi;
+  double *dphi = pdev->dphi;
+  double x, z, z2, z3, fw, sum;
+  int j, k, idx, nxi_max=0;
+
+  for (k=0; k<l_count; k++){
+    result[k] = 0.0;
+    nxi_max = MAX(nxi_max,nxi[k]);
+  }
+
+  if (nxi_max <= 0)
+    return _SUCCESS_;
+
+#pragma omp target teams distribute device(pdev->device) is_device_ptr(phi,dphi) \
+  map(to:nxi[0:l_count],xinterp[0:nxi_max],f[0:nxi_max],w[0:nxi_max])           \
+  map(from:result[0:l_count]) private(sum)
+  for (k=0; k<l_count; k++){
+    sum = 0.0;
+#pragma omp parallel for private(x,z,z2,z3,fw,idx) reduction(+:sum)
+    for (j=0; j<nxi[k]; j++){
+      x = xinterp[j];
+      idx = ((int) ((x-xmin)*one_over_deltax))+1;
+      idx = MAX(1,idx);
+      idx = MIN(nx-1,idx);
+      z = (x-(xmin+(idx-1)*deltax))*one_over_deltax;
+      z2 = z*z;
+      z3 = z2*z;
+      fw = ((x >= xmin) && (x <= xmax)) ? f[j]*w[j] : 0.0;
+      sum += fw*(1.0-3.0*z2+2.0*z3)*phi[(lnum+k)*nx+idx-1]+fw*(3.0*z2-2.0*z3)*phi[(lnum+k)*nx+idx]+
+        fw*deltax*(z-2.0*z2+z3)*dphi[(lnum+k)*nx+idx-1]+fw*deltax*(z3-z2)*dphi[(lnum+k)*nx+idx];
+    }
+    result[k] = sum;
+  }
+#else
+  class_stop(error_message,
+             "the code was compiled without -DCLASS_OFFLOAD (option OFFLOAD of the Makefile)");
+#endif
+
+  return _SUCCESS_;
+}
+
 int hyperspherical_Hermite4_interpolation_vector_dPhi(HyperInterpStruct *pHIS,
                                                       int nxi,
                                                       int lnum,
@@ -43,6 +43,10 @@ int parser_read_file(
 
   fclose(inputfile);
 
+  class_call(parser_index(pfc,errmsg),
+	     errmsg,
+	     errmsg);
+
   return _SUCCESS_;
 
 }
@@ -54,6 +58,11 @@ int parser_init(
 		ErrorMsg errmsg
 		) {
 
+  pfc->index_entries=0;
+  pfc->index_size=0;
+  pfc->index=NULL;
+  pfc->next=NULL;
+
   if (size > 0) {
     pfc->size=size;
     class_alloc(pfc->filename,(strlen(filename)+1)*sizeof(char),errmsg);
@@ -75,11 +84,146 @@ int parser_free(
     free(pfc->value);
     free(pfc->read);
     free(pfc->filename);
+    if (pfc->index != NULL) {
+      free(pfc->index);
+      free(pfc->next);
+      pfc->index = NULL;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Build the hash index of the names in a file_content structure: a
+ * table of slots (twice as many as entries, rounded to a power of two)
+ * giving the position of the first entry with a given name, with open
+ * addressing, and for each entry the position of the next one with the
+ * same name (used to detect multiple entries). It is called at the end
+ * of parser_read_file() and parser_cat(), and otherwise by
+ * parser_find() the first time a parameter is searched, since callers
+ * of parser_init() fill the names themselves. It is rebuilt whenever
+ * pfc->size differs from the number of entries indexed.
+ *
+ * @param pfc    Input/Output: file content structure
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int parser_index(
+		 struct file_content * pfc,
+		 ErrorMsg errmsg
+		 ) {
+
+  int i,slot,index_size;
+
+  if (pfc->index != NULL) {
+    free(pfc->index);
+    free(pfc->next);
+    pfc->index = NULL;
+  }
+
+  pfc->index_entries = pfc->size;
+  pfc->index_size = 0;
+
+  if (pfc->size <= 0)
+    return _SUCCESS_;
+
+  index_size = 1;
+  while (index_size < 2*pfc->size)
+    index_size *= 2;
+
+  class_alloc(pfc->index,index_size*sizeof(int),errmsg);
+  class_alloc(pfc->next,pfc->size*sizeof(int),errmsg);
+  pfc->index_size = index_size;
+
+  for (slot=0; slot<index_size; slot++)
+    pfc->index[slot] = -1;
+
+  /* insert from the end, so that the slot keeps the first occurrence
+     and next[] points to the following one */
+
+  for (i=pfc->size-1; i>=0; i--) {
+    pfc->next[i] = -1;
+    slot = parser_hash(pfc->name[i]) & (index_size-1);
+    while (pfc->index[slot] != -1) {
+      if (strcmp(pfc->name[pfc->index[slot]],pfc->name[i]) == 0) {
+        pfc->next[i] = pfc->index[slot];
+        break;
+      }
+      slot = (slot+1) & (index_size-1);
+    }
+    pfc->index[slot] = i;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the position of the first entry with a given name, using (and
+ * if needed building) the hash index.
+ *
+ * @param pfc    Input/Output: file content structure
+ * @param name   Input: name of the parameter
+ * @param index  Output: position of the entry, or pfc->size if absent
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int parser_find(
+		struct file_content * pfc,
+		char * name,
+		int * index,
+		ErrorMsg errmsg
+		) {
+
+  int slot;
+
+  *index = pfc->size;
+
+  if (pfc->size <= 0)
+    return _SUCCESS_;
+
+  if ((pfc->index == NULL) || (pfc->index_entries != pfc->size)) {
+    class_call(parser_index(pfc,errmsg),
+	       errmsg,
+	       errmsg);
+  }
+
+  slot = parser_hash(name) & (pfc->index_size-1);
+  while (pfc->index[slot] != -1) {
+    if (strcmp(pfc->name[pfc->index[slot]],name) == 0) {
+      *index = pfc->index[slot];
+      break;
+    }
+    slot = (slot+1) & (pfc->index_size-1);
   }
 
   return _SUCCESS_;
 }
 
+/**
+ * FNV-1a hash of a null-terminated string.
+ *
+ * @param string Input: string
+ * @return the hash
+ */
+
+unsigned int parser_hash(
+			 char * string
+			 ) {
+
+  unsigned int hash = 2166136261u;
+
+  while (*string != '\0') {
+    hash ^= (unsigned char)(*string);
+    hash *= 16777619u;
+    string++;
+  }
+
+  return hash;
+}
+
 int parser_read_line(
 		     char * line,
 		     int * is_data,
@@ -163,7 +307,6 @@ int parser_read_int(
 		    ErrorMsg errmsg
 		    ) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -171,9 +314,9 @@ int parser_read_int(
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -195,11 +338,9 @@ int parser_read_int(
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-	       errmsg,
-	       "multiple entry of parameter %s in file %s\n",name,pfc->filename);
-  }
+  class_test(pfc->next[index] != -1,
+	     errmsg,
+	     "multiple entry of parameter %s in file %s\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -215,7 +356,6 @@ int parser_read_double(
 		       ErrorMsg errmsg
 		       ) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -223,9 +363,9 @@ int parser_read_double(
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -247,11 +387,9 @@ int parser_read_double(
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-	       errmsg,
-	       "multiple entry of parameter %s in file %s\n",name,pfc->filename);
-  }
+  class_test(pfc->next[index] != -1,
+	     errmsg,
+	     "multiple entry of parameter %s in file %s\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -268,7 +406,6 @@ int parser_read_double_and_position(
 		       ErrorMsg errmsg
 		       ) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -276,9 +413,9 @@ int parser_read_double_and_position(
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -300,11 +437,9 @@ int parser_read_double_and_position(
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-	       errmsg,
-	       "multiple entry of parameter %s in file %s\n",name,pfc->filename);
-  }
+  class_test(pfc->next[index] != -1,
+	     errmsg,
+	     "multiple entry of parameter %s in file %s\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -322,7 +457,6 @@ int parser_read_string(
 		       ErrorMsg errmsg
 		       ) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -330,9 +464,9 @@ int parser_read_string(
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -352,11 +486,9 @@ int parser_read_string(
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-	       errmsg,
-	       "multiple entry of parameter %s in file %s\n",name,pfc->filename);
-  }
+  class_test(pfc->next[index] != -1,
+	     errmsg,
+	     "multiple entry of parameter %s in file %s\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -387,9 +519,9 @@ int parser_read_list_of_doubles(
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -442,11 +574,9 @@ int parser_read_list_of_doubles(
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-	       errmsg,
-	       "multiple entry of parameter %s in file %s\n",name,pfc->filename);
-  }
+  class_test(pfc->next[index] != -1,
+	     errmsg,
+	     "multiple entry of parameter %s in file %s\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -477,9 +607,9 @@ int parser_read_list_of_integers(
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -532,11 +662,9 @@ int parser_read_list_of_integers(
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-	       errmsg,
-	       "multiple entry of parameter %s in file %s\n",name,pfc->filename);
-  }
+  class_test(pfc->next[index] != -1,
+	     errmsg,
+	     "multiple entry of parameter %s in file %s\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -567,9 +695,9 @@ int parser_read_list_of_strings(
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -616,11 +744,9 @@ int parser_read_list_of_strings(
   /* check for multiple entries of the same parameter. If another occurence is
      found,
      return an error. */
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-	       errmsg,
-	       "multiple entry of parameter %s in file %s\n",name,pfc->filename);
-  }
+  class_test(pfc->next[index] != -1,
+	     errmsg,
+	     "multiple entry of parameter %s in file %s\n",name,pfc->filename);
   /* if everything proceeded normally, return with 'found' flag equal to true */
   return _SUCCESS_;
 }
@@ -672,6 +798,11 @@ int parser_cat(
     pfc3->read[i+pfc1->size]=pfc2->read[i];
   }
 
+  pfc3->index = NULL;
+  class_call(parser_index(pfc3,errmsg),
+	     errmsg,
+	     errmsg);
+
   return _SUCCESS_;
 
 }
@@ -0,0 +1,261 @@
+/** @file shared_table.c Documented tables shared between processes
+ *
+ * Tables which depend only on precision parameters (quadrature rules,
+ * Wigner d-functions, HyRec rates, ...) are identical in all the
+ * processes running on a node, e.g. for many Markov chains. With
+ * shared_table_get(), the first process needing a table builds it and
+ * writes it to a cache directory (ideally on a memory file system
+ * like /dev/shm); all processes then map this file read-only, so that
+ * the node holds a single copy of the table.
+ */
+
+#include "shared_table.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** number of files written by this process, for unique temporary names */
+
+static int shared_table_writes = 0;
+
+/**
+ * Size in bytes of the part of a cache file preceding the table: the
+ * header and the key, padded to a multiple of 8 bytes.
+ */
+
+static size_t shared_table_offset(size_t key_size) {
+  return sizeof(struct shared_table_header) + 8*((key_size+7)/8);
+}
+
+/**
+ * Try to map read-only the cache file filename, and check that it
+ * contains the table described by header and key.
+ *
+ * @param filename Input: name of the cache file
+ * @param header   Input: expected header
+ * @param key      Input: expected key
+ * @param table    Output: the mapped table, if found
+ * @return _TRUE_ if the table was found and mapped, _FALSE_ otherwise
+ */
+
+static int shared_table_map(
+                            char * filename,
+                            struct shared_table_header * header,
+                            void * key,
+                            struct shared_table * table
+                            ) {
+
+  struct stat file_stat;
+  size_t offset,file_size;
+  void * mapping;
+  int fd,found;
+
+  offset = shared_table_offset(header->key_size);
+  file_size = offset + header->data_size*sizeof(double);
+
+  found = _FALSE_;
+  fd = open(filename,O_RDONLY);
+  if (fd < 0)
+    return _FALSE_;
+
+  if ((fstat(fd,&file_stat) == 0) && ((size_t)file_stat.st_size == file_size)) {
+    mapping = mmap(NULL,file_size,PROT_READ,MAP_SHARED,fd,0);
+    if (mapping != MAP_FAILED) {
+      if ((memcmp(mapping,header,sizeof(struct shared_table_header)) == 0) &&
+          (memcmp((char *)mapping+sizeof(struct shared_table_header),key,header->key_size) == 0)) {
+        table->data = (double *)((char *)mapping+offset);
+        table->data_size = header->data_size;
+        table->mapping = mapping;
+        table->mapping_size = file_size;
+        found = _TRUE_;
+      }
+      else {
+        munmap(mapping,file_size);
+      }
+    }
+  }
+  close(fd);
+
+  return found;
+}
+
+/**
+ * Get a table of data_size doubles depending only on key, from the
+ * cache directory when another process (or a previous run) already
+ * wrote it there, or else by calling build() and writing the result
+ * there.
+ *
+ * The file name contains kind and a FNV-1a hash of the key; the file
+ * also contains the full key, which must match. While a process
+ * builds a table, it holds an exclusive lock (flock) on a companion
+ * lock file, so that the processes asking for the same table at the
+ * same time wait for it instead of building it too. The table is
+ * written under a temporary name and renamed, so that a partial file
+ * is never seen. Failing to lock, write or map the file is not an
+ * error: the table is then simply kept in the memory of this process.
+ * With an empty directory, this is just an allocation followed by
+ * build().
+ *
+ * @param directory Input: cache directory (may be empty)
+ * @param kind      Input: short name of the kind of table (less than 16 characters)
+ * @param key       Input: all the parameters on which the table depends (compared bytewise: padding bytes must be zeroed)
+ * @param key_size  Input: size in bytes of the key
+ * @param data_size Input: number of doubles in the table
+ * @param build     Input: function filling the table
+ * @param context   Input: argument passed to build()
+ * @param table     Output: table, to be released with shared_table_free()
+ * @param errmsg    Output: error message
+ * @return the error status
+ */
+
+int shared_table_get(
+                     char * directory,
+                     char * kind,
+                     void * key,
+                     size_t key_size,
+                     size_t data_size,
+                     shared_table_builder build,
+                     void * context,
+                     struct shared_table * table,
+                     ErrorMsg errmsg
+                     ) {
+
+  struct shared_table_header header;
+  char filename[_FILENAMESIZE_+64],lockname[_FILENAMESIZE_+72],tmpname[_FILENAMESIZE_+96];
+  unsigned long long hash;
+  unsigned char * byte;
+  static const char padding[8] = {0,0,0,0,0,0,0,0};
+  size_t index_byte;
+  FILE * cache_file;
+  double * copy;
+  int lock_fd,index_write,written;
+
+  class_test(strlen(kind) >= sizeof(header.kind),
+             errmsg,
+             "kind of table '%s' is too long",kind);
+
+  table->data = NULL;
+  table->data_size = data_size;
+  table->mapping = NULL;
+  table->mapping_size = 0;
+
+  /** - without cache directory, just build the table */
+
+  if (directory[0] == '\0') {
+    class_alloc(table->data,MAX(data_size,1)*sizeof(double),errmsg);
+    class_call((*build)(context,table->data,errmsg),
+               errmsg,
+               errmsg);
+    return _SUCCESS_;
+  }
+
+  /** - name of the file: kind and hash of the key */
+
+  memset(&header,0,sizeof(struct shared_table_header));
+  memcpy(header.magic,"CLASSTAB",8);
+  header.format_version = _SHARED_TABLE_VERSION_;
+  header.key_size = (int)key_size;
+  strcpy(header.kind,kind);
+  header.data_size = data_size;
+
+  hash = 14695981039346656037ULL;
+  byte = (unsigned char *) &header;
+  for (index_byte=0; index_byte<sizeof(struct shared_table_header); index_byte++) {
+    hash ^= byte[index_byte];
+    hash *= 1099511628211ULL;
+  }
+  byte = (unsigned char *) key;
+  for (index_byte=0; index_byte<key_size; index_byte++) {
+    hash ^= byte[index_byte];
+    hash *= 1099511628211ULL;
+  }
+  sprintf(filename,"%s/%s_%016llx.dat",directory,kind,hash);
+
+  /** - map the file if it exists */
+
+  if (shared_table_map(filename,&header,key,table) == _TRUE_)
+    return _SUCCESS_;
+
+  /** - otherwise, take the lock and check again, since another
+      process may have written the file while we were waiting */
+
+  sprintf(lockname,"%s.lock",filename);
+  lock_fd = open(lockname,O_RDWR|O_CREAT,0666);
+  if (lock_fd >= 0) {
+    if (flock(lock_fd,LOCK_EX) != 0) {
+      close(lock_fd);
+      lock_fd = -1;
+    }
+  }
+
+  if (shared_table_map(filename,&header,key,table) == _FALSE_) {
+
+    /** - build the table and write it */
+
+    table->data = (double *)malloc(MAX(data_size,1)*sizeof(double));
+    if ((table->data == NULL) || ((*build)(context,table->data,errmsg) == _FAILURE_)) {
+      if (table->data == NULL)
+        class_alloc_message(errmsg,"table->data",(int)(MAX(data_size,1)*sizeof(double)));
+      free(table->data);
+      table->data = NULL;
+      if (lock_fd >= 0) {
+        flock(lock_fd,LOCK_UN);
+        close(lock_fd);
+      }
+      return _FAILURE_;
+    }
+
+#pragma omp critical (shared_table_writes)
+    index_write = shared_table_writes++;
+
+    sprintf(tmpname,"%s.%d.%d.tmp",filename,(int)getpid(),index_write);
+    cache_file = fopen(tmpname,"wb");
+    if (cache_file != NULL) {
+      written = ((fwrite(&header,sizeof(struct shared_table_header),1,cache_file) == 1) &&
+                 (fwrite(key,1,key_size,cache_file) == key_size) &&
+                 (fwrite(padding,1,8*((key_size+7)/8)-key_size,cache_file) == 8*((key_size+7)/8)-key_size) &&
+                 (fwrite(table->data,sizeof(double),data_size,cache_file) == data_size));
+      if ((fclose(cache_file) != 0) || (written == _FALSE_) || (rename(tmpname,filename) != 0))
+        remove(tmpname);
+    }
+
+    /** - use the mapping of the new file rather than the private
+        copy, so that this process shares its pages with the others */
+
+    copy = table->data;
+    if (shared_table_map(filename,&header,key,table) == _TRUE_)
+      free(copy);
+  }
+
+  if (lock_fd >= 0) {
+    flock(lock_fd,LOCK_UN);
+    close(lock_fd);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Release a table obtained with shared_table_get()
+ *
+ * @param table Input/Output: table
+ * @return the error status
+ */
+
+int shared_table_free(
+                      struct shared_table * table
+                      ) {
+
+  if (table->mapping != NULL)
+    munmap(table->mapping,table->mapping_size);
+  else
+    free(table->data);
+
+  table->data = NULL;
+  table->mapping = NULL;
+  table->mapping_size = 0;
+
+  return _SUCCESS_;
+}
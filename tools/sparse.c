@@ -199,6 +199,7 @@ int sp_ludcmp(sp_num *N, sp_mat *A, double pivtol){
 int sp_lusolve(sp_num *N, double *b, double *x){
 	int p, j, n, *Ap, *Ai;
 	double *Ax, *w;
+	class_kernel_start(kernel_sp_lusolve);
 	n=N->n;
 	/* permute b and initialize x:*/
 	for (j=0; j<n; j++) x[N->pinv[j]] = b[j];
@@ -224,6 +225,7 @@ int sp_lusolve(sp_num *N, double *b, double *x){
 		for(j=0;j<n;j++) w[j] = x[j];
 		for(j=0; j<n; j++) x[N->q[j]] = w[j];
 	}
+	class_kernel_stop(kernel_sp_lusolve);
 	return _SUCCESS_;
 }
 
@@ -625,4 +627,65 @@ int sp_tdfs(int j, int k, int *head, const int *next, int *post, int *stack){
 	return (k);
 }
 
+int sp_ord_lookup(sp_ord **list, sp_mat *A, int *q, int *found){
+	/* Look for the sparsity pattern of A in the list. If it is there, copy the
+	   corresponding ordering to q, and move the entry to the front of the list. */
+	sp_ord *O, *prev;
+	int n, nz, i;
+	n = A->ncols; nz = A->Ap[n];
+	*found = _FALSE_;
+	for(prev=NULL, O=*list; O!=NULL; prev=O, O=O->next){
+		if ((O->n != n)||(O->nz != nz)) continue;
+		for(i=0; i<=n; i++) if (O->Ap[i] != A->Ap[i]) break;
+		if (i<=n) continue;
+		for(i=0; i<nz; i++) if (O->Ai[i] != A->Ai[i]) break;
+		if (i<nz) continue;
+		/* Pattern found: */
+		for(i=0; i<=n; i++) q[i] = O->q[i];
+		if (prev != NULL){
+			prev->next = O->next;
+			O->next = *list;
+			*list = O;
+		}
+		*found = _TRUE_;
+		break;
+	}
+	return _SUCCESS_;
+}
 
+int sp_ord_store(sp_ord **list, sp_mat *A, int *q, int max_entries, ErrorMsg error_message){
+	/* Add the pattern of A and its ordering q at the front of the list. The list is
+	   then truncated to max_entries, so the least recently used orderings go first. */
+	sp_ord *O;
+	int n, nz, i;
+	n = A->ncols; nz = A->Ap[n];
+	class_alloc(O,sizeof(sp_ord),error_message);
+	class_alloc(O->Ap,(n+1)*sizeof(int),error_message);
+	class_alloc(O->Ai,nz*sizeof(int),error_message);
+	class_alloc(O->q,(n+1)*sizeof(int),error_message);
+	O->n = n; O->nz = nz;
+	for(i=0; i<=n; i++) O->Ap[i] = A->Ap[i];
+	for(i=0; i<nz; i++) O->Ai[i] = A->Ai[i];
+	for(i=0; i<=n; i++) O->q[i] = q[i];
+	O->next = *list;
+	*list = O;
+	for(i=1; (O!=NULL)&&(i<max_entries); i++) O = O->next;
+	if (O != NULL){
+		sp_ord_free(O->next);
+		O->next = NULL;
+	}
+	return _SUCCESS_;
+}
+
+int sp_ord_free(sp_ord *list){
+	sp_ord *O;
+	while (list != NULL){
+		O = list->next;
+		free(list->Ap);
+		free(list->Ai);
+		free(list->q);
+		free(list);
+		list = O;
+	}
+	return _SUCCESS_;
+}